@@ -0,0 +1,307 @@
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <netinet/ip6.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../tools/libipv6.h"
+
+/*
+   Microbenchmarks for the hot functions of libipv6. Each benchmark is run with an increasing number of iterations
+   until it takes at least BENCH_MIN_NS, and one line is printed for it:
+
+   <name>/<parameter> <iterations> <nanoseconds per operation> ns/op
+
+   The names and parameters are stable, such that the output of two builds can be compared line by line.
+ */
+
+#define BENCH_MIN_NS 200000000ULL
+#define BENCH_MAX_PREFIXES 4096
+
+struct bench_data {
+    unsigned char packet[MIN_IPV6_HLEN + 9000];
+    size_t len;
+    struct in6_addr prefixes[BENCH_MAX_PREFIXES];
+    uint8_t lens[BENCH_MAX_PREFIXES];
+    struct prefix_entry entries[BENCH_MAX_PREFIXES];
+    struct prefix_entry *pentries[BENCH_MAX_PREFIXES];
+    struct prefix_list plist;
+    struct prefix_trie trie;
+    unsigned int nprefix;
+    struct in6_addr addrs[64];
+    char paddrs[64][INET6_ADDRSTRLEN];
+    char dnsname[MAX_DOMAIN_LEN];
+    unsigned char dnswire[MAX_DOMAIN_LEN + 2];
+    unsigned int dnswirelen;
+};
+
+void bench(const char *, unsigned long, void (*)(unsigned long));
+void bench_decode_ipv6_address(unsigned long);
+void bench_dns_decode(unsigned long);
+void bench_dns_str2wire(unsigned long);
+void bench_ether_ntop(unsigned long);
+void bench_ether_pton(unsigned long);
+void bench_in_chksum(unsigned long);
+void bench_inet_ntop(unsigned long);
+void bench_inet_pton(unsigned long);
+void bench_ipv6_ntop(unsigned long);
+void bench_ipv6_pton(unsigned long);
+void bench_is_ip6_in_prefix_list(unsigned long);
+void bench_match_ipv6(unsigned long);
+void bench_match_prefix_trie(unsigned long);
+void init_prefixes(unsigned int);
+
+static struct bench_data bd;
+
+/* Results are accumulated here, such that the compiler cannot discard the benchmarked calls */
+volatile unsigned long sink;
+
+int main(void){
+    unsigned int sizes[]= {64, 512, 1500, 9000};
+    unsigned int nprefixes[]= {1, 16, 256, BENCH_MAX_PREFIXES};
+    unsigned int i;
+
+    srandom(1);
+
+    for (i=0; i < sizeof(bd.packet); i++) {
+        bd.packet[i]= random();
+    }
+
+    for (i=0; i < 64; i++) {
+        bd.addrs[i].s6_addr32[0]= htonl(0x20010db8);
+        bd.addrs[i].s6_addr32[1]= random();
+        bd.addrs[i].s6_addr32[2]= (i % 4) ? random() : 0;
+        bd.addrs[i].s6_addr32[3]= (i % 2) ? random() : htonl(i);
+    }
+
+    /* Link-local, multicast, Teredo and IPv4-mapped addresses exercise the other branches of decode_ipv6_address() */
+    bd.addrs[1].s6_addr32[0]= htonl(0xfe800000);
+    bd.addrs[1].s6_addr32[1]= 0;
+    bd.addrs[2].s6_addr32[0]= htonl(0xff0e0000);
+    bd.addrs[3].s6_addr32[0]= htonl(0x20010000);
+    memset(&(bd.addrs[5]), 0, 10);
+    bd.addrs[5].s6_addr16[5]= 0xffff;
+
+    for (i=0; i < 64; i++) {
+        if (inet_ntop(AF_INET6, &(bd.addrs[i]), bd.paddrs[i], INET6_ADDRSTRLEN) == NULL) {
+            puts("inet_ntop(): Error converting IPv6 address to presentation format");
+            abort();
+        }
+    }
+
+    for (i=0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        bd.len= sizes[i];
+        bench("in_chksum", sizes[i], bench_in_chksum);
+    }
+
+    if (init_prefix_trie(&(bd.trie)) != SUCCESS) {
+        puts("Error while initializing the prefix trie");
+        abort();
+    }
+
+    for (i=0; i < sizeof(nprefixes) / sizeof(nprefixes[0]); i++) {
+        init_prefixes(nprefixes[i]);
+        bench("match_ipv6", nprefixes[i], bench_match_ipv6);
+        bench("is_ip6_in_prefix_list", nprefixes[i], bench_is_ip6_in_prefix_list);
+        bench("match_prefix_trie", nprefixes[i], bench_match_prefix_trie);
+    }
+
+    bench("decode_ipv6_address", 64, bench_decode_ipv6_address);
+
+    strncpy(bd.dnsname, "www.ipv6.example-domain.com", sizeof(bd.dnsname) - 1);
+    bd.dnswirelen= dns_str2wire(bd.dnsname, strlen(bd.dnsname), (char *)bd.dnswire, sizeof(bd.dnswire));
+    if (bd.dnswirelen != strlen(bd.dnsname) + 2) {
+        puts("Error while encoding the domain name");
+        abort();
+    }
+    bench("dns_str2wire", strlen(bd.dnsname), bench_dns_str2wire);
+    bench("dns_decode", strlen(bd.dnsname), bench_dns_decode);
+
+    bench("ether_pton", 4, bench_ether_pton);
+    bench("ether_ntop", 64, bench_ether_ntop);
+    bench("inet_pton", 64, bench_inet_pton);
+    bench("ipv6_pton", 64, bench_ipv6_pton);
+    bench("inet_ntop", 64, bench_inet_ntop);
+    bench("ipv6_ntop", 64, bench_ipv6_ntop);
+
+    exit(EXIT_SUCCESS);
+}
+
+/*
+ * Runs a benchmark with an increasing number of iterations, until it takes at least BENCH_MIN_NS, and prints the
+ * resulting time per operation. "param" is the size of the input (bytes, prefixes or distinct addresses).
+ */
+
+void bench(const char *name, unsigned long param, void (*fn)(unsigned long)){
+    struct timespec start, end;
+    unsigned long long elapsed;
+    unsigned long n= 1;
+
+    while (1) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        fn(n);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        elapsed= (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+
+        if (elapsed >= BENCH_MIN_NS)
+            break;
+
+        /* Aim at 1.5 times the minimum duration, but do not grow more than 100 times per round */
+        if (elapsed == 0 || (BENCH_MIN_NS * 3 / 2 * n) / elapsed > n * 100)
+            n*= 100;
+        else
+            n= (BENCH_MIN_NS * 3 / 2 * n) / elapsed + 1;
+    }
+
+    printf("%s/%lu %lu %.2f ns/op\n", name, param, n, (double)elapsed / n);
+    fflush(stdout);
+}
+
+/*
+ * Fills the prefix list, the prefix trie and the arrays of match_ipv6() with "nprefix" /48 prefixes. None of them
+ * contains the benchmarked addresses, such that all of them are checked by the linear searches.
+ */
+
+void init_prefixes(unsigned int nprefix){
+    unsigned int i;
+
+    for (i=bd.nprefix; i < nprefix; i++) {
+        bd.prefixes[i].s6_addr32[0]= htonl(0x20010db9);
+        bd.prefixes[i].s6_addr32[1]= random() & htonl(0xffff0000);
+        bd.prefixes[i].s6_addr32[2]= 0;
+        bd.prefixes[i].s6_addr32[3]= 0;
+        bd.lens[i]= 48;
+        bd.entries[i].ip6= bd.prefixes[i];
+        bd.entries[i].len= 48;
+        bd.pentries[i]= &(bd.entries[i]);
+        if (add_to_prefix_trie(&(bd.trie), &(bd.prefixes[i]), 48) != SUCCESS) {
+            puts("Error while adding a prefix to the prefix trie");
+            abort();
+        }
+    }
+
+    bd.nprefix= nprefix;
+    bd.plist.prefix= bd.pentries;
+    bd.plist.nprefix= nprefix;
+    bd.plist.maxprefix= BENCH_MAX_PREFIXES;
+}
+
+void bench_in_chksum(unsigned long n){
+    unsigned long i;
+
+    for (i=0; i < n; i++) {
+        sink+= in_chksum(bd.packet, bd.packet + MIN_IPV6_HLEN, bd.len, IPPROTO_UDP);
+    }
+}
+
+void bench_match_ipv6(unsigned long n){
+    unsigned long i;
+
+    for (i=0; i < n; i++) {
+        sink+= match_ipv6(bd.prefixes, bd.lens, bd.nprefix, &(bd.addrs[i % 64]));
+    }
+}
+
+void bench_is_ip6_in_prefix_list(unsigned long n){
+    unsigned long i;
+
+    for (i=0; i < n; i++) {
+        sink+= is_ip6_in_prefix_list(&(bd.addrs[i % 64]), &(bd.plist));
+    }
+}
+
+void bench_match_prefix_trie(unsigned long n){
+    unsigned long i;
+
+    for (i=0; i < n; i++) {
+        sink+= match_prefix_trie(&(bd.trie), &(bd.addrs[i % 64]));
+    }
+}
+
+void bench_decode_ipv6_address(unsigned long n){
+    struct decode6 decode;
+    unsigned long i;
+
+    for (i=0; i < n; i++) {
+        decode.ip6= bd.addrs[i % 64];
+        decode_ipv6_address(&decode);
+        sink+= decode.type + decode.iidtype;
+    }
+}
+
+void bench_dns_str2wire(unsigned long n){
+    char wire[MAX_DOMAIN_LEN + 2];
+    unsigned long i;
+
+    for (i=0; i < n; i++) {
+        sink+= dns_str2wire(bd.dnsname, strlen(bd.dnsname), wire, sizeof(wire));
+    }
+}
+
+void bench_dns_decode(unsigned long n){
+    char name[MAX_DOMAIN_LEN + 1];
+    unsigned char *next;
+    unsigned long i;
+
+    for (i=0; i < n; i++) {
+        sink+= dns_decode(bd.dnswire, bd.dnswirelen, bd.dnswire, name, sizeof(name), &next);
+    }
+}
+
+void bench_ether_pton(unsigned long n){
+    const char *ethers[]= {"00:11:22:33:44:55", "aa:bb:cc:dd:ee:ff", "1:2:3:4:5:6", "de:ad:be:ef:0:1"};
+    struct ether_addr ether;
+    unsigned long i;
+
+    for (i=0; i < n; i++) {
+        sink+= ether_pton(ethers[i % 4], &ether, sizeof(ether));
+    }
+}
+
+void bench_ether_ntop(unsigned long n){
+    char pether[ETHER_ADDR_PLEN];
+    unsigned long i;
+
+    for (i=0; i < n; i++) {
+        sink+= ether_ntop((struct ether_addr *)&(bd.addrs[i % 64]), pether, sizeof(pether));
+    }
+}
+
+void bench_inet_pton(unsigned long n){
+    struct in6_addr addr;
+    unsigned long i;
+
+    for (i=0; i < n; i++) {
+        sink+= inet_pton(AF_INET6, bd.paddrs[i % 64], &addr);
+    }
+}
+
+void bench_ipv6_pton(unsigned long n){
+    struct in6_addr addr;
+    unsigned long i;
+
+    for (i=0; i < n; i++) {
+        sink+= ipv6_pton(bd.paddrs[i % 64], &addr);
+    }
+}
+
+void bench_inet_ntop(unsigned long n){
+    char paddr[INET6_ADDRSTRLEN];
+    unsigned long i;
+
+    for (i=0; i < n; i++) {
+        sink+= (inet_ntop(AF_INET6, &(bd.addrs[i % 64]), paddr, sizeof(paddr)) != NULL);
+    }
+}
+
+void bench_ipv6_ntop(unsigned long n){
+    char paddr[INET6_ADDRSTRLEN];
+    unsigned long i;
+
+    for (i=0; i < n; i++) {
+        sink+= ipv6_ntop(&(bd.addrs[i % 64]), paddr);
+    }
+}
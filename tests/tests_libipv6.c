@@ -1,19 +1,164 @@
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <netinet/ip6.h>
+#include <arpa/inet.h>
 #include <assert.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/rtnetlink.h>
+#endif
 #include "../tools/libipv6.h"
 
+void test_arena(void);
+void test_dissect_packet(void);
 void test_ether_ntop(void);
 void test_ether_pton(void);
+void test_event_loop(void);
+void test_filters_to_bpf(void);
+void test_in_chksum(void);
+void test_iface_set(void);
+void test_ipv6_ntop(void);
+void test_ipv6_pton(void);
 void test_is_service_port(void);
+void test_lookup_route_table(void);
+void test_metrics(void);
+void test_neighbor_cache(void);
+void test_packet_template(void);
+void test_prefix_trie(void);
+void test_prng(void);
+void test_route_table(void);
+void test_siphash24(void);
+void write_savefile(const char *, unsigned char, unsigned int);
 
 int main(void){
+    test_arena();
+    test_dissect_packet();
     test_ether_ntop();
     test_ether_pton();
+    test_event_loop();
+    test_filters_to_bpf();
+    test_in_chksum();
+    test_iface_set();
+    test_ipv6_ntop();
+    test_ipv6_pton();
     test_is_service_port();
+    test_lookup_route_table();
+    test_metrics();
+    test_neighbor_cache();
+    test_packet_template();
+    test_prefix_trie();
+    test_prng();
+    test_route_table();
+    test_siphash24();
     exit(EXIT_SUCCESS);
 }
 
+void test_arena(void){
+    struct arena arena;
+    struct prefix_entry *p1, *p2;
+    unsigned char *big;
+
+    memset(&arena, 0, sizeof(arena));
+
+    p1= arena_alloc(&arena, sizeof(struct prefix_entry));
+    p2= arena_alloc(&arena, sizeof(struct prefix_entry));
+    assert(p1 != NULL && p2 != NULL);
+
+    /* Consecutive entries are adjacent (and aligned) */
+    assert((unsigned char *)p2 - (unsigned char *)p1 ==
+           ((sizeof(struct prefix_entry) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1)));
+    assert(((uintptr_t)p2 % ARENA_ALIGN) == 0);
+
+    /* Allocations larger than a block get a block of their own */
+    big= arena_alloc(&arena, ARENA_BLOCK_SIZE * 2);
+    assert(big != NULL);
+    memset(big, 0xff, ARENA_BLOCK_SIZE * 2);
+
+    free_arena(&arena);
+    assert(arena.block == NULL);
+    return;
+}
+
+void test_dissect_packet(void){
+    static struct iface_data idata;
+    unsigned char frame[ETHER_HDR_LEN + MIN_IPV6_HLEN + 8 + 8 + sizeof(struct tcp_hdr) + 4];
+    struct pcap_pkthdr pkthdr;
+    struct packet_view view;
+    struct ether_header *ether;
+    struct ip6_hdr *ipv6;
+    struct ip6_frag *frag;
+    struct tcp_hdr *tcp;
+    unsigned char *hbh;
+    uint16_t cksum;
+
+    memset(&idata, 0, sizeof(idata));
+    idata.type= DLT_EN10MB;
+    idata.linkhsize= ETHER_HDR_LEN;
+
+    /* Ethernet, IPv6, Hop-by-Hop Options, Fragment Header (atomic fragment), TCP */
+    memset(frame, 0, sizeof(frame));
+    ether= (struct ether_header *)frame;
+    ether->ether_type= htons(ETHERTYPE_IPV6);
+    ipv6= (struct ip6_hdr *)(frame + ETHER_HDR_LEN);
+    ipv6->ip6_vfc= 0x60;
+    ipv6->ip6_plen= htons(sizeof(frame) - ETHER_HDR_LEN - MIN_IPV6_HLEN);
+    ipv6->ip6_nxt= IPPROTO_HOPOPTS;
+    assert(inet_pton(AF_INET6, "2001:db8::1", &(ipv6->ip6_src)) == 1);
+    assert(inet_pton(AF_INET6, "2001:db8::2", &(ipv6->ip6_dst)) == 1);
+    hbh= (unsigned char *)ipv6 + MIN_IPV6_HLEN;
+    hbh[0]= IPPROTO_FRAGMENT;
+    hbh[2]= 0x01; /* PadN */
+    hbh[3]= 4;
+    frag= (struct ip6_frag *)(hbh + 8);
+    frag->ip6f_nxt= IPPROTO_TCP;
+    tcp= (struct tcp_hdr *)((unsigned char *)frag + 8);
+    tcp->th_sport= htons(80);
+    tcp->th_off= sizeof(struct tcp_hdr) >> 2;
+
+    pkthdr.caplen= sizeof(frame);
+    pkthdr.len= sizeof(frame);
+
+    assert(dissect_packet(&idata, frame, &pkthdr, &view, 0) == SUCCESS);
+    assert(view.ipv6 == ipv6 && view.frag == frag && view.upper == (unsigned char *)tcp);
+    assert(view.proto == IPPROTO_TCP && view.nexthdrs == 2);
+    assert(view.upperlen == sizeof(struct tcp_hdr) + 4);
+    assert((view.flags & (PV_EXTHDRS | PV_FRAGMENT)) == (PV_EXTHDRS | PV_FRAGMENT));
+    assert(!(view.flags & (PV_LATER_FRAGMENT | PV_TRUNCATED | PV_CKSUM_OK)));
+
+    /* Without the Fragment Header, the checksum can be verified */
+    hbh[0]= IPPROTO_TCP;
+    memmove(frag, tcp, sizeof(struct tcp_hdr) + 4);
+    tcp= (struct tcp_hdr *)frag;
+    ipv6->ip6_plen= htons(ntohs(ipv6->ip6_plen) - 8);
+    pkthdr.caplen-= 8;
+    pkthdr.len-= 8;
+    tcp->th_sum= 0;
+    cksum= in_chksum(ipv6, tcp, sizeof(struct tcp_hdr) + 4, IPPROTO_TCP);
+    tcp->th_sum= cksum;
+
+    assert(dissect_packet(&idata, frame, &pkthdr, &view, DISSECT_CKSUM) == SUCCESS);
+    assert(view.upper == (unsigned char *)tcp && view.nexthdrs == 1 && (view.flags & PV_CKSUM_OK));
+
+    tcp->th_sum= cksum ^ 0x0100;
+    assert(dissect_packet(&idata, frame, &pkthdr, &view, DISSECT_CKSUM) == FAILURE);
+    tcp->th_sum= cksum;
+
+    /* Truncated headers, and packets that are not IPv6 */
+    pkthdr.caplen= ETHER_HDR_LEN + MIN_IPV6_HLEN + 4;
+    assert(dissect_packet(&idata, frame, &pkthdr, &view, 0) == FAILURE);
+    pkthdr.caplen= ETHER_HDR_LEN + MIN_IPV6_HLEN + 8 + 10;
+    assert(dissect_packet(&idata, frame, &pkthdr, &view, 0) == FAILURE);
+    pkthdr.caplen= pkthdr.len;
+
+    ether->ether_type= htons(0x0800);
+    assert(dissect_packet(&idata, frame, &pkthdr, &view, 0) == FAILURE);
+    return;
+}
+
 void test_ether_ntop(void){
     struct ether_addr ether;
     unsigned int i;
@@ -45,8 +190,685 @@ void test_ether_pton(void){
     return;
 }
 
+void test_event_loop(void){
+    struct event_loop loop;
+    unsigned int id;
+
+    assert(init_event_loop(&loop, -1, 3) == SUCCESS);
+
+    /* Nothing to wait for */
+    assert(wait_event_loop(&loop) == FAILURE);
+
+    set_event_timer(&loop, 0, 50000);
+    set_event_timer(&loop, 1, 2000);
+    set_event_timer(&loop, 2, 1000);
+    cancel_event_timer(&loop, 2);
+    assert(expired_event_timer(&loop, &id) == FALSE);
+
+    /* The earliest armed timer fires first, and only once */
+    assert(wait_event_loop(&loop) == SUCCESS);
+    assert(expired_event_timer(&loop, &id) == TRUE && id == 1);
+    assert(expired_event_timer(&loop, &id) == FALSE);
+
+    assert(wait_event_loop(&loop) == SUCCESS);
+    assert(expired_event_timer(&loop, &id) == TRUE && id == 0);
+    assert(wait_event_loop(&loop) == FAILURE);
+
+    free_event_loop(&loop);
+    return;
+}
+
+void test_filters_to_bpf(void){
+    struct iface_data idata;
+    struct filters filters;
+    char expr[512];
+
+    memset(&idata, 0, sizeof(idata));
+    idata.type= DLT_EN10MB;
+    assert(init_filters(&filters) == 0);
+
+    /* Without filters, the base filter is left alone */
+    assert(filters_to_bpf(&idata, &filters, "ip6", expr, sizeof(expr)) == 0);
+    assert(strcmp(expr, "(ip6)") == 0);
+
+    assert(inet_pton(AF_INET6, "2001:db8::", &(filters.blocksrc[0])) == 1);
+    filters.blocksrclen[0]= 32;
+    filters.nblocksrc= 1;
+    assert(ether_pton("00:11:22:33:44:55", &(filters.blocklinkdst[0]), sizeof(struct ether_addr)) == 1);
+    filters.nblocklinkdst= 1;
+    assert(inet_pton(AF_INET6, "fe80::1", &(filters.acceptdst[0])) == 1);
+    filters.acceptdstlen[0]= 128;
+    filters.nacceptdst= 1;
+    filters.acceptfilters_f= TRUE;
+
+    assert(filters_to_bpf(&idata, &filters, "ip6", expr, sizeof(expr)) == 3);
+    assert(strcmp(expr, "(ip6) and not (ip6 src net 2001:db8::/32 or ether dst 00:11:22:33:44:55) and "
+                        "(ip6 dst net fe80::1/128)") == 0);
+
+    /* Link-layer filters only apply to Ethernet */
+    idata.type= DLT_RAW;
+    assert(filters_to_bpf(&idata, &filters, "ip6", expr, sizeof(expr)) == 2);
+    assert(strcmp(expr, "(ip6) and not (ip6 src net 2001:db8::/32) and (ip6 dst net fe80::1/128)") == 0);
+
+    /* Accept filters that cannot be expressed leave all the accept filters to user space */
+    filters.naccepttarget= 1;
+    assert(filters_to_bpf(&idata, &filters, "ip6", expr, sizeof(expr)) == 1);
+    assert(strcmp(expr, "(ip6) and not (ip6 src net 2001:db8::/32)") == 0);
+
+    assert(filters_to_bpf(&idata, &filters, "ip6", expr, 20) == -1);
+    return;
+}
+
+void test_in_chksum(void){
+    unsigned char buffer[MIN_IPV6_HLEN + 101 + 1];
+    struct ip6_hdr *ipv6;
+    unsigned char *data;
+    struct in6_addr addr;
+    uint32_t sum;
+    uint16_t cksum, word;
+    unsigned int i, len;
+
+    for (i=0; i < sizeof(buffer); i++) {
+        buffer[i]= (i * 37 + 11) & 0xff;
+    }
+
+    /* Compare against a straightforward sum of 16-bit words (at an odd alignment, and with odd lengths) */
+    ipv6= (struct ip6_hdr *)(buffer + 1);
+    data= (unsigned char *)ipv6 + MIN_IPV6_HLEN;
+
+    for (len=0; len <= 101; len++) {
+        sum= htons(len) + htons(IPPROTO_UDP);
+
+        for (i=0; i < sizeof(struct in6_addr) * 2; i+=2) {
+            memcpy(&word, (unsigned char *)&(ipv6->ip6_src) + i, 2);
+            sum+= word;
+        }
+
+        for (i=0; i + 1 < len; i+=2) {
+            memcpy(&word, data + i, 2);
+            sum+= word;
+        }
+
+        if (len % 2) {
+            word= 0;
+            *(unsigned char *)&word= data[len - 1];
+            sum+= word;
+        }
+
+        sum= (sum >> 16) + (sum & 0xffff);
+        sum+= (sum >> 16);
+        assert(in_chksum(ipv6, data, len, IPPROTO_UDP) == (uint16_t)~sum);
+    }
+
+    /* Patching the checksum must produce the same result as computing it again */
+    cksum= in_chksum(ipv6, data, 100, IPPROTO_UDP);
+    memset(&addr, 0xa5, sizeof(addr));
+    cksum= in_chksum_update(cksum, &(ipv6->ip6_src), &addr, sizeof(addr));
+    ipv6->ip6_src= addr;
+    assert(cksum == in_chksum(ipv6, data, 100, IPPROTO_UDP));
+
+    memcpy(&word, data + 2, 2);
+    cksum= in_chksum_update(cksum, &word, "\x12\x34", 2);
+    memcpy(data + 2, "\x12\x34", 2);
+    assert(cksum == in_chksum(ipv6, data, 100, IPPROTO_UDP));
+
+    /* A packet with a correct checksum sums to zero */
+    memset(data + 6, 0, 2);
+    cksum= in_chksum(ipv6, data, 100, IPPROTO_UDP);
+    memcpy(data + 6, &cksum, 2);
+    assert(in_chksum(ipv6, data, 100, IPPROTO_UDP) == 0);
+    return;
+}
+
+void test_iface_set(void){
+    char path[2][sizeof("/tmp/tests_libipv6.XXXXXX")]= {"/tmp/tests_libipv6.XXXXXX", "/tmp/tests_libipv6.XXXXXX"};
+    char errbuf[PCAP_ERRBUF_SIZE];
+    static struct iface_data iface[MAX_IFACE_SET + 1];
+    struct iface_set set;
+    struct iface_data *idata;
+    struct pcap_pkthdr *pkthdr;
+    const u_char *pktdata;
+    struct timeval timeout;
+    unsigned int i;
+    int fd;
+
+    for (i=0; i < 2; i++) {
+        assert((fd= mkstemp(path[i])) != -1);
+        close(fd);
+    }
+
+    /* Three frames are available on the first interface, and only one on the second */
+    write_savefile(path[0], 0, 3);
+    write_savefile(path[1], 1, 1);
+
+    memset(&set, 0, sizeof(set));
+
+    for (i=0; i < 2; i++) {
+        memset(&(iface[i]), 0, sizeof(struct iface_data));
+        assert((iface[i].pfd= pcap_open_offline(path[i], errbuf)) != NULL);
+        iface[i].fd= -1;
+    }
+
+    /* Output is only tagged with the interface name once there is more than one */
+    assert(add_iface_set(&set, &(iface[0])) == SUCCESS);
+    assert(iface[0].ifset_f == FALSE);
+    assert(add_iface_set(&set, &(iface[1])) == SUCCESS);
+    assert(iface[0].ifset_f == TRUE && iface[1].ifset_f == TRUE);
+
+    /* Without descriptors to wait on, only the timeout ends the wait */
+    timeout.tv_sec= 0;
+    timeout.tv_usec= 1000;
+    assert(wait_iface_set(&set, &timeout) == 0);
+
+    /* The interfaces take turns, such that the busy one cannot starve the other */
+    assert(read_iface_set(&set, &idata, &pkthdr, &pktdata) == 1);
+    assert(idata == &(iface[0]) && pktdata[0] == 0 && pktdata[1] == 0);
+    assert(read_iface_set(&set, &idata, &pkthdr, &pktdata) == 1);
+    assert(idata == &(iface[1]) && pktdata[0] == 1 && pktdata[1] == 0);
+    assert(read_iface_set(&set, &idata, &pkthdr, &pktdata) == 1);
+    assert(idata == &(iface[0]) && pktdata[0] == 0 && pktdata[1] == 1);
+
+    /* The end of a savefile ends the reads (see open_rx_replay()) */
+    assert(read_iface_set(&set, &idata, &pkthdr, &pktdata) == PCAP_ERROR_BREAK);
+    assert(idata == &(iface[1]));
+
+    for (i=2; i < MAX_IFACE_SET; i++)
+        assert(add_iface_set(&set, &(iface[i])) == SUCCESS);
+
+    assert(add_iface_set(&set, &(iface[MAX_IFACE_SET])) == FAILURE);
+
+    for (i=0; i < 2; i++) {
+        pcap_close(iface[i].pfd);
+        unlink(path[i]);
+    }
+
+    free_event_loop(&(set.loop));
+    return;
+}
+
+void test_ipv6_ntop(void){
+    const char *addrs[]= {"::", "::1", "1::", "2001:db8::1", "2001:db8:0:1:1:1:1:1", "2001:0:0:1::1",
+                          "fe80::1:0:0:1", "::ffff:192.0.2.1", "::192.0.2.1", "::1:0:0:0:1", "ff02::1:ff00:1"};
+    struct in6_addr addr, list[2];
+    char pv6addr[INET6_ADDRSTRLEN], libcaddr[INET6_ADDRSTRLEN], buf[2 * INET6_ADDRSTRLEN];
+    size_t len;
+    unsigned int i;
+
+    for (i=0; i < sizeof(addrs)/sizeof(addrs[0]); i++) {
+        assert(inet_pton(AF_INET6, addrs[i], &addr) == 1);
+        assert(inet_ntop(AF_INET6, &addr, libcaddr, sizeof(libcaddr)) != NULL);
+        assert(ipv6_ntop(&addr, pv6addr) == strlen(libcaddr));
+        assert(strcmp(pv6addr, libcaddr) == 0);
+    }
+
+    assert(inet_pton(AF_INET6, "2001:db8::1", &list[0]) == 1);
+    assert(inet_pton(AF_INET6, "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff", &list[1]) == 1);
+    assert(ipv6_ntop_batch(list, 2, buf, sizeof(buf), &len) == 2);
+    assert(len == 52 && memcmp(buf, "2001:db8::1\nffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff\n", len) == 0);
+
+    /* Only the addresses that are guaranteed to fit are formatted */
+    assert(ipv6_ntop_batch(list, 2, buf, INET6_ADDRSTRLEN + 1, &len) == 1);
+    assert(len == 12);
+    return;
+}
+
+void test_ipv6_pton(void){
+    const char *addrs[]= {"::", "::1", "1::", "2001:DB8::1", "2001:db8:0:0:1:0:0:1", "::ffff:192.0.2.1",
+                          "1:2:3:4:5:6:1.2.3.4", "", ":", ":::", "1::2::3", "1:2:3:4:5:6:7:8:9", "12345::",
+                          "1:", ":1", "::1.2.3", "::1.2.3.04", "::256.1.1.1", "1:2:3:4:5:6:7:1.2.3.4", "::g",
+                          "1:2:3:4:5:6:7:8::", "::1:2:3:4:5:6:7:8"};
+    struct in6_addr addr, libcaddr;
+    unsigned int i;
+    int r;
+
+    for (i=0; i < sizeof(addrs)/sizeof(addrs[0]); i++) {
+        r= inet_pton(AF_INET6, addrs[i], &libcaddr);
+        assert(ipv6_pton(addrs[i], &addr) == r);
+
+        if (r == 1)
+            assert(memcmp(&addr, &libcaddr, sizeof(addr)) == 0);
+    }
+
+    return;
+}
+
 void test_is_service_port(void){
     assert(is_service_port(443));
     assert(is_service_port(1000) == FALSE);
     return;
 }
+
+void test_lookup_route_table(void){
+#ifdef __linux__
+    struct iface_data idata;
+    struct route_entry *first, *second;
+    struct in6_addr addr;
+
+    memset(&idata, 0, sizeof(idata));
+    assert(inet_pton(AF_INET6, "::1", &addr) == 1);
+
+    /* Nothing is looked up until the snapshot has been loaded */
+    assert(lookup_route_table(&idata, &addr) == NULL);
+
+    /* The snapshot is loaded once, so both lookups return the same entry (or NULL, if it cannot be cached) */
+    if (load_route_table(&idata) == FAILURE)
+        assert(load_route_table(&idata) == FAILURE);
+
+    first= lookup_route_table(&idata, &addr);
+    second= lookup_route_table(&idata, &addr);
+    assert(first == second);
+
+    if (first != NULL)
+        assert(first->local_f && first->type == RTN_LOCAL);
+#endif
+    return;
+}
+
+void test_metrics(void){
+    static struct iface_data idata;
+    struct metrics m, total, reports[2];
+    int pipefd[2];
+    struct timeval sent, received;
+    char json[2048];
+    FILE *fp;
+    size_t len;
+
+    memset(&m, 0, sizeof(m));
+    m.tool= "tests";
+    assert(attach_metrics(&m, &idata) == SUCCESS);
+    assert(idata.metrics == &m);
+
+    report_filter_result(&idata, NULL, ACCEPTED);
+    report_filter_result(&idata, NULL, BLOCKED);
+    report_filter_result(&idata, NULL, BLOCKED);
+    assert(m.accepted == 1 && m.filtered == 2);
+
+    /* 1.5 ms falls in the [1024, 2048) microseconds bucket */
+    sent.tv_sec= 100;
+    sent.tv_usec= 999000;
+    received.tv_sec= 101;
+    received.tv_usec= 500;
+    record_latency(&m, &sent, &received);
+    assert(m.nlatency == 1 && m.latency[11] == 1);
+
+    /* Responses timestamped before their probes (e.g. replayed savefiles) go to the first bucket */
+    record_latency(&m, &received, &sent);
+    assert(m.nlatency == 2 && m.latency[0] == 1);
+    assert(m.latencymax > 1.49 && m.latencymax < 1.51);
+
+    idata.write_errors= 3;
+    m.txpackets= 10;
+
+    assert((fp= tmpfile()) != NULL);
+    print_metrics_json(&m, fp);
+    rewind(fp);
+    len= fread(json, 1, sizeof(json) - 1, fp);
+    json[len]= 0;
+    fclose(fp);
+
+    assert(strstr(json, "\"tool\": \"tests\"") != NULL);
+    assert(strstr(json, "\"packets\": 10,") != NULL);
+    assert(strstr(json, "\"errors\": 3}") != NULL);
+    assert(strstr(json, "\"filter\": {\"accepted\": 1, \"filtered\": 2}") != NULL);
+    assert(strstr(json, "[2048, 1]") != NULL);
+    assert(json[len - 2] == '}' && json[len - 1] == '\n');
+
+    /* A worker reports its metrics (inject errors included) through a pipe, and the parent adds them up */
+    assert(pipe(pipefd) == 0);
+    redirect_metrics(&m, pipefd[1], 1);
+    m.interval= 1;
+    m.next= 0;
+    check_metrics(&m);
+    assert(read(pipefd[0], &reports[1], sizeof(reports[1])) == sizeof(reports[1]));
+    assert(reports[1].reporter == 1 && reports[1].errors == 3);
+    close(pipefd[0]);
+    close(pipefd[1]);
+
+    memset(&reports[0], 0, sizeof(reports[0]));
+    reports[0].txpackets= 5;
+    reports[0].errors= 1;
+    reports[0].latency[3]= 1;
+    reports[0].nlatency= 1;
+    reports[0].latencymax= 3.0;
+
+    memset(&total, 0, sizeof(total));
+    total.txpackets= 1000;
+    sum_metrics(&total, reports, 2);
+    assert(total.txpackets == 15 && total.errors == 4 && total.accepted == 1 && total.filtered == 2);
+    assert(total.nlatency == 3 && total.latency[3] == 1 && total.latency[11] == 1 && total.latencymax == 3.0);
+    return;
+}
+
+void test_neighbor_cache(void){
+    char path[]= "/tmp/tests_libipv6.XXXXXX";
+    struct iface_data idata;
+    struct in6_addr addr, expired, other;
+    struct ether_addr ether1, ether2, ether;
+    unsigned int i;
+    int fd;
+
+    assert((fd= mkstemp(path)) != -1);
+    close(fd);
+
+    memset(&idata, 0, sizeof(idata));
+    strncpy(idata.iface, "eth0", IFACE_LENGTH - 1);
+    assert(inet_pton(AF_INET6, "fe80::1", &addr) == 1);
+    assert(inet_pton(AF_INET6, "fe80::2", &expired) == 1);
+    assert(ether_pton("00:11:22:33:44:55", &ether1, sizeof(ether1)) == TRUE);
+    assert(ether_pton("66:77:88:99:aa:bb", &ether2, sizeof(ether2)) == TRUE);
+
+    assert(open_neighbor_cache(path, 300) == SUCCESS);
+    assert(lookup_neighbor_cache(&idata, &addr, &ether) == FALSE);
+    assert(update_neighbor_cache(&idata, &addr, &ether1, FALSE) == SUCCESS);
+    assert(lookup_neighbor_cache(&idata, &addr, &ether) == TRUE);
+    assert(memcmp(&ether, &ether1, sizeof(ether)) == 0);
+
+    /* An existing entry is updated, but not with an entry that expires earlier */
+    assert(update_neighbor_cache(&idata, &addr, &ether2, FALSE) == SUCCESS);
+    assert(lookup_neighbor_cache(&idata, &addr, &ether) == TRUE);
+    assert(memcmp(&ether, &ether2, sizeof(ether)) == 0);
+    assert(add_neighbor_cache_entry("eth0", &addr, &ether1, time(NULL) + 10, FALSE) == SUCCESS);
+    assert(lookup_neighbor_cache(&idata, &addr, &ether) == TRUE);
+    assert(memcmp(&ether, &ether2, sizeof(ether)) == 0);
+
+    /* Entries belong to an interface */
+    assert(add_neighbor_cache_entry("eth1", &addr, &ether1, time(NULL) + 300, FALSE) == SUCCESS);
+    assert(lookup_neighbor_cache(&idata, &addr, &ether) == TRUE);
+    assert(memcmp(&ether, &ether2, sizeof(ether)) == 0);
+
+    /* Expired entries are neither returned nor saved */
+    assert(add_neighbor_cache_entry("eth0", &expired, &ether1, time(NULL) - 1, FALSE) == SUCCESS);
+    assert(lookup_neighbor_cache(&idata, &expired, &ether) == FALSE);
+
+    /* Enough entries to grow the entries and the hash table */
+    other= addr;
+
+    for (i=0; i < NCACHE_INIT_ENTRIES * 4; i++) {
+        other.s6_addr16[4]= htons(i + 1);
+        assert(update_neighbor_cache(&idata, &other, &ether1, FALSE) == SUCCESS);
+    }
+
+    save_neighbor_cache();
+    close_neighbor_cache();
+
+    /* Round trip through the file */
+    assert(open_neighbor_cache(path, 300) == SUCCESS);
+    assert(lookup_neighbor_cache(&idata, &addr, &ether) == TRUE);
+    assert(memcmp(&ether, &ether2, sizeof(ether)) == 0);
+    assert(lookup_neighbor_cache(&idata, &expired, &ether) == FALSE);
+
+    for (i=0; i < NCACHE_INIT_ENTRIES * 4; i++) {
+        other.s6_addr16[4]= htons(i + 1);
+        assert(lookup_neighbor_cache(&idata, &other, &ether) == TRUE);
+        assert(memcmp(&ether, &ether1, sizeof(ether)) == 0);
+    }
+
+    strncpy(idata.iface, "eth1", IFACE_LENGTH - 1);
+    assert(lookup_neighbor_cache(&idata, &addr, &ether) == TRUE);
+    assert(memcmp(&ether, &ether1, sizeof(ether)) == 0);
+
+    close_neighbor_cache();
+    unlink(path);
+    return;
+}
+
+void test_packet_template(void){
+    static struct packet_template tmpl;
+    unsigned char frame[ETHER_HDR_LEN + MIN_IPV6_HLEN + 8 + 21];
+    struct ip6_hdr *ipv6;
+    struct prefix_entry prefix;
+    struct port_prefix port;
+    struct in6_addr src;
+    unsigned char *udp;
+    uint16_t cksum;
+    unsigned int i;
+
+    for (i=0; i < sizeof(frame); i++) {
+        frame[i]= (i * 37 + 11) & 0xff;
+    }
+
+    ipv6= (struct ip6_hdr *)(frame + ETHER_HDR_LEN);
+    udp= frame + ETHER_HDR_LEN + MIN_IPV6_HLEN;
+    memset(udp + 6, 0, 2);
+    cksum= in_chksum(ipv6, udp, sizeof(frame) - (udp - frame), IPPROTO_UDP);
+    memcpy(udp + 6, &cksum, 2);
+
+    assert(inet_pton(AF_INET6, "2001:db8::", &(prefix.ip6)) == 1);
+    prefix.len= 64;
+    port.port= 1024;
+    port.len= 6;
+
+    assert(init_packet_template(&tmpl, frame, sizeof(frame), (udp + 6) - frame) == SUCCESS);
+    assert(add_template_field(&tmpl, udp - frame, 2, template_random_port, &port, 1, TRUE) == SUCCESS);
+    assert(add_template_field(&tmpl, 9, 16, template_random_ipv6_addr, &prefix, 3, TRUE) == FAILURE);
+    assert(add_template_field(&tmpl, (unsigned char *)&(ipv6->ip6_src) - frame, sizeof(struct in6_addr),
+                              template_random_ipv6_addr, &prefix, 3, TRUE) == SUCCESS);
+    assert(add_template_field(&tmpl, 6, 6, template_random_bytes, NULL, 3, FALSE) == SUCCESS);
+
+    /* The patched checksum must match the one computed over the whole packet */
+    for (i=1; i <= 100; i++) {
+        memcpy(&src, tmpl.frame + ETHER_HDR_LEN + offsetof(struct ip6_hdr, ip6_src), sizeof(src));
+        assert(next_template_frame(&tmpl) == sizeof(frame));
+
+        ipv6= (struct ip6_hdr *)(tmpl.frame + ETHER_HDR_LEN);
+        udp= tmpl.frame + ETHER_HDR_LEN + MIN_IPV6_HLEN;
+        assert(in_chksum(ipv6, udp, sizeof(frame) - (udp - tmpl.frame), IPPROTO_UDP) == 0);
+        assert(((udp[0] << 8 | udp[1]) & 0xfc00) == 1024);
+
+        /* The IPv6 Source Address only changes every third frame */
+        if (i % 3)
+            assert(memcmp(&src, &(ipv6->ip6_src), sizeof(src)) == 0);
+        else
+            assert(memcmp(&(ipv6->ip6_src), &(prefix.ip6), 8) == 0);
+
+        assert(memcmp(tmpl.frame + ETHER_HDR_LEN + MIN_IPV6_HLEN + 8, frame + ETHER_HDR_LEN + MIN_IPV6_HLEN + 8,
+                      21) == 0);
+    }
+
+    return;
+}
+
+void test_prefix_trie(void){
+    struct prefix_trie trie;
+    struct in6_addr prefixes[200], addr;
+    uint8_t lens[200];
+    unsigned int i, j;
+
+    assert(init_prefix_trie(&trie) == SUCCESS);
+    memset(&addr, 0, sizeof(addr));
+    assert(match_prefix_trie(&trie, &addr) == FALSE);
+
+    /* Prefixes of all lengths, most of them sharing the first 16 bits (such that they overlap) */
+    srandom(1);
+
+    for (i=0; i < 200; i++) {
+        for (j=0; j < 16; j++) {
+            prefixes[i].s6_addr[j]= random();
+        }
+
+        if (i % 4) {
+            prefixes[i].s6_addr[0]= 0x20;
+            prefixes[i].s6_addr[1]= 0x01;
+        }
+
+        lens[i]= 1 + (i * 7) % 128;
+        sanitize_ipv6_prefix(&(prefixes[i]), lens[i]);
+        assert(add_to_prefix_trie(&trie, &(prefixes[i]), lens[i]) == SUCCESS);
+    }
+
+    /* The trie must agree with a linear search, both for addresses within the prefixes and for random addresses */
+    for (i=0; i < 20000; i++) {
+        if (i % 2) {
+            for (j=0; j < 16; j++) {
+                addr.s6_addr[j]= random();
+            }
+        }
+        else {
+            addr= prefixes[(i / 2) % 200];
+            addr.s6_addr[15]^= random() & 0x0f;
+        }
+
+        assert(match_prefix_trie(&trie, &addr) == (match_ipv6(prefixes, lens, 200, &addr) ? TRUE : FALSE));
+    }
+
+    assert(add_to_prefix_trie(&trie, &addr, 0) == SUCCESS);
+    assert(match_prefix_trie(&trie, &addr) == TRUE);
+    return;
+}
+
+void test_prng(void){
+    struct prng p1, p2;
+    struct in6_addr prefix, addrs[64];
+    uint16_t ports[64];
+    uint8_t key[PRNG_KEY_SIZE];
+    unsigned char buf[37];
+    unsigned int i;
+
+    /* The same seed produces the same sequence (and different seeds, different ones) */
+    prng_seed(&p1, 1);
+    prng_seed(&p2, 1);
+    for (i=0; i < 100; i++)
+        assert(prng_next(&p1) == prng_next(&p2));
+
+    prng_seed(&p2, 2);
+    assert(prng_next(&p1) != prng_next(&p2));
+
+    memset(key, 0x5a, sizeof(key));
+    prng_seed_key(&p1, key);
+    prng_seed_key(&p2, key);
+    assert(p1.type == PRNG_KEYED);
+    for (i=0; i < 100; i++)
+        assert(prng_next(&p1) == prng_next(&p2));
+
+    memset(buf, 0, sizeof(buf));
+    prng_fill(&p1, buf, sizeof(buf) - 1);
+    assert(buf[sizeof(buf) - 1] == 0);
+
+    /* Batches of addresses and ports stay within their prefixes */
+    assert(inet_pton(AF_INET6, "2001:db8:ffff:ffff::", &prefix) == 1);
+    randomize_ipv6_addrs(addrs, 64, &prefix, 36);
+    for (i=0; i < 64; i++) {
+        assert(addrs[i].s6_addr32[0] == prefix.s6_addr32[0]);
+        assert((addrs[i].s6_addr[4] & 0xf0) == 0xf0);
+    }
+
+    assert(memcmp(&addrs[0], &addrs[1], sizeof(struct in6_addr)) != 0);
+
+    randomize_ports(ports, 64, 0x1234, 8);
+    for (i=0; i < 64; i++)
+        assert((ports[i] & 0xff00) == 0x1200);
+
+    assert(prng_random32() != prng_random32() || prng_random32() != prng_random32());
+    return;
+}
+
+void test_route_table(void){
+    struct route_table table;
+    struct route_entry route, *match;
+    struct in6_addr addr;
+    unsigned int i;
+
+    assert(init_route_table(&table) == SUCCESS);
+
+    /* Default route, plus many more-specific routes to force the hash table to grow */
+    memset(&route, 0, sizeof(route));
+    route.ifindex= 1;
+    route.gateway_f= TRUE;
+    assert(add_to_route_table(&table, &route) == SUCCESS);
+
+    for (i=0; i < 1000; i++) {
+        memset(&route, 0, sizeof(route));
+        route.dst.s6_addr[0]= 0x20;
+        route.dst.s6_addr[1]= 0x01;
+        route.dst.s6_addr[2]= i >> 8;
+        route.dst.s6_addr[3]= i & 0xff;
+        route.dstlen= 32;
+        route.ifindex= 2;
+        route.priority= 100;
+        assert(add_to_route_table(&table, &route) == SUCCESS);
+    }
+
+    /* A more specific route, and a route with a lower metric to the same prefix */
+    assert(inet_pton(AF_INET6, "2001:7::", &(route.dst)) == 1);
+    route.dstlen= 48;
+    route.ifindex= 3;
+    assert(add_to_route_table(&table, &route) == SUCCESS);
+    assert(inet_pton(AF_INET6, "2001:7::", &(route.dst)) == 1);
+    route.dstlen= 32;
+    route.ifindex= 4;
+    route.priority= 10;
+    assert(add_to_route_table(&table, &route) == SUCCESS);
+    assert(table.nentries == 1002);
+
+    /* A local route shadows every route of the main table */
+    assert(inet_pton(AF_INET6, "2001:9::1", &(route.dst)) == 1);
+    route.dstlen= 128;
+    route.ifindex= 5;
+    route.local_f= TRUE;
+    assert(add_to_route_table(&table, &route) == SUCCESS);
+
+    assert(inet_pton(AF_INET6, "2001:7:1::1", &addr) == 1);
+    assert((match= match_route_table(&table, &addr)) != NULL && match->ifindex == 4);
+    assert(inet_pton(AF_INET6, "2001:7::1", &addr) == 1);
+    assert((match= match_route_table(&table, &addr)) != NULL && match->ifindex == 3);
+    assert(inet_pton(AF_INET6, "2001:3e7:ffff::1", &addr) == 1);
+    assert((match= match_route_table(&table, &addr)) != NULL && match->ifindex == 2);
+    assert(inet_pton(AF_INET6, "2001:3e8::1", &addr) == 1);
+    assert((match= match_route_table(&table, &addr)) != NULL && match->ifindex == 1);
+    assert(inet_pton(AF_INET6, "2001:9::1", &addr) == 1);
+    assert((match= match_route_table(&table, &addr)) != NULL && match->ifindex == 5);
+
+    clear_route_table(&table);
+    assert(match_route_table(&table, &addr) == NULL);
+    return;
+}
+
+void test_siphash24(void){
+    uint8_t key[16], msg[15];
+    unsigned int i;
+
+    for (i=0; i < sizeof(key); i++) {
+        key[i]= i;
+    }
+
+    for (i=0; i < sizeof(msg); i++) {
+        msg[i]= i;
+    }
+
+    /* Test vectors from the SipHash reference implementation */
+    assert(siphash24(key, msg, 0) == 0x726fdb47dd0e0e31ULL);
+    assert(siphash24(key, msg, sizeof(msg)) == 0xa129ca6149be45e5ULL);
+    return;
+}
+
+/*
+ * Writes a pcap savefile with "nframes" Ethernet frames. The first byte of each frame is "id", and the second one
+ * is the index of the frame.
+ */
+
+void write_savefile(const char *path, unsigned char id, unsigned int nframes){
+    FILE *fp;
+    uint32_t magic= 0xa1b2c3d4, header[4]= {0, 0, 65535, DLT_EN10MB}, record[4];
+    uint16_t version[2]= {2, 4};
+    unsigned char frame[64];
+    unsigned int i;
+
+    assert((fp= fopen(path, "wb")) != NULL);
+    assert(fwrite(&magic, sizeof(magic), 1, fp) == 1);
+    assert(fwrite(version, sizeof(version), 1, fp) == 1);
+    assert(fwrite(header, sizeof(header), 1, fp) == 1);
+
+    for (i=0; i < nframes; i++) {
+        memset(frame, 0, sizeof(frame));
+        frame[0]= id;
+        frame[1]= i;
+        record[0]= i;
+        record[1]= 0;
+        record[2]= sizeof(frame);
+        record[3]= sizeof(frame);
+        assert(fwrite(record, sizeof(record), 1, fp) == 1);
+        assert(fwrite(frame, sizeof(frame), 1, fp) == 1);
+    }
+
+    fclose(fp);
+}
@@ -0,0 +1,275 @@
+#include <assert.h>
+
+/* The scan6 internals are not part of libipv6: build them in, with the tool's main() renamed */
+#define main scan6_main
+#include "../tools/scan6.c"
+#undef main
+
+void test_add_to_scan_list(void);
+void test_hashed_host_list(void);
+void test_is_ip6_in_scan_list(void);
+void test_normalize_scan_list(void);
+void test_read_probe_key(void);
+void test_valid_icmp6_response_remote(void);
+void set_scan_entry(struct scan_entry *, const char *, const char *);
+
+int main(void){
+    test_add_to_scan_list();
+    test_hashed_host_list();
+    test_is_ip6_in_scan_list();
+    test_normalize_scan_list();
+    test_read_probe_key();
+    test_valid_icmp6_response_remote();
+    exit(EXIT_SUCCESS);
+}
+
+void set_scan_entry(struct scan_entry *entry, const char *start, const char *end){
+    assert(inet_pton(AF_INET6, start, &(entry->start.in6_addr)) == 1);
+    assert(inet_pton(AF_INET6, end, &(entry->end.in6_addr)) == 1);
+    entry->cur= entry->start;
+}
+
+void test_add_to_scan_list(void){
+    static struct scan_list scan;
+    static struct scan_entry *targets[4];
+    struct scan_entry entry;
+    unsigned int i;
+
+    scan.target= targets;
+    scan.maxtarget= 4;
+
+    /* Duplicates of the same range must not use up the list */
+    set_scan_entry(&entry, "2001:db8::", "2001:db8::ffff");
+
+    for (i=0; i < 16; i++) {
+        assert(add_to_scan_list(&scan, &entry) == TRUE);
+    }
+
+    set_scan_entry(&entry, "2001:db8:1::1", "2001:db8:1::1");
+    assert(add_to_scan_list(&scan, &entry) == TRUE);
+    set_scan_entry(&entry, "2001:db8:2::1", "2001:db8:2::1");
+    assert(add_to_scan_list(&scan, &entry) == TRUE);
+    set_scan_entry(&entry, "2001:db8:3::1", "2001:db8:3::1");
+    assert(add_to_scan_list(&scan, &entry) == TRUE);
+    assert(normalize_scan_list(&scan) == 0);
+    assert(scan.ntarget == 4);
+
+    /* The list is full of distinct ranges */
+    set_scan_entry(&entry, "2001:db8:4::1", "2001:db8:4::1");
+    assert(add_to_scan_list(&scan, &entry) == FALSE);
+    assert(scan.ntarget == 4);
+
+    set_scan_entry(&entry, "2001:db8::", "2001:db8::ffff");
+    assert(memcmp(&(scan.target[0]->start), &(entry.start), sizeof(union my6_addr)) == 0);
+
+    free_arena(&(scan.arena));
+    return;
+}
+
+void test_hashed_host_list(void){
+    struct hashed_host_list hlist;
+    struct hashed_host_entry *host;
+    struct in6_addr addr;
+    unsigned int i, j;
+
+    assert(init_hashed_host_list(&hlist, 8, 13) == TRUE);
+    assert(hlist.resultsize == 4);
+
+    /* The results of every host start out empty, in the first batch as well as in the following ones */
+    for (j=0; j < 2; j++) {
+        memset(&addr, 0, sizeof(addr));
+
+        for (i=0; i < hlist.maxhosts; i++) {
+            addr.s6_addr[15]= i;
+            assert((host= add_hashed_host_entry(&hlist, &addr)) != NULL);
+            assert(add_hashed_host_entry(&hlist, &addr) == host);
+            assert(get_port_result(host, 0) == 0 && get_port_result(host, 12) == 0);
+            set_port_result(host, 12, PSCAN_RESP_OPEN);
+            set_port_result(host, 0, PSCAN_RESP_CLOSED);
+            assert(get_port_result(host, 12) == PSCAN_RESP_OPEN && get_port_result(host, 0) == PSCAN_RESP_CLOSED);
+            assert(get_port_result(host, 1) == 0);
+        }
+
+        addr.s6_addr[15]= i;
+        assert(add_hashed_host_entry(&hlist, &addr) == NULL);
+        reset_hashed_host_list(&hlist);
+        assert(find_hashed_host_entry(&hlist, &addr) == NULL);
+    }
+
+    return;
+}
+
+void test_is_ip6_in_scan_list(void){
+    static struct scan_list scan;
+    static struct scan_entry *targets[1024];
+    struct scan_entry entry;
+    struct in6_addr addr;
+    char paddr[INET6_ADDRSTRLEN];
+    unsigned int i;
+
+    scan.target= targets;
+    scan.maxtarget= 1024;
+
+    /* A wide range that is not contiguous (hence not merged), and that starts before all the others */
+    set_scan_entry(&entry, "2001:db8::1", "2001:db8:ffff::ffff");
+    assert(add_to_scan_list(&scan, &entry) == TRUE);
+
+    /* Many narrow ranges, all of them within the address span of the wide range */
+    for (i=1; i <= 1000; i++) {
+        snprintf(paddr, sizeof(paddr), "2001:db8:%x::1:0", i);
+        set_scan_entry(&entry, paddr, paddr);
+        entry.end.s6addr16[7]= htons(0xff);
+        assert(add_to_scan_list(&scan, &entry) == TRUE);
+    }
+
+    assert(build_scan_index(&scan) == TRUE);
+    assert(scan.nindex == 1001);
+
+    /* In the wide range only: it has to be found past all the narrow ranges */
+    assert(inet_pton(AF_INET6, "2001:db8:ffff::2", &addr) == 1);
+    assert(is_ip6_in_scan_list(&scan, &addr) == TRUE);
+    assert(inet_pton(AF_INET6, "2001:db8::2", &addr) == 1);
+    assert(is_ip6_in_scan_list(&scan, &addr) == TRUE);
+
+    /* In one of the narrow ranges only */
+    assert(inet_pton(AF_INET6, "2001:db8:1f4::1:80", &addr) == 1);
+    assert(is_ip6_in_scan_list(&scan, &addr) == TRUE);
+
+    /* Within the span of the wide range, but not in any of the ranges */
+    assert(inet_pton(AF_INET6, "2001:db8:1f4::2:0", &addr) == 1);
+    assert(is_ip6_in_scan_list(&scan, &addr) == FALSE);
+    assert(inet_pton(AF_INET6, "2001:db8:ffff::1:0", &addr) == 1);
+    assert(is_ip6_in_scan_list(&scan, &addr) == FALSE);
+
+    /* Before and after all the ranges */
+    assert(inet_pton(AF_INET6, "2001:db8::", &addr) == 1);
+    assert(is_ip6_in_scan_list(&scan, &addr) == FALSE);
+    assert(inet_pton(AF_INET6, "2001:db9::", &addr) == 1);
+    assert(is_ip6_in_scan_list(&scan, &addr) == FALSE);
+
+    free(scan.index);
+    free_arena(&(scan.arena));
+    return;
+}
+
+void test_normalize_scan_list(void){
+    static struct scan_list scan;
+    static struct scan_entry *targets[16];
+    struct scan_entry entry, expected;
+
+    scan.target= targets;
+    scan.maxtarget= 16;
+
+    /* A single address, that goes first and must stay first */
+    set_scan_entry(&entry, "2001:db8:1::1", "2001:db8:1::1");
+    assert(add_to_scan_list(&scan, &entry) == TRUE);
+
+    set_scan_entry(&entry, "2001:db8::", "2001:db8::ffff");
+    assert(add_to_scan_list(&scan, &entry) == TRUE);
+
+    /* Duplicates */
+    assert(add_to_scan_list(&scan, &entry) == TRUE);
+    set_scan_entry(&entry, "2001:db8:1::1", "2001:db8:1::1");
+    assert(add_to_scan_list(&scan, &entry) == TRUE);
+
+    /* Contained in 2001:db8::/112 */
+    set_scan_entry(&entry, "2001:db8::10", "2001:db8::20");
+    assert(add_to_scan_list(&scan, &entry) == TRUE);
+
+    /* Adjacent and overlapping contiguous ranges, merged into 2001:db8::/111 */
+    set_scan_entry(&entry, "2001:db8::1:0", "2001:db8::1:ffff");
+    assert(add_to_scan_list(&scan, &entry) == TRUE);
+    set_scan_entry(&entry, "2001:db8::1:8000", "2001:db8::1:ffff");
+    assert(add_to_scan_list(&scan, &entry) == TRUE);
+
+    assert(scan.ntarget == 7);
+    assert(normalize_scan_list(&scan) == 5);
+    assert(scan.ntarget == 2);
+
+    set_scan_entry(&expected, "2001:db8:1::1", "2001:db8:1::1");
+    assert(memcmp(&(scan.target[0]->start), &(expected.start), sizeof(union my6_addr)) == 0);
+    assert(memcmp(&(scan.target[0]->end), &(expected.end), sizeof(union my6_addr)) == 0);
+
+    set_scan_entry(&expected, "2001:db8::", "2001:db8::1:ffff");
+    assert(memcmp(&(scan.target[1]->start), &(expected.start), sizeof(union my6_addr)) == 0);
+    assert(memcmp(&(scan.target[1]->end), &(expected.end), sizeof(union my6_addr)) == 0);
+    assert(memcmp(&(scan.target[1]->cur), &(expected.start), sizeof(union my6_addr)) == 0);
+
+    /* Sharding drops entries too: the remaining ones must still be valid */
+    assert(shard_scan_list(&scan, 1, 2) == SUCCESS);
+    assert(scan.ntarget == 1);
+
+    free_arena(&(scan.arena));
+    return;
+}
+
+void test_read_probe_key(void){
+    uint8_t expected[PROBE_KEY_SIZE]= {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+                                       0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+
+    assert(read_probe_key("00112233445566778899AABBCCDDEEFF") == TRUE);
+    assert(memcmp(probe_key, expected, sizeof(expected)) == 0);
+
+    /* Wrong length, and non-hexadecimal digits */
+    assert(read_probe_key("00112233445566778899aabbccddeef") == FALSE);
+    assert(read_probe_key("00112233445566778899aabbccddeeff00") == FALSE);
+    assert(read_probe_key("0x112233445566778899aabbccddeeff") == FALSE);
+    assert(read_probe_key("00112233445566778899aabbccddee-f") == FALSE);
+
+    return;
+}
+
+void test_valid_icmp6_response_remote(void){
+    static struct iface_data tdata;
+    unsigned char frame[ETHER_HDR_LEN + MIN_IPV6_HLEN + 8 + sizeof(struct icmp6_hdr) + ICMPV6_ECHO_PAYLOAD_SIZE];
+    struct pcap_pkthdr pkthdr;
+    struct packet_view view;
+    struct ether_header *ether;
+    struct ip6_hdr *ipv6;
+    struct icmp6_hdr *icmp6;
+    struct timeval sent;
+    unsigned char *dstopt;
+    uint32_t cookie;
+
+    tdata.type= DLT_EN10MB;
+    tdata.linkhsize= ETHER_HDR_LEN;
+    assert(read_probe_key("00112233445566778899aabbccddeeff") == TRUE);
+
+    /* Echo Reply that carries a Destination Options header before the ICMPv6 header */
+    memset(frame, 0, sizeof(frame));
+    ether= (struct ether_header *)frame;
+    ether->ether_type= htons(ETHERTYPE_IPV6);
+    ipv6= (struct ip6_hdr *)(frame + ETHER_HDR_LEN);
+    ipv6->ip6_vfc= 0x60;
+    ipv6->ip6_plen= htons(sizeof(frame) - ETHER_HDR_LEN - MIN_IPV6_HLEN);
+    ipv6->ip6_nxt= IPPROTO_DSTOPTS;
+    ipv6->ip6_hlim= 64;
+    assert(inet_pton(AF_INET6, "2001:db8::1", &(ipv6->ip6_src)) == 1);
+    assert(inet_pton(AF_INET6, "2001:db8::2", &(ipv6->ip6_dst)) == 1);
+
+    dstopt= (unsigned char *)ipv6 + MIN_IPV6_HLEN;
+    dstopt[0]= IPPROTO_ICMPV6;
+    dstopt[2]= 0x01; /* PadN */
+    dstopt[3]= 4;
+
+    icmp6= (struct icmp6_hdr *)(dstopt + 8);
+    icmp6->icmp6_type= ICMP6_ECHO_REPLY;
+    cookie= probe_cookie(&(ipv6->ip6_dst), &(ipv6->ip6_src), 0);
+    icmp6->icmp6_data16[0]= htons(cookie >> 16);
+    icmp6->icmp6_data16[1]= htons(cookie & 0xffff);
+    icmp6->icmp6_cksum= in_chksum(ipv6, icmp6, sizeof(struct icmp6_hdr) + ICMPV6_ECHO_PAYLOAD_SIZE, IPPROTO_ICMPV6);
+
+    pkthdr.caplen= pkthdr.len= sizeof(frame);
+    assert(dissect_packet(&tdata, frame, &pkthdr, &view, 0) == SUCCESS);
+    assert(view.proto == IPPROTO_ICMPV6 && view.nexthdrs == 1);
+    assert(valid_icmp6_response_remote(&tdata, PROBE_ICMP6_ECHO, &view, &sent));
+
+    /* A wrong cookie is rejected */
+    icmp6->icmp6_data16[1]^= htons(1);
+    icmp6->icmp6_cksum= 0;
+    icmp6->icmp6_cksum= in_chksum(ipv6, icmp6, sizeof(struct icmp6_hdr) + ICMPV6_ECHO_PAYLOAD_SIZE, IPPROTO_ICMPV6);
+    assert(dissect_packet(&tdata, frame, &pkthdr, &view, 0) == SUCCESS);
+    assert(valid_icmp6_response_remote(&tdata, PROBE_ICMP6_ECHO, &view, &sent) == 0);
+
+    return;
+}
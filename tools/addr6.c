@@ -53,6 +53,7 @@ uint16_t key(struct hashed_host_list *, struct in6_addr *);
 struct hashed_host_entry *add_hashed_host_entry(struct hashed_host_list *, struct in6_addr *);
 unsigned int is_ip6_in_hashed_list(struct hashed_host_list *, struct in6_addr *);
 void print_stats(struct stats6 *);
+void flush_output_batch(void);
 
 unsigned char stdin_f = FALSE, addr_f = FALSE, verbose_f = FALSE, decode_f = FALSE, block_duplicate_f = FALSE;
 unsigned char block_duplicate_preflen_f = FALSE, stats_f = FALSE, filter_f = FALSE, canonic_f = FALSE;
@@ -62,6 +63,11 @@ unsigned int pstart, pend;
 unsigned int caddr = 0, naddr = 0;
 char line[MAX_LINE_SIZE];
 
+/* Addresses read from stdin that are pending to be printed (see flush_output_batch()) */
+struct in6_addr outlist[MAX_OUTPUT_BATCH];
+unsigned int nout = 0;
+char outbuf[MAX_OUTPUT_BATCH * INET6_ADDRSTRLEN];
+
 extern char *optarg;
 extern int optind, opterr, optopt;
 
@@ -770,7 +776,7 @@ int main(int argc, char **argv) {
             r = read_prefix(line, Strnlen(line, MAX_LINE_SIZE), &ptr);
 
             if (r == 1) {
-                if (inet_pton(AF_INET6, ptr, &(addr.ip6)) <= 0) {
+                if (ipv6_pton(ptr, &(addr.ip6)) == 0) {
                     if (decode_f)
                         puts("Error: Invalid IPv6 address");
 
@@ -920,6 +926,16 @@ int main(int argc, char **argv) {
 
                     caddr++;
                 }
+                else if (!print_unique_preflen_f && !fixed_f && !response_f) {
+                    /*
+                       Plain addresses are formatted in batches, and printed with a single fwrite(). This is not
+                       done with -R, since the "REJECT" responses must be interleaved with the accepted addresses.
+                     */
+                    outlist[nout++] = addr.ip6;
+
+                    if (nout == MAX_OUTPUT_BATCH)
+                        flush_output_batch();
+                }
                 else {
                     if (print_unique_preflen_f) {
                         sanitize_ipv6_prefix(&(addr.ip6), dpreflen);
@@ -936,10 +952,7 @@ int main(int argc, char **argv) {
                         }
                     }
                     else {
-                        if (inet_ntop(AF_INET6, &(addr.ip6), pv6addr, sizeof(pv6addr)) == NULL) {
-                            puts("inet_ntop(): Error converting IPv6 address to fixed format");
-                            exit(EXIT_FAILURE);
-                        }
+                        ipv6_ntop(&(addr.ip6), pv6addr);
                     }
 
                     printf("%s%s\n", pv6addr, prefstr);
@@ -947,6 +960,8 @@ int main(int argc, char **argv) {
             }
         }
 
+        flush_output_batch();
+
         if (stats_f) {
             print_stats(&stats);
         }
@@ -1127,11 +1142,7 @@ int main(int argc, char **argv) {
             printf("%s%s\n", pv6addr, prefstr);
         }
         else {
-            if (inet_ntop(AF_INET6, &(addr.ip6), pv6addr, sizeof(pv6addr)) == NULL) {
-                puts("inet_ntop(): Error converting IPv6 address to fixed format");
-                exit(EXIT_FAILURE);
-            }
-
+            ipv6_ntop(&(addr.ip6), pv6addr);
             printf("%s%s\n", pv6addr, prefstr);
         }
     }
@@ -1749,6 +1760,24 @@ unsigned int is_ip6_in_hashed_list(struct hashed_host_list *hlist, struct in6_ad
     return 0;
 }
 
+/*
+ * Function: flush_output_batch()
+ *
+ * Prints the addresses pending in the output batch
+ */
+
+void flush_output_batch(void) {
+    unsigned int i, n;
+    size_t len;
+
+    for (i = 0; i < nout; i += n) {
+        n = ipv6_ntop_batch(outlist + i, nout - i, outbuf, sizeof(outbuf), &len);
+        fwrite(outbuf, 1, len, stdout);
+    }
+
+    nout = 0;
+}
+
 /*
  * Function: print_stats()
  *
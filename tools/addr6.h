@@ -5,6 +5,7 @@
 #define MAX_HOST_ENTRIES 4000000000
 #define MAX_ADDR_PATTERN 10000000
 #define MAX_ADDR_FILTERS MAX_ADDR_PATTERN / 100
+#define MAX_OUTPUT_BATCH 1024 /* Addresses formatted with a single ipv6_ntop_batch() call */
 
 /* Filter Constants */
 #define MAX_BLOCK 50
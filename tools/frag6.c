@@ -63,17 +63,17 @@
 int predict_frag_id(uint32_t *, unsigned int, uint32_t *, unsigned int);
 void print_attack_info(struct iface_data *);
 void print_help(void);
-void print_icmp6_echo(struct iface_data *, struct pcap_pkthdr *, const u_char *);
-void print_icmp6_timed(struct iface_data *, struct pcap_pkthdr *, const u_char *);
-void process_icmp6_echo(struct iface_data *, struct pcap_pkthdr *, const u_char *, unsigned char *, unsigned int *);
-void process_icmp6_timed(struct iface_data *, struct pcap_pkthdr *, const u_char *, unsigned char *);
+void print_icmp6_echo(struct iface_data *, struct packet_view *);
+void print_icmp6_timed(struct iface_data *, struct packet_view *);
+void process_icmp6_echo(struct iface_data *, struct packet_view *, unsigned char *, unsigned int *);
+void process_icmp6_timed(struct iface_data *, struct packet_view *, unsigned char *);
 int send_fid_probe(struct iface_data *);
 int send_fragment(struct iface_data *, unsigned int, unsigned int, unsigned int, unsigned int, unsigned int);
 int send_fragment2(struct iface_data *, uint16_t, unsigned int, unsigned int, unsigned int, unsigned int, char *);
 int test_frag_pattern(unsigned char *, unsigned int, char *);
 void usage(void);
-int valid_icmp6_response(struct iface_data *, struct pcap_pkthdr *, const u_char *);
-int valid_icmp6_response2(struct iface_data *, struct pcap_pkthdr *, const u_char *, unsigned int);
+int valid_icmp6_response(struct iface_data *, struct packet_view *);
+int valid_icmp6_response2(struct iface_data *, struct packet_view *, unsigned int);
 
 /* Used for router discovery */
 struct iface_data idata;
@@ -91,6 +91,7 @@ struct icmp6_hdr *pkt_icmp6;
 struct nd_neighbor_solicit *pkt_ns;
 struct in6_addr *pkt_ipv6addr;
 unsigned int pktbytes;
+struct packet_view pview;
 
 bpf_u_int32 my_netmask;
 bpf_u_int32 my_ip;
@@ -165,6 +166,9 @@ char block8[8] = {'a', 'a', 'd', 'd', 'c', 'c', 'b', 'b'};
 uint16_t addr_sig, addr_key;
 uint32_t icmp6_sig;
 
+/* Used for measuring the packet-generation speed (see open_tx_dump()) */
+char *txdumpfile = NULL;
+
 int main(int argc, char **argv) {
     extern char *optarg;
     char *endptr; /* Used by strtoul() */
@@ -206,11 +210,14 @@ int main(int argc, char **argv) {
                                        {"flood-frags", required_argument, 0, 'F'},
                                        {"loop", no_argument, 0, 'l'},
                                        {"sleep", required_argument, 0, 'z'},
+                                       {"write-pcap", required_argument, 0, 'Y'},
+                                       {"dry-run", no_argument, 0, '3'},
+                                       {"read-pcap", required_argument, 0, 'M'},
                                        {"verbose", no_argument, 0, 'v'},
                                        {"help", no_argument, 0, 'h'},
                                        {0, 0, 0, 0}};
 
-    const char shortopts[] = "i:S:D:s:d:A:u:U:H:P:O:o:I:TnpWXF:lz:vh";
+    const char shortopts[] = "i:S:D:s:d:A:u:U:H:P:O:o:I:TnpWXF:lz:Y:vh";
 
     char option;
 
@@ -536,6 +543,18 @@ int main(int argc, char **argv) {
             sleep_f = 1;
             break;
 
+        case 'Y': /* Write the packets to a savefile, rather than sending them */
+            txdumpfile = optarg;
+            break;
+
+        case '3': /* Discard the packets, rather than sending them */
+            txdumpfile = "/dev/null";
+            break;
+
+        case 'M': /* Read the incoming packets from a savefile, rather than from the network */
+            idata.rxreplayfile = optarg;
+            break;
+
         case 'v': /* Be verbose */
             idata.verbose_f++;
             break;
@@ -575,6 +594,15 @@ int main(int argc, char **argv) {
 
     release_privileges();
 
+    /* When replaying a savefile, the packets are not sent */
+    if (idata.rxreplayfile != NULL && txdumpfile == NULL)
+        txdumpfile = "/dev/null";
+
+    if (txdumpfile != NULL && open_tx_dump(&idata, txdumpfile) == FAILURE) {
+        printf("Error while opening savefile %s\n", txdumpfile);
+        exit(EXIT_FAILURE);
+    }
+
     if ((idata.ip6_local_flag && idata.ip6_global_flag) && !idata.srcaddr_f)
         localaddr_f = 1;
 
@@ -678,7 +706,7 @@ int main(int argc, char **argv) {
                 if (idata.verbose_f)
                     puts("Sending Fragments for Test #1....");
 
-                id = random();
+                id = prng_random32();
 
                 if (send_fragment2(&idata, sizeof(struct icmp6_hdr) + minfragsize * 2 - overlap, id, 0, minfragsize,
                                    FIRST_FRAGMENT, block1) == -1) {
@@ -696,7 +724,7 @@ int main(int argc, char **argv) {
                 if (idata.verbose_f)
                     puts("Sending Fragments for Test #2....");
 
-                id = random();
+                id = prng_random32();
 
                 if (send_fragment2(&idata, sizeof(struct icmp6_hdr) + minfragsize * 3 - overlap, id, 0, minfragsize,
                                    FIRST_FRAGMENT, block2) == -1) {
@@ -718,7 +746,7 @@ int main(int argc, char **argv) {
                 if (idata.verbose_f)
                     puts("Sending Fragments for Test #3....");
 
-                id = random();
+                id = prng_random32();
 
                 if (send_fragment2(&idata, sizeof(struct icmp6_hdr) + minfragsize * 3 - overlap, id, 0, minfragsize,
                                    FIRST_FRAGMENT, block3) == -1) {
@@ -740,7 +768,7 @@ int main(int argc, char **argv) {
                 if (idata.verbose_f)
                     puts("Sending Fragments for Test #4....");
 
-                id = random();
+                id = prng_random32();
 
                 if (send_fragment2(&idata, sizeof(struct icmp6_hdr) + minfragsize * 4, id, 0, minfragsize,
                                    FIRST_FRAGMENT, block4) == -1) {
@@ -762,28 +790,40 @@ int main(int argc, char **argv) {
                 if (idata.verbose_f)
                     puts("Sending Fragments for Test #5....");
 
-                id = random();
+                id = prng_random32();
 
                 if (send_fragment2(&idata, sizeof(struct icmp6_hdr) + minfragsize * 4 - overlap, id, 0, minfragsize,
                                    FIRST_FRAGMENT, block5) == -1) {
+                    if (tx_dump_stopped())
+                        exit(EXIT_SUCCESS);
+
                     puts("Error when writing fragment");
                     exit(EXIT_FAILURE);
                 }
 
                 if (send_fragment2(&idata, 0, id, sizeof(struct icmp6_hdr) + minfragsize * 2, minfragsize,
                                    MIDDLE_FRAGMENT, block6) == -1) {
+                    if (tx_dump_stopped())
+                        exit(EXIT_SUCCESS);
+
                     puts("Error when writing fragment");
                     exit(EXIT_FAILURE);
                 }
 
                 if (send_fragment2(&idata, 0, id, sizeof(struct icmp6_hdr) + minfragsize * 3 - overlap, minfragsize,
                                    LAST_FRAGMENT, block7) == -1) {
+                    if (tx_dump_stopped())
+                        exit(EXIT_SUCCESS);
+
                     puts("Error when writing fragment");
                     exit(EXIT_FAILURE);
                 }
 
                 if (send_fragment2(&idata, 0, id, sizeof(struct icmp6_hdr) + minfragsize, minfragsize, MIDDLE_FRAGMENT,
                                    block8) == -1) {
+                    if (tx_dump_stopped())
+                        exit(EXIT_SUCCESS);
+
                     puts("Error when writing fragment");
                     exit(EXIT_FAILURE);
                 }
@@ -816,57 +856,64 @@ int main(int argc, char **argv) {
 #else
             if (sel && FD_ISSET(idata.fd, &rset)) {
 #endif
-                /* Read a packet (Echo Reply, ICMPv6 Error, or Neighbor Solicitation) */
-                if ((r = pcap_next_ex(idata.pfd, &pkthdr, &pktdata)) == -1) {
-                    printf("pcap_next_ex(): %s", pcap_geterr(idata.pfd));
-                    exit(EXIT_FAILURE);
-                }
-                else if (r == 1 && pktdata != NULL) {
-                    pkt_ether = (struct ether_header *)pktdata;
-                    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata.linkhsize);
-                    pkt_icmp6 = (struct icmp6_hdr *)((char *)pkt_ipv6 + sizeof(struct ip6_hdr));
-                    pkt_ns = (struct nd_neighbor_solicit *)pkt_icmp6;
-                    pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
+                /* Read all the available packets (Echo Reply, ICMPv6 Error, or Neighbor Solicitation) */
+                while ((r = read_frame(&idata, &pkthdr, &pktdata)) == 1) {
+                    if (pktdata == NULL)
+                        continue;
 
-                    if ((pkt_end - pktdata) < (idata.linkhsize + MIN_IPV6_HLEN))
+                    if (dissect_packet(&idata, pktdata, pkthdr, &pview, 0) == FAILURE ||
+                        pview.proto != IPPROTO_ICMPV6 || (pview.flags & PV_LATER_FRAGMENT))
                         continue;
 
-                    if (pkt_ipv6->ip6_nxt == IPPROTO_ICMPV6) {
-                        if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK) &&
-                            pkt_icmp6->icmp6_type == ND_NEIGHBOR_SOLICIT) {
-                            if ((pkt_end - (unsigned char *)pkt_ns) < sizeof(struct nd_neighbor_solicit))
-                                continue;
-                            /*
-                                    If the addresses that we're using are not actually configured on the local system
-                                    (i.e., they are "spoofed", we must check whether it is a Neighbor Solicitation for
-                                    one of our addresses, and respond with a Neighbor Advertisement. Otherwise, the
-                               kernel will take care of that.
-                             */
-                            if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK) && !localaddr_f &&
-                                is_eq_in6_addr(&(pkt_ns->nd_ns_target), &idata.srcaddr)) {
-                                if (send_neighbor_advert(&idata, idata.pfd, pktdata) == -1) {
-                                    puts("Error sending Neighbor Advertisement");
-                                    exit(EXIT_FAILURE);
-                                }
+                    pkt_ether = (struct ether_header *)pktdata;
+                    pkt_ipv6 = pview.ipv6;
+                    pkt_icmp6 = (struct icmp6_hdr *)pview.upper;
+                    pkt_ns = (struct nd_neighbor_solicit *)pkt_icmp6;
+                    pkt_end = pview.end;
+
+                    if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK) &&
+                        pkt_icmp6->icmp6_type == ND_NEIGHBOR_SOLICIT) {
+                        if ((pkt_end - (unsigned char *)pkt_ns) < sizeof(struct nd_neighbor_solicit))
+                            continue;
+                        /*
+                                If the addresses that we're using are not actually configured on the local system
+                                (i.e., they are "spoofed", we must check whether it is a Neighbor Solicitation for
+                                one of our addresses, and respond with a Neighbor Advertisement. Otherwise, the
+                           kernel will take care of that.
+                         */
+                        if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK) && !localaddr_f &&
+                            is_eq_in6_addr(&(pkt_ns->nd_ns_target), &idata.srcaddr)) {
+                            if (send_neighbor_advert(&idata, idata.pfd, pktdata) == -1) {
+                                puts("Error sending Neighbor Advertisement");
+                                exit(EXIT_FAILURE);
                             }
                         }
-                        else if ((pkt_icmp6->icmp6_type == ICMP6_ECHO_REPLY) ||
-                                 (pkt_icmp6->icmp6_type == ICMP6_TIME_EXCEEDED)) {
-                            if ((pkt_end - (unsigned char *)pkt_icmp6) < sizeof(struct icmp6_hdr))
-                                continue;
+                    }
+                    else if ((pkt_icmp6->icmp6_type == ICMP6_ECHO_REPLY) ||
+                             (pkt_icmp6->icmp6_type == ICMP6_TIME_EXCEEDED)) {
+                        if ((pkt_end - (unsigned char *)pkt_icmp6) < sizeof(struct icmp6_hdr))
+                            continue;
 
-                            switch (pkt_icmp6->icmp6_type) {
-                            case ICMP6_ECHO_REPLY:
-                                process_icmp6_echo(&idata, pkthdr, pktdata, test, &responses);
-                                break;
+                        switch (pkt_icmp6->icmp6_type) {
+                        case ICMP6_ECHO_REPLY:
+                            process_icmp6_echo(&idata, &pview, test, &responses);
+                            break;
 
-                            case ICMP6_TIME_EXCEEDED:
-                                process_icmp6_timed(&idata, pkthdr, pktdata, test);
-                                break;
-                            }
+                        case ICMP6_TIME_EXCEEDED:
+                            process_icmp6_timed(&idata, &pview, test);
+                            break;
                         }
                     }
                 }
+
+                if (r == -1) {
+                    printf("pcap_next_ex(): %s", pcap_geterr(idata.pfd));
+                    exit(EXIT_FAILURE);
+                }
+                else if (r == PCAP_ERROR_BREAK) {
+                    /* End of the savefile (see open_rx_replay()) */
+                    break;
+                }
             }
         }
 
@@ -982,6 +1029,9 @@ int main(int argc, char **argv) {
             if (is_time_elapsed(&curtimet, &lastfrag1t, FID_ASSESS_DELTA)) {
                 if (testtype == FIXED_ORIGIN) {
                     if (send_fid_probe(&idata) == -1) {
+                        if (tx_dump_stopped())
+                            exit(EXIT_SUCCESS);
+
                         puts("Error while sending packet");
                         exit(EXIT_FAILURE);
                     }
@@ -1010,6 +1060,9 @@ int main(int argc, char **argv) {
                     */
 
                     if (send_fid_probe(&idata) == -1) {
+                        if (tx_dump_stopped())
+                            exit(EXIT_SUCCESS);
+
                         puts("Error while sending packet");
                         exit(EXIT_FAILURE);
                     }
@@ -1043,22 +1096,21 @@ int main(int argc, char **argv) {
 #else
             if (sel && FD_ISSET(idata.fd, &rset)) {
 #endif
-                /* Read a packet (Echo Reply, or Neighbor Solicitation) */
-                if ((r = pcap_next_ex(idata.pfd, &pkthdr, &pktdata)) == -1) {
-                    printf("pcap_next_ex(): %s", pcap_geterr(idata.pfd));
-                    exit(EXIT_FAILURE);
-                }
-                else if (r == 1 && pktdata != NULL) {
-                    pkt_ether = (struct ether_header *)pktdata;
-                    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata.linkhsize);
-                    pkt_icmp6 = (struct icmp6_hdr *)((char *)pkt_ipv6 + sizeof(struct ip6_hdr));
-                    pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
+                /* Read all the available packets (Echo Reply, or Neighbor Solicitation) */
+                while ((r = read_frame(&idata, &pkthdr, &pktdata)) == 1) {
+                    if (pktdata == NULL)
+                        continue;
 
-                    if ((pkt_end - pktdata) < (idata.linkhsize + MIN_IPV6_HLEN))
+                    if (dissect_packet(&idata, pktdata, pkthdr, &pview, 0) == FAILURE || pview.proto != IPPROTO_ICMPV6)
                         continue;
 
-                    if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK) &&
-                        pkt_ipv6->ip6_nxt == IPPROTO_ICMPV6 && pkt_icmp6->icmp6_type == ND_NEIGHBOR_SOLICIT) {
+                    pkt_ether = (struct ether_header *)pktdata;
+                    pkt_ipv6 = pview.ipv6;
+                    pkt_icmp6 = (struct icmp6_hdr *)pview.upper;
+                    pkt_end = pview.end;
+
+                    if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK) && pview.frag == NULL &&
+                        pkt_icmp6->icmp6_type == ND_NEIGHBOR_SOLICIT) {
                         pkt_ns = (struct nd_neighbor_solicit *)pkt_icmp6;
 
                         if ((pkt_end - (unsigned char *)pkt_ns) < sizeof(struct nd_neighbor_solicit))
@@ -1091,15 +1143,11 @@ int main(int argc, char **argv) {
                             }
                         }
                     }
-                    else if (pkt_ipv6->ip6_nxt == IPPROTO_FRAGMENT) {
-                        if ((pkt_end - (unsigned char *)pkt_ipv6) < (sizeof(struct ip6_hdr) + sizeof(struct ip6_frag) +
-                                                                     sizeof(struct icmp6_hdr) + sizeof(uint32_t)))
+                    else if (pview.frag != NULL) {
+                        if (pview.upperlen < (sizeof(struct icmp6_hdr) + sizeof(uint32_t)))
                             continue;
 
-                        pkt_fh = (struct ip6_frag *)((unsigned char *)pkt_ipv6 + sizeof(struct ip6_hdr));
-
-                        if (pkt_fh->ip6f_nxt != IPPROTO_ICMPV6)
-                            continue;
+                        pkt_fh = pview.frag;
 
                         /* XXX We only sample non-first fragments (see below) */
                         if (!(pkt_fh->ip6f_offlg & IP6F_OFF_MASK))
@@ -1110,8 +1158,6 @@ int main(int argc, char **argv) {
                          * network, we never get the first fragment because it is discarded when it triggers ND.
                          */
                         if (!(pkt_fh->ip6f_offlg & IP6F_OFF_MASK)) {
-                            pkt_icmp6 = (struct icmp6_hdr *)((unsigned char *)pkt_fh + sizeof(struct ip6_frag));
-
                             if (pkt_icmp6->icmp6_type != ICMP6_ECHO_REPLY)
                                 continue;
 
@@ -1159,6 +1205,15 @@ int main(int argc, char **argv) {
                         }
                     }
                 }
+
+                if (r == -1) {
+                    printf("pcap_next_ex(): %s", pcap_geterr(idata.pfd));
+                    exit(EXIT_FAILURE);
+                }
+                else if (r == PCAP_ERROR_BREAK) {
+                    /* End of the savefile (see open_rx_replay()) */
+                    break;
+                }
             }
         }
 
@@ -1210,7 +1265,7 @@ int main(int argc, char **argv) {
         pcap_freecode(&pcap_filter);
 
         maxsizedchunk = idata.mtu - sizeof(struct ip6_hdr) - sizeof(struct ip6_frag);
-        id = random();
+        id = prng_random32();
         foffset = 0;
         i = 0;
 
@@ -1218,6 +1273,9 @@ int main(int argc, char **argv) {
         while ((foffset + maxsizedchunk) < MAX_FRAG_OFFSET) {
             if (send_fragment(&idata, id, foffset, maxsizedchunk, foffset ? MIDDLE_FRAGMENT : FIRST_FRAGMENT,
                               NO_TIMESTAMP) == -1) {
+                if (tx_dump_stopped())
+                    exit(EXIT_SUCCESS);
+
                 puts("Error when writing fragment");
                 exit(EXIT_FAILURE);
             }
@@ -1226,7 +1284,7 @@ int main(int argc, char **argv) {
             i++;
 
             /* Pause for 1 second every 8 packets */
-            if (!(i % 8))
+            if (!(i % 8) && txdumpfile == NULL)
                 sleep(1);
         }
 
@@ -1237,6 +1295,9 @@ int main(int argc, char **argv) {
         if (foffset != MAX_FRAG_OFFSET) {
             if (send_fragment(&idata, id, foffset, (idata.mtu - maxsizedchunk) / 8, MIDDLE_FRAGMENT, NO_TIMESTAMP) ==
                 -1) {
+                if (tx_dump_stopped())
+                    exit(EXIT_SUCCESS);
+
                 puts("Error when writing fragment");
                 exit(EXIT_FAILURE);
             }
@@ -1247,6 +1308,9 @@ int main(int argc, char **argv) {
         /* Send a last fragment, at the right edge, with the maximum possible size */
         if (send_fragment(&idata, id, foffset, idata.mtu - sizeof(struct ip6_hdr) - sizeof(struct ip6_frag),
                           LAST_FRAGMENT, NO_TIMESTAMP) == -1) {
+            if (tx_dump_stopped())
+                exit(EXIT_SUCCESS);
+
             puts("Error when writing fragment");
             exit(EXIT_FAILURE);
         }
@@ -1285,13 +1349,14 @@ int main(int argc, char **argv) {
                 break;
             }
 
-            if ((curtime - lastfrag) >= nsleep) {
+            /* A dry run (-Y) writes the bursts back to back, rather than sleeping between them */
+            if ((curtime - lastfrag) >= nsleep || txdumpfile != NULL) {
                 puts("Sending Fragment(s)....");
 
                 frags = 0;
 
                 if (!foffset_f) {
-                    foffset = random();
+                    foffset = prng_random32();
                 }
 
                 if (forder != LAST_FRAGMENT) {
@@ -1299,9 +1364,11 @@ int main(int argc, char **argv) {
                 }
 
                 while (frags < nfrags) {
-                    if (send_fragment(&idata, fid_f ? fid : random(), foffset,
-                                      fsize_f ? fsize : (((MIN_FRAG_SIZE + (random() % 400)) >> 3) << 3), forder,
+                    if (send_fragment(&idata, fid_f ? fid : prng_random32(), foffset,
+                                      fsize_f ? fsize : (((MIN_FRAG_SIZE + (prng_random32() % 400)) >> 3) << 3), forder,
                                       tstamp_f) == -1) {
+                        if (tx_dump_stopped())
+                            exit(EXIT_SUCCESS);
 
                         puts("Error sending packet");
                         exit(EXIT_FAILURE);
@@ -1338,73 +1405,80 @@ int main(int argc, char **argv) {
 #else
             if (sel && FD_ISSET(idata.fd, &rset)) {
 #endif
-                /* Read a packet (Echo Reply, ICMPv6 Error, or Neighbor Solicitation) */
-                if ((r = pcap_next_ex(idata.pfd, &pkthdr, &pktdata)) == -1) {
-                    printf("pcap_next_ex(): %s", pcap_geterr(idata.pfd));
-                    exit(EXIT_FAILURE);
-                }
-                else if (r == 1 && pktdata != NULL) {
-                    pkt_ether = (struct ether_header *)pktdata;
-                    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata.linkhsize);
-                    pkt_icmp6 = (struct icmp6_hdr *)((char *)pkt_ipv6 + sizeof(struct ip6_hdr));
-                    pkt_ns = (struct nd_neighbor_solicit *)pkt_icmp6;
-                    pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
+                /* Read all the available packets (Echo Reply, ICMPv6 Error, or Neighbor Solicitation) */
+                while ((r = read_frame(&idata, &pkthdr, &pktdata)) == 1) {
+                    if (pktdata == NULL)
+                        continue;
 
-                    if ((pkt_end - pktdata) < (idata.linkhsize + MIN_IPV6_HLEN))
+                    if (dissect_packet(&idata, pktdata, pkthdr, &pview, 0) == FAILURE ||
+                        pview.proto != IPPROTO_ICMPV6 || (pview.flags & PV_LATER_FRAGMENT))
                         continue;
 
-                    if (pkt_ipv6->ip6_nxt == IPPROTO_ICMPV6) {
-                        if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK) &&
-                            pkt_icmp6->icmp6_type == ND_NEIGHBOR_SOLICIT) {
-                            if ((pkt_end - (unsigned char *)pkt_ns) < sizeof(struct nd_neighbor_solicit))
-                                continue;
-                            /*
-                                    If the addresses that we're using are not actually configured on the local system
-                                    (i.e., they are "spoofed", we must check whether it is a Neighbor Solicitation for
-                                    one of our addresses, and respond with a Neighbor Advertisement. Otherwise, the
-                               kernel will take care of that.
-                             */
-                            if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK) && !localaddr_f &&
-                                is_eq_in6_addr(&(pkt_ns->nd_ns_target), &(idata.srcaddr))) {
-                                if (send_neighbor_advert(&idata, idata.pfd, pktdata) == -1) {
-                                    puts("Error sending Neighbor Advertisement");
-                                    exit(EXIT_FAILURE);
-                                }
+                    pkt_ether = (struct ether_header *)pktdata;
+                    pkt_ipv6 = pview.ipv6;
+                    pkt_icmp6 = (struct icmp6_hdr *)pview.upper;
+                    pkt_ns = (struct nd_neighbor_solicit *)pkt_icmp6;
+                    pkt_end = pview.end;
+
+                    if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK) &&
+                        pkt_icmp6->icmp6_type == ND_NEIGHBOR_SOLICIT) {
+                        if ((pkt_end - (unsigned char *)pkt_ns) < sizeof(struct nd_neighbor_solicit))
+                            continue;
+                        /*
+                                If the addresses that we're using are not actually configured on the local system
+                                (i.e., they are "spoofed", we must check whether it is a Neighbor Solicitation for
+                                one of our addresses, and respond with a Neighbor Advertisement. Otherwise, the
+                           kernel will take care of that.
+                         */
+                        if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK) && !localaddr_f &&
+                            is_eq_in6_addr(&(pkt_ns->nd_ns_target), &(idata.srcaddr))) {
+                            if (send_neighbor_advert(&idata, idata.pfd, pktdata) == -1) {
+                                puts("Error sending Neighbor Advertisement");
+                                exit(EXIT_FAILURE);
                             }
                         }
-                        else if ((pkt_icmp6->icmp6_type == ICMP6_ECHO_REPLY) ||
-                                 (pkt_icmp6->icmp6_type == ICMP6_TIME_EXCEEDED)) {
-                            if ((pkt_end - (unsigned char *)pkt_icmp6) < sizeof(struct icmp6_hdr)) {
-                                continue;
-                            }
-                            /*
-                               Do a preliminar validation check on the ICMPv6 packet (packet size, Source Address,
-                               and Destination Address).
-                             */
-                            if (!valid_icmp6_response(&idata, pkthdr, pktdata)) {
-                                continue;
-                            }
+                    }
+                    else if ((pkt_icmp6->icmp6_type == ICMP6_ECHO_REPLY) ||
+                             (pkt_icmp6->icmp6_type == ICMP6_TIME_EXCEEDED)) {
+                        if ((pkt_end - (unsigned char *)pkt_icmp6) < sizeof(struct icmp6_hdr)) {
+                            continue;
+                        }
+                        /*
+                           Do a preliminar validation check on the ICMPv6 packet (packet size, Source Address,
+                           and Destination Address).
+                         */
+                        if (!valid_icmp6_response(&idata, &pview)) {
+                            continue;
+                        }
 
-                            switch (pkt_icmp6->icmp6_type) {
-                            case ICMP6_ECHO_REPLY:
-                                gotresp_f = TRUE;
+                        switch (pkt_icmp6->icmp6_type) {
+                        case ICMP6_ECHO_REPLY:
+                            gotresp_f = TRUE;
 
-                                if (resp_f)
-                                    print_icmp6_echo(&idata, pkthdr, pktdata);
+                            if (resp_f)
+                                print_icmp6_echo(&idata, &pview);
 
-                                break;
+                            break;
 
-                            case ICMP6_TIME_EXCEEDED:
-                                gotresp_f = TRUE;
+                        case ICMP6_TIME_EXCEEDED:
+                            gotresp_f = TRUE;
 
-                                if (resp_f)
-                                    print_icmp6_timed(&idata, pkthdr, pktdata);
+                            if (resp_f)
+                                print_icmp6_timed(&idata, &pview);
 
-                                break;
-                            }
+                            break;
                         }
                     }
                 }
+
+                if (r == -1) {
+                    printf("pcap_next_ex(): %s", pcap_geterr(idata.pfd));
+                    exit(EXIT_FAILURE);
+                }
+                else if (r == PCAP_ERROR_BREAK) {
+                    /* End of the savefile (see open_rx_replay()) */
+                    break;
+                }
             }
         }
 
@@ -1419,18 +1493,18 @@ int main(int argc, char **argv) {
  *
  * Print information about a received ICMPv6 Echo Response packet
  */
-void print_icmp6_echo(struct iface_data *idata, struct pcap_pkthdr *pkthdr, const u_char *pktdata) {
+void print_icmp6_echo(struct iface_data *idata, struct packet_view *view) {
     struct ip6_hdr *pkt_ipv6;
     time_t rtt;
 
-    pkt_ipv6 = (struct ip6_hdr *)(pktdata + idata->linkhsize);
+    pkt_ipv6 = view->ipv6;
 
     if (inet_ntop(AF_INET6, &(pkt_ipv6->ip6_src), pv6addr, sizeof(pv6addr)) == NULL) {
         puts("inet_ntop(): Error converting IPv6 Source Address to presentation format");
         exit(EXIT_FAILURE);
     }
 
-    rtt = time(NULL) - *(time_t *)((unsigned char *)pkt_ipv6 + (sizeof(struct ip6_hdr) + sizeof(struct icmp6_hdr)));
+    rtt = time(NULL) - *(time_t *)(view->upper + sizeof(struct icmp6_hdr));
     printf("ICMPv6 echo Reply from %s", pv6addr);
     if (rtt > 0)
         printf(" (RTT: %u second%s)\n", (uint32_t)rtt, (rtt > 1) ? "s" : "");
@@ -1443,7 +1517,7 @@ void print_icmp6_echo(struct iface_data *idata, struct pcap_pkthdr *pkthdr, cons
  *
  * Print information about a received ICMPv6 Time Exceeded error message
  */
-void print_icmp6_timed(struct iface_data *idata, struct pcap_pkthdr *pkthdr, const u_char *pktdata) {
+void print_icmp6_timed(struct iface_data *idata, struct packet_view *view) {
     struct ip6_hdr *pkt_ipv6, *pkt_ipv6_ipv6;
     struct icmp6_hdr *pkt_icmp6, *pkt_icmp6_icmp6;
     struct ip6_ext *pkt_ext;
@@ -1451,8 +1525,8 @@ void print_icmp6_timed(struct iface_data *idata, struct pcap_pkthdr *pkthdr, con
     uint8_t pkt_prev_nh;
     time_t rtt;
 
-    pkt_ipv6 = (struct ip6_hdr *)(pktdata + idata->linkhsize);
-    pkt_icmp6 = (struct icmp6_hdr *)((unsigned char *)pkt_ipv6 + sizeof(struct ip6_hdr));
+    pkt_ipv6 = view->ipv6;
+    pkt_icmp6 = (struct icmp6_hdr *)view->upper;
     pkt_ipv6_ipv6 = (struct ip6_hdr *)((unsigned char *)pkt_icmp6 + sizeof(struct icmp6_hdr));
     pkt_fh_fh = NULL;
     pkt_ext = (struct ip6_ext *)((unsigned char *)pkt_ipv6_ipv6 + sizeof(struct ip6_hdr));
@@ -1526,16 +1600,14 @@ void print_icmp6_timed(struct iface_data *idata, struct pcap_pkthdr *pkthdr, con
  * Process ICMPv6 echo reply messages received in response to our probe packets that investigate
  * the fragment reassembly policy of a target
  */
-void process_icmp6_echo(struct iface_data *idata, struct pcap_pkthdr *pkthdr, const u_char *pktdata,
-                        unsigned char *test, unsigned int *responses) {
-    struct ip6_hdr *pkt_ipv6;
+void process_icmp6_echo(struct iface_data *idata, struct packet_view *view, unsigned char *test,
+                        unsigned int *responses) {
     struct icmp6_hdr *pkt_icmp6;
 
-    pkt_ipv6 = (struct ip6_hdr *)(pktdata + idata->linkhsize);
-    pkt_icmp6 = (struct icmp6_hdr *)((unsigned char *)pkt_ipv6 + sizeof(struct ip6_hdr));
+    pkt_icmp6 = (struct icmp6_hdr *)view->upper;
 
     if (test_frag_pattern(((unsigned char *)pkt_icmp6 + sizeof(struct icmp6_hdr)), FRAG_BLOCK_SIZE, block1)) {
-        if (!valid_icmp6_response2(idata, pkthdr, pktdata,
+        if (!valid_icmp6_response2(idata, view,
                                    sizeof(struct ip6_hdr) + sizeof(struct icmp6_hdr) + minfragsize * 2 - overlap)) {
             return;
         }
@@ -1555,7 +1627,7 @@ void process_icmp6_echo(struct iface_data *idata, struct pcap_pkthdr *pkthdr, co
         (*responses)++;
     }
     else if (test_frag_pattern(((unsigned char *)pkt_icmp6 + sizeof(struct icmp6_hdr)), FRAG_BLOCK_SIZE, block2)) {
-        if (!valid_icmp6_response2(idata, pkthdr, pktdata,
+        if (!valid_icmp6_response2(idata, view,
                                    sizeof(struct ip6_hdr) + sizeof(struct icmp6_hdr) + minfragsize * 3 - overlap)) {
             return;
         }
@@ -1575,7 +1647,7 @@ void process_icmp6_echo(struct iface_data *idata, struct pcap_pkthdr *pkthdr, co
         (*responses)++;
     }
     else if (test_frag_pattern(((unsigned char *)pkt_icmp6 + sizeof(struct icmp6_hdr)), FRAG_BLOCK_SIZE, block3)) {
-        if (!valid_icmp6_response2(idata, pkthdr, pktdata,
+        if (!valid_icmp6_response2(idata, view,
                                    sizeof(struct ip6_hdr) + sizeof(struct icmp6_hdr) + minfragsize * 3 - overlap)) {
             return;
         }
@@ -1595,7 +1667,7 @@ void process_icmp6_echo(struct iface_data *idata, struct pcap_pkthdr *pkthdr, co
         (*responses)++;
     }
     else if (test_frag_pattern(((unsigned char *)pkt_icmp6 + sizeof(struct icmp6_hdr)), FRAG_BLOCK_SIZE, block4)) {
-        if (!valid_icmp6_response2(idata, pkthdr, pktdata,
+        if (!valid_icmp6_response2(idata, view,
                                    sizeof(struct ip6_hdr) + sizeof(struct icmp6_hdr) + minfragsize * 4)) {
             return;
         }
@@ -1615,7 +1687,7 @@ void process_icmp6_echo(struct iface_data *idata, struct pcap_pkthdr *pkthdr, co
         (*responses)++;
     }
     else if (test_frag_pattern(((unsigned char *)pkt_icmp6 + sizeof(struct icmp6_hdr)), FRAG_BLOCK_SIZE, block5)) {
-        if (!valid_icmp6_response2(idata, pkthdr, pktdata,
+        if (!valid_icmp6_response2(idata, view,
                                    sizeof(struct ip6_hdr) + sizeof(struct icmp6_hdr) + minfragsize * 4 - overlap)) {
             return;
         }
@@ -1646,16 +1718,14 @@ void process_icmp6_echo(struct iface_data *idata, struct pcap_pkthdr *pkthdr, co
  * Process ICMPv6 Time Exceeded messages received in response to our probe packets that investigate
  * the fragment reassembly policy of a target
  */
-void process_icmp6_timed(struct iface_data *idata, struct pcap_pkthdr *pkthdr, const u_char *pktdata,
-                         unsigned char *test) {
-    struct ip6_hdr *pkt_ipv6, *pkt_ipv6_ipv6;
+void process_icmp6_timed(struct iface_data *idata, struct packet_view *view, unsigned char *test) {
+    struct ip6_hdr *pkt_ipv6_ipv6;
     struct icmp6_hdr *pkt_icmp6, *pkt_icmp6_icmp6;
     struct ip6_ext *pkt_ext;
     struct ip6_frag *pkt_fh_fh;
     uint8_t pkt_prev_nh;
 
-    pkt_ipv6 = (struct ip6_hdr *)(pktdata + idata->linkhsize);
-    pkt_icmp6 = (struct icmp6_hdr *)((unsigned char *)pkt_ipv6 + sizeof(struct ip6_hdr));
+    pkt_icmp6 = (struct icmp6_hdr *)view->upper;
     pkt_ipv6_ipv6 = (struct ip6_hdr *)((unsigned char *)pkt_icmp6 + sizeof(struct icmp6_hdr));
     pkt_fh_fh = NULL;
     pkt_ext = (struct ip6_ext *)((unsigned char *)pkt_ipv6_ipv6 + sizeof(struct ip6_hdr));
@@ -1702,7 +1772,7 @@ void process_icmp6_timed(struct iface_data *idata, struct pcap_pkthdr *pkthdr, c
     }
 
     if (test_frag_pattern(((unsigned char *)pkt_icmp6_icmp6 + sizeof(struct icmp6_hdr)), FRAG_BLOCK_SIZE, block1)) {
-        if (!valid_icmp6_response2(idata, pkthdr, pktdata,
+        if (!valid_icmp6_response2(idata, view,
                                    sizeof(struct ip6_hdr) + sizeof(struct icmp6_hdr) + sizeof(struct ip6_frag) +
                                        sizeof(struct ip6_hdr) + sizeof(struct icmp6_hdr) + minfragsize)) {
 
@@ -1714,7 +1784,7 @@ void process_icmp6_timed(struct iface_data *idata, struct pcap_pkthdr *pkthdr, c
     }
     else if (test_frag_pattern(((unsigned char *)pkt_icmp6_icmp6 + sizeof(struct icmp6_hdr)), FRAG_BLOCK_SIZE,
                                block2)) {
-        if (!valid_icmp6_response2(idata, pkthdr, pktdata,
+        if (!valid_icmp6_response2(idata, view,
                                    sizeof(struct ip6_hdr) + sizeof(struct icmp6_hdr) + sizeof(struct ip6_frag) +
                                        sizeof(struct ip6_hdr) + sizeof(struct icmp6_hdr) + minfragsize)) {
             return;
@@ -1724,7 +1794,7 @@ void process_icmp6_timed(struct iface_data *idata, struct pcap_pkthdr *pkthdr, c
     }
     else if (test_frag_pattern(((unsigned char *)pkt_icmp6_icmp6 + sizeof(struct icmp6_hdr)), FRAG_BLOCK_SIZE,
                                block3)) {
-        if (!valid_icmp6_response2(idata, pkthdr, pktdata,
+        if (!valid_icmp6_response2(idata, view,
                                    sizeof(struct ip6_hdr) + sizeof(struct icmp6_hdr) + sizeof(struct ip6_frag) +
                                        sizeof(struct ip6_hdr) + sizeof(struct icmp6_hdr) + minfragsize)) {
             return;
@@ -1734,7 +1804,7 @@ void process_icmp6_timed(struct iface_data *idata, struct pcap_pkthdr *pkthdr, c
     }
     else if (test_frag_pattern(((unsigned char *)pkt_icmp6_icmp6 + sizeof(struct icmp6_hdr)), FRAG_BLOCK_SIZE,
                                block4)) {
-        if (!valid_icmp6_response2(idata, pkthdr, pktdata,
+        if (!valid_icmp6_response2(idata, view,
                                    sizeof(struct ip6_hdr) + sizeof(struct icmp6_hdr) + sizeof(struct ip6_frag) +
                                        sizeof(struct ip6_hdr) + sizeof(struct icmp6_hdr) + minfragsize)) {
             return;
@@ -1744,7 +1814,7 @@ void process_icmp6_timed(struct iface_data *idata, struct pcap_pkthdr *pkthdr, c
     }
     else if (test_frag_pattern(((unsigned char *)pkt_icmp6_icmp6 + sizeof(struct icmp6_hdr)), FRAG_BLOCK_SIZE,
                                block5)) {
-        if (!valid_icmp6_response2(idata, pkthdr, pktdata,
+        if (!valid_icmp6_response2(idata, view,
                                    sizeof(struct ip6_hdr) + sizeof(struct icmp6_hdr) + sizeof(struct ip6_frag) +
                                        sizeof(struct ip6_hdr) + sizeof(struct icmp6_hdr) + minfragsize)) {
             return;
@@ -1885,13 +1955,13 @@ int send_fragment2(struct iface_data *idata, uint16_t ip6len, unsigned int id, u
         ipv6->ip6_plen = htons(ptr - (v6buffer + MIN_IPV6_HLEN));
     }
 
-    if ((nw = pcap_inject(idata->pfd, buffer, ptr - buffer)) == -1) {
-        printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+    if ((nw = send_frame(idata, buffer, ptr - buffer)) == -1) {
+        printf("send_frame(): %s\n", send_frame_error(idata));
         return (-1);
     }
 
     if (nw != (ptr - buffer)) {
-        printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+        printf("send_frame(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
         return (-1);
     }
 
@@ -1906,7 +1976,6 @@ int send_fragment2(struct iface_data *idata, uint16_t ip6len, unsigned int id, u
 int send_fragment(struct iface_data *idata, unsigned int id, unsigned int offset, unsigned int fsize,
                   unsigned int forder, unsigned int tstamp_f) {
     uint32_t tstamp;
-    unsigned int i;
 
     ethernet = (struct ether_header *)buffer;
     dlt_null = (struct dlt_null *)buffer;
@@ -2080,10 +2149,8 @@ int send_fragment(struct iface_data *idata, unsigned int id, unsigned int offset
                 fsize = 0;
         }
 
-        for (i = 0; i < (fsize / 4); i++) {
-            *(uint32_t *)ptr = random();
-            ptr += sizeof(uint32_t);
-        }
+        prng_fill(thread_prng(), ptr, (fsize / sizeof(uint32_t)) * sizeof(uint32_t));
+        ptr += (fsize / sizeof(uint32_t)) * sizeof(uint32_t);
 
         ipv6->ip6_plen = htons(ptr - (v6buffer + MIN_IPV6_HLEN));
         icmp6->icmp6_cksum = in_chksum(v6buffer, icmp6, ptr - ((unsigned char *)icmp6), IPPROTO_ICMPV6);
@@ -2116,21 +2183,19 @@ int send_fragment(struct iface_data *idata, unsigned int id, unsigned int offset
             return (-1);
         }
 
-        for (i = 0; i < (fsize / sizeof(uint32_t)); i++) {
-            *(uint32_t *)ptr = random();
-            ptr += sizeof(uint32_t);
-        }
+        prng_fill(thread_prng(), ptr, (fsize / sizeof(uint32_t)) * sizeof(uint32_t));
+        ptr += (fsize / sizeof(uint32_t)) * sizeof(uint32_t);
 
         ipv6->ip6_plen = htons(ptr - (v6buffer + MIN_IPV6_HLEN));
     }
 
-    if ((nw = pcap_inject(idata->pfd, buffer, ptr - buffer)) == -1) {
-        printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+    if ((nw = send_frame(idata, buffer, ptr - buffer)) == -1) {
+        printf("send_frame(): %s\n", send_frame_error(idata));
         return (-1);
     }
 
     if (nw != (ptr - buffer)) {
-        printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+        printf("send_frame(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
         return (-1);
     }
 
@@ -2218,7 +2283,7 @@ int send_fid_probe(struct iface_data *idata) {
     fptr = fptr + (fragpart - buffer);
 
     fh = (struct ip6_frag *)(fragbuffer + idata->linkhsize + sizeof(struct ip6_hdr));
-    fh->ip6f_ident = random();
+    fh->ip6f_ident = prng_random32();
     startoffragment = fptr;
 
     /* We'll be sending packets of at most 1280 bytes (the IPv6 minimum MTU) */
@@ -2252,13 +2317,13 @@ int send_fid_probe(struct iface_data *idata) {
 
         fipv6->ip6_plen = htons((fptr - fragbuffer) - MIN_IPV6_HLEN - idata->linkhsize);
 
-        if ((nw = pcap_inject(idata->pfd, fragbuffer, fptr - fragbuffer)) == -1) {
-            printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+        if ((nw = send_frame(idata, fragbuffer, fptr - fragbuffer)) == -1) {
+            printf("send_frame(): %s\n", send_frame_error(idata));
             return (-1);
         }
 
         if (nw != (fptr - fragbuffer)) {
-            printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+            printf("send_frame(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
             return (-1);
         }
     } /* Sending fragments */
@@ -2276,7 +2341,8 @@ void usage(void) {
          "       [-s SRC_ADDR[/LEN]] [-A HOP_LIMIT] [-u DST_OPT_HDR_SIZE]\n"
          "       [-U DST_OPT_U_HDR_SIZE] [-H HBH_OPT_HDR_SIZE] [-P FRAG_SIZE]\n"
          "       [-O FRAG_TYPE] [-o FRAG_OFFSET] [-I FRAG_ID] [-T] [-n]\n"
-         "       [-p | -W | -X | -F N_FRAGS] [-l] [-z SECONDS] [-v] [-h]");
+         "       [-p | -W | -X | -F N_FRAGS] [-l] [-z SECONDS] [-Y PCAP_FILE | --dry-run]\n"
+         "       [--read-pcap PCAP_FILE] [-v] [-h]");
 }
 
 /*
@@ -2311,6 +2377,9 @@ void print_help(void) {
          "  --flood-frags, -F         Flood target with IPv6 fragments\n"
          "  --loop, -l                Send IPv6 fragments periodically\n"
          "  --sleep, -z               Pause between sending IPv6 fragments\n"
+         "  --write-pcap, -Y          Write the packets to a pcap savefile, rather than sending them\n"
+         "  --dry-run                 Discard the packets, rather than sending them\n"
+         "  --read-pcap               Read the incoming packets from a pcap savefile\n"
          "  --verbose, -v             Be verbose\n"
          "  --help, -h                Print help for the frag6 tool\n"
          "\n"
@@ -2381,9 +2450,8 @@ void print_attack_info(struct iface_data *idata) {
  * Checks whether the response to an ICMPv6 probe is valid
  */
 
-int valid_icmp6_response(struct iface_data *idata, struct pcap_pkthdr *pkthdr, const u_char *pktdata) {
+int valid_icmp6_response(struct iface_data *idata, struct packet_view *view) {
 
-    struct ether_header *pkt_ether;
     struct ip6_hdr *pkt_ipv6, *pkt_ipv6_ipv6;
     struct ip6_ext *pkt_ext;
     struct icmp6_hdr *pkt_icmp6, *pkt_icmp6_icmp6;
@@ -2392,19 +2460,12 @@ int valid_icmp6_response(struct iface_data *idata, struct pcap_pkthdr *pkthdr, c
     uint8_t pkt_prev_nh;
     unsigned int minfragsize;
 
-    pkt_ether = (struct ether_header *)pktdata;
-    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata->linkhsize);
-    pkt_icmp6 = (struct icmp6_hdr *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
+    /* The caller has dissected the packet (see dissect_packet()), so Extension Headers have been skipped */
+    pkt_ipv6 = view->ipv6;
+    pkt_icmp6 = (struct icmp6_hdr *)view->upper;
     pkt_icmp6_icmp6 = (struct icmp6_hdr *)((unsigned char *)pkt_icmp6 + sizeof(struct icmp6_hdr) +
                                            sizeof(struct ip6_hdr) + MIN_HBH_LEN);
-
-    pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
-
-    /* The packet length is the minimum of what we capured, and what is specified in the
-       IPv6 Total Lenght field
-     */
-    if (pkt_end > ((unsigned char *)pkt_icmp6 + ntohs(pkt_ipv6->ip6_plen)))
-        pkt_end = (unsigned char *)pkt_icmp6 + ntohs(pkt_ipv6->ip6_plen);
+    pkt_end = view->end;
 
     switch (pkt_icmp6->icmp6_type) {
     case ICMP6_ECHO_REPLY:
@@ -2542,10 +2603,8 @@ int valid_icmp6_response(struct iface_data *idata, struct pcap_pkthdr *pkthdr, c
  * Checks whether the response to an ICMPv6 probe (for identifying the fragment reassembly policy) is valid
  */
 
-int valid_icmp6_response2(struct iface_data *idata, struct pcap_pkthdr *pkthdr, const u_char *pktdata,
-                          unsigned int minsize) {
+int valid_icmp6_response2(struct iface_data *idata, struct packet_view *view, unsigned int minsize) {
 
-    struct ether_header *pkt_ether;
     struct ip6_hdr *pkt_ipv6, *pkt_ipv6_ipv6;
     struct ip6_ext *pkt_ext;
     struct icmp6_hdr *pkt_icmp6, *pkt_icmp6_icmp6;
@@ -2553,17 +2612,10 @@ int valid_icmp6_response2(struct iface_data *idata, struct pcap_pkthdr *pkthdr,
     unsigned char *pkt_end;
     uint8_t pkt_prev_nh;
 
-    pkt_ether = (struct ether_header *)pktdata;
-    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata->linkhsize);
-    pkt_icmp6 = (struct icmp6_hdr *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
-
-    pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
-
-    /* The packet length is the minimum of what we capured, and what is specified in the
-       IPv6 Total Lenght field
-     */
-    if (pkt_end > ((unsigned char *)pkt_icmp6 + ntohs(pkt_ipv6->ip6_plen)))
-        pkt_end = (unsigned char *)pkt_icmp6 + ntohs(pkt_ipv6->ip6_plen);
+    /* The caller has dissected the packet (see dissect_packet()), so Extension Headers have been skipped */
+    pkt_ipv6 = view->ipv6;
+    pkt_icmp6 = (struct icmp6_hdr *)view->upper;
+    pkt_end = view->end;
 
     switch (pkt_icmp6->icmp6_type) {
     case ICMP6_ECHO_REPLY:
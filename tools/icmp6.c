@@ -111,6 +111,7 @@ unsigned int pktbytes;
 bpf_u_int32 my_netmask;
 bpf_u_int32 my_ip;
 struct bpf_program pcap_filter;
+const char *pcapfilter;
 char dev[64], errbuf[PCAP_ERRBUF_SIZE];
 unsigned char buffer[PACKET_BUFFER_SIZE], buffrh[MIN_IPV6_HLEN + MIN_TCP_HLEN];
 unsigned char *v6buffer, *ptr, *startofprefixes;
@@ -208,6 +209,7 @@ int main(int argc, char **argv) {
                                        {"accept-dst-addr", required_argument, 0, 'g'},
                                        {"accept-link-src-addr", required_argument, 0, 'B'},
                                        {"accept-link-dst-addr", required_argument, 0, 'G'},
+                                       {"filter-file", required_argument, 0, 'I'},
                                        {"sanity-filters", no_argument, 0, 'f'},
                                        {"loop", no_argument, 0, 'l'},
                                        {"sleep", required_argument, 0, 'z'},
@@ -945,6 +947,14 @@ int main(int argc, char **argv) {
             filters.acceptfilters_f = 1;
             break;
 
+        case 'I': /* Address filters from a file */
+            if (load_filter_file(&filters, optarg) == FAILURE) {
+                printf("Error while loading address filters from file %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+
+            break;
+
         case 'f': /* Sanity filters */
             sanityfilters_f = 1;
             break;
@@ -1124,25 +1134,16 @@ int main(int argc, char **argv) {
         break;
     }
 
-    if (rhtcp_f) {
-        if (pcap_compile(idata.pfd, &pcap_filter, PCAP_TCPV6_FILTER, PCAP_OPT, PCAP_NETMASK_UNKNOWN) == -1) {
-            printf("pcap_compile(): %s", pcap_geterr(idata.pfd));
-            exit(EXIT_FAILURE);
-        }
-    }
-    else if (rhudp_f) {
-        if (pcap_compile(idata.pfd, &pcap_filter, PCAP_UDPV6_FILTER, PCAP_OPT, PCAP_NETMASK_UNKNOWN) == -1) {
-            printf("pcap_compile(): %s", pcap_geterr(idata.pfd));
-            exit(EXIT_FAILURE);
-        }
-    }
-    else if (rhicmp6_f) {
-        if (pcap_compile(idata.pfd, &pcap_filter, PCAP_ICMPV6_FILTER, PCAP_OPT, PCAP_NETMASK_UNKNOWN) == -1) {
-            printf("pcap_compile(): %s", pcap_geterr(idata.pfd));
-            exit(EXIT_FAILURE);
-        }
-    }
-    else if (pcap_compile(idata.pfd, &pcap_filter, PCAP_IPV6_FILTER, PCAP_OPT, PCAP_NETMASK_UNKNOWN) == -1) {
+    if (rhtcp_f)
+        pcapfilter = PCAP_TCPV6_FILTER;
+    else if (rhudp_f)
+        pcapfilter = PCAP_UDPV6_FILTER;
+    else if (rhicmp6_f)
+        pcapfilter = PCAP_ICMPV6_FILTER;
+    else
+        pcapfilter = PCAP_IPV6_FILTER;
+
+    if (pcap_compile(idata.pfd, &pcap_filter, pcapfilter, PCAP_OPT, PCAP_NETMASK_UNKNOWN) == -1) {
         printf("pcap_compile(): %s", pcap_geterr(idata.pfd));
         exit(EXIT_FAILURE);
     }
@@ -1180,6 +1181,16 @@ int main(int argc, char **argv) {
     }
 
     if (listen_f) {
+        if (compile_filters(&filters) == FAILURE) {
+            puts("Error while compiling the address filters");
+            exit(EXIT_FAILURE);
+        }
+
+        if (set_filters_bpf(&idata, &filters, pcapfilter) == FAILURE) {
+            puts("Error while pushing the address filters into the capture filter");
+            exit(EXIT_FAILURE);
+        }
+
         if (idata.verbose_f) {
             print_filters(&idata, &filters);
             if (rhtcp_f) {
@@ -1254,9 +1265,8 @@ int main(int argc, char **argv) {
                         }
                     }
 
-                    if (filters.nblocksrc) {
-                        if (match_ipv6(filters.blocksrc, filters.blocksrclen, filters.nblocksrc,
-                                       &(pkt_ipv6->ip6_src))) {
+                    if (filters.blocksrctrie.nprefix) {
+                        if (match_prefix_trie(&(filters.blocksrctrie), &(pkt_ipv6->ip6_src))) {
                             if (idata.verbose_f > 1)
                                 print_filter_result(&idata, pktdata, BLOCKED);
 
@@ -1264,9 +1274,8 @@ int main(int argc, char **argv) {
                         }
                     }
 
-                    if (filters.nblockdst) {
-                        if (match_ipv6(filters.blockdst, filters.blockdstlen, filters.nblockdst,
-                                       &(pkt_ipv6->ip6_dst))) {
+                    if (filters.blockdsttrie.nprefix) {
+                        if (match_prefix_trie(&(filters.blockdsttrie), &(pkt_ipv6->ip6_dst))) {
                             if (idata.verbose_f > 1)
                                 print_filter_result(&idata, pktdata, BLOCKED);
 
@@ -1286,15 +1295,13 @@ int main(int argc, char **argv) {
                         }
                     }
 
-                    if (filters.nacceptsrc && !accepted_f) {
-                        if (match_ipv6(filters.acceptsrc, filters.acceptsrclen, filters.nacceptsrc,
-                                       &(pkt_ipv6->ip6_src)))
+                    if (filters.acceptsrctrie.nprefix && !accepted_f) {
+                        if (match_prefix_trie(&(filters.acceptsrctrie), &(pkt_ipv6->ip6_src)))
                             accepted_f = 1;
                     }
 
-                    if (filters.nacceptdst && !accepted_f) {
-                        if (match_ipv6(filters.acceptdst, filters.acceptdstlen, filters.nacceptdst,
-                                       &(pkt_ipv6->ip6_dst)))
+                    if (filters.acceptdsttrie.nprefix && !accepted_f) {
+                        if (match_prefix_trie(&(filters.acceptdsttrie), &(pkt_ipv6->ip6_dst)))
                             accepted_f = 1;
                     }
 
@@ -1742,7 +1749,7 @@ void send_packet(struct iface_data *idata, const u_char *pktdata, struct pcap_pk
 
                 memcpy(fptr, (char *)&fraghdr, FRAG_HDR_SIZE);
                 fh = (struct ip6_frag *)fptr;
-                fh->ip6f_ident = random();
+                fh->ip6f_ident = prng_random32();
                 startoffragment = fptr + FRAG_HDR_SIZE;
 
                 /*
@@ -1861,6 +1868,7 @@ void print_help(void) {
          "  --accept-dst, -g            Accept IPv6 Destination Address prefix\n"
          "  --accept-link-src, -B       Accept Ethernet Source Address\n"
          "  --accept-link-dst, -G       Accept Ethernet Destination Address\n"
+         "  --filter-file               Load address filters from a file\n"
          "  --sanity-filters, -f        Add sanity filters\n"
          "  --listen, -L                Listen to incoming traffic\n"
          "  --loop, -l                  Send periodic ICMPv6 error messages\n"
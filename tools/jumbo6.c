@@ -919,7 +919,7 @@ int send_packet(struct iface_data *idata, struct pcap_pkthdr *pkthdr, const u_ch
         /* Copy the Fragmentation Header */
         memcpy(fptr, (char *)&fraghdr, FRAG_HDR_SIZE);
         fh = (struct ip6_frag *)fptr;
-        fh->ip6f_ident = random();
+        fh->ip6f_ident = prng_random32();
         startoffragment = fptr + FRAG_HDR_SIZE;
 
         /*
@@ -25,6 +25,10 @@
  * Please send any bug reports to Fernando Gont <fgont@si6networks.com>
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE /* For sendmmsg() */
+#endif
+
 #include <sys/param.h>
 #include <sys/select.h>
 #include <sys/socket.h>
@@ -50,11 +54,11 @@
 #endif
 
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <math.h>
 #include <pcap.h>
 #include <pwd.h>
-#include <setjmp.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -65,9 +69,27 @@
 #include "ipv6toolkit.h"
 #include "libipv6.h"
 
-/* IPv6 Address Resolution */
-static sigjmp_buf env;
-static unsigned int canjump;
+/* Frames written to a savefile rather than sent (see open_tx_dump()) */
+static struct iface_data *txdump_idata;
+static volatile sig_atomic_t txdump_stop;
+
+/* Frames read from a savefile rather than captured (see open_rx_replay()) */
+static struct iface_data *rxreplay_idata;
+
+/* Runtime metrics printed when the tool exits (see init_metrics()) */
+static struct metrics *exit_metrics;
+static volatile sig_atomic_t metrics_stop;
+
+/* Pseudorandom number generator of the calling thread (see thread_prng()) */
+static __thread struct prng tprng;
+
+/* Neighbor cache shared by the tools (see load_neighbor_cache()) */
+static struct neighbor_cache ncache;
+
+#ifdef __linux__
+/* Snapshot of the kernel routing table (see lookup_route_table()) */
+static struct route_table rtable;
+#endif
 
 #ifdef __linux__
 /* Netlink requests */
@@ -495,6 +517,266 @@ const char *inet_ntof(int family, const void *src, char *dst, socklen_t size) {
         return NULL;
 }
 
+/*
+ * Function: ipv6_pton()
+ *
+ * Converts an IPv6 address from presentation to network format. It accepts exactly the same strings as
+ * inet_pton(AF_INET6, ...) (including an embedded IPv4 address in dotted-decimal notation), but is considerably
+ * faster, since hex digits are decoded with a lookup table. Returns 1 on success, or 0 if the string is not a valid
+ * IPv6 address.
+ */
+
+int ipv6_pton(const char *src, struct in6_addr *dst) {
+    static const signed char hexval[256] = {
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+         0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+        -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
+    unsigned char tmp[16], *tp, *colonp = NULL, *endp;
+    const unsigned char *p, *curtok;
+    unsigned int val = 0, xdigits = 0, octets, octet;
+    unsigned char sawdigit_f;
+    int digit, ch;
+    size_t n;
+
+    p = (const unsigned char *)src;
+    tp = tmp;
+    endp = tmp + sizeof(tmp);
+
+    /* A leading "::" requires some special handling */
+    if (*p == ':') {
+        if (*(++p) != ':')
+            return (0);
+    }
+
+    curtok = p;
+
+    while ((ch = *p++) != '\0') {
+        if ((digit = hexval[ch]) >= 0) {
+            if (xdigits == 4)
+                return (0);
+
+            val = (val << 4) | digit;
+            xdigits++;
+            continue;
+        }
+
+        if (ch == ':') {
+            curtok = p;
+
+            if (xdigits == 0) {
+                if (colonp != NULL)
+                    return (0);
+
+                colonp = tp;
+                continue;
+            }
+            else if (*p == '\0') {
+                return (0);
+            }
+
+            if (tp > (endp - 2))
+                return (0);
+
+            *tp++ = val >> 8;
+            *tp++ = val & 0xff;
+            xdigits = 0;
+            val = 0;
+            continue;
+        }
+
+        /* An embedded IPv4 address must be the last token, and it must fit in the remaining space */
+        if (ch == '.' && tp <= (endp - 4)) {
+            octets = 0;
+            octet = 0;
+            sawdigit_f = FALSE;
+
+            for (p = curtok; (ch = *p) != '\0'; p++) {
+                if (ch >= '0' && ch <= '9') {
+                    /* Leading zeros are not allowed */
+                    if (sawdigit_f && octet == 0)
+                        return (0);
+
+                    if ((octet = octet * 10 + (ch - '0')) > 255)
+                        return (0);
+
+                    if (!sawdigit_f) {
+                        if (++octets > 4)
+                            return (0);
+
+                        sawdigit_f = TRUE;
+                    }
+                }
+                else if (ch == '.' && sawdigit_f) {
+                    if (octets == 4)
+                        return (0);
+
+                    *tp++ = octet;
+                    octet = 0;
+                    sawdigit_f = FALSE;
+                }
+                else {
+                    return (0);
+                }
+            }
+
+            if (octets < 4)
+                return (0);
+
+            *tp++ = octet;
+            xdigits = 0;
+            break;
+        }
+
+        return (0);
+    }
+
+    if (xdigits > 0) {
+        if (tp > (endp - 2))
+            return (0);
+
+        *tp++ = val >> 8;
+        *tp++ = val & 0xff;
+    }
+
+    if (colonp != NULL) {
+        /* "::" cannot stand for a zero-length sequence of 16-bit words */
+        if (tp == endp)
+            return (0);
+
+        n = tp - colonp;
+        memmove(endp - n, colonp, n);
+        memset(colonp, 0, (endp - n) - colonp);
+        tp = endp;
+    }
+
+    if (tp != endp)
+        return (0);
+
+    memcpy(dst, tmp, sizeof(tmp));
+    return (1);
+}
+
+/*
+ * Function: ipv6_ntop()
+ *
+ * Converts an IPv6 address from network to presentation format, producing the same (RFC 5952) string as
+ * inet_ntop(AF_INET6, ...). dst must be at least INET6_ADDRSTRLEN bytes long. Returns the length of the string.
+ */
+
+size_t ipv6_ntop(const struct in6_addr *src, char *dst) {
+    static const char hexdigits[] = "0123456789abcdef";
+    unsigned int words[8], i, base = 8, len = 0, curbase = 0, curlen = 0, w, octet;
+    char *tp = dst;
+
+    for (i = 0; i < 8; i++) {
+        words[i] = (src->s6_addr[i * 2] << 8) | src->s6_addr[i * 2 + 1];
+
+        /* Find the (first) longest run of zero words */
+        if (words[i] == 0) {
+            if (curlen == 0)
+                curbase = i;
+
+            if (++curlen > len) {
+                base = curbase;
+                len = curlen;
+            }
+        }
+        else {
+            curlen = 0;
+        }
+    }
+
+    /* A single zero word is never compressed */
+    if (len < 2)
+        base = 8;
+
+    for (i = 0; i < 8; i++) {
+        if (i >= base && i < (base + len)) {
+            if (i == base)
+                *tp++ = ':';
+
+            continue;
+        }
+
+        if (i != 0)
+            *tp++ = ':';
+
+        /* IPv4-compatible and IPv4-mapped addresses are printed with the IPv4 address in dotted-decimal notation */
+        if (i == 6 && base == 0 && (len == 6 || (len == 5 && words[5] == 0xffff))) {
+            for (w = 12; w < 16; w++) {
+                octet = src->s6_addr[w];
+
+                if (octet >= 100) {
+                    *tp++ = '0' + octet / 100;
+                    *tp++ = '0' + (octet / 10) % 10;
+                }
+                else if (octet >= 10) {
+                    *tp++ = '0' + octet / 10;
+                }
+
+                *tp++ = '0' + octet % 10;
+
+                if (w != 15)
+                    *tp++ = '.';
+            }
+
+            break;
+        }
+
+        w = words[i];
+
+        if (w >= 0x1000)
+            *tp++ = hexdigits[w >> 12];
+        if (w >= 0x100)
+            *tp++ = hexdigits[(w >> 8) & 0xf];
+        if (w >= 0x10)
+            *tp++ = hexdigits[(w >> 4) & 0xf];
+
+        *tp++ = hexdigits[w & 0xf];
+    }
+
+    if (base != 8 && (base + len) == 8)
+        *tp++ = ':';
+
+    *tp = '\0';
+    return (tp - dst);
+}
+
+/*
+ * Function: ipv6_ntop_batch()
+ *
+ * Converts naddrs IPv6 addresses to presentation format (see ipv6_ntop()), one per line, into a single buffer
+ * (such that they can be printed with a single fwrite()). The buffer is not NULL-terminated. Returns the number
+ * of addresses that fit in the buffer, and stores the number of bytes used in "len".
+ */
+
+unsigned int ipv6_ntop_batch(const struct in6_addr *addrs, unsigned int naddrs, char *buf, size_t size, size_t *len) {
+    unsigned int i;
+    size_t used = 0;
+
+    /* Each line (address plus newline) takes at most INET6_ADDRSTRLEN bytes */
+    for (i = 0; i < naddrs && (size - used) >= INET6_ADDRSTRLEN; i++) {
+        used += ipv6_ntop(&(addrs[i]), buf + used);
+        buf[used++] = '\n';
+    }
+
+    *len = used;
+    return (i);
+}
+
 /*
  * Function: ether_multicast()
  *
@@ -620,13 +902,13 @@ int find_ipv6_router_full(pcap_t *pfd, struct iface_data *idata) {
     struct pcap_pkthdr *pkthdr;
     struct bpf_program pcap_filter;
     const u_char *pktdata;
-    struct ether_header *pkt_ether;
+    struct packet_view view;
     struct ip6_hdr *pkt_ipv6;
     struct nd_router_advert *pkt_ra;
     unsigned char *pkt_end;
     unsigned char *prev_nh;
-    volatile unsigned char *ptr;
-    volatile unsigned char *p;
+    unsigned char *ptr;
+    unsigned char *p;
     int nw;
 
     unsigned char buffer[PACKET_BUFFER_SIZE];
@@ -637,9 +919,9 @@ int find_ipv6_router_full(pcap_t *pfd, struct iface_data *idata) {
     struct nd_router_solicit *rs;
     struct nd_opt_slla *sllaopt;
     struct nd_opt_prefix_info *pio;
-    volatile unsigned int tries = 0;
-    volatile unsigned int foundrouter = 0;
-    struct sigaction new_sig, old_sig;
+    struct event_loop loop;
+    unsigned int tries = 0;
+    unsigned int foundrouter = 0;
     unsigned char error_f = 0;
     int result;
 
@@ -724,26 +1006,13 @@ int find_ipv6_router_full(pcap_t *pfd, struct iface_data *idata) {
     rs->nd_rs_cksum = 0;
     rs->nd_rs_cksum = in_chksum(v6buffer, rs, ptr - ((unsigned char *)rs), IPPROTO_ICMPV6);
 
-    /* We set the signal handler, and the anchor for siglongjump() */
-    canjump = 0;
-    memset(&new_sig, 0, sizeof(struct sigaction));
-    sigemptyset(&new_sig.sa_mask);
-    new_sig.sa_handler = &sig_alarm;
-
-    alarm(0);
-
-    if (sigaction(SIGALRM, &new_sig, &old_sig) == -1) {
+    if (init_event_loop(&loop, pcap_fileno(pfd), 1) == FAILURE) {
         if (idata->verbose_f > 1)
-            puts("Error setting up 'Alarm' signal");
+            puts("Error while initializing the event loop");
 
         return (-1);
     }
 
-    if (sigsetjmp(env, 1) != 0)
-        tries++;
-
-    canjump = 1;
-
     while (tries < 3 && !foundrouter && !error_f) {
         if ((nw = pcap_inject(pfd, buffer, ptr - buffer)) == -1) {
             if (idata->verbose_f > 1)
@@ -761,33 +1030,36 @@ int find_ipv6_router_full(pcap_t *pfd, struct iface_data *idata) {
             break;
         }
 
-        alarm(idata->local_timeout + 1);
+        set_event_timer(&loop, 0, idata->local_timeout + 1000000);
+        tries++;
 
         while (!foundrouter && !error_f) {
+            if (expired_event_timer(&loop, NULL))
+                break;
 
-            do {
-                if ((result = pcap_next_ex(pfd, &pkthdr, &pktdata)) == -1) {
-                    if (idata->verbose_f > 1)
-                        printf("pcap_next_ex(): %s", pcap_geterr(pfd));
+            if ((result = pcap_next_ex(pfd, &pkthdr, &pktdata)) == -1) {
+                if (idata->verbose_f > 1)
+                    printf("pcap_next_ex(): %s", pcap_geterr(pfd));
+
+                error_f = 1;
+                break;
+            }
 
+            if (result != 1 || pktdata == NULL) {
+                if (wait_event_loop(&loop) == FAILURE)
                     error_f = 1;
-                    break;
-                }
-            } while (result == 0 || pktdata == NULL);
 
-            if (error_f)
-                break;
+                continue;
+            }
 
-            pkt_ether = (struct ether_header *)pktdata;
-            pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + ETHER_HDR_LEN);
-            pkt_ra = (struct nd_router_advert *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
-            pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
+            /* Only complete ICMPv6 packets with a valid checksum are of interest */
+            if (dissect_packet(idata, pktdata, pkthdr, &view, DISSECT_CKSUM) == FAILURE ||
+                view.proto != IPPROTO_ICMPV6 || !(view.flags & PV_CKSUM_OK))
+                continue;
 
-            /* The packet length is the minimum of what we capured, and what is specified in the
-               IPv6 Total Lenght field
-             */
-            if (pkt_end > ((unsigned char *)pkt_ra + ntohs(pkt_ipv6->ip6_plen)))
-                pkt_end = (unsigned char *)pkt_ra + ntohs(pkt_ipv6->ip6_plen);
+            pkt_ipv6 = view.ipv6;
+            pkt_ra = (struct nd_router_advert *)view.upper;
+            pkt_end = view.end;
 
             /*
                Discard the packet if it is not of the minimum size to contain a Router Advertisement
@@ -817,13 +1089,6 @@ int find_ipv6_router_full(pcap_t *pfd, struct iface_data *idata) {
             if (!is_eq_in6_addr(&(pkt_ipv6->ip6_dst), &(ipv6->ip6_src)) && !IN6_IS_ADDR_MULTICAST(&(pkt_ipv6->ip6_dst)))
                 continue;
 
-            /* Check that the ICMPv6 checksum is correct. If the received checksum is valid,
-               and we compute the checksum over the received packet (including the Checksum field)
-               the result is 0. Otherwise, the packet has been corrupted.
-            */
-            if (in_chksum(pkt_ipv6, pkt_ra, pkt_end - (unsigned char *)pkt_ra, IPPROTO_ICMPV6) != 0)
-                continue;
-
             p = (unsigned char *)pkt_ra + sizeof(struct nd_router_advert);
 
             /* Process Router Advertisement options */
@@ -834,7 +1099,7 @@ int find_ipv6_router_full(pcap_t *pfd, struct iface_data *idata) {
                         break;
 
                     /* Got a response, so we shouln't time out */
-                    alarm(0);
+                    cancel_event_timer(&loop, 0);
 
                     /* Save the link-layer address */
                     idata->router_ether = *(struct ether_addr *)(p + 2);
@@ -854,7 +1119,7 @@ int find_ipv6_router_full(pcap_t *pfd, struct iface_data *idata) {
                             !is_ip6_in_prefix_list(&(pio->nd_opt_pi_prefix), &(idata->prefix_ol))) {
 
                             if ((idata->prefix_ol.prefix[idata->prefix_ol.nprefix] =
-                                     malloc(sizeof(struct prefix_entry))) == NULL) {
+                                     arena_alloc(&(idata->prefix_ol.arena), sizeof(struct prefix_entry))) == NULL) {
                                 if (idata->verbose_f > 1)
                                     puts("Error in malloc() while learning prefixes");
 
@@ -881,7 +1146,7 @@ int find_ipv6_router_full(pcap_t *pfd, struct iface_data *idata) {
                             !is_ip6_in_prefix_list(&(pio->nd_opt_pi_prefix), &(idata->prefix_ac))) {
 
                             if ((idata->prefix_ac.prefix[idata->prefix_ac.nprefix] =
-                                     malloc(sizeof(struct prefix_entry))) == NULL) {
+                                     arena_alloc(&(idata->prefix_ac.arena), sizeof(struct prefix_entry))) == NULL) {
                                 if (idata->verbose_f > 1)
                                     puts("Error in malloc() while learning prefixes");
 
@@ -902,8 +1167,8 @@ int find_ipv6_router_full(pcap_t *pfd, struct iface_data *idata) {
 
                             if (!idata->ip6_global_flag && idata->ip6_global.nprefix < idata->ip6_global.maxprefix) {
 
-                                if ((idata->ip6_global.prefix[idata->ip6_global.nprefix] =
-                                         malloc(sizeof(struct prefix_entry))) == NULL) {
+                                if ((idata->ip6_global.prefix[idata->ip6_global.nprefix] = arena_alloc(
+                                         &(idata->ip6_global.arena), sizeof(struct prefix_entry))) == NULL) {
                                     if (idata->verbose_f > 1)
                                         puts("Error in malloc() creating local SLAAC addresses");
 
@@ -938,12 +1203,7 @@ int find_ipv6_router_full(pcap_t *pfd, struct iface_data *idata) {
     if (idata->ip6_global.nprefix)
         idata->ip6_global_flag = 1;
 
-    if (sigaction(SIGALRM, &old_sig, NULL) == -1) {
-        if (idata->verbose_f > 1)
-            puts("Error setting up 'Alarm' signal");
-
-        return (-1);
-    }
+    free_event_loop(&loop);
 
     if (foundrouter)
         return 1;
@@ -960,26 +1220,66 @@ int find_ipv6_router_full(pcap_t *pfd, struct iface_data *idata) {
 unsigned int match_ipv6(struct in6_addr *prefixlist, uint8_t *prefixlen, unsigned int nprefix,
                         struct in6_addr *ipv6addr) {
 
-    unsigned int i, j;
-    struct in6_addr dummyipv6_1, dummyipv6_2;
+    unsigned int i, j, full32, rest32;
+    uint32_t mask32;
 
     for (i = 0; i < nprefix; i++) {
-        dummyipv6_1 = *ipv6addr;
-        sanitize_ipv6_prefix(&dummyipv6_1, prefixlen[i]);
-        dummyipv6_2 = prefixlist[i];
-        sanitize_ipv6_prefix(&dummyipv6_2, prefixlen[i]);
+        full32 = prefixlen[i] / 32;
+        rest32 = prefixlen[i] % 32;
 
-        for (j = 0; j < 4; j++)
-            if (dummyipv6_1.s6_addr32[j] != dummyipv6_2.s6_addr32[j])
+        for (j = 0; j < full32; j++)
+            if (ipv6addr->s6_addr32[j] != prefixlist[i].s6_addr32[j])
                 break;
 
-        if (j == 4)
+        if (j < full32)
+            continue;
+
+        if (rest32 == 0)
+            return 1;
+
+        mask32 = htonl(0xffffffff << (32 - rest32));
+
+        if ((ipv6addr->s6_addr32[full32] & mask32) == (prefixlist[i].s6_addr32[full32] & mask32))
             return 1;
     }
 
     return 0;
 }
 
+/*
+ * Function: match_prefix_trie()
+ *
+ * Finds if an IPv6 address matches any of the prefixes of a prefix trie. As opposed to match_ipv6(), the cost of
+ * a lookup does not depend on the number of prefixes.
+ */
+
+int match_prefix_trie(struct prefix_trie *trie, struct in6_addr *ipv6addr) {
+    struct prefix_trie_node *node;
+    unsigned int depth, nibble;
+
+    if (trie->all_f)
+        return (TRUE);
+
+    if (trie->nprefix == 0)
+        return (FALSE);
+
+    node = trie->node;
+
+    for (depth = 0; depth < (128 / PTRIE_STRIDE); depth++) {
+        nibble = (ipv6addr->s6_addr[depth >> 1] >> ((depth & 1) ? 0 : 4)) & 0x0f;
+
+        if (node->match & (1 << nibble))
+            return (TRUE);
+
+        if (node->child[nibble] == 0)
+            return (FALSE);
+
+        node = trie->node + node->child[nibble];
+    }
+
+    return (FALSE);
+}
+
 /*
  * match_ether()
  *
@@ -1009,46 +1309,100 @@ unsigned int match_ether(struct ether_addr *addrlist, unsigned int naddr, struct
  */
 
 uint16_t in_chksum(void *ptr_ipv6, void *ptr_icmpv6, size_t len, uint8_t proto) {
-    struct ipv6pseudohdr pseudohdr;
     struct ip6_hdr *v6packet;
-    size_t nleft;
-    unsigned int sum = 0;
-    uint16_t *w;
-    uint16_t answer = 0;
+    uint64_t sum;
 
     v6packet = ptr_ipv6;
 
-    memset(&pseudohdr, 0, sizeof(struct ipv6pseudohdr));
-    pseudohdr.srcaddr = v6packet->ip6_src;
-    pseudohdr.dstaddr = v6packet->ip6_dst;
-    pseudohdr.len = htons(len);
-    pseudohdr.nh = proto;
+    /*
+       IPv6 pseudo-header. The Upper-Layer Packet Length and Next Header fields are summed directly as 16-bit words
+       in network byte order (the zero bytes of the pseudo-header do not contribute to the sum)
+     */
+    sum = htons(len) + htons(proto);
+    sum = in_chksum_add(sum, &(v6packet->ip6_src), sizeof(struct in6_addr));
+    sum = in_chksum_add(sum, &(v6packet->ip6_dst), sizeof(struct in6_addr));
+    sum = in_chksum_add(sum, ptr_icmpv6, len);
+    return (in_chksum_fold(sum));
+}
+
+/*
+ * Function: in_chksum_add()
+ *
+ * Adds a block of data to a partial Internet checksum. The data are summed as 32-bit words into a 64-bit accumulator
+ * (which cannot overflow for any realistic packet size), such that the carries need only be folded once, by
+ * in_chksum_fold(). A partial sum may be computed with several calls, as long as all blocks but the last one have an
+ * even length.
+ */
+
+uint64_t in_chksum_add(uint64_t sum, const void *data, size_t len) {
+    const unsigned char *ptr;
+    uint32_t w[4];
+    uint16_t h;
 
-    nleft = 40;
-    w = (uint16_t *)&pseudohdr;
+    ptr = data;
 
-    while (nleft > 1) {
-        sum += *w++;
-        nleft -= 2;
+    while (len >= sizeof(w)) {
+        memcpy(w, ptr, sizeof(w));
+        sum += (uint64_t)w[0] + w[1] + w[2] + w[3];
+        ptr += sizeof(w);
+        len -= sizeof(w);
     }
 
-    nleft = len;
-    w = (uint16_t *)ptr_icmpv6;
+    while (len >= sizeof(uint32_t)) {
+        memcpy(w, ptr, sizeof(uint32_t));
+        sum += w[0];
+        ptr += sizeof(uint32_t);
+        len -= sizeof(uint32_t);
+    }
 
-    while (nleft > 1) {
-        sum += *w++;
-        nleft -= 2;
+    if (len >= sizeof(uint16_t)) {
+        memcpy(&h, ptr, sizeof(uint16_t));
+        sum += h;
+        ptr += sizeof(uint16_t);
+        len -= sizeof(uint16_t);
     }
 
-    if (nleft == 1) {
-        *(unsigned char *)(&answer) = *(unsigned char *)w;
-        sum += answer;
+    /* An odd trailing byte is padded with a zero byte */
+    if (len) {
+        h = 0;
+        *(unsigned char *)&h = *ptr;
+        sum += h;
     }
 
+    return (sum);
+}
+
+/*
+ * Function: in_chksum_fold()
+ *
+ * Folds a partial sum computed with in_chksum_add() into 16 bits, and returns its ones' complement (i.e., the value
+ * of the checksum field)
+ */
+
+uint16_t in_chksum_fold(uint64_t sum) {
+    sum = (sum >> 32) + (sum & 0xffffffff);
+    sum = (sum >> 16) + (sum & 0xffff);
     sum = (sum >> 16) + (sum & 0xffff);
-    sum += (sum >> 16);
-    answer = ~sum;
-    return (answer);
+    sum = (sum >> 16) + (sum & 0xffff);
+    return ((uint16_t)~sum);
+}
+
+/*
+ * Function: in_chksum_update()
+ *
+ * Updates an Internet checksum when len bytes of the checksummed data change from 'from' to 'to' (RFC 1624, eqn. 3):
+ * HC' = ~(~HC + ~m + m'). This allows a tool that only changes e.g. an address or a port from one packet to the next
+ * to patch the checksum, rather than computing it over the whole packet. The changed data must start at an even
+ * offset within the checksummed data, and len must be even.
+ */
+
+uint16_t in_chksum_update(uint16_t cksum, const void *from, const void *to, size_t len) {
+    uint64_t sum;
+
+    sum = (uint16_t)~cksum;
+    sum += in_chksum_fold(in_chksum_add(0, from, len));
+    sum += (uint16_t)~in_chksum_fold(in_chksum_add(0, to, len));
+    return (in_chksum_fold(sum));
 }
 
 /*
@@ -1085,18 +1439,35 @@ int insert_pad_opt(unsigned char *ptrhdr, const unsigned char *ptrhdrend, unsign
 /*
  * Function: ipv6_to_ether()
  *
- * Obtains the Ethernet address corresponding to an IPv6 address (by means of Neighbor Discovery)
+ * Obtains the Ethernet address corresponding to an IPv6 address (by means of Neighbor Discovery, unless the address
+ * can be found in the neighbor cache)
  */
 
 int ipv6_to_ether(pcap_t *pfd, struct iface_data *idata, struct in6_addr *targetaddr, struct ether_addr *result_ether) {
+    unsigned char found_f;
+
+    return (resolve_neighbors(idata, targetaddr, result_ether, &found_f, 1));
+}
+
+/*
+ * Function: resolve_neighbors()
+ *
+ * Obtains the Ethernet addresses corresponding to ntargets IPv6 addresses. The Neighbor Solicitations for all the
+ * targets are outstanding at the same time (each with its own retransmission timer), such that resolving many
+ * neighbors takes about as long as resolving one. found[i] is set to TRUE if results[i] holds the link-layer
+ * address of targets[i]. Returns the number of targets that were resolved, or -1 on error.
+ */
+
+int resolve_neighbors(struct iface_data *idata, struct in6_addr *targets, struct ether_addr *results,
+                      unsigned char *found, unsigned int ntargets) {
     struct bpf_program pcap_filter;
     struct pcap_pkthdr *pkthdr;
     const u_char *pktdata;
-    struct ether_header *pkt_ether;
+    struct packet_view view;
     struct ip6_hdr *pkt_ipv6;
     struct nd_neighbor_advert *pkt_na;
     unsigned char *pkt_end, *prev_nh;
-    volatile unsigned char *ptr, *p;
+    unsigned char *ptr, *p;
 
     unsigned char buffer[PACKET_BUFFER_SIZE];
     unsigned int ns_max_packet_size;
@@ -1105,13 +1476,21 @@ int ipv6_to_ether(pcap_t *pfd, struct iface_data *idata, struct in6_addr *target
     struct ip6_hdr *ipv6;
     struct nd_neighbor_solicit *ns;
     struct nd_opt_slla *sllaopt;
-    volatile unsigned int tries = 0;
-    unsigned int foundaddr = 0;
-    struct sigaction new_sig, old_sig;
+    struct event_loop loop;
+    unsigned char *tries;
+    unsigned int i, nfound = 0, pending = 0;
     int result;
-    unsigned char error_f = 0;
+    unsigned char error_f = FALSE;
     int nw;
 
+    for (i = 0; i < ntargets; i++) {
+        if ((found[i] = lookup_neighbor_cache(idata, &(targets[i]), &(results[i]))))
+            nfound++;
+    }
+
+    if (nfound == ntargets)
+        return (nfound);
+
     ns_max_packet_size = idata->mtu;
 
     ether = (struct ether_header *)buffer;
@@ -1138,10 +1517,8 @@ int ipv6_to_ether(pcap_t *pfd, struct iface_data *idata, struct in6_addr *target
     ipv6->ip6_vfc = 0x60;
     ipv6->ip6_hlim = 255;
     ipv6->ip6_src = idata->ip6_local;
-    ipv6->ip6_dst = solicited_node(targetaddr);
 
     ether->src = idata->ether;
-    ether->dst = ether_multicast(&(ipv6->ip6_dst));
     ether->ether_type = htons(ETHERTYPE_IPV6);
 
     prev_nh = (unsigned char *)&(ipv6->ip6_nxt);
@@ -1161,7 +1538,6 @@ int ipv6_to_ether(pcap_t *pfd, struct iface_data *idata, struct in6_addr *target
     ns->nd_ns_type = ND_NEIGHBOR_SOLICIT;
     ns->nd_ns_code = 0;
     ns->nd_ns_reserved = 0;
-    ns->nd_ns_target = *targetaddr;
 
     ptr += sizeof(struct nd_neighbor_solicit);
     sllaopt = (struct nd_opt_slla *)ptr;
@@ -1179,2776 +1555,5589 @@ int ipv6_to_ether(pcap_t *pfd, struct iface_data *idata, struct in6_addr *target
     ptr += sizeof(struct nd_opt_slla);
 
     ipv6->ip6_plen = htons((ptr - v6buffer) - MIN_IPV6_HLEN);
-    ns->nd_ns_cksum = 0;
-    ns->nd_ns_cksum = in_chksum(v6buffer, ns, ptr - ((unsigned char *)ns), IPPROTO_ICMPV6);
 
-    /* We set the signal handler, and the anchor for siglongjump() */
-    canjump = 0;
-    memset(&new_sig, 0, sizeof(struct sigaction));
-    sigemptyset(&new_sig.sa_mask);
-    new_sig.sa_handler = &sig_alarm;
+    if (init_event_loop(&loop, idata->fd, ntargets) == FAILURE) {
+        if (idata->verbose_f > 1)
+            puts("Error while initializing the event loop");
 
-    alarm(0);
+        return (-1);
+    }
 
-    if (sigaction(SIGALRM, &new_sig, &old_sig) == -1) {
+    if ((tries = calloc(ntargets, sizeof(unsigned char))) == NULL) {
         if (idata->verbose_f > 1)
-            puts("Error setting up 'Alarm' signal");
+            puts("Error while allocating memory for Neighbor Discovery");
 
+        free_event_loop(&loop);
         return (-1);
     }
 
-    if (sigsetjmp(env, 1) != 0)
-        tries++;
+    /* Mark all unresolved targets as expired, such that the first Neighbor Solicitations are sent right away */
+    for (i = 0; i < ntargets; i++) {
+        if (!found[i]) {
+            set_event_timer(&loop, i, 0);
+            pending++;
+        }
+    }
 
-    canjump = 1;
+    while (pending && !error_f) {
+        while (!error_f && expired_event_timer(&loop, &i)) {
+            if (tries[i] >= 3) {
+                /* No response after three Neighbor Solicitations: give up on this target */
+                pending--;
+                continue;
+            }
 
-    while (tries < 3 && !foundaddr && !error_f) {
-        if ((nw = pcap_inject(idata->pfd, buffer, ptr - buffer)) == -1) {
-            if (idata->verbose_f > 1)
-                printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+            tries[i]++;
 
-            error_f = 1;
-            break;
+            ipv6->ip6_dst = solicited_node(&(targets[i]));
+            ether->dst = ether_multicast(&(ipv6->ip6_dst));
+            ns->nd_ns_target = targets[i];
+            ns->nd_ns_cksum = 0;
+            ns->nd_ns_cksum = in_chksum(v6buffer, ns, ptr - ((unsigned char *)ns), IPPROTO_ICMPV6);
+
+            if ((nw = pcap_inject(idata->pfd, buffer, ptr - buffer)) == -1) {
+                if (idata->verbose_f > 1)
+                    printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+
+                error_f = TRUE;
+                break;
+            }
+
+            if (nw != (ptr - buffer)) {
+                if (idata->verbose_f > 1)
+                    printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+
+                error_f = TRUE;
+                break;
+            }
+
+            set_event_timer(&loop, i, idata->local_timeout);
         }
 
-        if (nw != (ptr - buffer)) {
+        if (error_f || !pending)
+            break;
+
+        if ((result = pcap_next_ex(idata->pfd, &pkthdr, &pktdata)) == -1) {
             if (idata->verbose_f > 1)
-                printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
-            error_f = 1;
+                printf("pcap_next_ex(): %s", pcap_geterr(idata->pfd));
+
+            error_f = TRUE;
             break;
         }
 
-        alarm(idata->local_timeout);
-
-        while (!foundaddr && !error_f) {
-            do {
-                if ((result = pcap_next_ex(idata->pfd, &pkthdr, &pktdata)) == -1) {
-                    if (idata->verbose_f > 1)
-                        printf("pcap_next_ex(): %s", pcap_geterr(pfd));
+        if (result != 1 || pktdata == NULL) {
+            if (wait_event_loop(&loop) == FAILURE) {
+                if (idata->verbose_f > 1)
+                    puts("Error while waiting for Neighbor Advertisements");
 
-                    error_f = 1;
-                    break;
-                }
-            } while (result == 0 || pktdata == NULL);
+                error_f = TRUE;
+            }
 
-            if (error_f)
-                break;
+            continue;
+        }
 
 #ifdef DEBUG
-            puts("DEBUG: ipv6_to_ether(): Got NA");
+        puts("DEBUG: resolve_neighbors(): Got NA");
 #endif
-            pkt_ether = (struct ether_header *)pktdata;
-            pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + ETHER_HDR_LEN);
-            pkt_na = (struct nd_neighbor_advert *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
-            pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
+        /* Only complete ICMPv6 packets with a valid checksum are of interest */
+        if (dissect_packet(idata, pktdata, pkthdr, &view, DISSECT_CKSUM) == FAILURE || view.proto != IPPROTO_ICMPV6 ||
+            !(view.flags & PV_CKSUM_OK)) {
+#ifdef DEBUG
+            puts("DEBUG: resolve_neighbors(): Malformed packet or invalid checksum");
+#endif
+            continue;
+        }
 
-            /* The packet length is the minimum of what we capured, and what is specified in the
-               IPv6 Total Lenght field
-             */
-            if (pkt_end > ((unsigned char *)pkt_na + ntohs(pkt_ipv6->ip6_plen)))
-                pkt_end = (unsigned char *)pkt_na + ntohs(pkt_ipv6->ip6_plen);
+        pkt_ipv6 = view.ipv6;
+        pkt_na = (struct nd_neighbor_advert *)view.upper;
+        pkt_end = view.end;
 
-            /*
-               Discard the packet if it is not of the minimum size to contain a Neighbor Advertisement
-               message with a source link-layer address option
-             */
-            if ((pkt_end - (unsigned char *)pkt_na) <
-                (sizeof(struct nd_neighbor_advert) + sizeof(struct nd_opt_tlla))) {
+        /*
+           Discard the packet if it is not of the minimum size to contain a Neighbor Advertisement
+           message with a source link-layer address option
+         */
+        if ((pkt_end - (unsigned char *)pkt_na) < (sizeof(struct nd_neighbor_advert) + sizeof(struct nd_opt_tlla))) {
 #ifdef DEBUG
-                puts("DEBUG: ipv6_to_ether(): NA too small");
+            puts("DEBUG: resolve_neighbors(): NA too small");
 #endif
-                continue;
-            }
-            /*
-               Neighbor Discovery packets must have a Hop Limit of 255
-             */
-            if (pkt_ipv6->ip6_hlim != 255) {
+            continue;
+        }
+        /*
+           Neighbor Discovery packets must have a Hop Limit of 255
+         */
+        if (pkt_ipv6->ip6_hlim != 255) {
 #ifdef DEBUG
-                puts("DEBUG: ipv6_to_ether(): NA Hop Limit != 255");
+            puts("DEBUG: resolve_neighbors(): NA Hop Limit != 255");
 #endif
-                continue;
-            }
+            continue;
+        }
 
-            /*
-               Check that that the Destination Address of the Neighbor Advertisement is the one
-               that we used for sending the Neighbor Solicitation message
-             */
-            if (!is_eq_in6_addr(&(pkt_ipv6->ip6_dst), &(ipv6->ip6_src))) {
+        /*
+           Check that that the Destination Address of the Neighbor Advertisement is the one
+           that we used for sending the Neighbor Solicitation messages
+         */
+        if (!is_eq_in6_addr(&(pkt_ipv6->ip6_dst), &(ipv6->ip6_src))) {
 #ifdef DEBUG
-                puts("DEBUG: ipv6_to_ether(): NA Dst != NS Src");
+            puts("DEBUG: resolve_neighbors(): NA Dst != NS Src");
 #endif
-                continue;
-            }
+            continue;
+        }
+
+        /* Check that the ICMPv6 Target Address is one of those we are still waiting for */
+        for (i = 0; i < ntargets; i++) {
+            if (!found[i] && loop.active[i] && is_eq_in6_addr(&(pkt_na->nd_na_target), &(targets[i])))
+                break;
+        }
 
-            /* Check that the ICMPv6 checksum is correct */
-            if (in_chksum(pkt_ipv6, pkt_na, pkt_end - ((unsigned char *)pkt_na), IPPROTO_ICMPV6) != 0) {
+        if (i >= ntargets) {
 #ifdef DEBUG
-                puts("DEBUG: ipv6_to_ether(): NA Checksum invalid");
+            puts("DEBUG: resolve_neighbors(): NA Tgt != NS Tgt");
 #endif
-                continue;
-            }
+            continue;
+        }
 
-            /* Check that the ICMPv6 Target Address is the one we had asked for */
-            if (!is_eq_in6_addr(&(pkt_na->nd_na_target), targetaddr)) {
+        p = (unsigned char *)pkt_na + sizeof(struct nd_neighbor_advert);
+
+        /* Process Neighbor Advertisement options */
+        while ((p + sizeof(struct nd_opt_tlla)) <= pkt_end && (*(p + 1) != 0)) {
+            if (*p == ND_OPT_TARGET_LINKADDR) {
 #ifdef DEBUG
-                puts("DEBUG: ipv6_to_ether(): NA Tgt != NS Tgt");
+                puts("DEBUG: resolve_neighbors(): Found TLLA in NA");
 #endif
-                continue;
+                if ((*(p + 1) * 8) != sizeof(struct nd_opt_tlla))
+                    break;
+
+                /* Got a response, so we shouln't time out */
+                cancel_event_timer(&loop, i);
+
+                /* Save the link-layer address */
+                results[i] = *(struct ether_addr *)(p + 2);
+                found[i] = TRUE;
+                update_neighbor_cache(idata, &(targets[i]), &(results[i]), FALSE);
+                nfound++;
+                pending--;
+                break;
             }
 
-            p = (unsigned char *)pkt_na + sizeof(struct nd_neighbor_advert);
+            p = p + *(p + 1) * 8;
+        } /* Processing options */
 
-            /* Process Neighbor Advertisement options */
-            while ((p + sizeof(struct nd_opt_tlla)) <= pkt_end && (*(p + 1) != 0)) {
-                if (*p == ND_OPT_TARGET_LINKADDR) {
-#ifdef DEBUG
-                    puts("DEBUG: ipv6_to_ether(): Found TLLA in NA");
-#endif
-                    if ((*(p + 1) * 8) != sizeof(struct nd_opt_tlla))
-                        break;
+    } /* Processing packets and retransmissions */
 
-                    /* Got a response, so we shouln't time out */
-                    alarm(0);
+    free(tries);
+    free_event_loop(&loop);
 
-                    /* Save the link-layer address */
-                    *result_ether = *(struct ether_addr *)(p + 2);
-                    foundaddr = 1;
-                    break;
-                }
+    if (error_f)
+        return (-1);
 
-                p = p + *(p + 1) * 8;
-            } /* Processing options */
+    return (nfound);
+}
 
-        } /* Processing packets */
+/*
+ * Function: load_neighbor_cache()
+ *
+ * Sets up the neighbor cache shared by the tools, as specified in the toolkit configuration file: the cache is read
+ * from (and saved back to, when the tool exits) the file specified by the Neighbor-Cache variable, and can also be
+ * seeded from the kernel neighbor table (Neighbor-Cache-Kernel). Only the first call does any work. Returns FAILURE
+ * if the neighbor cache is not in use.
+ */
+
+int load_neighbor_cache(struct iface_data *idata) {
+    FILE *fp;
+    char line[MAX_NCACHE_LINE_SIZE], path[MAX_NCACHE_LINE_SIZE];
+    char *key, *value, *endptr;
+    unsigned long ttl = NCACHE_DEFAULT_TTL;
+    unsigned char kernel_f = FALSE;
+
+    if (ncache.loaded_f)
+        return ((ncache.entry != NULL) ? SUCCESS : FAILURE);
+
+    ncache.loaded_f = TRUE;
+    ncache.fd = -1;
+    path[0] = 0;
+
+    if ((fp = fopen(TOOLKIT_CONFIG_FILE, "r")) == NULL)
+        return (FAILURE);
 
-    } /* Resending Neighbor Solicitations */
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (keyval(line, Strnlen(line, sizeof(line)), &key, &value) != 1)
+            continue;
+
+        if (strncmp(key, "Neighbor-Cache", sizeof("Neighbor-Cache")) == 0) {
+            strncpy(path, value, sizeof(path) - 1);
+            path[sizeof(path) - 1] = 0;
+        }
+        else if (strncmp(key, "Neighbor-Cache-TTL", sizeof("Neighbor-Cache-TTL")) == 0) {
+            ttl = strtoul(value, &endptr, 10);
+
+            if (endptr == value || *endptr != 0)
+                ttl = NCACHE_DEFAULT_TTL;
+        }
+        else if (strncmp(key, "Neighbor-Cache-Kernel", sizeof("Neighbor-Cache-Kernel")) == 0) {
+            kernel_f = (strncmp(value, "yes", sizeof("yes")) == 0);
+        }
+    }
+
+    fclose(fp);
 
-    alarm(0);
+    if (path[0] == 0 && !kernel_f)
+        return (FAILURE);
 
-    if (sigaction(SIGALRM, &old_sig, NULL) == -1) {
+    if (open_neighbor_cache(path, ttl) == FAILURE) {
         if (idata->verbose_f > 1)
-            puts("Error setting up 'Alarm' signal");
+            puts("Not enough memory for the neighbor cache");
 
-        return (-1);
+        return (FAILURE);
     }
 
-    if (foundaddr)
-        return 1;
-    else
-        return 0;
+    ncache.kernel_f = kernel_f;
+
+    if (ncache.fd != -1 && atexit(save_neighbor_cache) != 0 && idata->verbose_f > 1)
+        puts("Error registering the function that saves the neighbor cache");
+
+#ifdef __linux__
+    if (ncache.kernel_f && seed_neighbor_cache() == FAILURE && idata->verbose_f > 1)
+        puts("Error while reading the kernel neighbor table");
+#endif
+
+    return (SUCCESS);
 }
 
 /*
- * Function: solicited_node()
+ * Function: open_neighbor_cache()
  *
- * Obtains the Solicited-node multicast address corresponding to an IPv6 address.
+ * Sets up the neighbor cache with the specified entry lifetime, and reads the entries of the specified file (if
+ * "path" is not empty). The file is opened right away, since the tools have usually released their privileges by
+ * the time the cache is saved (see save_neighbor_cache()).
  */
 
-struct in6_addr solicited_node(const struct in6_addr *ipv6addr) {
-    struct in6_addr solicited;
+int open_neighbor_cache(const char *path, unsigned int ttl) {
+    ncache.loaded_f = TRUE;
+    ncache.ttl = ttl;
+    ncache.fd = -1;
 
-    solicited.s6_addr32[0] = htonl(0xff020000);
-    solicited.s6_addr32[1] = htonl(0);
-    solicited.s6_addr32[2] = htonl(0x00000001);
-    solicited.s6_addr32[3] = htonl(0xff000000) | ipv6addr->s6_addr32[3];
+    if ((ncache.entry = malloc(sizeof(struct neighbor_cache_entry) * NCACHE_INIT_ENTRIES)) == NULL)
+        return (FAILURE);
 
-    return solicited;
+    if ((ncache.hash = calloc(NCACHE_INIT_ENTRIES * 2, sizeof(uint32_t))) == NULL) {
+        free(ncache.entry);
+        ncache.entry = NULL;
+        return (FAILURE);
+    }
+
+    ncache.nentries = 0;
+    ncache.maxentries = NCACHE_INIT_ENTRIES;
+    ncache.hashsize = NCACHE_INIT_ENTRIES * 2;
+
+    if (path[0] != 0) {
+        strncpy(ncache.path, path, sizeof(ncache.path) - 1);
+        ncache.path[sizeof(ncache.path) - 1] = 0;
+
+        if ((ncache.fd = open(ncache.path, O_RDWR | O_CREAT, 0644)) == -1)
+            ncache.fd = open(ncache.path, O_RDONLY);
+
+        if (ncache.fd != -1 && lock_neighbor_cache(F_RDLCK) == SUCCESS) {
+            read_neighbor_cache(ncache.fd);
+            lock_neighbor_cache(F_UNLCK);
+        }
+    }
+
+    return (SUCCESS);
 }
 
 /*
- * Function: is_eq_in6_addr()
+ * Function: close_neighbor_cache()
  *
- * Compares two IPv6 addresses. Returns 0 if they are equal.
+ * Releases the neighbor cache (without saving it), such that it is set up again when next used
  */
 
-int is_eq_in6_addr(struct in6_addr *ip1, struct in6_addr *ip2) {
-    unsigned int i;
+void close_neighbor_cache(void) {
+    if (!ncache.loaded_f)
+        return;
 
-    for (i = 0; i < 4; i++)
-        if (ip1->s6_addr32[i] != ip2->s6_addr32[i])
-            return FALSE;
+    if (ncache.fd != -1)
+        close(ncache.fd);
 
-    return TRUE;
+    free(ncache.entry);
+    free(ncache.hash);
+    memset(&ncache, 0, sizeof(ncache));
+    ncache.fd = -1;
 }
 
 /*
- * Function: generate_slaac_address()
+ * Function: neighbor_hash()
  *
- * Generates an IPv6 address (with modified EUI-64 identifiers) based on
- * a IPv6 prefix and an Ethernet address.
+ * Computes the bucket of the hash table of the neighbor cache for an interface and address
  */
 
-void generate_slaac_address(struct in6_addr *prefix, struct ether_addr *etheraddr, struct in6_addr *ipv6addr) {
+unsigned int neighbor_hash(const char *iface, struct in6_addr *addr) {
+    uint32_t h;
     unsigned int i;
 
-    for (i = 0; i < 2; i++)
-        ipv6addr->s6_addr32[i] = prefix->s6_addr32[i];
+    h = addr->s6_addr32[0] ^ addr->s6_addr32[1] ^ addr->s6_addr32[2] ^ addr->s6_addr32[3];
 
-    ipv6addr->s6_addr[8] = etheraddr->a[0] | 0x02;
-    ipv6addr->s6_addr[9] = etheraddr->a[1];
-    ipv6addr->s6_addr[10] = etheraddr->a[2];
-    ipv6addr->s6_addr[11] = 0xff;
-    ipv6addr->s6_addr[12] = 0xfe;
-    ipv6addr->s6_addr[13] = etheraddr->a[3];
-    ipv6addr->s6_addr[14] = etheraddr->a[4];
-    ipv6addr->s6_addr[15] = etheraddr->a[5];
+    for (i = 0; i < IFACE_LENGTH && iface[i] != 0; i++)
+        h = (h << 5) + h + (unsigned char)iface[i];
+
+    h = h * 0x9e3779b1;
+    h = h ^ (h >> 16);
+
+    return (h & (ncache.hashsize - 1));
 }
 
 /*
- * Function: get_if_addrs()
+ * Function: add_neighbor_cache_entry()
  *
- * Obtains Ethernet and IPv6 addresses of a network interface card
+ * Adds an entry to the neighbor cache, or refreshes the existing entry for the same interface and address (unless
+ * the existing entry expires later)
  */
 
-int get_if_addrs(struct iface_data *idata) {
-    struct ifaddrs *ifptr, *ptr;
-    struct sockaddr_in6 *sockin6ptr;
+int add_neighbor_cache_entry(const char *iface, struct in6_addr *addr, struct ether_addr *ether, time_t expires,
+                             unsigned char router_f) {
+    struct neighbor_cache_entry *entry;
+    uint32_t *newhash;
+    void *ptr;
+    unsigned int i, j, bucket;
 
-#ifdef __linux__
-    struct sockaddr_ll *sockpptr;
-#elif defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__) ||                     \
-    defined(__FreeBSD_kernel__)
-    struct sockaddr_dl *sockpptr;
-#endif
+    for (bucket = neighbor_hash(iface, addr); ncache.hash[bucket] != 0; bucket = (bucket + 1) & (ncache.hashsize - 1)) {
+        entry = &(ncache.entry[ncache.hash[bucket] - 1]);
 
-    if (getifaddrs(&ifptr) != 0) {
-        if (idata->verbose_f > 1) {
-            printf("Error while learning addresses of the %s interface\n", idata->iface);
+        if (strncmp(entry->iface, iface, IFACE_LENGTH) == 0 && is_eq_in6_addr(&(entry->addr), addr)) {
+            if (expires >= entry->expires) {
+                entry->ether = *ether;
+                entry->expires = expires;
+            }
+
+            entry->router_f |= router_f;
+            return (SUCCESS);
         }
-        return (-1);
     }
 
-    for (ptr = ifptr; ptr != NULL; ptr = ptr->ifa_next) {
-        if (ptr->ifa_addr == NULL)
-            continue;
-
-#ifdef __linux__
-        if (!(idata->ether_flag) && ((ptr->ifa_addr)->sa_family == AF_PACKET)) {
-            if (strncmp(idata->iface, ptr->ifa_name, IFACE_LENGTH) == 0) {
-                sockpptr = (struct sockaddr_ll *)(ptr->ifa_addr);
-                if (sockpptr->sll_halen == ETHER_ADDR_LEN) {
-                    memcpy((idata->ether).a, sockpptr->sll_addr, ETHER_ADDR_LEN);
-                    idata->ether_flag = TRUE;
-                }
-            }
-        }
-#elif defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__) ||                     \
-    defined(__FreeBSD_kernel__)
-        if (!(idata->ether_flag) && ((ptr->ifa_addr)->sa_family == AF_LINK)) {
-            if (strncmp(idata->iface, ptr->ifa_name, IFACE_LENGTH) == 0) {
-                sockpptr = (struct sockaddr_dl *)(ptr->ifa_addr);
-                if (sockpptr->sdl_alen == ETHER_ADDR_LEN) {
-                    memcpy((idata->ether).a, (sockpptr->sdl_data + sockpptr->sdl_nlen), ETHER_ADDR_LEN);
-                    idata->ether_flag = TRUE;
-                }
-            }
-        }
-#endif
-        else if ((ptr->ifa_addr)->sa_family == AF_INET6) {
-            sockin6ptr = (struct sockaddr_in6 *)(ptr->ifa_addr);
+    /* Keep the hash table at most half full */
+    if ((ncache.nentries + 1) * 2 > ncache.hashsize) {
+        if ((newhash = calloc(ncache.hashsize * 2, sizeof(uint32_t))) == NULL)
+            return (FAILURE);
 
-            if (!(idata->ip6_local_flag) && IN6_IS_ADDR_LINKLOCAL(&(sockin6ptr->sin6_addr))) {
-                if (strncmp(idata->iface, ptr->ifa_name, IFACE_LENGTH) == 0) {
-                    idata->ip6_local = sockin6ptr->sin6_addr;
-#if defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__) ||                       \
-    defined(__FreeBSD_kernel__)
-                    /* BSDs store the interface index in s6_addr16[1], so we must clear it */
-                    idata->ip6_local.s6_addr16[1] = 0;
-                    idata->ip6_local.s6_addr16[2] = 0;
-                    idata->ip6_local.s6_addr16[3] = 0;
-#endif
-                    idata->ip6_local_flag = TRUE;
-                }
-            }
-            else if (!IN6_IS_ADDR_LINKLOCAL(&(sockin6ptr->sin6_addr))) {
-                if (strncmp(idata->iface, ptr->ifa_name, IFACE_LENGTH) == 0) {
-                    if (IN6_IS_ADDR_LOOPBACK(&(sockin6ptr->sin6_addr)))
-                        idata->flags = IFACE_LOOPBACK;
+        free(ncache.hash);
+        ncache.hash = newhash;
+        ncache.hashsize = ncache.hashsize * 2;
 
-                    if (!is_ip6_in_prefix_list(&(sockin6ptr->sin6_addr), &(idata->ip6_global))) {
-                        if (idata->ip6_global.nprefix < idata->ip6_global.maxprefix) {
-                            if ((idata->ip6_global.prefix[idata->ip6_global.nprefix] =
-                                     malloc(sizeof(struct prefix_entry))) == NULL) {
-                                if (idata->verbose_f > 1)
-                                    puts("Error while storing Source Address");
+        for (i = 0; i < ncache.nentries; i++) {
+            entry = &(ncache.entry[i]);
 
-                                freeifaddrs(ifptr);
-                                return (-1);
-                            }
+            for (j = neighbor_hash(entry->iface, &(entry->addr)); ncache.hash[j] != 0;
+                 j = (j + 1) & (ncache.hashsize - 1))
+                ;
 
-                            (idata->ip6_global.prefix[idata->ip6_global.nprefix])->len = 64;
-                            (idata->ip6_global.prefix[idata->ip6_global.nprefix])->ip6 = sockin6ptr->sin6_addr;
-                            idata->ip6_global.nprefix++;
-                            idata->ip6_global_flag = TRUE;
-                        }
-                    }
-                }
-            }
+            ncache.hash[j] = i + 1;
         }
-        /*		else if((ptr->ifa_addr)->sa_family == AF_INET){
-                                if(strncmp(idata->iface, ptr->ifa_name, IFACE_LENGTH) == 0){
-                                                idata->ip6_local = sockin6ptr->sin6_addr;
 
-                                }
-                        }
-        */
+        for (bucket = neighbor_hash(iface, addr); ncache.hash[bucket] != 0;
+             bucket = (bucket + 1) & (ncache.hashsize - 1))
+            ;
     }
 
-    freeifaddrs(ifptr);
-    return (0);
+    if (ncache.nentries >= ncache.maxentries) {
+        if ((ptr = realloc(ncache.entry, sizeof(struct neighbor_cache_entry) * ncache.maxentries * 2)) == NULL)
+            return (FAILURE);
+
+        ncache.entry = ptr;
+        ncache.maxentries = ncache.maxentries * 2;
+    }
+
+    entry = &(ncache.entry[ncache.nentries]);
+    memset(entry, 0, sizeof(struct neighbor_cache_entry));
+    strncpy(entry->iface, iface, IFACE_LENGTH - 1);
+    entry->addr = *addr;
+    entry->ether = *ether;
+    entry->expires = expires;
+    entry->router_f = router_f;
+    ncache.nentries++;
+    ncache.hash[bucket] = ncache.nentries;
+    return (SUCCESS);
 }
 
 /*
- * Function: is_ip6_in_address_list()
+ * Function: lookup_neighbor_cache()
  *
- * Checks whether an IPv6 address is present in an address list.
+ * Looks up the link-layer address of an IPv6 address in the neighbor cache. Returns TRUE if an entry that has not
+ * expired is found for the interface of the tool.
  */
 
-int is_ip6_in_address_list(struct prefix_list *plist, struct in6_addr *target) {
-    unsigned int i, j;
+int lookup_neighbor_cache(struct iface_data *idata, struct in6_addr *addr, struct ether_addr *ether) {
+    struct neighbor_cache_entry *entry;
+    unsigned int bucket;
 
-    for (i = 0; i < plist->nprefix; i++) {
-        for (j = 0; j < 4; j++) {
-            if (target->s6_addr32[j] != (plist->prefix[i])->ip6.s6_addr32[j])
-                break;
-        }
+    if (load_neighbor_cache(idata) == FAILURE)
+        return (FALSE);
 
-        if (j == 4)
-            return TRUE;
+    for (bucket = neighbor_hash(idata->iface, addr); ncache.hash[bucket] != 0;
+         bucket = (bucket + 1) & (ncache.hashsize - 1)) {
+        entry = &(ncache.entry[ncache.hash[bucket] - 1]);
+
+        if (strncmp(entry->iface, idata->iface, IFACE_LENGTH) == 0 && is_eq_in6_addr(&(entry->addr), addr)) {
+            if (entry->expires <= time(NULL))
+                return (FALSE);
+
+            *ether = entry->ether;
+            return (TRUE);
+        }
     }
 
-    return FALSE;
+    return (FALSE);
 }
 
 /*
- * Function: is_ip6_in_prefix_list()
+ * Function: lookup_router_cache()
  *
- * Checks whether an IPv6 address is present in an address list.
+ * Looks up a local router in the neighbor cache. Returns TRUE if an entry that has not expired is found for the
+ * interface of the tool.
  */
 
-int is_ip6_in_prefix_list(struct in6_addr *target, struct prefix_list *plist) {
-    unsigned int i, j, full32, rest32;
-    uint32_t mask32;
-
-    for (i = 0; i < plist->nprefix; i++) {
-        full32 = (plist->prefix[i])->len / 32;
-        rest32 = (plist->prefix[i])->len % 32;
-        mask32 = 0xffffffff;
+int lookup_router_cache(struct iface_data *idata, struct in6_addr *addr, struct ether_addr *ether) {
+    time_t now;
+    unsigned int i;
 
-        for (j = 0; j < full32; j++)
-            if (target->s6_addr32[j] != (plist->prefix[i])->ip6.s6_addr32[j])
-                break;
+    if (load_neighbor_cache(idata) == FAILURE)
+        return (FALSE);
 
-        if (j == full32) {
-            if (rest32 == 0)
-                return TRUE;
-            else {
-                mask32 = mask32 << (32 - rest32);
+    now = time(NULL);
 
-                if ((target->s6_addr32[full32] & htonl(mask32)) ==
-                    ((plist->prefix[i])->ip6.s6_addr32[full32] & htonl(mask32)))
-                    return TRUE;
-            }
+    for (i = 0; i < ncache.nentries; i++) {
+        if (ncache.entry[i].router_f && ncache.entry[i].expires > now &&
+            strncmp(ncache.entry[i].iface, idata->iface, IFACE_LENGTH) == 0) {
+            *addr = ncache.entry[i].addr;
+            *ether = ncache.entry[i].ether;
+            return (TRUE);
         }
     }
 
-    return FALSE;
+    return (FALSE);
 }
 
 /*
- * Function: is_time_elapsed()
+ * Function: update_neighbor_cache()
  *
- * Checks whether a specific amount of time has elapsed. (i.e., whether curtime >= lastprobe + delta
+ * Records the result of Neighbor Discovery (or Router Discovery, if router_f is set) in the neighbor cache
  */
 
-int is_time_elapsed(struct timeval *curtime, struct timeval *lastprobe, unsigned long delta) {
-    if (curtime->tv_sec > (lastprobe->tv_sec + delta / 1000000)) {
-        return (1);
-    }
-    else if (curtime->tv_sec == (lastprobe->tv_sec + delta / 1000000)) {
-        if (curtime->tv_usec >= (lastprobe->tv_usec + delta % 1000000)) {
-            return (1);
-        }
-    }
+int update_neighbor_cache(struct iface_data *idata, struct in6_addr *addr, struct ether_addr *ether,
+                          unsigned char router_f) {
+    if (load_neighbor_cache(idata) == FAILURE)
+        return (FAILURE);
 
-    return (0);
+    if (add_neighbor_cache_entry(idata->iface, addr, ether, time(NULL) + ncache.ttl, router_f) == FAILURE)
+        return (FAILURE);
+
+    ncache.dirty_f = TRUE;
+    return (SUCCESS);
 }
 
 /*
- * Function: print_filters()
+ * Function: lock_neighbor_cache()
  *
- * Prints the filters that will be applied to incoming packets.
+ * Locks (or unlocks, for F_UNLCK) the neighbor cache file, which may be shared by several tools running at the same
+ * time
  */
 
-void print_filters(struct iface_data *idata, struct filters *filters) {
-    unsigned int i;
-    char plinkaddr[ETHER_ADDR_PLEN];
-    char pv6addr[INET6_ADDRSTRLEN];
+int lock_neighbor_cache(short type) {
+    struct flock lock;
 
-    if (filters->nblocksrc) {
-        printf("Block filter for IPv6 Source Address: ");
-
-        for (i = 0; i < filters->nblocksrc; i++) {
-            if (inet_ntop(AF_INET6, &(filters->blocksrc[i]), pv6addr, sizeof(pv6addr)) == NULL) {
-                puts("inet_ntop(): Error converting IPv6 Src. Addr. filter to presentation format");
-                exit(EXIT_FAILURE);
-            }
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
 
-            printf("%s/%u   ", pv6addr, filters->blocksrclen[i]);
-        }
-        printf("\n");
+    while (fcntl(ncache.fd, F_SETLKW, &lock) == -1) {
+        if (errno != EINTR)
+            return (FAILURE);
     }
 
-    if (filters->nblockdst) {
-        printf("Block filter for IPv6 Destination Address: ");
+    return (SUCCESS);
+}
 
-        for (i = 0; i < filters->nblockdst; i++) {
-            if (inet_ntop(AF_INET6, &(filters->blockdst[i]), pv6addr, sizeof(pv6addr)) == NULL) {
-                puts("inet_ntop(): Error converting IPv6 Dst. Addr. filter to presentation format");
-                exit(EXIT_FAILURE);
-            }
+/*
+ * Function: read_neighbor_cache()
+ *
+ * Merges the entries of a neighbor cache file into the neighbor cache. Each line of the file contains an interface
+ * name, an IPv6 address, a link-layer address, the expiration time of the entry (in seconds since the Epoch), and
+ * optionally the word "router". Malformed and expired entries are ignored.
+ */
 
-            printf("%s/%u   ", pv6addr, filters->blockdstlen[i]);
-        }
-        printf("\n");
+int read_neighbor_cache(int fd) {
+    FILE *fp;
+    char line[MAX_NCACHE_LINE_SIZE], iface[IFACE_LENGTH], addrstr[INET6_ADDRSTRLEN], etherstr[ETHER_ADDR_PLEN];
+    char router[sizeof("router")];
+    struct in6_addr addr;
+    struct ether_addr ether;
+    long long expires;
+    time_t now;
+    int nfields, dupfd;
+
+    /* The stream is read through a duplicate of the descriptor, since fclose() closes it */
+    if (lseek(fd, 0, SEEK_SET) == -1 || (dupfd = dup(fd)) == -1)
+        return (FAILURE);
+
+    if ((fp = fdopen(dupfd, "r")) == NULL) {
+        close(dupfd);
+        return (FAILURE);
     }
 
-    if (filters->nblocktarget) {
-        printf("Block filter for Target Address: ");
+    now = time(NULL);
 
-        for (i = 0; i < filters->nblocktarget; i++) {
-            if (inet_ntop(AF_INET6, &(filters->blocktarget[i]), pv6addr, sizeof(pv6addr)) == NULL) {
-                puts("inet_ntop(): Error converting Target Addr. filter to presentation format");
-                exit(EXIT_FAILURE);
-            }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if ((nfields = sscanf(line, "%15s %45s %17s %lld %6s", iface, addrstr, etherstr, &expires, router)) < 4 ||
+            expires <= now)
+            continue;
 
-            printf("%s/%u   ", pv6addr, filters->blocktargetlen[i]);
-        }
-        printf("\n");
+        if (inet_pton(AF_INET6, addrstr, &addr) != 1 || ether_pton(etherstr, &ether, sizeof(ether)) == FALSE)
+            continue;
+
+        if (add_neighbor_cache_entry(iface, &addr, &ether, (time_t)expires,
+                                     (nfields == 5 && strncmp(router, "router", sizeof("router")) == 0)) == FAILURE)
+            break;
     }
 
-    if (idata->type == DLT_EN10MB && !(idata->flags & IFACE_LOOPBACK)) {
-        if (filters->nblocklinksrc) {
-            printf("Block filter for link-layer Source Address: ");
+    fclose(fp);
+    return (SUCCESS);
+}
 
-            for (i = 0; i < filters->nblocklinksrc; i++) {
-                if (ether_ntop(&(filters->blocklinksrc[i]), plinkaddr, sizeof(plinkaddr)) == FALSE) {
-                    puts("ether_ntop(): Error converting address");
-                    exit(EXIT_FAILURE);
-                }
+/*
+ * Function: save_neighbor_cache()
+ *
+ * Saves the neighbor cache to the file it was read from, if any entries were learned (registered with atexit()).
+ * Since several tools may share the file, the entries saved meanwhile by other tools are merged first.
+ */
 
-                printf("%s   ", plinkaddr);
-            }
-            printf("\n");
-        }
+void save_neighbor_cache(void) {
+    FILE *fp;
+    char addrstr[INET6_ADDRSTRLEN], etherstr[ETHER_ADDR_PLEN];
+    struct neighbor_cache_entry *entry;
+    time_t now;
+    unsigned int i;
+    int dupfd;
 
-        if (filters->nblocklinkdst) {
-            printf("Block filter for link-layer Destination Address: ");
+    if (!ncache.dirty_f || ncache.fd == -1 || lock_neighbor_cache(F_WRLCK) == FAILURE)
+        return;
 
-            for (i = 0; i < filters->nblocklinkdst; i++) {
-                if (ether_ntop(&(filters->blocklinkdst[i]), plinkaddr, sizeof(plinkaddr)) == FALSE) {
-                    puts("ether_ntop(): Error converting address");
-                    exit(EXIT_FAILURE);
-                }
+    read_neighbor_cache(ncache.fd);
 
-                printf("%s   ", plinkaddr);
-            }
-            printf("\n");
-        }
+    if (lseek(ncache.fd, 0, SEEK_SET) == -1 || ftruncate(ncache.fd, 0) == -1 || (dupfd = dup(ncache.fd)) == -1) {
+        lock_neighbor_cache(F_UNLCK);
+        return;
     }
 
-    if (filters->nacceptsrc) {
-        printf("Accept filter for IPv6 Source Address: ");
+    if ((fp = fdopen(dupfd, "w")) == NULL) {
+        close(dupfd);
+        lock_neighbor_cache(F_UNLCK);
+        return;
+    }
 
-        for (i = 0; i < filters->nacceptsrc; i++) {
-            if (inet_ntop(AF_INET6, &(filters->acceptsrc[i]), pv6addr, sizeof(pv6addr)) == NULL) {
-                puts("inet_ntop(): Error converting IPv6 Src. Addr. filter to presentation format");
-                exit(EXIT_FAILURE);
-            }
+    now = time(NULL);
 
-            printf("%s/%u   ", pv6addr, filters->acceptsrclen[i]);
-        }
-        printf("\n");
+    for (i = 0; i < ncache.nentries; i++) {
+        entry = &(ncache.entry[i]);
+
+        if (entry->expires <= now || inet_ntop(AF_INET6, &(entry->addr), addrstr, sizeof(addrstr)) == NULL ||
+            ether_ntop(&(entry->ether), etherstr, sizeof(etherstr)) == FALSE)
+            continue;
+
+        fprintf(fp, "%s %s %s %lld%s\n", entry->iface, addrstr, etherstr, (long long)entry->expires,
+                (entry->router_f ? " router" : ""));
     }
 
-    if (filters->nacceptdst) {
-        printf("Accept filter for IPv6 Destination Address: ");
+    fclose(fp);
+    lock_neighbor_cache(F_UNLCK);
+    ncache.dirty_f = FALSE;
+}
 
-        for (i = 0; i < filters->nacceptdst; i++) {
-            if (inet_ntop(AF_INET6, &(filters->acceptdst[i]), pv6addr, sizeof(pv6addr)) == NULL) {
-                puts("inet_ntop(): Error converting IPv6 Dst. Addr. filter to presentation format");
-                exit(EXIT_FAILURE);
-            }
+#ifdef __linux__
+/*
+ * Function: seed_neighbor_cache()
+ *
+ * Adds the IPv6 entries of the kernel neighbor table (as obtained over Netlink) to the neighbor cache
+ */
 
-            printf("%s/%u   ", pv6addr, filters->acceptdstlen[i]);
-        }
-        printf("\n");
-    }
+int seed_neighbor_cache(void) {
+    int sockfd, len;
+    struct {
+        struct nlmsghdr nl;
+        struct ndmsg nd;
+    } req;
+    char reply[MAX_NLDUMP_SIZE], iface[IFACE_LENGTH];
+    struct nlmsghdr *nlp;
+    struct ndmsg *ndp;
+    struct rtattr *rtap;
+    struct in6_addr *addr;
+    struct ether_addr *ether;
+    time_t expires;
+    int rtl;
+    unsigned char done_f = FALSE;
 
-    if (filters->naccepttarget) {
-        printf("Accept filter for Target Address: ");
+    if ((sockfd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE)) == -1)
+        return (FAILURE);
 
-        for (i = 0; i < filters->naccepttarget; i++) {
-            if (inet_ntop(AF_INET6, &(filters->accepttarget[i]), pv6addr, sizeof(pv6addr)) == NULL) {
-                puts("inet_ntop(): Error converting Target Addr. filter to presentation format");
-                exit(EXIT_FAILURE);
-            }
+    memset(&req, 0, sizeof(req));
+    req.nl.nlmsg_len = NLMSG_LENGTH(sizeof(struct ndmsg));
+    req.nl.nlmsg_type = RTM_GETNEIGH;
+    req.nl.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nd.ndm_family = AF_INET6;
 
-            printf("%s/%u   ", pv6addr, filters->accepttargetlen[i]);
-        }
-        printf("\n");
+    if (send(sockfd, &req, req.nl.nlmsg_len, 0) == -1) {
+        close(sockfd);
+        return (FAILURE);
     }
 
-    if (idata->type == DLT_EN10MB && !(idata->flags & IFACE_LOOPBACK)) {
-        if (filters->nacceptlinksrc) {
-            printf("Accept filter for link-layer Source Address: ");
+    expires = time(NULL) + ncache.ttl;
 
-            for (i = 0; i < filters->nacceptlinksrc; i++) {
-                if (ether_ntop(&(filters->acceptlinksrc[i]), plinkaddr, sizeof(plinkaddr)) == FALSE) {
-                    puts("ether_ntop(): Error converting address");
-                    exit(EXIT_FAILURE);
-                }
+    while (!done_f) {
+        if ((len = recv(sockfd, reply, sizeof(reply), 0)) <= 0) {
+            close(sockfd);
+            return (FAILURE);
+        }
 
-                printf("%s   ", plinkaddr);
+        for (nlp = (struct nlmsghdr *)reply; NLMSG_OK(nlp, len); nlp = NLMSG_NEXT(nlp, len)) {
+            if (nlp->nlmsg_type == NLMSG_DONE || nlp->nlmsg_type == NLMSG_ERROR) {
+                done_f = TRUE;
+                break;
             }
-            printf("\n");
-        }
 
-        if (filters->nacceptlinkdst) {
-            printf("Accept filter for link-layer Destination Address: ");
+            ndp = (struct ndmsg *)NLMSG_DATA(nlp);
 
-            for (i = 0; i < filters->nacceptlinkdst; i++) {
-                if (ether_ntop(&(filters->acceptlinkdst[i]), plinkaddr, sizeof(plinkaddr)) == FALSE) {
-                    puts("ether_ntop(): Error converting address");
-                    exit(EXIT_FAILURE);
-                }
+            /* Incomplete and failed entries carry no usable link-layer address */
+            if (nlp->nlmsg_type != RTM_NEWNEIGH || ndp->ndm_family != AF_INET6 ||
+                !(ndp->ndm_state & (NUD_REACHABLE | NUD_STALE | NUD_DELAY | NUD_PROBE | NUD_PERMANENT)))
+                continue;
 
-                printf("%s   ", plinkaddr);
+            addr = NULL;
+            ether = NULL;
+
+            for (rtap = (struct rtattr *)((char *)ndp + NLMSG_ALIGN(sizeof(struct ndmsg))),
+                rtl = NLMSG_PAYLOAD(nlp, sizeof(struct ndmsg));
+                 RTA_OK(rtap, rtl); rtap = RTA_NEXT(rtap, rtl)) {
+                if (rtap->rta_type == NDA_DST && RTA_PAYLOAD(rtap) == sizeof(struct in6_addr))
+                    addr = (struct in6_addr *)RTA_DATA(rtap);
+                else if (rtap->rta_type == NDA_LLADDR && RTA_PAYLOAD(rtap) == sizeof(struct ether_addr))
+                    ether = (struct ether_addr *)RTA_DATA(rtap);
             }
-            printf("\n");
+
+            if (addr == NULL || ether == NULL || if_indextoname(ndp->ndm_ifindex, iface) == NULL)
+                continue;
+
+            if (add_neighbor_cache_entry(iface, addr, ether, expires, ((ndp->ndm_flags & NTF_ROUTER) != 0)) ==
+                FAILURE)
+                break;
         }
     }
+
+    close(sockfd);
+    return (SUCCESS);
 }
+#endif
 
 /*
- * Function: print_filter_result()
+ * Function: solicited_node()
  *
- * Prints infromation about an incoming packet and whether it was blocked or
- * accepted by a filter.
+ * Obtains the Solicited-node multicast address corresponding to an IPv6 address.
  */
 
-void print_filter_result(struct iface_data *idata, const u_char *pkt_data, unsigned char fresult) {
-    struct ip6_hdr *pkt_ipv6;
-    char psrcaddr[INET6_ADDRSTRLEN], pdstaddr[INET6_ADDRSTRLEN];
-
-    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_data + idata->linkhsize);
-
-    if (inet_ntop(AF_INET6, &(pkt_ipv6->ip6_src), psrcaddr, sizeof(psrcaddr)) == NULL) {
-        puts("inet_ntop(): Error converting IPv6 Source Address to presentation format");
-        exit(EXIT_FAILURE);
-    }
+struct in6_addr solicited_node(const struct in6_addr *ipv6addr) {
+    struct in6_addr solicited;
 
-    if (inet_ntop(AF_INET6, &(pkt_ipv6->ip6_dst), pdstaddr, sizeof(pdstaddr)) == NULL) {
-        puts("inet_ntop(): Error converting IPv6 Destination Address to presentation format");
-        exit(EXIT_FAILURE);
-    }
+    solicited.s6_addr32[0] = htonl(0xff020000);
+    solicited.s6_addr32[1] = htonl(0);
+    solicited.s6_addr32[2] = htonl(0x00000001);
+    solicited.s6_addr32[3] = htonl(0xff000000) | ipv6addr->s6_addr32[3];
 
-    printf("Received IPv6 packet from %s to %s (%s)\n", psrcaddr, pdstaddr,
-           ((fresult == ACCEPTED) ? "accepted" : "blocked"));
+    return solicited;
 }
 
 /*
- * randomize_ether_addr()
+ * Function: is_eq_in6_addr()
  *
- * Select a random Ethernet address.
+ * Compares two IPv6 addresses. Returns 0 if they are equal.
  */
 
-void randomize_ether_addr(struct ether_addr *ethaddr) {
+int is_eq_in6_addr(struct in6_addr *ip1, struct in6_addr *ip2) {
     unsigned int i;
 
-    for (i = 0; i < 6; i++)
-        ethaddr->a[i] = random();
+    for (i = 0; i < 4; i++)
+        if (ip1->s6_addr32[i] != ip2->s6_addr32[i])
+            return FALSE;
 
-    ethaddr->a[0] = (ethaddr->a[0] & 0xfc) | 0x02;
+    return TRUE;
 }
 
 /*
- * randomize_ipv6_addr()
+ * Function: generate_slaac_address()
  *
- * Select a random IPv6 from a given prefix.
+ * Generates an IPv6 address (with modified EUI-64 identifiers) based on
+ * a IPv6 prefix and an Ethernet address.
  */
 
-void randomize_ipv6_addr(struct in6_addr *ipv6addr, const struct in6_addr *prefix, uint8_t preflen) {
-    uint32_t mask;
-    uint8_t startrand;
+void generate_slaac_address(struct in6_addr *prefix, struct ether_addr *etheraddr, struct in6_addr *ipv6addr) {
     unsigned int i;
-    struct in6_addr ripv6addr;
 
-    startrand = preflen / 32;
-
-    /* 32-bit words from prefix that must be copied entirely into randomized address */
-    for (i = 0; i < startrand; i++)
-        ripv6addr.s6_addr32[i] = prefix->s6_addr32[i];
-
-    /* 32-bit word (if any) that must be partially randomized */
-    if (preflen % 32) {
-        mask = 0xffffffff;
-        mask = mask >> (preflen % 32);
-
-        ripv6addr.s6_addr32[startrand] = (prefix->s6_addr32[startrand] & htonl(~mask)) | (random() & htonl(mask));
-        startrand++;
-    }
-
-    for (i = startrand; i < 4; i++)
-        ripv6addr.s6_addr32[i] = random();
+    for (i = 0; i < 2; i++)
+        ipv6addr->s6_addr32[i] = prefix->s6_addr32[i];
 
-    *ipv6addr = ripv6addr;
+    ipv6addr->s6_addr[8] = etheraddr->a[0] | 0x02;
+    ipv6addr->s6_addr[9] = etheraddr->a[1];
+    ipv6addr->s6_addr[10] = etheraddr->a[2];
+    ipv6addr->s6_addr[11] = 0xff;
+    ipv6addr->s6_addr[12] = 0xfe;
+    ipv6addr->s6_addr[13] = etheraddr->a[3];
+    ipv6addr->s6_addr[14] = etheraddr->a[4];
+    ipv6addr->s6_addr[15] = etheraddr->a[5];
 }
 
 /*
- * randomize_port()
+ * Function: get_if_addrs()
  *
- * Select a random port from a given port/mask
+ * Obtains Ethernet and IPv6 addresses of a network interface card
  */
 
-void randomize_port(uint16_t *port, uint16_t prefix, uint8_t preflen) {
-    uint32_t mask;
-
-    mask = 0x10000;
-    mask = mask >> preflen;
-
-    sanitize_port(&prefix, preflen);
-
-    *port = (uint16_t)(prefix + random() % mask);
-}
-
-/*
- * release_privileges()
- *
- * Releases superuser privileges by switching to the real uid and gid, or to nobody
- */
+int get_if_addrs(struct iface_data *idata) {
+    struct ifaddrs *ifptr, *ptr;
+    struct sockaddr_in6 *sockin6ptr;
 
-void release_privileges(void) {
-    uid_t ruid;
-    gid_t rgid;
-    struct passwd *pwdptr;
+#ifdef __linux__
+    struct sockaddr_ll *sockpptr;
+#elif defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__) ||                     \
+    defined(__FreeBSD_kernel__)
+    struct sockaddr_dl *sockpptr;
+#endif
 
-    /*
-       If the real UID is not root, we setuid() and setgid() to that user and group, releasing superuser
-       privileges. Otherwise, if the real UID is 0, we try to setuid() to "nobody", releasing superuser
-       privileges.
-     */
-    if ((ruid = getuid()) && (rgid = getgid())) {
-        if (setgid(rgid) == -1) {
-            puts("Error while releasing superuser privileges (changing to real GID)");
-            exit(EXIT_FAILURE);
+    if (getifaddrs(&ifptr) != 0) {
+        if (idata->verbose_f > 1) {
+            printf("Error while learning addresses of the %s interface\n", idata->iface);
         }
+        return (-1);
+    }
 
-        if (setuid(ruid) == -1) {
-            puts("Error while releasing superuser privileges (changing to real UID)");
-            exit(EXIT_FAILURE);
+    for (ptr = ifptr; ptr != NULL; ptr = ptr->ifa_next) {
+        if (ptr->ifa_addr == NULL)
+            continue;
+
+#ifdef __linux__
+        if (!(idata->ether_flag) && ((ptr->ifa_addr)->sa_family == AF_PACKET)) {
+            if (strncmp(idata->iface, ptr->ifa_name, IFACE_LENGTH) == 0) {
+                sockpptr = (struct sockaddr_ll *)(ptr->ifa_addr);
+                if (sockpptr->sll_halen == ETHER_ADDR_LEN) {
+                    memcpy((idata->ether).a, sockpptr->sll_addr, ETHER_ADDR_LEN);
+                    idata->ether_flag = TRUE;
+                }
+            }
         }
-    }
-    else {
-        if ((pwdptr = getpwnam("nobody"))) {
-            if (!pwdptr->pw_uid || !pwdptr->pw_gid) {
-                puts("User 'nobody' has incorrect privileges");
-                exit(EXIT_FAILURE);
+#elif defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__) ||                     \
+    defined(__FreeBSD_kernel__)
+        if (!(idata->ether_flag) && ((ptr->ifa_addr)->sa_family == AF_LINK)) {
+            if (strncmp(idata->iface, ptr->ifa_name, IFACE_LENGTH) == 0) {
+                sockpptr = (struct sockaddr_dl *)(ptr->ifa_addr);
+                if (sockpptr->sdl_alen == ETHER_ADDR_LEN) {
+                    memcpy((idata->ether).a, (sockpptr->sdl_data + sockpptr->sdl_nlen), ETHER_ADDR_LEN);
+                    idata->ether_flag = TRUE;
+                }
             }
+        }
+#endif
+        else if ((ptr->ifa_addr)->sa_family == AF_INET6) {
+            sockin6ptr = (struct sockaddr_in6 *)(ptr->ifa_addr);
 
-            if (setgid(pwdptr->pw_gid) == -1) {
-                puts("Error while releasing superuser privileges (changing to nobody's group)");
-                exit(EXIT_FAILURE);
+            if (!(idata->ip6_local_flag) && IN6_IS_ADDR_LINKLOCAL(&(sockin6ptr->sin6_addr))) {
+                if (strncmp(idata->iface, ptr->ifa_name, IFACE_LENGTH) == 0) {
+                    idata->ip6_local = sockin6ptr->sin6_addr;
+#if defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__) ||                       \
+    defined(__FreeBSD_kernel__)
+                    /* BSDs store the interface index in s6_addr16[1], so we must clear it */
+                    idata->ip6_local.s6_addr16[1] = 0;
+                    idata->ip6_local.s6_addr16[2] = 0;
+                    idata->ip6_local.s6_addr16[3] = 0;
+#endif
+                    idata->ip6_local_flag = TRUE;
+                }
             }
+            else if (!IN6_IS_ADDR_LINKLOCAL(&(sockin6ptr->sin6_addr))) {
+                if (strncmp(idata->iface, ptr->ifa_name, IFACE_LENGTH) == 0) {
+                    if (IN6_IS_ADDR_LOOPBACK(&(sockin6ptr->sin6_addr)))
+                        idata->flags = IFACE_LOOPBACK;
 
-            if (setuid(pwdptr->pw_uid) == -1) {
-                puts("Error while releasing superuser privileges (changing to 'nobody')");
-                exit(EXIT_FAILURE);
+                    if (!is_ip6_in_prefix_list(&(sockin6ptr->sin6_addr), &(idata->ip6_global))) {
+                        if (idata->ip6_global.nprefix < idata->ip6_global.maxprefix) {
+                            if ((idata->ip6_global.prefix[idata->ip6_global.nprefix] =
+                                     arena_alloc(&(idata->ip6_global.arena), sizeof(struct prefix_entry))) == NULL) {
+                                if (idata->verbose_f > 1)
+                                    puts("Error while storing Source Address");
+
+                                freeifaddrs(ifptr);
+                                return (-1);
+                            }
+
+                            (idata->ip6_global.prefix[idata->ip6_global.nprefix])->len = 64;
+                            (idata->ip6_global.prefix[idata->ip6_global.nprefix])->ip6 = sockin6ptr->sin6_addr;
+                            idata->ip6_global.nprefix++;
+                            idata->ip6_global_flag = TRUE;
+                        }
+                    }
+                }
             }
         }
+        /*		else if((ptr->ifa_addr)->sa_family == AF_INET){
+                                if(strncmp(idata->iface, ptr->ifa_name, IFACE_LENGTH) == 0){
+                                                idata->ip6_local = sockin6ptr->sin6_addr;
+
+                                }
+                        }
+        */
     }
+
+    freeifaddrs(ifptr);
+    return (0);
 }
 
 /*
- * sanitize_ipv6_prefix()
+ * Function: is_ip6_in_address_list()
  *
- * Clears those bits in an IPv6 address that are not within a prefix length.
+ * Checks whether an IPv6 address is present in an address list.
  */
 
-void sanitize_ipv6_prefix(struct in6_addr *ipv6addr, uint8_t prefixlen) {
-    unsigned int skip, i;
-    uint32_t mask;
-
-    skip = (prefixlen + 31) / 32;
+int is_ip6_in_address_list(struct prefix_list *plist, struct in6_addr *target) {
+    unsigned int i, j;
 
-    if (prefixlen % 32) {
-        mask = 0;
-        for (i = 0; i < (prefixlen % 32); i++)
-            mask = (mask >> 1) | 0x80000000;
+    for (i = 0; i < plist->nprefix; i++) {
+        for (j = 0; j < 4; j++) {
+            if (target->s6_addr32[j] != (plist->prefix[i])->ip6.s6_addr32[j])
+                break;
+        }
 
-        ipv6addr->s6_addr32[skip - 1] = ipv6addr->s6_addr32[skip - 1] & htonl(mask);
+        if (j == 4)
+            return TRUE;
     }
 
-    for (i = skip; i < 4; i++)
-        ipv6addr->s6_addr32[i] = 0;
+    return FALSE;
 }
 
 /*
- * sanitize_port()
+ * Function: arena_alloc()
  *
- * Clears those bits in a transport port that are not within a port mas.
+ * Allocates "size" bytes from an arena (as with malloc(), the memory is not initialized). Consecutive allocations
+ * are adjacent in memory, such that walking a list of entries does not jump all over the heap. Memory obtained
+ * from an arena is never released individually: free_arena() releases all of it at once.
  */
 
-void sanitize_port(uint16_t *port, uint8_t prefixlen) {
-    uint16_t mask;
+void *arena_alloc(struct arena *arena, size_t size) {
+    struct arena_block *block;
+    size_t hdrsize, blocksize;
+    void *p;
 
-    mask = 0xffff;
-    mask = mask << (16 - prefixlen);
+    hdrsize = (sizeof(struct arena_block) + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1);
+    size = (size + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1);
 
-    *port = *port & mask;
+    if (arena->block == NULL || (arena->block->size - arena->block->used) < size) {
+        blocksize = (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE;
+
+        if ((block = malloc(hdrsize + blocksize)) == NULL)
+            return (NULL);
+
+        block->used = 0;
+        block->size = blocksize;
+        block->next = arena->block;
+        arena->block = block;
+    }
+
+    block = arena->block;
+    p = (unsigned char *)block + hdrsize + block->used;
+    block->used += size;
+    return (p);
 }
 
 /*
- * Handler for the ALARM signal.
+ * Function: free_arena()
  *
- * Used for setting a timeout on libpcap reads
+ * Releases all the memory allocated from an arena, which can then be reused
  */
 
-void sig_alarm(int num) {
-    if (canjump == 0)
-        return;
+void free_arena(struct arena *arena) {
+    struct arena_block *block, *next;
 
-    siglongjmp(env, 1);
+    for (block = arena->block; block != NULL; block = next) {
+        next = block->next;
+        free(block);
+    }
+
+    arena->block = NULL;
 }
 
 /*
- * Function: src_addr_sel2()
+ * Function: is_ip6_in_prefix_list()
  *
- * Selects a Source Address for a given Destination Address (old function)
+ * Checks whether an IPv6 address is present in an address list.
  */
 
-struct in6_addr *sel_src_addr_ra(struct iface_data *idata, struct in6_addr *dst) {
-    uint32_t mask32;
+int is_ip6_in_prefix_list(struct in6_addr *target, struct prefix_list *plist) {
     unsigned int i, j, full32, rest32;
-    /*
-       If the destination address is a link-local address, we select our link-local
-       address as the Source Address. If the dst address is a global unicast address
-       we select our first matching address, or else our first global address.
-       Worst case scenario, we don't have global address and must use our link-local
-       address.
-    */
-    if (IN6_IS_ADDR_LINKLOCAL(dst)) {
-        return (&(idata->ip6_local));
-    }
-    else if (IN6_IS_ADDR_MC_LINKLOCAL(dst) || IN6_IS_ADDR_LINKLOCAL(dst)) {
-        return (&(idata->ip6_local));
-    }
-    else if (idata->ip6_global_flag) {
-        for (i = 0; i < idata->ip6_global.nprefix; i++) {
-            full32 = (idata->ip6_global.prefix[i])->len / 32;
-            rest32 = (idata->ip6_global.prefix[i])->len % 32;
-            mask32 = 0xffffffff;
+    uint32_t mask32;
 
-            for (j = 0; j < full32; j++)
-                if (dst->s6_addr32[j] != (idata->ip6_global.prefix[i])->ip6.s6_addr32[j])
-                    break;
+    for (i = 0; i < plist->nprefix; i++) {
+        full32 = (plist->prefix[i])->len / 32;
+        rest32 = (plist->prefix[i])->len % 32;
+        mask32 = 0xffffffff;
 
-            if ((j == full32) && rest32) {
+        for (j = 0; j < full32; j++)
+            if (target->s6_addr32[j] != (plist->prefix[i])->ip6.s6_addr32[j])
+                break;
+
+        if (j == full32) {
+            if (rest32 == 0)
+                return TRUE;
+            else {
                 mask32 = mask32 << (32 - rest32);
 
-                if ((dst->s6_addr32[full32] & htonl(mask32)) ==
-                    ((idata->ip6_global.prefix[i])->ip6.s6_addr32[full32] & htonl(mask32)))
-                    return (&((idata->ip6_global.prefix[i])->ip6));
+                if ((target->s6_addr32[full32] & htonl(mask32)) ==
+                    ((plist->prefix[i])->ip6.s6_addr32[full32] & htonl(mask32)))
+                    return TRUE;
             }
         }
-
-        return (&((idata->ip6_global.prefix[0])->ip6));
     }
 
-    /* else */
-    return (&(idata->ip6_local));
+    return FALSE;
 }
 
 /*
- * Function: send_neighbor_advertisement()
+ * Function: is_time_elapsed()
  *
- * Send a Neighbor advertisement in response to a Neighbor Solicitation message
+ * Checks whether a specific amount of time has elapsed. (i.e., whether curtime >= lastprobe + delta
  */
 
-int send_neighbor_advert(struct iface_data *idata, pcap_t *pfd, const u_char *pktdata) {
-    unsigned int i;
-    int nw;
-    struct ether_header *pkt_ether;
-    struct ip6_hdr *pkt_ipv6;
-    struct nd_neighbor_solicit *pkt_ns;
-    unsigned char *ptr;
-    struct ether_header *ethernet;
-    unsigned char *v6buffer;
-    struct ip6_hdr *ipv6;
-    struct nd_neighbor_advert *na;
-    struct nd_opt_tlla *tllaopt;
-    struct in6_addr *pkt_ipv6addr;
-    unsigned char wbuffer[2500];
-
-    if (idata->mtu > sizeof(wbuffer)) {
-        if (idata->verbose_f)
-            puts("send_neighbor_advert(): Internal buffer too small");
-
-        return (-1);
+int is_time_elapsed(struct timeval *curtime, struct timeval *lastprobe, unsigned long delta) {
+    if (curtime->tv_sec > (lastprobe->tv_sec + delta / 1000000)) {
+        return (1);
+    }
+    else if (curtime->tv_sec == (lastprobe->tv_sec + delta / 1000000)) {
+        if (curtime->tv_usec >= (lastprobe->tv_usec + delta % 1000000)) {
+            return (1);
+        }
     }
 
-    ethernet = (struct ether_header *)wbuffer;
-    v6buffer = (unsigned char *)ethernet + sizeof(struct ether_header);
-    ipv6 = (struct ip6_hdr *)v6buffer;
-    na = (struct nd_neighbor_advert *)((char *)v6buffer + MIN_IPV6_HLEN);
-    ptr = (unsigned char *)na;
+    return (0);
+}
 
-    pkt_ether = (struct ether_header *)pktdata;
-    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + ETHER_HDR_LEN);
-    pkt_ns = (struct nd_neighbor_solicit *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
+/*
+ * Function: print_filters()
+ *
+ * Prints the filters that will be applied to incoming packets.
+ */
 
-    ethernet->ether_type = htons(ETHERTYPE_IPV6);
-    ipv6->ip6_flow = 0;
-    ipv6->ip6_vfc = 0x60;
-    ipv6->ip6_hlim = 255;
-    ipv6->ip6_nxt = IPPROTO_ICMPV6;
+void print_filters(struct iface_data *idata, struct filters *filters) {
+    unsigned int i;
+    char plinkaddr[ETHER_ADDR_PLEN];
+    char pv6addr[INET6_ADDRSTRLEN];
 
-    if ((ptr + sizeof(struct nd_neighbor_advert)) > (v6buffer + idata->mtu)) {
-        if (idata->verbose_f)
-            puts("send_neighbor_advert(): Packet too large when sending Neighbor Advertisement");
+    if (filters->nblocksrc) {
+        printf("Block filter for IPv6 Source Address: ");
 
-        return (-1);
+        for (i = 0; i < filters->nblocksrc; i++) {
+            if (inet_ntop(AF_INET6, &(filters->blocksrc[i]), pv6addr, sizeof(pv6addr)) == NULL) {
+                puts("inet_ntop(): Error converting IPv6 Src. Addr. filter to presentation format");
+                exit(EXIT_FAILURE);
+            }
+
+            printf("%s/%u   ", pv6addr, filters->blocksrclen[i]);
+        }
+        printf("\n");
     }
 
-    na->nd_na_type = ND_NEIGHBOR_ADVERT;
-    na->nd_na_code = 0;
-    ptr += sizeof(struct nd_neighbor_advert);
+    if (filters->nblockdst) {
+        printf("Block filter for IPv6 Destination Address: ");
 
-    if ((ptr + sizeof(struct nd_opt_tlla)) <= (v6buffer + idata->mtu)) {
-        tllaopt = (struct nd_opt_tlla *)ptr;
-        tllaopt->type = ND_OPT_TARGET_LINKADDR;
-        tllaopt->length = TLLA_OPT_LEN;
-        memcpy(tllaopt->address, idata->ether.a, ETH_ALEN);
-        ptr += sizeof(struct nd_opt_tlla);
-    }
-    else {
-        if (idata->verbose_f)
-            puts("send_neighbor_advert(): Packet Too Large while inserting TLLA option in NA message");
+        for (i = 0; i < filters->nblockdst; i++) {
+            if (inet_ntop(AF_INET6, &(filters->blockdst[i]), pv6addr, sizeof(pv6addr)) == NULL) {
+                puts("inet_ntop(): Error converting IPv6 Dst. Addr. filter to presentation format");
+                exit(EXIT_FAILURE);
+            }
 
-        return (-1);
+            printf("%s/%u   ", pv6addr, filters->blockdstlen[i]);
+        }
+        printf("\n");
     }
 
-    /* If the IPv6 Source Address of the incoming Neighbor Solicitation is the unspecified
-       address (::), the Neighbor Advertisement must be directed to the IPv6 all-nodes
-       multicast address (and the Ethernet Destination address should be 33:33:33:00:00:01).
-       Otherwise, the Neighbor Advertisement is sent to the IPv6 Source Address (and
-       Ethernet Source Address) of the incoming Neighbor Solicitation message
-     */
-    pkt_ipv6addr = &(pkt_ipv6->ip6_src);
+    if (filters->nblocktarget) {
+        printf("Block filter for Target Address: ");
 
-    if (IN6_IS_ADDR_UNSPECIFIED(pkt_ipv6addr)) {
-        na->nd_na_flags_reserved = 0;
+        for (i = 0; i < filters->nblocktarget; i++) {
+            if (inet_ntop(AF_INET6, &(filters->blocktarget[i]), pv6addr, sizeof(pv6addr)) == NULL) {
+                puts("inet_ntop(): Error converting Target Addr. filter to presentation format");
+                exit(EXIT_FAILURE);
+            }
 
-        if (inet_pton(AF_INET6, ALL_NODES_MULTICAST_ADDR, &(ipv6->ip6_dst)) <= 0) {
-            if (idata->verbose_f)
-                puts("send_neighbor_advert(): Error converting all-nodes multicast address");
+            printf("%s/%u   ", pv6addr, filters->blocktargetlen[i]);
+        }
+        printf("\n");
+    }
 
-            return (-1);
+    if (idata->type == DLT_EN10MB && !(idata->flags & IFACE_LOOPBACK)) {
+        if (filters->nblocklinksrc) {
+            printf("Block filter for link-layer Source Address: ");
+
+            for (i = 0; i < filters->nblocklinksrc; i++) {
+                if (ether_ntop(&(filters->blocklinksrc[i]), plinkaddr, sizeof(plinkaddr)) == FALSE) {
+                    puts("ether_ntop(): Error converting address");
+                    exit(EXIT_FAILURE);
+                }
+
+                printf("%s   ", plinkaddr);
+            }
+            printf("\n");
         }
 
-        if (ether_pton(ETHER_ALLNODES_LINK_ADDR, &(ethernet->dst), ETHER_ADDR_LEN) == FALSE) {
-            if (idata->verbose_f)
-                puts("send_neighbor_advert(): Error converting all-nodes link-local address");
+        if (filters->nblocklinkdst) {
+            printf("Block filter for link-layer Destination Address: ");
 
-            return (-1);
+            for (i = 0; i < filters->nblocklinkdst; i++) {
+                if (ether_ntop(&(filters->blocklinkdst[i]), plinkaddr, sizeof(plinkaddr)) == FALSE) {
+                    puts("ether_ntop(): Error converting address");
+                    exit(EXIT_FAILURE);
+                }
+
+                printf("%s   ", plinkaddr);
+            }
+            printf("\n");
         }
     }
-    else {
-        ipv6->ip6_dst = pkt_ipv6->ip6_src;
-        ethernet->dst = pkt_ether->src;
 
-        /*
-           Set the "Solicited" flag if NS was sent from an address other than the unspecified
-           address (i.e., the response will be unicast).
-         */
+    if (filters->nacceptsrc) {
+        printf("Accept filter for IPv6 Source Address: ");
 
-        na->nd_na_flags_reserved = ND_NA_FLAG_OVERRIDE | ND_NA_FLAG_SOLICITED;
-    }
+        for (i = 0; i < filters->nacceptsrc; i++) {
+            if (inet_ntop(AF_INET6, &(filters->acceptsrc[i]), pv6addr, sizeof(pv6addr)) == NULL) {
+                puts("inet_ntop(): Error converting IPv6 Src. Addr. filter to presentation format");
+                exit(EXIT_FAILURE);
+            }
 
-    ethernet->src = idata->ether;
+            printf("%s/%u   ", pv6addr, filters->acceptsrclen[i]);
+        }
+        printf("\n");
+    }
 
-    /*
-       If the Neighbor Solicitation message was directed to one of our unicast addresses, the IPv6 Source
-       Address is set to that address. Otherwise, we set the IPv6 Source Address to our link-local address.
-     */
+    if (filters->nacceptdst) {
+        printf("Accept filter for IPv6 Destination Address: ");
 
-    pkt_ipv6addr = &(pkt_ipv6->ip6_dst);
+        for (i = 0; i < filters->nacceptdst; i++) {
+            if (inet_ntop(AF_INET6, &(filters->acceptdst[i]), pv6addr, sizeof(pv6addr)) == NULL) {
+                puts("inet_ntop(): Error converting IPv6 Dst. Addr. filter to presentation format");
+                exit(EXIT_FAILURE);
+            }
 
-    if (IN6_IS_ADDR_MULTICAST(pkt_ipv6addr)) {
-        ipv6->ip6_src = idata->ip6_local;
-    }
-    else {
-        if (is_eq_in6_addr(pkt_ipv6addr, &(idata->ip6_local))) {
-            ipv6->ip6_src = idata->ip6_local;
+            printf("%s/%u   ", pv6addr, filters->acceptdstlen[i]);
         }
-        else if (idata->ip6_global_flag) {
-            for (i = 0; i < idata->ip6_global.nprefix; i++) {
-                if (is_eq_in6_addr(pkt_ipv6addr, &((idata->ip6_global.prefix[i])->ip6))) {
-                    ipv6->ip6_src = (idata->ip6_global.prefix[i])->ip6;
-                    break;
-                }
+        printf("\n");
+    }
+
+    if (filters->naccepttarget) {
+        printf("Accept filter for Target Address: ");
+
+        for (i = 0; i < filters->naccepttarget; i++) {
+            if (inet_ntop(AF_INET6, &(filters->accepttarget[i]), pv6addr, sizeof(pv6addr)) == NULL) {
+                puts("inet_ntop(): Error converting Target Addr. filter to presentation format");
+                exit(EXIT_FAILURE);
             }
 
-            if (i == idata->ip6_global.nprefix)
-                return 0;
-        }
-        else {
-            return 0;
+            printf("%s/%u   ", pv6addr, filters->accepttargetlen[i]);
         }
+        printf("\n");
     }
 
-    na->nd_na_target = pkt_ns->nd_ns_target;
-
-    na->nd_na_cksum = 0;
-    na->nd_na_cksum = in_chksum(v6buffer, na, ptr - ((unsigned char *)na), IPPROTO_ICMPV6);
+    if (idata->type == DLT_EN10MB && !(idata->flags & IFACE_LOOPBACK)) {
+        if (filters->nacceptlinksrc) {
+            printf("Accept filter for link-layer Source Address: ");
 
-    ipv6->ip6_plen = htons((ptr - v6buffer) - MIN_IPV6_HLEN);
+            for (i = 0; i < filters->nacceptlinksrc; i++) {
+                if (ether_ntop(&(filters->acceptlinksrc[i]), plinkaddr, sizeof(plinkaddr)) == FALSE) {
+                    puts("ether_ntop(): Error converting address");
+                    exit(EXIT_FAILURE);
+                }
 
-    if ((nw = pcap_inject(pfd, wbuffer, ptr - wbuffer)) == -1) {
-        if (idata->verbose_f)
-            printf("send_neighbor_advert(): pcap_inject(): %s", pcap_geterr(pfd));
+                printf("%s   ", plinkaddr);
+            }
+            printf("\n");
+        }
 
-        return (-1);
-    }
+        if (filters->nacceptlinkdst) {
+            printf("Accept filter for link-layer Destination Address: ");
 
-    if (nw != (ptr - wbuffer)) {
-        if (idata->verbose_f)
-            printf("send_neighbor_advert(): pcap_inject(): only wrote %d bytes "
-                   "(rather than %lu bytes)\n",
-                   nw, (LUI)(ptr - wbuffer));
+            for (i = 0; i < filters->nacceptlinkdst; i++) {
+                if (ether_ntop(&(filters->acceptlinkdst[i]), plinkaddr, sizeof(plinkaddr)) == FALSE) {
+                    puts("ether_ntop(): Error converting address");
+                    exit(EXIT_FAILURE);
+                }
 
-        return (-1);
+                printf("%s   ", plinkaddr);
+            }
+            printf("\n");
+        }
     }
 
-    return 0;
+    if (filters->nfilefilters)
+        printf("Address filters loaded from filter files: %u\n", filters->nfilefilters);
 }
 
 /*
- * Function: string_escapes()
+ * Function: dissect_packet()
  *
- * Replace some escape sequences in a string
+ * Walks the link-layer header, the IPv6 header and all the Extension Headers of a received packet, and fills
+ * "view" with pointers to them. Returns FAILURE if the packet is not an IPv6 packet, if any of its headers is
+ * truncated, if its upper-layer header is shorter than the minimum TCP, UDP or ICMPv6 header, or (with
+ * DISSECT_CKSUM) if its upper-layer checksum is not valid. The checksum can only be verified for packets that have
+ * been captured in full and that are not fragments: PV_CKSUM_OK is set in view->flags when it has been.
  */
 
-int string_escapes(char *data, unsigned int *datalen, unsigned int maxlen) {
-    char *org, *dst;
-    org = data;
-    dst = data;
+int dissect_packet(struct iface_data *idata, const u_char *pktdata, const struct pcap_pkthdr *pkthdr,
+                   struct packet_view *view, unsigned int flags) {
+    unsigned char *p, *capend;
+    size_t hdrlen, minlen;
+    uint8_t nh;
 
-    while (org < (data + *datalen) && dst <= (data + maxlen)) {
-        if (*org == '\\') {
-            if ((org + 1) < (data + *datalen)) {
-                org++;
+    memset(view, 0, sizeof(struct packet_view));
 
-                switch (*org) {
-                case '\\':
-                    *dst = '\\';
-                    break;
+    if (pkthdr->caplen < (idata->linkhsize + MIN_IPV6_HLEN))
+        return (FAILURE);
 
-                case 'n':
-                    *dst = CHAR_LF;
-                    break;
+    if (idata->type == DLT_EN10MB) {
+        view->ether = (struct ether_header *)pktdata;
 
-                case 'r':
-                    *dst = CHAR_CR;
-                    break;
+        if (view->ether->ether_type != htons(ETHERTYPE_IPV6))
+            return (FAILURE);
+    }
 
-                default:
-                    return 0;
-                }
-            }
-            else
-                *dst = *org;
-        }
-        else {
-            if (org != dst)
-                *dst = *org;
-        }
+    view->ipv6 = (struct ip6_hdr *)((unsigned char *)pktdata + idata->linkhsize);
 
-        org++;
-        dst++;
+    if ((view->ipv6->ip6_vfc & 0xf0) != 0x60)
+        return (FAILURE);
+
+    /*
+       The packet length is the minimum of what we captured, and what is specified in the IPv6 Payload Length
+       field (a Payload Length of 0 is only used by jumbograms, in which case we use what we captured)
+     */
+    capend = (unsigned char *)pktdata + pkthdr->caplen;
+    view->end = (unsigned char *)view->ipv6 + MIN_IPV6_HLEN + ntohs(view->ipv6->ip6_plen);
+
+    if (view->ipv6->ip6_plen == 0 || view->end > capend) {
+        if (view->ipv6->ip6_plen != 0 || pkthdr->caplen < pkthdr->len)
+            view->flags |= PV_TRUNCATED;
+
+        view->end = capend;
     }
 
-    *datalen = dst - data;
-    return 1;
-}
+    p = (unsigned char *)view->ipv6 + MIN_IPV6_HLEN;
+    nh = view->ipv6->ip6_nxt;
 
-/*
- * Function: Strnlen()
- *
- * Our own version of strnlen(), since some OSes do not support it.
- */
+    while (nh == IPPROTO_HOPOPTS || nh == IPPROTO_ROUTING || nh == IPPROTO_DSTOPTS || nh == IPPROTO_FRAGMENT ||
+           nh == IPPROTO_AH) {
+        /* All of these headers are at least 8 bytes long */
+        if ((view->end - p) < 8)
+            return (FAILURE);
 
-size_t Strnlen(const char *s, size_t maxlen) {
-    size_t i = 0;
+        if (nh == IPPROTO_FRAGMENT)
+            hdrlen = sizeof(struct ip6_frag);
+        else if (nh == IPPROTO_AH)
+            hdrlen = (*(p + 1) + 2) << 2;
+        else
+            hdrlen = (*(p + 1) + 1) << 3;
 
-    while (i < maxlen && s[i] != 0)
-        i++;
+        if ((view->end - p) < hdrlen)
+            return (FAILURE);
 
-    if (i < maxlen)
-        return (i);
-    else
-        return (maxlen);
-}
+        view->flags |= PV_EXTHDRS;
+        view->nexthdrs++;
 
-/*
- * Function: init_iface_data()
- *
- * Initializes the contents of "iface_data" structure
- */
+        if (nh == IPPROTO_FRAGMENT) {
+            view->frag = (struct ip6_frag *)p;
+            view->flags |= PV_FRAGMENT;
 
-int init_iface_data(struct iface_data *idata) {
-    unsigned int i;
+            if (view->frag->ip6f_offlg & IP6F_OFF_MASK)
+                view->flags |= PV_LATER_FRAGMENT;
+        }
 
-    memset(idata, 0, sizeof(struct iface_data));
+        nh = *p;
+        p += hdrlen;
 
-    idata->mtu = ETH_DATA_LEN;
-    idata->local_retrans = 0;
-    idata->local_timeout = 1;
+        if (view->flags & PV_LATER_FRAGMENT)
+            break;
+    }
 
-    if ((idata->ip6_global.prefix = malloc(MAX_LOCAL_ADDRESSES * sizeof(struct prefix_entry *))) == NULL)
-        return (FAILURE);
+    view->upper = p;
+    view->upperlen = view->end - p;
+    view->proto = nh;
 
-    idata->ip6_global.nprefix = 0;
-    idata->ip6_global.maxprefix = MAX_LOCAL_ADDRESSES;
+    if (view->flags & PV_LATER_FRAGMENT)
+        return (SUCCESS);
 
-    if ((idata->prefix_ol.prefix = malloc(MAX_PREFIXES_ONLINK * sizeof(struct prefix_entry *))) == NULL)
-        return (FAILURE);
+    switch (nh) {
+    case IPPROTO_TCP:
+        minlen = sizeof(struct tcp_hdr);
+        break;
 
-    idata->prefix_ol.nprefix = 0;
-    idata->prefix_ol.maxprefix = MAX_PREFIXES_ONLINK;
+    case IPPROTO_UDP:
+        minlen = sizeof(struct udp_hdr);
+        break;
 
-    if ((idata->prefix_ac.prefix = malloc(MAX_PREFIXES_AUTO * sizeof(struct prefix_entry *))) == NULL)
-        return (FAILURE);
+    case IPPROTO_ICMPV6:
+        minlen = sizeof(struct icmp6_hdr);
+        break;
 
-    idata->prefix_ac.nprefix = 0;
-    idata->prefix_ac.maxprefix = MAX_PREFIXES_AUTO;
+    default:
+        return (SUCCESS);
+    }
 
-    if (((idata->iflist).ifaces = malloc(sizeof(struct iface_entry) * MAX_IFACES)) == NULL)
+    if (view->upperlen < minlen)
         return (FAILURE);
 
-    memset((idata->iflist).ifaces, 0, sizeof(struct iface_entry) * MAX_IFACES);
-
-    idata->iflist.nifaces = 0;
-    idata->iflist.maxifaces = MAX_IFACES;
-
-    for (i = 0; i < MAX_IFACES; i++) {
-        if (((idata->iflist).ifaces[i].ip6_global.prefix =
-                 malloc(sizeof(struct prefix_entry *) * MAX_LOCAL_ADDRESSES)) == NULL) {
-            return (FAILURE);
-        }
-
-        (idata->iflist).ifaces[i].ip6_global.maxprefix = MAX_LOCAL_ADDRESSES;
-
-        if (((idata->iflist).ifaces[i].ip6_local.prefix =
-                 malloc(sizeof(struct prefix_entry *) * MAX_LOCAL_ADDRESSES)) == NULL) {
+    if ((flags & DISSECT_CKSUM) && !(view->flags & (PV_TRUNCATED | PV_FRAGMENT))) {
+        if (in_chksum(view->ipv6, view->upper, view->upperlen, nh) != 0)
             return (FAILURE);
-        }
 
-        (idata->iflist).ifaces[i].ip6_local.maxprefix = MAX_LOCAL_ADDRESSES;
+        view->flags |= PV_CKSUM_OK;
     }
 
-    return SUCCESS;
+    return (SUCCESS);
 }
 
 /*
- * Function: init_filters()
+ * Function: print_filter_result()
  *
- * Initializes a filters structure, and allocates memory for the filter data.
+ * Prints infromation about an incoming packet and whether it was blocked or
+ * accepted by a filter.
  */
 
-int init_filters(struct filters *filters) {
-    memset(filters, 0, sizeof(struct filters));
-
-    if ((filters->blocksrc = malloc(sizeof(struct in6_addr) * MAX_BLOCK_SRC)) == NULL)
-        return (-1);
-
-    if ((filters->blockdst = malloc(sizeof(struct in6_addr) * MAX_BLOCK_DST)) == NULL)
-        return (-1);
-
-    if ((filters->blocktarget = malloc(sizeof(struct in6_addr) * MAX_BLOCK_TARGET)) == NULL)
-        return (-1);
+void print_filter_result(struct iface_data *idata, const u_char *pkt_data, unsigned char fresult) {
+    struct ip6_hdr *pkt_ipv6;
+    char psrcaddr[INET6_ADDRSTRLEN], pdstaddr[INET6_ADDRSTRLEN];
 
-    if ((filters->blocklinksrc = malloc(sizeof(struct ether_addr) * MAX_BLOCK_LINK_SRC)) == NULL)
-        return (-1);
+    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_data + idata->linkhsize);
 
-    if ((filters->blocklinkdst = malloc(sizeof(struct ether_addr) * MAX_BLOCK_LINK_DST)) == NULL)
-        return (-1);
+    if (inet_ntop(AF_INET6, &(pkt_ipv6->ip6_src), psrcaddr, sizeof(psrcaddr)) == NULL) {
+        puts("inet_ntop(): Error converting IPv6 Source Address to presentation format");
+        exit(EXIT_FAILURE);
+    }
 
-    if ((filters->blocksrclen = malloc(sizeof(uint8_t) * MAX_BLOCK_SRC)) == NULL)
-        return (-1);
+    if (inet_ntop(AF_INET6, &(pkt_ipv6->ip6_dst), pdstaddr, sizeof(pdstaddr)) == NULL) {
+        puts("inet_ntop(): Error converting IPv6 Destination Address to presentation format");
+        exit(EXIT_FAILURE);
+    }
 
-    if ((filters->blockdstlen = malloc(sizeof(uint8_t) * MAX_BLOCK_DST)) == NULL)
-        return (-1);
+    if (idata->ifset_f)
+        printf("%s: ", idata->iface);
 
-    if ((filters->blocktargetlen = malloc(sizeof(uint8_t) * MAX_BLOCK_TARGET)) == NULL)
-        return (-1);
+    printf("Received IPv6 packet from %s to %s (%s)\n", psrcaddr, pdstaddr,
+           ((fresult == ACCEPTED) ? "accepted" : "blocked"));
+}
 
-    if ((filters->acceptsrc = malloc(sizeof(struct in6_addr) * MAX_ACCEPT_SRC)) == NULL)
-        return (-1);
+/*
+ * Function: count_filter_result()
+ *
+ * Accounts an incoming packet as accepted or blocked in the metrics of the interface (if any)
+ */
 
-    if ((filters->acceptdst = malloc(sizeof(struct in6_addr) * MAX_ACCEPT_DST)) == NULL)
-        return (-1);
+void count_filter_result(struct iface_data *idata, unsigned char fresult) {
+    if (idata->metrics != NULL) {
+        if (fresult == ACCEPTED)
+            idata->metrics->accepted++;
+        else
+            idata->metrics->filtered++;
+    }
+}
 
-    if ((filters->accepttarget = malloc(sizeof(struct in6_addr) * MAX_ACCEPT_TARGET)) == NULL)
-        return (-1);
+/*
+ * Function: report_filter_result()
+ *
+ * Accounts an incoming packet as accepted or blocked in the metrics of the interface (if any), and prints it with
+ * print_filter_result() (blocked packets are printed only at the higher verbosity level)
+ */
 
-    if ((filters->acceptlinksrc = malloc(sizeof(struct ether_addr) * MAX_ACCEPT_LINK_SRC)) == NULL)
-        return (-1);
+void report_filter_result(struct iface_data *idata, const u_char *pkt_data, unsigned char fresult) {
+    count_filter_result(idata, fresult);
 
-    if ((filters->acceptlinkdst = malloc(sizeof(struct ether_addr) * MAX_ACCEPT_LINK_DST)) == NULL)
-        return (-1);
+    if (idata->verbose_f > ((fresult == ACCEPTED) ? 0 : 1))
+        print_filter_result(idata, pkt_data, fresult);
+}
 
-    if ((filters->acceptsrclen = malloc(sizeof(uint8_t) * MAX_ACCEPT_SRC)) == NULL)
-        return (-1);
+/*
+ * randomize_ether_addr()
+ *
+ * Select a random Ethernet address.
+ */
 
-    if ((filters->acceptdstlen = malloc(sizeof(uint8_t) * MAX_ACCEPT_DST)) == NULL)
-        return (-1);
+void randomize_ether_addr(struct ether_addr *ethaddr) {
+    prng_fill(thread_prng(), ethaddr, sizeof(struct ether_addr));
+    ethaddr->a[0] = (ethaddr->a[0] & 0xfc) | 0x02;
+}
 
-    if ((filters->accepttargetlen = malloc(sizeof(uint8_t) * MAX_ACCEPT_TARGET)) == NULL)
-        return (-1);
+/*
+ * randomize_ipv6_addr()
+ *
+ * Select a random IPv6 from a given prefix.
+ */
 
-    return (0);
+void randomize_ipv6_addr(struct in6_addr *ipv6addr, const struct in6_addr *prefix, uint8_t preflen) {
+    randomize_ipv6_addrs(ipv6addr, 1, prefix, preflen);
 }
 
 /*
- * Function: sel_next_hop_ra()
- *
- * Performs next hop determination by sending the necessary packets
+ * randomize_ipv6_addrs()
  *
+ * Select "n" random IPv6 addresses from a given prefix (e.g., the Source Addresses of a batch of packets). The
+ * random bits for all of the addresses are produced at once, and the prefix is then merged into each address.
  */
 
-int sel_next_hop_ra(struct iface_data *idata) {
-    /*
-       Select link-layer destination address
+void randomize_ipv6_addrs(struct in6_addr *ipv6addrs, unsigned int n, const struct in6_addr *prefix, uint8_t preflen) {
+    uint32_t mask[4];
+    struct in6_addr pfx;
+    unsigned int i, j;
 
-       + If the underlying interface is loopback or tunnel, there is no need
-         to select a link-layer destination address
-       + If a link-layer Destination Address has been specified, we do not need to
-         select one
-       + If the destination address is link-local, there is no need to perform
-         next-hop determination
-       + Otherwise we need to learn the local router or do ND as a last ressort
-     */
-    if ((idata->type == DLT_EN10MB && (!(idata->flags & IFACE_LOOPBACK) && !(idata->flags & IFACE_TUNNEL))) &&
-        (!(idata->hdstaddr_f) && idata->dstaddr_f)) {
-        if (IN6_IS_ADDR_LINKLOCAL(&(idata->dstaddr))) {
-            /*
-               If the IPv6 Destination Address is a multicast address, there is no need
-               to perform Neighbor Discovery
-             */
-            if (IN6_IS_ADDR_MC_LINKLOCAL(&(idata->dstaddr))) {
-                idata->hdstaddr = ether_multicast(&(idata->dstaddr));
-            }
-            else if (ipv6_to_ether(idata->pfd, idata, &(idata->dstaddr), &(idata->hdstaddr)) != 1) {
-                if (idata->verbose_f)
-                    puts("Error while performing Neighbor Discovery for the Destination Address");
+    for (j = 0; j < 4; j++) {
+        if (preflen >= (j + 1) * 32)
+            mask[j] = 0xffffffff;
+        else if (preflen <= j * 32)
+            mask[j] = 0;
+        else
+            mask[j] = htonl(0xffffffff << (32 - (preflen - j * 32)));
 
-                return (-1);
-            }
-        }
-        else if (find_ipv6_router_full(idata->pfd, idata) == 1) {
-            if (is_ip6_in_prefix_list(&(idata->dstaddr), &(idata->prefix_ol))) {
-                /* If address is on-link, we must perform Neighbor Discovery */
-                if (ipv6_to_ether(idata->pfd, idata, &(idata->dstaddr), &(idata->hdstaddr)) != 1) {
-                    if (idata->verbose_f)
-                        puts("Error while performing Neighbor Discovery for the Destination Address");
+        pfx.s6_addr32[j] = prefix->s6_addr32[j] & mask[j];
+    }
 
-                    return (-1);
-                }
-            }
-            else {
-                idata->hdstaddr = idata->router_ether;
-            }
-        }
-        else {
-            if (idata->verbose_f)
-                puts("Couldn't find local router. Now trying Neighbor Discovery for the target node");
-            /*
-             * If we were not able to find a local router, we assume the destination is "on-link" (as
-             * a last ressort), and thus perform Neighbor Discovery for that destination
-             */
-            if (ipv6_to_ether(idata->pfd, idata, &(idata->dstaddr), &(idata->hdstaddr)) != 1) {
-                if (idata->verbose_f)
-                    puts("Error while performing Neighbor Discovery for the Destination Address");
+    prng_fill(thread_prng(), ipv6addrs, n * sizeof(struct in6_addr));
 
-                return (-1);
-            }
-        }
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < 4; j++)
+            ipv6addrs[i].s6_addr32[j] = pfx.s6_addr32[j] | (ipv6addrs[i].s6_addr32[j] & ~mask[j]);
     }
-
-    return (0);
 }
 
 /*
- * Function: inc_sdev()
+ * randomize_port()
  *
- * Computes the average increment and standard deviation of an array of uint32_t's.
- * The function computes the aforementioned values for network byte order and host byte order,
- * and returns as a result the set of values with smaller standard deviation.
+ * Select a random port from a given port/mask
  */
-int inc_sdev(uint32_t *s, unsigned int n, uint32_t *diff_avg, double *diff_sdev) {
-    unsigned int i;
-    uint32_t *diff, *s2;
-    unsigned long long int diff1_avg, diff2_avg;
-    double diff1_sdev, diff2_sdev;
 
-    if ((diff = malloc((n - 1) * sizeof(uint32_t))) == NULL)
-        return (-1);
+void randomize_port(uint16_t *port, uint16_t prefix, uint8_t preflen) {
+    randomize_ports(port, 1, prefix, preflen);
+}
 
-    diff1_avg = 0;
+/*
+ * randomize_ports()
+ *
+ * Select "n" random ports from a given port/mask
+ */
 
-    for (i = 0; i < (n - 1); i++) {
-        diff[i] = s[i + 1] - s[i];
-        diff1_avg += diff[i];
-    }
+void randomize_ports(uint16_t *ports, unsigned int n, uint16_t prefix, uint8_t preflen) {
+    uint32_t mask;
+    unsigned int i;
 
-    diff1_avg = diff1_avg / (n - 1);
+    mask = 0x10000;
+    mask = mask >> preflen;
 
-    diff1_sdev = 0;
+    sanitize_port(&prefix, preflen);
+    prng_fill(thread_prng(), ports, n * sizeof(uint16_t));
 
-    for (i = 0; i < (n - 1); i++)
-        diff1_sdev = diff1_sdev + (diff[i] - diff1_avg) * (diff[i] - diff1_avg);
+    for (i = 0; i < n; i++)
+        ports[i] = (uint16_t)(prefix + (ports[i] & (mask - 1)));
+}
 
-    diff1_sdev = sqrt(diff1_sdev / (n - 2));
+/*
+ * release_privileges()
+ *
+ * Releases superuser privileges by switching to the real uid and gid, or to nobody
+ */
 
-    if ((s2 = malloc(n * sizeof(uint32_t))) == NULL)
-        return (-1);
+void release_privileges(void) {
+    uid_t ruid;
+    gid_t rgid;
+    struct passwd *pwdptr;
 
-    memcpy(s2, s, n * sizeof(uint32_t));
-    change_endianness(s2, n);
-
-    diff2_avg = 0;
+    /*
+       If the real UID is not root, we setuid() and setgid() to that user and group, releasing superuser
+       privileges. Otherwise, if the real UID is 0, we try to setuid() to "nobody", releasing superuser
+       privileges.
+     */
+    if ((ruid = getuid()) && (rgid = getgid())) {
+        if (setgid(rgid) == -1) {
+            puts("Error while releasing superuser privileges (changing to real GID)");
+            exit(EXIT_FAILURE);
+        }
 
-    for (i = 0; i < (n - 1); i++) {
-        diff[i] = s2[i + 1] - s2[i];
-        diff2_avg += diff[i];
+        if (setuid(ruid) == -1) {
+            puts("Error while releasing superuser privileges (changing to real UID)");
+            exit(EXIT_FAILURE);
+        }
     }
+    else {
+        if ((pwdptr = getpwnam("nobody"))) {
+            if (!pwdptr->pw_uid || !pwdptr->pw_gid) {
+                puts("User 'nobody' has incorrect privileges");
+                exit(EXIT_FAILURE);
+            }
 
-    diff2_avg = diff2_avg / (n - 1);
-
-    diff2_sdev = 0;
-
-    for (i = 0; i < (n - 1); i++)
-        diff2_sdev = diff2_sdev + (diff[i] - diff2_avg) * (diff[i] - diff2_avg);
-
-    diff2_sdev = sqrt(diff2_sdev / (n - 2));
-
-    free(diff);
-    free(s2);
+            if (setgid(pwdptr->pw_gid) == -1) {
+                puts("Error while releasing superuser privileges (changing to nobody's group)");
+                exit(EXIT_FAILURE);
+            }
 
-    if (diff1_sdev <= diff2_sdev) {
-        *diff_avg = (uint32_t)diff1_avg;
-        *diff_sdev = diff1_sdev;
-    }
-    else {
-        *diff_avg = (uint32_t)diff2_avg;
-        *diff_sdev = diff2_sdev;
+            if (setuid(pwdptr->pw_uid) == -1) {
+                puts("Error while releasing superuser privileges (changing to 'nobody')");
+                exit(EXIT_FAILURE);
+            }
+        }
     }
-
-    return (0);
 }
 
 /*
- * Function: change_endianness()
+ * sanitize_ipv6_prefix()
  *
- * Changes the endianness of an array of uint32_t's
+ * Clears those bits in an IPv6 address that are not within a prefix length.
  */
-void change_endianness(uint32_t *s, unsigned int n) {
-    unsigned int i;
-    union {
-        uint32_t ui;
-        unsigned char c[4];
-    } swapper;
 
-    unsigned char c;
+void sanitize_ipv6_prefix(struct in6_addr *ipv6addr, uint8_t prefixlen) {
+    unsigned int skip, i;
+    uint32_t mask;
 
-    for (i = 0; i < n; i++) {
-        swapper.ui = *s;
-        c = swapper.c[3];
-        swapper.c[3] = swapper.c[0];
-        swapper.c[0] = c;
+    skip = (prefixlen + 31) / 32;
 
-        c = swapper.c[2];
-        swapper.c[2] = swapper.c[1];
-        swapper.c[1] = c;
+    if (prefixlen % 32) {
+        mask = 0;
+        for (i = 0; i < (prefixlen % 32); i++)
+            mask = (mask >> 1) | 0x80000000;
+
+        ipv6addr->s6_addr32[skip - 1] = ipv6addr->s6_addr32[skip - 1] & htonl(mask);
     }
+
+    for (i = skip; i < 4; i++)
+        ipv6addr->s6_addr32[i] = 0;
 }
 
 /*
- * Function: send_neighbor_solicit()
+ * sanitize_port()
  *
- * Sends a Neighbor Advertisement message for a target address
+ * Clears those bits in a transport port that are not within a port mas.
  */
-int send_neighbor_solicit(struct iface_data *idata, struct in6_addr *target) {
-    unsigned char *ptr, *prev_nh;
-    unsigned char buffer[PACKET_BUFFER_SIZE];
-    unsigned int ns_max_packet_size;
-    struct ether_header *ether;
-    unsigned char *v6buffer;
-    int nw;
-    struct ip6_hdr *ipv6;
-    struct nd_neighbor_solicit *ns;
-    struct nd_opt_slla *sllaopt;
 
-    ns_max_packet_size = idata->mtu;
+void sanitize_port(uint16_t *port, uint8_t prefixlen) {
+    uint16_t mask;
 
-    ether = (struct ether_header *)buffer;
-    v6buffer = buffer + idata->linkhsize;
-    ipv6 = (struct ip6_hdr *)v6buffer;
+    mask = 0xffff;
+    mask = mask << (16 - prefixlen);
 
-    ether->src = idata->ether;
-    ether->dst = ether_multicast(&(ipv6->ip6_dst));
-    ether->ether_type = htons(ETHERTYPE_IPV6);
+    *port = *port & mask;
+}
 
-    ipv6->ip6_flow = 0;
-    ipv6->ip6_vfc = 0x60;
-    ipv6->ip6_hlim = 255;
-    ipv6->ip6_src = idata->srcaddr;
-    ipv6->ip6_dst = solicited_node(&(idata->dstaddr));
+/*
+ * Function: siphash24()
+ *
+ * Computes the SipHash-2-4 keyed hash of a buffer, with a 128-bit key
+ */
 
-    prev_nh = (unsigned char *)&(ipv6->ip6_nxt);
-    *prev_nh = IPPROTO_ICMPV6;
+#define SIPROUND                                                                                                       \
+    do {                                                                                                               \
+        v0 += v1;                                                                                                      \
+        v1 = (v1 << 13) | (v1 >> 51);                                                                                  \
+        v1 ^= v0;                                                                                                      \
+        v0 = (v0 << 32) | (v0 >> 32);                                                                                  \
+        v2 += v3;                                                                                                      \
+        v3 = (v3 << 16) | (v3 >> 48);                                                                                  \
+        v3 ^= v2;                                                                                                      \
+        v0 += v3;                                                                                                      \
+        v3 = (v3 << 21) | (v3 >> 43);                                                                                  \
+        v3 ^= v0;                                                                                                      \
+        v2 += v1;                                                                                                      \
+        v1 = (v1 << 17) | (v1 >> 47);                                                                                  \
+        v1 ^= v2;                                                                                                      \
+        v2 = (v2 << 32) | (v2 >> 32);                                                                                  \
+    } while (0)
+
+uint64_t siphash24(const uint8_t *key, const void *data, size_t len) {
+    const uint8_t *in = data;
+    uint64_t k0 = 0, k1 = 0, m, b;
+    uint64_t v0, v1, v2, v3;
+    size_t i, left;
+
+    for (i = 0; i < 8; i++) {
+        k0 |= (uint64_t)key[i] << (8 * i);
+        k1 |= (uint64_t)key[i + 8] << (8 * i);
+    }
+
+    v0 = k0 ^ 0x736f6d6570736575ULL;
+    v1 = k1 ^ 0x646f72616e646f6dULL;
+    v2 = k0 ^ 0x6c7967656e657261ULL;
+    v3 = k1 ^ 0x7465646279746573ULL;
+
+    for (left = len; left >= 8; left -= 8, in += 8) {
+        m = 0;
+
+        for (i = 0; i < 8; i++)
+            m |= (uint64_t)in[i] << (8 * i);
+
+        v3 ^= m;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= m;
+    }
+
+    b = ((uint64_t)len) << 56;
+
+    for (i = 0; i < left; i++)
+        b |= (uint64_t)in[i] << (8 * i);
+
+    v3 ^= b;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+
+    return (v0 ^ v1 ^ v2 ^ v3);
+}
 
-    ptr = (unsigned char *)v6buffer + MIN_IPV6_HLEN;
+/*
+ * Function: prng_seed()
+ *
+ * Seeds the fast generator (the state is expanded from the seed with SplitMix64, such that similar seeds do not
+ * produce similar sequences)
+ */
 
-    if ((ptr + sizeof(struct nd_neighbor_solicit)) > (v6buffer + ns_max_packet_size)) {
-        if (idata->verbose_f > 1)
-            puts("Packet too large while inserting Neighbor Solicitation header");
+void prng_seed(struct prng *prng, uint64_t seed) {
+    uint64_t z;
+    unsigned int i;
 
-        return (-1);
+    for (i = 0; i < 4; i++) {
+        seed += 0x9e3779b97f4a7c15ULL;
+        z = seed;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        prng->s[i] = z ^ (z >> 31);
     }
 
-    ns = (struct nd_neighbor_solicit *)(ptr);
-
-    ns->nd_ns_type = ND_NEIGHBOR_SOLICIT;
-    ns->nd_ns_code = 0;
-    ns->nd_ns_reserved = 0;
-    ns->nd_ns_target = *target;
+    prng->type = PRNG_FAST;
+    prng->seeded_f = TRUE;
+}
 
-    ptr += sizeof(struct nd_neighbor_solicit);
-    sllaopt = (struct nd_opt_slla *)ptr;
+/*
+ * Function: prng_seed_key()
+ *
+ * Seeds the keyed generator with a PRNG_KEY_SIZE-byte key
+ */
 
-    if ((ptr + sizeof(struct nd_opt_slla)) > (v6buffer + ns_max_packet_size)) {
-        if (idata->verbose_f > 1)
-            puts("NS message too large while processing source link-layer address opt.");
+void prng_seed_key(struct prng *prng, const uint8_t *key) {
+    memcpy(prng->key, key, PRNG_KEY_SIZE);
+    prng->counter = 0;
+    prng->type = PRNG_KEYED;
+    prng->seeded_f = TRUE;
+}
 
-        return (-1);
-    }
+/*
+ * Function: prng_seed_random()
+ *
+ * Seeds a generator of the specified type from /dev/urandom. If /dev/urandom is not available, the seed is derived
+ * from the current time and the process ID, and FAILURE is returned.
+ */
 
-    sllaopt->type = ND_OPT_SOURCE_LINKADDR;
-    sllaopt->length = SLLA_OPT_LEN;
-    memcpy(sllaopt->address, &(idata->ether.a), ETH_ALEN);
-    ptr += sizeof(struct nd_opt_slla);
+int prng_seed_random(struct prng *prng, unsigned char type) {
+    uint8_t seed[PRNG_KEY_SIZE];
+    struct timeval tv;
+    uint64_t weak;
+    FILE *fp;
+    int r = FAILURE;
 
-    ipv6->ip6_plen = htons((ptr - v6buffer) - MIN_IPV6_HLEN);
-    ns->nd_ns_cksum = 0;
-    ns->nd_ns_cksum = in_chksum(v6buffer, ns, ptr - ((unsigned char *)ns), IPPROTO_ICMPV6);
+    if ((fp = fopen("/dev/urandom", "r")) != NULL) {
+        if (fread(seed, sizeof(seed), 1, fp) == 1)
+            r = SUCCESS;
 
-    if ((nw = pcap_inject(idata->pfd, buffer, ptr - buffer)) == -1) {
-        if (idata->verbose_f > 1)
-            printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+        fclose(fp);
+    }
 
-        return (-1);
+    if (r == FAILURE) {
+        gettimeofday(&tv, NULL);
+        weak = ((uint64_t)tv.tv_sec << 32) ^ (uint64_t)tv.tv_usec ^ ((uint64_t)getpid() << 16);
+        memset(seed, 0, sizeof(seed));
+        memcpy(seed, &weak, sizeof(weak));
     }
 
-    if (nw != (ptr - buffer)) {
-        if (idata->verbose_f > 1)
-            printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
-        return (-1);
+    if (type == PRNG_KEYED) {
+        prng_seed_key(prng, seed);
+    }
+    else {
+        memcpy(&weak, seed, sizeof(weak));
+        prng_seed(prng, weak ^ siphash24(seed, seed + sizeof(weak), sizeof(seed) - sizeof(weak)));
     }
 
-    return 0;
+    return (r);
 }
 
-#ifdef __linux__
 /*
- * Function: sel_next_hop()
+ * Function: prng_next()
  *
- * Find the next hop for a target destination
+ * Returns the next 64-bit output of a generator
  */
-int sel_next_hop(struct iface_data *idata) {
-    int sockfd;
-    struct sockaddr_nl addr, them;
-    int ret;
-    pid_t pid;
-    char reply[MAX_NLPAYLOAD];
-    struct msghdr msg;
-    struct iovec iov;
-    struct nlrequest req;
-    struct nlmsghdr *nlp;
-    struct rtmsg *rtp;
-    struct rtattr *rtap;
-    int nll, rtl;
-    unsigned char skip_f;
-
-#ifdef DEBUG
-    puts("DEBUG: BEGIN sel_next_hop()");
-#endif
 
-    if ((sockfd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE)) == -1) {
-        if (idata->verbose_f)
-            puts("Error in socket()");
+uint64_t prng_next(struct prng *prng) {
+    uint64_t *s = prng->s;
+    uint64_t r, t;
+
+    if (prng->type == PRNG_KEYED) {
+        r = siphash24(prng->key, &(prng->counter), sizeof(prng->counter));
+        prng->counter++;
+        return (r);
+    }
+
+    r = s[1] * 5;
+    r = ((r << 7) | (r >> 57)) * 9;
+    t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+    return (r);
+}
 
-        return (FAILURE);
-    }
+/*
+ * Function: prng_fill()
+ *
+ * Fills a buffer with pseudorandom bytes (e.g., the Fragment Identifications of a batch of packets)
+ */
 
-    memset((void *)&addr, 0, sizeof(addr));
-    addr.nl_family = AF_NETLINK;
-    addr.nl_pid = pid = getpid();
-    addr.nl_groups = RTMGRP_IPV6_ROUTE;
+void prng_fill(struct prng *prng, void *buf, size_t len) {
+    unsigned char *p = buf;
+    uint64_t r;
 
-    if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
-        if (idata->verbose_f)
-            puts("Error in bind()");
+    while (len >= sizeof(r)) {
+        r = prng_next(prng);
+        memcpy(p, &r, sizeof(r));
+        p += sizeof(r);
+        len -= sizeof(r);
+    }
 
-        close(sockfd);
-        return (FAILURE);
+    if (len > 0) {
+        r = prng_next(prng);
+        memcpy(p, &r, len);
     }
+}
 
-    memset(&req, 0, sizeof(req));
-    req.nl.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
-    req.nl.nlmsg_flags = NLM_F_REQUEST;
-    req.nl.nlmsg_type = RTM_GETROUTE;
-    req.rt.rtm_family = AF_INET6;
+/*
+ * Function: thread_prng()
+ *
+ * Returns the (fast) generator of the calling thread, which is seeded from /dev/urandom when first used. A process
+ * that forks must reseed it in the child with prng_seed_random(), or both processes will produce the same sequence.
+ */
 
-    rtap = (struct rtattr *)req.buf;
+struct prng *thread_prng(void) {
+    if (!tprng.seeded_f)
+        prng_seed_random(&tprng, PRNG_FAST);
 
-    /* Destination Address */
-    if (idata->dstaddr_f) {
-#ifdef DEBUG
-        print_ipv6_address("DEBUG Req RTA_DST: ", &(idata->dstaddr));
-#endif
-        rtap->rta_type = RTA_DST;
-        rtap->rta_len = RTA_SPACE(sizeof(idata->dstaddr));
-        memcpy(RTA_DATA(rtap), &(idata->dstaddr), sizeof(idata->dstaddr));
-        req.nl.nlmsg_len += rtap->rta_len;
-    }
+    return (&tprng);
+}
 
-    /* Source Address */
-    if (idata->srcaddr_f) {
-#ifdef DEBUG
-        print_ipv6_address("DEBUG Req RTA_SRC: ", &(idata->srcaddr));
-#endif
-        rtap = (struct rtattr *)((char *)rtap + (rtap->rta_len));
-        rtap->rta_type = RTA_SRC;
-        rtap->rta_len = RTA_SPACE(sizeof(idata->srcaddr));
-        memcpy(RTA_DATA(rtap), &(idata->srcaddr), sizeof(idata->srcaddr));
-        req.nl.nlmsg_len += rtap->rta_len;
-    }
+/*
+ * Function: prng_random32()
+ *
+ * Returns 32 pseudorandom bits from the generator of the calling thread (a replacement for random())
+ */
 
-    /* address it */
-    memset(&them, 0, sizeof(them));
-    them.nl_family = AF_NETLINK;
+uint32_t prng_random32(void) {
+    return ((uint32_t)(prng_next(thread_prng()) >> 32));
+}
 
-    memset(&msg, 0, sizeof(msg));
-    msg.msg_name = (void *)&them;
-    msg.msg_namelen = sizeof(them);
+/*
+ * Function: src_addr_sel2()
+ *
+ * Selects a Source Address for a given Destination Address (old function)
+ */
 
-    memset(&iov, 0, sizeof(iov));
-    iov.iov_base = (void *)&req.nl;
-    iov.iov_len = req.nl.nlmsg_len;
+struct in6_addr *sel_src_addr_ra(struct iface_data *idata, struct in6_addr *dst) {
+    uint32_t mask32;
+    unsigned int i, j, full32, rest32;
+    /*
+       If the destination address is a link-local address, we select our link-local
+       address as the Source Address. If the dst address is a global unicast address
+       we select our first matching address, or else our first global address.
+       Worst case scenario, we don't have global address and must use our link-local
+       address.
+    */
+    if (IN6_IS_ADDR_LINKLOCAL(dst)) {
+        return (&(idata->ip6_local));
+    }
+    else if (IN6_IS_ADDR_MC_LINKLOCAL(dst) || IN6_IS_ADDR_LINKLOCAL(dst)) {
+        return (&(idata->ip6_local));
+    }
+    else if (idata->ip6_global_flag) {
+        for (i = 0; i < idata->ip6_global.nprefix; i++) {
+            full32 = (idata->ip6_global.prefix[i])->len / 32;
+            rest32 = (idata->ip6_global.prefix[i])->len % 32;
+            mask32 = 0xffffffff;
 
-    msg.msg_iov = &iov;
-    msg.msg_iovlen = 1;
+            for (j = 0; j < full32; j++)
+                if (dst->s6_addr32[j] != (idata->ip6_global.prefix[i])->ip6.s6_addr32[j])
+                    break;
 
-    /* send it */
-    if ((ret = sendmsg(sockfd, &msg, 0)) < 0) {
+            if ((j == full32) && rest32) {
+                mask32 = mask32 << (32 - rest32);
+
+                if ((dst->s6_addr32[full32] & htonl(mask32)) ==
+                    ((idata->ip6_global.prefix[i])->ip6.s6_addr32[full32] & htonl(mask32)))
+                    return (&((idata->ip6_global.prefix[i])->ip6));
+            }
+        }
+
+        return (&((idata->ip6_global.prefix[0])->ip6));
+    }
+
+    /* else */
+    return (&(idata->ip6_local));
+}
+
+/*
+ * Function: send_neighbor_advertisement()
+ *
+ * Send a Neighbor advertisement in response to a Neighbor Solicitation message
+ */
+
+int send_neighbor_advert(struct iface_data *idata, pcap_t *pfd, const u_char *pktdata) {
+    unsigned int i;
+    int nw;
+    struct ether_header *pkt_ether;
+    struct ip6_hdr *pkt_ipv6;
+    struct nd_neighbor_solicit *pkt_ns;
+    unsigned char *ptr;
+    struct ether_header *ethernet;
+    unsigned char *v6buffer;
+    struct ip6_hdr *ipv6;
+    struct nd_neighbor_advert *na;
+    struct nd_opt_tlla *tllaopt;
+    struct in6_addr *pkt_ipv6addr;
+    unsigned char wbuffer[2500];
+
+    if (idata->mtu > sizeof(wbuffer)) {
         if (idata->verbose_f)
-            puts("Error in send()");
+            puts("send_neighbor_advert(): Internal buffer too small");
 
-        close(sockfd);
-        return (FAILURE);
+        return (-1);
     }
 
-    memset(reply, 0, sizeof(reply));
+    ethernet = (struct ether_header *)wbuffer;
+    v6buffer = (unsigned char *)ethernet + sizeof(struct ether_header);
+    ipv6 = (struct ip6_hdr *)v6buffer;
+    na = (struct nd_neighbor_advert *)((char *)v6buffer + MIN_IPV6_HLEN);
+    ptr = (unsigned char *)na;
 
-    if ((ret = recv(sockfd, reply, sizeof(reply), 0)) < 0) {
+    pkt_ether = (struct ether_header *)pktdata;
+    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + ETHER_HDR_LEN);
+    pkt_ns = (struct nd_neighbor_solicit *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
+
+    ethernet->ether_type = htons(ETHERTYPE_IPV6);
+    ipv6->ip6_flow = 0;
+    ipv6->ip6_vfc = 0x60;
+    ipv6->ip6_hlim = 255;
+    ipv6->ip6_nxt = IPPROTO_ICMPV6;
+
+    if ((ptr + sizeof(struct nd_neighbor_advert)) > (v6buffer + idata->mtu)) {
         if (idata->verbose_f)
-            puts("Error in recv()");
+            puts("send_neighbor_advert(): Packet too large when sending Neighbor Advertisement");
 
-        close(sockfd);
-        return (FAILURE);
+        return (-1);
     }
 
-    nll = ret;
+    na->nd_na_type = ND_NEIGHBOR_ADVERT;
+    na->nd_na_code = 0;
+    ptr += sizeof(struct nd_neighbor_advert);
 
-#ifdef DEBUG
-    puts("DEBUG: sel_next_hop() going to loop through the results");
-#endif
+    if ((ptr + sizeof(struct nd_opt_tlla)) <= (v6buffer + idata->mtu)) {
+        tllaopt = (struct nd_opt_tlla *)ptr;
+        tllaopt->type = ND_OPT_TARGET_LINKADDR;
+        tllaopt->length = TLLA_OPT_LEN;
+        memcpy(tllaopt->address, idata->ether.a, ETH_ALEN);
+        ptr += sizeof(struct nd_opt_tlla);
+    }
+    else {
+        if (idata->verbose_f)
+            puts("send_neighbor_advert(): Packet Too Large while inserting TLLA option in NA message");
 
-    /*
-       This should eventually be improved to handle the case where messages are lost, since Netlink messages
-       are reliable.
+        return (-1);
+    }
+
+    /* If the IPv6 Source Address of the incoming Neighbor Solicitation is the unspecified
+       address (::), the Neighbor Advertisement must be directed to the IPv6 all-nodes
+       multicast address (and the Ethernet Destination address should be 33:33:33:00:00:01).
+       Otherwise, the Neighbor Advertisement is sent to the IPv6 Source Address (and
+       Ethernet Source Address) of the incoming Neighbor Solicitation message
      */
-    for (nlp = (struct nlmsghdr *)reply; NLMSG_OK(nlp, nll); nlp = NLMSG_NEXT(nlp, nll)) {
-        rtp = (struct rtmsg *)NLMSG_DATA(nlp);
+    pkt_ipv6addr = &(pkt_ipv6->ip6_src);
 
-        skip_f = 0;
+    if (IN6_IS_ADDR_UNSPECIFIED(pkt_ipv6addr)) {
+        na->nd_na_flags_reserved = 0;
 
-        if (rtp->rtm_family == AF_INET6) {
-            for (rtap = (struct rtattr *)RTM_RTA(rtp), rtl = RTM_PAYLOAD(nlp); RTA_OK(rtap, rtl);
-                 rtap = RTA_NEXT(rtap, rtl)) {
-                switch (rtap->rta_type) {
-                case RTA_DST:
+        if (inet_pton(AF_INET6, ALL_NODES_MULTICAST_ADDR, &(ipv6->ip6_dst)) <= 0) {
+            if (idata->verbose_f)
+                puts("send_neighbor_advert(): Error converting all-nodes multicast address");
 
-#ifdef DEBUG
-                    print_ipv6_address("DEBUG: RTA_DST: ", (struct in6_addr *)RTA_DATA(rtap));
-#endif
+            return (-1);
+        }
 
-                    /*
-                       If Destination is different from Destination Address, this just means that we need to send
-                       our packets to a local router
-                     */
-                    /*
-                    if(!is_eq_in6_addr(&(idata->dstaddr), (struct in6_addr *) RTA_DATA(rtap))){
-                            skip_f=1;
-                    }
-                    */
-                    break;
+        if (ether_pton(ETHER_ALLNODES_LINK_ADDR, &(ethernet->dst), ETHER_ADDR_LEN) == FALSE) {
+            if (idata->verbose_f)
+                puts("send_neighbor_advert(): Error converting all-nodes link-local address");
 
-                case RTA_OIF:
-                    idata->nhifindex = *((int *)RTA_DATA(rtap));
+            return (-1);
+        }
+    }
+    else {
+        ipv6->ip6_dst = pkt_ipv6->ip6_src;
+        ethernet->dst = pkt_ether->src;
 
-                    if (if_indextoname(idata->nhifindex, idata->nhiface) == NULL) {
-                        if (idata->verbose_f)
-                            puts("Error calling if_indextoname() from sel_next_hop()");
+        /*
+           Set the "Solicited" flag if NS was sent from an address other than the unspecified
+           address (i.e., the response will be unicast).
+         */
 
-#ifdef DEBUG
-                        puts("DEBUG: RTA_OIF: iif_indextoname() failed");
-#endif
-                        return (FAILURE);
-                    }
+        na->nd_na_flags_reserved = ND_NA_FLAG_OVERRIDE | ND_NA_FLAG_SOLICITED;
+    }
 
-#ifdef DEBUG
-                    printf("DEBUG: RTA_OIF: Index: %d, Name: %s\n", idata->nhifindex, idata->nhiface);
-#endif
-                    idata->nhifindex_f = 1;
-                    break;
+    ethernet->src = idata->ether;
 
-                case RTA_GATEWAY:
-                    idata->nhaddr = *((struct in6_addr *)RTA_DATA(rtap));
-#ifdef DEBUG
-                    print_ipv6_address("DEBUG: RTA_GATEWAY: ", (struct in6_addr *)RTA_DATA(rtap));
-#endif
+    /*
+       If the Neighbor Solicitation message was directed to one of our unicast addresses, the IPv6 Source
+       Address is set to that address. Otherwise, we set the IPv6 Source Address to our link-local address.
+     */
 
-                    if (!IN6_IS_ADDR_UNSPECIFIED(&(idata->nhaddr))) {
-                        idata->nhaddr_f = 1;
-#ifdef DEBUG
-                        puts("DEBUG: set the nhaddr_F flag");
-#endif
-                    }
-                    else {
-#ifdef DEBUG
-                        puts("DEBUG: Did not set the nhaddr_f flag was ADR_UNSPECIFIED)");
-#endif
-                    }
-                    break;
-                }
+    pkt_ipv6addr = &(pkt_ipv6->ip6_dst);
 
-                if (skip_f)
+    if (IN6_IS_ADDR_MULTICAST(pkt_ipv6addr)) {
+        ipv6->ip6_src = idata->ip6_local;
+    }
+    else {
+        if (is_eq_in6_addr(pkt_ipv6addr, &(idata->ip6_local))) {
+            ipv6->ip6_src = idata->ip6_local;
+        }
+        else if (idata->ip6_global_flag) {
+            for (i = 0; i < idata->ip6_global.nprefix; i++) {
+                if (is_eq_in6_addr(pkt_ipv6addr, &((idata->ip6_global.prefix[i])->ip6))) {
+                    ipv6->ip6_src = (idata->ip6_global.prefix[i])->ip6;
                     break;
+                }
             }
 
-            if (skip_f) {
-#ifdef DEBUG
-                puts("DEBUG: Skipping set");
-#endif
-                continue;
-            }
+            if (i == idata->ip6_global.nprefix)
+                return 0;
+        }
+        else {
+            return 0;
         }
     }
 
-    close(sockfd);
+    na->nd_na_target = pkt_ns->nd_ns_target;
 
-    if (idata->nhifindex_f) {
-        idata->nh_f = TRUE;
-#ifdef DEBUG
-        puts("DEBUG: END sel_next_hop() (SUCCESS)");
-#endif
-        return (SUCCESS);
-    }
-    else {
-#ifdef DEBUG
-        puts("DEBUG: END sel_next_hop() (FAILURE)");
-#endif
-        return (FAILURE);
-    }
-}
-#elif defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__) ||                     \
-    defined(__FreeBSD_kernel__) || defined(__sun) || defined(sun)
-/*
- * Function: sel_next_hop()
- *
- * Find the next hop for a target destination
- */
-int sel_next_hop(struct iface_data *idata) {
-    int sockfd;
-    pid_t pid;
-    int seq;
-    ssize_t r;
-    unsigned int queries = 0, i;
-    char reply[MAX_RTPAYLOAD];
-    struct rt_msghdr *rtm;
-    struct sockaddr_in6 *sin6;
-    struct sockaddr_dl *sockpptr;
-    struct sockaddr *sa;
-    unsigned char onlink_f = FALSE;
+    na->nd_na_cksum = 0;
+    na->nd_na_cksum = in_chksum(v6buffer, na, ptr - ((unsigned char *)na), IPPROTO_ICMPV6);
 
-#ifdef DEBUG
-    puts("DEBUG: BEGIN sel_next_hop()");
-#endif
+    ipv6->ip6_plen = htons((ptr - v6buffer) - MIN_IPV6_HLEN);
 
-    if ((sockfd = socket(AF_ROUTE, SOCK_RAW, 0)) == -1) {
+    if ((nw = pcap_inject(pfd, wbuffer, ptr - wbuffer)) == -1) {
         if (idata->verbose_f)
-            puts("Error in socket() call from sel_next_hop()");
+            printf("send_neighbor_advert(): pcap_inject(): %s", pcap_geterr(pfd));
 
-#ifdef DEBUG
-        puts("DEBUG: sel_next_hop() Failed when opening socket");
-        puts("DEBUG end sel_next_hop() (FAILURE)");
-#endif
-        return (FAILURE);
+        return (-1);
     }
 
-    idata->nhaddr = idata->dstaddr;
-
-    do {
-        rtm = (struct rt_msghdr *)reply;
-        memset(rtm, 0, sizeof(struct rt_msghdr));
-        rtm->rtm_msglen = sizeof(struct rt_msghdr) + sizeof(struct sockaddr_in6);
-        rtm->rtm_version = RTM_VERSION;
-        rtm->rtm_type = RTM_GET;
-#if defined(__OpenBSD__)
-        rtm->rtm_addrs = RTA_DST;
-#else
-        rtm->rtm_addrs = RTA_DST | RTA_IFP;
-#endif
-        rtm->rtm_pid = pid = getpid();
-        rtm->rtm_seq = seq = random();
-
-        sin6 = (struct sockaddr_in6 *)(rtm + 1);
-        memset(sin6, 0, sizeof(struct sockaddr_in6));
-#ifdef SIN6_LEN
-        sin6->sin6_len = sizeof(struct sockaddr_in6);
-#endif
-        sin6->sin6_family = AF_INET6;
-        sin6->sin6_addr = idata->nhaddr;
+    if (nw != (ptr - wbuffer)) {
+        if (idata->verbose_f)
+            printf("send_neighbor_advert(): pcap_inject(): only wrote %d bytes "
+                   "(rather than %lu bytes)\n",
+                   nw, (LUI)(ptr - wbuffer));
 
-        if (write(sockfd, rtm, rtm->rtm_msglen) == -1) {
-            if (idata->verbose_f)
-                puts("write() failed. No route to the intenteded destination in the local routing table");
+        return (-1);
+    }
 
-            return (FAILURE);
-        }
+    return 0;
+}
 
-        do {
-            if ((r = read(sockfd, rtm, MAX_RTPAYLOAD)) < 0) {
-                if (idata->verbose_f)
-                    puts("Error in read() call from sel_next_hop()");
+/*
+ * Function: string_escapes()
+ *
+ * Replace some escape sequences in a string
+ */
 
-                return (FAILURE);
-            }
-        } while (rtm->rtm_type != RTM_GET || rtm->rtm_pid != pid || rtm->rtm_seq != seq);
+int string_escapes(char *data, unsigned int *datalen, unsigned int maxlen) {
+    char *org, *dst;
+    org = data;
+    dst = data;
 
-        /* The rt_msghdr{} structure is followed by sockaddr structures */
-        sa = (struct sockaddr *)(rtm + 1);
+    while (org < (data + *datalen) && dst <= (data + maxlen)) {
+        if (*org == '\\') {
+            if ((org + 1) < (data + *datalen)) {
+                org++;
 
-        for (i = 0; i < RTAX_MAX; i++) {
-            if (rtm->rtm_addrs & (1 << i)) {
-                switch (i) {
-                case RTAX_GATEWAY:
-                    if (sa->sa_family == AF_INET6 && rtm->rtm_flags & RTF_GATEWAY) {
-                        idata->nhaddr = ((struct sockaddr_in6 *)sa)->sin6_addr;
-                        idata->nhaddr_f = TRUE;
-                    }
+                switch (*org) {
+                case '\\':
+                    *dst = '\\';
                     break;
 
-                case RTAX_IFP:
-                    if (sa->sa_family == AF_LINK) {
-                        sockpptr = (struct sockaddr_dl *)(sa);
-                        idata->nhifindex = sockpptr->sdl_index;
-                        idata->nhifindex_f = TRUE;
-
-                        if (if_indextoname(idata->nhifindex, idata->nhiface) == NULL) {
-                            puts("Error calling if_indextoname() from sel_next_hop()");
-                            return (EXIT_FAILURE);
-                        }
+                case 'n':
+                    *dst = CHAR_LF;
+                    break;
 
-                        onlink_f = TRUE;
-                    }
+                case 'r':
+                    *dst = CHAR_CR;
                     break;
-                }
 
-#if defined(sun) || defined(__sun)
-                if (i == RTAX_IFP || i == RTAX_IFA)
-                    sa = (struct sockaddr *)((char *)sa + sizeof(struct sockaddr_dl));
-                else
-                    sa = (struct sockaddr *)((char *)sa + sizeof(struct sockaddr_in6));
-#else
-                sa = (struct sockaddr *)((char *)sa + SA_SIZE(sa));
-#endif
+                default:
+                    return 0;
+                }
             }
+            else
+                *dst = *org;
         }
-
-        queries++;
-    } while (!onlink_f && queries < 10);
-
-    close(sockfd);
-
-    if (idata->nhifindex_f) {
-#if defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__) ||                       \
-    defined(__FreeBSD_kernel__)
-        if (IN6_IS_ADDR_LINKLOCAL(&(idata->nhaddr))) {
-            /* BSDs store the interface index in s6_addr16[1], so we must clear it */
-            idata->nhaddr.s6_addr16[1] = 0;
-            idata->nhaddr.s6_addr16[2] = 0;
-            idata->nhaddr.s6_addr16[3] = 0;
+        else {
+            if (org != dst)
+                *dst = *org;
         }
-#endif
 
-#ifdef DEBUG
-        puts("DEBUG: END sel_next_hop() (SUCCESS)");
-#endif
-        return (SUCCESS);
-    }
-    else {
-#ifdef DEBUG
-        puts("DEBUG: END sel_next_hop() (FAILURE)");
-#endif
-        return (FAILURE);
+        org++;
+        dst++;
     }
+
+    *datalen = dst - data;
+    return 1;
 }
-#endif
 
 /*
- * Function: print_ipv6_address()
+ * Function: Strnlen()
  *
- * Prints an IPv6 address with a legend
+ * Our own version of strnlen(), since some OSes do not support it.
  */
 
-unsigned int print_ipv6_address(char *s, struct in6_addr *v6addr) {
-    char pv6addr[INET6_ADDRSTRLEN];
+size_t Strnlen(const char *s, size_t maxlen) {
+    size_t i = 0;
 
-    if (inet_ntop(AF_INET6, v6addr, pv6addr, sizeof(pv6addr)) == NULL) {
-        puts("inet_ntop(): Error converting IPv6 Source Address to presentation format");
-        return (EXIT_FAILURE);
-    }
+    while (i < maxlen && s[i] != 0)
+        i++;
 
-    printf("%s%s\n", s, pv6addr);
-    return (EXIT_SUCCESS);
+    if (i < maxlen)
+        return (i);
+    else
+        return (maxlen);
 }
 
 /*
- * Function: print_ipv6_address_rev()
+ * Function: init_iface_data()
  *
- * Prints an IPv6 address in reversed form
+ * Initializes the contents of "iface_data" structure
  */
 
-unsigned int print_ipv6_address_rev(struct in6_addr *v6addr) {
-    int i;
+int init_iface_data(struct iface_data *idata) {
+    unsigned int i;
 
-    for (i = 15; i >= 0; i--) {
-        printf("%01x.%01x%s", v6addr->s6_addr[i] & 0x0f, v6addr->s6_addr[i] >> 4, i ? "." : "\n");
-    }
+    memset(idata, 0, sizeof(struct iface_data));
 
-    return (EXIT_SUCCESS);
-}
+    idata->mtu = ETH_DATA_LEN;
+    idata->local_retrans = 0;
+    idata->local_timeout = 1000000;
 
-/*
- * Function: get_local_addrs()
- *
- * Obtains all local addresses (Ethernet and IPv6 addresses for all interfaces)
- */
+    if ((idata->ip6_global.prefix = malloc(MAX_LOCAL_ADDRESSES * sizeof(struct prefix_entry *))) == NULL)
+        return (FAILURE);
 
-int get_local_addrs(struct iface_data *idata) {
-    struct iface_entry *cif;
-    struct ifaddrs *ifptr, *ptr;
-    struct sockaddr_in6 *sockin6ptr;
+    idata->ip6_global.nprefix = 0;
+    idata->ip6_global.maxprefix = MAX_LOCAL_ADDRESSES;
 
-#ifdef __linux__
-    struct sockaddr_ll *sockpptr;
-#elif defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__) ||                     \
-    defined(__FreeBSD_kernel__)
-    struct sockaddr_dl *sockpptr;
-#endif
+    if ((idata->prefix_ol.prefix = malloc(MAX_PREFIXES_ONLINK * sizeof(struct prefix_entry *))) == NULL)
+        return (FAILURE);
 
-    if (getifaddrs(&ifptr) != 0) {
-        if (idata->verbose_f > 1) {
-            puts("Error in call to getifaddrs()");
-        }
+    idata->prefix_ol.nprefix = 0;
+    idata->prefix_ol.maxprefix = MAX_PREFIXES_ONLINK;
+
+    if ((idata->prefix_ac.prefix = malloc(MAX_PREFIXES_AUTO * sizeof(struct prefix_entry *))) == NULL)
         return (FAILURE);
-    }
 
-    for (ptr = ifptr; ptr != NULL; ptr = ptr->ifa_next) {
-        if (ptr->ifa_addr == NULL) {
-            continue;
-        }
+    idata->prefix_ac.nprefix = 0;
+    idata->prefix_ac.maxprefix = MAX_PREFIXES_AUTO;
 
-        if (ptr->ifa_name == NULL) {
-#ifdef DEBUG
-            puts("DEBUG: ifa_name was null");
-#endif
-            continue;
-        }
+    if (((idata->iflist).ifaces = malloc(sizeof(struct iface_entry) * MAX_IFACES)) == NULL)
+        return (FAILURE);
 
-        if ((cif = find_iface_by_name(&(idata->iflist), ptr->ifa_name)) == NULL) {
-            if (idata->iflist.nifaces >= MAX_IFACES)
-                continue;
-            else {
-                cif = &(idata->iflist.ifaces[idata->iflist.nifaces]);
-                strncpy(cif->iface, ptr->ifa_name, IFACE_LENGTH);
-                cif->iface[IFACE_LENGTH - 1] = 0;
-                /* XXX: Cannot otherwise find the index for tun devices? */
-                cif->ifindex = if_nametoindex(cif->iface);
-                idata->iflist.nifaces++;
-            }
-        }
-
-#ifdef __linux__
-        if ((ptr->ifa_addr)->sa_family == AF_PACKET) {
-            sockpptr = (struct sockaddr_ll *)(ptr->ifa_addr);
+    memset((idata->iflist).ifaces, 0, sizeof(struct iface_entry) * MAX_IFACES);
 
-            if (sockpptr->sll_halen == ETHER_ADDR_LEN) {
-                memcpy(&(cif->ether), sockpptr->sll_addr, ETHER_ADDR_LEN);
-                cif->ether_f = TRUE;
-            }
+    idata->iflist.nifaces = 0;
+    idata->iflist.maxifaces = MAX_IFACES;
 
-            cif->ifindex = sockpptr->sll_ifindex;
+    for (i = 0; i < MAX_IFACES; i++) {
+        if (((idata->iflist).ifaces[i].ip6_global.prefix =
+                 malloc(sizeof(struct prefix_entry *) * MAX_LOCAL_ADDRESSES)) == NULL) {
+            return (FAILURE);
         }
-#elif defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__) ||                     \
-    defined(__FreeBSD_kernel__)
-        if ((ptr->ifa_addr)->sa_family == AF_LINK) {
-            sockpptr = (struct sockaddr_dl *)(ptr->ifa_addr);
-            if (sockpptr->sdl_alen == ETHER_ADDR_LEN) {
-                memcpy(&(cif->ether), (sockpptr->sdl_data + sockpptr->sdl_nlen), ETHER_ADDR_LEN);
-                cif->ether_f = TRUE;
-            }
 
-            cif->ifindex = sockpptr->sdl_index;
-        }
-#endif
-        else if ((ptr->ifa_addr)->sa_family == AF_INET6) {
-            sockin6ptr = (struct sockaddr_in6 *)(ptr->ifa_addr);
+        (idata->iflist).ifaces[i].ip6_global.maxprefix = MAX_LOCAL_ADDRESSES;
 
-            if (IN6_IS_ADDR_LINKLOCAL(&(sockin6ptr->sin6_addr))) {
-                if (cif->ip6_local.nprefix >= cif->ip6_local.maxprefix)
-                    continue;
+        if (((idata->iflist).ifaces[i].ip6_local.prefix =
+                 malloc(sizeof(struct prefix_entry *) * MAX_LOCAL_ADDRESSES)) == NULL) {
+            return (FAILURE);
+        }
 
-                if (is_ip6_in_prefix_list(&(sockin6ptr->sin6_addr), &(cif->ip6_local)) == TRUE)
-                    continue;
+        (idata->iflist).ifaces[i].ip6_local.maxprefix = MAX_LOCAL_ADDRESSES;
+    }
 
-                if ((cif->ip6_local.prefix[cif->ip6_local.nprefix] = malloc(sizeof(struct prefix_entry))) == NULL) {
-                    if (idata->verbose_f > 1)
-                        puts("Error while storing Source Address");
+    return SUCCESS;
+}
 
-                    freeifaddrs(ifptr);
-                    return (FAILURE);
-                }
+/*
+ * Function: init_tx_batch()
+ *
+ * Enables batched transmission of frames with send_frame(). On Linux, frames are queued and sent in batches with
+ * sendmmsg() over a PF_PACKET socket. On other systems (or on non-Ethernet links), send_frame() falls back to
+ * pcap_inject(). Since it opens a PF_PACKET socket, it must be called before dropping privileges.
+ */
 
-                (cif->ip6_local.prefix[cif->ip6_local.nprefix])->len = 128;
-                (cif->ip6_local.prefix[cif->ip6_local.nprefix])->ip6 = sockin6ptr->sin6_addr;
+int init_tx_batch(struct iface_data *idata, unsigned int nframes) {
+#ifdef __linux__
+    struct sockaddr_ll sll;
+    unsigned int ifindex;
 
-#if defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__) ||                       \
-    defined(__FreeBSD_kernel__)
-                /* BSDs store the interface index in s6_addr16[1], so we must clear it */
-                (cif->ip6_local.prefix[cif->ip6_local.nprefix])->ip6.s6_addr16[1] = 0;
-                (cif->ip6_local.prefix[cif->ip6_local.nprefix])->ip6.s6_addr16[2] = 0;
-                (cif->ip6_local.prefix[cif->ip6_local.nprefix])->ip6.s6_addr16[3] = 0;
-#endif
+    if (nframes < 2 || idata->type != DLT_EN10MB || idata->txbatch_f)
+        return (SUCCESS);
 
-                cif->ip6_local.nprefix++;
-            }
-            else {
-                if (is_ip6_in_prefix_list(&(sockin6ptr->sin6_addr), &(cif->ip6_global)))
-                    continue;
+    if ((ifindex = if_nametoindex(idata->iface)) == 0)
+        return (SUCCESS);
 
-                if (IN6_IS_ADDR_LOOPBACK(&(sockin6ptr->sin6_addr)))
-                    cif->flags = IFACE_LOOPBACK;
+    if ((idata->txfd = socket(PF_PACKET, SOCK_RAW, 0)) == -1) {
+        if (idata->verbose_f > 1)
+            perror("init_tx_batch()");
 
-                if (cif->ip6_global.nprefix >= cif->ip6_global.maxprefix)
-                    continue;
+        return (SUCCESS);
+    }
 
-                if ((cif->ip6_global.prefix[cif->ip6_global.nprefix] = malloc(sizeof(struct prefix_entry))) == NULL) {
-                    if (idata->verbose_f > 1)
-                        puts("Error while storing Source Address");
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = 0;
+    sll.sll_ifindex = ifindex;
 
-                    freeifaddrs(ifptr);
-                    return (FAILURE);
-                }
+    if (bind(idata->txfd, (struct sockaddr *)&sll, sizeof(sll)) == -1) {
+        if (idata->verbose_f > 1)
+            perror("init_tx_batch()");
 
-                (cif->ip6_global.prefix[cif->ip6_global.nprefix])->len = 128;
-                (cif->ip6_global.prefix[cif->ip6_global.nprefix])->ip6 = sockin6ptr->sin6_addr;
-                cif->ip6_global.nprefix++;
-            }
-        }
+        close(idata->txfd);
+        return (SUCCESS);
     }
 
-    freeifaddrs(ifptr);
+    if ((idata->txbuffer = malloc(nframes * TX_FRAME_SIZE)) == NULL ||
+        (idata->txlen = malloc(nframes * sizeof(unsigned int))) == NULL) {
+        if (idata->verbose_f > 1)
+            puts("init_tx_batch(): Not enough memory");
 
-#ifdef DEBUG
-    debug_print_ifaces_data(&(idata->iflist));
+        free(idata->txbuffer);
+        idata->txbuffer = NULL;
+        close(idata->txfd);
+        return (FAILURE);
+    }
+
+    idata->ntxframes = 0;
+    idata->maxtxframes = nframes;
+    idata->txbatch_f = TRUE;
 #endif
     return (SUCCESS);
 }
 
 /*
- * Function: debug_print_ifaces_data()
+ * Function: flush_tx_batch()
  *
- * Prints the data correspoding to each interface
+ * Sends all frames queued by send_frame(). Frames that cannot be sent with sendmmsg() are sent with pcap_inject().
+ * Every frame that cannot be sent is accounted in write_errors. Returns 0 if all the frames were sent, or -1 (with
+ * errno set by the last failure) if any of them could not be sent.
  */
 
-void debug_print_ifaces_data(struct iface_list *iflist) {
-    unsigned int i, j;
-    struct iface_entry *iface;
-    char plinkaddr[ETHER_ADDR_PLEN];
-    char pv6addr[INET6_ADDRSTRLEN];
-
-    for (i = 0; i < iflist->nifaces; i++) {
-        iface = iflist->ifaces + i;
-
-        printf("DEBUG: Interface: %s (%d)\tFlags:%s%s\n", iface->iface, iface->ifindex,
-               (iface->flags & IFACE_LOOPBACK) ? " LOOPBACK" : "", (iface->flags & IFACE_TUNNEL) ? "TUNNEL" : "");
+int flush_tx_batch(struct iface_data *idata) {
+#ifdef __linux__
+    struct mmsghdr msgs[TX_BATCH_SIZE];
+    struct iovec iovs[TX_BATCH_SIZE];
+    unsigned int i, n, sent = 0, errors = 0;
+    size_t bytes;
+    int r;
 
-        if (iface->ether_f) {
-            if (ether_ntop(&(iface->ether), plinkaddr, sizeof(plinkaddr)) == FALSE) {
-                puts("DEBUG: ether_ntop(): Error converting address");
-                exit(EXIT_FAILURE);
-            }
+    if (!idata->txbatch_f || idata->ntxframes == 0)
+        return (0);
 
-            printf("DEBUG: Link address: %s\n", plinkaddr);
-        }
+    while (sent < idata->ntxframes) {
+        n = idata->ntxframes - sent;
 
-        if ((iface->ip6_global).nprefix) {
-            puts("DEBUG: Global addresses:");
+        if (n > TX_BATCH_SIZE)
+            n = TX_BATCH_SIZE;
 
-            for (j = 0; j < (iface->ip6_global.nprefix); j++) {
-                if (inet_ntop(AF_INET6, &((iface->ip6_global.prefix[j])->ip6), pv6addr, sizeof(pv6addr)) == NULL) {
-                    puts("DEBUG: inet_ntop(): Error converting IPv6 Address to presentation format");
-                    exit(EXIT_FAILURE);
-                }
+        memset(msgs, 0, n * sizeof(struct mmsghdr));
 
-                printf("DEBUG: %s\n", pv6addr);
-            }
+        for (i = 0; i < n; i++) {
+            iovs[i].iov_base = idata->txbuffer + (sent + i) * TX_FRAME_SIZE;
+            iovs[i].iov_len = idata->txlen[sent + i];
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
         }
 
-        if ((iface->ip6_local).nprefix) {
-            puts("DEBUG: Local addresses:");
-
-            for (j = 0; j < (iface->ip6_local.nprefix); j++) {
-                if (inet_ntop(AF_INET6, &((iface->ip6_local.prefix[j])->ip6), pv6addr, sizeof(pv6addr)) == NULL) {
-                    puts("DEBUG: inet_ntop(): Error converting IPv6 Address to presentation format");
-                    exit(EXIT_FAILURE);
-                }
+        if ((r = sendmmsg(idata->txfd, msgs, n, 0)) <= 0) {
+            if (r == -1 && errno == EINTR)
+                continue;
 
-                printf("DEBUG: %s\n", pv6addr);
+            /* Fall back to pcap_inject() for the frame that could not be sent */
+            if (pcap_inject(idata->pfd, idata->txbuffer + sent * TX_FRAME_SIZE, idata->txlen[sent]) !=
+                idata->txlen[sent]) {
+                idata->write_errors++;
+                errors++;
+            }
+            else {
+                count_tx_frames(idata, 1, idata->txlen[sent]);
             }
+
+            sent++;
+            continue;
         }
 
-        puts("");
+        for (i = 0, bytes = 0; i < (unsigned int)r; i++)
+            bytes += idata->txlen[sent + i];
+
+        count_tx_frames(idata, r, bytes);
+        sent += r;
     }
+
+    idata->ntxframes = 0;
+    return (errors ? -1 : 0);
+#else
+    return (0);
+#endif
 }
 
 /*
- * Function: find_iface_by_name()
+ * Function: count_tx_frames()
  *
- * Finds an Interface (by name) in an Interface list
+ * Accounts frames that have actually been sent (or written to a savefile) in the metrics of an interface, if any
  */
 
-void *find_iface_by_name(struct iface_list *iflist, char *iface) {
-    unsigned int i;
-
-    for (i = 0; i < iflist->nifaces; i++) {
-        if (strncmp((iflist->ifaces[i]).iface, iface, IFACE_LENGTH) == 0)
-            return (&(iflist->ifaces[i]));
-    }
+void count_tx_frames(struct iface_data *idata, unsigned int nframes, size_t nbytes) {
+    if (idata->metrics == NULL)
+        return;
 
-    return (NULL);
+    idata->metrics->txpackets += nframes;
+    idata->metrics->txbytes += nbytes;
+    check_metrics(idata->metrics);
 }
 
 /*
- * Function: find_iface_by_index()
+ * Function: send_frame()
  *
- * Finds an Interface (by index) in an Interface list
+ * Sends a link-layer frame. When batched transmission has been enabled with init_tx_batch(), the frame is queued,
+ * and the queue is flushed when full (callers must call flush_tx_batch() before waiting for responses). Otherwise,
+ * the frame is sent right away with pcap_inject(). Returns the number of bytes written/queued, or -1 on error.
+ * When frames are written to a savefile and the tool has been interrupted, -1 is returned with errno set to EINTR
+ * (see tx_dump_stopped()).
  */
 
-void *find_iface_by_index(struct iface_list *iflist, int ifindex) {
-    unsigned int i;
+int send_frame(struct iface_data *idata, const void *frame, size_t len) {
+    struct pcap_pkthdr pkthdr;
+    int r;
 
-    for (i = 0; i < iflist->nifaces; i++) {
-        if ((iflist->ifaces[i]).ifindex == ifindex)
-            return (&(iflist->ifaces[i]));
+    if (idata->txdump_f) {
+        if (txdump_stop) {
+            errno = EINTR;
+            return (-1);
+        }
+
+        gettimeofday(&(pkthdr.ts), NULL);
+        pkthdr.caplen = len;
+        pkthdr.len = len;
+        pcap_dump((u_char *)idata->txdump, &pkthdr, frame);
+
+        if (idata->txframes == 0)
+            idata->txstart = pkthdr.ts;
+
+        idata->txlast = pkthdr.ts;
+        idata->txframes++;
+        idata->txbytes += len;
+        count_tx_frames(idata, 1, len);
+        return (len);
     }
 
-    return (NULL);
+    if (!idata->txbatch_f || len > TX_FRAME_SIZE) {
+        if (idata->txbatch_f && flush_tx_batch(idata) == -1)
+            return (-1);
+
+        if ((r = pcap_inject(idata->pfd, frame, len)) == -1)
+            idata->write_errors++;
+        else
+            count_tx_frames(idata, 1, r);
+
+        return (r);
+    }
+
+    memcpy(idata->txbuffer + idata->ntxframes * TX_FRAME_SIZE, frame, len);
+    idata->txlen[idata->ntxframes] = len;
+    idata->ntxframes++;
+
+    if (idata->ntxframes >= idata->maxtxframes) {
+        if (flush_tx_batch(idata) == -1)
+            return (-1);
+    }
+
+    return (len);
 }
 
 /*
- * Function: find_iface_by_addr()
+ * Function: send_frame_error()
  *
- * Finds an Interface (by IPv6 address) in an Interface list
+ * Describes the last failure of send_frame(), flush_tx_batch() or send_template_frames(). Frames that could not be
+ * injected are described by libpcap (errno is not meaningful after pcap_inject()). Otherwise (e.g. when writing
+ * frames to a savefile was interrupted), errno is described.
  */
 
-void *find_iface_by_addr(struct iface_list *iflist, struct in6_addr *addr) {
-    unsigned int i;
+const char *send_frame_error(struct iface_data *idata) {
+    if (idata->txdump_f || idata->pfd == NULL)
+        return (strerror(errno));
 
-    for (i = 0; i < iflist->nifaces; i++) {
-        if (is_ip6_in_prefix_list(addr, &((iflist->ifaces[i]).ip6_global)) ||
-            is_ip6_in_prefix_list(addr, &((iflist->ifaces[i]).ip6_local)))
-            return (&(iflist->ifaces[i]));
-    }
+    return (pcap_geterr(idata->pfd));
+}
 
-    return (NULL);
+/*
+ * Function: init_packet_template()
+ *
+ * Initializes a packet template with a copy of a pre-built frame. "cksumoff" is the offset (within the frame) of
+ * the upper-layer checksum, which must be correct in the pre-built frame, or 0 if the frame has no checksum
+ */
+
+int init_packet_template(struct packet_template *tmpl, const void *frame, size_t len, unsigned int cksumoff) {
+    if (len > sizeof(tmpl->frame) || (cksumoff != 0 && (cksumoff + sizeof(uint16_t)) > len))
+        return (FAILURE);
+
+    memcpy(tmpl->frame, frame, len);
+    tmpl->len = len;
+    tmpl->cksumoff = cksumoff;
+    tmpl->nfields = 0;
+    tmpl->nframes = 0;
+    return (SUCCESS);
 }
 
 /*
- * Function: is_in6addr_iniface_list()
+ * Function: add_template_field()
  *
- * Finds an Interface (by name) in an Interface list
+ * Adds a variable field to a packet template. The field is rewritten with gen(field, len, arg) every "period"
+ * frames (every frame if period is 0 or 1). Fields covered by the checksum must have an even offset and length.
  */
 
-int is_ip6_in_iface_entry(struct iface_list *iflist, int ifindex, struct in6_addr *addr) {
-    unsigned int i;
+int add_template_field(struct packet_template *tmpl, unsigned int offset, unsigned int len,
+                       void (*gen)(unsigned char *, unsigned int, void *), void *arg, unsigned long period,
+                       unsigned char cksum_f) {
+    struct template_field *field;
 
-    for (i = 0; i < iflist->nifaces; i++) {
-        if (iflist->ifaces[i].ifindex == ifindex) {
-            if (is_ip6_in_prefix_list(addr, &(iflist->ifaces[i].ip6_global)))
-                return (TRUE);
-            else if (is_ip6_in_prefix_list(addr, &(iflist->ifaces[i].ip6_local)))
-                return (TRUE);
-        }
-    }
+    if (tmpl->nfields >= MAX_TEMPLATE_FIELDS || len == 0 || len > MAX_TEMPLATE_FIELD_LEN || (offset + len) > tmpl->len)
+        return (FAILURE);
 
-    return (FALSE);
+    if (cksum_f && tmpl->cksumoff != 0 && ((offset | len) & 1))
+        return (FAILURE);
+
+    field = &(tmpl->field[tmpl->nfields]);
+    field->offset = offset;
+    field->len = len;
+    field->gen = gen;
+    field->arg = arg;
+    field->period = (period == 0) ? 1 : period;
+    field->cksum_f = (cksum_f && tmpl->cksumoff != 0);
+    tmpl->nfields++;
+    return (SUCCESS);
 }
 
 /*
- * Function: find_matching_address()
+ * Function: next_template_frame()
  *
- * Finds the longest matching address in an Interface list
+ * Produces the next frame of a packet template (in tmpl->frame): the variable fields that are due are rewritten,
+ * and the checksum is patched incrementally for those that it covers. Returns the length of the frame.
  */
 
-struct iface_entry *find_matching_address(struct iface_data *idata, struct iface_list *iflist, struct in6_addr *dst,
-                                          struct in6_addr *match) {
-    unsigned int i, j, mlen, len;
-    struct iface_entry *cif = NULL; /* Not needed, but avoids warning in OpenBSD/gcc */
-    mlen = 0;
+size_t next_template_frame(struct packet_template *tmpl) {
+    unsigned char old[MAX_TEMPLATE_FIELD_LEN];
+    struct template_field *field;
+    unsigned int i;
+    uint16_t cksum = 0;
 
-    for (i = 0; i < iflist->nifaces; i++) {
-        if (idata->iface_f && (idata->ifindex != (iflist->ifaces[i]).ifindex))
-            continue;
+    tmpl->nframes++;
 
-        for (j = 0; j < (iflist->ifaces[i]).ip6_local.nprefix; j++) {
-            if ((len = ip6_longest_match(&((iflist->ifaces[i].ip6_local.prefix[j])->ip6), dst)) >= mlen) {
-                cif = &(iflist->ifaces[i]);
-                *match = (iflist->ifaces[i].ip6_local.prefix[j])->ip6;
-                mlen = len;
-            }
+    if (tmpl->cksumoff != 0)
+        memcpy(&cksum, tmpl->frame + tmpl->cksumoff, sizeof(cksum));
 
-            if (mlen >= 64) {
-                return (cif);
-            }
-        }
+    for (i = 0; i < tmpl->nfields; i++) {
+        field = &(tmpl->field[i]);
 
-        for (j = 0; j < (iflist->ifaces[i]).ip6_global.nprefix; j++) {
-            if ((len = ip6_longest_match(&((iflist->ifaces[i].ip6_global.prefix[j])->ip6), dst)) >= mlen) {
-                cif = &(iflist->ifaces[i]);
-                *match = (iflist->ifaces[i].ip6_global.prefix[j])->ip6;
-                mlen = len;
-            }
+        if ((tmpl->nframes % field->period) != 0)
+            continue;
 
-            if (mlen >= 64) {
-                return (cif);
-            }
+        if (field->cksum_f) {
+            memcpy(old, tmpl->frame + field->offset, field->len);
+            field->gen(tmpl->frame + field->offset, field->len, field->arg);
+            cksum = in_chksum_update(cksum, old, tmpl->frame + field->offset, field->len);
+        }
+        else {
+            field->gen(tmpl->frame + field->offset, field->len, field->arg);
         }
     }
 
-    return (cif);
+    if (tmpl->cksumoff != 0)
+        memcpy(tmpl->frame + tmpl->cksumoff, &cksum, sizeof(cksum));
+
+    return (tmpl->len);
 }
 
 /*
- * Function: ip6_longest_match()
+ * Function: send_template_frames()
  *
- * Finds the mask that two IPv6 addresses have in common
- * XXX
+ * Produces and sends the next "nframes" frames of a packet template. With batched transmission (see
+ * init_tx_batch()), the frames are queued and sent with as few system calls as possible.
  */
-unsigned int ip6_longest_match(struct in6_addr *addr1, struct in6_addr *addr2) {
-    unsigned int mask, step = 1, match = 0;
-    struct in6_addr a1, a2;
 
-    for (mask = 0; mask <= 64; mask = mask + step) {
-        a1 = *addr1;
-        a2 = *addr2;
-        sanitize_ipv6_prefix(&a1, mask);
-        sanitize_ipv6_prefix(&a2, mask);
+int send_template_frames(struct iface_data *idata, struct packet_template *tmpl, unsigned int nframes) {
+    size_t len;
 
-        if (!is_eq_in6_addr(&a1, &a2))
-            return (match);
-        else
-            match = mask;
+    while (nframes > 0) {
+        len = next_template_frame(tmpl);
+
+        if (send_frame(idata, tmpl->frame, len) != (int)len)
+            return (FAILURE);
+
+        nframes--;
     }
 
-    return (64);
+    if (flush_tx_batch(idata) == -1)
+        return (FAILURE);
+
+    return (SUCCESS);
 }
 
 /*
- * Function: sel_src_addr()
+ * Function: template_copy_field()
  *
- * Selects a Source Address for a given Destination
+ * Packet template generator: copies the bytes pointed to by "arg" (typically, another field of the same template,
+ * since fields are rewritten in the order in which they were added)
  */
-int sel_src_addr(struct iface_data *idata) {
-    struct in6_addr match;
-    struct iface_entry *cif, *nhif;
+
+void template_copy_field(unsigned char *field, unsigned int len, void *arg) {
+    memcpy(field, arg, len);
+}
+
+/*
+ * Function: template_random_bytes()
+ *
+ * Packet template generator: fills the field with random bytes
+ */
+
+void template_random_bytes(unsigned char *field, unsigned int len, void *arg) {
+    prng_fill(thread_prng(), field, len);
+}
+
+/*
+ * Function: template_random_ether_addr()
+ *
+ * Packet template generator: writes a random link-layer address (see randomize_ether_addr())
+ */
+
+void template_random_ether_addr(unsigned char *field, unsigned int len, void *arg) {
+    struct ether_addr addr;
+
+    randomize_ether_addr(&addr);
+    memcpy(field, &addr, (len < sizeof(addr)) ? len : sizeof(addr));
+}
+
+/*
+ * Function: template_random_ipv6_addr()
+ *
+ * Packet template generator: writes a random IPv6 address from the prefix pointed to by "arg" (a prefix_entry)
+ */
+
+void template_random_ipv6_addr(unsigned char *field, unsigned int len, void *arg) {
+    struct prefix_entry *prefix = arg;
+    struct in6_addr addr;
+
+    randomize_ipv6_addr(&addr, &(prefix->ip6), prefix->len);
+    memcpy(field, &addr, (len < sizeof(addr)) ? len : sizeof(addr));
+}
+
+/*
+ * Function: template_random_port()
+ *
+ * Packet template generator: writes a random port (in network byte order) from the port prefix pointed to by "arg"
+ */
+
+void template_random_port(unsigned char *field, unsigned int len, void *arg) {
+    struct port_prefix *prefix = arg;
+    uint16_t port;
+
+    randomize_port(&port, prefix->port, prefix->len);
+    port = htons(port);
+    memcpy(field, &port, (len < sizeof(port)) ? len : sizeof(port));
+}
+
+/*
+ * Function: init_prefix_trie()
+ *
+ * Initializes a prefix trie (with an empty root node)
+ */
+
+int init_prefix_trie(struct prefix_trie *trie) {
+    memset(trie, 0, sizeof(struct prefix_trie));
+
+    if ((trie->node = malloc(sizeof(struct prefix_trie_node) * PTRIE_INIT_NODES)) == NULL)
+        return (FAILURE);
+
+    memset(trie->node, 0, sizeof(struct prefix_trie_node));
+    trie->nnodes = 1;
+    trie->maxnodes = PTRIE_INIT_NODES;
+    return (SUCCESS);
+}
+
+/*
+ * Function: add_to_prefix_trie()
+ *
+ * Adds a prefix to a prefix trie. Prefixes whose length is not a multiple of PTRIE_STRIDE are expanded into the
+ * corresponding children of the last node, and prefixes that are covered by a shorter prefix are not stored at all.
+ */
+
+int add_to_prefix_trie(struct prefix_trie *trie, struct in6_addr *prefix, uint8_t len) {
+    struct prefix_trie_node *ptr;
+    unsigned int cur, depth, nibble, span;
+
+    if (len > 128)
+        return (FAILURE);
+
+    trie->nprefix++;
+
+    if (len == 0) {
+        trie->all_f = TRUE;
+        return (SUCCESS);
+    }
+
+    cur = 0;
+
+    for (depth = 0;; depth++) {
+        nibble = (prefix->s6_addr[depth >> 1] >> ((depth & 1) ? 0 : 4)) & 0x0f;
+
+        if (len <= (depth + 1) * PTRIE_STRIDE) {
+            span = 1 << ((depth + 1) * PTRIE_STRIDE - len);
+            nibble = nibble & ~(span - 1);
+            trie->node[cur].match |= ((1 << span) - 1) << nibble;
+            return (SUCCESS);
+        }
+
+        /* Already covered by a shorter prefix */
+        if (trie->node[cur].match & (1 << nibble))
+            return (SUCCESS);
+
+        if (trie->node[cur].child[nibble] == 0) {
+            if (trie->nnodes >= trie->maxnodes) {
+                if ((ptr = realloc(trie->node, sizeof(struct prefix_trie_node) * trie->maxnodes * 2)) == NULL)
+                    return (FAILURE);
+
+                trie->node = ptr;
+                trie->maxnodes = trie->maxnodes * 2;
+            }
+
+            memset(trie->node + trie->nnodes, 0, sizeof(struct prefix_trie_node));
+            trie->node[cur].child[nibble] = trie->nnodes;
+            trie->nnodes++;
+        }
+
+        cur = trie->node[cur].child[nibble];
+    }
+}
+
+/*
+ * Function: compile_filters()
+ *
+ * Adds the address filters specified on the command line to the prefix tries employed for matching them (this must
+ * be called once all the filters have been specified, and before any packets are matched against them)
+ */
+
+int compile_filters(struct filters *filters) {
+    unsigned int i;
+
+    for (i = 0; i < filters->nblocksrc; i++)
+        if (add_to_prefix_trie(&(filters->blocksrctrie), &(filters->blocksrc[i]), filters->blocksrclen[i]) == FAILURE)
+            return (FAILURE);
+
+    for (i = 0; i < filters->nblockdst; i++)
+        if (add_to_prefix_trie(&(filters->blockdsttrie), &(filters->blockdst[i]), filters->blockdstlen[i]) == FAILURE)
+            return (FAILURE);
+
+    for (i = 0; i < filters->nblocktarget; i++)
+        if (add_to_prefix_trie(&(filters->blocktargettrie), &(filters->blocktarget[i]), filters->blocktargetlen[i]) ==
+            FAILURE)
+            return (FAILURE);
+
+    for (i = 0; i < filters->nacceptsrc; i++)
+        if (add_to_prefix_trie(&(filters->acceptsrctrie), &(filters->acceptsrc[i]), filters->acceptsrclen[i]) ==
+            FAILURE)
+            return (FAILURE);
+
+    for (i = 0; i < filters->nacceptdst; i++)
+        if (add_to_prefix_trie(&(filters->acceptdsttrie), &(filters->acceptdst[i]), filters->acceptdstlen[i]) ==
+            FAILURE)
+            return (FAILURE);
+
+    for (i = 0; i < filters->naccepttarget; i++)
+        if (add_to_prefix_trie(&(filters->accepttargettrie), &(filters->accepttarget[i]),
+                               filters->accepttargetlen[i]) == FAILURE)
+            return (FAILURE);
+
+    return (SUCCESS);
+}
+
+/*
+ * Function: load_filter_file()
+ *
+ * Loads address filters from a file. Each line contains the name of the long option that would specify the filter
+ * on the command line (e.g. "block-src-addr"), followed by an IPv6 prefix. Empty lines and lines starting with '#'
+ * are ignored. The prefixes are added straight to the prefix tries, such that the number of filters is not limited.
+ */
+
+int load_filter_file(struct filters *filters, const char *path) {
+    FILE *fp;
+    char line[MAX_FILTER_LINE_SIZE], type[MAX_FILTER_LINE_SIZE], pref[MAX_FILTER_LINE_SIZE];
+    char *charptr, *endptr;
+    struct in6_addr prefix;
+    struct prefix_trie *trie;
+    unsigned int lineno = 0, len;
+    unsigned char accept_f;
+    int nfields;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        perror("Error opening filter file");
+        return (FAILURE);
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+
+        if ((nfields = sscanf(line, "%s %s", type, pref)) < 1 || type[0] == '#')
+            continue;
+
+        accept_f = FALSE;
+
+        if (strncmp(type, "block-src-addr", sizeof("block-src-addr")) == 0) {
+            trie = &(filters->blocksrctrie);
+        }
+        else if (strncmp(type, "block-dst-addr", sizeof("block-dst-addr")) == 0) {
+            trie = &(filters->blockdsttrie);
+        }
+        else if (strncmp(type, "block-target-addr", sizeof("block-target-addr")) == 0) {
+            trie = &(filters->blocktargettrie);
+        }
+        else if (strncmp(type, "accept-src-addr", sizeof("accept-src-addr")) == 0) {
+            trie = &(filters->acceptsrctrie);
+            accept_f = TRUE;
+        }
+        else if (strncmp(type, "accept-dst-addr", sizeof("accept-dst-addr")) == 0) {
+            trie = &(filters->acceptdsttrie);
+            accept_f = TRUE;
+        }
+        else if (strncmp(type, "accept-target-addr", sizeof("accept-target-addr")) == 0) {
+            trie = &(filters->accepttargettrie);
+            accept_f = TRUE;
+        }
+        else {
+            printf("Unknown filter type '%s' in line %u of filter file %s\n", type, lineno, path);
+            fclose(fp);
+            return (FAILURE);
+        }
+
+        if (nfields < 2) {
+            printf("Missing prefix in line %u of filter file %s\n", lineno, path);
+            fclose(fp);
+            return (FAILURE);
+        }
+
+        len = 128;
+
+        if ((charptr = strchr(pref, '/')) != NULL) {
+            *charptr = 0;
+            len = strtoul(charptr + 1, &endptr, 10);
+
+            if (endptr == (charptr + 1) || *endptr != 0)
+                len = 129;
+        }
+
+        if (inet_pton(AF_INET6, pref, &prefix) <= 0 || len > 128) {
+            printf("Error in line %u of filter file %s\n", lineno, path);
+            fclose(fp);
+            return (FAILURE);
+        }
+
+        sanitize_ipv6_prefix(&prefix, len);
+
+        if (add_to_prefix_trie(trie, &prefix, len) == FAILURE) {
+            puts("Not enough memory for the filter prefixes");
+            fclose(fp);
+            return (FAILURE);
+        }
+
+        if (accept_f)
+            filters->acceptfilters_f = TRUE;
+
+        filters->nfilefilters++;
+    }
+
+    fclose(fp);
+    return (SUCCESS);
+}
+
+/*
+ * Function: filters_to_bpf()
+ *
+ * Builds a libpcap filter expression that ANDs the base filter of a tool with the block and accept filters specified
+ * on the command line, such that unwanted packets are dropped by the kernel rather than copied to user space. The
+ * expression is only a first pass: the tools still match every packet against the filters (target address filters
+ * and those loaded from filter files are only applied there). Returns the number of filters included in the
+ * expression, or -1 if it does not fit in the buffer.
+ */
+
+int filters_to_bpf(struct iface_data *idata, struct filters *filters, const char *base, char *buf, size_t size) {
+    char *ptr = buf, *end = buf + size, *clause;
+    char addr[INET6_ADDRSTRLEN];
+    unsigned int i, nterms = 0, nclause;
+    unsigned char ether_f, accept_f;
+    int n;
+
+    if (size == 0)
+        return (-1);
+
+    *buf = 0;
+    ether_f = (idata->type == DLT_EN10MB && !(idata->flags & IFACE_LOOPBACK));
+
+    /*
+       Target address filters, and accept filters loaded from filter files, cannot be expressed here. Since an accept
+       clause without them would drop packets that the tool would accept, we leave the accept filters to user space
+       in that case.
+     */
+    accept_f = (filters->acceptfilters_f && filters->naccepttarget == 0 && filters->nfilefilters == 0);
+
+#define BPF_APPEND(...)                                                                                                \
+    do {                                                                                                               \
+        n = snprintf(ptr, end - ptr, __VA_ARGS__);                                                                     \
+        if (n < 0 || n >= (end - ptr))                                                                                 \
+            return (-1);                                                                                               \
+        ptr += n;                                                                                                      \
+    } while (0)
+
+#define BPF_APPEND_PREFIX(dir, pref, len)                                                                              \
+    do {                                                                                                               \
+        if (inet_ntop(AF_INET6, (pref), addr, sizeof(addr)) == NULL)                                                   \
+            return (-1);                                                                                               \
+        BPF_APPEND("%sip6 %s net %s/%u", (nclause++ ? " or " : ""), (dir), addr, (unsigned int)(len));                 \
+    } while (0)
+
+#define BPF_APPEND_ETHER(dir, ether)                                                                                   \
+    BPF_APPEND("%sether %s %02x:%02x:%02x:%02x:%02x:%02x", (nclause++ ? " or " : ""), (dir), (ether)->a[0],           \
+               (ether)->a[1], (ether)->a[2], (ether)->a[3], (ether)->a[4], (ether)->a[5])
+
+    BPF_APPEND("(%s)", base);
+
+    /* Block filters */
+    clause = ptr;
+    nclause = 0;
+    BPF_APPEND(" and not (");
+
+    for (i = 0; i < filters->nblocksrc; i++)
+        BPF_APPEND_PREFIX("src", &(filters->blocksrc[i]), filters->blocksrclen[i]);
+
+    for (i = 0; i < filters->nblockdst; i++)
+        BPF_APPEND_PREFIX("dst", &(filters->blockdst[i]), filters->blockdstlen[i]);
+
+    if (ether_f) {
+        for (i = 0; i < filters->nblocklinksrc; i++)
+            BPF_APPEND_ETHER("src", &(filters->blocklinksrc[i]));
+
+        for (i = 0; i < filters->nblocklinkdst; i++)
+            BPF_APPEND_ETHER("dst", &(filters->blocklinkdst[i]));
+    }
+
+    if (nclause) {
+        BPF_APPEND(")");
+        nterms += nclause;
+    }
+    else {
+        ptr = clause;
+        *ptr = 0;
+    }
+
+    /* Accept filters */
+    if (accept_f) {
+        clause = ptr;
+        nclause = 0;
+        BPF_APPEND(" and (");
+
+        for (i = 0; i < filters->nacceptsrc; i++)
+            BPF_APPEND_PREFIX("src", &(filters->acceptsrc[i]), filters->acceptsrclen[i]);
+
+        for (i = 0; i < filters->nacceptdst; i++)
+            BPF_APPEND_PREFIX("dst", &(filters->acceptdst[i]), filters->acceptdstlen[i]);
+
+        if (ether_f) {
+            for (i = 0; i < filters->nacceptlinksrc; i++)
+                BPF_APPEND_ETHER("src", &(filters->acceptlinksrc[i]));
+
+            for (i = 0; i < filters->nacceptlinkdst; i++)
+                BPF_APPEND_ETHER("dst", &(filters->acceptlinkdst[i]));
+        }
+
+        if (nclause) {
+            BPF_APPEND(")");
+            nterms += nclause;
+        }
+        else {
+            ptr = clause;
+            *ptr = 0;
+        }
+    }
+
+#undef BPF_APPEND_ETHER
+#undef BPF_APPEND_PREFIX
+#undef BPF_APPEND
+
+    return (nterms);
+}
+
+/*
+ * Function: set_filters_bpf()
+ *
+ * Replaces the libpcap filter of the capture handle with the base filter of the tool ANDed with the block and accept
+ * filters (see filters_to_bpf()). If no filters can be pushed to the kernel, the current filter is left untouched.
+ */
+
+int set_filters_bpf(struct iface_data *idata, struct filters *filters, const char *base) {
+    struct bpf_program pcap_filter;
+    char *expr;
+    size_t size;
+    int nterms;
+
+    size = strlen(base) + 64 +
+           (filters->nblocksrc + filters->nblockdst + filters->nacceptsrc + filters->nacceptdst) *
+               (INET6_ADDRSTRLEN + 20) +
+           (filters->nblocklinksrc + filters->nblocklinkdst + filters->nacceptlinksrc + filters->nacceptlinkdst) * 40;
+
+    if ((expr = malloc(size)) == NULL)
+        return (FAILURE);
+
+    if ((nterms = filters_to_bpf(idata, filters, base, expr, size)) <= 0) {
+        free(expr);
+        return ((nterms == 0) ? SUCCESS : FAILURE);
+    }
+
+    if (idata->verbose_f > 1)
+        printf("Capture filter: %s\n", expr);
+
+    if (pcap_compile(idata->pfd, &pcap_filter, expr, PCAP_OPT, PCAP_NETMASK_UNKNOWN) == -1) {
+        printf("pcap_compile(): %s\n", pcap_geterr(idata->pfd));
+        free(expr);
+        return (FAILURE);
+    }
+
+    free(expr);
+
+    if (pcap_setfilter(idata->pfd, &pcap_filter) == -1) {
+        printf("pcap_setfilter(): %s\n", pcap_geterr(idata->pfd));
+        pcap_freecode(&pcap_filter);
+        return (FAILURE);
+    }
+
+    pcap_freecode(&pcap_filter);
+    return (SUCCESS);
+}
+
+/*
+ * Function: init_filters()
+ *
+ * Initializes a filters structure, and allocates memory for the filter data.
+ */
+
+int init_filters(struct filters *filters) {
+    memset(filters, 0, sizeof(struct filters));
+
+    if ((filters->blocksrc = malloc(sizeof(struct in6_addr) * MAX_BLOCK_SRC)) == NULL)
+        return (-1);
+
+    if ((filters->blockdst = malloc(sizeof(struct in6_addr) * MAX_BLOCK_DST)) == NULL)
+        return (-1);
+
+    if ((filters->blocktarget = malloc(sizeof(struct in6_addr) * MAX_BLOCK_TARGET)) == NULL)
+        return (-1);
+
+    if ((filters->blocklinksrc = malloc(sizeof(struct ether_addr) * MAX_BLOCK_LINK_SRC)) == NULL)
+        return (-1);
+
+    if ((filters->blocklinkdst = malloc(sizeof(struct ether_addr) * MAX_BLOCK_LINK_DST)) == NULL)
+        return (-1);
+
+    if ((filters->blocksrclen = malloc(sizeof(uint8_t) * MAX_BLOCK_SRC)) == NULL)
+        return (-1);
+
+    if ((filters->blockdstlen = malloc(sizeof(uint8_t) * MAX_BLOCK_DST)) == NULL)
+        return (-1);
+
+    if ((filters->blocktargetlen = malloc(sizeof(uint8_t) * MAX_BLOCK_TARGET)) == NULL)
+        return (-1);
+
+    if ((filters->acceptsrc = malloc(sizeof(struct in6_addr) * MAX_ACCEPT_SRC)) == NULL)
+        return (-1);
+
+    if ((filters->acceptdst = malloc(sizeof(struct in6_addr) * MAX_ACCEPT_DST)) == NULL)
+        return (-1);
+
+    if ((filters->accepttarget = malloc(sizeof(struct in6_addr) * MAX_ACCEPT_TARGET)) == NULL)
+        return (-1);
+
+    if ((filters->acceptlinksrc = malloc(sizeof(struct ether_addr) * MAX_ACCEPT_LINK_SRC)) == NULL)
+        return (-1);
+
+    if ((filters->acceptlinkdst = malloc(sizeof(struct ether_addr) * MAX_ACCEPT_LINK_DST)) == NULL)
+        return (-1);
+
+    if ((filters->acceptsrclen = malloc(sizeof(uint8_t) * MAX_ACCEPT_SRC)) == NULL)
+        return (-1);
+
+    if ((filters->acceptdstlen = malloc(sizeof(uint8_t) * MAX_ACCEPT_DST)) == NULL)
+        return (-1);
+
+    if ((filters->accepttargetlen = malloc(sizeof(uint8_t) * MAX_ACCEPT_TARGET)) == NULL)
+        return (-1);
+
+    if (init_prefix_trie(&(filters->blocksrctrie)) == FAILURE || init_prefix_trie(&(filters->blockdsttrie)) == FAILURE ||
+        init_prefix_trie(&(filters->blocktargettrie)) == FAILURE ||
+        init_prefix_trie(&(filters->acceptsrctrie)) == FAILURE ||
+        init_prefix_trie(&(filters->acceptdsttrie)) == FAILURE ||
+        init_prefix_trie(&(filters->accepttargettrie)) == FAILURE)
+        return (-1);
+
+    return (0);
+}
+
+/*
+ * Function: sel_next_hop_ra()
+ *
+ * Performs next hop determination by sending the necessary packets
+ *
+ */
+
+int sel_next_hop_ra(struct iface_data *idata) {
+    /*
+       Select link-layer destination address
+
+       + If the underlying interface is loopback or tunnel, there is no need
+         to select a link-layer destination address
+       + If a link-layer Destination Address has been specified, we do not need to
+         select one
+       + If the destination address is link-local, there is no need to perform
+         next-hop determination
+       + Otherwise we need to learn the local router or do ND as a last ressort
+     */
+    if ((idata->type == DLT_EN10MB && (!(idata->flags & IFACE_LOOPBACK) && !(idata->flags & IFACE_TUNNEL))) &&
+        (!(idata->hdstaddr_f) && idata->dstaddr_f)) {
+        if (IN6_IS_ADDR_LINKLOCAL(&(idata->dstaddr))) {
+            /*
+               If the IPv6 Destination Address is a multicast address, there is no need
+               to perform Neighbor Discovery
+             */
+            if (IN6_IS_ADDR_MC_LINKLOCAL(&(idata->dstaddr))) {
+                idata->hdstaddr = ether_multicast(&(idata->dstaddr));
+            }
+            else if (ipv6_to_ether(idata->pfd, idata, &(idata->dstaddr), &(idata->hdstaddr)) != 1) {
+                if (idata->verbose_f)
+                    puts("Error while performing Neighbor Discovery for the Destination Address");
+
+                return (-1);
+            }
+        }
+        else if (find_ipv6_router_full(idata->pfd, idata) == 1) {
+            if (is_ip6_in_prefix_list(&(idata->dstaddr), &(idata->prefix_ol))) {
+                /* If address is on-link, we must perform Neighbor Discovery */
+                if (ipv6_to_ether(idata->pfd, idata, &(idata->dstaddr), &(idata->hdstaddr)) != 1) {
+                    if (idata->verbose_f)
+                        puts("Error while performing Neighbor Discovery for the Destination Address");
+
+                    return (-1);
+                }
+            }
+            else {
+                idata->hdstaddr = idata->router_ether;
+            }
+        }
+        else {
+            if (idata->verbose_f)
+                puts("Couldn't find local router. Now trying Neighbor Discovery for the target node");
+            /*
+             * If we were not able to find a local router, we assume the destination is "on-link" (as
+             * a last ressort), and thus perform Neighbor Discovery for that destination
+             */
+            if (ipv6_to_ether(idata->pfd, idata, &(idata->dstaddr), &(idata->hdstaddr)) != 1) {
+                if (idata->verbose_f)
+                    puts("Error while performing Neighbor Discovery for the Destination Address");
+
+                return (-1);
+            }
+        }
+    }
+
+    return (0);
+}
+
+/*
+ * Function: inc_sdev()
+ *
+ * Computes the average increment and standard deviation of an array of uint32_t's.
+ * The function computes the aforementioned values for network byte order and host byte order,
+ * and returns as a result the set of values with smaller standard deviation.
+ */
+int inc_sdev(uint32_t *s, unsigned int n, uint32_t *diff_avg, double *diff_sdev) {
+    unsigned int i;
+    uint32_t *diff, *s2;
+    unsigned long long int diff1_avg, diff2_avg;
+    double diff1_sdev, diff2_sdev;
+
+    if ((diff = malloc((n - 1) * sizeof(uint32_t))) == NULL)
+        return (-1);
+
+    diff1_avg = 0;
+
+    for (i = 0; i < (n - 1); i++) {
+        diff[i] = s[i + 1] - s[i];
+        diff1_avg += diff[i];
+    }
+
+    diff1_avg = diff1_avg / (n - 1);
+
+    diff1_sdev = 0;
+
+    for (i = 0; i < (n - 1); i++)
+        diff1_sdev = diff1_sdev + (diff[i] - diff1_avg) * (diff[i] - diff1_avg);
+
+    diff1_sdev = sqrt(diff1_sdev / (n - 2));
+
+    if ((s2 = malloc(n * sizeof(uint32_t))) == NULL)
+        return (-1);
+
+    memcpy(s2, s, n * sizeof(uint32_t));
+    change_endianness(s2, n);
+
+    diff2_avg = 0;
+
+    for (i = 0; i < (n - 1); i++) {
+        diff[i] = s2[i + 1] - s2[i];
+        diff2_avg += diff[i];
+    }
+
+    diff2_avg = diff2_avg / (n - 1);
+
+    diff2_sdev = 0;
+
+    for (i = 0; i < (n - 1); i++)
+        diff2_sdev = diff2_sdev + (diff[i] - diff2_avg) * (diff[i] - diff2_avg);
+
+    diff2_sdev = sqrt(diff2_sdev / (n - 2));
+
+    free(diff);
+    free(s2);
+
+    if (diff1_sdev <= diff2_sdev) {
+        *diff_avg = (uint32_t)diff1_avg;
+        *diff_sdev = diff1_sdev;
+    }
+    else {
+        *diff_avg = (uint32_t)diff2_avg;
+        *diff_sdev = diff2_sdev;
+    }
+
+    return (0);
+}
+
+/*
+ * Function: change_endianness()
+ *
+ * Changes the endianness of an array of uint32_t's
+ */
+void change_endianness(uint32_t *s, unsigned int n) {
+    unsigned int i;
+    union {
+        uint32_t ui;
+        unsigned char c[4];
+    } swapper;
+
+    unsigned char c;
+
+    for (i = 0; i < n; i++) {
+        swapper.ui = *s;
+        c = swapper.c[3];
+        swapper.c[3] = swapper.c[0];
+        swapper.c[0] = c;
+
+        c = swapper.c[2];
+        swapper.c[2] = swapper.c[1];
+        swapper.c[1] = c;
+    }
+}
+
+/*
+ * Function: send_neighbor_solicit()
+ *
+ * Sends a Neighbor Advertisement message for a target address
+ */
+int send_neighbor_solicit(struct iface_data *idata, struct in6_addr *target) {
+    unsigned char *ptr, *prev_nh;
+    unsigned char buffer[PACKET_BUFFER_SIZE];
+    unsigned int ns_max_packet_size;
+    struct ether_header *ether;
+    unsigned char *v6buffer;
+    int nw;
+    struct ip6_hdr *ipv6;
+    struct nd_neighbor_solicit *ns;
+    struct nd_opt_slla *sllaopt;
+
+    ns_max_packet_size = idata->mtu;
+
+    ether = (struct ether_header *)buffer;
+    v6buffer = buffer + idata->linkhsize;
+    ipv6 = (struct ip6_hdr *)v6buffer;
+
+    ether->src = idata->ether;
+    ether->dst = ether_multicast(&(ipv6->ip6_dst));
+    ether->ether_type = htons(ETHERTYPE_IPV6);
+
+    ipv6->ip6_flow = 0;
+    ipv6->ip6_vfc = 0x60;
+    ipv6->ip6_hlim = 255;
+    ipv6->ip6_src = idata->srcaddr;
+    ipv6->ip6_dst = solicited_node(&(idata->dstaddr));
+
+    prev_nh = (unsigned char *)&(ipv6->ip6_nxt);
+    *prev_nh = IPPROTO_ICMPV6;
+
+    ptr = (unsigned char *)v6buffer + MIN_IPV6_HLEN;
+
+    if ((ptr + sizeof(struct nd_neighbor_solicit)) > (v6buffer + ns_max_packet_size)) {
+        if (idata->verbose_f > 1)
+            puts("Packet too large while inserting Neighbor Solicitation header");
+
+        return (-1);
+    }
+
+    ns = (struct nd_neighbor_solicit *)(ptr);
+
+    ns->nd_ns_type = ND_NEIGHBOR_SOLICIT;
+    ns->nd_ns_code = 0;
+    ns->nd_ns_reserved = 0;
+    ns->nd_ns_target = *target;
+
+    ptr += sizeof(struct nd_neighbor_solicit);
+    sllaopt = (struct nd_opt_slla *)ptr;
+
+    if ((ptr + sizeof(struct nd_opt_slla)) > (v6buffer + ns_max_packet_size)) {
+        if (idata->verbose_f > 1)
+            puts("NS message too large while processing source link-layer address opt.");
+
+        return (-1);
+    }
+
+    sllaopt->type = ND_OPT_SOURCE_LINKADDR;
+    sllaopt->length = SLLA_OPT_LEN;
+    memcpy(sllaopt->address, &(idata->ether.a), ETH_ALEN);
+    ptr += sizeof(struct nd_opt_slla);
+
+    ipv6->ip6_plen = htons((ptr - v6buffer) - MIN_IPV6_HLEN);
+    ns->nd_ns_cksum = 0;
+    ns->nd_ns_cksum = in_chksum(v6buffer, ns, ptr - ((unsigned char *)ns), IPPROTO_ICMPV6);
+
+    if ((nw = pcap_inject(idata->pfd, buffer, ptr - buffer)) == -1) {
+        if (idata->verbose_f > 1)
+            printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+
+        return (-1);
+    }
+
+    if (nw != (ptr - buffer)) {
+        if (idata->verbose_f > 1)
+            printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+        return (-1);
+    }
+
+    return 0;
+}
+
+/*
+ * Function: init_route_table()
+ *
+ * Initializes a routing table snapshot (see match_route_table())
+ */
+
+int init_route_table(struct route_table *table) {
+    memset(table, 0, sizeof(struct route_table));
+
+    if ((table->entry = malloc(sizeof(struct route_entry) * RTABLE_INIT_ENTRIES)) == NULL)
+        return (FAILURE);
+
+    if ((table->hash = calloc(RTABLE_INIT_ENTRIES * 2, sizeof(uint32_t))) == NULL) {
+        free(table->entry);
+        table->entry = NULL;
+        return (FAILURE);
+    }
+
+    table->maxentries = RTABLE_INIT_ENTRIES;
+    table->hashsize = RTABLE_INIT_ENTRIES * 2;
+    table->fd = -1;
+    return (SUCCESS);
+}
+
+/*
+ * Function: clear_route_table()
+ *
+ * Removes all the routes of a routing table snapshot (keeping the memory allocated for them)
+ */
+
+void clear_route_table(struct route_table *table) {
+    table->nentries = 0;
+    table->nlens = 0;
+    memset(table->hash, 0, sizeof(uint32_t) * table->hashsize);
+}
+
+/*
+ * Function: route_hash()
+ *
+ * Computes the bucket of the hash table of a routing table snapshot for a (masked) prefix
+ */
+
+unsigned int route_hash(struct route_table *table, struct in6_addr *prefix, uint8_t len, unsigned char local_f) {
+    uint32_t h;
+
+    h = (prefix->s6_addr32[0] ^ prefix->s6_addr32[1] ^ prefix->s6_addr32[2] ^ prefix->s6_addr32[3] ^
+         ((uint32_t)len << 1 | local_f)) *
+        0x9e3779b1;
+    h = h ^ (h >> 16);
+
+    return (h & (table->hashsize - 1));
+}
+
+/*
+ * Function: add_to_route_table()
+ *
+ * Adds a route to a routing table snapshot. Of several routes to the same prefix, the one with the lowest metric is
+ * kept (as the kernel would employ).
+ */
+
+int add_to_route_table(struct route_table *table, struct route_entry *route) {
+    struct route_entry *entry;
+    uint32_t *newhash;
+    void *ptr;
+    unsigned int i, j, bucket;
+
+    sanitize_ipv6_prefix(&(route->dst), route->dstlen);
+
+    for (bucket = route_hash(table, &(route->dst), route->dstlen, route->local_f); table->hash[bucket] != 0;
+         bucket = (bucket + 1) & (table->hashsize - 1)) {
+        entry = &(table->entry[table->hash[bucket] - 1]);
+
+        if (entry->dstlen == route->dstlen && entry->local_f == route->local_f &&
+            is_eq_in6_addr(&(entry->dst), &(route->dst))) {
+            if (route->priority < entry->priority)
+                *entry = *route;
+
+            return (SUCCESS);
+        }
+    }
+
+    /* Keep the hash table at most half full */
+    if ((table->nentries + 1) * 2 > table->hashsize) {
+        if ((newhash = calloc(table->hashsize * 2, sizeof(uint32_t))) == NULL)
+            return (FAILURE);
+
+        free(table->hash);
+        table->hash = newhash;
+        table->hashsize = table->hashsize * 2;
+
+        for (i = 0; i < table->nentries; i++) {
+            entry = &(table->entry[i]);
+
+            for (j = route_hash(table, &(entry->dst), entry->dstlen, entry->local_f); table->hash[j] != 0;
+                 j = (j + 1) & (table->hashsize - 1))
+                ;
+
+            table->hash[j] = i + 1;
+        }
+
+        for (bucket = route_hash(table, &(route->dst), route->dstlen, route->local_f); table->hash[bucket] != 0;
+             bucket = (bucket + 1) & (table->hashsize - 1))
+            ;
+    }
+
+    if (table->nentries >= table->maxentries) {
+        if ((ptr = realloc(table->entry, sizeof(struct route_entry) * table->maxentries * 2)) == NULL)
+            return (FAILURE);
+
+        table->entry = ptr;
+        table->maxentries = table->maxentries * 2;
+    }
+
+    table->entry[table->nentries] = *route;
+    table->nentries++;
+    table->hash[bucket] = table->nentries;
+
+    /* Keep the list of prefix lengths in use sorted from longest to shortest */
+    for (i = 0; i < table->nlens && table->lens[i] > route->dstlen; i++)
+        ;
+
+    if (i == table->nlens || table->lens[i] != route->dstlen) {
+        memmove(&(table->lens[i + 1]), &(table->lens[i]), table->nlens - i);
+        table->lens[i] = route->dstlen;
+        table->nlens++;
+    }
+
+    return (SUCCESS);
+}
+
+/*
+ * Function: match_route_table()
+ *
+ * Finds the route that the kernel would employ for a destination in a routing table snapshot: local routes (the
+ * addresses of the node) are looked up first, and then the longest-matching prefix, with one hash lookup per prefix
+ * length in use. Returns NULL if no route matches.
+ */
+
+struct route_entry *match_route_table(struct route_table *table, struct in6_addr *dst) {
+    struct route_entry *entry;
+    struct in6_addr prefix;
+    unsigned int i, j, bucket;
+    unsigned char local_f;
+    uint8_t len;
+
+    for (local_f = TRUE;; local_f = FALSE) {
+        for (i = 0; i < table->nlens; i++) {
+            len = table->lens[i];
+
+            for (j = 0; j < 4; j++) {
+                if (len >= (j + 1) * 32)
+                    prefix.s6_addr32[j] = dst->s6_addr32[j];
+                else if (len <= j * 32)
+                    prefix.s6_addr32[j] = 0;
+                else
+                    prefix.s6_addr32[j] = dst->s6_addr32[j] & htonl(0xffffffff << (32 - (len - j * 32)));
+            }
+
+            for (bucket = route_hash(table, &prefix, len, local_f); table->hash[bucket] != 0;
+                 bucket = (bucket + 1) & (table->hashsize - 1)) {
+                entry = &(table->entry[table->hash[bucket] - 1]);
+
+                if (entry->dstlen == len && entry->local_f == local_f && is_eq_in6_addr(&(entry->dst), &prefix))
+                    return (entry);
+            }
+        }
+
+        if (!local_f)
+            break;
+    }
+
+    return (NULL);
+}
+
+#ifdef __linux__
+/*
+ * Function: dump_route_table()
+ *
+ * Loads a snapshot of the IPv6 routing table of the kernel (as obtained with a Netlink RTM_GETROUTE dump). The
+ * snapshot is flagged as unusable if the routing decision of the kernel might depend on anything but the Destination
+ * Address (policy routing, source-specific routes) or if it employs multipath routes.
+ */
+
+int dump_route_table(struct route_table *table) {
+    int sockfd, len, rtl;
+    struct {
+        struct nlmsghdr nl;
+        struct rtmsg rt;
+    } req;
+    char reply[MAX_NLDUMP_SIZE];
+    struct nlmsghdr *nlp;
+    struct rtmsg *rtp;
+    struct rtattr *rtap;
+    struct route_entry route;
+    unsigned char done_f = FALSE;
+
+    clear_route_table(table);
+    table->usable_f = FALSE;
+
+    if ((sockfd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE)) == -1)
+        return (FAILURE);
+
+    memset(&req, 0, sizeof(req));
+    req.nl.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+    req.nl.nlmsg_type = RTM_GETROUTE;
+    req.nl.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.rt.rtm_family = AF_INET6;
+
+    if (send(sockfd, &req, req.nl.nlmsg_len, 0) == -1) {
+        close(sockfd);
+        return (FAILURE);
+    }
+
+    table->usable_f = TRUE;
+
+    while (!done_f) {
+        if ((len = recv(sockfd, reply, sizeof(reply), 0)) <= 0) {
+            table->usable_f = FALSE;
+            break;
+        }
+
+        for (nlp = (struct nlmsghdr *)reply; NLMSG_OK(nlp, len); nlp = NLMSG_NEXT(nlp, len)) {
+            if (nlp->nlmsg_type == NLMSG_DONE || nlp->nlmsg_type == NLMSG_ERROR) {
+                if (nlp->nlmsg_type == NLMSG_ERROR)
+                    table->usable_f = FALSE;
+
+                done_f = TRUE;
+                break;
+            }
+
+            rtp = (struct rtmsg *)NLMSG_DATA(nlp);
+
+            if (nlp->nlmsg_type != RTM_NEWROUTE || rtp->rtm_family != AF_INET6 || !table->usable_f)
+                continue;
+
+            if ((rtp->rtm_table != RT_TABLE_MAIN && rtp->rtm_table != RT_TABLE_LOCAL) || rtp->rtm_src_len != 0) {
+                table->usable_f = FALSE;
+                continue;
+            }
+
+            /* Multicast and anycast routes of the local table do not affect unicast next-hop selection */
+            if (rtp->rtm_type == RTN_MULTICAST || rtp->rtm_type == RTN_ANYCAST)
+                continue;
+
+            memset(&route, 0, sizeof(route));
+            route.dstlen = rtp->rtm_dst_len;
+            route.type = rtp->rtm_type;
+            route.local_f = (rtp->rtm_table == RT_TABLE_LOCAL);
+            route.ifindex = -1;
+
+            for (rtap = (struct rtattr *)RTM_RTA(rtp), rtl = RTM_PAYLOAD(nlp); RTA_OK(rtap, rtl);
+                 rtap = RTA_NEXT(rtap, rtl)) {
+                switch (rtap->rta_type) {
+                case RTA_DST:
+                    route.dst = *((struct in6_addr *)RTA_DATA(rtap));
+                    break;
+
+                case RTA_GATEWAY:
+                    route.gateway = *((struct in6_addr *)RTA_DATA(rtap));
+                    route.gateway_f = !IN6_IS_ADDR_UNSPECIFIED(&(route.gateway));
+                    break;
+
+                case RTA_OIF:
+                    route.ifindex = *((int *)RTA_DATA(rtap));
+                    break;
+
+                case RTA_PRIORITY:
+                    route.priority = *((uint32_t *)RTA_DATA(rtap));
+                    break;
+
+                case RTA_MULTIPATH:
+                    table->usable_f = FALSE;
+                    break;
+                }
+            }
+
+            if (route.ifindex == -1 && route.type == RTN_UNICAST)
+                table->usable_f = FALSE;
+
+            if (table->usable_f && add_to_route_table(table, &route) == FAILURE)
+                table->usable_f = FALSE;
+        }
+    }
+
+    close(sockfd);
+    return (table->usable_f ? SUCCESS : FAILURE);
+}
+
+/*
+ * Function: load_route_table()
+ *
+ * Loads a snapshot of the kernel routing table, and subscribes to the kernel notifications for changes in the IPv6
+ * routing table (such that the snapshot can be kept up to date). This requires a full dump of the routing table, so
+ * it only pays off for tools that look up many destinations: those should call this function before the first call
+ * to sel_src_addr() or sel_next_hop(), which employ the snapshot (if loaded) rather than query the kernel.
+ */
+
+int load_route_table(struct iface_data *idata) {
+    struct sockaddr_nl addr;
+    int fd;
+
+    if (rtable.loaded_f)
+        return (rtable.usable_f ? SUCCESS : FAILURE);
+
+    /* init_route_table() clears the whole table (loaded_f included) */
+    if (init_route_table(&rtable) == FAILURE)
+        return (FAILURE);
+
+    /* From now on, failures leave rtable.fd set to -1, such that the kernel is queried directly */
+    rtable.loaded_f = TRUE;
+
+    /* Subscribe to route changes before dumping the table, such that no change can be missed */
+    if ((fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE)) == -1)
+        return (FAILURE);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_IPV6_ROUTE;
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return (FAILURE);
+    }
+
+    rtable.fd = fd;
+
+    if (dump_route_table(&rtable) == FAILURE) {
+        if (idata->verbose_f > 1)
+            puts("Routing table cannot be cached (next hops will be obtained from the kernel)");
+
+        return (FAILURE);
+    }
+
+    return (SUCCESS);
+}
+
+/*
+ * Function: lookup_route_table()
+ *
+ * Finds the route for a destination in the snapshot of the kernel routing table (see load_route_table()). The
+ * snapshot is reloaded whenever the kernel notifies a change in the IPv6 routing table. Returns NULL if the snapshot
+ * has not been loaded, or if the route cannot be determined from it (in which case the kernel should be queried
+ * directly).
+ */
+
+struct route_entry *lookup_route_table(struct iface_data *idata, struct in6_addr *dst) {
+    char buffer[MAX_NLDUMP_SIZE];
+    unsigned char changed_f = FALSE;
+
+    if (!rtable.loaded_f || rtable.fd == -1)
+        return (NULL);
+
+    /* An overrun (ENOBUFS) means that notifications were lost, which also requires reloading the table */
+    while (recv(rtable.fd, buffer, sizeof(buffer), MSG_DONTWAIT) != -1 || errno == ENOBUFS)
+        changed_f = TRUE;
+
+    if (changed_f && dump_route_table(&rtable) == FAILURE && idata->verbose_f > 1)
+        puts("Routing table cannot be cached (next hops will be obtained from the kernel)");
+
+    if (!rtable.usable_f)
+        return (NULL);
+
+    return (match_route_table(&rtable, dst));
+}
+
+/*
+ * Function: sel_next_hop()
+ *
+ * Find the next hop for a target destination
+ */
+int sel_next_hop(struct iface_data *idata) {
+    int sockfd;
+    struct sockaddr_nl addr, them;
+    int ret;
+    struct route_entry *route;
+    char reply[MAX_NLPAYLOAD];
+    struct msghdr msg;
+    struct iovec iov;
+    struct nlrequest req;
+    struct nlmsghdr *nlp;
+    struct rtmsg *rtp;
+    struct rtattr *rtap;
+    int nll, rtl;
+    unsigned char skip_f;
+
+#ifdef DEBUG
+    puts("DEBUG: BEGIN sel_next_hop()");
+#endif
+
+    /*
+       If a tool has already loaded the routing table snapshot (see load_route_table()), unicast destinations are
+       looked up there. Otherwise a single RTM_GETROUTE query is cheaper than a full dump. Link-local destinations are
+       ambiguous without an outgoing interface, so the kernel gets to choose.
+     */
+    if (rtable.loaded_f && idata->dstaddr_f && !IN6_IS_ADDR_LINKLOCAL(&(idata->dstaddr)) &&
+        !IN6_IS_ADDR_MULTICAST(&(idata->dstaddr)) && (route = lookup_route_table(idata, &(idata->dstaddr))) != NULL &&
+        route->type == RTN_UNICAST && if_indextoname(route->ifindex, idata->nhiface) != NULL) {
+        idata->nhifindex = route->ifindex;
+        idata->nhifindex_f = 1;
+
+        if (route->gateway_f) {
+            idata->nhaddr = route->gateway;
+            idata->nhaddr_f = 1;
+        }
+
+        idata->nh_f = TRUE;
+#ifdef DEBUG
+        puts("DEBUG: END sel_next_hop() (SUCCESS, cached routing table)");
+#endif
+        return (SUCCESS);
+    }
+
+    if ((sockfd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE)) == -1) {
+        if (idata->verbose_f)
+            puts("Error in socket()");
+
+        return (FAILURE);
+    }
+
+    /* The port ID is assigned by the kernel, since the routing table cache employs a Netlink socket, too */
+    memset((void *)&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_IPV6_ROUTE;
+
+    if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        if (idata->verbose_f)
+            puts("Error in bind()");
+
+        close(sockfd);
+        return (FAILURE);
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.nl.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+    req.nl.nlmsg_flags = NLM_F_REQUEST;
+    req.nl.nlmsg_type = RTM_GETROUTE;
+    req.rt.rtm_family = AF_INET6;
+
+    rtap = (struct rtattr *)req.buf;
+
+    /* Destination Address */
+    if (idata->dstaddr_f) {
+#ifdef DEBUG
+        print_ipv6_address("DEBUG Req RTA_DST: ", &(idata->dstaddr));
+#endif
+        rtap->rta_type = RTA_DST;
+        rtap->rta_len = RTA_SPACE(sizeof(idata->dstaddr));
+        memcpy(RTA_DATA(rtap), &(idata->dstaddr), sizeof(idata->dstaddr));
+        req.nl.nlmsg_len += rtap->rta_len;
+    }
+
+    /* Source Address */
+    if (idata->srcaddr_f) {
+#ifdef DEBUG
+        print_ipv6_address("DEBUG Req RTA_SRC: ", &(idata->srcaddr));
+#endif
+        rtap = (struct rtattr *)((char *)rtap + (rtap->rta_len));
+        rtap->rta_type = RTA_SRC;
+        rtap->rta_len = RTA_SPACE(sizeof(idata->srcaddr));
+        memcpy(RTA_DATA(rtap), &(idata->srcaddr), sizeof(idata->srcaddr));
+        req.nl.nlmsg_len += rtap->rta_len;
+    }
+
+    /* address it */
+    memset(&them, 0, sizeof(them));
+    them.nl_family = AF_NETLINK;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = (void *)&them;
+    msg.msg_namelen = sizeof(them);
+
+    memset(&iov, 0, sizeof(iov));
+    iov.iov_base = (void *)&req.nl;
+    iov.iov_len = req.nl.nlmsg_len;
+
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    /* send it */
+    if ((ret = sendmsg(sockfd, &msg, 0)) < 0) {
+        if (idata->verbose_f)
+            puts("Error in send()");
+
+        close(sockfd);
+        return (FAILURE);
+    }
+
+    memset(reply, 0, sizeof(reply));
+
+    if ((ret = recv(sockfd, reply, sizeof(reply), 0)) < 0) {
+        if (idata->verbose_f)
+            puts("Error in recv()");
+
+        close(sockfd);
+        return (FAILURE);
+    }
+
+    nll = ret;
+
+#ifdef DEBUG
+    puts("DEBUG: sel_next_hop() going to loop through the results");
+#endif
+
+    /*
+       This should eventually be improved to handle the case where messages are lost, since Netlink messages
+       are reliable.
+     */
+    for (nlp = (struct nlmsghdr *)reply; NLMSG_OK(nlp, nll); nlp = NLMSG_NEXT(nlp, nll)) {
+        rtp = (struct rtmsg *)NLMSG_DATA(nlp);
+
+        skip_f = 0;
+
+        if (rtp->rtm_family == AF_INET6) {
+            for (rtap = (struct rtattr *)RTM_RTA(rtp), rtl = RTM_PAYLOAD(nlp); RTA_OK(rtap, rtl);
+                 rtap = RTA_NEXT(rtap, rtl)) {
+                switch (rtap->rta_type) {
+                case RTA_DST:
+
+#ifdef DEBUG
+                    print_ipv6_address("DEBUG: RTA_DST: ", (struct in6_addr *)RTA_DATA(rtap));
+#endif
+
+                    /*
+                       If Destination is different from Destination Address, this just means that we need to send
+                       our packets to a local router
+                     */
+                    /*
+                    if(!is_eq_in6_addr(&(idata->dstaddr), (struct in6_addr *) RTA_DATA(rtap))){
+                            skip_f=1;
+                    }
+                    */
+                    break;
+
+                case RTA_OIF:
+                    idata->nhifindex = *((int *)RTA_DATA(rtap));
+
+                    if (if_indextoname(idata->nhifindex, idata->nhiface) == NULL) {
+                        if (idata->verbose_f)
+                            puts("Error calling if_indextoname() from sel_next_hop()");
+
+#ifdef DEBUG
+                        puts("DEBUG: RTA_OIF: iif_indextoname() failed");
+#endif
+                        return (FAILURE);
+                    }
+
+#ifdef DEBUG
+                    printf("DEBUG: RTA_OIF: Index: %d, Name: %s\n", idata->nhifindex, idata->nhiface);
+#endif
+                    idata->nhifindex_f = 1;
+                    break;
+
+                case RTA_GATEWAY:
+                    idata->nhaddr = *((struct in6_addr *)RTA_DATA(rtap));
+#ifdef DEBUG
+                    print_ipv6_address("DEBUG: RTA_GATEWAY: ", (struct in6_addr *)RTA_DATA(rtap));
+#endif
+
+                    if (!IN6_IS_ADDR_UNSPECIFIED(&(idata->nhaddr))) {
+                        idata->nhaddr_f = 1;
+#ifdef DEBUG
+                        puts("DEBUG: set the nhaddr_F flag");
+#endif
+                    }
+                    else {
+#ifdef DEBUG
+                        puts("DEBUG: Did not set the nhaddr_f flag was ADR_UNSPECIFIED)");
+#endif
+                    }
+                    break;
+                }
+
+                if (skip_f)
+                    break;
+            }
+
+            if (skip_f) {
+#ifdef DEBUG
+                puts("DEBUG: Skipping set");
+#endif
+                continue;
+            }
+        }
+    }
+
+    close(sockfd);
+
+    if (idata->nhifindex_f) {
+        idata->nh_f = TRUE;
+#ifdef DEBUG
+        puts("DEBUG: END sel_next_hop() (SUCCESS)");
+#endif
+        return (SUCCESS);
+    }
+    else {
+#ifdef DEBUG
+        puts("DEBUG: END sel_next_hop() (FAILURE)");
+#endif
+        return (FAILURE);
+    }
+}
+#elif defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__) ||                     \
+    defined(__FreeBSD_kernel__) || defined(__sun) || defined(sun)
+/*
+ * Function: load_route_table()
+ *
+ * Routing table snapshots are only supported on Linux: next hops are always obtained from the kernel
+ */
+int load_route_table(struct iface_data *idata) {
+    (void)idata;
+    return (FAILURE);
+}
+
+/*
+ * Function: sel_next_hop()
+ *
+ * Find the next hop for a target destination
+ */
+int sel_next_hop(struct iface_data *idata) {
+    int sockfd;
+    pid_t pid;
+    int seq;
+    ssize_t r;
+    unsigned int queries = 0, i;
+    char reply[MAX_RTPAYLOAD];
+    struct rt_msghdr *rtm;
+    struct sockaddr_in6 *sin6;
+    struct sockaddr_dl *sockpptr;
+    struct sockaddr *sa;
+    unsigned char onlink_f = FALSE;
+
+#ifdef DEBUG
+    puts("DEBUG: BEGIN sel_next_hop()");
+#endif
+
+    if ((sockfd = socket(AF_ROUTE, SOCK_RAW, 0)) == -1) {
+        if (idata->verbose_f)
+            puts("Error in socket() call from sel_next_hop()");
+
+#ifdef DEBUG
+        puts("DEBUG: sel_next_hop() Failed when opening socket");
+        puts("DEBUG end sel_next_hop() (FAILURE)");
+#endif
+        return (FAILURE);
+    }
+
+    idata->nhaddr = idata->dstaddr;
+
+    do {
+        rtm = (struct rt_msghdr *)reply;
+        memset(rtm, 0, sizeof(struct rt_msghdr));
+        rtm->rtm_msglen = sizeof(struct rt_msghdr) + sizeof(struct sockaddr_in6);
+        rtm->rtm_version = RTM_VERSION;
+        rtm->rtm_type = RTM_GET;
+#if defined(__OpenBSD__)
+        rtm->rtm_addrs = RTA_DST;
+#else
+        rtm->rtm_addrs = RTA_DST | RTA_IFP;
+#endif
+        rtm->rtm_pid = pid = getpid();
+        rtm->rtm_seq = seq = random();
+
+        sin6 = (struct sockaddr_in6 *)(rtm + 1);
+        memset(sin6, 0, sizeof(struct sockaddr_in6));
+#ifdef SIN6_LEN
+        sin6->sin6_len = sizeof(struct sockaddr_in6);
+#endif
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_addr = idata->nhaddr;
+
+        if (write(sockfd, rtm, rtm->rtm_msglen) == -1) {
+            if (idata->verbose_f)
+                puts("write() failed. No route to the intenteded destination in the local routing table");
+
+            return (FAILURE);
+        }
+
+        do {
+            if ((r = read(sockfd, rtm, MAX_RTPAYLOAD)) < 0) {
+                if (idata->verbose_f)
+                    puts("Error in read() call from sel_next_hop()");
+
+                return (FAILURE);
+            }
+        } while (rtm->rtm_type != RTM_GET || rtm->rtm_pid != pid || rtm->rtm_seq != seq);
+
+        /* The rt_msghdr{} structure is followed by sockaddr structures */
+        sa = (struct sockaddr *)(rtm + 1);
+
+        for (i = 0; i < RTAX_MAX; i++) {
+            if (rtm->rtm_addrs & (1 << i)) {
+                switch (i) {
+                case RTAX_GATEWAY:
+                    if (sa->sa_family == AF_INET6 && rtm->rtm_flags & RTF_GATEWAY) {
+                        idata->nhaddr = ((struct sockaddr_in6 *)sa)->sin6_addr;
+                        idata->nhaddr_f = TRUE;
+                    }
+                    break;
+
+                case RTAX_IFP:
+                    if (sa->sa_family == AF_LINK) {
+                        sockpptr = (struct sockaddr_dl *)(sa);
+                        idata->nhifindex = sockpptr->sdl_index;
+                        idata->nhifindex_f = TRUE;
+
+                        if (if_indextoname(idata->nhifindex, idata->nhiface) == NULL) {
+                            puts("Error calling if_indextoname() from sel_next_hop()");
+                            return (EXIT_FAILURE);
+                        }
+
+                        onlink_f = TRUE;
+                    }
+                    break;
+                }
+
+#if defined(sun) || defined(__sun)
+                if (i == RTAX_IFP || i == RTAX_IFA)
+                    sa = (struct sockaddr *)((char *)sa + sizeof(struct sockaddr_dl));
+                else
+                    sa = (struct sockaddr *)((char *)sa + sizeof(struct sockaddr_in6));
+#else
+                sa = (struct sockaddr *)((char *)sa + SA_SIZE(sa));
+#endif
+            }
+        }
+
+        queries++;
+    } while (!onlink_f && queries < 10);
+
+    close(sockfd);
+
+    if (idata->nhifindex_f) {
+#if defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__) ||                       \
+    defined(__FreeBSD_kernel__)
+        if (IN6_IS_ADDR_LINKLOCAL(&(idata->nhaddr))) {
+            /* BSDs store the interface index in s6_addr16[1], so we must clear it */
+            idata->nhaddr.s6_addr16[1] = 0;
+            idata->nhaddr.s6_addr16[2] = 0;
+            idata->nhaddr.s6_addr16[3] = 0;
+        }
+#endif
+
+#ifdef DEBUG
+        puts("DEBUG: END sel_next_hop() (SUCCESS)");
+#endif
+        return (SUCCESS);
+    }
+    else {
+#ifdef DEBUG
+        puts("DEBUG: END sel_next_hop() (FAILURE)");
+#endif
+        return (FAILURE);
+    }
+}
+#endif
+
+/*
+ * Function: print_ipv6_address()
+ *
+ * Prints an IPv6 address with a legend
+ */
+
+unsigned int print_ipv6_address(char *s, struct in6_addr *v6addr) {
+    char pv6addr[INET6_ADDRSTRLEN];
+
+    if (inet_ntop(AF_INET6, v6addr, pv6addr, sizeof(pv6addr)) == NULL) {
+        puts("inet_ntop(): Error converting IPv6 Source Address to presentation format");
+        return (EXIT_FAILURE);
+    }
+
+    printf("%s%s\n", s, pv6addr);
+    return (EXIT_SUCCESS);
+}
+
+/*
+ * Function: print_ipv6_address_rev()
+ *
+ * Prints an IPv6 address in reversed form
+ */
+
+unsigned int print_ipv6_address_rev(struct in6_addr *v6addr) {
+    int i;
+
+    for (i = 15; i >= 0; i--) {
+        printf("%01x.%01x%s", v6addr->s6_addr[i] & 0x0f, v6addr->s6_addr[i] >> 4, i ? "." : "\n");
+    }
+
+    return (EXIT_SUCCESS);
+}
+
+/*
+ * Function: get_local_addrs()
+ *
+ * Obtains all local addresses (Ethernet and IPv6 addresses for all interfaces)
+ */
+
+int get_local_addrs(struct iface_data *idata) {
+    struct iface_entry *cif;
+    struct ifaddrs *ifptr, *ptr;
+    struct sockaddr_in6 *sockin6ptr;
+
+#ifdef __linux__
+    struct sockaddr_ll *sockpptr;
+#elif defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__) ||                     \
+    defined(__FreeBSD_kernel__)
+    struct sockaddr_dl *sockpptr;
+#endif
+
+    if (getifaddrs(&ifptr) != 0) {
+        if (idata->verbose_f > 1) {
+            puts("Error in call to getifaddrs()");
+        }
+        return (FAILURE);
+    }
+
+    for (ptr = ifptr; ptr != NULL; ptr = ptr->ifa_next) {
+        if (ptr->ifa_addr == NULL) {
+            continue;
+        }
+
+        if (ptr->ifa_name == NULL) {
+#ifdef DEBUG
+            puts("DEBUG: ifa_name was null");
+#endif
+            continue;
+        }
+
+        if ((cif = find_iface_by_name(&(idata->iflist), ptr->ifa_name)) == NULL) {
+            if (idata->iflist.nifaces >= MAX_IFACES)
+                continue;
+            else {
+                cif = &(idata->iflist.ifaces[idata->iflist.nifaces]);
+                strncpy(cif->iface, ptr->ifa_name, IFACE_LENGTH);
+                cif->iface[IFACE_LENGTH - 1] = 0;
+                /* XXX: Cannot otherwise find the index for tun devices? */
+                cif->ifindex = if_nametoindex(cif->iface);
+                idata->iflist.nifaces++;
+            }
+        }
+
+#ifdef __linux__
+        if ((ptr->ifa_addr)->sa_family == AF_PACKET) {
+            sockpptr = (struct sockaddr_ll *)(ptr->ifa_addr);
+
+            if (sockpptr->sll_halen == ETHER_ADDR_LEN) {
+                memcpy(&(cif->ether), sockpptr->sll_addr, ETHER_ADDR_LEN);
+                cif->ether_f = TRUE;
+            }
+
+            cif->ifindex = sockpptr->sll_ifindex;
+        }
+#elif defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__) ||                     \
+    defined(__FreeBSD_kernel__)
+        if ((ptr->ifa_addr)->sa_family == AF_LINK) {
+            sockpptr = (struct sockaddr_dl *)(ptr->ifa_addr);
+            if (sockpptr->sdl_alen == ETHER_ADDR_LEN) {
+                memcpy(&(cif->ether), (sockpptr->sdl_data + sockpptr->sdl_nlen), ETHER_ADDR_LEN);
+                cif->ether_f = TRUE;
+            }
+
+            cif->ifindex = sockpptr->sdl_index;
+        }
+#endif
+        else if ((ptr->ifa_addr)->sa_family == AF_INET6) {
+            sockin6ptr = (struct sockaddr_in6 *)(ptr->ifa_addr);
+
+            if (IN6_IS_ADDR_LINKLOCAL(&(sockin6ptr->sin6_addr))) {
+                if (cif->ip6_local.nprefix >= cif->ip6_local.maxprefix)
+                    continue;
+
+                if (is_ip6_in_prefix_list(&(sockin6ptr->sin6_addr), &(cif->ip6_local)) == TRUE)
+                    continue;
+
+                if ((cif->ip6_local.prefix[cif->ip6_local.nprefix] =
+                         arena_alloc(&(cif->ip6_local.arena), sizeof(struct prefix_entry))) == NULL) {
+                    if (idata->verbose_f > 1)
+                        puts("Error while storing Source Address");
+
+                    freeifaddrs(ifptr);
+                    return (FAILURE);
+                }
+
+                (cif->ip6_local.prefix[cif->ip6_local.nprefix])->len = 128;
+                (cif->ip6_local.prefix[cif->ip6_local.nprefix])->ip6 = sockin6ptr->sin6_addr;
+
+#if defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__APPLE__) ||                       \
+    defined(__FreeBSD_kernel__)
+                /* BSDs store the interface index in s6_addr16[1], so we must clear it */
+                (cif->ip6_local.prefix[cif->ip6_local.nprefix])->ip6.s6_addr16[1] = 0;
+                (cif->ip6_local.prefix[cif->ip6_local.nprefix])->ip6.s6_addr16[2] = 0;
+                (cif->ip6_local.prefix[cif->ip6_local.nprefix])->ip6.s6_addr16[3] = 0;
+#endif
+
+                cif->ip6_local.nprefix++;
+            }
+            else {
+                if (is_ip6_in_prefix_list(&(sockin6ptr->sin6_addr), &(cif->ip6_global)))
+                    continue;
+
+                if (IN6_IS_ADDR_LOOPBACK(&(sockin6ptr->sin6_addr)))
+                    cif->flags = IFACE_LOOPBACK;
+
+                if (cif->ip6_global.nprefix >= cif->ip6_global.maxprefix)
+                    continue;
+
+                if ((cif->ip6_global.prefix[cif->ip6_global.nprefix] =
+                         arena_alloc(&(cif->ip6_global.arena), sizeof(struct prefix_entry))) == NULL) {
+                    if (idata->verbose_f > 1)
+                        puts("Error while storing Source Address");
+
+                    freeifaddrs(ifptr);
+                    return (FAILURE);
+                }
+
+                (cif->ip6_global.prefix[cif->ip6_global.nprefix])->len = 128;
+                (cif->ip6_global.prefix[cif->ip6_global.nprefix])->ip6 = sockin6ptr->sin6_addr;
+                cif->ip6_global.nprefix++;
+            }
+        }
+    }
+
+    freeifaddrs(ifptr);
+
+#ifdef DEBUG
+    debug_print_ifaces_data(&(idata->iflist));
+#endif
+    return (SUCCESS);
+}
+
+/*
+ * Function: debug_print_ifaces_data()
+ *
+ * Prints the data correspoding to each interface
+ */
+
+void debug_print_ifaces_data(struct iface_list *iflist) {
+    unsigned int i, j;
+    struct iface_entry *iface;
+    char plinkaddr[ETHER_ADDR_PLEN];
+    char pv6addr[INET6_ADDRSTRLEN];
+
+    for (i = 0; i < iflist->nifaces; i++) {
+        iface = iflist->ifaces + i;
+
+        printf("DEBUG: Interface: %s (%d)\tFlags:%s%s\n", iface->iface, iface->ifindex,
+               (iface->flags & IFACE_LOOPBACK) ? " LOOPBACK" : "", (iface->flags & IFACE_TUNNEL) ? "TUNNEL" : "");
+
+        if (iface->ether_f) {
+            if (ether_ntop(&(iface->ether), plinkaddr, sizeof(plinkaddr)) == FALSE) {
+                puts("DEBUG: ether_ntop(): Error converting address");
+                exit(EXIT_FAILURE);
+            }
+
+            printf("DEBUG: Link address: %s\n", plinkaddr);
+        }
+
+        if ((iface->ip6_global).nprefix) {
+            puts("DEBUG: Global addresses:");
+
+            for (j = 0; j < (iface->ip6_global.nprefix); j++) {
+                if (inet_ntop(AF_INET6, &((iface->ip6_global.prefix[j])->ip6), pv6addr, sizeof(pv6addr)) == NULL) {
+                    puts("DEBUG: inet_ntop(): Error converting IPv6 Address to presentation format");
+                    exit(EXIT_FAILURE);
+                }
+
+                printf("DEBUG: %s\n", pv6addr);
+            }
+        }
+
+        if ((iface->ip6_local).nprefix) {
+            puts("DEBUG: Local addresses:");
+
+            for (j = 0; j < (iface->ip6_local.nprefix); j++) {
+                if (inet_ntop(AF_INET6, &((iface->ip6_local.prefix[j])->ip6), pv6addr, sizeof(pv6addr)) == NULL) {
+                    puts("DEBUG: inet_ntop(): Error converting IPv6 Address to presentation format");
+                    exit(EXIT_FAILURE);
+                }
+
+                printf("DEBUG: %s\n", pv6addr);
+            }
+        }
+
+        puts("");
+    }
+}
+
+/*
+ * Function: find_iface_by_name()
+ *
+ * Finds an Interface (by name) in an Interface list
+ */
+
+void *find_iface_by_name(struct iface_list *iflist, char *iface) {
+    unsigned int i;
+
+    for (i = 0; i < iflist->nifaces; i++) {
+        if (strncmp((iflist->ifaces[i]).iface, iface, IFACE_LENGTH) == 0)
+            return (&(iflist->ifaces[i]));
+    }
+
+    return (NULL);
+}
+
+/*
+ * Function: find_iface_by_index()
+ *
+ * Finds an Interface (by index) in an Interface list
+ */
+
+void *find_iface_by_index(struct iface_list *iflist, int ifindex) {
+    unsigned int i;
+
+    for (i = 0; i < iflist->nifaces; i++) {
+        if ((iflist->ifaces[i]).ifindex == ifindex)
+            return (&(iflist->ifaces[i]));
+    }
+
+    return (NULL);
+}
+
+/*
+ * Function: find_iface_by_addr()
+ *
+ * Finds an Interface (by IPv6 address) in an Interface list
+ */
+
+void *find_iface_by_addr(struct iface_list *iflist, struct in6_addr *addr) {
+    unsigned int i;
+
+    for (i = 0; i < iflist->nifaces; i++) {
+        if (is_ip6_in_prefix_list(addr, &((iflist->ifaces[i]).ip6_global)) ||
+            is_ip6_in_prefix_list(addr, &((iflist->ifaces[i]).ip6_local)))
+            return (&(iflist->ifaces[i]));
+    }
+
+    return (NULL);
+}
+
+/*
+ * Function: is_in6addr_iniface_list()
+ *
+ * Finds an Interface (by name) in an Interface list
+ */
+
+int is_ip6_in_iface_entry(struct iface_list *iflist, int ifindex, struct in6_addr *addr) {
+    unsigned int i;
+
+    for (i = 0; i < iflist->nifaces; i++) {
+        if (iflist->ifaces[i].ifindex == ifindex) {
+            if (is_ip6_in_prefix_list(addr, &(iflist->ifaces[i].ip6_global)))
+                return (TRUE);
+            else if (is_ip6_in_prefix_list(addr, &(iflist->ifaces[i].ip6_local)))
+                return (TRUE);
+        }
+    }
+
+    return (FALSE);
+}
+
+/*
+ * Function: find_matching_address()
+ *
+ * Finds the longest matching address in an Interface list
+ */
+
+struct iface_entry *find_matching_address(struct iface_data *idata, struct iface_list *iflist, struct in6_addr *dst,
+                                          struct in6_addr *match) {
+    unsigned int i, j, mlen, len;
+    struct iface_entry *cif = NULL; /* Not needed, but avoids warning in OpenBSD/gcc */
+    int ifindex = -1;
+#ifdef __linux__
+    struct route_entry *route;
+#endif
+
+    if (idata->iface_f) {
+        ifindex = idata->ifindex;
+    }
+#ifdef __linux__
+    /*
+       If the routing table snapshot is loaded (see load_route_table()), the address is selected from the outgoing
+       interface, such that sel_src_addr() need not switch interfaces once the next hop is known
+     */
+    else if (!IN6_IS_ADDR_LINKLOCAL(dst) && !IN6_IS_ADDR_MULTICAST(dst) &&
+             (route = lookup_route_table(idata, dst)) != NULL && route->type == RTN_UNICAST) {
+        ifindex = route->ifindex;
+    }
+#endif
+
+    while (1) {
+        mlen = 0;
+
+        for (i = 0; i < iflist->nifaces; i++) {
+            if (ifindex != -1 && (ifindex != (iflist->ifaces[i]).ifindex))
+                continue;
+
+            for (j = 0; j < (iflist->ifaces[i]).ip6_local.nprefix; j++) {
+                if ((len = ip6_longest_match(&((iflist->ifaces[i].ip6_local.prefix[j])->ip6), dst)) >= mlen) {
+                    cif = &(iflist->ifaces[i]);
+                    *match = (iflist->ifaces[i].ip6_local.prefix[j])->ip6;
+                    mlen = len;
+                }
+
+                if (mlen >= 64) {
+                    return (cif);
+                }
+            }
+
+            for (j = 0; j < (iflist->ifaces[i]).ip6_global.nprefix; j++) {
+                if ((len = ip6_longest_match(&((iflist->ifaces[i].ip6_global.prefix[j])->ip6), dst)) >= mlen) {
+                    cif = &(iflist->ifaces[i]);
+                    *match = (iflist->ifaces[i].ip6_global.prefix[j])->ip6;
+                    mlen = len;
+                }
+
+                if (mlen >= 64) {
+                    return (cif);
+                }
+            }
+        }
+
+        /* The outgoing interface has no addresses: fall back to the longest match over all interfaces */
+        if (cif != NULL || idata->iface_f || ifindex == -1)
+            return (cif);
+
+        ifindex = -1;
+    }
+}
+
+/*
+ * Function: ip6_longest_match()
+ *
+ * Finds the mask that two IPv6 addresses have in common (up to 64 bits)
+ */
+unsigned int ip6_longest_match(struct in6_addr *addr1, struct in6_addr *addr2) {
+    unsigned int i, match;
+    uint8_t diff;
+
+    for (i = 0; i < 8; i++) {
+        if ((diff = addr1->s6_addr[i] ^ addr2->s6_addr[i]) != 0) {
+            for (match = i * 8; !(diff & 0x80); diff = diff << 1)
+                match++;
+
+            return (match);
+        }
+    }
+
+    return (64);
+}
+
+/*
+ * Function: sel_src_addr()
+ *
+ * Selects a Source Address for a given Destination
+ */
+int sel_src_addr(struct iface_data *idata) {
+    struct in6_addr match;
+    struct iface_entry *cif, *nhif;
+
+#ifdef DEBUG
+    puts("DEBUG: BEGIN sel_src_addr()");
+#endif
+
+    /*
+       If the packet is directed to a link-local addresses, the ourgoing interface should have been specified.
+       If not, that's a failure. If specified, we give higher priority to link-local addresses
+     */
+    if (IN6_IS_ADDR_LINKLOCAL(&(idata->dstaddr))) {
+#ifdef DEBUG
+        puts("DEBUG: Destination is link-local");
+#endif
+
+        if (!idata->iface_f) {
+#ifdef DEBUG
+            puts("DEBUG: Interface not specified");
+            puts("DEBUG: END sel_src_addr() (FAILURE)");
+#endif
+            return (FAILURE);
+        }
+        else {
+#ifdef DEBUG
+            puts("DEBUG: Interface has been specified");
+#endif
+            if ((cif = find_iface_by_index(&(idata->iflist), idata->ifindex)) == NULL) {
+#ifdef DEBUG
+                puts("DEBUG: Did not find interface in local data");
+                puts("DEBUG: END sel_src_addr() (FAILURE)");
+#endif
+                return (FAILURE);
+            }
+            else {
+#ifdef DEBUG
+                puts("DEBUG: Found interface in local data");
+#endif
+                idata->ether = cif->ether;
+                idata->ether_flag = cif->ether_f;
+                idata->flags = cif->flags;
+
+                if ((cif->ip6_local).nprefix) {
+                    idata->ip6_local = (cif->ip6_local).prefix[0]->ip6;
+                    idata->ip6_local_flag = TRUE;
+                }
+
+                idata->ip6_global = cif->ip6_global;
+                if ((idata->ip6_global).nprefix)
+                    idata->ip6_global_flag = TRUE;
+
+                /*
+                   Since destination is a link-local address, use a link-local address as IPv6 Source Address
+                   if available.
+                 */
+                if (idata->ip6_local_flag == TRUE) {
+                    idata->srcaddr = (cif->ip6_local.prefix[0])->ip6;
+                    idata->srcaddr_f = ADDR_AUTO;
+#ifdef DEBUG
+                    puts("DEBUG: END sel_src_addr() (SUCCESS)");
+#endif
+                    return (SUCCESS);
+                }
+                else if (idata->ip6_global_flag == TRUE) {
+                    idata->srcaddr = (cif->ip6_local.prefix[0])->ip6;
+                    idata->srcaddr_f = ADDR_AUTO;
+#ifdef DEBUG
+                    puts("DEBUG: END sel_src_addr() (SUCCESS)");
+#endif
+                    return (SUCCESS);
+                }
+            }
+        }
+    }
+    else {
+#ifdef DEBUG
+        puts("DEBUG: Destination is NOT link-local");
+#endif
+        /*
+           If the destination address is not a link-local address, then:
+
+           1) If the interface has been specified, we select an IPv6 address assigned to that interface
+              (prioritizing "global" addresses)
+
+           2) If an interface has not been specified, we select the longest-matching address for that
+              destination
+         */
+        if (idata->iface_f) {
+#ifdef DEBUG
+            puts("DEBUG: Interface was specified");
+#endif
+            if ((cif = find_iface_by_index(&(idata->iflist), idata->ifindex)) == NULL) {
+#ifdef DEBUG
+                puts("DEBUG: Did not find interface in local data");
+                puts("DEBUG: END sel_src_addr() (FAILURE)");
+#endif
+                return (FAILURE);
+            }
+            else {
+                idata->ether = cif->ether;
+                idata->ether_flag = cif->ether_f;
+                idata->flags = cif->flags;
+
+                idata->ip6_global = cif->ip6_global;
+                if (cif->ip6_global.nprefix) {
+                    idata->ip6_global_flag = TRUE;
+                }
+
+                if ((cif->ip6_local).nprefix) {
+                    idata->ip6_local = (cif->ip6_local).prefix[0]->ip6;
+                    idata->ip6_local_flag = TRUE;
+                }
+
+                if (idata->ip6_global_flag) {
+                    /* XXX This should be replaced with "find the longest match for this list */
+                    idata->srcaddr = (idata->ip6_global).prefix[0]->ip6;
+                    idata->srcaddr_f = ADDR_AUTO;
+#ifdef DEBUG
+                    puts("DEBUG: END sel_src_addr() Used global address (SUCCESS)");
+#endif
+                    return (SUCCESS);
+                }
+                else if (idata->ip6_local_flag) {
+                    idata->srcaddr = idata->ip6_local;
+                    idata->srcaddr_f = ADDR_AUTO;
+#ifdef DEBUG
+                    puts("DEBUG: END sel_src_addr() Used local address (SUCCESS)");
+#endif
+                    return (SUCCESS);
+                }
+                else {
+#ifdef DEBUG
+                    puts("DEBUG: END sel_src_addr() Have no IPv6 addresses (FAILURE)");
+#endif
+                    return (FAILURE);
+                }
+            }
+        }
+        else {
+#ifdef DEBUG
+            puts("DEBUG: Interface was not specified");
+#endif
+            if ((cif = find_matching_address(idata, &(idata->iflist), &(idata->dstaddr), &match)) != NULL) {
+                idata->srcaddr = match;
+                idata->srcaddr_f = ADDR_AUTO;
+                strncpy(idata->iface, cif->iface, IFACE_LENGTH);
+                idata->iface[IFACE_LENGTH - 1] = 0;
+                idata->ifindex = cif->ifindex;
+                idata->ifindex_f = TRUE;
+                idata->flags = cif->flags;
+
+#ifdef DEBUG
+                puts("DEBUG: Found a matching address");
+                print_ipv6_address("DEBUG: Src addr: ", &(idata->srcaddr));
+                printf("DEBUG: Interface name: %s, Index: %d\n", idata->iface, idata->ifindex);
+#endif
+
+                /*
+                   We know check whether the selected address belongs to the outgoing
+                   interface -- otherwise packets might be filtered
+                 */
+
+                if (sel_next_hop(idata) == SUCCESS) {
+#ifdef DEBUG
+                    puts("DEBUG: sel_next_hop() suceeded");
+#endif
+
+                    if ((nhif = find_iface_by_index(&(idata->iflist), idata->nhifindex)) == NULL) {
+                        return (FAILURE);
+                    }
+
+                    if ((nhif->flags & IFACE_LOOPBACK) ||
+                        is_ip6_in_iface_entry(&(idata->iflist), idata->nhifindex, &(idata->srcaddr)) == TRUE) {
+#ifdef DEBUG
+                        puts("DEBUG: Selected address was in outgoing interface");
+#endif
+                        if ((cif->ip6_local).nprefix) {
+                            idata->ip6_local = (cif->ip6_local).prefix[0]->ip6;
+                            idata->ip6_local_flag = TRUE;
+                        }
+
+                        idata->ip6_global = cif->ip6_global;
+                        if ((idata->ip6_global).nprefix)
+                            idata->ip6_global_flag = TRUE;
+
+                        idata->ether = cif->ether;
+                        idata->ether_flag = cif->ether_f;
+                        idata->srcaddr_f = ADDR_AUTO;
+
+#ifdef DEBUG
+                        print_ipv6_address("DEBUG: Src addr: ", &(idata->srcaddr));
+                        puts("DEBUG: END sel_src_addr() (SUCCESS)");
+#endif
+                        return (SUCCESS);
+                    }
+                    else {
+#ifdef DEBUG
+                        puts("DEBUG: Selected address was NOT in outgoing interface");
+#endif
+                        /*
+                           If the seleted address doesn't correspond to the outgoing interface, throw away
+                           the previously-selected IPv6 Address, and select one that is assigned to the
+                           outgoing interface.
+                         */
+                        if ((cif = find_iface_by_index(&(idata->iflist), idata->nhifindex)) == NULL) {
+#ifdef DEBUG
+                            puts("DEBUG: END Did not find interface in local data");
+                            puts("DEBUG: END sel_src_addr() (FAILURE)");
+#endif
+                            return (FAILURE);
+                        }
+                        else {
+#ifdef DEBUG
+                            puts("DEBUG: Copying data from output interface into idata");
+#endif
+                            idata->ether = cif->ether;
+                            idata->ether_flag = cif->ether_f;
+                            idata->ifindex = idata->nhifindex;
+                            idata->flags = cif->flags;
+                            strncpy(idata->iface, idata->nhiface, IFACE_LENGTH);
+                            idata->iface[IFACE_LENGTH - 1] = 0;
+
+                            if ((cif->ip6_local).nprefix) {
+                                idata->ip6_local = (cif->ip6_local).prefix[0]->ip6;
+                                idata->ip6_local_flag = TRUE;
+                            }
+
+                            idata->ip6_global = cif->ip6_global;
+                            if ((idata->ip6_global).nprefix)
+                                idata->ip6_global_flag = TRUE;
+
+                            if (idata->ip6_global_flag == TRUE) {
+                                idata->srcaddr = (cif->ip6_global.prefix[0])->ip6;
+                                idata->srcaddr_f = ADDR_AUTO;
+#ifdef DEBUG
+                                puts("DEBUG: Used global src addr for global dst addr");
+                                print_ipv6_address("DEBUG: Src addr: ", &(idata->srcaddr));
+                                puts("DEBUG: END sel_src_addr() (SUCCESS)");
+#endif
+                                return (SUCCESS);
+                            }
+                            else if (idata->ip6_local_flag) {
+                                idata->srcaddr = idata->ip6_local;
+                                idata->srcaddr_f = ADDR_AUTO;
+#ifdef DEBUG
+                                puts("DEBUG: Used local src addr for global dst addr");
+                                print_ipv6_address("DEBUG: Src addr: ", &(idata->srcaddr));
+                                puts("DEBUG: END sel_src_addr() (SUCCESS)");
+#endif
+                                return (SUCCESS);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+#ifdef DEBUG
+    puts("DEBUG: END sel_src_addr() (FAILURE)");
+#endif
+    return (FAILURE);
+}
+
+/*
+ * Function: load_dst_and_pcap()
+ *
+ * Finds the Sorurce Address, Next-Hop, and outgoing interface for a given Destination Address
+ */
+int load_dst_and_pcap(struct iface_data *idata, unsigned int mode) {
+    struct iface_entry *cif, *rif;
+    struct in6_addr randprefix, loopback;
+    unsigned char randpreflen;
+    char errbuf[PCAP_ERRBUF_SIZE];
+
+    if (mode != LOAD_PCAP_ONLY &&
+        (IN6_IS_ADDR_LINKLOCAL(&(idata->dstaddr)) || IN6_IS_ADDR_MC_LINKLOCAL(&(idata->dstaddr)))) {
+        /* Special case where the Destination Address is a link-local address */
+        if (!idata->iface_f) {
+            puts("Need to specify an interface ('-i' option) when Destination Address is link-local");
+            return (FAILURE);
+        }
+
+        if (!idata->ifindex_f) {
+            idata->ifindex = if_nametoindex(idata->iface);
+            idata->ifindex_f = TRUE;
+        }
+
+        idata->nhifindex = idata->ifindex;
+        idata->nhifindex_f = TRUE;
+
+        if (get_if_addrs(idata) == -1) {
+            if (idata->verbose_f) {
+                puts("Error while obtaining local interface data");
+            }
+
+            return (FAILURE);
+        }
+    }
+    else if (mode != LOAD_PCAP_ONLY) {
+        if (idata->srcprefix_f) {
+            randprefix = idata->srcaddr;
+            randpreflen = idata->srcpreflen;
+            randomize_ipv6_addr(&(idata->srcaddr), &randprefix, randpreflen);
+            idata->srcaddr_f = 1;
+        }
+
+        if (get_local_addrs(idata) == FAILURE) {
+            if (idata->verbose_f)
+                puts("Error while obtaining local addresses");
+
+            return (FAILURE);
+        }
+
+        if (!idata->srcaddr_f) {
+#ifdef DEBUG
+            puts("DEBUG: Has not specified source address");
+#endif
+
+            /*
+               If no source address or prefix have been specified, then we need to automatically learn our IPv6
+               address. This is our appraoch:
+
+               * Firstly, assume that our host has IPv6 connectivity:
+                    + If an interface has been specified, select an IPv6 address from one of the configures addresses
+                          of such interface.
+
+                    * If an interface has not been specified, select a source address taking into consideration
+                      all configured addresses.
+
+               * If that doesn't succeed, try sending RAs
+
+             */
+
+            if (sel_src_addr(idata) == SUCCESS) {
+                if (sel_next_hop(idata) == SUCCESS) {
+                    /* This is actually redundant (nh_f is already set by sel_next_hop() */
+#ifdef DEBUG
+                    puts("DEBUG: sel_next_hop() succeeded");
+#endif
+                    idata->nh_f = TRUE;
+                }
+                else {
+#ifdef DEBUG
+                    puts("DEBUG: sel_next_hop() failed");
+#endif
+                }
+
+#ifdef DEBUG
+                printf("DEBUG: nhifindex_f: %s\tnhaddr_f: %s", (idata->nhifindex_f) ? "TRUE" : "FALSE",
+                       (idata->nhaddr_f) ? "TRUE" : "FALSE");
+
+                if (idata->nhifindex_f)
+                    printf("\tnhifindex: %d ", idata->nhifindex);
+
+                if (idata->nhaddr_f)
+                    print_ipv6_address("\tnhaddr: ", &(idata->nhaddr));
+                else
+                    puts("");
+#endif
+            }
+
+            if (idata->nh_f == FALSE) {
+#ifdef DEBUG
+                puts("DEBUG: Automatic address selection failed");
+#endif
+                /* XXX Should really free the memory allocated by the other functions, since they are of no further use
+                 */
+                idata->ip6_local_flag = FALSE;
+                idata->ip6_global.nprefix = 0;
+                idata->ip6_global_flag = FALSE;
+
+                if (!idata->iface_f) {
+#ifdef DEBUG
+                    puts("DEBUG: No automatic address selection, and no specified interface");
+#endif
+                    if (idata->verbose_f)
+                        puts("Could not determine next hop address");
+
+                    return (FAILURE);
+                }
+
+                /* This sends an RA, populates the local addresses and prefixes, and the local router */
+                if (sel_next_hop_ra(idata) == -1) {
+#ifdef DEBUG
+                    puts("DEBUG: sel_next_hop_ra() failed");
+#endif
+                    puts("Could not learn a local router");
+                    return (FAILURE);
+                }
+
+                if (sel_src_addr_ra(idata, &(idata->dstaddr)) == FAILURE || !idata->ether_flag ||
+                    !idata->ip6_global_flag || !idata->ip6_local_flag) {
+#ifdef DEBUG
+                    puts("DEBUG: sel_src_addr_ra() failed");
+#endif
+                    puts("Could not obtain local address **");
+                    return (FAILURE);
+                }
+
+                idata->ifindex = if_nametoindex(idata->iface);
+                idata->ifindex_f = TRUE;
+            }
+        }
+        else {
+#ifdef DEBUG
+            puts("DEBUG: Has specified source address");
+#endif
+
+            if (sel_next_hop(idata) == SUCCESS) {
+#ifdef DEBUG
+                puts("DEBUG: sel_next_hop() succeeded");
+#endif
+                idata->ifindex = idata->nhifindex;
+                idata->nh_f = TRUE;
+                strncpy(idata->iface, idata->nhiface, IFACE_LENGTH);
+                idata->iface[IFACE_LENGTH - 1] = 0;
+
+                if ((cif = find_iface_by_index(&(idata->iflist), idata->ifindex)) != NULL) {
+                    idata->ether = cif->ether;
+                    idata->ether_flag = cif->ether_f;
+                }
+            }
+            else {
+#ifdef DEBUG
+                puts("DEBUG: sel_next_hop() DID NOT succeed, Now trying RAs");
+#endif
+                /* This sends an RA, populates the local addresses and prefixes, and the local router */
+                if (sel_next_hop_ra(idata) == -1) {
+#ifdef DEBUG
+                    puts("DEBUG: ssel_next_hop_ra() failed");
+#endif
+
+                    puts("Could not learn a local router");
+                    return (FAILURE);
+                }
+            }
+        }
+
+        /*
+           If a next hop was found, we employ whatever was found as the output interface, because we need to open
+           a pcap_t for that interface
+         */
+        if (idata->nhifindex_f) {
+#ifdef DEBUG
+            puts("sel_next eligio nh_index");
+#endif
+            idata->ifindex = idata->nhifindex;
+
+            if ((cif = find_iface_by_index(&(idata->iflist), idata->ifindex)) == NULL) {
+                if (idata->verbose_f) {
+                    puts("Could not find selected interface in local data");
+                }
+#ifdef DEBUG
+                puts("No la interfaz que buscaba");
+#endif
+                return (FAILURE);
+            }
+
+            idata->flags = cif->flags;
+
+            if (if_indextoname(idata->ifindex, idata->iface) == NULL) {
+                if (idata->verbose_f)
+                    puts("Error calling if_indextoname() from sel_next_hop()");
+
+#ifdef DEBUG
+                puts("DEBUG: if_indextoname() failed");
+#endif
+                return (FAILURE);
+            }
+        }
 
 #ifdef DEBUG
-    puts("DEBUG: BEGIN sel_src_addr()");
+        puts("Voy a chequear si es loopback");
 #endif
+        if (!(idata->flags & IFACE_LOOPBACK)) {
+#ifdef DEBUG
+            puts("COmprobe que era distinta de loopback");
+#endif
+            if (is_ip6_in_prefix_list(&(idata->dstaddr), &(idata->ip6_global)) ||
+                is_eq_in6_addr(&(idata->dstaddr), &(idata->ip6_local))) {
 
-    /*
-       If the packet is directed to a link-local addresses, the ourgoing interface should have been specified.
-       If not, that's a failure. If specified, we give higher priority to link-local addresses
-     */
-    if (IN6_IS_ADDR_LINKLOCAL(&(idata->dstaddr))) {
 #ifdef DEBUG
-        puts("DEBUG: Destination is link-local");
+                puts("ENcontre la dst en mi lista de direcciones");
 #endif
+                /*
+                   Since we're sending a packet on the same interface to which the destination address belongs,
+                   the packet should actually be sent to the loopback interface
+                 */
+                if (inet_pton(AF_INET6, LOOPBACK_ADDR, &loopback) <= 0) {
+                    if (idata->verbose_f)
+                        puts("inet_pton(): Error converting loopback address from presentation to network format");
 
-        if (!idata->iface_f) {
 #ifdef DEBUG
-            puts("DEBUG: Interface not specified");
-            puts("DEBUG: END sel_src_addr() (FAILURE)");
+                    puts("inet_pton dio error");
 #endif
-            return (FAILURE);
-        }
-        else {
+                    return (FAILURE);
+                }
+
+                if ((rif = find_iface_by_addr(&(idata->iflist), &loopback)) == NULL) {
 #ifdef DEBUG
-            puts("DEBUG: Interface has been specified");
+                    puts("No encontre loopback");
 #endif
-            if ((cif = find_iface_by_index(&(idata->iflist), idata->ifindex)) == NULL) {
+                    if (idata->verbose_f)
+                        puts("Could not find loopback interface in local data");
+
+                    return (FAILURE);
+                }
+                else {
 #ifdef DEBUG
-                puts("DEBUG: Did not find interface in local data");
-                puts("DEBUG: END sel_src_addr() (FAILURE)");
+                    puts("Encontre loopback y voy a sobreeescribir la info de destino");
 #endif
-                return (FAILURE);
+                    idata->flags = rif->flags;
+                    idata->ifindex = rif->ifindex;
+                    strncpy(idata->iface, rif->iface, IFACE_LENGTH);
+                    idata->iface[IFACE_LENGTH - 1] = 0;
+                }
             }
-            else {
+        }
+    }
+    else {
+        /* LOAD_PCAP_ONLY */
+
+        if (!idata->iface_f) {
+            if (idata->verbose_f) {
+                puts("Error opening pcap socket because interface was not specified");
+            }
+
+            return (FAILURE);
+        }
+
+        idata->ifindex = if_nametoindex(idata->iface);
+        idata->ifindex_f = TRUE;
+
+        if (get_if_addrs(idata) == -1) {
+            if (idata->verbose_f) {
+                puts("Error while obtaining local interface data");
+            }
+
+            return (FAILURE);
+        }
+    }
+
+    if (idata->nhifindex_f && !idata->nhaddr_f)
+        idata->nhaddr = idata->dstaddr;
+
 #ifdef DEBUG
-                puts("DEBUG: Found interface in local data");
+    if (idata->nhaddr_f)
+        print_ipv6_address("DEBUG: load_dst_(): Nex Hop: ", &(idata->nhaddr));
+    else
+        puts("DEBUG: load_dst() Next Hop address not set");
+
+    printf("DEBUG: Output interface: %s (%d)\n", idata->iface, idata->ifindex);
 #endif
-                idata->ether = cif->ether;
-                idata->ether_flag = cif->ether_f;
-                idata->flags = cif->flags;
 
-                if ((cif->ip6_local).nprefix) {
-                    idata->ip6_local = (cif->ip6_local).prefix[0]->ip6;
-                    idata->ip6_local_flag = TRUE;
+    if (!(idata->hsrcaddr_f)) {
+        if (idata->ether_flag)
+            idata->hsrcaddr = idata->ether;
+        else {
+            randomize_ether_addr(&(idata->hsrcaddr));
+        }
+    }
+
+    if (!idata->ip6_local_flag) {
+        ether_to_ipv6_linklocal(&idata->ether, &idata->ip6_local);
+    }
+
+    if (idata->rxreplayfile != NULL) {
+        if (open_rx_replay(idata, errbuf) == FAILURE) {
+            printf("pcap_open_offline(%s): %s\n", idata->rxreplayfile, errbuf);
+            return (FAILURE);
+        }
+    }
+    else if ((idata->pfd = open_iface_pcap(idata->iface, errbuf)) == NULL) {
+        printf("open_iface_pcap(%s): %s\n", idata->iface, errbuf);
+        return (FAILURE);
+    }
+
+    /* Savefiles cannot be put into non-blocking mode (but reading from them never blocks anyway) */
+    if (!idata->rxreplay_f && pcap_setnonblock(idata->pfd, 1, errbuf) == -1) {
+        printf("pcap_setnonblock(): %s\n", errbuf);
+        return (FAILURE);
+    }
+
+    if ((idata->fd = pcap_fileno(idata->pfd)) == -1) {
+        if (idata->verbose_f)
+            puts("Error obtaining descriptor number for pcap_t");
+
+        return (FAILURE);
+    }
+
+    if ((idata->type = pcap_datalink(idata->pfd)) == DLT_EN10MB) {
+        idata->linkhsize = ETH_HLEN;
+        idata->mtu = ETH_DATA_LEN;
+    }
+    else if (idata->type == DLT_RAW) {
+        idata->linkhsize = 0;
+        idata->mtu = MIN_IPV6_MTU;
+        idata->flags |= IFACE_TUNNEL;
+    }
+#if defined(__OpenBSD__)
+    else if (idata->type == DLT_LOOP) {
+        idata->linkhsize = 4;
+        idata->mtu = MIN_IPV6_MTU;
+        idata->flags |= IFACE_TUNNEL;
+    }
+#elif defined(__linux__)
+    else if (idata->type == DLT_LINUX_SLL) {
+        idata->linkhsize = sizeof(struct sll_linux);
+        idata->mtu = MIN_IPV6_MTU;
+        idata->flags |= IFACE_TUNNEL;
+    }
+#endif
+    else if (idata->type == DLT_NULL) {
+        idata->linkhsize = 4;
+        idata->mtu = MIN_IPV6_MTU;
+        idata->flags |= IFACE_TUNNEL;
+    }
+    else {
+#ifdef DEBUG
+        puts("Estoy en load_dst() y voy a imprimir error");
+#endif
+        printf("Error: Interface %s is not of any supported type (type= %u)\n", idata->iface, idata->type);
+        return (FAILURE);
+    }
+
+    if (idata->fragh_f)
+        idata->max_packet_size = MAX_IPV6_PAYLOAD + MIN_IPV6_HLEN;
+    else
+        idata->max_packet_size = idata->mtu;
+
+    if (mode == LOAD_PCAP_ONLY)
+        return (SUCCESS);
+
+    if (!(idata->flags & IFACE_TUNNEL) && !(idata->flags & IFACE_LOOPBACK)) {
+        if (!(idata->hdstaddr_f)) {
+            if (IN6_IS_ADDR_MULTICAST(&(idata->dstaddr))) {
+                idata->nhhaddr = ether_multicast(&(idata->dstaddr));
+            }
+            else if (idata->rxreplay_f) {
+                /* Neighbor Discovery is not possible when replaying a savefile (the frames are not sent, anyway) */
+                memset(&(idata->nhhaddr), 0, sizeof(struct ether_addr));
+            }
+            else {
+                if (ipv6_to_ether(idata->pfd, idata, &(idata->nhaddr), &(idata->nhhaddr)) != 1) {
+                    puts("Error while performing Neighbor Discovery for the Destination Address");
+                    return (FAILURE);
                 }
+            }
+
+            idata->hdstaddr = idata->nhhaddr;
+        }
+    }
+
+    return (SUCCESS);
+}
+
+/*
+ * Function: open_iface_pcap()
+ *
+ * Opens a libpcap handle for capturing on (and injecting into) the specified interface. As opposed to
+ * pcap_open_live(), it requests a large kernel capture buffer. On Linux, this is the size of the TPACKET_V3
+ * memory-mapped ring employed by libpcap, such that bursts of responses can be drained a whole block at a time
+ * rather than being dropped.
+ */
+
+pcap_t *open_iface_pcap(const char *iface, char *errbuf) {
+    pcap_t *pfd;
+    int r;
+
+    if ((pfd = pcap_create(iface, errbuf)) == NULL)
+        return (NULL);
+
+    if (pcap_set_snaplen(pfd, PCAP_SNAP_LEN) != 0 || pcap_set_promisc(pfd, PCAP_PROMISC) != 0 ||
+        pcap_set_timeout(pfd, PCAP_TIMEOUT) != 0 || pcap_set_buffer_size(pfd, PCAP_BUFFER_SIZE) != 0) {
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "Error while setting capture parameters");
+        pcap_close(pfd);
+        return (NULL);
+    }
+
+    /* Positive values are warnings (e.g., promiscuous mode not supported) */
+    if ((r = pcap_activate(pfd)) < 0) {
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s", pcap_geterr(pfd));
+        pcap_close(pfd);
+        return (NULL);
+    }
+
+    return (pfd);
+}
+
+/*
+ * Function: open_tx_dump()
+ *
+ * Makes send_frame() write all frames to a savefile (e.g. "/dev/null"), rather than sending them. This allows the
+ * packet-generation speed of a tool to be measured without sending any packets: the number of frames per second
+ * and the time spent for each frame are printed when the tool exits (or is interrupted).
+ */
+
+int open_tx_dump(struct iface_data *idata, const char *path) {
+    if ((idata->txdumppfd = pcap_open_dead(idata->type, PCAP_SNAP_LEN)) == NULL) {
+        if (idata->verbose_f)
+            puts("open_tx_dump(): Error while opening libpcap handle");
+
+        return (FAILURE);
+    }
+
+    if ((idata->txdump = pcap_dump_open(idata->txdumppfd, path)) == NULL) {
+        if (idata->verbose_f)
+            printf("pcap_dump_open(): %s\n", pcap_geterr(idata->txdumppfd));
+
+        pcap_close(idata->txdumppfd);
+        return (FAILURE);
+    }
+
+    idata->txframes = 0;
+    idata->txbytes = 0;
+    idata->txdump_f = TRUE;
+    txdump_idata = idata;
+
+    if (atexit(close_tx_dump) != 0 || signal(SIGINT, sig_tx_dump) == SIG_ERR ||
+        signal(SIGTERM, sig_tx_dump) == SIG_ERR) {
+        return (FAILURE);
+    }
+
+    return (SUCCESS);
+}
+
+/*
+ * Function: close_tx_dump()
+ *
+ * Closes the savefile opened with open_tx_dump(), and prints the packet-generation statistics (registered with
+ * atexit())
+ */
+
+void close_tx_dump(void) {
+    struct iface_data *idata = txdump_idata;
+    double elapsed;
+
+    if (idata == NULL || !idata->txdump_f)
+        return;
+
+    pcap_dump_close(idata->txdump);
+    pcap_close(idata->txdumppfd);
+    idata->txdump_f = FALSE;
+
+    elapsed = (idata->txlast.tv_sec - idata->txstart.tv_sec) + (idata->txlast.tv_usec - idata->txstart.tv_usec) / 1e6;
+
+    printf("Generated %llu frames (%llu bytes) in %.3f seconds", idata->txframes, idata->txbytes, elapsed);
+
+    if (idata->txframes > 1 && elapsed > 0)
+        printf(": %.0f pps, %.1f ns/packet\n", (idata->txframes - 1) / elapsed, elapsed * 1e9 / (idata->txframes - 1));
+    else
+        puts("");
+
+    fflush(stdout);
+}
+
+/*
+ * Handler for the INT and TERM signals, when frames are written to a savefile.
+ *
+ * The next calls to send_frame() fail, and the tool is expected to stop (see tx_dump_stopped()). A second signal
+ * terminates the tool right away.
+ */
+
+void sig_tx_dump(int num) {
+    txdump_stop = TRUE;
+    signal(num, SIG_DFL);
+}
+
+/*
+ * Function: tx_dump_stopped()
+ *
+ * Tells whether send_frame() failed because the tool was interrupted while writing frames to a savefile, rather than
+ * because of an error. The tool should then exit normally: the savefile is closed by close_tx_dump().
+ */
+
+int tx_dump_stopped(void) {
+    return (txdump_stop ? TRUE : FALSE);
+}
+
+/*
+ * Function: open_rx_replay()
+ *
+ * Opens the savefile specified in idata->rxreplayfile in place of the capture handle of the interface, such that the
+ * response-processing code of a tool can be profiled without a live network. read_frame() returns PCAP_ERROR_BREAK at
+ * the end of the savefile, and the tool is expected to end its loop. The number of frames processed per second is
+ * printed when the tool exits.
+ */
+
+int open_rx_replay(struct iface_data *idata, char *errbuf) {
+    if ((idata->pfd = pcap_open_offline(idata->rxreplayfile, errbuf)) == NULL)
+        return (FAILURE);
 
-                idata->ip6_global = cif->ip6_global;
-                if ((idata->ip6_global).nprefix)
-                    idata->ip6_global_flag = TRUE;
+    idata->rxframes = 0;
+    idata->rxbytes = 0;
+    idata->rxreplay_f = TRUE;
+    rxreplay_idata = idata;
 
-                /*
-                   Since destination is a link-local address, use a link-local address as IPv6 Source Address
-                   if available.
-                 */
-                if (idata->ip6_local_flag == TRUE) {
-                    idata->srcaddr = (cif->ip6_local.prefix[0])->ip6;
-                    idata->srcaddr_f = ADDR_AUTO;
-#ifdef DEBUG
-                    puts("DEBUG: END sel_src_addr() (SUCCESS)");
-#endif
-                    return (SUCCESS);
-                }
-                else if (idata->ip6_global_flag == TRUE) {
-                    idata->srcaddr = (cif->ip6_local.prefix[0])->ip6;
-                    idata->srcaddr_f = ADDR_AUTO;
-#ifdef DEBUG
-                    puts("DEBUG: END sel_src_addr() (SUCCESS)");
-#endif
-                    return (SUCCESS);
-                }
-            }
-        }
+    if (atexit(close_rx_replay) != 0) {
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "Error while registering exit handler");
+        return (FAILURE);
     }
-    else {
-#ifdef DEBUG
-        puts("DEBUG: Destination is NOT link-local");
-#endif
-        /*
-           If the destination address is not a link-local address, then:
 
-           1) If the interface has been specified, we select an IPv6 address assigned to that interface
-              (prioritizing "global" addresses)
+    return (SUCCESS);
+}
 
-           2) If an interface has not been specified, we select the longest-matching address for that
-              destination
-         */
-        if (idata->iface_f) {
-#ifdef DEBUG
-            puts("DEBUG: Interface was specified");
-#endif
-            if ((cif = find_iface_by_index(&(idata->iflist), idata->ifindex)) == NULL) {
-#ifdef DEBUG
-                puts("DEBUG: Did not find interface in local data");
-                puts("DEBUG: END sel_src_addr() (FAILURE)");
-#endif
-                return (FAILURE);
-            }
-            else {
-                idata->ether = cif->ether;
-                idata->ether_flag = cif->ether_f;
-                idata->flags = cif->flags;
+/*
+ * Function: close_rx_replay()
+ *
+ * Prints the statistics of the savefile replayed with open_rx_replay() (registered with atexit())
+ */
 
-                idata->ip6_global = cif->ip6_global;
-                if (cif->ip6_global.nprefix) {
-                    idata->ip6_global_flag = TRUE;
-                }
+void close_rx_replay(void) {
+    struct iface_data *idata = rxreplay_idata;
+    struct timeval now;
+    double elapsed;
 
-                if ((cif->ip6_local).nprefix) {
-                    idata->ip6_local = (cif->ip6_local).prefix[0]->ip6;
-                    idata->ip6_local_flag = TRUE;
-                }
+    if (idata == NULL || !idata->rxreplay_f)
+        return;
 
-                if (idata->ip6_global_flag) {
-                    /* XXX This should be replaced with "find the longest match for this list */
-                    idata->srcaddr = (idata->ip6_global).prefix[0]->ip6;
-                    idata->srcaddr_f = ADDR_AUTO;
-#ifdef DEBUG
-                    puts("DEBUG: END sel_src_addr() Used global address (SUCCESS)");
-#endif
-                    return (SUCCESS);
-                }
-                else if (idata->ip6_local_flag) {
-                    idata->srcaddr = idata->ip6_local;
-                    idata->srcaddr_f = ADDR_AUTO;
-#ifdef DEBUG
-                    puts("DEBUG: END sel_src_addr() Used local address (SUCCESS)");
-#endif
-                    return (SUCCESS);
-                }
-                else {
-#ifdef DEBUG
-                    puts("DEBUG: END sel_src_addr() Have no IPv6 addresses (FAILURE)");
-#endif
-                    return (FAILURE);
-                }
-            }
-        }
-        else {
-#ifdef DEBUG
-            puts("DEBUG: Interface was not specified");
-#endif
-            if ((cif = find_matching_address(idata, &(idata->iflist), &(idata->dstaddr), &match)) != NULL) {
-                idata->srcaddr = match;
-                idata->srcaddr_f = ADDR_AUTO;
-                strncpy(idata->iface, cif->iface, IFACE_LENGTH);
-                idata->iface[IFACE_LENGTH - 1] = 0;
-                idata->ifindex = cif->ifindex;
-                idata->ifindex_f = TRUE;
-                idata->flags = cif->flags;
+    gettimeofday(&now, NULL);
+    idata->rxreplay_f = FALSE;
 
-#ifdef DEBUG
-                puts("DEBUG: Found a matching address");
-                print_ipv6_address("DEBUG: Src addr: ", &(idata->srcaddr));
-                printf("DEBUG: Interface name: %s, Index: %d\n", idata->iface, idata->ifindex);
-#endif
+    if (idata->rxframes == 0)
+        elapsed = 0;
+    else
+        elapsed = (now.tv_sec - idata->rxstart.tv_sec) + (now.tv_usec - idata->rxstart.tv_usec) / 1e6;
 
-                /*
-                   We know check whether the selected address belongs to the outgoing
-                   interface -- otherwise packets might be filtered
-                 */
+    printf("Processed %llu frames (%llu bytes) in %.3f seconds", idata->rxframes, idata->rxbytes, elapsed);
 
-                if (sel_next_hop(idata) == SUCCESS) {
-#ifdef DEBUG
-                    puts("DEBUG: sel_next_hop() suceeded");
-#endif
+    if (idata->rxframes > 0 && elapsed > 0)
+        printf(": %.0f pps, %.1f ns/packet\n", idata->rxframes / elapsed, elapsed * 1e9 / idata->rxframes);
+    else
+        puts("");
 
-                    if ((nhif = find_iface_by_index(&(idata->iflist), idata->nhifindex)) == NULL) {
-                        return (FAILURE);
-                    }
+    fflush(stdout);
+}
 
-                    if ((nhif->flags & IFACE_LOOPBACK) ||
-                        is_ip6_in_iface_entry(&(idata->iflist), idata->nhifindex, &(idata->srcaddr)) == TRUE) {
-#ifdef DEBUG
-                        puts("DEBUG: Selected address was in outgoing interface");
-#endif
-                        if ((cif->ip6_local).nprefix) {
-                            idata->ip6_local = (cif->ip6_local).prefix[0]->ip6;
-                            idata->ip6_local_flag = TRUE;
-                        }
+/*
+ * Function: read_frame()
+ *
+ * Reads the next frame from the capture handle of an interface (see pcap_next_ex()). When a savefile is being
+ * replayed (see open_rx_replay()), the frames are accounted for, and PCAP_ERROR_BREAK is returned at the end of the
+ * savefile.
+ */
 
-                        idata->ip6_global = cif->ip6_global;
-                        if ((idata->ip6_global).nprefix)
-                            idata->ip6_global_flag = TRUE;
+int read_frame(struct iface_data *idata, struct pcap_pkthdr **pkthdr, const u_char **pktdata) {
+    int r;
 
-                        idata->ether = cif->ether;
-                        idata->ether_flag = cif->ether_f;
-                        idata->srcaddr_f = ADDR_AUTO;
+    r = pcap_next_ex(idata->pfd, pkthdr, pktdata);
 
-#ifdef DEBUG
-                        print_ipv6_address("DEBUG: Src addr: ", &(idata->srcaddr));
-                        puts("DEBUG: END sel_src_addr() (SUCCESS)");
-#endif
-                        return (SUCCESS);
-                    }
-                    else {
-#ifdef DEBUG
-                        puts("DEBUG: Selected address was NOT in outgoing interface");
-#endif
-                        /*
-                           If the seleted address doesn't correspond to the outgoing interface, throw away
-                           the previously-selected IPv6 Address, and select one that is assigned to the
-                           outgoing interface.
-                         */
-                        if ((cif = find_iface_by_index(&(idata->iflist), idata->nhifindex)) == NULL) {
-#ifdef DEBUG
-                            puts("DEBUG: END Did not find interface in local data");
-                            puts("DEBUG: END sel_src_addr() (FAILURE)");
-#endif
-                            return (FAILURE);
-                        }
-                        else {
-#ifdef DEBUG
-                            puts("DEBUG: Copying data from output interface into idata");
-#endif
-                            idata->ether = cif->ether;
-                            idata->ether_flag = cif->ether_f;
-                            idata->ifindex = idata->nhifindex;
-                            idata->flags = cif->flags;
-                            strncpy(idata->iface, idata->nhiface, IFACE_LENGTH);
-                            idata->iface[IFACE_LENGTH - 1] = 0;
+    if (idata->metrics != NULL) {
+        if (r == 1) {
+            idata->metrics->rxpackets++;
+            idata->metrics->rxbytes += (*pkthdr)->caplen;
+        }
 
-                            if ((cif->ip6_local).nprefix) {
-                                idata->ip6_local = (cif->ip6_local).prefix[0]->ip6;
-                                idata->ip6_local_flag = TRUE;
-                            }
+        check_metrics(idata->metrics);
+    }
 
-                            idata->ip6_global = cif->ip6_global;
-                            if ((idata->ip6_global).nprefix)
-                                idata->ip6_global_flag = TRUE;
+    if (idata->rxreplay_f) {
+        if (r == 1) {
+            if (idata->rxframes == 0)
+                gettimeofday(&(idata->rxstart), NULL);
 
-                            if (idata->ip6_global_flag == TRUE) {
-                                idata->srcaddr = (cif->ip6_global.prefix[0])->ip6;
-                                idata->srcaddr_f = ADDR_AUTO;
-#ifdef DEBUG
-                                puts("DEBUG: Used global src addr for global dst addr");
-                                print_ipv6_address("DEBUG: Src addr: ", &(idata->srcaddr));
-                                puts("DEBUG: END sel_src_addr() (SUCCESS)");
-#endif
-                                return (SUCCESS);
-                            }
-                            else if (idata->ip6_local_flag) {
-                                idata->srcaddr = idata->ip6_local;
-                                idata->srcaddr_f = ADDR_AUTO;
-#ifdef DEBUG
-                                puts("DEBUG: Used local src addr for global dst addr");
-                                print_ipv6_address("DEBUG: Src addr: ", &(idata->srcaddr));
-                                puts("DEBUG: END sel_src_addr() (SUCCESS)");
-#endif
-                                return (SUCCESS);
-                            }
-                        }
-                    }
-                }
-            }
+            idata->rxframes++;
+            idata->rxbytes += (*pkthdr)->caplen;
         }
     }
 
-#ifdef DEBUG
-    puts("DEBUG: END sel_src_addr() (FAILURE)");
-#endif
-    return (FAILURE);
+    return (r);
 }
 
 /*
- * Function: load_dst_and_pcap()
+ * Function: clone_iface_data()
  *
- * Finds the Sorurce Address, Next-Hop, and outgoing interface for a given Destination Address
+ * Allocates and initializes the iface_data for an additional interface of a tool, with the options that the user
+ * specified for the first one (addresses, timeouts, verbosity). The capture handle, the link-layer addresses and
+ * the next hop of the interface are learned when the caller runs load_dst_and_pcap() on it.
  */
-int load_dst_and_pcap(struct iface_data *idata, unsigned int mode) {
-    struct iface_entry *cif, *rif;
-    struct in6_addr randprefix, loopback;
-    unsigned char randpreflen;
-    char errbuf[PCAP_ERRBUF_SIZE];
 
-    if (mode != LOAD_PCAP_ONLY &&
-        (IN6_IS_ADDR_LINKLOCAL(&(idata->dstaddr)) || IN6_IS_ADDR_MC_LINKLOCAL(&(idata->dstaddr)))) {
-        /* Special case where the Destination Address is a link-local address */
-        if (!idata->iface_f) {
-            puts("Need to specify an interface ('-i' option) when Destination Address is link-local");
-            return (FAILURE);
-        }
+struct iface_data *clone_iface_data(const struct iface_data *idata, const char *iface) {
+    struct iface_data *new;
+
+    if ((new = malloc(sizeof(struct iface_data))) == NULL)
+        return (NULL);
+
+    if (init_iface_data(new) == FAILURE) {
+        free(new);
+        return (NULL);
+    }
+
+    strncpy(new->iface, iface, IFACE_LENGTH);
+    new->iface[IFACE_LENGTH - 1] = 0;
+    new->iface_f = TRUE;
+
+    new->hsrcaddr = idata->hsrcaddr;
+    new->hsrcaddr_f = idata->hsrcaddr_f;
+    new->hdstaddr = idata->hdstaddr;
+    new->hdstaddr_f = idata->hdstaddr_f;
+    new->srcaddr = idata->srcaddr;
+    new->srcaddr_f = idata->srcaddr_f;
+    new->srcpreflen = idata->srcpreflen;
+    new->srcprefix_f = idata->srcprefix_f;
+    new->dstaddr = idata->dstaddr;
+    new->dstaddr_f = idata->dstaddr_f;
+    new->local_retrans = idata->local_retrans;
+    new->local_timeout = idata->local_timeout;
+    new->verbose_f = idata->verbose_f;
+    new->listen_f = idata->listen_f;
+    new->fragh_f = idata->fragh_f;
+    return (new);
+}
+
+/*
+ * Function: add_iface_set()
+ *
+ * Adds an interface to an interface set (a zeroed iface_set is empty). Once a set has more than one member, the
+ * output of the tool is tagged with the name of the interface.
+ */
+
+int add_iface_set(struct iface_set *set, struct iface_data *idata) {
+    unsigned int i;
+
+    if (set->niface >= MAX_IFACE_SET)
+        return (FAILURE);
+
+    if (set->niface == 0 && init_event_loop(&(set->loop), -1, 1) == FAILURE)
+        return (FAILURE);
+
+    set->iface[set->niface] = idata;
+    set->niface++;
+
+    for (i = 0; i < set->niface; i++)
+        set->iface[i]->ifset_f = (set->niface > 1);
+
+    return (SUCCESS);
+}
+
+/*
+ * Function: wait_iface_set()
+ *
+ * Waits (with the event loop of the set) until a frame can be read from any of the interfaces of a set, or until the
+ * timeout expires (NULL means no timeout). Returns 1 if a frame may be read, 0 on timeout, or -1 on error.
+ */
+
+int wait_iface_set(struct iface_set *set, struct timeval *timeout) {
+    unsigned int i;
+
+    /* The capture descriptors are only known once the handles have been opened (see load_dst_and_pcap()) */
+    set->loop.nfd = 0;
+
+    for (i = 0; i < set->niface; i++) {
+        if (set->iface[i]->fd >= 0 && add_event_fd(&(set->loop), set->iface[i]->fd) == FAILURE)
+            return (-1);
+    }
+
+    if (timeout != NULL)
+        set_event_timer(&(set->loop), 0, timeout->tv_sec * 1000000 + timeout->tv_usec);
+    else
+        cancel_event_timer(&(set->loop), 0);
+
+    if (wait_event_loop(&(set->loop)) == FAILURE)
+        return (-1);
 
-        if (!idata->ifindex_f) {
-            idata->ifindex = if_nametoindex(idata->iface);
-            idata->ifindex_f = TRUE;
-        }
+    return (expired_event_timer(&(set->loop), NULL) ? 0 : 1);
+}
 
-        idata->nhifindex = idata->ifindex;
-        idata->nhifindex_f = TRUE;
+/*
+ * Function: read_iface_set()
+ *
+ * Reads the next frame from an interface set (see read_frame()). The interfaces are tried in round-robin order,
+ * such that a busy interface cannot starve the others. On return, "idata" points to the interface that the frame
+ * was read from. Returns 1 if a frame was read, 0 if none was available, -1 on error, or PCAP_ERROR_BREAK at the end
+ * of a replayed savefile.
+ */
 
-        if (get_if_addrs(idata) == -1) {
-            if (idata->verbose_f) {
-                puts("Error while obtaining local interface data");
-            }
+int read_iface_set(struct iface_set *set, struct iface_data **idata, struct pcap_pkthdr **pkthdr,
+                   const u_char **pktdata) {
+    unsigned int i, n;
+    int r;
 
-            return (FAILURE);
+    for (n = 0; n < set->niface; n++) {
+        i = (set->next + n) % set->niface;
+        *idata = set->iface[i];
+
+        if ((r = read_frame(*idata, pkthdr, pktdata)) == -1 || r == PCAP_ERROR_BREAK)
+            return (r);
+
+        if (r == 1 && *pktdata != NULL) {
+            set->next = (i + 1) % set->niface;
+            return (1);
         }
     }
-    else if (mode != LOAD_PCAP_ONLY) {
-        if (idata->srcprefix_f) {
-            randprefix = idata->srcaddr;
-            randpreflen = idata->srcpreflen;
-            randomize_ipv6_addr(&(idata->srcaddr), &randprefix, randpreflen);
-            idata->srcaddr_f = 1;
-        }
 
-        if (get_local_addrs(idata) == FAILURE) {
-            if (idata->verbose_f)
-                puts("Error while obtaining local addresses");
+    return (0);
+}
 
-            return (FAILURE);
-        }
+/*
+ * Function: print_pcap_stats()
+ *
+ * Prints the number of packets received and dropped by the capture path of an interface
+ */
 
-        if (!idata->srcaddr_f) {
-#ifdef DEBUG
-            puts("DEBUG: Has not specified source address");
-#endif
+int print_pcap_stats(struct iface_data *idata) {
+    struct pcap_stat stats;
 
-            /*
-               If no source address or prefix have been specified, then we need to automatically learn our IPv6
-               address. This is our appraoch:
+    if (idata->pfd == NULL || pcap_stats(idata->pfd, &stats) == -1) {
+        if (idata->verbose_f > 1)
+            puts("Error while obtaining capture statistics");
 
-               * Firstly, assume that our host has IPv6 connectivity:
-                    + If an interface has been specified, select an IPv6 address from one of the configures addresses
-                          of such interface.
+        return (FAILURE);
+    }
 
-                    * If an interface has not been specified, select a source address taking into consideration
-                      all configured addresses.
+    printf("Capture statistics: %u packets received, %u dropped by the kernel, %u dropped by the interface\n",
+           stats.ps_recv, stats.ps_drop, stats.ps_ifdrop);
 
-               * If that doesn't succeed, try sending RAs
+    return (SUCCESS);
+}
 
-             */
+/*
+ * Function: init_metrics()
+ *
+ * Initializes the runtime metrics of a tool. If "interval" is not zero, a one-line summary is printed (on the
+ * standard error) every "interval" seconds, from send_frame()/read_frame(). When the tool exits, the metrics are
+ * printed in JSON format (see print_metrics_json()), so "m" must not be an automatic variable. Interfaces are
+ * accounted once attached with attach_metrics().
+ */
 
-            if (sel_src_addr(idata) == SUCCESS) {
-                if (sel_next_hop(idata) == SUCCESS) {
-                    /* This is actually redundant (nh_f is already set by sel_next_hop() */
-#ifdef DEBUG
-                    puts("DEBUG: sel_next_hop() succeeded");
-#endif
-                    idata->nh_f = TRUE;
-                }
-                else {
-#ifdef DEBUG
-                    puts("DEBUG: sel_next_hop() failed");
-#endif
-                }
+int init_metrics(struct metrics *m, const char *tool, unsigned int interval) {
+    memset(m, 0, sizeof(struct metrics));
+    m->tool = tool;
+    m->interval = interval;
+    gettimeofday(&(m->start), NULL);
+    m->last = m->start;
+    m->next = m->start.tv_sec + interval;
+    m->reportfd = -1;
+    exit_metrics = m;
+
+    if (atexit(close_metrics) != 0 || signal(SIGINT, sig_metrics) == SIG_ERR ||
+        signal(SIGTERM, sig_metrics) == SIG_ERR) {
+        return (FAILURE);
+    }
 
-#ifdef DEBUG
-                printf("DEBUG: nhifindex_f: %s\tnhaddr_f: %s", (idata->nhifindex_f) ? "TRUE" : "FALSE",
-                       (idata->nhaddr_f) ? "TRUE" : "FALSE");
+    return (SUCCESS);
+}
 
-                if (idata->nhifindex_f)
-                    printf("\tnhifindex: %d ", idata->nhifindex);
+/*
+ * Function: attach_metrics()
+ *
+ * Makes send_frame() and read_frame() account the frames of an interface in the specified metrics
+ */
 
-                if (idata->nhaddr_f)
-                    print_ipv6_address("\tnhaddr: ", &(idata->nhaddr));
-                else
-                    puts("");
-#endif
-            }
+int attach_metrics(struct metrics *m, struct iface_data *idata) {
+    if (m->niface >= MAX_IFACE_SET)
+        return (FAILURE);
 
-            if (idata->nh_f == FALSE) {
-#ifdef DEBUG
-                puts("DEBUG: Automatic address selection failed");
-#endif
-                /* XXX Should really free the memory allocated by the other functions, since they are of no further use
-                 */
-                idata->ip6_local_flag = FALSE;
-                idata->ip6_global.nprefix = 0;
-                idata->ip6_global_flag = FALSE;
+    m->iface[m->niface] = idata;
+    m->niface++;
+    idata->metrics = m;
+    return (SUCCESS);
+}
 
-                if (!idata->iface_f) {
-#ifdef DEBUG
-                    puts("DEBUG: No automatic address selection, and no specified interface");
-#endif
-                    if (idata->verbose_f)
-                        puts("Could not determine next hop address");
+/*
+ * Function: redirect_metrics()
+ *
+ * Makes a worker process report its metrics to its parent through a pipe, rather than printing them. The periodic
+ * and final reports are written as a raw struct metrics (with a single write(), such that the reports of different
+ * workers are not mixed), and can be added up with sum_metrics().
+ */
 
-                    return (FAILURE);
-                }
+void redirect_metrics(struct metrics *m, int fd, unsigned int reporter) {
+    m->reportfd = fd;
+    m->reporter = reporter;
+}
 
-                /* This sends an RA, populates the local addresses and prefixes, and the local router */
-                if (sel_next_hop_ra(idata) == -1) {
-#ifdef DEBUG
-                    puts("DEBUG: sel_next_hop_ra() failed");
-#endif
-                    puts("Could not learn a local router");
-                    return (FAILURE);
-                }
+/*
+ * Function: sum_metrics()
+ *
+ * Sets the counters of the metrics to the sum of "n" reports received from worker processes (see redirect_metrics())
+ */
 
-                if (sel_src_addr_ra(idata, &(idata->dstaddr)) == FAILURE || !idata->ether_flag ||
-                    !idata->ip6_global_flag || !idata->ip6_local_flag) {
-#ifdef DEBUG
-                    puts("DEBUG: sel_src_addr_ra() failed");
-#endif
-                    puts("Could not obtain local address **");
-                    return (FAILURE);
-                }
+void sum_metrics(struct metrics *m, const struct metrics *reports, unsigned int n) {
+    unsigned int i, j;
 
-                idata->ifindex = if_nametoindex(idata->iface);
-                idata->ifindex_f = TRUE;
-            }
-        }
-        else {
-#ifdef DEBUG
-            puts("DEBUG: Has specified source address");
-#endif
+    m->txpackets = m->txbytes = m->rxpackets = m->rxbytes = 0;
+    m->accepted = m->filtered = m->nlatency = m->errors = m->drops = 0;
+    m->latencysum = m->latencymax = 0;
+    memset(m->latency, 0, sizeof(m->latency));
 
-            if (sel_next_hop(idata) == SUCCESS) {
-#ifdef DEBUG
-                puts("DEBUG: sel_next_hop() succeeded");
-#endif
-                idata->ifindex = idata->nhifindex;
-                idata->nh_f = TRUE;
-                strncpy(idata->iface, idata->nhiface, IFACE_LENGTH);
-                idata->iface[IFACE_LENGTH - 1] = 0;
+    for (i = 0; i < n; i++) {
+        m->txpackets += reports[i].txpackets;
+        m->txbytes += reports[i].txbytes;
+        m->rxpackets += reports[i].rxpackets;
+        m->rxbytes += reports[i].rxbytes;
+        m->accepted += reports[i].accepted;
+        m->filtered += reports[i].filtered;
+        m->errors += reports[i].errors;
+        m->drops += reports[i].drops;
 
-                if ((cif = find_iface_by_index(&(idata->iflist), idata->ifindex)) != NULL) {
-                    idata->ether = cif->ether;
-                    idata->ether_flag = cif->ether_f;
-                }
-            }
-            else {
-#ifdef DEBUG
-                puts("DEBUG: sel_next_hop() DID NOT succeed, Now trying RAs");
-#endif
-                /* This sends an RA, populates the local addresses and prefixes, and the local router */
-                if (sel_next_hop_ra(idata) == -1) {
-#ifdef DEBUG
-                    puts("DEBUG: ssel_next_hop_ra() failed");
-#endif
+        for (j = 0; j < METRICS_LATENCY_BUCKETS; j++)
+            m->latency[j] += reports[i].latency[j];
 
-                    puts("Could not learn a local router");
-                    return (FAILURE);
-                }
-            }
-        }
+        m->nlatency += reports[i].nlatency;
+        m->latencysum += reports[i].latencysum;
 
-        /*
-           If a next hop was found, we employ whatever was found as the output interface, because we need to open
-           a pcap_t for that interface
-         */
-        if (idata->nhifindex_f) {
-#ifdef DEBUG
-            puts("sel_next eligio nh_index");
-#endif
-            idata->ifindex = idata->nhifindex;
+        if (reports[i].latencymax > m->latencymax)
+            m->latencymax = reports[i].latencymax;
+    }
+}
 
-            if ((cif = find_iface_by_index(&(idata->iflist), idata->ifindex)) == NULL) {
-                if (idata->verbose_f) {
-                    puts("Could not find selected interface in local data");
-                }
-#ifdef DEBUG
-                puts("No la interfaz que buscaba");
-#endif
-                return (FAILURE);
-            }
+/*
+ * Function: record_latency()
+ *
+ * Accounts the time elapsed between a probe and its response in the latency histogram of the metrics
+ */
 
-            idata->flags = cif->flags;
+void record_latency(struct metrics *m, const struct timeval *sent, const struct timeval *received) {
+    double usecs;
+    unsigned int i;
 
-            if (if_indextoname(idata->ifindex, idata->iface) == NULL) {
-                if (idata->verbose_f)
-                    puts("Error calling if_indextoname() from sel_next_hop()");
+    usecs = (received->tv_sec - sent->tv_sec) * 1e6 + (received->tv_usec - sent->tv_usec);
 
-#ifdef DEBUG
-                puts("DEBUG: if_indextoname() failed");
-#endif
-                return (FAILURE);
-            }
-        }
+    if (usecs < 0)
+        usecs = 0;
 
-#ifdef DEBUG
-        puts("Voy a chequear si es loopback");
-#endif
-        if (!(idata->flags & IFACE_LOOPBACK)) {
-#ifdef DEBUG
-            puts("COmprobe que era distinta de loopback");
-#endif
-            if (is_ip6_in_prefix_list(&(idata->dstaddr), &(idata->ip6_global)) ||
-                is_eq_in6_addr(&(idata->dstaddr), &(idata->ip6_local))) {
+    for (i = 0; i < (METRICS_LATENCY_BUCKETS - 1) && usecs >= (double)(1UL << i); i++)
+        ;
 
-#ifdef DEBUG
-                puts("ENcontre la dst en mi lista de direcciones");
-#endif
-                /*
-                   Since we're sending a packet on the same interface to which the destination address belongs,
-                   the packet should actually be sent to the loopback interface
-                 */
-                if (inet_pton(AF_INET6, LOOPBACK_ADDR, &loopback) <= 0) {
-                    if (idata->verbose_f)
-                        puts("inet_pton(): Error converting loopback address from presentation to network format");
+    m->latency[i]++;
+    m->nlatency++;
+    m->latencysum += usecs / 1000;
 
-#ifdef DEBUG
-                    puts("inet_pton dio error");
-#endif
-                    return (FAILURE);
-                }
+    if (usecs / 1000 > m->latencymax)
+        m->latencymax = usecs / 1000;
+}
 
-                if ((rif = find_iface_by_addr(&(idata->iflist), &loopback)) == NULL) {
-#ifdef DEBUG
-                    puts("No encontre loopback");
-#endif
-                    if (idata->verbose_f)
-                        puts("Could not find loopback interface in local data");
+/*
+ * Function: metrics_latency_pct()
+ *
+ * Returns the upper bound (in milliseconds) of the histogram bucket that contains the specified percentile of the
+ * response latencies
+ */
 
-                    return (FAILURE);
-                }
-                else {
-#ifdef DEBUG
-                    puts("Encontre loopback y voy a sobreeescribir la info de destino");
-#endif
-                    idata->flags = rif->flags;
-                    idata->ifindex = rif->ifindex;
-                    strncpy(idata->iface, rif->iface, IFACE_LENGTH);
-                    idata->iface[IFACE_LENGTH - 1] = 0;
-                }
-            }
-        }
+static double metrics_latency_pct(struct metrics *m, double pct) {
+    unsigned long long count = 0;
+    unsigned int i;
+
+    for (i = 0; i < METRICS_LATENCY_BUCKETS; i++) {
+        count += m->latency[i];
+
+        if (count >= m->nlatency * pct)
+            break;
     }
-    else {
-        /* LOAD_PCAP_ONLY */
 
-        if (!idata->iface_f) {
-            if (idata->verbose_f) {
-                puts("Error opening pcap socket because interface was not specified");
-            }
+    return ((double)(1UL << i) / 1000);
+}
 
-            return (FAILURE);
-        }
+/*
+ * Function: metrics_iface_counters()
+ *
+ * Obtains the frames that failed to be sent and those dropped by the capture path, for all the attached interfaces
+ */
 
-        idata->ifindex = if_nametoindex(idata->iface);
-        idata->ifindex_f = TRUE;
+static void metrics_iface_counters(struct metrics *m, unsigned long long *errors, unsigned long long *drops) {
+    struct pcap_stat stats;
+    unsigned int i;
 
-        if (get_if_addrs(idata) == -1) {
-            if (idata->verbose_f) {
-                puts("Error while obtaining local interface data");
-            }
+    *errors = m->errors;
+    *drops = m->drops;
 
-            return (FAILURE);
-        }
+    for (i = 0; i < m->niface; i++) {
+        *errors += m->iface[i]->write_errors;
+
+        /* Savefiles have no capture statistics */
+        if (m->iface[i]->pfd != NULL && !m->iface[i]->rxreplay_f && pcap_stats(m->iface[i]->pfd, &stats) != -1)
+            *drops += stats.ps_drop + stats.ps_ifdrop;
     }
+}
 
-    if (idata->nhifindex_f && !idata->nhaddr_f)
-        idata->nhaddr = idata->dstaddr;
+/*
+ * Function: send_metrics()
+ *
+ * Reports the metrics of a worker process to its parent (see redirect_metrics())
+ */
 
-#ifdef DEBUG
-    if (idata->nhaddr_f)
-        print_ipv6_address("DEBUG: load_dst_(): Nex Hop: ", &(idata->nhaddr));
-    else
-        puts("DEBUG: load_dst() Next Hop address not set");
+static void send_metrics(struct metrics *m) {
+    struct metrics report;
 
-    printf("DEBUG: Output interface: %s (%d)\n", idata->iface, idata->ifindex);
-#endif
+    report = *m;
+    metrics_iface_counters(m, &(report.errors), &(report.drops));
 
-    if (!(idata->hsrcaddr_f)) {
-        if (idata->ether_flag)
-            idata->hsrcaddr = idata->ether;
-        else {
-            randomize_ether_addr(&(idata->hsrcaddr));
-        }
-    }
+    while (write(m->reportfd, &report, sizeof(report)) == -1 && errno == EINTR)
+        ;
 
-    if (!idata->ip6_local_flag) {
-        ether_to_ipv6_linklocal(&idata->ether, &idata->ip6_local);
-    }
+    m->next = time(NULL) + m->interval;
+}
 
-    if ((idata->pfd = pcap_open_live(idata->iface, PCAP_SNAP_LEN, PCAP_PROMISC, PCAP_TIMEOUT, errbuf)) == NULL) {
-        printf("pcap_open_live(%s): %s\n", idata->iface, errbuf);
-        return (FAILURE);
-    }
+/*
+ * Function: check_metrics()
+ *
+ * Prints (or reports, see redirect_metrics()) the periodic summary of the metrics when it is due, and makes the tool
+ * exit when it has been interrupted (such that the final metrics are printed from the exit handler rather than from
+ * the signal handler)
+ */
 
-    if (pcap_setnonblock(idata->pfd, 1, errbuf) == -1) {
-        printf("pcap_setnonblock(): %s\n", errbuf);
-        return (FAILURE);
+void check_metrics(struct metrics *m) {
+    if (metrics_stop)
+        exit(EXIT_SUCCESS);
+
+    if (m->interval && time(NULL) >= m->next) {
+        if (m->reportfd != -1)
+            send_metrics(m);
+        else
+            print_metrics(m);
     }
+}
 
-    if ((idata->fd = pcap_fileno(idata->pfd)) == -1) {
-        if (idata->verbose_f)
-            puts("Error obtaining descriptor number for pcap_t");
+/*
+ * Function: print_metrics()
+ *
+ * Prints a one-line summary of the metrics on the standard error, with the rates measured since the last summary
+ */
 
-        return (FAILURE);
-    }
+void print_metrics(struct metrics *m) {
+    struct timeval now;
+    unsigned long long errors, drops;
+    double elapsed, delta;
 
-    if ((idata->type = pcap_datalink(idata->pfd)) == DLT_EN10MB) {
-        idata->linkhsize = ETH_HLEN;
-        idata->mtu = ETH_DATA_LEN;
-    }
-    else if (idata->type == DLT_RAW) {
-        idata->linkhsize = 0;
-        idata->mtu = MIN_IPV6_MTU;
-        idata->flags |= IFACE_TUNNEL;
-    }
-#if defined(__OpenBSD__)
-    else if (idata->type == DLT_LOOP) {
-        idata->linkhsize = 4;
-        idata->mtu = MIN_IPV6_MTU;
-        idata->flags |= IFACE_TUNNEL;
-    }
-#elif defined(__linux__)
-    else if (idata->type == DLT_LINUX_SLL) {
-        idata->linkhsize = sizeof(struct sll_linux);
-        idata->mtu = MIN_IPV6_MTU;
-        idata->flags |= IFACE_TUNNEL;
-    }
-#endif
-    else if (idata->type == DLT_NULL) {
-        idata->linkhsize = 4;
-        idata->mtu = MIN_IPV6_MTU;
-        idata->flags |= IFACE_TUNNEL;
-    }
-    else {
-#ifdef DEBUG
-        puts("Estoy en load_dst() y voy a imprimir error");
-#endif
-        printf("Error: Interface %s is not of any supported type (type= %u)\n", idata->iface, idata->type);
-        return (FAILURE);
-    }
+    gettimeofday(&now, NULL);
+    metrics_iface_counters(m, &errors, &drops);
+    elapsed = time_diff_ms(&now, &(m->start)) / 1000;
+    delta = time_diff_ms(&now, &(m->last)) / 1000;
 
-    if (idata->fragh_f)
-        idata->max_packet_size = MAX_IPV6_PAYLOAD + MIN_IPV6_HLEN;
+    if (delta <= 0)
+        delta = 1e-6;
+
+    fprintf(stderr, "%s: %.1f s: tx %llu (%.0f pps), rx %llu (%.0f pps), %llu inject errors, %llu dropped, "
+                    "%llu accepted, %llu filtered",
+            m->tool, elapsed, m->txpackets, (m->txpackets - m->lasttx) / delta, m->rxpackets,
+            (m->rxpackets - m->lastrx) / delta, errors, drops, m->accepted, m->filtered);
+
+    if (m->nlatency)
+        fprintf(stderr, ", latency avg %.3f ms, p99 < %.3f ms\n", m->latencysum / m->nlatency,
+                metrics_latency_pct(m, 0.99));
     else
-        idata->max_packet_size = idata->mtu;
+        fputs("\n", stderr);
 
-    if (mode == LOAD_PCAP_ONLY)
-        return (SUCCESS);
+    m->last = now;
+    m->lasttx = m->txpackets;
+    m->lastrx = m->rxpackets;
+    m->next = now.tv_sec + m->interval;
+}
 
-    if (!(idata->flags & IFACE_TUNNEL) && !(idata->flags & IFACE_LOOPBACK)) {
-        if (!(idata->hdstaddr_f)) {
-            if (IN6_IS_ADDR_MULTICAST(&(idata->dstaddr))) {
-                idata->nhhaddr = ether_multicast(&(idata->dstaddr));
-            }
-            else {
-                if (ipv6_to_ether(idata->pfd, idata, &(idata->nhaddr), &(idata->nhhaddr)) != 1) {
-                    puts("Error while performing Neighbor Discovery for the Destination Address");
-                    return (FAILURE);
-                }
-            }
+/*
+ * Function: print_metrics_json()
+ *
+ * Prints the metrics as a single JSON object. The latency histogram lists, for each bucket, the upper bound of the
+ * bucket (in microseconds) and the number of responses in the bucket.
+ */
 
-            idata->hdstaddr = idata->nhhaddr;
-        }
-    }
+void print_metrics_json(struct metrics *m, FILE *fp) {
+    struct timeval now;
+    unsigned long long errors, drops;
+    double elapsed;
+    unsigned int i;
 
-    return (SUCCESS);
+    gettimeofday(&now, NULL);
+    metrics_iface_counters(m, &errors, &drops);
+    elapsed = time_diff_ms(&now, &(m->start)) / 1000;
+
+    fprintf(fp, "{\"tool\": \"%s\", \"pid\": %ld, \"elapsed\": %.3f, ", m->tool, (long)getpid(), elapsed);
+    fprintf(fp, "\"tx\": {\"packets\": %llu, \"bytes\": %llu, \"pps\": %.1f, \"errors\": %llu}, ", m->txpackets,
+            m->txbytes, (elapsed > 0) ? m->txpackets / elapsed : 0, errors);
+    fprintf(fp, "\"rx\": {\"packets\": %llu, \"bytes\": %llu, \"pps\": %.1f, \"dropped\": %llu}, ", m->rxpackets,
+            m->rxbytes, (elapsed > 0) ? m->rxpackets / elapsed : 0, drops);
+    fprintf(fp, "\"filter\": {\"accepted\": %llu, \"filtered\": %llu}, ", m->accepted, m->filtered);
+    fprintf(fp, "\"latency\": {\"samples\": %llu, \"avg_ms\": %.3f, \"max_ms\": %.3f, \"histogram_us\": [",
+            m->nlatency, (m->nlatency) ? m->latencysum / m->nlatency : 0, m->latencymax);
+
+    for (i = 0; i < METRICS_LATENCY_BUCKETS; i++)
+        fprintf(fp, "%s[%lu, %llu]", (i) ? ", " : "", 1UL << i, m->latency[i]);
+
+    fputs("]}}\n", fp);
+    fflush(fp);
+}
+
+/*
+ * Function: close_metrics()
+ *
+ * Prints the metrics initialized with init_metrics() in JSON format, on the standard error, or reports them to the
+ * parent process (registered with atexit())
+ */
+
+void close_metrics(void) {
+    if (exit_metrics == NULL)
+        return;
+
+    if (exit_metrics->reportfd != -1)
+        send_metrics(exit_metrics);
+    else
+        print_metrics_json(exit_metrics, stderr);
+
+    exit_metrics = NULL;
+}
+
+/*
+ * Handler for the INT and TERM signals, when runtime metrics are enabled.
+ *
+ * The tool exits on the next call to send_frame() or read_frame(). A second signal terminates the tool right away.
+ */
+
+void sig_metrics(int num) {
+    metrics_stop = TRUE;
+    signal(num, SIG_DFL);
 }
 
 /*
@@ -4199,7 +7388,7 @@ int read_ipv6_address(char *line, unsigned int len, struct in6_addr *iid) {
     /* NULL-terminate the ASCII-encoded IPv6 address */
     *ptr = 0;
 
-    if (inet_pton(AF_INET6, ipv6addr, iid) <= 0) {
+    if (ipv6_pton(ipv6addr, iid) == 0) {
         return (-1);
     }
 
@@ -4271,7 +7460,7 @@ int find_ipv6_router(pcap_t *pfd, struct ether_addr *hsrcaddr, struct in6_addr *
     struct ip6_hdr *pkt_ipv6;
     struct nd_router_advert *pkt_ra;
     unsigned char *pkt_end;
-    unsigned char *ptr, *prev_nh;
+    unsigned char *ptr, *p, *prev_nh;
     int r;
     int nw;
 
@@ -4282,9 +7471,9 @@ int find_ipv6_router(pcap_t *pfd, struct ether_addr *hsrcaddr, struct in6_addr *
     struct ip6_hdr *ipv6;
     struct nd_router_solicit *rs;
     struct nd_opt_slla *sllaopt;
-    volatile unsigned int tries = 0;
-    volatile unsigned int foundrouter = 0;
-    struct sigaction new_sig, old_sig;
+    struct event_loop loop;
+    unsigned int tries = 0;
+    unsigned int foundrouter = 0;
 
     rs_max_packet_size = ETH_DATA_LEN;
 
@@ -4356,44 +7545,43 @@ int find_ipv6_router(pcap_t *pfd, struct ether_addr *hsrcaddr, struct in6_addr *
     rs->nd_rs_cksum = 0;
     rs->nd_rs_cksum = in_chksum(v6buffer, rs, ptr - ((unsigned char *)rs), IPPROTO_ICMPV6);
 
-    /* We set the signal handler, and the anchor for siglongjump() */
-    canjump = 0;
-    memset(&new_sig, 0, sizeof(struct sigaction));
-    sigemptyset(&new_sig.sa_mask);
-    new_sig.sa_handler = &sig_alarm;
-
-    alarm(0);
-
-    if (sigaction(SIGALRM, &new_sig, &old_sig) == -1) {
-        puts("Error setting up 'Alarm' signal");
+    if (init_event_loop(&loop, pcap_fileno(pfd), 1) == FAILURE) {
+        puts("Error while initializing the event loop");
         return (-1);
     }
 
-    if (sigsetjmp(env, 1) != 0)
-        tries++;
-
-    canjump = 1;
-
     while (tries < 3 && !foundrouter) {
         if ((nw = pcap_inject(pfd, buffer, ptr - buffer)) == -1) {
             printf("pcap_inject(): %s\n", pcap_geterr(pfd));
+            free_event_loop(&loop);
             return (-1);
         }
 
         if (nw != (ptr - buffer)) {
             printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+            free_event_loop(&loop);
             return (-1);
         }
 
-        alarm(1);
+        set_event_timer(&loop, 0, 1000000);
+        tries++;
 
         while (!foundrouter) {
+            if (expired_event_timer(&loop, NULL))
+                break;
+
             if ((r = pcap_next_ex(pfd, &pkthdr, &pktdata)) == -1) {
                 printf("pcap_next_ex(): %s", pcap_geterr(pfd));
                 exit(EXIT_FAILURE);
             }
-            else if (r == 0 || pktdata == NULL) {
-                continue; /* Should never happen */
+            else if (r != 1 || pktdata == NULL) {
+                if (wait_event_loop(&loop) == FAILURE) {
+                    puts("Error while waiting for Router Advertisements");
+                    free_event_loop(&loop);
+                    return (-1);
+                }
+
+                continue;
             }
 
             pkt_ether = (struct ether_header *)pktdata;
@@ -4459,35 +7647,32 @@ int find_ipv6_router(pcap_t *pfd, struct ether_addr *hsrcaddr, struct in6_addr *
             if (in_chksum(pkt_ipv6, pkt_ra, pkt_end - (unsigned char *)pkt_ra, IPPROTO_ICMPV6) != 0)
                 continue;
 
-            ptr = (unsigned char *)pkt_ra + sizeof(struct nd_router_advert);
+            p = (unsigned char *)pkt_ra + sizeof(struct nd_router_advert);
 
             /* Process Router Advertisement options */
-            while ((ptr + sizeof(struct nd_opt_slla)) <= pkt_end && (*(ptr + 1) != 0)) {
-                if (*ptr == ND_OPT_SOURCE_LINKADDR) {
-                    if ((*(ptr + 1) * 8) != sizeof(struct nd_opt_tlla))
+            while ((p + sizeof(struct nd_opt_slla)) <= pkt_end && (*(p + 1) != 0)) {
+                if (*p == ND_OPT_SOURCE_LINKADDR) {
+                    if ((*(p + 1) * 8) != sizeof(struct nd_opt_tlla))
                         break;
 
                     /* Got a response, so we shouln't time out */
-                    alarm(0);
+                    cancel_event_timer(&loop, 0);
 
                     /* Save the link-layer address */
-                    *result_ether = *(struct ether_addr *)(ptr + 2);
+                    *result_ether = *(struct ether_addr *)(p + 2);
                     *result_ipv6 = pkt_ipv6->ip6_src;
                     foundrouter = 1;
                     break;
                 }
 
-                ptr = ptr + *(ptr + 1) * 8;
+                p = p + *(p + 1) * 8;
             } /* Processing options */
 
         } /* Processing packets */
 
     } /* Resending Router Solicitations */
 
-    if (sigaction(SIGALRM, &old_sig, NULL) == -1) {
-        puts("Error setting up 'Alarm' signal");
-        return (-1);
-    }
+    free_event_loop(&loop);
 
     if (foundrouter)
         return 0;
@@ -4532,6 +7717,190 @@ float time_diff_ms(struct timeval *t2, struct timeval *t1) {
     return (result);
 }
 
+/*
+ * Function: init_event_loop()
+ *
+ * Initializes an event loop that waits on the descriptor fd (typically that of the pcap handle, or -1 if
+ * there is none), with ntimers timers. Further descriptors can be added with add_event_fd().
+ */
+
+int init_event_loop(struct event_loop *loop, int fd, unsigned int ntimers) {
+    memset(loop, 0, sizeof(struct event_loop));
+
+    if (fd != -1 && add_event_fd(loop, fd) == FAILURE)
+        return (FAILURE);
+
+    if (ntimers == 0)
+        ntimers = 1;
+
+    if ((loop->deadline = malloc(sizeof(struct timeval) * ntimers)) == NULL)
+        return (FAILURE);
+
+    if ((loop->active = calloc(ntimers, sizeof(unsigned char))) == NULL) {
+        free(loop->deadline);
+        loop->deadline = NULL;
+        return (FAILURE);
+    }
+
+    loop->ntimers = ntimers;
+    return (SUCCESS);
+}
+
+/*
+ * Function: add_event_fd()
+ *
+ * Adds a descriptor to the set of descriptors that an event loop waits on
+ */
+
+int add_event_fd(struct event_loop *loop, int fd) {
+    if (fd < 0 || fd >= FD_SETSIZE || loop->nfd >= MAX_EVENT_FDS)
+        return (FAILURE);
+
+    loop->fd[loop->nfd] = fd;
+    loop->nfd++;
+    return (SUCCESS);
+}
+
+/*
+ * Function: free_event_loop()
+ *
+ * Releases the timers of an event loop
+ */
+
+void free_event_loop(struct event_loop *loop) {
+    free(loop->deadline);
+    free(loop->active);
+    loop->deadline = NULL;
+    loop->active = NULL;
+    loop->ntimers = 0;
+}
+
+/*
+ * Function: set_event_timer()
+ *
+ * (Re)arms timer "id" such that it expires "usecs" microseconds from now
+ */
+
+void set_event_timer(struct event_loop *loop, unsigned int id, unsigned long usecs) {
+    struct timeval *tv;
+
+    if (id >= loop->ntimers)
+        return;
+
+    tv = &(loop->deadline[id]);
+
+    if (gettimeofday(tv, NULL) == -1) {
+        tv->tv_sec = time(NULL);
+        tv->tv_usec = 0;
+    }
+
+    tv->tv_sec += usecs / 1000000;
+    tv->tv_usec += usecs % 1000000;
+
+    if (tv->tv_usec >= 1000000) {
+        tv->tv_sec++;
+        tv->tv_usec -= 1000000;
+    }
+
+    loop->active[id] = TRUE;
+}
+
+/*
+ * Function: cancel_event_timer()
+ *
+ * Disarms timer "id" (e.g., because the corresponding response has been received)
+ */
+
+void cancel_event_timer(struct event_loop *loop, unsigned int id) {
+    if (id < loop->ntimers)
+        loop->active[id] = FALSE;
+}
+
+/*
+ * Function: expired_event_timer()
+ *
+ * Checks whether any of the timers has expired. If so, the timer is disarmed, its index is stored in "id" (unless
+ * it is NULL), and TRUE is returned. Callers should loop on this function, since several timers may expire at once.
+ */
+
+int expired_event_timer(struct event_loop *loop, unsigned int *id) {
+    struct timeval now;
+    unsigned int i;
+
+    if (gettimeofday(&now, NULL) == -1)
+        return (FALSE);
+
+    for (i = 0; i < loop->ntimers; i++) {
+        if (!loop->active[i])
+            continue;
+
+        if (loop->deadline[i].tv_sec < now.tv_sec ||
+            (loop->deadline[i].tv_sec == now.tv_sec && loop->deadline[i].tv_usec <= now.tv_usec)) {
+            loop->active[i] = FALSE;
+
+            if (id != NULL)
+                *id = i;
+
+            return (TRUE);
+        }
+    }
+
+    return (FALSE);
+}
+
+/*
+ * Function: wait_event_loop()
+ *
+ * Blocks until any of the descriptors of the event loop becomes readable, or until the earliest armed timer expires.
+ * Pending events are then processed by the caller (with read_frame() and expired_event_timer()). As opposed to
+ * alarm(), timers have microsecond resolution, and any number of them can be outstanding at the same time.
+ */
+
+int wait_event_loop(struct event_loop *loop) {
+    struct timeval now, timeout, *next = NULL;
+    unsigned int i;
+    int maxfd = -1;
+    fd_set rset;
+
+    for (i = 0; i < loop->ntimers; i++) {
+        if (!loop->active[i])
+            continue;
+
+        if (next == NULL || loop->deadline[i].tv_sec < next->tv_sec ||
+            (loop->deadline[i].tv_sec == next->tv_sec && loop->deadline[i].tv_usec < next->tv_usec))
+            next = &(loop->deadline[i]);
+    }
+
+    if (next != NULL) {
+        if (gettimeofday(&now, NULL) == -1)
+            return (FAILURE);
+
+        if (next->tv_sec < now.tv_sec || (next->tv_sec == now.tv_sec && next->tv_usec <= now.tv_usec))
+            return (SUCCESS);
+
+        timeout = timeval_sub(next, &now);
+    }
+    else if (loop->nfd == 0) {
+        /* Nothing to wait for */
+        return (FAILURE);
+    }
+
+    FD_ZERO(&rset);
+
+    for (i = 0; i < loop->nfd; i++) {
+        FD_SET(loop->fd[i], &rset);
+
+        if (loop->fd[i] > maxfd)
+            maxfd = loop->fd[i];
+    }
+
+    /* Being interrupted by a signal is not an error: the caller simply checks for events again */
+    if (select(maxfd + 1, &rset, NULL, NULL, (next != NULL) ? &timeout : NULL) == -1 && errno != EINTR)
+        return (FAILURE);
+
+    return (SUCCESS);
+}
+
 /*
  * Function: dump_hex()
  *
@@ -61,7 +61,33 @@
 #define FRAG_BUFFER_SIZE (ETHER_HDR_LEN + MIN_IPV6_HLEN + MAX_IPV6_PAYLOAD)
 #define PACKET_BUFFER_SIZE FRAG_BUFFER_SIZE 
 
+/* Batched transmission of frames (see init_tx_batch()) */
+#define TX_BATCH_SIZE 64
+#define TX_FRAME_SIZE (ETHER_HDR_LEN + ETH_DATA_LEN)
+
+/*
+   Prefix tries (see add_to_prefix_trie()). Each node consumes PTRIE_STRIDE bits of the address, such that a lookup
+   visits at most 128 / PTRIE_STRIDE nodes, regardless of the number of prefixes
+ */
+#define PTRIE_STRIDE 4
+#define PTRIE_FANOUT (1 << PTRIE_STRIDE)
+#define PTRIE_INIT_NODES 64
+
+struct prefix_trie_node {
+    uint32_t child[PTRIE_FANOUT]; /* Index of the child node for each value of the next PTRIE_STRIDE bits (0: none) */
+    uint16_t match;               /* Children that are completely covered by a prefix */
+};
+
+struct prefix_trie {
+    struct prefix_trie_node *node; /* node[0] is the root */
+    unsigned int nnodes;
+    unsigned int maxnodes;
+    unsigned int nprefix;
+    unsigned char all_f; /* A ::/0 prefix has been added */
+};
+
 /* Filter Constants */
+#define MAX_FILTER_LINE_SIZE 250
 #define MAX_BLOCK_SRC 50
 #define MAX_BLOCK_DST 50
 #define MAX_BLOCK_TARGET 50
@@ -105,6 +131,18 @@ struct filters {
     unsigned int naccepttarget;
     unsigned int nacceptlinksrc;
     unsigned int nacceptlinkdst;
+
+    /*
+       The address filters are matched against these tries, which contain the prefixes of the arrays above (see
+       compile_filters()), along with those loaded from filter files (see load_filter_file())
+     */
+    struct prefix_trie blocksrctrie;
+    struct prefix_trie blockdsttrie;
+    struct prefix_trie blocktargettrie;
+    struct prefix_trie acceptsrctrie;
+    struct prefix_trie acceptdsttrie;
+    struct prefix_trie accepttargettrie;
+    unsigned int nfilefilters;
 };
 
 #define MAX_ACCEPT_SRC 50
@@ -119,6 +157,7 @@ struct filters {
 /* Constants used with the libcap functions */
 #define PCAP_SNAP_LEN 65535
 #define PCAP_PROMISC 1
+#define PCAP_BUFFER_SIZE (32 * 1024 * 1024) /* Size of the kernel capture buffer (mmap ring on Linux) */
 #define PCAP_OPT 1
 #ifndef PCAP_NETMASK_UNKNOWN
 #define PCAP_NETMASK_UNKNOWN 0xffffffff
@@ -498,6 +537,23 @@ struct target_ipv6 {
     unsigned int flags;         /* Value-result: Whether the canonic name is required/obtained */
 };
 
+/*
+   Storage for the entries of the prefix, host and scan lists (see arena_alloc()). Entries are carved out of large
+   blocks, such that they are contiguous in memory, and are all released at once. A zeroed arena is empty.
+ */
+#define ARENA_BLOCK_SIZE 65536
+#define ARENA_ALIGN 16
+
+struct arena_block {
+    struct arena_block *next;
+    size_t used;
+    size_t size;
+};
+
+struct arena {
+    struct arena_block *block; /* Block currently being filled (the others follow it) */
+};
+
 struct prefix_entry {
     struct in6_addr ip6;
     unsigned char len;
@@ -507,6 +563,7 @@ struct prefix_list {
     struct prefix_entry **prefix;
     unsigned int nprefix;
     unsigned int maxprefix;
+    struct arena arena;
 };
 
 struct prefix4_entry {
@@ -525,6 +582,7 @@ struct host_list {
     struct host_entry **host;
     unsigned int nhosts;
     unsigned int maxhosts;
+    struct arena arena;
 };
 
 struct address_list {
@@ -825,7 +883,7 @@ struct iface_data {
     struct prefix_list prefix_ac;
     struct prefix_list prefix_ol;
     unsigned int local_retrans;
-    unsigned int local_timeout;
+    unsigned long local_timeout; /* In microseconds */
     unsigned int mtu;
     struct ether_addr hsrcaddr;
     unsigned int hsrcaddr_f;
@@ -855,11 +913,42 @@ struct iface_data {
     unsigned char nhifindex_f;
     char nhiface[IFACE_LENGTH];
     unsigned char nh_f;
+
+    /* Batched transmission of frames */
+    unsigned char txbatch_f;
+    int txfd;
+    unsigned int ntxframes;
+    unsigned int maxtxframes;
+    unsigned char *txbuffer;
+    unsigned int *txlen;
+
+    /* Frames written to a savefile rather than sent (see open_tx_dump()) */
+    unsigned char txdump_f;
+    pcap_t *txdumppfd;
+    pcap_dumper_t *txdump;
+    unsigned long long txframes;
+    unsigned long long txbytes;
+    struct timeval txstart;
+    struct timeval txlast;
+
+    /* Frames read from a savefile rather than captured (see open_rx_replay()) */
+    char *rxreplayfile;
+    unsigned char rxreplay_f;
+    unsigned long long rxframes;
+    unsigned long long rxbytes;
+    struct timeval rxstart;
+
+    /* Member of an interface set (see add_iface_set()): output is tagged with the interface name */
+    unsigned char ifset_f;
+
+    /* Runtime metrics that the frames of the interface are accounted to (see attach_metrics()), or NULL */
+    struct metrics *metrics;
 };
 
 #ifdef __linux__
 /* Consulting the routing table */
 #define MAX_NLPAYLOAD 1024
+#define MAX_NLDUMP_SIZE 8192 /* Dumping the neighbor table */
 #else
 #define MAX_RTPAYLOAD 1024
 #endif
@@ -890,6 +979,198 @@ struct next_hop {
     unsigned char ifindex_f;
 };
 
+/* Neighbor cache shared by the tools (see load_neighbor_cache()) */
+#define TOOLKIT_CONFIG_FILE "/etc/ipv6toolkit.conf"
+#define NCACHE_DEFAULT_TTL 300 /* Seconds */
+#define NCACHE_INIT_ENTRIES 64
+#define MAX_NCACHE_LINE_SIZE 250
+
+struct neighbor_cache_entry {
+    char iface[IFACE_LENGTH];
+    struct in6_addr addr;
+    struct ether_addr ether;
+    time_t expires;
+    unsigned char router_f;
+};
+
+struct neighbor_cache {
+    struct neighbor_cache_entry *entry;
+    unsigned int nentries;
+    unsigned int maxentries;
+    uint32_t *hash; /* Open addressing, with (entry index + 1) in each bucket */
+    unsigned int hashsize;
+    char path[MAX_NCACHE_LINE_SIZE];
+    int fd;
+    unsigned int ttl;
+    unsigned char kernel_f; /* Seed the cache from the kernel neighbor table */
+    unsigned char loaded_f;
+    unsigned char dirty_f; /* Entries have been learned since the cache was read */
+};
+
+/* Snapshot of the routing table, for next-hop selection (see match_route_table()) */
+#define RTABLE_INIT_ENTRIES 64
+
+struct route_entry {
+    struct in6_addr dst;
+    uint8_t dstlen;
+    unsigned char type;    /* RTN_* */
+    unsigned char local_f; /* Belongs to the local table, which is looked up first */
+    struct in6_addr gateway;
+    unsigned char gateway_f;
+    int ifindex;
+    uint32_t priority;
+};
+
+struct route_table {
+    struct route_entry *entry;
+    unsigned int nentries;
+    unsigned int maxentries;
+    uint32_t *hash; /* Open addressing, with (entry index + 1) in each bucket */
+    unsigned int hashsize;
+    uint8_t lens[129]; /* Prefix lengths in use, from longest to shortest */
+    unsigned int nlens;
+    int fd; /* Netlink socket that receives the route change notifications */
+    unsigned char loaded_f;
+    unsigned char usable_f;
+};
+
+/*
+   Event loop used by the routines that wait for responses (see wait_event_loop()). Each outstanding operation
+   (e.g., the resolution of one neighbor) owns a timer, identified by its index.
+ */
+#define MAX_EVENT_FDS 16
+
+struct event_loop {
+    int fd[MAX_EVENT_FDS]; /* Descriptors to wait on (see add_event_fd()) */
+    unsigned int nfd;
+    struct timeval *deadline;
+    unsigned char *active;
+    unsigned int ntimers;
+};
+
+/*
+   Set of interfaces on which a tool captures and sends at the same time (see add_iface_set()). Each interface has
+   an iface_data of its own (capture handle, link-layer addresses, next hop); wait_iface_set() and read_iface_set()
+   multiplex them.
+ */
+#define MAX_IFACE_SET 16
+
+struct iface_set {
+    struct iface_data *iface[MAX_IFACE_SET];
+    unsigned int niface;
+    unsigned int next;      /* Interface that read_iface_set() tries first (round-robin) */
+    struct event_loop loop; /* Descriptors of the members, and the timeout of wait_iface_set() */
+};
+
+/*
+   Runtime metrics of a tool (see init_metrics()). The frames sent with send_frame() and read with read_frame() on
+   the attached interfaces are accounted automatically; tools account for filtered packets and response latencies.
+   Latency bucket i counts the responses that took less than 2^i microseconds (and at least 2^(i-1)); the last
+   bucket also counts any longer latencies.
+ */
+#define METRICS_LATENCY_BUCKETS 24
+
+struct metrics {
+    const char *tool;
+    struct iface_data *iface[MAX_IFACE_SET];
+    unsigned int niface;
+    unsigned long long txpackets;
+    unsigned long long txbytes;
+    unsigned long long rxpackets;
+    unsigned long long rxbytes;
+    unsigned long long accepted;
+    unsigned long long filtered;
+    unsigned long long latency[METRICS_LATENCY_BUCKETS];
+    unsigned long long nlatency;
+    double latencysum; /* In milliseconds */
+    double latencymax;
+    struct timeval start;
+    unsigned int interval; /* Seconds between reports (0: only at exit) */
+    time_t next;           /* Time of the next report */
+    struct timeval last;   /* Time of the last report, and counters at that time (for the rates) */
+    unsigned long long lasttx;
+    unsigned long long lastrx;
+    unsigned long long errors; /* Inject errors and drops of other processes (see sum_metrics()) */
+    unsigned long long drops;
+    int reportfd;          /* Pipe to which the metrics are reported, rather than printed (-1 if none) */
+    unsigned int reporter; /* Identifies the reporting process (see redirect_metrics()) */
+};
+
+/*
+   Packet templates, used by the flood modes (see next_template_frame()). A template holds a pre-built frame, and a
+   list of variable fields that are rewritten by a generator function before each frame is sent. Fields covered by
+   the upper-layer checksum must have an even offset and length, such that the checksum can be patched rather than
+   computed again.
+ */
+#define MAX_TEMPLATE_FIELDS 8
+#define MAX_TEMPLATE_FIELD_LEN 16
+
+struct template_field {
+    unsigned int offset; /* Offset of the field within the frame */
+    unsigned int len;
+    void (*gen)(unsigned char *, unsigned int, void *); /* Writes a new value for the field */
+    void *arg;                                          /* Argument passed to the generator */
+    unsigned long period;                               /* The field changes every "period" frames */
+    unsigned char cksum_f;                              /* Whether the field is covered by the checksum */
+};
+
+struct packet_template {
+    unsigned char frame[PACKET_BUFFER_SIZE];
+    size_t len;
+    unsigned int cksumoff; /* Offset of the upper-layer checksum (0 if none) */
+    struct template_field field[MAX_TEMPLATE_FIELDS];
+    unsigned int nfields;
+    unsigned long nframes; /* Frames produced so far */
+};
+
+/* Argument of the template_random_port() generator */
+struct port_prefix {
+    uint16_t port;
+    uint8_t len;
+};
+
+/*
+   Pseudorandom number generators (see prng_next()). The fast generator (xoshiro256**) is meant for per-packet
+   randomization; the keyed generator runs SipHash-2-4 over a counter, such that its output cannot be predicted
+   without the key. Each thread has a generator of its own (see thread_prng()).
+ */
+#define PRNG_FAST 0
+#define PRNG_KEYED 1
+#define PRNG_KEY_SIZE 16
+
+struct prng {
+    uint64_t s[4]; /* State of the fast generator */
+    uint8_t key[PRNG_KEY_SIZE];
+    uint64_t counter; /* Next input of the keyed generator */
+    unsigned char type;
+    unsigned char seeded_f;
+};
+
+/*
+   Result of dissecting a received packet (see dissect_packet()). The pointers refer to the captured frame; the
+   upper-layer header is preceded by "nexthdrs" Extension Headers, and is only available if the packet is not a
+   non-first fragment.
+ */
+#define DISSECT_CKSUM 0x01 /* Verify the upper-layer checksum */
+
+#define PV_EXTHDRS 0x01        /* The packet contains Extension Headers */
+#define PV_FRAGMENT 0x02       /* The packet contains a Fragment Header */
+#define PV_LATER_FRAGMENT 0x04 /* Non-first fragment (the upper-layer header is not available) */
+#define PV_TRUNCATED 0x08      /* The capture is shorter than the packet */
+#define PV_CKSUM_OK 0x10       /* The upper-layer checksum has been verified */
+
+struct packet_view {
+    struct ether_header *ether; /* NULL if the link-layer is not Ethernet */
+    struct ip6_hdr *ipv6;
+    struct ip6_frag *frag; /* NULL if the packet contains no Fragment Header */
+    unsigned char *upper;  /* Upper-layer header */
+    unsigned char *end;    /* End of the packet: the minimum of the captured length and the IPv6 Payload Length */
+    size_t upperlen;
+    uint8_t proto; /* Upper-layer protocol */
+    unsigned int nexthdrs;
+    unsigned int flags;
+};
+
 /* Flags that specify what the load_dst_and_pcap() function should do */
 #define LOAD_PCAP_ONLY 0x01
 #define LOAD_SRC_NXT_HOP 0x02
@@ -912,19 +1193,45 @@ struct next_hop {
 #endif
 #endif
 
+int add_neighbor_cache_entry(const char *, struct in6_addr *, struct ether_addr *, time_t, unsigned char);
 int address_contains_colons(char *);
 int address_contains_ranges(char *);
+int add_event_fd(struct event_loop *, int);
+int add_iface_set(struct iface_set *, struct iface_data *);
+int add_to_route_table(struct route_table *, struct route_entry *);
+int add_to_prefix_trie(struct prefix_trie *, struct in6_addr *, uint8_t);
+int attach_metrics(struct metrics *, struct iface_data *);
+int add_template_field(struct packet_template *, unsigned int, unsigned int,
+                       void (*)(unsigned char *, unsigned int, void *), void *, unsigned long, unsigned char);
+void *arena_alloc(struct arena *, size_t);
+void cancel_event_timer(struct event_loop *, unsigned int);
 void change_endianness(uint32_t *, unsigned int);
+void check_metrics(struct metrics *);
+void clear_route_table(struct route_table *);
+int compile_filters(struct filters *);
+struct iface_data *clone_iface_data(const struct iface_data *, const char *);
+void close_metrics(void);
+void close_neighbor_cache(void);
+void count_filter_result(struct iface_data *, unsigned char);
+void count_tx_frames(struct iface_data *, unsigned int, size_t);
+void close_rx_replay(void);
+void close_tx_dump(void);
 void debug_print_ifaces_data(struct iface_list *);
 uint16_t dec_to_hex(uint16_t);
 void decode_ipv6_address(struct decode6 *);
+int dissect_packet(struct iface_data *, const u_char *, const struct pcap_pkthdr *, struct packet_view *,
+                   unsigned int);
 int dns_decode(unsigned char *, unsigned int, unsigned char *, char *, unsigned int, unsigned char **);
 int dns_str2wire(char *, unsigned int, char *, unsigned int);
 void dump_hex(void *, size_t);
+int dump_route_table(struct route_table *);
+int flush_tx_batch(struct iface_data *);
+int expired_event_timer(struct event_loop *, unsigned int *);
 struct ether_addr ether_multicast(const struct in6_addr *);
 int ether_ntop(const struct ether_addr *, char *, size_t);
 int ether_pton(const char *, struct ether_addr *, unsigned int);
 void ether_to_ipv6_linklocal(struct ether_addr *etheraddr, struct in6_addr *ipv6addr);
+int filters_to_bpf(struct iface_data *, struct filters *, const char *, char *, size_t);
 void *find_iface_by_index(struct iface_list *, int);
 void *find_iface_by_name(struct iface_list *, char *);
 void *find_iface_by_addr(struct iface_list *, struct in6_addr *);
@@ -932,6 +1239,8 @@ int find_ipv6_router(pcap_t *, struct ether_addr *, struct in6_addr *, struct et
 int find_ipv6_router_full(pcap_t *, struct iface_data *);
 struct iface_entry *find_matching_address(struct iface_data *, struct iface_list *, struct in6_addr *,
                                           struct in6_addr *);
+void free_arena(struct arena *);
+void free_event_loop(struct event_loop *);
 void generate_slaac_address(struct in6_addr *, struct ether_addr *, struct in6_addr *);
 int get_if_addrs(struct iface_data *);
 int get_local_addrs(struct iface_data *);
@@ -941,9 +1250,21 @@ int get_ipv6_target(struct target_ipv6 *);
 int inc_sdev(uint32_t *, unsigned int, uint32_t *, double *);
 const char *inet_ntof(int, const void *, char *, socklen_t);
 int init_iface_data(struct iface_data *);
+int init_metrics(struct metrics *, const char *, unsigned int);
+int init_event_loop(struct event_loop *, int, unsigned int);
 int init_filters(struct filters *);
+int init_prefix_trie(struct prefix_trie *);
+int init_route_table(struct route_table *);
+int init_tx_batch(struct iface_data *, unsigned int);
+int init_packet_template(struct packet_template *, const void *, size_t, unsigned int);
 uint16_t in_chksum(void *, void *, size_t, uint8_t);
+uint64_t in_chksum_add(uint64_t, const void *, size_t);
+uint16_t in_chksum_fold(uint64_t);
+uint16_t in_chksum_update(uint16_t, const void *, const void *, size_t);
 int insert_pad_opt(unsigned char *ptrhdr, const unsigned char *, unsigned int);
+size_t ipv6_ntop(const struct in6_addr *, char *);
+unsigned int ipv6_ntop_batch(const struct in6_addr *, unsigned int, char *, size_t, size_t *);
+int ipv6_pton(const char *, struct in6_addr *);
 int ipv6_to_ether(pcap_t *, struct iface_data *, struct in6_addr *, struct ether_addr *);
 unsigned int ip6_longest_match(struct in6_addr *, struct in6_addr *);
 int is_iid_null(struct in6_addr *, uint8_t);
@@ -954,34 +1275,88 @@ int is_ip6_in_prefix_list(struct in6_addr *, struct prefix_list *);
 int is_eq_in6_addr(struct in6_addr *, struct in6_addr *);
 unsigned int is_service_port(uint16_t);
 int is_time_elapsed(struct timeval *, struct timeval *, unsigned long);
+size_t next_template_frame(struct packet_template *);
+pcap_t *open_iface_pcap(const char *, char *);
+int open_neighbor_cache(const char *, unsigned int);
+int open_rx_replay(struct iface_data *, char *);
+int open_tx_dump(struct iface_data *, const char *);
 int keyval(char *, unsigned int, char **, char **);
 int load_dst_and_pcap(struct iface_data *, unsigned int);
+int load_filter_file(struct filters *, const char *);
+int load_neighbor_cache(struct iface_data *);
+int load_route_table(struct iface_data *);
+int lock_neighbor_cache(short);
+int lookup_neighbor_cache(struct iface_data *, struct in6_addr *, struct ether_addr *);
+unsigned int neighbor_hash(const char *, struct in6_addr *);
+int lookup_router_cache(struct iface_data *, struct in6_addr *, struct ether_addr *);
+struct route_entry *lookup_route_table(struct iface_data *, struct in6_addr *);
 unsigned int match_ether(struct ether_addr *, unsigned int, struct ether_addr *);
 unsigned int match_ipv6(struct in6_addr *, uint8_t *, unsigned int, struct in6_addr *);
+int match_prefix_trie(struct prefix_trie *, struct in6_addr *);
+struct route_entry *match_route_table(struct route_table *, struct in6_addr *);
 void print_filters(struct iface_data *, struct filters *);
 void print_filter_result(struct iface_data *, const u_char *, unsigned char);
 unsigned int print_ipv6_address(char *s, struct in6_addr *);
 unsigned int print_ipv6_address_rev(struct in6_addr *);
 int print_local_addrs(struct iface_data *);
+void print_metrics(struct metrics *);
+void print_metrics_json(struct metrics *, FILE *);
+int print_pcap_stats(struct iface_data *);
+void prng_fill(struct prng *, void *, size_t);
+uint64_t prng_next(struct prng *);
+uint32_t prng_random32(void);
+void prng_seed(struct prng *, uint64_t);
+void prng_seed_key(struct prng *, const uint8_t *);
+int prng_seed_random(struct prng *, unsigned char);
 void randomize_ether_addr(struct ether_addr *);
 void randomize_ipv6_addr(struct in6_addr *, const struct in6_addr *, uint8_t);
+void randomize_ipv6_addrs(struct in6_addr *, unsigned int, const struct in6_addr *, uint8_t);
 void randomize_port(uint16_t *, uint16_t, uint8_t);
+void randomize_ports(uint16_t *, unsigned int, uint16_t, uint8_t);
+int read_frame(struct iface_data *, struct pcap_pkthdr **, const u_char **);
+int read_iface_set(struct iface_set *, struct iface_data **, struct pcap_pkthdr **, const u_char **);
 int read_ipv6_address(char *, unsigned int, struct in6_addr *);
+int read_neighbor_cache(int);
 int read_prefix(char *, unsigned int, char **);
+void record_latency(struct metrics *, const struct timeval *, const struct timeval *);
+void redirect_metrics(struct metrics *, int, unsigned int);
 void release_privileges(void);
+void report_filter_result(struct iface_data *, const u_char *, unsigned char);
+int resolve_neighbors(struct iface_data *, struct in6_addr *, struct ether_addr *, unsigned char *, unsigned int);
+unsigned int route_hash(struct route_table *, struct in6_addr *, uint8_t, unsigned char);
 void sanitize_ipv4_prefix(struct prefix4_entry *);
 void sanitize_ipv6_prefix(struct in6_addr *, uint8_t);
 void sanitize_port(uint16_t *, uint8_t);
+void save_neighbor_cache(void);
+int seed_neighbor_cache(void);
+int send_frame(struct iface_data *, const void *, size_t);
+const char *send_frame_error(struct iface_data *);
+int send_template_frames(struct iface_data *, struct packet_template *, unsigned int);
+void set_event_timer(struct event_loop *, unsigned int, unsigned long);
+int set_filters_bpf(struct iface_data *, struct filters *, const char *);
 int send_neighbor_advert(struct iface_data *, pcap_t *, const u_char *);
 int send_neighbor_solicit(struct iface_data *, struct in6_addr *);
 int sel_src_addr(struct iface_data *);
 struct in6_addr *sel_src_addr_ra(struct iface_data *, struct in6_addr *);
 int sel_next_hop(struct iface_data *);
 int sel_next_hop_ra(struct iface_data *);
-void sig_alarm(int);
+void sig_metrics(int);
+void sum_metrics(struct metrics *, const struct metrics *, unsigned int);
+void sig_tx_dump(int);
+uint64_t siphash24(const uint8_t *, const void *, size_t);
 struct in6_addr solicited_node(const struct in6_addr *);
 int string_escapes(char *, unsigned int *, unsigned int);
 size_t Strnlen(const char *, size_t);
+void template_copy_field(unsigned char *, unsigned int, void *);
+void template_random_bytes(unsigned char *, unsigned int, void *);
+void template_random_ether_addr(unsigned char *, unsigned int, void *);
+void template_random_ipv6_addr(unsigned char *, unsigned int, void *);
+void template_random_port(unsigned char *, unsigned int, void *);
+struct prng *thread_prng(void);
 struct timeval timeval_sub(struct timeval *, struct timeval *);
+int tx_dump_stopped(void);
 float time_diff_ms(struct timeval *, struct timeval *);
+int update_neighbor_cache(struct iface_data *, struct in6_addr *, struct ether_addr *, unsigned char);
+int wait_event_loop(struct event_loop *);
+int wait_iface_set(struct iface_set *, struct timeval *);
 unsigned int zero_byte_iid(struct in6_addr *);
@@ -52,6 +52,7 @@
 /* Function prototypes */
 void init_packet_data(struct iface_data *);
 int send_packet(struct iface_data *, struct pcap_pkthdr *, const u_char *);
+int send_flood_template(struct iface_data *, unsigned char);
 void print_attack_info(struct iface_data *);
 void usage(void);
 void print_help(void);
@@ -74,6 +75,7 @@ struct icmp6_hdr *pkt_icmp6;
 struct nd_neighbor_solicit *pkt_ns;
 struct ether_header *ethernet, *pkt_ether;
 struct nd_opt_tlla *tllaopt;
+struct packet_view pview;
 
 struct in6_addr targetaddr;
 struct ether_addr linkaddr[MAX_TLLA_OPTION];
@@ -118,10 +120,27 @@ unsigned char *prev_nh, *startoffragment;
 struct filters filters;
 struct iface_data idata;
 
+/* Additional interfaces (repeated '-i' options) served concurrently in listening mode */
+struct iface_set ifset;
+struct iface_data *ifdata;
+char extraiface[MAX_IFACE_SET - 1][IFACE_LENGTH];
+unsigned int nextraifaces = 0;
+
+/* Used for measuring the packet-generation speed (see open_tx_dump()) */
+char *txdumpfile = NULL;
+
+/* Template for the flood packets (see send_flood_template()) */
+struct packet_template tmpl;
+struct prefix_entry srcprefix, targetprefix;
+
+/* Runtime metrics (see init_metrics()) */
+struct metrics metrics;
+unsigned int statsinterval;
+unsigned char stats_f = FALSE;
+
 int main(int argc, char **argv) {
     extern char *optarg;
     int r, sel;
-    fd_set sset, rset;
 #if defined(sun) || defined(__sun) || defined(__linux__)
     struct timeval timeout;
 #endif
@@ -153,16 +172,20 @@ int main(int argc, char **argv) {
                                        {"accept-link-src-addr", required_argument, 0, 'B'},
                                        {"accept-link-dst-addr", required_argument, 0, 'G'},
                                        {"accept-target-addr", required_argument, 0, 'W'},
+                                       {"filter-file", required_argument, 0, 'I'},
                                        {"flood-sources", required_argument, 0, 'F'},
                                        {"flood-targets", required_argument, 0, 'T'},
                                        {"loop", no_argument, 0, 'l'},
                                        {"sleep", required_argument, 0, 'z'},
                                        {"listen", no_argument, 0, 'L'},
+                                       {"write-pcap", required_argument, 0, 'Y'},
+                                       {"dry-run", no_argument, 0, '3'},
+                                       {"stats-interval", required_argument, 0, '1'},
                                        {"verbose", no_argument, 0, 'v'},
                                        {"help", no_argument, 0, 'h'},
                                        {0, 0, 0, 0}};
 
-    const char shortopts[] = "i:s:d:A:u:U:H:y:S:D:t:roceE:j:k:J:K:w:b:g:B:G:W:T:F:lz:vhL";
+    const char shortopts[] = "i:s:d:A:u:U:H:y:S:D:t:roceE:j:k:J:K:w:b:g:B:G:W:T:F:lz:Y:vhL";
 
     char option;
 
@@ -189,6 +212,18 @@ int main(int argc, char **argv) {
 
         switch (option) {
         case 'i': /* Interface */
+            if (idata.iface_f) {
+                if (nextraifaces >= (MAX_IFACE_SET - 1)) {
+                    puts("Error: Too many interfaces specified");
+                    exit(EXIT_FAILURE);
+                }
+
+                strncpy(extraiface[nextraifaces], optarg, IFACE_LENGTH);
+                extraiface[nextraifaces][IFACE_LENGTH - 1] = 0;
+                nextraifaces++;
+                break;
+            }
+
             strncpy(idata.iface, optarg, IFACE_LENGTH);
             idata.iface[IFACE_LENGTH - 1] = 0;
             idata.iface_f = TRUE;
@@ -688,6 +723,14 @@ int main(int argc, char **argv) {
             filters.acceptfilters_f = 1;
             break;
 
+        case 'I': /* Address filters from a file */
+            if (load_filter_file(&filters, optarg) == FAILURE) {
+                printf("Error while loading address filters from file %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+
+            break;
+
         case 'w': /* ND Target Address (block) filter */
             if (filters.nblocktarget > MAX_BLOCK_TARGET) {
                 puts("Too many Target Address (block) filters.");
@@ -797,6 +840,19 @@ int main(int argc, char **argv) {
             sleep_f = 1;
             break;
 
+        case 'Y': /* Write the packets to a savefile, rather than sending them */
+            txdumpfile = optarg;
+            break;
+
+        case '3': /* Discard the packets, rather than sending them */
+            txdumpfile = "/dev/null";
+            break;
+
+        case '1': /* Print the runtime metrics periodically */
+            statsinterval = atoi(optarg);
+            stats_f = TRUE;
+            break;
+
         case 'v': /* Be verbose */
             idata.verbose_f++;
             break;
@@ -828,8 +884,71 @@ int main(int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
 
+    if (init_tx_batch(&idata, TX_BATCH_SIZE) == FAILURE) {
+        puts("Error while initializing batched transmission");
+        exit(EXIT_FAILURE);
+    }
+
+    if (nextraifaces && !listen_f) {
+        puts("Error: Multiple interfaces can only be specified in 'listen' mode");
+        exit(EXIT_FAILURE);
+    }
+
+    if (nextraifaces && txdumpfile != NULL) {
+        puts("Error: Multiple interfaces cannot be used when writing packets to a file");
+        exit(EXIT_FAILURE);
+    }
+
+    if (add_iface_set(&ifset, &idata) == FAILURE) {
+        puts("Error while adding the interface to the interface set");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < nextraifaces; i++) {
+        if ((ifdata = clone_iface_data(&idata, extraiface[i])) == NULL) {
+            puts("Error initializing internal data structure");
+            exit(EXIT_FAILURE);
+        }
+
+        if (load_dst_and_pcap(ifdata, LOAD_PCAP_ONLY) == FAILURE) {
+            printf("Error while learning Source Address and Next Hop for interface %s\n", ifdata->iface);
+            exit(EXIT_FAILURE);
+        }
+
+        if (ifdata->type != idata.type) {
+            printf("Error: Interface %s has a different link-layer type than interface %s\n", ifdata->iface,
+                   idata.iface);
+            exit(EXIT_FAILURE);
+        }
+
+        if (init_tx_batch(ifdata, TX_BATCH_SIZE) == FAILURE) {
+            puts("Error while initializing batched transmission");
+            exit(EXIT_FAILURE);
+        }
+
+        if (add_iface_set(&ifset, ifdata) == FAILURE) {
+            printf("Error while adding interface %s to the interface set\n", ifdata->iface);
+            exit(EXIT_FAILURE);
+        }
+    }
+
     release_privileges();
 
+    if (txdumpfile != NULL && open_tx_dump(&idata, txdumpfile) == FAILURE) {
+        printf("Error while opening savefile %s\n", txdumpfile);
+        exit(EXIT_FAILURE);
+    }
+
+    if (stats_f) {
+        if (init_metrics(&metrics, "na6", statsinterval) == FAILURE) {
+            puts("Error while initializing the runtime metrics");
+            exit(EXIT_FAILURE);
+        }
+
+        for (i = 0; i < ifset.niface; i++)
+            attach_metrics(&metrics, ifset.iface[i]);
+    }
+
     if (listen_f && loop_f) {
         puts("'Error: listen' mode and 'loop' mode are incompatible");
         exit(EXIT_FAILURE);
@@ -908,6 +1027,20 @@ int main(int argc, char **argv) {
             exit(EXIT_FAILURE);
         }
 
+    /* Additional interfaces answer with their own link-local address, unless a source address was specified */
+    for (i = 1; i < ifset.niface; i++) {
+        ifdata = ifset.iface[i];
+
+        if (!idata.srcaddr_f && !floods_f && ifdata->ip6_local_flag)
+            ifdata->srcaddr = ifdata->ip6_local;
+        else
+            ifdata->srcaddr = idata.srcaddr;
+
+        ifdata->srcpreflen = idata.srcpreflen;
+        ifdata->dstaddr = idata.dstaddr;
+        ifdata->hdstaddr = idata.hdstaddr;
+    }
+
     if (tllaopt_f && !tllaopta_f) {   /* The value of the target link-layer address      */
         linkaddr[0] = idata.hsrcaddr; /* option defaults to the Ethernet Source Address */
         nlinkaddr++;
@@ -956,6 +1089,9 @@ int main(int argc, char **argv) {
      */
     if ((idata.dstaddr_f || idata.hdstaddr_f) && (targetaddr_f || floodt_f)) {
         if (send_packet(&idata, NULL, NULL) == FAILURE) {
+            if (tx_dump_stopped())
+                exit(EXIT_SUCCESS);
+
             puts("Error while sending packet");
             exit(EXIT_FAILURE);
         }
@@ -969,8 +1105,13 @@ int main(int argc, char **argv) {
                        "second%s...\n",
                        nsleep, ((nsleep > 1) ? "s" : ""));
             while (loop_f) {
-                sleep(nsleep);
+                if (txdumpfile == NULL)
+                    sleep(nsleep);
+
                 if (send_packet(&idata, NULL, NULL) == FAILURE) {
+                    if (tx_dump_stopped())
+                        exit(EXIT_SUCCESS);
+
                     puts("Error while sending packet");
                     exit(EXIT_FAILURE);
                 }
@@ -981,8 +1122,17 @@ int main(int argc, char **argv) {
     }
 
     if (listen_f) {
-        FD_ZERO(&sset);
-        FD_SET(idata.fd, &sset);
+        if (compile_filters(&filters) == FAILURE) {
+            puts("Error while compiling the address filters");
+            exit(EXIT_FAILURE);
+        }
+
+        for (i = 0; i < ifset.niface; i++) {
+            if (set_filters_bpf(ifset.iface[i], &filters, PCAP_ICMPV6_NS_FILTER) == FAILURE) {
+                puts("Error while pushing the address filters into the capture filter");
+                exit(EXIT_FAILURE);
+            }
+        }
 
         if (idata.verbose_f) {
             print_filters(&idata, &filters);
@@ -991,100 +1141,82 @@ int main(int argc, char **argv) {
         }
 
         while (listen_f) {
-            rset = sset;
-
 #if defined(sun) || defined(__sun) || defined(__linux__)
             timeout.tv_usec = 1000;
             timeout.tv_sec = 0;
-            if ((sel = select(idata.fd + 1, &rset, NULL, NULL, &timeout)) == -1) {
+            if ((sel = wait_iface_set(&ifset, &timeout)) == -1) {
 #else
-            if ((sel = select(idata.fd + 1, &rset, NULL, NULL, NULL)) == -1) {
+            if ((sel = wait_iface_set(&ifset, NULL)) == -1) {
 #endif
-                if (errno == EINTR) {
-                    continue;
-                }
-                else {
-                    puts("Error in select()");
-                    exit(EXIT_FAILURE);
-                }
+                puts("Error in select()");
+                exit(EXIT_FAILURE);
             }
 
 #if defined(sun) || defined(__sun) || defined(__linux__)
             if (TRUE) {
 #else
-            if (sel && FD_ISSET(idata.fd, &rset)) {
+            if (sel) {
 #endif
-                /* Read a Neighbor Solicitation message */
-                if ((r = pcap_next_ex(idata.pfd, &pkthdr, &pktdata)) == -1) {
-                    printf("pcap_next_ex(): %s", pcap_geterr(idata.pfd));
+                /* Read a Neighbor Solicitation message from any of the interfaces */
+                if ((r = read_iface_set(&ifset, &ifdata, &pkthdr, &pktdata)) == -1) {
+                    printf("pcap_next_ex(): %s", pcap_geterr(ifdata->pfd));
                     exit(EXIT_FAILURE);
                 }
-                else if (r == 1 && pktdata != NULL) {
-                    /* XXX Code assumes no IPv6 Extension Headers */
+                else if (r == 1) {
+                    /* The capture filter cannot skip Extension Headers, so the packet is checked again here */
+                    if (dissect_packet(ifdata, pktdata, pkthdr, &pview, 0) == FAILURE ||
+                        pview.proto != IPPROTO_ICMPV6 || (pview.flags & PV_LATER_FRAGMENT) ||
+                        pview.upperlen < sizeof(struct nd_neighbor_solicit))
+                        continue;
+
                     pkt_ether = (struct ether_header *)pktdata;
-                    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata.linkhsize);
-                    pkt_ns = (struct nd_neighbor_solicit *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
+                    pkt_ipv6 = pview.ipv6;
+                    pkt_ns = (struct nd_neighbor_solicit *)pview.upper;
                     pkt_icmp6 = (struct icmp6_hdr *)pkt_ns;
 
-                    /* XXX This should probably be removed when pcap filter
-                     * problem is solved */
-                    if (pkt_ipv6->ip6_nxt != IPPROTO_ICMPV6 || pkt_icmp6->icmp6_type != ND_NEIGHBOR_SOLICIT ||
-                        pkt_icmp6->icmp6_code != 0)
+                    if (pkt_icmp6->icmp6_type != ND_NEIGHBOR_SOLICIT || pkt_icmp6->icmp6_code != 0)
                         continue;
 
                     accepted_f = 0;
 
-                    if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK)) {
+                    if (ifdata->type == DLT_EN10MB && !(ifdata->flags & IFACE_LOOPBACK)) {
                         if (filters.nblocklinksrc) {
                             if (match_ether(filters.blocklinksrc, filters.nblocklinksrc, &(pkt_ether->src))) {
-                                if (idata.verbose_f > 1)
-                                    print_filter_result(&idata, pktdata, BLOCKED);
-
+                                report_filter_result(ifdata, pktdata, BLOCKED);
                                 continue;
                             }
                         }
 
                         if (filters.nblocklinkdst) {
                             if (match_ether(filters.blocklinkdst, filters.nblocklinkdst, &(pkt_ether->dst))) {
-                                if (idata.verbose_f > 1)
-                                    print_filter_result(&idata, pktdata, BLOCKED);
-
+                                report_filter_result(ifdata, pktdata, BLOCKED);
                                 continue;
                             }
                         }
                     }
 
-                    if (filters.nblocksrc) {
-                        if (match_ipv6(filters.blocksrc, filters.blocksrclen, filters.nblocksrc,
-                                       &(pkt_ipv6->ip6_src))) {
-                            if (idata.verbose_f > 1)
-                                print_filter_result(&idata, pktdata, BLOCKED);
-
+                    if (filters.blocksrctrie.nprefix) {
+                        if (match_prefix_trie(&(filters.blocksrctrie), &(pkt_ipv6->ip6_src))) {
+                            report_filter_result(ifdata, pktdata, BLOCKED);
                             continue;
                         }
                     }
 
-                    if (filters.nblockdst) {
-                        if (match_ipv6(filters.blockdst, filters.blockdstlen, filters.nblockdst,
-                                       &(pkt_ipv6->ip6_dst))) {
-                            if (idata.verbose_f > 1)
-                                print_filter_result(&idata, pktdata, BLOCKED);
-
+                    if (filters.blockdsttrie.nprefix) {
+                        if (match_prefix_trie(&(filters.blockdsttrie), &(pkt_ipv6->ip6_dst))) {
+                            report_filter_result(ifdata, pktdata, BLOCKED);
                             continue;
                         }
                     }
 
-                    if (filters.nblocktarget) {
-                        if (match_ipv6(filters.blocktarget, filters.blocktargetlen, filters.nblocktarget,
-                                       &(pkt_ns->nd_ns_target))) {
-                            if (idata.verbose_f > 1)
-                                print_filter_result(&idata, pktdata, BLOCKED);
-
+                    if (filters.blocktargettrie.nprefix) {
+                        if (match_prefix_trie(&(filters.blocktargettrie), &(pkt_ns->nd_ns_target))) {
+                            report_filter_result(ifdata, pktdata, BLOCKED);
                             continue;
                         }
                     }
 
-                    if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK)) {
+                    if (ifdata->type == DLT_EN10MB && !(ifdata->flags & IFACE_LOOPBACK)) {
                         if (filters.nacceptlinksrc) {
                             if (match_ether(filters.acceptlinksrc, filters.nacceptlinksrc, &(pkt_ether->src)))
                                 accepted_f = 1;
@@ -1096,36 +1228,33 @@ int main(int argc, char **argv) {
                         }
                     }
 
-                    if (filters.nacceptsrc && !accepted_f) {
-                        if (match_ipv6(filters.acceptsrc, filters.acceptsrclen, filters.nacceptsrc,
-                                       &(pkt_ipv6->ip6_src)))
+                    if (filters.acceptsrctrie.nprefix && !accepted_f) {
+                        if (match_prefix_trie(&(filters.acceptsrctrie), &(pkt_ipv6->ip6_src)))
                             accepted_f = 1;
                     }
 
-                    if (filters.nacceptdst && !accepted_f) {
-                        if (match_ipv6(filters.acceptdst, filters.acceptdstlen, filters.nacceptdst,
-                                       &(pkt_ipv6->ip6_dst)))
+                    if (filters.acceptdsttrie.nprefix && !accepted_f) {
+                        if (match_prefix_trie(&(filters.acceptdsttrie), &(pkt_ipv6->ip6_dst)))
                             accepted_f = 1;
                     }
 
-                    if (filters.naccepttarget && !accepted_f) {
-                        if (match_ipv6(filters.accepttarget, filters.accepttargetlen, filters.naccepttarget,
-                                       &(pkt_ns->nd_ns_target)))
+                    if (filters.accepttargettrie.nprefix && !accepted_f) {
+                        if (match_prefix_trie(&(filters.accepttargettrie), &(pkt_ns->nd_ns_target)))
                             accepted_f = 1;
                     }
 
                     if (filters.acceptfilters_f && !accepted_f) {
-                        if (idata.verbose_f > 1)
-                            print_filter_result(&idata, pktdata, BLOCKED);
-
+                        report_filter_result(ifdata, pktdata, BLOCKED);
                         continue;
                     }
 
-                    if (idata.verbose_f)
-                        print_filter_result(&idata, pktdata, ACCEPTED);
+                    report_filter_result(ifdata, pktdata, ACCEPTED);
 
                     /* Send a Neighbor Advertisement */
-                    if (send_packet(&idata, pkthdr, pktdata) == FAILURE) {
+                    if (send_packet(ifdata, pkthdr, pktdata) == FAILURE) {
+                        if (tx_dump_stopped())
+                            exit(EXIT_SUCCESS);
+
                         puts("Error while sending packet");
                         exit(EXIT_FAILURE);
                     }
@@ -1307,10 +1436,10 @@ int send_packet(struct iface_data *idata, struct pcap_pkthdr *pkthdr, const u_ch
     if (pktdata == NULL) {
         sources = 0;
     }
-    else { /* Sending a response to a Neighbor Solicitation message */
+    else { /* Sending a response to a Neighbor Solicitation message (already dissected into pview) */
         pkt_ether = (struct ether_header *)pktdata;
-        pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata->linkhsize);
-        pkt_ns = (struct nd_neighbor_solicit *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
+        pkt_ipv6 = pview.ipv6;
+        pkt_ns = (struct nd_neighbor_solicit *)pview.upper;
 
         /* If the IPv6 Source Address of the incoming Neighbor Solicitation is
            the unspecified address (::), the Neighbor Advertisement must be
@@ -1372,6 +1501,10 @@ int send_packet(struct iface_data *idata, struct pcap_pkthdr *pkthdr, const u_ch
             ethernet->src = idata->hsrcaddr;
             sources = 0;
             multicastdst_f = 1;
+
+            /* The NS may have been received on any of the interfaces (see read_iface_set()) */
+            if (tllaopt_f && !tllaopta_f)
+                memcpy(tllaopt->address, ethernet->src.a, ETH_ALEN);
         }
         else {
             ipv6->ip6_src = pkt_ipv6->ip6_dst;
@@ -1383,6 +1516,13 @@ int send_packet(struct iface_data *idata, struct pcap_pkthdr *pkthdr, const u_ch
         na->nd_na_target = pkt_ns->nd_ns_target;
     }
 
+    /*
+       Without fragmentation, and with at most one Target Link-Layer Address option (included by init_packet_data()),
+       all the flood packets have the same length, and only differ in a few fields
+     */
+    if ((floods_f || floodt_f) && !idata->fragh_f && nlinkaddr <= 1)
+        return (send_flood_template(idata, (pktdata == NULL || multicastdst_f)));
+
     do {
         if (floods_f && (pktdata == NULL || (pktdata != NULL && multicastdst_f))) {
             /*
@@ -1441,13 +1581,13 @@ int send_packet(struct iface_data *idata, struct pcap_pkthdr *pkthdr, const u_ch
                 if (!idata->fragh_f) {
                     ipv6->ip6_plen = htons((ptr - v6buffer) - MIN_IPV6_HLEN);
 
-                    if ((nw = pcap_inject(idata->pfd, buffer, ptr - buffer)) == -1) {
-                        printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+                    if ((nw = send_frame(idata, buffer, ptr - buffer)) == -1) {
+                        printf("send_frame(): %s\n", send_frame_error(idata));
                         return (FAILURE);
                     }
 
                     if (nw != (ptr - buffer)) {
-                        printf("pcap_inject(): only wrote %d bytes (rather "
+                        printf("send_frame(): only wrote %d bytes (rather "
                                "than %lu bytes)\n",
                                nw, (LUI)(ptr - buffer));
                         return (FAILURE);
@@ -1469,7 +1609,7 @@ int send_packet(struct iface_data *idata, struct pcap_pkthdr *pkthdr, const u_ch
 
                     memcpy(fptr, (char *)&fraghdr, FRAG_HDR_SIZE);
                     fh = (struct ip6_frag *)fptr;
-                    fh->ip6f_ident = random();
+                    fh->ip6f_ident = prng_random32();
                     startoffragment = fptr + FRAG_HDR_SIZE;
 
                     /*
@@ -1499,13 +1639,13 @@ int send_packet(struct iface_data *idata, struct pcap_pkthdr *pkthdr, const u_ch
 
                         fipv6->ip6_plen = htons((fptr - fragbuffer) - MIN_IPV6_HLEN - idata->linkhsize);
 
-                        if ((nw = pcap_inject(idata->pfd, fragbuffer, fptr - fragbuffer)) == -1) {
-                            printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+                        if ((nw = send_frame(idata, fragbuffer, fptr - fragbuffer)) == -1) {
+                            printf("send_frame(): %s\n", send_frame_error(idata));
                             return (FAILURE);
                         }
 
                         if (nw != (fptr - fragbuffer)) {
-                            printf("pcap_inject(): only wrote %d bytes (rather "
+                            printf("send_frame(): only wrote %d bytes (rather "
                                    "than %lu "
                                    "bytes)\n",
                                    nw, (LUI)(ptr - buffer));
@@ -1522,6 +1662,100 @@ int send_packet(struct iface_data *idata, struct pcap_pkthdr *pkthdr, const u_ch
         sources++;
     } while (sources < nsources);
 
+    if (flush_tx_batch(idata) == -1) {
+        printf("Error while sending packets: %s\n", send_frame_error(idata));
+        return (FAILURE);
+    }
+
+    return (SUCCESS);
+}
+
+/*
+ * Function: send_flood_template()
+ *
+ * Sends the flood packets of send_packet() from a packet template. The first packet is built and sent as usual, and
+ * the template produces the following ones: the IPv6 Source Address and the link-layer address change every
+ * "ntargets" packets (if "floodsrc_f" is set), and the ND Target Address changes in every packet.
+ */
+int send_flood_template(struct iface_data *idata, unsigned char floodsrc_f) {
+    unsigned long nframes;
+
+    nframes = ((sources < nsources) ? (nsources - sources) : 1) * ntargets;
+    floodsrc_f = floodsrc_f && floods_f;
+    ptr = startofprefixes;
+
+    if (floodsrc_f) {
+        randomize_ipv6_addr(&(ipv6->ip6_src), &(idata->srcaddr), idata->srcpreflen);
+
+        if (!idata->hsrcaddr_f) {
+            randomize_ether_addr(&(ethernet->src));
+        }
+
+        if (tllaopt_f && !tllaopta_f) {
+            memcpy(tllaopt->address, ethernet->src.a, ETH_ALEN);
+        }
+    }
+
+    if (floodt_f) {
+        randomize_ipv6_addr(&(na->nd_na_target), &targetaddr, targetpreflen);
+    }
+
+    ipv6->ip6_plen = htons((ptr - v6buffer) - MIN_IPV6_HLEN);
+    na->nd_na_cksum = 0;
+    na->nd_na_cksum = in_chksum(v6buffer, na, ptr - ((unsigned char *)na), IPPROTO_ICMPV6);
+
+    if ((nw = send_frame(idata, buffer, ptr - buffer)) == -1) {
+        printf("send_frame(): %s\n", send_frame_error(idata));
+        return (FAILURE);
+    }
+
+    if (nw != (ptr - buffer)) {
+        printf("send_frame(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+        return (FAILURE);
+    }
+
+    if (init_packet_template(&tmpl, buffer, ptr - buffer, (unsigned char *)&(na->nd_na_cksum) - buffer) == FAILURE) {
+        puts("Error while initializing the packet template");
+        return (FAILURE);
+    }
+
+    if (floodsrc_f) {
+        srcprefix.ip6 = idata->srcaddr;
+        srcprefix.len = idata->srcpreflen;
+
+        if (add_template_field(&tmpl, (unsigned char *)&(ipv6->ip6_src) - buffer, sizeof(struct in6_addr),
+                               template_random_ipv6_addr, &srcprefix, ntargets, TRUE) == FAILURE)
+            return (FAILURE);
+
+        if (!idata->hsrcaddr_f) {
+            if (add_template_field(&tmpl, (unsigned char *)&(ethernet->src) - buffer, sizeof(struct ether_addr),
+                                   template_random_ether_addr, NULL, ntargets, FALSE) == FAILURE)
+                return (FAILURE);
+
+            /* Fields are rewritten in order: the option gets the Ethernet Source Address of the same packet */
+            if (tllaopt_f && !tllaopta_f) {
+                if (add_template_field(&tmpl, tllaopt->address - buffer, ETH_ALEN, template_copy_field,
+                                       tmpl.frame + ((unsigned char *)&(ethernet->src) - buffer), ntargets,
+                                       TRUE) == FAILURE)
+                    return (FAILURE);
+            }
+        }
+    }
+
+    if (floodt_f) {
+        targetprefix.ip6 = targetaddr;
+        targetprefix.len = targetpreflen;
+
+        if (add_template_field(&tmpl, (unsigned char *)&(na->nd_na_target) - buffer, sizeof(struct in6_addr),
+                               template_random_ipv6_addr, &targetprefix, 1, TRUE) == FAILURE)
+            return (FAILURE);
+    }
+
+    if (send_template_frames(idata, &tmpl, nframes - 1) == FAILURE) {
+        printf("Error while sending packets: %s\n", send_frame_error(idata));
+        return (FAILURE);
+    }
+
     return (SUCCESS);
 }
 
@@ -1541,7 +1775,8 @@ void usage(void) {
          "PREFIX[/LEN]] "
          "[-b PREFIX[/LEN]] [-g PREFIX[/LEN]] [-B LINK_ADDR] [-G LINK_ADDR] [-W "
          "PREFIX[/LEN]] "
-         "[-F N_SOURCES] [-T N_TARGETS] [-L | -l] [-z] [-v] [-V] [-h]");
+         "[-F N_SOURCES] [-T N_TARGETS] [-L | -l] [-z] [-Y PCAP_FILE | --dry-run] "
+         "[--stats-interval SECONDS] [-v] [-V] [-h]");
 }
 
 /*
@@ -1583,6 +1818,7 @@ void print_help(void) {
          "  --accept-link-src, -B      Accept Ethernet Source Address\n"
          "  --accept-link-dst, -G      Accept Ethernet Destination Address\n"
          "  --accept-target, -W        Accept ND Target IPv6 prefix\n"
+         "  --filter-file              Load address filters from a file\n"
          "  --flood-targets, -T        Flood with NA's for multiple Target "
          "Addresses\n"
          "  --flood-sources, -F        Number of Source Addresses to forge "
@@ -1592,6 +1828,9 @@ void print_help(void) {
          "  --loop, -l                 Send periodic Neighbor Advertisements\n"
          "  --sleep, -z                Pause between sending NA messages\n"
          "  --help, -h                 Print help for the na6 tool\n"
+         "  --write-pcap, -Y           Write the packets to a pcap savefile, rather than sending them\n"
+         "  --dry-run                  Discard the packets, rather than sending them\n"
+         "  --stats-interval           Print the runtime metrics every SECONDS (and as JSON at exit)\n"
          "  --verbose, -v              Be verbose\n"
          "\n"
          "Programmed by Fernando Gont for SI6 Networks "
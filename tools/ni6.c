@@ -210,6 +210,7 @@ int main(int argc, char **argv) {
                                        {"accept-dst-addr", required_argument, 0, 'g'},
                                        {"accept-link-src-addr", required_argument, 0, 'B'},
                                        {"accept-link-dst-addr", required_argument, 0, 'G'},
+                                       {"filter-file", required_argument, 0, 'I'},
                                        {"forge-src-addr", no_argument, 0, 'r'},
                                        {"forge-link-src-addr", no_argument, 0, 'R'},
                                        {"loop", no_argument, 0, 'l'},
@@ -862,6 +863,14 @@ int main(int argc, char **argv) {
             filters.acceptfilters_f = 1;
             break;
 
+        case 'I': /* Address filters from a file */
+            if (load_filter_file(&filters, optarg) == FAILURE) {
+                printf("Error while loading address filters from file %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+
+            break;
+
         case 'r':
             rand_src_f = 1;
             break;
@@ -1165,6 +1174,16 @@ int main(int argc, char **argv) {
             print_attack_info(&idata);
         }
 
+        if (compile_filters(&filters) == FAILURE) {
+            puts("Error while compiling the address filters");
+            exit(EXIT_FAILURE);
+        }
+
+        if (set_filters_bpf(&idata, &filters, PCAP_ICMPV6_NI_QUERY) == FAILURE) {
+            puts("Error while pushing the address filters into the capture filter");
+            exit(EXIT_FAILURE);
+        }
+
         if (idata.verbose_f) {
             print_filters(&idata, &filters);
             puts("Listening to incoming IPv6 packets...");
@@ -1237,9 +1256,8 @@ int main(int argc, char **argv) {
                         }
                     }
 
-                    if (filters.nblocksrc) {
-                        if (match_ipv6(filters.blocksrc, filters.blocksrclen, filters.nblocksrc,
-                                       &(pkt_ipv6->ip6_src))) {
+                    if (filters.blocksrctrie.nprefix) {
+                        if (match_prefix_trie(&(filters.blocksrctrie), &(pkt_ipv6->ip6_src))) {
                             if (idata.verbose_f > 1)
                                 print_filter_result(&idata, pktdata, BLOCKED);
 
@@ -1247,9 +1265,8 @@ int main(int argc, char **argv) {
                         }
                     }
 
-                    if (filters.nblockdst) {
-                        if (match_ipv6(filters.blockdst, filters.blockdstlen, filters.nblockdst,
-                                       &(pkt_ipv6->ip6_dst))) {
+                    if (filters.blockdsttrie.nprefix) {
+                        if (match_prefix_trie(&(filters.blockdsttrie), &(pkt_ipv6->ip6_dst))) {
                             if (idata.verbose_f > 1)
                                 print_filter_result(&idata, pktdata, BLOCKED);
 
@@ -1267,15 +1284,13 @@ int main(int argc, char **argv) {
                             accepted_f = 1;
                     }
 
-                    if (filters.nacceptsrc && !accepted_f) {
-                        if (match_ipv6(filters.acceptsrc, filters.acceptsrclen, filters.nacceptsrc,
-                                       &(pkt_ipv6->ip6_src)))
+                    if (filters.acceptsrctrie.nprefix && !accepted_f) {
+                        if (match_prefix_trie(&(filters.acceptsrctrie), &(pkt_ipv6->ip6_src)))
                             accepted_f = 1;
                     }
 
-                    if (filters.nacceptdst && !accepted_f) {
-                        if (match_ipv6(filters.acceptdst, filters.acceptdstlen, filters.nacceptdst,
-                                       &(pkt_ipv6->ip6_dst)))
+                    if (filters.acceptdsttrie.nprefix && !accepted_f) {
+                        if (match_prefix_trie(&(filters.acceptdsttrie), &(pkt_ipv6->ip6_dst)))
                             accepted_f = 1;
                     }
 
@@ -2219,7 +2234,7 @@ int send_packet(struct iface_data *idata, const u_char *pktdata, struct pcap_pkt
 
         memcpy(fptr, (char *)&fraghdr, FRAG_HDR_SIZE);
         fh = (struct ip6_frag *)fptr;
-        fh->ip6f_ident = random();
+        fh->ip6f_ident = prng_random32();
         startoffragment = fptr + FRAG_HDR_SIZE;
 
         /*
@@ -2334,6 +2349,7 @@ void print_help(void) {
          "  --accept-dst, -g           Accept IPv6 Destination Address prefix\n"
          "  --accept-link-src, -B      Accept Ethernet Source Address\n"
          "  --accept-link-dst, -G      Accept Ethernet Destination Address\n"
+         "  --filter-file              Load address filters from a file\n"
          "  --forge-src-addr, -r       Forge IPv6 Source Address\n"
          "  --forge-link-src-addr, -R  Forge link-layer Source Address\n"
          "  --loop, -l                 Send periodic ICMPv6 error messages\n"
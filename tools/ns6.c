@@ -50,6 +50,7 @@
 
 void init_packet_data(struct iface_data *);
 void send_packet(struct iface_data *);
+int send_flood_template(struct iface_data *);
 int send_packet_to_ns(struct iface_data *, struct pcap_pkthdr *, const u_char *);
 void print_attack_info(struct iface_data *);
 void usage(void);
@@ -68,6 +69,7 @@ unsigned char *v6buffer, *ptr, *startofprefixes;
 struct nd_neighbor_solicit *pkt_ns;
 struct ether_header *ethernet, *pkt_ether;
 struct icmp6_hdr *pkt_icmp6;
+struct packet_view pview;
 
 struct ip6_hdr *ipv6, *pkt_ipv6;
 struct nd_neighbor_solicit *ns;
@@ -118,10 +120,19 @@ struct filters filters;
 
 struct iface_data idata;
 
+/* Template for the flood packets (see send_flood_template()) */
+struct packet_template tmpl;
+struct prefix_entry srcprefix, targetprefix;
+
+/* Additional interfaces (repeated '-i' options) served concurrently in listening mode */
+struct iface_set ifset;
+struct iface_data *ifdata;
+char extraiface[MAX_IFACE_SET - 1][IFACE_LENGTH];
+unsigned int nextraifaces = 0;
+
 int main(int argc, char **argv) {
     extern char *optarg;
     int r, sel;
-    fd_set sset, rset;
 
 #if defined(sun) || defined(__sun) || defined(__linux__)
     struct timeval timeout;
@@ -152,6 +163,7 @@ int main(int argc, char **argv) {
                                        {"accept-link-src-addr", required_argument, 0, 'B'},
                                        {"accept-link-dst-addr", required_argument, 0, 'G'},
                                        {"accept-target-addr", required_argument, 0, 'W'},
+                                       {"filter-file", required_argument, 0, 'I'},
                                        {"flood-sources", required_argument, 0, 'F'},
                                        {"flood-targets", required_argument, 0, 'T'},
                                        {"loop", no_argument, 0, 'l'},
@@ -176,11 +188,29 @@ int main(int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
 
+    /* Initialize filters structure */
+    if (init_filters(&filters) == -1) {
+        puts("Error initializing internal data structure");
+        exit(EXIT_FAILURE);
+    }
+
     while ((r = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1) {
         option = r;
 
         switch (option) {
         case 'i': /* Interface */
+            if (idata.iface_f) {
+                if (nextraifaces >= (MAX_IFACE_SET - 1)) {
+                    puts("Error: Too many interfaces specified");
+                    exit(EXIT_FAILURE);
+                }
+
+                strncpy(extraiface[nextraifaces], optarg, IFACE_LENGTH);
+                extraiface[nextraifaces][IFACE_LENGTH - 1] = 0;
+                nextraifaces++;
+                break;
+            }
+
             strncpy(idata.iface, optarg, IFACE_LENGTH);
             idata.iface[IFACE_LENGTH - 1] = 0;
             idata.iface_f = 1;
@@ -643,6 +673,14 @@ int main(int argc, char **argv) {
             filters.acceptfilters_f = 1;
             break;
 
+        case 'I': /* Address filters from a file */
+            if (load_filter_file(&filters, optarg) == FAILURE) {
+                printf("Error while loading address filters from file %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+
+            break;
+
         case 'w': /* ND Target Address (block) filter */
             if (filters.nblocktarget > MAX_BLOCK_TARGET) {
                 puts("Too many Target Address (block) filters.");
@@ -766,16 +804,68 @@ int main(int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
 
+    if (nextraifaces && !listen_f) {
+        puts("Error: Multiple interfaces can only be specified in 'listen' mode");
+        exit(EXIT_FAILURE);
+    }
+
     if (listen_f) {
+        if (load_dst_and_pcap(&idata, LOAD_PCAP_ONLY) == FAILURE) {
+            puts("Error while learning Source Address and Next Hop");
+            exit(EXIT_FAILURE);
+        }
+
+        if (init_tx_batch(&idata, TX_BATCH_SIZE) == FAILURE) {
+            puts("Error while initializing batched transmission");
+            exit(EXIT_FAILURE);
+        }
+
+        if (add_iface_set(&ifset, &idata) == FAILURE) {
+            puts("Error while adding the interface to the interface set");
+            exit(EXIT_FAILURE);
+        }
+
+        for (i = 0; i < nextraifaces; i++) {
+            if ((ifdata = clone_iface_data(&idata, extraiface[i])) == NULL) {
+                puts("Error initializing internal data structure");
+                exit(EXIT_FAILURE);
+            }
+
+            if (load_dst_and_pcap(ifdata, LOAD_PCAP_ONLY) == FAILURE) {
+                printf("Error while learning Source Address and Next Hop for interface %s\n", ifdata->iface);
+                exit(EXIT_FAILURE);
+            }
+
+            if (ifdata->type != idata.type) {
+                printf("Error: Interface %s has a different link-layer type than interface %s\n", ifdata->iface,
+                       idata.iface);
+                exit(EXIT_FAILURE);
+            }
+
+            if (init_tx_batch(ifdata, TX_BATCH_SIZE) == FAILURE) {
+                puts("Error while initializing batched transmission");
+                exit(EXIT_FAILURE);
+            }
+
+            if (add_iface_set(&ifset, ifdata) == FAILURE) {
+                printf("Error while adding interface %s to the interface set\n", ifdata->iface);
+                exit(EXIT_FAILURE);
+            }
+        }
 
-        /* Initialize filters structure */
-        if (init_filters(&filters) == -1) {
-            puts("Error initializing internal data structure");
+        release_privileges();
+
+        if (compile_filters(&filters) == FAILURE) {
+            puts("Error while compiling the address filters");
             exit(EXIT_FAILURE);
         }
 
-        FD_ZERO(&sset);
-        FD_SET(idata.fd, &sset);
+        for (i = 0; i < ifset.niface; i++) {
+            if (set_filters_bpf(ifset.iface[i], &filters, PCAP_ICMPV6_NS_FILTER) == FAILURE) {
+                puts("Error while pushing the address filters into the capture filter");
+                exit(EXIT_FAILURE);
+            }
+        }
 
         if (idata.verbose_f) {
             print_filters(&idata, &filters);
@@ -786,53 +876,49 @@ int main(int argc, char **argv) {
         init_packet_data(&idata);
 
         while (listen_f) {
-            rset = sset;
-
 #if defined(sun) || defined(__sun) || defined(__linux__)
             timeout.tv_usec = 1000;
             timeout.tv_sec = 0;
-            if ((sel = select(idata.fd + 1, &rset, NULL, NULL, &timeout)) == -1) {
+            if ((sel = wait_iface_set(&ifset, &timeout)) == -1) {
 #else
-            if ((sel = select(idata.fd + 1, &rset, NULL, NULL, NULL)) == -1) {
+            if ((sel = wait_iface_set(&ifset, NULL)) == -1) {
 #endif
-                if (errno == EINTR) {
-                    continue;
-                }
-                else {
-                    puts("Error in select()");
-                    exit(EXIT_FAILURE);
-                }
+                puts("Error in select()");
+                exit(EXIT_FAILURE);
             }
 
 #if defined(sun) || defined(__sun) || defined(__linux__)
             if (TRUE) {
 #else
-            if (sel && FD_ISSET(idata.fd, &rset)) {
+            if (sel) {
 #endif
-                /* Read a Neighbor Solicitation message */
-                if ((r = pcap_next_ex(idata.pfd, &pkthdr, &pktdata)) == -1) {
-                    printf("pcap_next_ex(): %s", pcap_geterr(idata.pfd));
+                /* Read a Neighbor Solicitation message from any of the interfaces */
+                if ((r = read_iface_set(&ifset, &ifdata, &pkthdr, &pktdata)) == -1) {
+                    printf("pcap_next_ex(): %s", pcap_geterr(ifdata->pfd));
                     exit(EXIT_FAILURE);
                 }
-                else if (r == 1 && pktdata != NULL) {
-                    /* XXX Code assumes no IPv6 Extension Headers */
+                else if (r == 1) {
+                    /* The capture filter cannot skip Extension Headers, so the packet is checked again here */
+                    if (dissect_packet(ifdata, pktdata, pkthdr, &pview, 0) == FAILURE ||
+                        pview.proto != IPPROTO_ICMPV6 || (pview.flags & PV_LATER_FRAGMENT) ||
+                        pview.upperlen < sizeof(struct nd_neighbor_solicit))
+                        continue;
+
                     pkt_ether = (struct ether_header *)pktdata;
-                    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata.linkhsize);
-                    pkt_ns = (struct nd_neighbor_solicit *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
+                    pkt_ipv6 = pview.ipv6;
+                    pkt_ns = (struct nd_neighbor_solicit *)pview.upper;
                     pkt_icmp6 = (struct icmp6_hdr *)pkt_ns;
 
-                    /* XXX This should probably be removed when pcap filter problem is solved */
-                    if (pkt_ipv6->ip6_nxt != IPPROTO_ICMPV6 || pkt_icmp6->icmp6_type != ND_NEIGHBOR_SOLICIT ||
-                        pkt_icmp6->icmp6_code != 0)
+                    if (pkt_icmp6->icmp6_type != ND_NEIGHBOR_SOLICIT || pkt_icmp6->icmp6_code != 0)
                         continue;
 
                     accepted_f = 0;
 
-                    if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK)) {
+                    if (ifdata->type == DLT_EN10MB && !(ifdata->flags & IFACE_LOOPBACK)) {
                         if (filters.nblocklinksrc) {
                             if (match_ether(filters.blocklinksrc, filters.nblocklinksrc, &(pkt_ether->src))) {
                                 if (idata.verbose_f > 1)
-                                    print_filter_result(&idata, pktdata, BLOCKED);
+                                    print_filter_result(ifdata, pktdata, BLOCKED);
 
                                 continue;
                             }
@@ -841,44 +927,41 @@ int main(int argc, char **argv) {
                         if (filters.nblocklinkdst) {
                             if (match_ether(filters.blocklinkdst, filters.nblocklinkdst, &(pkt_ether->dst))) {
                                 if (idata.verbose_f > 1)
-                                    print_filter_result(&idata, pktdata, BLOCKED);
+                                    print_filter_result(ifdata, pktdata, BLOCKED);
 
                                 continue;
                             }
                         }
                     }
 
-                    if (filters.nblocksrc) {
-                        if (match_ipv6(filters.blocksrc, filters.blocksrclen, filters.nblocksrc,
-                                       &(pkt_ipv6->ip6_src))) {
+                    if (filters.blocksrctrie.nprefix) {
+                        if (match_prefix_trie(&(filters.blocksrctrie), &(pkt_ipv6->ip6_src))) {
                             if (idata.verbose_f > 1)
-                                print_filter_result(&idata, pktdata, BLOCKED);
+                                print_filter_result(ifdata, pktdata, BLOCKED);
 
                             continue;
                         }
                     }
 
-                    if (filters.nblockdst) {
-                        if (match_ipv6(filters.blockdst, filters.blockdstlen, filters.nblockdst,
-                                       &(pkt_ipv6->ip6_dst))) {
+                    if (filters.blockdsttrie.nprefix) {
+                        if (match_prefix_trie(&(filters.blockdsttrie), &(pkt_ipv6->ip6_dst))) {
                             if (idata.verbose_f > 1)
-                                print_filter_result(&idata, pktdata, BLOCKED);
+                                print_filter_result(ifdata, pktdata, BLOCKED);
 
                             continue;
                         }
                     }
 
-                    if (filters.nblocktarget) {
-                        if (match_ipv6(filters.blocktarget, filters.blocktargetlen, filters.nblocktarget,
-                                       &(pkt_ns->nd_ns_target))) {
+                    if (filters.blocktargettrie.nprefix) {
+                        if (match_prefix_trie(&(filters.blocktargettrie), &(pkt_ns->nd_ns_target))) {
                             if (idata.verbose_f > 1)
-                                print_filter_result(&idata, pktdata, BLOCKED);
+                                print_filter_result(ifdata, pktdata, BLOCKED);
 
                             continue;
                         }
                     }
 
-                    if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK)) {
+                    if (ifdata->type == DLT_EN10MB && !(ifdata->flags & IFACE_LOOPBACK)) {
                         if (filters.nacceptlinksrc) {
                             if (match_ether(filters.acceptlinksrc, filters.nacceptlinksrc, &(pkt_ether->src)))
                                 accepted_f = 1;
@@ -890,36 +973,33 @@ int main(int argc, char **argv) {
                         }
                     }
 
-                    if (filters.nacceptsrc && !accepted_f) {
-                        if (match_ipv6(filters.acceptsrc, filters.acceptsrclen, filters.nacceptsrc,
-                                       &(pkt_ipv6->ip6_src)))
+                    if (filters.acceptsrctrie.nprefix && !accepted_f) {
+                        if (match_prefix_trie(&(filters.acceptsrctrie), &(pkt_ipv6->ip6_src)))
                             accepted_f = 1;
                     }
 
-                    if (filters.nacceptdst && !accepted_f) {
-                        if (match_ipv6(filters.acceptdst, filters.acceptdstlen, filters.nacceptdst,
-                                       &(pkt_ipv6->ip6_dst)))
+                    if (filters.acceptdsttrie.nprefix && !accepted_f) {
+                        if (match_prefix_trie(&(filters.acceptdsttrie), &(pkt_ipv6->ip6_dst)))
                             accepted_f = 1;
                     }
 
-                    if (filters.naccepttarget && !accepted_f) {
-                        if (match_ipv6(filters.accepttarget, filters.accepttargetlen, filters.naccepttarget,
-                                       &(pkt_ns->nd_ns_target)))
+                    if (filters.accepttargettrie.nprefix && !accepted_f) {
+                        if (match_prefix_trie(&(filters.accepttargettrie), &(pkt_ns->nd_ns_target)))
                             accepted_f = 1;
                     }
 
                     if (filters.acceptfilters_f && !accepted_f) {
                         if (idata.verbose_f > 1)
-                            print_filter_result(&idata, pktdata, BLOCKED);
+                            print_filter_result(ifdata, pktdata, BLOCKED);
 
                         continue;
                     }
 
                     if (idata.verbose_f)
-                        print_filter_result(&idata, pktdata, ACCEPTED);
+                        print_filter_result(ifdata, pktdata, ACCEPTED);
 
                     /* Send a Neighbor Advertisement */
-                    if (send_packet_to_ns(&idata, pkthdr, pktdata) == FAILURE) {
+                    if (send_packet_to_ns(ifdata, pkthdr, pktdata) == FAILURE) {
                         puts("Error while sending packet");
                         exit(EXIT_FAILURE);
                     }
@@ -941,6 +1021,11 @@ int main(int argc, char **argv) {
             exit(EXIT_FAILURE);
         }
 
+        if (init_tx_batch(&idata, TX_BATCH_SIZE) == FAILURE) {
+            puts("Error while initializing batched transmission");
+            exit(EXIT_FAILURE);
+        }
+
         release_privileges();
 
         if (pcap_compile(idata.pfd, &pcap_filter, PCAP_NOPACKETS_FILTER, PCAP_OPT, PCAP_NETMASK_UNKNOWN) == -1) {
@@ -1219,6 +1304,21 @@ void init_packet_data(struct iface_data *idata) {
 void send_packet(struct iface_data *idata) {
     sources = 0;
 
+    /*
+       Without fragmentation, and with at most one Source Link-Layer Address option (included by init_packet_data()),
+       all the flood packets have the same length, and only differ in a few fields
+     */
+    if ((floods_f || floodt_f) && !idata->fragh_f && nlinkaddr <= 1) {
+        if (send_flood_template(idata) == FAILURE) {
+            if (tx_dump_stopped())
+                exit(EXIT_SUCCESS);
+
+            exit(EXIT_FAILURE);
+        }
+
+        return;
+    }
+
     do {
         if (floods_f) {
             /*
@@ -1277,13 +1377,13 @@ void send_packet(struct iface_data *idata) {
                 if (!idata->fragh_f) {
                     ipv6->ip6_plen = htons((ptr - v6buffer) - MIN_IPV6_HLEN);
 
-                    if ((nw = pcap_inject(idata->pfd, buffer, ptr - buffer)) == -1) {
-                        printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+                    if ((nw = send_frame(idata, buffer, ptr - buffer)) == -1) {
+                        printf("send_frame(): %s\n", send_frame_error(idata));
                         exit(EXIT_FAILURE);
                     }
 
                     if (nw != (ptr - buffer)) {
-                        printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+                        printf("send_frame(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
                         exit(EXIT_FAILURE);
                     }
                 }
@@ -1303,7 +1403,7 @@ void send_packet(struct iface_data *idata) {
 
                     memcpy(fptr, (char *)&fraghdr, FRAG_HDR_SIZE);
                     fh = (struct ip6_frag *)fptr;
-                    fh->ip6f_ident = random();
+                    fh->ip6f_ident = prng_random32();
                     startoffragment = fptr + FRAG_HDR_SIZE;
 
                     /*
@@ -1333,13 +1433,13 @@ void send_packet(struct iface_data *idata) {
 
                         fipv6->ip6_plen = htons((fptr - fragbuffer) - MIN_IPV6_HLEN - idata->linkhsize);
 
-                        if ((nw = pcap_inject(idata->pfd, fragbuffer, fptr - fragbuffer)) == -1) {
-                            printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+                        if ((nw = send_frame(idata, fragbuffer, fptr - fragbuffer)) == -1) {
+                            printf("send_frame(): %s\n", send_frame_error(idata));
                             exit(EXIT_FAILURE);
                         }
 
                         if (nw != (fptr - fragbuffer)) {
-                            printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw,
+                            printf("send_frame(): only wrote %d bytes (rather than %lu bytes)\n", nw,
                                    (LUI)(ptr - buffer));
                             exit(EXIT_FAILURE);
                         }
@@ -1355,6 +1455,99 @@ void send_packet(struct iface_data *idata) {
         sources++;
 
     } while (sources < nsources);
+
+    if (flush_tx_batch(idata) == -1) {
+        printf("Error while sending packets: %s\n", send_frame_error(idata));
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Function: send_flood_template()
+ *
+ * Sends the flood packets of send_packet() from a packet template. The first packet is built and sent as usual, and
+ * the template produces the following ones: the IPv6 Source Address and the link-layer address change every
+ * "ntargets" packets (with '-F'), and the ND Target Address changes in every packet (with '-T').
+ */
+int send_flood_template(struct iface_data *idata) {
+    unsigned long nframes;
+
+    nframes = (unsigned long)nsources * ntargets;
+    ptr = startofprefixes;
+
+    if (floods_f) {
+        randomize_ipv6_addr(&(ipv6->ip6_src), &(idata->srcaddr), idata->srcpreflen);
+
+        if (!idata->hsrcaddr_f) {
+            randomize_ether_addr(&(ethernet->src));
+
+            if (sllopt_f && !sllopta_f) {
+                memcpy(sllaopt->address, ethernet->src.a, ETH_ALEN);
+            }
+        }
+    }
+
+    if (floodt_f) {
+        randomize_ipv6_addr(&(ns->nd_ns_target), &targetaddr, targetpreflen);
+    }
+
+    ipv6->ip6_plen = htons((ptr - v6buffer) - MIN_IPV6_HLEN);
+    ns->nd_ns_cksum = 0;
+    ns->nd_ns_cksum = in_chksum(v6buffer, ns, ptr - ((unsigned char *)ns), IPPROTO_ICMPV6);
+
+    if ((nw = send_frame(idata, buffer, ptr - buffer)) == -1) {
+        printf("send_frame(): %s\n", send_frame_error(idata));
+        return (FAILURE);
+    }
+
+    if (nw != (ptr - buffer)) {
+        printf("send_frame(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+        return (FAILURE);
+    }
+
+    if (init_packet_template(&tmpl, buffer, ptr - buffer, (unsigned char *)&(ns->nd_ns_cksum) - buffer) == FAILURE) {
+        puts("Error while initializing the packet template");
+        return (FAILURE);
+    }
+
+    if (floods_f) {
+        srcprefix.ip6 = idata->srcaddr;
+        srcprefix.len = idata->srcpreflen;
+
+        if (add_template_field(&tmpl, (unsigned char *)&(ipv6->ip6_src) - buffer, sizeof(struct in6_addr),
+                               template_random_ipv6_addr, &srcprefix, ntargets, TRUE) == FAILURE)
+            return (FAILURE);
+
+        if (!idata->hsrcaddr_f) {
+            if (add_template_field(&tmpl, (unsigned char *)&(ethernet->src) - buffer, sizeof(struct ether_addr),
+                                   template_random_ether_addr, NULL, ntargets, FALSE) == FAILURE)
+                return (FAILURE);
+
+            /* Fields are rewritten in order: the option gets the Ethernet Source Address of the same packet */
+            if (sllopt_f && !sllopta_f) {
+                if (add_template_field(&tmpl, sllaopt->address - buffer, ETH_ALEN, template_copy_field,
+                                       tmpl.frame + ((unsigned char *)&(ethernet->src) - buffer), ntargets,
+                                       TRUE) == FAILURE)
+                    return (FAILURE);
+            }
+        }
+    }
+
+    if (floodt_f) {
+        targetprefix.ip6 = targetaddr;
+        targetprefix.len = targetpreflen;
+
+        if (add_template_field(&tmpl, (unsigned char *)&(ns->nd_ns_target) - buffer, sizeof(struct in6_addr),
+                               template_random_ipv6_addr, &targetprefix, 1, TRUE) == FAILURE)
+            return (FAILURE);
+    }
+
+    if (send_template_frames(idata, &tmpl, nframes - 1) == FAILURE) {
+        printf("Error while sending packets: %s\n", send_frame_error(idata));
+        return (FAILURE);
+    }
+
+    return (SUCCESS);
 }
 
 /*
@@ -1367,10 +1560,10 @@ int send_packet_to_ns(struct iface_data *idata, struct pcap_pkthdr *pkthdr, cons
     if (pktdata == NULL) {
         sources = 0;
     }
-    else { /* Sending a response to a Neighbor Solicitation message */
+    else { /* Sending a response to a Neighbor Solicitation message (already dissected into pview) */
         pkt_ether = (struct ether_header *)pktdata;
-        pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata->linkhsize);
-        pkt_ns = (struct nd_neighbor_solicit *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
+        pkt_ipv6 = pview.ipv6;
+        pkt_ns = (struct nd_neighbor_solicit *)pview.upper;
 
         /* If the IPv6 Source Address of the incoming Neighbor Solicitation is the unspecified
            address (::), the Neighbor Advertisement must be directed to the IPv6 all-nodes
@@ -1476,13 +1669,13 @@ int send_packet_to_ns(struct iface_data *idata, struct pcap_pkthdr *pkthdr, cons
                 if (!idata->fragh_f) {
                     ipv6->ip6_plen = htons((ptr - v6buffer) - MIN_IPV6_HLEN);
 
-                    if ((nw = pcap_inject(idata->pfd, buffer, ptr - buffer)) == -1) {
-                        printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+                    if ((nw = send_frame(idata, buffer, ptr - buffer)) == -1) {
+                        printf("send_frame(): %s\n", send_frame_error(idata));
                         return (FAILURE);
                     }
 
                     if (nw != (ptr - buffer)) {
-                        printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+                        printf("send_frame(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
                         return (FAILURE);
                     }
                 }
@@ -1502,7 +1695,7 @@ int send_packet_to_ns(struct iface_data *idata, struct pcap_pkthdr *pkthdr, cons
 
                     memcpy(fptr, (char *)&fraghdr, FRAG_HDR_SIZE);
                     fh = (struct ip6_frag *)fptr;
-                    fh->ip6f_ident = random();
+                    fh->ip6f_ident = prng_random32();
                     startoffragment = fptr + FRAG_HDR_SIZE;
 
                     /*
@@ -1532,13 +1725,13 @@ int send_packet_to_ns(struct iface_data *idata, struct pcap_pkthdr *pkthdr, cons
 
                         fipv6->ip6_plen = htons((fptr - fragbuffer) - MIN_IPV6_HLEN - idata->linkhsize);
 
-                        if ((nw = pcap_inject(idata->pfd, fragbuffer, fptr - fragbuffer)) == -1) {
-                            printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+                        if ((nw = send_frame(idata, fragbuffer, fptr - fragbuffer)) == -1) {
+                            printf("send_frame(): %s\n", send_frame_error(idata));
                             return (FAILURE);
                         }
 
                         if (nw != (fptr - fragbuffer)) {
-                            printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw,
+                            printf("send_frame(): only wrote %d bytes (rather than %lu bytes)\n", nw,
                                    (LUI)(ptr - buffer));
                             return (FAILURE);
                         }
@@ -1553,6 +1746,11 @@ int send_packet_to_ns(struct iface_data *idata, struct pcap_pkthdr *pkthdr, cons
         sources++;
     } while (sources < nsources);
 
+    if (flush_tx_batch(idata) == -1) {
+        printf("Error while sending packets: %s\n", send_frame_error(idata));
+        return (FAILURE);
+    }
+
     return (SUCCESS);
 }
 
@@ -1595,6 +1793,7 @@ void print_help(void) {
          "  --flood-targets, -T        Flood with NA's for multiple Target Addresses\n"
          "  --loop, -l                 Send Neighbor Solicitations periodically\n"
          "  --sleep, -z                Pause between peiodic Neighbor Solicitations\n"
+         "  --filter-file              Load address filters from a file\n"
          "  --help, -h                 Print help for the ns6 tool\n"
          "  --verbose, -v              Be verbose\n"
          "\n"
@@ -64,6 +64,11 @@ void usage(void);
 /* Used for router discovery */
 struct iface_data idata;
 
+/* Runtime metrics (see init_metrics()) */
+struct metrics metrics;
+unsigned int statsinterval;
+unsigned char stats_f = FALSE;
+
 struct in6_addr randprefix;
 unsigned char randpreflen;
 
@@ -80,6 +85,7 @@ struct udp_hdr *pkt_udp;
 struct ah_hdr *pkt_ah;
 struct esp_hdr *pkt_esp;
 struct ip6_eh *pkt_eh;
+struct packet_view pview;
 
 struct nd_neighbor_solicit *pkt_ns;
 struct in6_addr *pkt_ipv6addr;
@@ -185,6 +191,8 @@ int main(int argc, char **argv) {
                                        {"tcp-flags", required_argument, 0, 'X'},
                                        {"rate-limit", required_argument, 0, 'r'},
                                        {"mode", required_argument, 0, 'm'},
+                                       {"read-pcap", required_argument, 0, 'M'},
+                                       {"stats-interval", required_argument, 0, '1'},
                                        {"verbose", no_argument, 0, 'v'},
                                        {"help", no_argument, 0, 'h'},
                                        {0, 0, 0, 0}};
@@ -562,6 +570,15 @@ int main(int argc, char **argv) {
 
             break;
 
+        case 'M': /* Read the responses from a savefile, rather than from the network */
+            idata.rxreplayfile = optarg;
+            break;
+
+        case '1': /* Print the runtime metrics periodically */
+            statsinterval = atoi(optarg);
+            stats_f = TRUE;
+            break;
+
         case 'v': /* Be verbose */
             idata.verbose_f++;
             break;
@@ -606,6 +623,18 @@ int main(int argc, char **argv) {
 
     release_privileges();
 
+    /* When replaying a savefile, the probes are not sent */
+    if (idata.rxreplayfile != NULL && open_tx_dump(&idata, "/dev/null") == FAILURE) {
+        puts("Error while opening savefile /dev/null");
+        exit(EXIT_FAILURE);
+    }
+
+    if (stats_f && (init_metrics(&metrics, "path6", statsinterval) == FAILURE ||
+                    attach_metrics(&metrics, &idata) == FAILURE)) {
+        puts("Error while initializing the runtime metrics");
+        exit(EXIT_FAILURE);
+    }
+
     if ((idata.ip6_local_flag && idata.ip6_global_flag) && !idata.srcaddr_f)
         localaddr_f = 1;
 
@@ -955,65 +984,29 @@ int main(int argc, char **argv) {
 #else
         if (FD_ISSET(idata.fd, &rset)) {
 #endif
-            /* Read a packet (Echo Reply, ICMPv6 Error, or Neighbor Solicitation) */
-            if ((r = pcap_next_ex(idata.pfd, &pkthdr, &pktdata)) == -1) {
-                if (idata.verbose_f)
-                    printf("pcap_next_ex(): %s", pcap_geterr(idata.pfd));
+            /* Read all the available packets (Echo Reply, ICMPv6 Error, or Neighbor Solicitation) */
+            while ((r = read_frame(&idata, &pkthdr, &pktdata)) == 1) {
+                if (pktdata == NULL)
+                    continue;
 
-                exit(EXIT_FAILURE);
-            }
-            else if (r == 1 && pktdata != NULL) {
 #ifdef DEBUG
                 puts("Got packet");
 #endif
                 nflow = 0xffffffff;
-                pkt_ether = (struct ether_header *)pktdata;
-                pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata.linkhsize);
-                pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
-
-                if ((pkt_end - pktdata) < (idata.linkhsize + MIN_IPV6_HLEN))
+                /* Non-first fragments do not carry the upper-layer header that identifies our probes */
+                if (dissect_packet(&idata, pktdata, pkthdr, &pview, 0) == FAILURE || (pview.flags & PV_LATER_FRAGMENT))
                     continue;
 
-                /*
-                   We currently handle two cases: In the first case, there are extension headers, and hence we need to
-                   walk through the extension header chain. In the other, the upper layer protocol is right after the
-                   fixed IPv6 header
-                 */
-                if (pkt_ipv6->ip6_nxt != IPPROTO_ICMPV6 && pkt_ipv6->ip6_nxt != IPPROTO_TCP &&
-                    pkt_ipv6->ip6_nxt != IPPROTO_UDP && pkt_ipv6->ip6_nxt != IPPROTO_ESP &&
-                    pkt_ipv6->ip6_nxt != IPPROTO_AH) {
-                    pkt_eh = (struct ip6_eh *)((char *)pkt_ipv6 + sizeof(struct ip6_hdr));
-
-                    while (((unsigned char *)pkt_eh + MIN_EXT_HLEN) <= pkt_end &&
-                           (pkt_eh->eh_nxt != IPPROTO_ICMPV6 && pkt_eh->eh_nxt != IPPROTO_TCP &&
-                            pkt_eh->eh_nxt != IPPROTO_UDP && pkt_ipv6->ip6_nxt != IPPROTO_ESP &&
-                            pkt_ipv6->ip6_nxt != IPPROTO_AH)) {
-                        pkt_eh = (struct ip6_eh *)((char *)pkt_eh + (pkt_eh->eh_len + 1) * 8);
-                    }
-
-                    if ((unsigned char *)pkt_eh >= pkt_end) {
-                        continue;
-                    }
-                    else {
-                        ulhtype = pkt_eh->eh_nxt;
-                        pkt_icmp6 = (struct icmp6_hdr *)((char *)pkt_eh + (pkt_eh->eh_len + 1) * 8);
-                        pkt_udp = (struct udp_hdr *)pkt_icmp6;
-                        pkt_icmp6 = (struct icmp6_hdr *)pkt_icmp6;
-                        pkt_tcp = (struct tcp_hdr *)pkt_icmp6;
-                        pkt_ah = (struct ah_hdr *)pkt_icmp6;
-                        pkt_esp = (struct esp_hdr *)pkt_icmp6;
-                        pkt_ns = (struct nd_neighbor_solicit *)pkt_icmp6;
-                    }
-                }
-                else {
-                    ulhtype = pkt_ipv6->ip6_nxt;
-                    pkt_icmp6 = (struct icmp6_hdr *)((char *)pkt_ipv6 + sizeof(struct ip6_hdr));
-                    pkt_ns = (struct nd_neighbor_solicit *)pkt_icmp6;
-                    pkt_tcp = (struct tcp_hdr *)pkt_icmp6;
-                    pkt_ah = (struct ah_hdr *)pkt_icmp6;
-                    pkt_esp = (struct esp_hdr *)pkt_icmp6;
-                    pkt_udp = (struct udp_hdr *)pkt_icmp6;
-                }
+                pkt_ether = (struct ether_header *)pktdata;
+                pkt_ipv6 = pview.ipv6;
+                pkt_end = pview.end;
+                ulhtype = pview.proto;
+                pkt_icmp6 = (struct icmp6_hdr *)pview.upper;
+                pkt_ns = (struct nd_neighbor_solicit *)pkt_icmp6;
+                pkt_tcp = (struct tcp_hdr *)pkt_icmp6;
+                pkt_ah = (struct ah_hdr *)pkt_icmp6;
+                pkt_esp = (struct esp_hdr *)pkt_icmp6;
+                pkt_udp = (struct udp_hdr *)pkt_icmp6;
 
                 /*
                    At this point, we have skipped IPv6 EHs if there were any, and pkt_* pointers are set
@@ -1334,6 +1327,9 @@ int main(int argc, char **argv) {
                 test[nhop][nprobe].srcaddr = nsrc;
                 test[nhop][nprobe].rflow = nflow;
 
+                if (stats_f)
+                    record_latency(&metrics, &(test[nhop][nprobe].ststamp), &(test[nhop][nprobe].rtstamp));
+
                 /* If we got a response to a probe packet, allow for an additional probe to be sent */
                 send_f = TRUE;
 
@@ -1347,6 +1343,17 @@ int main(int argc, char **argv) {
 
                 endhost_f = 0;
             }
+
+            if (r == -1) {
+                if (idata.verbose_f)
+                    printf("pcap_next_ex(): %s", pcap_geterr(idata.pfd));
+
+                exit(EXIT_FAILURE);
+            }
+            else if (r == PCAP_ERROR_BREAK) {
+                /* End of the savefile (see open_rx_replay()) */
+                break;
+            }
         }
     }
 
@@ -1363,7 +1370,8 @@ void usage(void) {
          "       [-s SRC_ADDR[/LEN]] [-u DST_OPT_HDR_SIZE] [-U DST_OPT_U_HDR_SIZE]\n"
          "       [-H HBH_OPT_HDR_SIZE] [-y FRAG:SIZE] [-f FLOW_LABEL]\n"
          "       [-m MODE] [-p PROBE_TYPE] [-P PAYLOAD_SIZE] [-a DST_PORT] \n"
-         "       [-X TCP_FLAGS] [-r RATE_LIMIT] [-v] [-h]");
+         "       [-X TCP_FLAGS] [-r RATE_LIMIT] [--read-pcap PCAP_FILE]\n"
+         "       [--stats-interval SECONDS] [-v] [-h]");
 }
 
 /*
@@ -1393,6 +1401,8 @@ void print_help(void) {
          "  --dst-port, -a            Transport-layer Destination Port\n"
          "  --tcp-flags, -X           TCP Flags\n"
          "  --rate-limit, -r          Rate limit the probe packets\n"
+         "  --read-pcap               Read the responses from a pcap savefile\n"
+         "  --stats-interval          Print the runtime metrics every SECONDS (and as JSON at exit)\n"
          "  --verbose, -v             Be verbose\n"
          "  --help, -h                Print help for the path6 tool\n"
          "\n"
@@ -1838,13 +1848,13 @@ int send_probe(struct iface_data *idata, unsigned int probetype, unsigned char c
     if (!idata->fragh_f) {
         ipv6->ip6_plen = htons((ptr - v6buffer) - MIN_IPV6_HLEN);
 
-        if ((nw = pcap_inject(idata->pfd, buffer, ptr - buffer)) == -1) {
-            printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+        if ((nw = send_frame(idata, buffer, ptr - buffer)) == -1) {
+            printf("send_frame(): %s\n", send_frame_error(idata));
             return (-1);
         }
 
         if (nw != (ptr - buffer)) {
-            printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+            printf("send_frame(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
             return (-1);
         }
 
@@ -1866,7 +1876,7 @@ int send_probe(struct iface_data *idata, unsigned int probetype, unsigned char c
 
         memcpy(fptr, (char *)&fraghdr, FRAG_HDR_SIZE);
         fh = (struct ip6_frag *)fptr;
-        fh->ip6f_ident = random();
+        fh->ip6f_ident = prng_random32();
         startoffragment = fptr + FRAG_HDR_SIZE;
 
         /*
@@ -1897,13 +1907,13 @@ int send_probe(struct iface_data *idata, unsigned int probetype, unsigned char c
 
             fipv6->ip6_plen = htons((fptr - fragbuffer) - MIN_IPV6_HLEN - idata->linkhsize);
 
-            if ((nw = pcap_inject(idata->pfd, fragbuffer, fptr - fragbuffer)) == -1) {
-                printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+            if ((nw = send_frame(idata, fragbuffer, fptr - fragbuffer)) == -1) {
+                printf("send_frame(): %s\n", send_frame_error(idata));
                 exit(EXIT_FAILURE);
             }
 
             if (nw != (fptr - fragbuffer)) {
-                printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+                printf("send_frame(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
                 exit(EXIT_FAILURE);
             }
         } /* Sending fragments */
@@ -75,6 +75,7 @@ unsigned char *fragpart, *fptr, *fptrend, *ptrend;
 struct ip6_hdr *ipv6, *pkt_ipv6, *fipv6;
 struct nd_router_advert *ra;
 struct nd_router_solicit *pkt_rs;
+struct packet_view pview;
 struct nd_opt_rdnss_l *dnsopt;
 struct ether_header *ethernet, *pkt_ether;
 struct nd_opt_mtu *mtuopt;
@@ -149,10 +150,15 @@ unsigned char loop_f = 0, sleep_f = 0, accepted_f = 0, newdata_f = 0;
 struct iface_data idata;
 struct filters filters;
 
+/* Additional interfaces (repeated '-i' options) served concurrently in listening mode */
+struct iface_set ifset;
+struct iface_data *ifdata;
+char extraiface[MAX_IFACE_SET - 1][IFACE_LENGTH];
+unsigned int nextraifaces = 0;
+
 int main(int argc, char **argv) {
     extern char *optarg;
     int r, sel, rtepref;
-    fd_set sset, rset;
 #if defined(sun) || defined(__sun) || defined(__linux__)
     struct timeval timeout;
 #endif
@@ -195,6 +201,7 @@ int main(int argc, char **argv) {
                                        {"accept-dst-addr", required_argument, 0, 'g'},
                                        {"accept-link-src-addr", required_argument, 0, 'B'},
                                        {"accept-link-dst-addr", required_argument, 0, 'G'},
+                                       {"filter-file", required_argument, 0, 'I'},
                                        {"loop", no_argument, 0, 'l'},
                                        {"sleep", required_argument, 0, 'z'},
                                        {"listen", no_argument, 0, 'L'},
@@ -236,6 +243,18 @@ int main(int argc, char **argv) {
         switch (option) {
 
         case 'i': /* Interface */
+            if (idata.iface_f) {
+                if (nextraifaces >= (MAX_IFACE_SET - 1)) {
+                    puts("Error: Too many interfaces specified");
+                    exit(EXIT_FAILURE);
+                }
+
+                strncpy(extraiface[nextraifaces], optarg, IFACE_LENGTH);
+                extraiface[nextraifaces][IFACE_LENGTH - 1] = 0;
+                nextraifaces++;
+                break;
+            }
+
             strncpy(idata.iface, optarg, IFACE_LENGTH);
             idata.iface[IFACE_LENGTH - 1] = 0;
             idata.ifindex = if_nametoindex(idata.iface);
@@ -1039,6 +1058,14 @@ int main(int argc, char **argv) {
             filters.acceptfilters_f = 1;
             break;
 
+        case 'I': /* Address filters from a file */
+            if (load_filter_file(&filters, optarg) == FAILURE) {
+                printf("Error while loading address filters from file %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+
+            break;
+
         case 'l': /* "Loop mode */
             loop_f = 1;
             break;
@@ -1081,11 +1108,55 @@ int main(int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
 
+    if (nextraifaces && !listen_f) {
+        puts("Error: Multiple interfaces can only be specified in 'listen' mode");
+        exit(EXIT_FAILURE);
+    }
+
     if (load_dst_and_pcap(&idata, LOAD_PCAP_ONLY) == FAILURE) {
         puts("Error while learning Source Address and Next Hop");
         exit(EXIT_FAILURE);
     }
 
+    if (init_tx_batch(&idata, TX_BATCH_SIZE) == FAILURE) {
+        puts("Error while initializing batched transmission");
+        exit(EXIT_FAILURE);
+    }
+
+    if (add_iface_set(&ifset, &idata) == FAILURE) {
+        puts("Error while adding the interface to the interface set");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < nextraifaces; i++) {
+        if ((ifdata = clone_iface_data(&idata, extraiface[i])) == NULL) {
+            puts("Error initializing internal data structure");
+            exit(EXIT_FAILURE);
+        }
+
+        ifdata->ifindex = if_nametoindex(ifdata->iface);
+
+        if (load_dst_and_pcap(ifdata, LOAD_PCAP_ONLY) == FAILURE) {
+            printf("Error while learning Source Address and Next Hop for interface %s\n", ifdata->iface);
+            exit(EXIT_FAILURE);
+        }
+
+        if (pcap_datalink(ifdata->pfd) != DLT_EN10MB) {
+            printf("Error: Interface %s is not an Ethernet interface\n", ifdata->iface);
+            exit(EXIT_FAILURE);
+        }
+
+        if (init_tx_batch(ifdata, TX_BATCH_SIZE) == FAILURE) {
+            puts("Error while initializing batched transmission");
+            exit(EXIT_FAILURE);
+        }
+
+        if (add_iface_set(&ifset, ifdata) == FAILURE) {
+            printf("Error while adding interface %s to the interface set\n", ifdata->iface);
+            exit(EXIT_FAILURE);
+        }
+    }
+
     release_privileges();
 
     if (pcap_datalink(idata.pfd) != DLT_EN10MB) {
@@ -1156,6 +1227,20 @@ int main(int argc, char **argv) {
             exit(EXIT_FAILURE);
         }
 
+    /* Additional interfaces advertise their own link-local address, unless a source address was specified */
+    for (i = 1; i < ifset.niface; i++) {
+        ifdata = ifset.iface[i];
+
+        if (!idata.srcaddr_f && !floods_f && ifdata->ip6_local_flag)
+            ifdata->srcaddr = ifdata->ip6_local;
+        else
+            ifdata->srcaddr = idata.srcaddr;
+
+        ifdata->srcpreflen = idata.srcpreflen;
+        ifdata->dstaddr = idata.dstaddr;
+        ifdata->hdstaddr = idata.hdstaddr;
+    }
+
     if (sllopt_f && !sllopta_f) {     /* The value of the source link-layer address option  */
         linkaddr[0] = idata.hsrcaddr; /* defaults to the source Ethernet address            */
         nlinkaddr++;
@@ -1239,52 +1324,64 @@ int main(int argc, char **argv) {
     }
 
     if (listen_f) {
+        if (compile_filters(&filters) == FAILURE) {
+            puts("Error while compiling the address filters");
+            exit(EXIT_FAILURE);
+        }
+
+        for (i = 0; i < ifset.niface; i++) {
+            if (set_filters_bpf(ifset.iface[i], &filters, PCAP_ICMPV6_RS_FILTER) == FAILURE) {
+                puts("Error while pushing the address filters into the capture filter");
+                exit(EXIT_FAILURE);
+            }
+        }
+
         if (idata.verbose_f)
             puts("Listening to incoming ICMPv6 Router Solicitation messages...");
 
-        FD_ZERO(&sset);
-        FD_SET(idata.fd, &sset);
-
         while (listen_f) {
-            rset = sset;
 #if defined(sun) || defined(__sun) || defined(__linux__)
             timeout.tv_usec = 10000;
             timeout.tv_sec = 0;
-            if ((sel = select(idata.fd + 1, &rset, NULL, NULL, &timeout)) == -1) {
+            if ((sel = wait_iface_set(&ifset, &timeout)) == -1) {
 #else
-            if ((sel = select(idata.fd + 1, &rset, NULL, NULL, NULL)) == -1) {
+            if ((sel = wait_iface_set(&ifset, NULL)) == -1) {
 #endif
-                if (errno == EINTR) {
-                    continue;
-                }
-                else {
-                    puts("Error in select()");
-                    exit(EXIT_FAILURE);
-                }
+                puts("Error in select()");
+                exit(EXIT_FAILURE);
             }
 
 #if defined(sun) || defined(__sun) || defined(__linux__)
             if (TRUE) {
 #else
-            if (FD_ISSET(idata.fd, &rset)) {
+            if (sel) {
 #endif
-                /* Read a Router Solicitation message */
-                if ((r = pcap_next_ex(idata.pfd, &pkthdr, &pktdata)) == -1) {
-                    printf("pcap_next_ex(): %s", pcap_geterr(idata.pfd));
+                /* Read a Router Solicitation message from any of the interfaces */
+                if ((r = read_iface_set(&ifset, &ifdata, &pkthdr, &pktdata)) == -1) {
+                    printf("pcap_next_ex(): %s", pcap_geterr(ifdata->pfd));
                     exit(EXIT_FAILURE);
                 }
-                else if (r == 1 && pktdata != NULL) {
+                else if (r == 1) {
+                    /* The capture filter cannot skip Extension Headers, so the packet is checked again here */
+                    if (dissect_packet(ifdata, pktdata, pkthdr, &pview, 0) == FAILURE ||
+                        pview.proto != IPPROTO_ICMPV6 || (pview.flags & PV_LATER_FRAGMENT) ||
+                        pview.upperlen < sizeof(struct nd_router_solicit))
+                        continue;
+
                     pkt_ether = (struct ether_header *)pktdata;
-                    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + ETHER_HDR_LEN);
-                    pkt_rs = (struct nd_router_solicit *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
+                    pkt_ipv6 = pview.ipv6;
+                    pkt_rs = (struct nd_router_solicit *)pview.upper;
+
+                    if (pkt_rs->nd_rs_type != ND_ROUTER_SOLICIT || pkt_rs->nd_rs_code != 0)
+                        continue;
 
                     accepted_f = 0;
 
-                    if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK)) {
+                    if (ifdata->type == DLT_EN10MB && !(ifdata->flags & IFACE_LOOPBACK)) {
                         if (filters.nblocklinksrc) {
                             if (match_ether(filters.blocklinksrc, filters.nblocklinksrc, &(pkt_ether->src))) {
                                 if (idata.verbose_f > 1)
-                                    print_filter_result(&idata, pktdata, BLOCKED);
+                                    print_filter_result(ifdata, pktdata, BLOCKED);
 
                                 continue;
                             }
@@ -1293,34 +1390,32 @@ int main(int argc, char **argv) {
                         if (filters.nblocklinkdst) {
                             if (match_ether(filters.blocklinkdst, filters.nblocklinkdst, &(pkt_ether->dst))) {
                                 if (idata.verbose_f > 1)
-                                    print_filter_result(&idata, pktdata, BLOCKED);
+                                    print_filter_result(ifdata, pktdata, BLOCKED);
 
                                 continue;
                             }
                         }
                     }
 
-                    if (filters.nblocksrc) {
-                        if (match_ipv6(filters.blocksrc, filters.blocksrclen, filters.nblocksrc,
-                                       &(pkt_ipv6->ip6_src))) {
+                    if (filters.blocksrctrie.nprefix) {
+                        if (match_prefix_trie(&(filters.blocksrctrie), &(pkt_ipv6->ip6_src))) {
                             if (idata.verbose_f > 1)
-                                print_filter_result(&idata, pktdata, BLOCKED);
+                                print_filter_result(ifdata, pktdata, BLOCKED);
 
                             continue;
                         }
                     }
 
-                    if (filters.nblockdst) {
-                        if (match_ipv6(filters.blockdst, filters.blockdstlen, filters.nblockdst,
-                                       &(pkt_ipv6->ip6_dst))) {
+                    if (filters.blockdsttrie.nprefix) {
+                        if (match_prefix_trie(&(filters.blockdsttrie), &(pkt_ipv6->ip6_dst))) {
                             if (idata.verbose_f > 1)
-                                print_filter_result(&idata, pktdata, BLOCKED);
+                                print_filter_result(ifdata, pktdata, BLOCKED);
 
                             continue;
                         }
                     }
 
-                    if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK)) {
+                    if (ifdata->type == DLT_EN10MB && !(ifdata->flags & IFACE_LOOPBACK)) {
                         if (filters.nacceptlinksrc) {
                             if (match_ether(filters.acceptlinksrc, filters.nacceptlinksrc, &(pkt_ether->src)))
                                 accepted_f = 1;
@@ -1332,30 +1427,28 @@ int main(int argc, char **argv) {
                         }
                     }
 
-                    if (filters.nacceptsrc && !accepted_f) {
-                        if (match_ipv6(filters.acceptsrc, filters.acceptsrclen, filters.nacceptsrc,
-                                       &(pkt_ipv6->ip6_src)))
+                    if (filters.acceptsrctrie.nprefix && !accepted_f) {
+                        if (match_prefix_trie(&(filters.acceptsrctrie), &(pkt_ipv6->ip6_src)))
                             accepted_f = 1;
                     }
 
-                    if (filters.nacceptdst && !accepted_f) {
-                        if (match_ipv6(filters.acceptdst, filters.acceptdstlen, filters.nacceptdst,
-                                       &(pkt_ipv6->ip6_dst)))
+                    if (filters.acceptdsttrie.nprefix && !accepted_f) {
+                        if (match_prefix_trie(&(filters.acceptdsttrie), &(pkt_ipv6->ip6_dst)))
                             accepted_f = 1;
                     }
 
                     if (filters.acceptfilters_f && !accepted_f) {
                         if (idata.verbose_f > 1)
-                            print_filter_result(&idata, pktdata, BLOCKED);
+                            print_filter_result(ifdata, pktdata, BLOCKED);
 
                         continue;
                     }
 
                     if (idata.verbose_f > 1)
-                        print_filter_result(&idata, pktdata, ACCEPTED);
+                        print_filter_result(ifdata, pktdata, ACCEPTED);
 
                     /* Send a Router Advertisement */
-                    send_packet(&idata, pktdata);
+                    send_packet(ifdata, pktdata);
                 }
             }
         }
@@ -1528,9 +1621,9 @@ void send_packet(struct iface_data *idata, const u_char *pktdata) {
     if (pktdata == NULL) {
         sources = 0;
     }
-    else { /* Sending a response to a Router Solicitation message */
+    else { /* Sending a response to a Router Solicitation message (already dissected into pview) */
         pkt_ether = (struct ether_header *)pktdata;
-        pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata->linkhsize);
+        pkt_ipv6 = pview.ipv6;
         pkt_ipv6addr = &(pkt_ipv6->ip6_src);
 
         /* If the IPv6 Source Address of the incoming Router Solicitation is the unspecified
@@ -1568,6 +1661,10 @@ void send_packet(struct iface_data *idata, const u_char *pktdata) {
             ethernet->src = idata->hsrcaddr;
             sources = 0;
             multicastdst_f = 1;
+
+            /* The RS may have been received on any of the interfaces (see read_iface_set()) */
+            if (sllopt_f && !sllopta_f)
+                memcpy(sllaopt->address, ethernet->src.a, ETH_ALEN);
         }
         else {
             ipv6->ip6_src = pkt_ipv6->ip6_dst;
@@ -1771,13 +1868,13 @@ void send_packet(struct iface_data *idata, const u_char *pktdata) {
             if (!idata->fragh_f) {
                 ipv6->ip6_plen = htons((ptr - v6buffer) - MIN_IPV6_HLEN);
 
-                if ((nw = pcap_inject(idata->pfd, buffer, ptr - buffer)) == -1) {
-                    printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+                if ((nw = send_frame(idata, buffer, ptr - buffer)) == -1) {
+                    printf("send_frame(): %s\n", send_frame_error(idata));
                     exit(EXIT_FAILURE);
                 }
 
                 if (nw != (ptr - buffer)) {
-                    printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+                    printf("send_frame(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
                     exit(EXIT_FAILURE);
                 }
             }
@@ -1797,7 +1894,7 @@ void send_packet(struct iface_data *idata, const u_char *pktdata) {
 
                 memcpy(fptr, (char *)&fraghdr, FRAG_HDR_SIZE);
                 fh = (struct ip6_frag *)fptr;
-                fh->ip6f_ident = random();
+                fh->ip6f_ident = prng_random32();
                 startoffragment = fptr + FRAG_HDR_SIZE;
                 /*
                  * Check that the selected fragment size is not larger than the largest fragment size
@@ -1827,13 +1924,13 @@ void send_packet(struct iface_data *idata, const u_char *pktdata) {
 
                     fipv6->ip6_plen = htons((fptr - fragbuffer) - MIN_IPV6_HLEN - idata->linkhsize);
 
-                    if ((nw = pcap_inject(idata->pfd, fragbuffer, fptr - fragbuffer)) == -1) {
-                        printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+                    if ((nw = send_frame(idata, fragbuffer, fptr - fragbuffer)) == -1) {
+                        printf("send_frame(): %s\n", send_frame_error(idata));
                         exit(EXIT_FAILURE);
                     }
 
                     if (nw != (fptr - fragbuffer)) {
-                        printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+                        printf("send_frame(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
                         exit(EXIT_FAILURE);
                     }
                 }
@@ -1843,6 +1940,11 @@ void send_packet(struct iface_data *idata, const u_char *pktdata) {
             newdata_f);
         sources++;
     } while (sources < nsources);
+
+    if (flush_tx_batch(idata) == -1) {
+        printf("Error while sending packets: %s\n", send_frame_error(idata));
+        exit(EXIT_FAILURE);
+    }
 }
 
 /*
@@ -1914,6 +2016,7 @@ void print_help(void) {
          "  --accept-dst, -g           Accept IPv6 Destination Address prefix\n"
          "  --accept-link-src, -B      Accept Ethernet Source Address\n"
          "  --accept-link-dst, -G      Accept Ethernet Destination Address\n"
+         "  --filter-file              Load address filters from a file\n"
          "  --verbose, -v              Be verbose\n"
          "  --help, -h                 Print help for the ra6 tool\n"
          "\n"
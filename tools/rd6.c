@@ -200,6 +200,7 @@ int main(int argc, char **argv) {
                                        {"accept-dst-addr", required_argument, 0, 'g'},
                                        {"accept-link-src-addr", required_argument, 0, 'B'},
                                        {"accept-link-dst-addr", required_argument, 0, 'G'},
+                                       {"filter-file", required_argument, 0, 'I'},
                                        {"sanity-filters", no_argument, 0, 'f'},
                                        {"flood-dests", required_argument, 0, 'R'},
                                        {"flood-targets", required_argument, 0, 'T'},
@@ -876,6 +877,14 @@ int main(int argc, char **argv) {
             filters.acceptfilters_f = 1;
             break;
 
+        case 'I': /* Address filters from a file */
+            if (load_filter_file(&filters, optarg) == FAILURE) {
+                printf("Error while loading address filters from file %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+
+            break;
+
         case 'f': /* Sanity filters */
             sanityfilters_f = 1;
             break;
@@ -1008,12 +1017,16 @@ int main(int argc, char **argv) {
     }
 
     if (learnrouter_f) {
-        randomize_ether_addr(&rs_ether);
-        ether_to_ipv6_linklocal(&rs_ether, &rs_ipv6);
+        if (!lookup_router_cache(&idata, &router_ipv6, &router_ether)) {
+            randomize_ether_addr(&rs_ether);
+            ether_to_ipv6_linklocal(&rs_ether, &rs_ipv6);
 
-        if (find_ipv6_router(idata.pfd, &rs_ether, &rs_ipv6, &router_ether, &router_ipv6) != 0) {
-            puts("Failed learning default IPv6 router");
-            exit(EXIT_FAILURE);
+            if (find_ipv6_router(idata.pfd, &rs_ether, &rs_ipv6, &router_ether, &router_ipv6) != 0) {
+                puts("Failed learning default IPv6 router");
+                exit(EXIT_FAILURE);
+            }
+
+            update_neighbor_cache(&idata, &router_ipv6, &router_ether, TRUE);
         }
 
         if (!idata.hsrcaddr_f) {
@@ -1213,6 +1226,16 @@ int main(int argc, char **argv) {
     }
 
     if (idata.listen_f) {
+        if (compile_filters(&filters) == FAILURE) {
+            puts("Error while compiling the address filters");
+            exit(EXIT_FAILURE);
+        }
+
+        if (set_filters_bpf(&idata, &filters, PCAP_IPV6_FILTER) == FAILURE) {
+            puts("Error while pushing the address filters into the capture filter");
+            exit(EXIT_FAILURE);
+        }
+
         if (idata.verbose_f) {
             print_filters(&idata, &filters);
             puts("Listening to incoming IPv6 messages...");
@@ -1276,9 +1299,8 @@ int main(int argc, char **argv) {
                         }
                     }
 
-                    if (filters.nblocksrc) {
-                        if (match_ipv6(filters.blocksrc, filters.blocksrclen, filters.nblocksrc,
-                                       &(pkt_ipv6->ip6_src))) {
+                    if (filters.blocksrctrie.nprefix) {
+                        if (match_prefix_trie(&(filters.blocksrctrie), &(pkt_ipv6->ip6_src))) {
                             if (idata.verbose_f > 1)
                                 print_filter_result(&idata, pktdata, BLOCKED);
 
@@ -1286,9 +1308,8 @@ int main(int argc, char **argv) {
                         }
                     }
 
-                    if (filters.nblockdst) {
-                        if (match_ipv6(filters.blockdst, filters.blockdstlen, filters.nblockdst,
-                                       &(pkt_ipv6->ip6_dst))) {
+                    if (filters.blockdsttrie.nprefix) {
+                        if (match_prefix_trie(&(filters.blockdsttrie), &(pkt_ipv6->ip6_dst))) {
                             if (idata.verbose_f > 1)
                                 print_filter_result(&idata, pktdata, BLOCKED);
 
@@ -1308,15 +1329,13 @@ int main(int argc, char **argv) {
                         }
                     }
 
-                    if (filters.nacceptsrc && !accepted_f) {
-                        if (match_ipv6(filters.acceptsrc, filters.acceptsrclen, filters.nacceptsrc,
-                                       &(pkt_ipv6->ip6_src)))
+                    if (filters.acceptsrctrie.nprefix && !accepted_f) {
+                        if (match_prefix_trie(&(filters.acceptsrctrie), &(pkt_ipv6->ip6_src)))
                             accepted_f = 1;
                     }
 
-                    if (filters.nacceptdst && !accepted_f) {
-                        if (match_ipv6(filters.acceptdst, filters.acceptdstlen, filters.nacceptdst,
-                                       &(pkt_ipv6->ip6_dst)))
+                    if (filters.acceptdsttrie.nprefix && !accepted_f) {
+                        if (match_prefix_trie(&(filters.acceptdsttrie), &(pkt_ipv6->ip6_dst)))
                             accepted_f = 1;
                     }
 
@@ -1806,7 +1825,7 @@ void send_packet(struct iface_data *idata, const u_char *pktdata, struct pcap_pk
 
                     memcpy(fptr, (char *)&fraghdr, FRAG_HDR_SIZE);
                     fh = (struct ip6_frag *)fptr;
-                    fh->ip6f_ident = random();
+                    fh->ip6f_ident = prng_random32();
                     startoffragment = fptr + FRAG_HDR_SIZE;
 
                     /*
@@ -1924,6 +1943,7 @@ void print_help(void) {
          "  --accept-dst, -g          Accept IPv6 Destination Address prefix\n"
          "  --accept-link-src, -B     Accept Ethernet Source Address\n"
          "  --accept-link-dst, -G     Accept Ethernet Destination Address\n"
+         "  --filter-file             Load address filters from a file\n"
          "  --sanity-filters, -f      Add sanity filters\n"
          "  --flood-dests, -R         Flood with multiple Redirect Destination Addresses\n"
          "  --flood-targets, -T       Flood with multiple Redirect Target Addresses\n"
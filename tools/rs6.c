@@ -762,7 +762,7 @@ void send_packet(struct iface_data *idata) {
 
                 memcpy(fptr, (char *)&fraghdr, FRAG_HDR_SIZE);
                 fh = (struct ip6_frag *)fptr;
-                fh->ip6f_ident = random();
+                fh->ip6f_ident = prng_random32();
                 startoffragment = fptr + FRAG_HDR_SIZE;
 
                 /*
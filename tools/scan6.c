@@ -31,6 +31,7 @@
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 
 #include <arpa/inet.h>
 #include <net/if.h>
@@ -44,7 +45,6 @@
 #include <ctype.h>
 #include <errno.h>
 #include <getopt.h>
-#include <setjmp.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -61,24 +61,40 @@
 /* Function prototypes */
 void init_packet_data(struct iface_data *);
 int create_candidate_globals(struct iface_data *, struct host_list *, struct host_list *, struct host_list *);
-int find_local_globals(pcap_t *, struct iface_data *, unsigned char, const char *, struct host_list *);
 void free_host_entries(struct host_list *);
-int host_scan_local(pcap_t *, struct iface_data *, struct in6_addr *, unsigned char, struct host_entry *);
-int multi_scan_local(pcap_t *, struct iface_data *, struct in6_addr *, unsigned char, const char *, struct host_list *);
+int build_local_probe(struct local_probe *, unsigned char);
+int multi_scan_local(struct iface_set *, struct local_scan *, unsigned char, unsigned char);
+int run_local_probes(struct iface_set *, struct local_probe *, unsigned int, unsigned char);
+void scan_local_set(struct iface_set *);
+int set_local_filter(struct iface_data *, unsigned char);
 void print_help(void);
 void print_port_entries(struct port_list *);
 int print_host_entries(struct host_list *, unsigned char);
 int print_unique_host_entries(struct host_list *, unsigned char);
-void local_sig_alarm(int);
 void usage(void);
-int validate_host_entries(pcap_t *, struct iface_data *, struct host_list *, struct host_list *);
+int validate_host_entries(struct iface_set *, struct local_scan *);
 
 int probe_node_nd(const char *, struct ether_addr *, struct in6_addr *, struct in6_addr *, struct ether_addr *);
 int process_icmp6_response(struct iface_data *, struct host_list *, unsigned char, struct pcap_pkthdr *, const u_char *,
                            unsigned char *);
-int valid_icmp6_response(struct iface_data *, unsigned char, struct pcap_pkthdr *, const u_char *, unsigned char *);
-int valid_icmp6_response_remote(struct iface_data *, struct scan_list *, unsigned char, struct pcap_pkthdr *,
-                                const u_char *, unsigned char *);
+int valid_icmp6_response(struct iface_data *, unsigned char, struct packet_view *, unsigned char *);
+int valid_icmp6_response_remote(struct iface_data *, unsigned char, struct packet_view *, struct timeval *);
+int valid_tcp_response_remote(struct ip6_hdr *, struct tcp_hdr *);
+void init_probe_key(void);
+int read_probe_key(const char *);
+void init_random_key(uint8_t *, size_t);
+int init_scan_perm(struct scan_list *);
+uint64_t permute_scan_index(struct scan_list *, uint64_t);
+int get_next_perm_target(struct scan_list *);
+void take_scan_checkpoint(struct scan_list *, struct scan_checkpoint *);
+uint64_t scan_list_fingerprint(struct scan_list *);
+int save_scan_checkpoint(const char *, struct scan_list *, struct scan_checkpoint *);
+int load_scan_checkpoint(const char *, struct scan_list *);
+int update_scan_checkpoint(struct scan_list *, struct timeval *);
+void local_sig_int(int);
+uint32_t probe_cookie(struct in6_addr *, struct in6_addr *, uint16_t);
+void set_probe_timestamp(unsigned char *);
+void get_probe_timestamp(const unsigned char *, struct timeval *);
 int print_scan_entries(struct scan_list *);
 int load_ipv4mapped32_entries(struct scan_list *, struct scan_entry *, struct prefix4_entry *);
 int load_ipv4mapped64_entries(struct scan_list *, struct scan_entry *, struct prefix4_entry *);
@@ -97,7 +113,7 @@ int match_strings(char *, char *);
 int load_bruteforce_entries(struct scan_list *, struct scan_entry *);
 void prefix_to_scan(struct prefix_entry *, struct scan_entry *);
 void print_port_entries(struct port_list *);
-void print_port_scan(struct port_list *, unsigned int *, int);
+void print_port_scan(struct port_list *, struct hashed_host_entry *, int);
 void print_port_table(struct port_table_entry *, unsigned int);
 int get_next_target(struct scan_list *);
 
@@ -105,22 +121,44 @@ int get_next_port(struct port_list *);
 int is_port_in_range(struct port_list *);
 int is_target_in_range(struct scan_list *);
 int send_probe_remote(struct iface_data *, struct scan_list *, struct in6_addr *, unsigned char);
-int send_pscan_probe(struct iface_data *, struct scan_list *, struct port_list *, struct in6_addr *, unsigned char);
+int send_pscan_probe(struct iface_data *, struct in6_addr *, struct port_list *, struct in6_addr *, unsigned char);
+unsigned int index_port_list(struct port_list *, unsigned int);
+int init_hashed_host_list(struct hashed_host_list *, unsigned int, unsigned int);
+void reset_hashed_host_list(struct hashed_host_list *);
+unsigned int hashed_host_key(struct in6_addr *);
+struct hashed_host_entry *add_hashed_host_entry(struct hashed_host_list *, struct in6_addr *);
+struct hashed_host_entry *find_hashed_host_entry(struct hashed_host_list *, struct in6_addr *);
+void set_port_result(struct hashed_host_entry *, unsigned int, unsigned int);
+unsigned int get_port_result(struct hashed_host_entry *, unsigned int);
 void reset_scan_list(struct scan_list *);
 void reset_port_list(struct port_list *);
 int process_config_file(const char *);
 int is_ip6_in_scan_list(struct scan_list *, struct in6_addr *);
+int find_scan_index(struct scan_index_entry *, unsigned int, unsigned int, union my6_addr *);
+union my6_addr *set_scan_index_maxend(struct scan_index_entry *, unsigned int, unsigned int);
+int is_ip6_in_scan_entry(struct scan_entry *, union my6_addr *);
+int build_scan_index(struct scan_list *);
+int compare_scan_index(const void *, const void *);
 int add_to_scan_list(struct scan_list *, struct scan_entry *);
-int is_scan_entry_duplicate(struct scan_list *, struct scan_entry *);
-
-/* Used for multiscan */
-struct host_list host_local, host_global, host_candidate;
-struct host_entry *host_locals[MAX_IPV6_ENTRIES], *host_globals[MAX_IPV6_ENTRIES];
-struct host_entry *host_candidates[MAX_IPV6_ENTRIES];
+int normalize_scan_list(struct scan_list *);
+int compare_scan_norm(const void *, const void *);
+int compare_scan_norm_pos(const void *, const void *);
+int is_scan_range_contiguous(union my6_addr *, union my6_addr *);
+int is_my6_addr_next(union my6_addr *, union my6_addr *);
+int open_worker_pcaps(struct iface_data *, unsigned int);
+unsigned int check_scan_routes(struct iface_data *, struct scan_list *);
+int shard_scan_list(struct scan_list *, unsigned int, unsigned int);
+int start_scan_workers(struct iface_data *, struct scan_list *);
 
 /* Used for router discovery */
 struct iface_data idata;
 
+/* Additional interfaces (repeated '-i' options) for local scans */
+struct iface_set ifset;
+struct iface_data *ifdata;
+char extraiface[MAX_IFACE_SET - 1][IFACE_LENGTH];
+unsigned int nextraifaces = 0;
+
 /* Variables used for learning the default router */
 struct ether_addr router_ether, rs_ether;
 struct in6_addr router_ipv6, rs_ipv6;
@@ -141,6 +179,7 @@ struct nd_neighbor_solicit *pkt_ns;
 struct tcp_hdr *pkt_tcp;
 struct udp_hdr *pkt_udp;
 struct ip6_eh *pkt_eh;
+struct packet_view pview;
 int result;
 unsigned char error_f;
 
@@ -219,8 +258,31 @@ struct port_entry *udp_prt_list[MAX_PORT_ENTRIES];
 struct port_table_entry tcp_port_table[MAX_PORT_RANGE];
 struct port_table_entry udp_port_table[MAX_PORT_RANGE];
 
-/* These arrays maintain the port scan results for a single node */
-unsigned int *port_results, tcp_results[MAX_PORT_RANGE], udp_results[MAX_PORT_RANGE];
+/* Hosts that are being port-scanned concurrently (with their port scan results) */
+struct hashed_host_list pscan_hosts;
+struct hashed_host_entry *pscan_host;
+unsigned int npscanports, chost;
+
+/* Sender/receiver workers for sharded remote scans (one libpcap handle per worker) */
+pcap_t *worker_pfd[MAX_SCAN_WORKERS];
+struct metrics worker_metrics[MAX_SCAN_WORKERS]; /* Latest metrics reported by each worker */
+unsigned int nworkers = 1, worker_id = 0;
+unsigned char workers_f = FALSE;
+
+/* Used for checkpoints */
+char ckptfile[MAX_FILENAME_SIZE + 8];
+unsigned char checkpoint_f = FALSE, resume_f = FALSE;
+volatile sig_atomic_t interrupted_f = FALSE;
+struct scan_checkpoint ckpt_prev;
+struct timeval lastckpt;
+
+/*
+   Remote probes carry a keyed cookie (computed over the addresses and port of the probe), such that responses can be
+   validated without keeping any per-probe state
+ */
+uint8_t probe_key[PROBE_KEY_SIZE];
+unsigned char probekey_f = FALSE, noprobekey_f = FALSE, probecookie_f = TRUE;
+unsigned int tcp_probe_seglen;
 
 /* Load top ports */
 unsigned char loadalltopports_f = FALSE, loadtcptopports_f = FALSE, loadudptopports_f = FALSE;
@@ -236,7 +298,7 @@ unsigned char tgt_knowniids_f = FALSE, tgt_knowniidsfile_f = FALSE, knownprefixe
 unsigned char vm_vbox_f = FALSE, vm_vmware_f = FALSE, vm_vmware_esx_f = FALSE, vm_vmware_vsphere_f = FALSE,
               vm_vmwarem_f = FALSE, v4hostaddr_f = FALSE;
 unsigned char v4hostprefix_f = FALSE, sort_ouis_f = FALSE, rnd_probes_f = FALSE, inc_f = FALSE, end_f = FALSE,
-              endpscan_f = FALSE;
+              endpscan_f = FALSE, randorder_f = FALSE;
 unsigned char donesending_f = FALSE, nomoreaddr_f = FALSE;
 unsigned char onlink_f = FALSE, pps_f = FALSE, bps_f = FALSE, tcpflags_f = FALSE, rhbytes_f = FALSE, srcport_f = FALSE,
               dstport_f = FALSE, probetype;
@@ -268,16 +330,21 @@ uint16_t service_ports_hex[] = {0x21,   0x22,   0x23,   0x25,   0x49,   0x53,
 uint16_t service_ports_dec[] = {21,  22,  23,  25,  49,   53,   80,   110,  123,  179,  220, 389,
                                 443, 547, 993, 995, 1194, 3306, 5060, 5061, 5432, 6446, 8080};
 
-/* IPv6 Address Resolution */
-static sigjmp_buf env;
-static unsigned int canjump;
+/* Used for measuring the packet-generation speed (see open_tx_dump()) */
+char *txdumpfile = NULL;
+
+/* Runtime metrics (see init_metrics()) */
+struct metrics metrics;
+unsigned int statsinterval;
+unsigned char stats_f = FALSE;
 
 int main(int argc, char **argv) {
     extern char *optarg;
     int r;
     struct addrinfo hints, *res, *aiptr;
     struct target_ipv6 target;
-    struct timeval timeout;
+    struct timeval timeout, probesent;
+    double timeout_s;
     char date[DATE_STR_LEN], *endptr;
     uint8_t ulhtype;
     struct scan_entry dummy;
@@ -324,12 +391,22 @@ int main(int argc, char **argv) {
                                        {"rate-limit", required_argument, 0, 'r'},
                                        {"loop", no_argument, 0, 'l'},
                                        {"sleep", required_argument, 0, 'z'},
+                                       {"threads", required_argument, 0, 'n'},
+                                       {"random-order", no_argument, 0, 'R'},
+                                       {"checkpoint", required_argument, 0, 'C'},
+                                       {"resume", required_argument, 0, 'J'},
                                        {"config-file", required_argument, 0, 'c'},
+                                       {"write-pcap", required_argument, 0, 'Y'},
+                                       {"dry-run", no_argument, 0, '3'},
+                                       {"read-pcap", required_argument, 0, 'M'},
+                                       {"stats-interval", required_argument, 0, '1'},
+                                       {"probe-key", required_argument, 0, '2'},
+                                       {"no-probe-key", no_argument, 0, '4'},
                                        {"verbose", no_argument, 0, 'v'},
                                        {"help", no_argument, 0, 'h'},
                                        {0, 0, 0, 0}};
 
-    const char shortopts[] = "i:s:d:u:U:H:y:S:D:Lp:Z:o:a:X:P:j:G:qetx:O:fFV:bB:gk:K:w:W:m:Q:TNI:r:lz:c:vh";
+    const char shortopts[] = "i:s:d:u:U:H:y:S:D:Lp:Z:o:a:X:P:j:G:qetx:O:fFV:bB:gk:K:w:W:m:Q:TNI:r:lz:n:RC:J:c:Y:vh";
 
     char option;
 
@@ -385,6 +462,18 @@ int main(int argc, char **argv) {
 
         switch (option) {
         case 'i': /* Interface */
+            if (idata.iface_f) {
+                if (nextraifaces >= (MAX_IFACE_SET - 1)) {
+                    puts("Error: Too many interfaces specified");
+                    exit(EXIT_FAILURE);
+                }
+
+                strncpy(extraiface[nextraifaces], optarg, IFACE_LENGTH);
+                extraiface[nextraifaces][IFACE_LENGTH - 1] = 0;
+                nextraifaces++;
+                break;
+            }
+
             strncpy(idata.iface, optarg, IFACE_LENGTH);
             idata.iface[IFACE_LENGTH - 1] = 0;
             idata.ifindex = if_nametoindex(idata.iface);
@@ -471,7 +560,8 @@ int main(int argc, char **argv) {
 
                     if (smart_f || (prefix.len == 64 && !is_iid_null(&(prefix.ip6), 64))) {
                         if (smart_list.ntarget <= smart_list.maxtarget) {
-                            if ((smart_list.target[smart_list.ntarget] = malloc(sizeof(struct scan_entry))) == NULL) {
+                            if ((smart_list.target[smart_list.ntarget] =
+                                     arena_alloc(&(smart_list.arena), sizeof(struct scan_entry))) == NULL) {
                                 if (idata.verbose_f)
                                     puts("scan6: Not enough memory");
 
@@ -512,7 +602,8 @@ int main(int argc, char **argv) {
                         sanitize_ipv6_prefix(&(prefix.ip6), prefix.len);
 
                         if (prefix_list.ntarget <= prefix_list.maxtarget) {
-                            if ((prefix_list.target[prefix_list.ntarget] = malloc(sizeof(struct scan_entry))) == NULL) {
+                            if ((prefix_list.target[prefix_list.ntarget] =
+                                     arena_alloc(&(prefix_list.arena), sizeof(struct scan_entry))) == NULL) {
                                 if (idata.verbose_f)
                                     puts("scan6: Not enough memory");
 
@@ -660,7 +751,8 @@ int main(int argc, char **argv) {
                 }
 
                 if (prefix_list.ntarget <= prefix_list.maxtarget) {
-                    if ((prefix_list.target[prefix_list.ntarget] = malloc(sizeof(struct scan_entry))) == NULL) {
+                    if ((prefix_list.target[prefix_list.ntarget] =
+                             arena_alloc(&(prefix_list.arena), sizeof(struct scan_entry))) == NULL) {
                         if (idata.verbose_f)
                             puts("scan6: Not enough memory");
 
@@ -711,7 +803,8 @@ int main(int argc, char **argv) {
                 /* If the Prefix length is /128 (explicitly set, or by omission), we do a smart scan */
                 if (smart_f || (prefix.len == 64 && !is_iid_null(&(prefix.ip6), 64))) {
                     if (smart_list.ntarget <= smart_list.maxtarget) {
-                        if ((smart_list.target[smart_list.ntarget] = malloc(sizeof(struct scan_entry))) == NULL) {
+                        if ((smart_list.target[smart_list.ntarget] =
+                                 arena_alloc(&(smart_list.arena), sizeof(struct scan_entry))) == NULL) {
                             if (idata.verbose_f)
                                 puts("scan6: Not enough memory");
 
@@ -750,7 +843,8 @@ int main(int argc, char **argv) {
                 }
                 else {
                     if (prefix_list.ntarget <= prefix_list.maxtarget) {
-                        if ((prefix_list.target[prefix_list.ntarget] = malloc(sizeof(struct scan_entry))) == NULL) {
+                        if ((prefix_list.target[prefix_list.ntarget] =
+                                 arena_alloc(&(prefix_list.arena), sizeof(struct scan_entry))) == NULL) {
                             if (idata.verbose_f)
                                 puts("scan6: Not enough memory");
 
@@ -1091,7 +1185,13 @@ int main(int argc, char **argv) {
             break;
 
         case 'O':
-            idata.local_timeout = atoi(optarg);
+            /* The timeout may be a fraction of a second (e.g., "0.25") */
+            if ((timeout_s = atof(optarg)) <= 0) {
+                puts("Error in '-O' option: Timeout must be a positive number of seconds");
+                exit(EXIT_FAILURE);
+            }
+
+            idata.local_timeout = timeout_s * 1000000;
             break;
 
         case 'f':
@@ -1372,7 +1472,8 @@ int main(int argc, char **argv) {
                 exit(EXIT_FAILURE);
             }
 
-            if ((iid_list.prefix[iid_list.nprefix] = malloc(sizeof(struct prefix_entry))) == NULL) {
+            if ((iid_list.prefix[iid_list.nprefix] =
+                     arena_alloc(&(iid_list.arena), sizeof(struct prefix_entry))) == NULL) {
                 puts("Not enough memory while storing Interface ID");
                 exit(EXIT_FAILURE);
             }
@@ -1473,6 +1574,66 @@ int main(int argc, char **argv) {
             sleep_f = TRUE;
             break;
 
+        case 'n': /* Number of scan workers */
+            nworkers = atoi(optarg);
+            if (nworkers == 0 || nworkers > MAX_SCAN_WORKERS) {
+                printf("Invalid number of workers in '-n' option (must be between 1 and %u)\n", MAX_SCAN_WORKERS);
+                exit(EXIT_FAILURE);
+            }
+
+            workers_f = TRUE;
+            break;
+
+        case 'R': /* Scan the targets in pseudorandom order */
+            randorder_f = TRUE;
+            break;
+
+        case 'C': /* Checkpoint file */
+        case 'J': /* Resume from checkpoint file */
+            if (checkpoint_f) {
+                puts("Cannot specify more than one checkpoint file ('-C' or '-J' options)");
+                exit(EXIT_FAILURE);
+            }
+
+            strncpy(ckptfile, optarg, MAX_FILENAME_SIZE - 1);
+            ckptfile[MAX_FILENAME_SIZE - 1] = 0;
+            checkpoint_f = TRUE;
+
+            if (r == 'J')
+                resume_f = TRUE;
+
+            break;
+
+        case 'Y': /* Write the packets to a savefile, rather than sending them */
+            txdumpfile = optarg;
+            break;
+
+        case '3': /* Discard the packets, rather than sending them */
+            txdumpfile = "/dev/null";
+            break;
+
+        case 'M': /* Read the responses from a savefile, rather than from the network */
+            idata.rxreplayfile = optarg;
+            break;
+
+        case '2': /* Key of the probe cookies (for replaying the responses to a previous scan) */
+            if (!read_probe_key(optarg)) {
+                printf("The probe key must be specified as %u hexadecimal bytes\n", PROBE_KEY_SIZE);
+                exit(EXIT_FAILURE);
+            }
+
+            probekey_f = TRUE;
+            break;
+
+        case '4': /* Do not validate the probe cookies of the replayed responses */
+            noprobekey_f = TRUE;
+            break;
+
+        case '1': /* Print the runtime metrics periodically */
+            statsinterval = atoi(optarg);
+            stats_f = TRUE;
+            break;
+
         case 'v': /* Be verbose */
             idata.verbose_f++;
             break;
@@ -1512,6 +1673,17 @@ int main(int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
 
+    if (nextraifaces && !scan_local_f) {
+        puts("Error: Multiple interfaces can only be specified for local scans ('-L')");
+        exit(EXIT_FAILURE);
+    }
+
+    /* A Source Address belongs to a single link */
+    if (nextraifaces && idata.srcaddr_f) {
+        puts("Error: A Source Address ('-s') cannot be specified when scanning multiple interfaces");
+        exit(EXIT_FAILURE);
+    }
+
     /* Must open the "Known IIDs" file now, since it might be non-readable for the unprivileged user */
     if (tgt_knowniidsfile_f) {
         if ((knowniids_fp = fopen(knowniidsfile, "r")) == NULL) {
@@ -1537,21 +1709,116 @@ int main(int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
 
+    if (workers_f && (scan_local_f || portscan_f)) {
+        puts("The '-n' option is only supported for remote address scans");
+        exit(EXIT_FAILURE);
+    }
+
+    /* When replaying a savefile, the probes are not sent */
+    if (idata.rxreplayfile != NULL && txdumpfile == NULL)
+        txdumpfile = "/dev/null";
+
+    if (txdumpfile != NULL && nextraifaces) {
+        puts("Error: Multiple interfaces cannot be used when writing packets to a savefile ('-Y' or '--dry-run') or "
+             "when reading packets from a savefile ('--read-pcap')");
+        exit(EXIT_FAILURE);
+    }
+
+    if (txdumpfile != NULL && workers_f) {
+        puts("The '-n' option cannot be used when writing packets to a savefile ('-Y' or '--dry-run') or when reading "
+             "packets from a savefile ('--read-pcap')");
+        exit(EXIT_FAILURE);
+    }
+
+    if (noprobekey_f && (probekey_f || idata.rxreplayfile == NULL)) {
+        puts("The '--no-probe-key' option can only be used with '--read-pcap', and not along with '--probe-key'");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Without the key of the scan that produced the savefile, no response would pass the probe cookie checks */
+    if (idata.rxreplayfile != NULL && !scan_local_f && !probekey_f && !noprobekey_f) {
+        puts("Replaying the responses to a remote scan ('--read-pcap') requires the key of that scan ('--probe-key'), "
+             "or '--no-probe-key' to accept the responses without validating their probe cookies");
+        exit(EXIT_FAILURE);
+    }
+
+    if (probekey_f && workers_f) {
+        puts("The '--probe-key' option cannot be used with multiple workers ('-n'), since each of them employs its "
+             "own key");
+        exit(EXIT_FAILURE);
+    }
+
+    if (checkpoint_f && scan_local_f) {
+        puts("Checkpoints ('-C' and '-J' options) are not supported for local scans");
+        exit(EXIT_FAILURE);
+    }
+
     if (!scan_local_f) {
+        /*
+           With several target ranges, the routing table snapshot is loaded before the Source Address and Next Hop
+           are selected, such that the routes of all ranges are looked up without further queries to the kernel
+         */
+        if (scan_list.ntarget > 1 && idata.rxreplayfile == NULL)
+            load_route_table(&idata);
+
         if (load_dst_and_pcap(&idata, LOAD_SRC_NXT_HOP) == FAILURE) {
             puts("Error while learning Source Address and Next Hop");
             exit(EXIT_FAILURE);
         }
+
+        /* Each worker needs its own libpcap handle, and these cannot be opened once we have dropped privileges */
+        if (nworkers > 1) {
+            if (open_worker_pcaps(&idata, nworkers) == FAILURE) {
+                puts("Error while opening libpcap handles for the scan workers");
+                exit(EXIT_FAILURE);
+            }
+        }
     }
     else {
         if (load_dst_and_pcap(&idata, LOAD_PCAP_ONLY) == FAILURE) {
             puts("Error while learning Source Address and Next Hop");
             exit(EXIT_FAILURE);
         }
+
+        if (add_iface_set(&ifset, &idata) == FAILURE) {
+            puts("Error while adding the interface to the interface set");
+            exit(EXIT_FAILURE);
+        }
+
+        /* The capture handles of the additional interfaces cannot be opened once we have dropped privileges */
+        for (i = 0; i < nextraifaces; i++) {
+            if ((ifdata = clone_iface_data(&idata, extraiface[i])) == NULL) {
+                puts("Error initializing internal data structure");
+                exit(EXIT_FAILURE);
+            }
+
+            ifdata->ifindex = if_nametoindex(ifdata->iface);
+
+            if (load_dst_and_pcap(ifdata, LOAD_PCAP_ONLY) == FAILURE) {
+                printf("Error while learning Source Address and Next Hop for interface %s\n", ifdata->iface);
+                exit(EXIT_FAILURE);
+            }
+
+            if (add_iface_set(&ifset, ifdata) == FAILURE) {
+                printf("Error while adding interface %s to the interface set\n", ifdata->iface);
+                exit(EXIT_FAILURE);
+            }
+        }
     }
 
     release_privileges();
 
+    if (txdumpfile != NULL && open_tx_dump(&idata, txdumpfile) == FAILURE) {
+        printf("Error while opening savefile %s\n", txdumpfile);
+        exit(EXIT_FAILURE);
+    }
+
+    if (stats_f && (init_metrics(&metrics, "scan6", statsinterval) == FAILURE ||
+                    attach_metrics(&metrics, &idata) == FAILURE)) {
+        puts("Error while initializing the runtime metrics");
+        exit(EXIT_FAILURE);
+    }
+
     /* This loads prefixes, but not scan entries */
     if (knownprefixes_f) {
         if (!load_knownprefix_entries(&scan_list, &prefix_list, knownprefixes_fp)) {
@@ -1562,6 +1829,10 @@ int main(int argc, char **argv) {
 
     if (!inc_f)
         scan_list.inc = 1;
+    else if (randorder_f) {
+        puts("Cannot specify an increment size ('-I') when scanning targets in pseudorandom order ('-R')");
+        exit(EXIT_FAILURE);
+    }
 
     if (pps_f && bps_f) {
         puts("Cannot specify a rate-limit in bps and pps at the same time");
@@ -1600,6 +1871,10 @@ int main(int argc, char **argv) {
     if (!pps_f && !bps_f)
         pktinterval = 1000;
 
+    /* Packets written to a savefile are generated as fast as possible */
+    if (txdumpfile != NULL)
+        pktinterval = 0;
+
     if (!configfile_f) {
         strncpy(configfile, "/etc/ipv6toolkit.conf", MAX_FILENAME_SIZE);
     }
@@ -1676,9 +1951,11 @@ int main(int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
 
-    if (scan_local_f && (idata.type != DLT_EN10MB || (idata.flags & IFACE_TUNNEL))) {
-        puts("Error cannot apply local scan on a loopback or tunnel interface");
-        exit(EXIT_FAILURE);
+    for (i = 0; i < ifset.niface; i++) {
+        if (ifset.iface[i]->type != DLT_EN10MB || (ifset.iface[i]->flags & IFACE_TUNNEL)) {
+            printf("Error cannot apply local scan on a loopback or tunnel interface (%s)\n", ifset.iface[i]->iface);
+            exit(EXIT_FAILURE);
+        }
     }
 
     if (!print_f) {
@@ -1704,7 +1981,8 @@ int main(int argc, char **argv) {
             idata.ip6_local_flag = TRUE;
         }
         else {
-            if ((idata.ip6_global.prefix[idata.ip6_global.nprefix] = malloc(sizeof(struct prefix_entry))) == NULL) {
+            if ((idata.ip6_global.prefix[idata.ip6_global.nprefix] =
+                     arena_alloc(&(idata.ip6_global.arena), sizeof(struct prefix_entry))) == NULL) {
                 if (idata.verbose_f) {
                     puts("Not enough memory while saving global address");
                 }
@@ -1720,117 +1998,8 @@ int main(int argc, char **argv) {
     if ((idata.ip6_local_flag && idata.ip6_global_flag) && !idata.srcaddr_f)
         localaddr_f = TRUE;
 
-    if (scan_local_f) {
-        host_local.nhosts = 0;
-        host_local.maxhosts = MAX_IPV6_ENTRIES;
-        host_local.host = host_locals;
-
-        if (probe_echo_f) {
-            if (multi_scan_local(idata.pfd, &idata, &(idata.ip6_local), PROBE_ICMP6_ECHO, ALL_NODES_MULTICAST_ADDR,
-                                 &host_local) == -1) {
-                if (idata.verbose_f)
-                    puts("Error while learning link-local addresses with ICMPv6 Echo Requests");
-
-                exit(EXIT_FAILURE);
-            }
-        }
-
-        if (probe_unrec_f) {
-            if (multi_scan_local(idata.pfd, &idata, &(idata.ip6_local), PROBE_UNREC_OPT, ALL_NODES_MULTICAST_ADDR,
-                                 &host_local) == -1) {
-                if (idata.verbose_f)
-                    puts("Error while learning link-local addresses with Unrecognized options");
-
-                exit(EXIT_FAILURE);
-            }
-        }
-
-        if (print_local_f) {
-            if (idata.verbose_f)
-                puts("Link-local addresses:");
-
-            if (print_unique_f) {
-                if (print_unique_host_entries(&host_local, print_type) == -1) {
-                    if (idata.verbose_f)
-                        puts("Error while printing link-local addresses");
-
-                    exit(EXIT_FAILURE);
-                }
-            }
-            else {
-                if (print_host_entries(&host_local, print_type) == -1) {
-                    if (idata.verbose_f)
-                        puts("Error while printing link-local addresses");
-
-                    exit(EXIT_FAILURE);
-                }
-            }
-        }
-
-        if (print_global_f) {
-            host_global.nhosts = 0;
-            host_global.maxhosts = MAX_IPV6_ENTRIES;
-            host_global.host = host_globals;
-
-            if (probe_echo_f) {
-                if (find_local_globals(idata.pfd, &idata, PROBE_ICMP6_ECHO, ALL_NODES_MULTICAST_ADDR, &host_global) ==
-                    -1) {
-                    if (idata.verbose_f)
-                        puts("Error while learning link-local addresses with ICMPv6 Echo Requests");
-
-                    exit(EXIT_FAILURE);
-                }
-            }
-
-            if (probe_unrec_f) {
-                if (find_local_globals(idata.pfd, &idata, PROBE_UNREC_OPT, ALL_NODES_MULTICAST_ADDR, &host_global) ==
-                    -1) {
-                    if (idata.verbose_f)
-                        puts("Error while learning link-local addresses with Unrecognized options");
-
-                    exit(EXIT_FAILURE);
-                }
-            }
-
-            host_candidate.nhosts = 0;
-            host_candidate.maxhosts = MAX_IPV6_ENTRIES;
-            host_candidate.host = host_candidates;
-
-            if (create_candidate_globals(&idata, &host_local, &host_global, &host_candidate) == -1) {
-                if (idata.verbose_f)
-                    puts("Error while creating candidate global addresses");
-
-                exit(EXIT_FAILURE);
-            }
-
-            if (validate_host_entries(idata.pfd, &idata, &host_candidate, &host_global) == -1) {
-                if (idata.verbose_f)
-                    puts("Error while validating global entries");
-
-                exit(EXIT_FAILURE);
-            }
-
-            if (idata.verbose_f)
-                puts("\nGlobal addresses:");
-
-            if (print_unique_f) {
-                if (print_unique_host_entries(&host_global, print_type) == -1) {
-                    if (idata.verbose_f)
-                        puts("Error while printing global addresses");
-
-                    exit(EXIT_FAILURE);
-                }
-            }
-            else {
-                if (print_host_entries(&host_global, print_type) == -1) {
-                    if (idata.verbose_f)
-                        puts("Error while printing global addresses");
-
-                    exit(EXIT_FAILURE);
-                }
-            }
-        }
-    }
+    if (scan_local_f)
+        scan_local_set(&ifset);
 
     /* Perform a port-scan */
     else if (portscan_f) {
@@ -1932,6 +2101,17 @@ int main(int argc, char **argv) {
 
         /* scan_list.ctarget= scan_list.first; */
 
+        /* Remove duplicate ranges, and merge overlapping ones */
+        if ((r = normalize_scan_list(&scan_list)) == -1) {
+            puts("Error while normalizing target address ranges");
+            exit(EXIT_FAILURE);
+        }
+
+        if (randorder_f && !init_scan_perm(&scan_list)) {
+            puts("Error while initializing the pseudorandom order of the targets (target ranges may be too large)");
+            exit(EXIT_FAILURE);
+        }
+
         puts(SI6_TOOLKIT);
         puts("scan6: An advanced IPv6 scanning tool\n");
 
@@ -1940,7 +2120,7 @@ int main(int argc, char **argv) {
         }
 
         if (idata.verbose_f) {
-            printf("Target address ranges (%d)\n", scan_list.ntarget);
+            printf("Target address ranges (%d, %d duplicate or overlapping ranges coalesced)\n", scan_list.ntarget, r);
 
             if (!print_scan_entries(&scan_list)) {
                 puts("Error while printing target address ranges");
@@ -1956,6 +2136,13 @@ int main(int argc, char **argv) {
             exit(EXIT_FAILURE);
         }
 
+        /* All probes are sent to a single next hop: warn about target ranges that the kernel would route elsewhere */
+        if (!scan_local_f && scan_list.ntarget > 1 && idata.verbose_f && !idata.hdstaddr_f &&
+            idata.rxreplayfile == NULL && (r = check_scan_routes(&idata, &scan_list)) > 0) {
+            printf("Warning: %d target ranges are not routed through the next hop of the scan (%s)\n", r,
+                   idata.nhiface);
+        }
+
         if (idata.verbose_f) {
             if (tcp_port_list.nport) {
                 printf("Target TCP ports: ");
@@ -2020,49 +2207,88 @@ int main(int argc, char **argv) {
         FD_ZERO(&sset);
         FD_SET(idata.fd, &sset);
 
-        /* One loop for each address */
+        if (checkpoint_f) {
+            if (resume_f && !load_scan_checkpoint(ckptfile, &scan_list)) {
+                printf("Error while resuming the scan from checkpoint file %s\n", ckptfile);
+                exit(EXIT_FAILURE);
+            }
+
+            if (gettimeofday(&lastckpt, NULL) == -1) {
+                if (idata.verbose_f)
+                    perror("scan6");
+
+                exit(EXIT_FAILURE);
+            }
+
+            signal(SIGINT, local_sig_int);
+        }
+
+        /*
+           Hosts are port-scanned in batches: the probes for all the target ports of all the hosts of a batch are
+           interleaved, and the tool only waits for the responses once per batch (rather than once per host)
+         */
+        init_probe_key();
+        npscanports = index_port_list(&tcp_port_list, 0);
+        npscanports = index_port_list(&udp_port_list, npscanports);
+
+        if (!init_hashed_host_list(&pscan_hosts, PSCAN_BATCH_SIZE, npscanports)) {
+            puts("Error while allocating memory for the port scan results");
+            exit(EXIT_FAILURE);
+        }
 
         nomoreaddr_f = FALSE;
 
+        /* One loop for each batch of addresses */
         while (!nomoreaddr_f) {
-            if (tcp_port_list.nport) {
-                pscantype = IPPROTO_TCP;
-                port_list = &tcp_port_list;
-                port_results = tcp_results;
-            }
-            else if (udp_port_list.nport) {
-                pscantype = IPPROTO_UDP;
-                port_list = &udp_port_list;
-                port_results = udp_results;
+            /* Check whether the current scan_entry is within range. Otherwise, get the next target */
+            if (!is_target_in_range(&scan_list)) {
+                if (!get_next_target(&scan_list)) {
+                    nomoreaddr_f = TRUE;
+                    continue;
+                }
             }
-            else {
-                /* Should never happen */
-                puts("Error: Port scan selected, but no target TCP or UDP ports");
+
+            /* A resumed port scan starts over from the first host of the current batch */
+            if (checkpoint_f) {
+                take_scan_checkpoint(&scan_list, &ckpt_prev);
+
+                if (gettimeofday(&curtime, NULL) == -1) {
+                    if (idata.verbose_f)
+                        perror("scan6");
+
+                    exit(EXIT_FAILURE);
+                }
+
+                if (is_time_elapsed(&curtime, &lastckpt, CHECKPOINT_INTERVAL * 1000000) &&
+                    !update_scan_checkpoint(&scan_list, &curtime)) {
+                    printf("Error while writing checkpoint file %s\n", ckptfile);
+                    exit(EXIT_FAILURE);
+                }
             }
 
-            endpscan_f = FALSE;
-            end_f = FALSE;
-            donesending_f = FALSE;
+            reset_hashed_host_list(&pscan_hosts);
+
+            while (pscan_hosts.nhosts < pscan_hosts.maxhosts) {
+                if (add_hashed_host_entry(&pscan_hosts, &(scan_list.target[scan_list.ctarget]->cur.in6_addr)) ==
+                    NULL) {
+                    puts("Error while adding host to the port scan");
+                    exit(EXIT_FAILURE);
+                }
 
-            /* Check whether the current scan_entry is within range. Otherwise, get the next target */
-            if (!is_target_in_range(&scan_list)) {
                 if (!get_next_target(&scan_list)) {
-                    /* donesending_f=TRUE; */
                     nomoreaddr_f = TRUE;
-                    continue;
+                    break;
                 }
             }
 
+            /* We always start with TCP scans (if there are any target ports) */
             if (tcp_port_list.nport) {
-                /* Initialize port scan results for TCP (default to filtered) */
-                for (i = 0; i < MAX_PORT_ENTRIES; i++)
-                    tcp_results[i] = PORT_FILTERED;
+                pscantype = IPPROTO_TCP;
+                port_list = &tcp_port_list;
             }
-
-            if (udp_port_list.nport) {
-                /* Initialize port scan results for UDP (default to open) */
-                for (i = 0; i < MAX_PORT_ENTRIES; i++)
-                    udp_results[i] = PORT_OPEN;
+            else {
+                pscantype = IPPROTO_UDP;
+                port_list = &udp_port_list;
             }
 
             /* Reset the port entries */
@@ -2072,357 +2298,347 @@ int main(int argc, char **argv) {
             if (udp_port_list.nport)
                 reset_port_list(&udp_port_list);
 
-            print_ipv6_address("\nPort scan report for: ", &(scan_list.target[scan_list.ctarget]->cur.in6_addr));
-            puts("PORT      STATE     SERVICE");
+            chost = 0;
+            end_f = FALSE;
+            donesending_f = FALSE;
+            lastprobe.tv_sec = 0;
+            lastprobe.tv_usec = 0;
+            idata.pending_write_f = TRUE;
+
+            /* end_f is set when donesending_f and proper time has elapsed */
+            while (!end_f) {
+                if (interrupted_f) {
+                    if (!save_scan_checkpoint(ckptfile, &scan_list, &ckpt_prev))
+                        printf("Error while writing checkpoint file %s\n", ckptfile);
+                    else if (idata.verbose_f)
+                        printf("\nScan interrupted (resume it with '-J %s')\n", ckptfile);
 
-            /* endpscan_f is set when all protocols have been scanned */
-            while (!endpscan_f) {
-                lastprobe.tv_sec = 0;
-                lastprobe.tv_usec = 0;
-                idata.pending_write_f = TRUE;
+                    exit(EXIT_FAILURE);
+                }
 
-                /* end_f is set when donesending_f and proper time has elapsed */
-                while (!end_f) {
-                    rset = sset;
-                    wset = sset;
-                    eset = sset;
+                rset = sset;
+                wset = sset;
+                eset = sset;
 
-                    if (!donesending_f) {
-                        timeout.tv_sec = pktinterval / 1000000;
-                        timeout.tv_usec = pktinterval % 1000000;
-                    }
-                    else {
+                if (!donesending_f) {
+                    timeout.tv_sec = pktinterval / 1000000;
+                    timeout.tv_usec = pktinterval % 1000000;
+                }
+                else {
 #if defined(sun) || defined(__sun) || defined(__linux__)
-                        timeout.tv_sec = pktinterval / 1000000;
-                        timeout.tv_usec = pktinterval % 1000000;
+                    timeout.tv_sec = pktinterval / 1000000;
+                    timeout.tv_usec = pktinterval % 1000000;
 #else
-                        timeout.tv_usec = 0;
-                        timeout.tv_sec = PSCAN_TIMEOUT;
+                    timeout.tv_usec = 0;
+                    timeout.tv_sec = PSCAN_TIMEOUT;
 #endif
-                    }
+                }
 
-                    /*
-                            Check for readability and exceptions. We only check for writeability if there is pending
-                       data to send (the pcap descriptor will usually be writeable!).
-                     */
-                    if ((sel = select(idata.fd + 1, &rset, (idata.pending_write_f ? &wset : NULL), &eset, &timeout)) ==
-                        -1) {
-                        if (errno == EINTR) {
-                            continue;
-                        }
-                        else {
-                            perror("scan6:");
-                            exit(EXIT_FAILURE);
-                        }
+                /*
+                        Check for readability and exceptions. We only check for writeability if there is pending
+                   data to send (the pcap descriptor will usually be writeable!).
+                 */
+                if ((sel = select(idata.fd + 1, &rset, (idata.pending_write_f ? &wset : NULL), &eset, &timeout)) ==
+                    -1) {
+                    if (errno == EINTR) {
+                        continue;
                     }
-
-                    if (gettimeofday(&curtime, NULL) == -1) {
-                        if (idata.verbose_f)
-                            perror("scan6");
-
+                    else {
+                        perror("scan6:");
                         exit(EXIT_FAILURE);
                     }
+                }
 
-                    /* Check whether we have finished probing all ports */
-                    if (donesending_f) {
-                        if (is_time_elapsed(&curtime, &lastprobe, SELECT_TIMEOUT * 1000000)) {
-                            end_f = TRUE;
-                        }
+                if (gettimeofday(&curtime, NULL) == -1) {
+                    if (idata.verbose_f)
+                        perror("scan6");
+
+                    exit(EXIT_FAILURE);
+                }
+
+                /* Check whether we have finished probing all ports of all hosts */
+                if (donesending_f) {
+                    if (is_time_elapsed(&curtime, &lastprobe, SELECT_TIMEOUT * 1000000)) {
+                        end_f = TRUE;
                     }
+                }
 
 #if !defined(sun) && !defined(__sun) && !defined(__linux__)
-                    /*
-                       If we didn't check for writeability in the previous call to select(), we must do it now.
-                       Otherwise, we might block when trying to send a packet.
-                     */
-                    if (!donesending_f && !idata.pending_write_f) {
-                        wset = sset;
+                /*
+                   If we didn't check for writeability in the previous call to select(), we must do it now.
+                   Otherwise, we might block when trying to send a packet.
+                 */
+                if (!donesending_f && !idata.pending_write_f) {
+                    wset = sset;
 
-                        timeout.tv_usec = 0;
-                        timeout.tv_sec = 0;
+                    timeout.tv_usec = 0;
+                    timeout.tv_sec = 0;
 
-                        if ((sel = select(idata.fd + 1, NULL, &wset, NULL, &timeout)) == -1) {
-                            if (errno == EINTR) {
-                                continue;
-                            }
-                            else {
-                                perror("scan6:");
-                                exit(EXIT_FAILURE);
-                            }
+                    if ((sel = select(idata.fd + 1, NULL, &wset, NULL, &timeout)) == -1) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        else {
+                            perror("scan6:");
+                            exit(EXIT_FAILURE);
                         }
-
-                        idata.pending_write_f = TRUE;
                     }
+
+                    idata.pending_write_f = TRUE;
+                }
 #endif
 
 #if defined(sun) || defined(__sun) || defined(__linux__)
-                    if (TRUE) {
+                if (TRUE) {
 #else
-                    if (sel && FD_ISSET(idata.fd, &rset)) {
+                if (sel && FD_ISSET(idata.fd, &rset)) {
 #endif
-                        /* Must process incoming packet */
-                        error_f = FALSE;
-
-                        if ((result = pcap_next_ex(idata.pfd, &pkthdr, &pktdata)) == -1) {
-                            if (idata.verbose_f)
-                                printf("Error while reading packet in main loop: pcap_next_ex(): %s",
-                                       pcap_geterr(idata.pfd));
-
-                            exit(EXIT_FAILURE);
-                        }
-
-                        if (result == 1 && pktdata != NULL) {
-                            pkt_ether = (struct ether_header *)pktdata;
-                            pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata.linkhsize);
-                            pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
-
-                            if ((pkt_end - pktdata) < (idata.linkhsize + MIN_IPV6_HLEN)) {
-                                continue;
-                            }
-
-                            /* Skip IPv6 EHs if present */
-                            ulhtype = pkt_ipv6->ip6_nxt;
-                            pkt_eh = (struct ip6_eh *)((char *)pkt_ipv6 + sizeof(struct ip6_hdr));
+                    /* Must process incoming packet */
+                    error_f = FALSE;
 
-                            droppacket_f = FALSE;
+                    /* Drain all the packets that are available, rather than processing one per loop turn */
+                    while ((result = read_frame(&idata, &pkthdr, &pktdata)) == 1) {
+                        if (pktdata == NULL)
+                            continue;
 
-                            while (ulhtype != IPPROTO_ICMPV6 && ulhtype != IPPROTO_TCP && ulhtype != IPPROTO_UDP &&
-                                   !droppacket_f) {
-                                if (ulhtype == IPPROTO_FRAGMENT) {
-                                    if (((unsigned char *)pkt_eh + sizeof(struct ip6_frag)) > pkt_end) {
-                                        droppacket_f = TRUE;
-                                        break;
-                                    }
+                        /* Non-first fragments cannot be matched to our probes */
+                        if (dissect_packet(&idata, pktdata, pkthdr, &pview, 0) == FAILURE ||
+                            (pview.flags & PV_LATER_FRAGMENT))
+                            continue;
 
-                                    fh = (struct ip6_frag *)((char *)pkt_eh);
+                        pkt_ether = (struct ether_header *)pktdata;
+                        pkt_ipv6 = pview.ipv6;
+                        pkt_end = pview.end;
+                        ulhtype = pview.proto;
+                        pkt_eh = (struct ip6_eh *)pview.upper;
+
+                        pkt_icmp6 = (struct icmp6_hdr *)((char *)pkt_eh);
+                        pkt_tcp = (struct tcp_hdr *)((char *)pkt_eh);
+                        pkt_udp = (struct udp_hdr *)((char *)pkt_eh);
+                        pkt_ns = (struct nd_neighbor_solicit *)((char *)pkt_eh);
+
+                        if (ulhtype == IPPROTO_ICMPV6) {
+                            if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK) &&
+                                pkt_icmp6->icmp6_type == ND_NEIGHBOR_SOLICIT) {
+                                if ((pkt_end - (unsigned char *)pkt_ns) < sizeof(struct nd_neighbor_solicit))
+                                    continue;
 
-                                    if (fh->ip6f_offlg & IP6F_OFF_MASK) {
-                                        droppacket_f = TRUE;
-                                        break;
-                                    }
+                                /*
+                                        If the addresses that we're using are not actually configured on the local
+                                   system (i.e., they are "spoofed", we must check whether it is a Neighbor
+                                   Solicitation for one of our addresses, and respond with a Neighbor Advertisement.
+                                   Otherwise, the kernel will take care of that.
+                                 */
+                                if (is_ip6_in_address_list(&(idata.ip6_global), &(pkt_ns->nd_ns_target)) ||
+                                    is_eq_in6_addr(&(pkt_ns->nd_ns_target), &(idata.ip6_local))) {
+                                    if (send_neighbor_advert(&idata, idata.pfd, pktdata) == -1) {
+                                        if (idata.verbose_f)
+                                            puts("Error sending Neighbor Advertisement message");
 
-                                    ulhtype = fh->ip6f_nxt;
-                                    pkt_eh = (struct ip6_eh *)((char *)fh + sizeof(struct ip6_frag));
-                                }
-                                else {
-                                    if (((unsigned char *)pkt_eh + sizeof(struct ip6_eh)) > pkt_end) {
-                                        droppacket_f = TRUE;
-                                        break;
+                                        exit(EXIT_FAILURE);
                                     }
-
-                                    ulhtype = pkt_eh->eh_nxt;
-                                    pkt_eh = (struct ip6_eh *)((char *)pkt_eh + (pkt_eh->eh_len + 1) * 8);
-                                }
-
-                                if ((unsigned char *)pkt_eh >= pkt_end) {
-                                    droppacket_f = TRUE;
-                                    break;
                                 }
                             }
+                            else if (udp_port_list.nport && pkt_icmp6->icmp6_type == ICMP6_DST_UNREACH &&
+                                     pkt_icmp6->icmp6_code == ICMP6_DST_UNREACH_NOPORT) {
 
-                            if (droppacket_f) {
-                                continue;
-                            }
+                                /* We are interested in the embedded payload */
+                                pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_icmp6 + sizeof(struct icmp6_hdr));
 
-                            pkt_icmp6 = (struct icmp6_hdr *)((char *)pkt_eh);
-                            pkt_tcp = (struct tcp_hdr *)((char *)pkt_eh);
-                            pkt_udp = (struct udp_hdr *)((char *)pkt_eh);
-                            pkt_ns = (struct nd_neighbor_solicit *)((char *)pkt_eh);
-
-                            if (ulhtype == IPPROTO_ICMPV6) {
-                                if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK) &&
-                                    pkt_icmp6->icmp6_type == ND_NEIGHBOR_SOLICIT) {
-                                    if ((pkt_end - (unsigned char *)pkt_ns) < sizeof(struct nd_neighbor_solicit))
-                                        continue;
-
-                                    /*
-                                            If the addresses that we're using are not actually configured on the local
-                                       system (i.e., they are "spoofed", we must check whether it is a Neighbor
-                                       Solicitation for one of our addresses, and respond with a Neighbor Advertisement.
-                                       Otherwise, the kernel will take care of that.
-                                     */
-                                    if (is_ip6_in_address_list(&(idata.ip6_global), &(pkt_ns->nd_ns_target)) ||
-                                        is_eq_in6_addr(&(pkt_ns->nd_ns_target), &(idata.ip6_local))) {
-                                        if (send_neighbor_advert(&idata, idata.pfd, pktdata) == -1) {
-                                            if (idata.verbose_f)
-                                                puts("Error sending Neighbor Advertisement message");
-
-                                            exit(EXIT_FAILURE);
-                                        }
-                                    }
+                                if (((unsigned char *)pkt_ipv6 + sizeof(struct ip6_hdr)) > pkt_end) {
+                                    continue;
                                 }
-                                else if (pscantype == IPPROTO_UDP && pkt_icmp6->icmp6_type == ICMP6_DST_UNREACH &&
-                                         pkt_icmp6->icmp6_code == ICMP6_DST_UNREACH_NOPORT) {
-
-                                    /* We are interested in the embedded payload */
-                                    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_icmp6 + sizeof(struct icmp6_hdr));
-
-                                    if (((unsigned char *)pkt_ipv6 + sizeof(struct ip6_hdr)) > pkt_end) {
-                                        continue;
-                                    }
 
-                                    if (!is_eq_in6_addr(&(pkt_ipv6->ip6_dst), &(idata.dstaddr))) {
-                                        continue;
-                                    }
-
-                                    ulhtype = pkt_ipv6->ip6_nxt;
-                                    pkt_eh = (struct ip6_eh *)((char *)pkt_ipv6 + sizeof(struct ip6_hdr));
+                                if ((pscan_host = find_hashed_host_entry(&pscan_hosts, &(pkt_ipv6->ip6_dst))) ==
+                                    NULL) {
+                                    count_filter_result(&idata, BLOCKED);
+                                    continue;
+                                }
 
-                                    droppacket_f = FALSE;
+                                ulhtype = pkt_ipv6->ip6_nxt;
+                                pkt_eh = (struct ip6_eh *)((char *)pkt_ipv6 + sizeof(struct ip6_hdr));
 
-                                    while (ulhtype != IPPROTO_ICMPV6 && ulhtype != IPPROTO_TCP &&
-                                           ulhtype != IPPROTO_UDP && !droppacket_f) {
-                                        if (ulhtype == IPPROTO_FRAGMENT) {
-                                            if (((unsigned char *)pkt_eh + sizeof(struct ip6_frag)) > pkt_end) {
-                                                droppacket_f = TRUE;
-                                                break;
-                                            }
+                                droppacket_f = FALSE;
 
-                                            fh = (struct ip6_frag *)((char *)pkt_eh);
+                                while (ulhtype != IPPROTO_ICMPV6 && ulhtype != IPPROTO_TCP &&
+                                       ulhtype != IPPROTO_UDP && !droppacket_f) {
+                                    if (ulhtype == IPPROTO_FRAGMENT) {
+                                        if (((unsigned char *)pkt_eh + sizeof(struct ip6_frag)) > pkt_end) {
+                                            droppacket_f = TRUE;
+                                            break;
+                                        }
 
-                                            if (fh->ip6f_offlg & IP6F_OFF_MASK) {
-                                                droppacket_f = TRUE;
-                                                break;
-                                            }
+                                        fh = (struct ip6_frag *)((char *)pkt_eh);
 
-                                            ulhtype = fh->ip6f_nxt;
-                                            pkt_eh = (struct ip6_eh *)((char *)fh + sizeof(struct ip6_frag));
-                                        }
-                                        else {
-                                            /* If the EH is smaller than the minimum EH, we drop the packet */
-                                            if (((unsigned char *)pkt_eh + sizeof(struct ip6_eh)) > pkt_end) {
-                                                droppacket_f = TRUE;
-                                                break;
-                                            }
-
-                                            ulhtype = pkt_eh->eh_nxt;
-                                            pkt_eh = (struct ip6_eh *)((char *)pkt_eh + (pkt_eh->eh_len + 1) * 8);
+                                        if (fh->ip6f_offlg & IP6F_OFF_MASK) {
+                                            droppacket_f = TRUE;
+                                            break;
                                         }
 
-                                        if ((unsigned char *)pkt_eh >= pkt_end) {
+                                        ulhtype = fh->ip6f_nxt;
+                                        pkt_eh = (struct ip6_eh *)((char *)fh + sizeof(struct ip6_frag));
+                                    }
+                                    else {
+                                        /* If the EH is smaller than the minimum EH, we drop the packet */
+                                        if (((unsigned char *)pkt_eh + sizeof(struct ip6_eh)) > pkt_end) {
                                             droppacket_f = TRUE;
                                             break;
                                         }
-                                    }
 
-                                    if (droppacket_f || ulhtype != IPPROTO_UDP) {
-                                        continue;
+                                        ulhtype = pkt_eh->eh_nxt;
+                                        pkt_eh = (struct ip6_eh *)((char *)pkt_eh + (pkt_eh->eh_len + 1) * 8);
                                     }
 
-                                    pkt_udp = (struct udp_hdr *)((char *)pkt_eh);
-                                    port_results[ntohs(pkt_udp->uh_dport)] = PORT_CLOSED;
+                                    if ((unsigned char *)pkt_eh >= pkt_end) {
+                                        droppacket_f = TRUE;
+                                        break;
+                                    }
                                 }
-                            }
-                            /* We only bother to process TCP segments if we are currently sending TCP segments */
-                            else if (pscantype == IPPROTO_TCP && ulhtype == IPPROTO_TCP) {
-                                if (!is_eq_in6_addr(&(idata.dstaddr), &(pkt_ipv6->ip6_src)))
+
+                                if (droppacket_f || ulhtype != IPPROTO_UDP ||
+                                    ((unsigned char *)pkt_eh + sizeof(struct udp_hdr)) > pkt_end) {
                                     continue;
+                                }
 
-                                if (srcport_f) {
-                                    if (pkt_tcp->th_dport != htons(srcport))
-                                        continue;
+                                pkt_udp = (struct udp_hdr *)((char *)pkt_eh);
+
+                                if (udp_port_table[ntohs(pkt_udp->uh_dport)].index) {
+                                    count_filter_result(&idata, ACCEPTED);
+                                    set_port_result(pscan_host, udp_port_table[ntohs(pkt_udp->uh_dport)].index - 1,
+                                                    PSCAN_RESP_CLOSED);
                                 }
+                            }
+                        }
+                        /* We only bother to process TCP segments if we are sending TCP segments */
+                        else if (tcp_port_list.nport && ulhtype == IPPROTO_TCP) {
+                            if ((pscan_host = find_hashed_host_entry(&pscan_hosts, &(pkt_ipv6->ip6_src))) == NULL) {
+                                count_filter_result(&idata, BLOCKED);
+                                continue;
+                            }
 
-                                if (in_chksum(pkt_ipv6, pkt_tcp, pkt_end - ((unsigned char *)pkt_tcp), IPPROTO_TCP) !=
-                                    0)
+                            if (srcport_f) {
+                                if (pkt_tcp->th_dport != htons(srcport))
                                     continue;
+                            }
 
-                                /* Record the port number -- XXX might use the port-setting techniques from path6 */
-                                if (pkt_tcp->th_flags & TH_RST) {
-                                    port_results[ntohs(pkt_tcp->th_sport)] = PORT_CLOSED;
-                                }
-                                else if (pkt_tcp->th_flags & TH_SYN) {
-                                    port_results[ntohs(pkt_tcp->th_sport)] = PORT_OPEN;
-                                }
+                            if (in_chksum(pkt_ipv6, pkt_tcp, pkt_end - ((unsigned char *)pkt_tcp), IPPROTO_TCP) != 0)
+                                continue;
+
+                            if (!tcp_port_table[ntohs(pkt_tcp->th_sport)].index)
+                                continue;
+
+                            count_filter_result(&idata, ACCEPTED);
+
+                            /* Record the port number -- XXX might use the port-setting techniques from path6 */
+                            if (pkt_tcp->th_flags & TH_RST) {
+                                set_port_result(pscan_host, tcp_port_table[ntohs(pkt_tcp->th_sport)].index - 1,
+                                                PSCAN_RESP_CLOSED);
+                            }
+                            else if (pkt_tcp->th_flags & TH_SYN) {
+                                set_port_result(pscan_host, tcp_port_table[ntohs(pkt_tcp->th_sport)].index - 1,
+                                                PSCAN_RESP_OPEN);
                             }
                         }
                     }
 
-                    if (!donesending_f && !idata.pending_write_f &&
-                        is_time_elapsed(&curtime, &lastprobe, pktinterval)) {
-                        idata.pending_write_f = TRUE;
+                    if (result == -1) {
+                        if (idata.verbose_f)
+                            printf("Error while reading packet in main loop: pcap_next_ex(): %s",
+                                   pcap_geterr(idata.pfd));
+
+                        exit(EXIT_FAILURE);
+                    }
+                    else if (result == PCAP_ERROR_BREAK) {
+                        /* End of the savefile (see open_rx_replay()): report the current batch, and stop */
+                        donesending_f = TRUE;
+                        nomoreaddr_f = TRUE;
+                        end_f = TRUE;
                         continue;
                     }
+                }
+
+                if (!donesending_f && !idata.pending_write_f && is_time_elapsed(&curtime, &lastprobe, pktinterval)) {
+                    idata.pending_write_f = TRUE;
+                    continue;
+                }
 
 #if defined(sun) || defined(__sun) || defined(__linux__)
-                    if (!donesending_f && idata.pending_write_f) {
+                if (!donesending_f && idata.pending_write_f) {
 #else
-                    if (!donesending_f && idata.pending_write_f && FD_ISSET(idata.fd, &wset)) {
+                if (!donesending_f && idata.pending_write_f && FD_ISSET(idata.fd, &wset)) {
 #endif
-                        idata.pending_write_f = FALSE;
+                    idata.pending_write_f = FALSE;
 
-                        /* Check whether the current scan_entry is within range. Otherwise, get the next target */
-                        if (!is_port_in_range(port_list)) {
-                            if (!get_next_port(port_list)) {
-                                if (gettimeofday(&lastprobe, NULL) == -1) {
-                                    if (idata.verbose_f)
-                                        perror("scan6");
+                    if (!send_pscan_probe(&idata, &(pscan_hosts.entries[chost].ip6), port_list, &(idata.srcaddr),
+                                          pscantype)) {
+                        if (tx_dump_stopped())
+                            exit(EXIT_SUCCESS);
 
-                                    exit(EXIT_FAILURE);
-                                }
+                        exit(EXIT_FAILURE);
+                    }
 
-                                donesending_f = TRUE;
-                                continue;
-                            }
-                        }
+                    if (gettimeofday(&lastprobe, NULL) == -1) {
+                        if (idata.verbose_f)
+                            perror("scan6");
 
-                        if (!send_pscan_probe(&idata, &scan_list, port_list, &(idata.srcaddr), pscantype)) {
-                            exit(EXIT_FAILURE);
-                        }
+                        exit(EXIT_FAILURE);
+                    }
 
-                        if (gettimeofday(&lastprobe, NULL) == -1) {
-                            if (idata.verbose_f)
-                                perror("scan6");
+                    /* Each port is probed on all the hosts of the batch before moving to the next port */
+                    chost++;
 
-                            exit(EXIT_FAILURE);
-                        }
+                    if (chost >= pscan_hosts.nhosts) {
+                        chost = 0;
 
                         if (!get_next_port(port_list)) {
-                            donesending_f = TRUE;
-                            continue;
+                            if (pscantype == IPPROTO_TCP && udp_port_list.nport) {
+                                pscantype = IPPROTO_UDP;
+                                port_list = &udp_port_list;
+                            }
+                            else {
+                                donesending_f = TRUE;
+                                continue;
+                            }
                         }
                     }
-
-                    if (FD_ISSET(idata.fd, &eset)) {
-                        if (idata.verbose_f)
-                            puts("scan6: Found exception on libpcap descriptor");
-
-                        exit(EXIT_FAILURE);
-                    }
                 }
 
-                if (pscantype == IPPROTO_TCP) {
-                    /* Result types can be PORT_OPEN, PORT_CLOSED, and PORT_FILTERED */
-                    print_port_scan(port_list, port_results, PORT_OPEN);
-                }
-                else {
-                    print_port_scan(port_list, port_results, PORT_OPEN);
-                }
+                if (FD_ISSET(idata.fd, &eset)) {
+                    if (idata.verbose_f)
+                        puts("scan6: Found exception on libpcap descriptor");
 
-                /* We always start with TCP scans (if there are any target ports) */
-                if (pscantype == IPPROTO_TCP) {
-                    if (udp_port_list.nport) {
-                        pscantype = IPPROTO_UDP;
-                        port_list = &udp_port_list;
-                        port_results = udp_results;
-                    }
-                    else {
-                        endpscan_f = TRUE;
-                    }
-                }
-                else {
-                    endpscan_f = TRUE;
+                    exit(EXIT_FAILURE);
                 }
             }
 
-            if (!get_next_target(&scan_list)) {
-                nomoreaddr_f = TRUE;
-                continue;
+            for (i = 0; i < pscan_hosts.nhosts; i++) {
+                print_ipv6_address("\nPort scan report for: ", &(pscan_hosts.entries[i].ip6));
+                puts("PORT      STATE     SERVICE");
+
+                /* Result types can be PORT_OPEN, PORT_CLOSED, and PORT_FILTERED */
+                if (tcp_port_list.nport)
+                    print_port_scan(&tcp_port_list, &(pscan_hosts.entries[i]), PORT_OPEN);
+
+                if (udp_port_list.nport)
+                    print_port_scan(&udp_port_list, &(pscan_hosts.entries[i]), PORT_OPEN);
+
+                if (!nomoreaddr_f || (i + 1) < pscan_hosts.nhosts)
+                    puts("");
             }
+        }
 
-            puts("");
+        if (checkpoint_f) {
+            take_scan_checkpoint(&scan_list, &ckpt_prev);
+
+            if (!save_scan_checkpoint(ckptfile, &scan_list, &ckpt_prev)) {
+                printf("Error while writing checkpoint file %s\n", ckptfile);
+                exit(EXIT_FAILURE);
+            }
         }
 
+        if (idata.verbose_f)
+            print_pcap_stats(&idata);
+
         exit(EXIT_SUCCESS);
     }
     /* Remote scan */
@@ -2525,12 +2741,23 @@ int main(int argc, char **argv) {
 
         /* scan_list.ctarget= scan_list.first; */
 
+        /* Remove duplicate ranges, and merge overlapping ones */
+        if ((r = normalize_scan_list(&scan_list)) == -1) {
+            puts("Error while normalizing target address ranges");
+            exit(EXIT_FAILURE);
+        }
+
+        if (randorder_f && !init_scan_perm(&scan_list)) {
+            puts("Error while initializing the pseudorandom order of the targets (target ranges may be too large)");
+            exit(EXIT_FAILURE);
+        }
+
         if (idata.verbose_f && !bps_f && !pps_f) {
             puts("Rate-limiting probe packets to 1000 pps (override with the '-r' option if necessary)");
         }
 
         if (idata.verbose_f) {
-            printf("Target address ranges (%d)\n", scan_list.ntarget);
+            printf("Target address ranges (%d, %d duplicate or overlapping ranges coalesced)\n", scan_list.ntarget, r);
 
             if (!print_scan_entries(&scan_list)) {
                 puts("Error while printing target address ranges");
@@ -2546,6 +2773,13 @@ int main(int argc, char **argv) {
             exit(EXIT_FAILURE);
         }
 
+        /* All probes are sent to a single next hop: warn about target ranges that the kernel would route elsewhere */
+        if (!scan_local_f && scan_list.ntarget > 1 && idata.verbose_f && !idata.hdstaddr_f &&
+            idata.rxreplayfile == NULL && (r = check_scan_routes(&idata, &scan_list)) > 0) {
+            printf("Warning: %d target ranges are not routed through the next hop of the scan (%s)\n", r,
+                   idata.nhiface);
+        }
+
         switch (probetype) {
         case PROBE_ICMP6_ECHO:
             if (pcap_compile(idata.pfd, &pcap_filter, PCAP_ICMPV6_ERQNSNA_FILTER, 0, PCAP_NETMASK_UNKNOWN) == -1) {
@@ -2583,11 +2817,68 @@ int main(int argc, char **argv) {
             exit(EXIT_FAILURE);
         }
 
+        /* The handles of the other workers (see open_worker_pcaps()) need the same filter */
+        for (i = 1; i < nworkers; i++) {
+            if (pcap_setfilter(worker_pfd[i], &pcap_filter) == -1) {
+                if (idata.verbose_f > 1)
+                    printf("pcap_setfilter(): %s\n", pcap_geterr(worker_pfd[i]));
+
+                exit(EXIT_FAILURE);
+            }
+        }
+
         pcap_freecode(&pcap_filter);
 
         if (idata.verbose_f)
             puts("\nAlive nodes:");
 
+        /*
+           With multiple workers, the parent process only merges the output of the workers, and never returns from
+           start_scan_workers(). Each worker scans its own shard of the target ranges with the loop below.
+         */
+        if (checkpoint_f)
+            signal(SIGINT, local_sig_int);
+
+        if (nworkers > 1) {
+            if (start_scan_workers(&idata, &scan_list) == FAILURE) {
+                puts("Error while starting the scan workers");
+                exit(EXIT_FAILURE);
+            }
+
+            /* The rate-limit applies to the scan as a whole */
+            pktinterval = pktinterval * nworkers;
+
+            /* Each worker employs its own checkpoint file */
+            if (checkpoint_f)
+                snprintf(ckptfile + strlen(ckptfile), 8, ".%u", worker_id);
+        }
+
+        if (checkpoint_f) {
+            if (resume_f && !load_scan_checkpoint(ckptfile, &scan_list)) {
+                printf("Error while resuming the scan from checkpoint file %s\n", ckptfile);
+                exit(EXIT_FAILURE);
+            }
+
+            /* Checkpoints lag one interval behind, such that the responses to the last probes are not lost */
+            take_scan_checkpoint(&scan_list, &ckpt_prev);
+
+            if (gettimeofday(&lastckpt, NULL) == -1) {
+                if (idata.verbose_f)
+                    perror("scan6");
+
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        /* Each worker employs its own key, such that it only accepts responses to its own probes */
+        init_probe_key();
+
+        /* Build the index employed to match responses against the (possibly sharded) scan ranges */
+        if (!build_scan_index(&scan_list)) {
+            puts("Error while building the index of target address ranges");
+            exit(EXIT_FAILURE);
+        }
+
         FD_ZERO(&sset);
         FD_SET(idata.fd, &sset);
 
@@ -2596,6 +2887,16 @@ int main(int argc, char **argv) {
         idata.pending_write_f = TRUE;
 
         while (!end_f) {
+            if (interrupted_f) {
+                /* With multiple workers, the parent names the checkpoint to resume from (see start_scan_workers()) */
+                if (!save_scan_checkpoint(ckptfile, &scan_list, &ckpt_prev))
+                    printf("Error while writing checkpoint file %s\n", ckptfile);
+                else if (idata.verbose_f && nworkers <= 1)
+                    printf("\nScan interrupted (resume it with '-J %s')\n", ckptfile);
+
+                exit(EXIT_FAILURE);
+            }
+
             rset = sset;
             wset = sset;
             eset = sset;
@@ -2708,27 +3009,27 @@ int main(int argc, char **argv) {
                 puts("Prior to pcap_next_ex()");
 #endif
 
-                if ((result = pcap_next_ex(idata.pfd, &pkthdr, &pktdata)) == -1) {
-                    if (idata.verbose_f)
-                        printf("Error while reading packet in main loop: pcap_next_ex(): %s", pcap_geterr(idata.pfd));
-
-                    exit(EXIT_FAILURE);
-                }
+                /* Drain all the packets that are available, rather than processing one per loop turn */
+                while ((result = read_frame(&idata, &pkthdr, &pktdata)) == 1) {
 #ifdef DEBUG
-                puts("After to pcap_next_ex()");
+                    puts("After to pcap_next_ex()");
 #endif
-                if (result == 1 && pktdata != NULL) {
-                    pkt_ether = (struct ether_header *)pktdata;
-                    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata.linkhsize);
-                    pkt_icmp6 = (struct icmp6_hdr *)((char *)pkt_ipv6 + sizeof(struct ip6_hdr));
-                    pkt_tcp = (struct tcp_hdr *)((char *)pkt_ipv6 + sizeof(struct ip6_hdr));
-                    pkt_ns = (struct nd_neighbor_solicit *)pkt_icmp6;
-                    pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
+                    if (pktdata == NULL)
+                        continue;
 
-                    if ((pkt_end - pktdata) < (idata.linkhsize + MIN_IPV6_HLEN))
+                    /* Non-first fragments cannot be matched to our probes */
+                    if (dissect_packet(&idata, pktdata, pkthdr, &pview, 0) == FAILURE ||
+                        (pview.flags & PV_LATER_FRAGMENT))
                         continue;
 
-                    if (pkt_ipv6->ip6_nxt == IPPROTO_ICMPV6) {
+                    pkt_ether = (struct ether_header *)pktdata;
+                    pkt_ipv6 = pview.ipv6;
+                    pkt_icmp6 = (struct icmp6_hdr *)pview.upper;
+                    pkt_tcp = (struct tcp_hdr *)pview.upper;
+                    pkt_ns = (struct nd_neighbor_solicit *)pkt_icmp6;
+                    pkt_end = pview.end;
+
+                    if (pview.proto == IPPROTO_ICMPV6) {
                         if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK) &&
                             pkt_icmp6->icmp6_type == ND_NEIGHBOR_SOLICIT) {
                             if ((pkt_end - (unsigned char *)pkt_ns) < sizeof(struct nd_neighbor_solicit))
@@ -2738,10 +3039,12 @@ int main(int argc, char **argv) {
                                     If the addresses that we're using are not actually configured on the local system
                                     (i.e., they are "spoofed", we must check whether it is a Neighbor Solicitation for
                                     one of our addresses, and respond with a Neighbor Advertisement. Otherwise, the
-                               kernel will take care of that.
+                               kernel will take care of that. Only the first worker responds, since all workers see
+                               the same Neighbor Solicitations.
                              */
-                            if (is_ip6_in_address_list(&(idata.ip6_global), &(pkt_ns->nd_ns_target)) ||
-                                is_eq_in6_addr(&(pkt_ns->nd_ns_target), &(idata.ip6_local))) {
+                            if (worker_id == 0 &&
+                                (is_ip6_in_address_list(&(idata.ip6_global), &(pkt_ns->nd_ns_target)) ||
+                                 is_eq_in6_addr(&(pkt_ns->nd_ns_target), &(idata.ip6_local)))) {
 #ifdef DEBUG
                                 puts("Prior to send_neighbor_advert()");
 #endif
@@ -2758,13 +3061,20 @@ int main(int argc, char **argv) {
                         }
                         else if ((probetype == PROBE_ICMP6_ECHO && pkt_icmp6->icmp6_type == ICMP6_ECHO_REPLY) ||
                                  (probetype == PROBE_UNREC_OPT && pkt_icmp6->icmp6_type == ICMP6_PARAM_PROB)) {
-                            if (!is_ip6_in_scan_list(&scan_list, &(pkt_ipv6->ip6_src)))
-                                continue;
-
                             if ((pkt_end - (unsigned char *)pkt_icmp6) < sizeof(struct icmp6_hdr))
                                 continue;
 
-                            if (valid_icmp6_response_remote(&idata, &scan_list, probetype, pkthdr, pktdata, buffer)) {
+                            /* The (cheap) cookie check is performed before looking up the scan ranges */
+                            if (!valid_icmp6_response_remote(&idata, probetype, &pview, &probesent) ||
+                                !is_ip6_in_scan_list(&scan_list, &(pkt_ipv6->ip6_src))) {
+                                count_filter_result(&idata, BLOCKED);
+                            }
+                            else {
+                                count_filter_result(&idata, ACCEPTED);
+
+                                if (idata.metrics != NULL)
+                                    record_latency(idata.metrics, &probesent, &(pkthdr->ts));
+
                                 /* Print the Source Address of the incoming packet */
                                 if (inet_ntop(AF_INET6, &(pkt_ipv6->ip6_src), pv6addr, sizeof(pv6addr)) == NULL) {
                                     if (idata.verbose_f > 1)
@@ -2803,20 +3113,21 @@ int main(int argc, char **argv) {
                             }
                         }
                     }
-                    else if (probetype == PROBE_TCP && pkt_ipv6->ip6_nxt == IPPROTO_TCP) {
-                        if (!is_ip6_in_scan_list(&scan_list, &(pkt_ipv6->ip6_src)))
+                    else if (probetype == PROBE_TCP && pview.proto == IPPROTO_TCP) {
+                        if ((pkt_end - (unsigned char *)pkt_tcp) < sizeof(struct tcp_hdr))
                             continue;
 
-                        if (srcport_f)
-                            if (pkt_tcp->th_dport != htons(srcport))
-                                continue;
-
-                        if (dstport_f)
-                            if (pkt_tcp->th_sport != htons(dstport))
-                                continue;
-
-                        if (in_chksum(pkt_ipv6, pkt_tcp, pkt_end - ((unsigned char *)pkt_tcp), IPPROTO_TCP) != 0)
+                        /* TCP probes carry no timestamp, so only ICMPv6 responses are accounted for latency */
+                        if ((srcport_f && pkt_tcp->th_dport != htons(srcport)) ||
+                            (dstport_f && pkt_tcp->th_sport != htons(dstport)) ||
+                            in_chksum(pkt_ipv6, pkt_tcp, pkt_end - ((unsigned char *)pkt_tcp), IPPROTO_TCP) != 0 ||
+                            !valid_tcp_response_remote(pkt_ipv6, pkt_tcp) ||
+                            !is_ip6_in_scan_list(&scan_list, &(pkt_ipv6->ip6_src))) {
+                            count_filter_result(&idata, BLOCKED);
                             continue;
+                        }
+
+                        count_filter_result(&idata, ACCEPTED);
 
                         if (inet_ntop(AF_INET6, &(pkt_ipv6->ip6_src), pv6addr, sizeof(pv6addr)) == NULL) {
                             if (idata.verbose_f > 1)
@@ -2854,6 +3165,19 @@ int main(int argc, char **argv) {
                         }
                     }
                 }
+
+                if (result == -1) {
+                    if (idata.verbose_f)
+                        printf("Error while reading packet in main loop: pcap_next_ex(): %s", pcap_geterr(idata.pfd));
+
+                    exit(EXIT_FAILURE);
+                }
+                else if (result == PCAP_ERROR_BREAK) {
+                    /* End of the savefile (see open_rx_replay()) */
+                    donesending_f = TRUE;
+                    end_f = TRUE;
+                    continue;
+                }
             }
 
             if (!donesending_f && !idata.pending_write_f && is_time_elapsed(&curtime, &lastprobe, pktinterval)) {
@@ -2885,6 +3209,9 @@ int main(int argc, char **argv) {
                 }
 
                 if (!send_probe_remote(&idata, &scan_list, &(idata.srcaddr), probetype)) {
+                    if (tx_dump_stopped())
+                        exit(EXIT_SUCCESS);
+
                     puts("Error while sending probe packet");
                     exit(EXIT_FAILURE);
                 }
@@ -2900,6 +3227,13 @@ int main(int argc, char **argv) {
                     donesending_f = TRUE;
                     continue;
                 }
+
+                if (checkpoint_f && is_time_elapsed(&lastprobe, &lastckpt, CHECKPOINT_INTERVAL * 1000000)) {
+                    if (!update_scan_checkpoint(&scan_list, &lastprobe)) {
+                        printf("Error while writing checkpoint file %s\n", ckptfile);
+                        exit(EXIT_FAILURE);
+                    }
+                }
             }
 
 #ifdef DEBUG
@@ -2917,11 +3251,391 @@ int main(int argc, char **argv) {
             puts("After checking eset");
 #endif
         }
+
+        if (checkpoint_f) {
+            take_scan_checkpoint(&scan_list, &ckpt_prev);
+
+            if (!save_scan_checkpoint(ckptfile, &scan_list, &ckpt_prev)) {
+                printf("Error while writing checkpoint file %s\n", ckptfile);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        if (idata.verbose_f)
+            print_pcap_stats(&idata);
     }
 
     exit(EXIT_SUCCESS);
 }
 
+/*
+ * Function: init_scan_perm()
+ *
+ * Prepares a scan_list for scanning its targets in a pseudorandom order. All the addresses of all the ranges are
+ * numbered from 0 to N-1, and each index is mapped to another one with a keyed Feistel network (that is a
+ * permutation), such that each target is scanned exactly once. Returns FALSE if the ranges are too large.
+ */
+
+int init_scan_perm(struct scan_list *scan) {
+    uint64_t total, size, n;
+    unsigned int i, j;
+
+    if ((scan->perm_offset = malloc((scan->ntarget + 1) * sizeof(uint64_t))) == NULL) {
+        if (verbose_f > 1)
+            puts("scan6: Not enough memory");
+
+        return (FALSE);
+    }
+
+    total = 0;
+
+    for (i = 0; i < scan->ntarget; i++) {
+        scan->perm_offset[i] = total;
+        size = 1;
+
+        for (j = 0; j < 8; j++) {
+            if (ntohs(scan->target[i]->end.s6addr16[j]) < ntohs(scan->target[i]->start.s6addr16[j])) {
+                size = 0;
+                break;
+            }
+
+            n = (uint64_t)ntohs(scan->target[i]->end.s6addr16[j]) - ntohs(scan->target[i]->start.s6addr16[j]) + 1;
+
+            if (size > ((uint64_t)1 << PERM_MAX_BITS) / n) {
+                free(scan->perm_offset);
+                scan->perm_offset = NULL;
+                return (FALSE);
+            }
+
+            size = size * n;
+        }
+
+        if (size > ((uint64_t)1 << PERM_MAX_BITS) - total) {
+            free(scan->perm_offset);
+            scan->perm_offset = NULL;
+            return (FALSE);
+        }
+
+        total = total + size;
+    }
+
+    scan->perm_offset[scan->ntarget] = total;
+
+    /* The Feistel network operates on 2*perm_halfbits bits, such that it covers (at most 4 times) the target space */
+    for (scan->perm_halfbits = 1; (scan->perm_halfbits * 2) < PERM_MAX_BITS &&
+                                  ((uint64_t)1 << (scan->perm_halfbits * 2)) < total;
+         scan->perm_halfbits++)
+        ;
+
+    init_random_key(scan->perm_key, sizeof(scan->perm_key));
+    scan->perm_first = 0;
+    scan->perm_stride = 1;
+    scan->perm_f = TRUE;
+    reset_scan_list(scan);
+    return (TRUE);
+}
+
+/*
+ * Function: permute_scan_index()
+ *
+ * Maps an index of the target space to another one, with a keyed Feistel network
+ */
+
+uint64_t permute_scan_index(struct scan_list *scan, uint64_t index) {
+    uint64_t left, right, tmp, mask;
+    uint8_t data[9];
+    unsigned int i, j;
+
+    mask = ((uint64_t)1 << scan->perm_halfbits) - 1;
+    left = index >> scan->perm_halfbits;
+    right = index & mask;
+
+    for (i = 0; i < PERM_ROUNDS; i++) {
+        data[0] = i;
+
+        for (j = 0; j < 8; j++)
+            data[j + 1] = (right >> (j * 8)) & 0xff;
+
+        tmp = right;
+        right = left ^ (siphash24(scan->perm_key, data, sizeof(data)) & mask);
+        left = tmp;
+    }
+
+    return ((left << scan->perm_halfbits) | right);
+}
+
+/*
+ * Function: get_next_perm_target()
+ *
+ * Obtains the next target of a scan_list that is scanned in pseudorandom order
+ */
+
+int get_next_perm_target(struct scan_list *scan) {
+    uint64_t domain, index, offset, n;
+    unsigned int low, high, mid;
+    int i;
+
+    domain = (uint64_t)1 << (scan->perm_halfbits * 2);
+
+    while (scan->perm_next < domain) {
+        index = permute_scan_index(scan, scan->perm_next);
+        scan->perm_next = scan->perm_next + scan->perm_stride;
+
+        /* The Feistel network covers a larger space than the target space: skip indexes that are out of range */
+        if (index >= scan->perm_offset[scan->ntarget])
+            continue;
+
+        /* Find the range that contains the index */
+        low = 0;
+        high = scan->ntarget;
+
+        while ((high - low) > 1) {
+            mid = low + (high - low) / 2;
+
+            if (scan->perm_offset[mid] <= index)
+                low = mid;
+            else
+                high = mid;
+        }
+
+        scan->ctarget = low;
+        offset = index - scan->perm_offset[low];
+
+        for (i = 7; i >= 0; i--) {
+            n = (uint64_t)ntohs(scan->target[low]->end.s6addr16[i]) - ntohs(scan->target[low]->start.s6addr16[i]) + 1;
+            scan->target[low]->cur.s6addr16[i] = htons(ntohs(scan->target[low]->start.s6addr16[i]) + offset % n);
+            offset = offset / n;
+        }
+
+        return (TRUE);
+    }
+
+    scan->ctarget = scan->ntarget;
+    return (FALSE);
+}
+
+/*
+ * Function: take_scan_checkpoint()
+ *
+ * Records the current position of a scan (i.e., the next target to be scanned)
+ */
+
+void take_scan_checkpoint(struct scan_list *scan, struct scan_checkpoint *ckpt) {
+    memset(ckpt, 0, sizeof(struct scan_checkpoint));
+
+    if (scan->ctarget >= scan->ntarget) {
+        ckpt->ctarget = scan->ntarget;
+        return;
+    }
+
+    ckpt->ctarget = scan->ctarget;
+    ckpt->cur = scan->target[scan->ctarget]->cur;
+
+    /* get_next_perm_target() has already moved perm_next past the index of the current target */
+    if (scan->perm_f)
+        ckpt->perm_index = scan->perm_next - scan->perm_stride;
+}
+
+/*
+ * Function: scan_list_fingerprint()
+ *
+ * Computes a hash of the target ranges of a scan_list, such that a checkpoint is only used with the same targets
+ */
+
+uint64_t scan_list_fingerprint(struct scan_list *scan) {
+    uint8_t key[16];
+    uint64_t hash;
+    unsigned int i, j;
+
+    memset(key, 0, sizeof(key));
+    hash = scan->ntarget;
+
+    for (i = 0; i < scan->ntarget; i++) {
+        for (j = 0; j < 8; j++)
+            key[j] = (hash >> (j * 8)) & 0xff;
+
+        hash = siphash24(key, &(scan->target[i]->start), sizeof(union my6_addr)) ^
+               siphash24(key, &(scan->target[i]->end), sizeof(union my6_addr));
+    }
+
+    return (hash);
+}
+
+/*
+ * Function: save_scan_checkpoint()
+ *
+ * Writes a scan position to a checkpoint file. The file is replaced atomically, such that a valid checkpoint is
+ * available even if the tool is killed while writing it.
+ */
+
+int save_scan_checkpoint(const char *path, struct scan_list *scan, struct scan_checkpoint *ckpt) {
+    FILE *fp;
+    char tmpfile[MAX_FILENAME_SIZE + 16], addrstr[INET6_ADDRSTRLEN];
+    unsigned int i;
+
+    snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", path);
+
+    if ((fp = fopen(tmpfile, "w")) == NULL) {
+        if (verbose_f > 1)
+            perror("scan6");
+
+        return (FALSE);
+    }
+
+    fprintf(fp, "# scan6 checkpoint\n");
+    fprintf(fp, "Fingerprint %016llx\n", (unsigned long long)scan_list_fingerprint(scan));
+    fprintf(fp, "Worker %u/%u\n", worker_id, nworkers);
+    fprintf(fp, "Target %u\n", ckpt->ctarget);
+
+    if (ckpt->ctarget < scan->ntarget) {
+        if (inet_ntop(AF_INET6, &(ckpt->cur.in6_addr), addrstr, sizeof(addrstr)) == NULL) {
+            fclose(fp);
+            return (FALSE);
+        }
+
+        fprintf(fp, "Address %s\n", addrstr);
+    }
+
+    if (scan->perm_f) {
+        fprintf(fp, "PermIndex %llu\n", (unsigned long long)ckpt->perm_index);
+        fprintf(fp, "PermKey ");
+
+        for (i = 0; i < sizeof(scan->perm_key); i++)
+            fprintf(fp, "%02x", scan->perm_key[i]);
+
+        fprintf(fp, "\n");
+    }
+
+    if (fflush(fp) == EOF || fsync(fileno(fp)) == -1) {
+        fclose(fp);
+        return (FALSE);
+    }
+
+    if (fclose(fp) == EOF || rename(tmpfile, path) == -1) {
+        if (verbose_f > 1)
+            perror("scan6");
+
+        return (FALSE);
+    }
+
+    return (TRUE);
+}
+
+/*
+ * Function: update_scan_checkpoint()
+ *
+ * Writes the position recorded at the previous checkpoint, and records the current one. Since checkpoints lag one
+ * interval behind, responses to the probes sent right before an interruption are not lost when the scan is resumed.
+ */
+
+int update_scan_checkpoint(struct scan_list *scan, struct timeval *curtime) {
+    if (!save_scan_checkpoint(ckptfile, scan, &ckpt_prev))
+        return (FALSE);
+
+    take_scan_checkpoint(scan, &ckpt_prev);
+    lastckpt = *curtime;
+    return (TRUE);
+}
+
+/*
+ * Function: load_scan_checkpoint()
+ *
+ * Moves a scan_list to the position recorded in a checkpoint file. If the checkpoint indicates that the scan has
+ * already been completed, the tool exits.
+ */
+
+int load_scan_checkpoint(const char *path, struct scan_list *scan) {
+    FILE *fp;
+    char line[MAX_LINE_SIZE], addrstr[INET6_ADDRSTRLEN], keystr[PERM_KEY_SIZE * 2 + 1];
+    unsigned long long fingerprint = 0, permindex = 0;
+    unsigned int ctarget = 0, ckptworker = 0, ckptnworkers = 0, i, byte;
+    unsigned char fingerprint_f = FALSE, ctarget_f = FALSE, addr_f = FALSE, permkey_f = FALSE;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        if (verbose_f)
+            perror("scan6");
+
+        return (FALSE);
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (line[0] == '#')
+            continue;
+
+        if (sscanf(line, "Fingerprint %llx", &fingerprint) == 1)
+            fingerprint_f = TRUE;
+        else if (sscanf(line, "Worker %u/%u", &ckptworker, &ckptnworkers) == 2)
+            continue;
+        else if (sscanf(line, "Target %u", &ctarget) == 1)
+            ctarget_f = TRUE;
+        else if (sscanf(line, "Address %45s", addrstr) == 1)
+            addr_f = TRUE;
+        else if (sscanf(line, "PermIndex %llu", &permindex) == 1)
+            continue;
+        else if (sscanf(line, "PermKey %32s", keystr) == 1 && strlen(keystr) == PERM_KEY_SIZE * 2)
+            permkey_f = TRUE;
+    }
+
+    fclose(fp);
+
+    if (!fingerprint_f || !ctarget_f || fingerprint != scan_list_fingerprint(scan)) {
+        if (verbose_f)
+            puts("Checkpoint file does not correspond to the specified targets");
+
+        return (FALSE);
+    }
+
+    if (ckptworker != worker_id || ckptnworkers != nworkers || permkey_f != (scan->perm_f != 0)) {
+        if (verbose_f)
+            puts("Checkpoint file does not correspond to the specified '-n' and '-R' options");
+
+        return (FALSE);
+    }
+
+    if (ctarget >= scan->ntarget) {
+        puts("Scan had already been completed");
+        exit(EXIT_SUCCESS);
+    }
+
+    if (scan->perm_f) {
+        for (i = 0; i < PERM_KEY_SIZE; i++) {
+            if (sscanf(keystr + i * 2, "%2x", &byte) != 1)
+                return (FALSE);
+
+            scan->perm_key[i] = byte;
+        }
+
+        scan->perm_next = permindex;
+
+        if (!get_next_perm_target(scan))
+            return (FALSE);
+    }
+    else {
+        if (!addr_f || inet_pton(AF_INET6, addrstr, &(scan->target[ctarget]->cur.in6_addr)) != 1)
+            return (FALSE);
+
+        scan->ctarget = ctarget;
+    }
+
+    if (scan->ctarget != ctarget || !is_target_in_range(scan))
+        return (FALSE);
+
+    if (verbose_f)
+        print_ipv6_address("Resuming scan at target: ", &(scan->target[scan->ctarget]->cur.in6_addr));
+
+    return (TRUE);
+}
+
+/*
+ * Handler for the INT signal.
+ *
+ * Used for saving a checkpoint before exiting
+ */
+
+void local_sig_int(int num) {
+    interrupted_f = TRUE;
+}
+
 /*
  * Function: reset_scan_list()
  *
@@ -2936,6 +3650,12 @@ void reset_scan_list(struct scan_list *scan) {
 
     scan->ctarget = 0;
 
+    /* Move to the first target of the permutation */
+    if (scan->perm_f) {
+        scan->perm_next = scan->perm_first;
+        get_next_perm_target(scan);
+    }
+
     return;
 }
 
@@ -3008,8 +3728,8 @@ int get_next_port(struct port_list *port_list) {
  * Prints the result of a port scan
  */
 
-void print_port_scan(struct port_list *port_list, unsigned int *res, int types) {
-    int i, j;
+void print_port_scan(struct port_list *port_list, struct hashed_host_entry *host, int types) {
+    int i, j, res;
     char portstring[10];
 
     for (i = 0; i < port_list->nport; i++) {
@@ -3017,7 +3737,22 @@ void print_port_scan(struct port_list *port_list, unsigned int *res, int types)
             snprintf(portstring, sizeof(portstring), "%u/%s", j, (port_list->proto == IPPROTO_TCP) ? "tcp" : "udp");
             portstring[sizeof(portstring) - 1] = 0;
 
-            switch (res[j]) {
+            switch (get_port_result(host, port_list->port_table[j].index - 1)) {
+            case PSCAN_RESP_OPEN:
+                res = PORT_OPEN;
+                break;
+
+            case PSCAN_RESP_CLOSED:
+                res = PORT_CLOSED;
+                break;
+
+            default:
+                /* TCP ports that do not respond are "filtered", while UDP ports are assumed to be "open" */
+                res = (port_list->proto == IPPROTO_TCP) ? PORT_FILTERED : PORT_OPEN;
+                break;
+            }
+
+            switch (res) {
             case PORT_FILTERED:
                 if (types & PORT_FILTERED)
                     printf("%-9s filtered  %s\n", portstring, port_list->port_table[j].name);
@@ -3038,56 +3773,213 @@ void print_port_scan(struct port_list *port_list, unsigned int *res, int types)
 }
 
 /*
- * Function: is_target_in_range()
+ * Function: index_port_list()
  *
- * Checks whether a scan_entry->cur is >= scan_entry->start && <= scan_entry->end
+ * Assigns an index (in the port-scan results) to each port of a port_list, starting with "first". Returns the
+ * number of ports that have been indexed so far.
  */
 
-int is_target_in_range(struct scan_list *scan_list) {
-    unsigned int i;
-    struct scan_entry *scan_entry;
-
-    if (scan_list->ctarget >= scan_list->ntarget || scan_list->ctarget >= scan_list->maxtarget) {
-        return (FALSE);
-    }
-
-    scan_entry = scan_list->target[scan_list->ctarget];
+unsigned int index_port_list(struct port_list *port_list, unsigned int first) {
+    unsigned int i, j;
 
-    for (i = 0; i <= 7; i++) {
-        if (ntohs((scan_entry->cur).s6addr16[i]) < ntohs((scan_entry->start).s6addr16[i]) ||
-            (ntohs((scan_entry->cur).s6addr16[i]) > ntohs((scan_entry->end).s6addr16[i]))) {
-            return (FALSE);
+    for (i = 0; i < port_list->nport; i++) {
+        for (j = (port_list->port[i])->start; j <= (port_list->port[i])->end; j++) {
+            if (port_list->port_table[j].index == 0) {
+                first++;
+                port_list->port_table[j].index = first;
+            }
         }
     }
 
-    return (TRUE);
+    return (first);
 }
 
 /*
- * Function: get_next_target()
+ * Function: init_hashed_host_list()
  *
- * "Increments" a scan_entry structure to obtain the next target to scan.
+ * Initializes a hashed_host_list structure for a concurrent port scan of (at most) "maxhosts" hosts, with "nports"
+ * target ports. The number of hosts is reduced if the results for all of them would not fit in PSCAN_MAX_RESULTS.
  */
 
-int get_next_target(struct scan_list *scan_list) {
-    int i;
-    unsigned int cind;
+int init_hashed_host_list(struct hashed_host_list *hlist, unsigned int maxhosts, unsigned int nports) {
+    memset(hlist, 0, sizeof(struct hashed_host_list));
 
-    for (i = 7; i >= 0; i--) {
-        /*
-                Increment scan_entry according to scan_entry->start and scan_entry->end, starting with the low-order
-           word
-         */
+    hlist->resultsize = (nports + 3) / 4;
 
-        if (ntohs((scan_list->target[scan_list->ctarget])->cur.s6addr16[i]) >=
-            ntohs((scan_list->target[scan_list->ctarget])->end.s6addr16[i])) {
-            if (i == 0) {
-                scan_list->ctarget++;
+    if (hlist->resultsize == 0)
+        hlist->resultsize = 1;
 
-                if (scan_list->ctarget < scan_list->ntarget && scan_list->ctarget < scan_list->maxtarget) {
-                    return (TRUE);
-                }
-                else {
+    if ((hlist->resultsize * maxhosts) > PSCAN_MAX_RESULTS)
+        maxhosts = PSCAN_MAX_RESULTS / hlist->resultsize;
+
+    if (maxhosts == 0)
+        maxhosts = 1;
+
+    hlist->maxhosts = maxhosts;
+
+    if ((hlist->host = malloc(PSCAN_HASH_SIZE * sizeof(struct hashed_host_entry *))) == NULL)
+        return (FALSE);
+
+    if ((hlist->entries = malloc(maxhosts * sizeof(struct hashed_host_entry))) == NULL)
+        return (FALSE);
+
+    /* reset_hashed_host_list() only clears the results of the hosts that were added */
+    if ((hlist->results = calloc(maxhosts, hlist->resultsize)) == NULL)
+        return (FALSE);
+
+    reset_hashed_host_list(hlist);
+    return (TRUE);
+}
+
+/*
+ * Function: reset_hashed_host_list()
+ *
+ * Removes all the host entries (and their results) from a hashed_host_list structure
+ */
+
+void reset_hashed_host_list(struct hashed_host_list *hlist) {
+    unsigned int i;
+
+    for (i = 0; i < PSCAN_HASH_SIZE; i++)
+        hlist->host[i] = NULL;
+
+    memset(hlist->results, 0, hlist->nhosts * hlist->resultsize);
+    hlist->nhosts = 0;
+}
+
+/*
+ * Function: hashed_host_key()
+ *
+ * Computes the hash-table bucket for an IPv6 address (keyed with the probe key, such that it cannot be predicted)
+ */
+
+unsigned int hashed_host_key(struct in6_addr *ipv6) {
+    return ((unsigned int)(siphash24(probe_key, ipv6, sizeof(struct in6_addr)) % PSCAN_HASH_SIZE));
+}
+
+/*
+ * Function: add_hashed_host_entry()
+ *
+ * Adds a host to a hashed_host_list structure (or returns the existing entry, if the host was already present)
+ */
+
+struct hashed_host_entry *add_hashed_host_entry(struct hashed_host_list *hlist, struct in6_addr *ipv6) {
+    struct hashed_host_entry *hentry;
+    unsigned int hkey;
+
+    if ((hentry = find_hashed_host_entry(hlist, ipv6)) != NULL)
+        return (hentry);
+
+    if (hlist->nhosts >= hlist->maxhosts)
+        return (NULL);
+
+    hkey = hashed_host_key(ipv6);
+    hentry = &(hlist->entries[hlist->nhosts]);
+    hentry->ip6 = *ipv6;
+    hentry->results = hlist->results + hlist->nhosts * hlist->resultsize;
+    hentry->prev = NULL;
+    hentry->next = hlist->host[hkey];
+
+    if (hentry->next != NULL)
+        hentry->next->prev = hentry;
+
+    hlist->host[hkey] = hentry;
+    (hlist->nhosts)++;
+    return (hentry);
+}
+
+/*
+ * Function: find_hashed_host_entry()
+ *
+ * Looks up a host in a hashed_host_list structure
+ */
+
+struct hashed_host_entry *find_hashed_host_entry(struct hashed_host_list *hlist, struct in6_addr *ipv6) {
+    struct hashed_host_entry *hentry;
+
+    for (hentry = hlist->host[hashed_host_key(ipv6)]; hentry != NULL; hentry = hentry->next) {
+        if (is_eq_in6_addr(ipv6, &(hentry->ip6)))
+            return (hentry);
+    }
+
+    return (NULL);
+}
+
+/*
+ * Function: set_port_result()
+ *
+ * Records the result (PSCAN_RESP_OPEN or PSCAN_RESP_CLOSED) for the port with the specified index
+ */
+
+void set_port_result(struct hashed_host_entry *host, unsigned int index, unsigned int res) {
+    host->results[index >> 2] =
+        (host->results[index >> 2] & ~(0x03 << ((index & 0x03) * 2))) | ((res & 0x03) << ((index & 0x03) * 2));
+}
+
+/*
+ * Function: get_port_result()
+ *
+ * Obtains the result for the port with the specified index
+ */
+
+unsigned int get_port_result(struct hashed_host_entry *host, unsigned int index) {
+    return ((host->results[index >> 2] >> ((index & 0x03) * 2)) & 0x03);
+}
+
+/*
+ * Function: is_target_in_range()
+ *
+ * Checks whether a scan_entry->cur is >= scan_entry->start && <= scan_entry->end
+ */
+
+int is_target_in_range(struct scan_list *scan_list) {
+    unsigned int i;
+    struct scan_entry *scan_entry;
+
+    if (scan_list->ctarget >= scan_list->ntarget || scan_list->ctarget >= scan_list->maxtarget) {
+        return (FALSE);
+    }
+
+    scan_entry = scan_list->target[scan_list->ctarget];
+
+    for (i = 0; i <= 7; i++) {
+        if (ntohs((scan_entry->cur).s6addr16[i]) < ntohs((scan_entry->start).s6addr16[i]) ||
+            (ntohs((scan_entry->cur).s6addr16[i]) > ntohs((scan_entry->end).s6addr16[i]))) {
+            return (FALSE);
+        }
+    }
+
+    return (TRUE);
+}
+
+/*
+ * Function: get_next_target()
+ *
+ * "Increments" a scan_entry structure to obtain the next target to scan.
+ */
+
+int get_next_target(struct scan_list *scan_list) {
+    int i;
+    unsigned int cind;
+
+    if (scan_list->perm_f)
+        return (get_next_perm_target(scan_list));
+
+    for (i = 7; i >= 0; i--) {
+        /*
+                Increment scan_entry according to scan_entry->start and scan_entry->end, starting with the low-order
+           word
+         */
+
+        if (ntohs((scan_list->target[scan_list->ctarget])->cur.s6addr16[i]) >=
+            ntohs((scan_list->target[scan_list->ctarget])->end.s6addr16[i])) {
+            if (i == 0) {
+                scan_list->ctarget++;
+
+                if (scan_list->ctarget < scan_list->ntarget && scan_list->ctarget < scan_list->maxtarget) {
+                    return (TRUE);
+                }
+                else {
                     return (FALSE);
                 }
             }
@@ -3365,7 +4257,8 @@ int load_knownprefix_entries(struct scan_list *scan_list, struct scan_list *pref
                 }
 
                 if (prefix_list->ntarget <= prefix_list->maxtarget) {
-                    if ((prefix_list->target[prefix_list->ntarget] = malloc(sizeof(struct scan_entry))) == NULL) {
+                    if ((prefix_list->target[prefix_list->ntarget] =
+                             arena_alloc(&(prefix_list->arena), sizeof(struct scan_entry))) == NULL) {
                         if (verbose_f > 1)
                             puts("scan6: Not enough memory");
 
@@ -3419,7 +4312,8 @@ int load_knownprefix_entries(struct scan_list *scan_list, struct scan_list *pref
                 }
 
                 if (prefix_list->ntarget <= prefix_list->maxtarget) {
-                    if ((prefix_list->target[prefix_list->ntarget] = malloc(sizeof(struct scan_entry))) == NULL) {
+                    if ((prefix_list->target[prefix_list->ntarget] =
+                             arena_alloc(&(prefix_list->arena), sizeof(struct scan_entry))) == NULL) {
                         if (verbose_f)
                             puts("scan6: Not enough memory");
 
@@ -4245,7 +5139,9 @@ void usage(void) {
          "       [-x RETRANS] [-o TIMEOUT] [-V VM_TYPE] [-b] [-B ENCODING] [-g]\n"
          "       [-k IEEE_OUI] [-K VENDOR] [-m PREFIXES_FILE] [-w IIDS_FILE] [-W IID]\n"
          "       [-Q IPV4_PREFIX[/LEN]] [-T] [-I INC_SIZE] [-r RATE(bps|pps)] [-l]\n"
-         "       [-z SECONDS] [-c CONFIG_FILE] [-v] [-h]");
+         "       [-z SECONDS] [-n WORKERS] [-R] [-C CHECKPOINT_FILE | -J CHECKPOINT_FILE]\n"
+         "       [-Y PCAP_FILE | --dry-run] [--read-pcap PCAP_FILE] [--stats-interval SECONDS]\n"
+         "       [--probe-key KEY | --no-probe-key] [-c CONFIG_FILE] [-v] [-h]");
 }
 
 /*
@@ -4277,7 +5173,7 @@ void print_help(void) {
          "  --print-link-addr, -e       Print link-layer addresses\n"
          "  --print-timestamp, -t       Print timestamp for each alive node\n"
          "  --retrans, -x               Number of retransmissions of each probe\n"
-         "  --timeout, -O               Timeout in seconds (default: 1 second)\n"
+         "  --timeout, -O               Timeout in seconds, may be fractional (default: 1 second)\n"
          "  --local-scan, -L            Scan the local subnet\n"
          "  --rand-src-addr, -f         Randomize the IPv6 Source Address\n"
          "  --rand-link-src-addr, -F    Randomize the Ethernet Source Address\n"
@@ -4295,8 +5191,18 @@ void print_help(void) {
          "  --rate-limit, -r            Rate limit the address scan to specified rate\n"
          "  --loop, -l                  Send periodic probes to the specified targets\n"
          "  --sleep, -z                 Pause between periodic probes\n"
+         "  --threads, -n               Number of workers for remote address scans\n"
+         "  --random-order, -R          Scan the target addresses in pseudorandom order\n"
+         "  --checkpoint, -C            Periodically save the scan position to the specified file\n"
+         "  --resume, -J                Resume the scan from the specified checkpoint file\n"
          "  --config-file, -c           Use alternate configuration file\n"
          "  --help, -h                  Print help for the scan6 tool\n"
+         "  --write-pcap, -Y            Write the packets to a pcap savefile, rather than sending them\n"
+         "  --dry-run                   Discard the packets, rather than sending them\n"
+         "  --read-pcap                 Read the responses from a pcap savefile, rather than from the network\n"
+         "  --probe-key                 Key of the probe cookies (to replay the responses to a scan with that key)\n"
+         "  --no-probe-key              Do not validate the probe cookies of the responses read with '--read-pcap'\n"
+         "  --stats-interval            Print the runtime metrics every SECONDS (and as JSON at exit)\n"
          "  --verbose, -v               Be verbose\n"
          "\n"
          " Programmed by Fernando Gont for SI6 Networks <https://www.si6networks.com>\n"
@@ -4322,7 +5228,7 @@ int send_probe_remote(struct iface_data *idata, struct scan_list *scan, struct i
     struct tcp_hdr *tcp;
     struct ip6_dest *destopth;
     struct ip6_option *opt;
-    uint32_t *uint32;
+    uint32_t *uint32, cookie;
 
     ether = (struct ether_header *)buffer;
     dlt_null = (struct dlt_null *)buffer;
@@ -4395,12 +5301,15 @@ int send_probe_remote(struct iface_data *idata, struct scan_list *scan, struct i
         icmp6 = (struct icmp6_hdr *)ptr;
         icmp6->icmp6_type = ICMP6_ECHO_REQUEST;
         icmp6->icmp6_code = 0;
-        icmp6->icmp6_data16[0] = htons(getpid()); /* Identifier */
-        icmp6->icmp6_data16[1] = htons(0);        /* Sequence Number */
+        cookie = probe_cookie(&(ipv6->ip6_src), &(ipv6->ip6_dst), 0);
+        icmp6->icmp6_data16[0] = htons(cookie >> 16);    /* Identifier */
+        icmp6->icmp6_data16[1] = htons(cookie & 0xffff); /* Sequence Number */
 
         ptr = ptr + sizeof(struct icmp6_hdr);
+        set_probe_timestamp(ptr);
+        ptr += PROBE_TIMESTAMP_SIZE;
 
-        for (i = 0; i < (ICMPV6_ECHO_PAYLOAD_SIZE >> 2); i++) {
+        for (i = 0; i < ((ICMPV6_ECHO_PAYLOAD_SIZE - PROBE_TIMESTAMP_SIZE) >> 2); i++) {
             *(uint32_t *)ptr = random();
             ptr += sizeof(uint32_t);
         }
@@ -4437,12 +5346,15 @@ int send_probe_remote(struct iface_data *idata, struct scan_list *scan, struct i
         icmp6 = (struct icmp6_hdr *)ptr;
         icmp6->icmp6_type = ICMP6_ECHO_REQUEST;
         icmp6->icmp6_code = 0;
-        icmp6->icmp6_data16[0] = htons(getpid()); /* Identifier */
-        icmp6->icmp6_data16[1] = htons(0);        /* Sequence Number */
+        cookie = probe_cookie(&(ipv6->ip6_src), &(ipv6->ip6_dst), 0);
+        icmp6->icmp6_data16[0] = htons(cookie >> 16);    /* Identifier */
+        icmp6->icmp6_data16[1] = htons(cookie & 0xffff); /* Sequence Number */
 
         ptr = ptr + sizeof(struct icmp6_hdr);
+        set_probe_timestamp(ptr);
+        ptr += PROBE_TIMESTAMP_SIZE;
 
-        for (i = 0; i < (ICMPV6_ECHO_PAYLOAD_SIZE >> 2); i++) {
+        for (i = 0; i < ((ICMPV6_ECHO_PAYLOAD_SIZE - PROBE_TIMESTAMP_SIZE) >> 2); i++) {
             *(uint32_t *)ptr = random();
             ptr += sizeof(uint32_t);
         }
@@ -4480,8 +5392,15 @@ int send_probe_remote(struct iface_data *idata, struct scan_list *scan, struct i
         else
             tcp->th_flags = TH_ACK;
 
-        if (tcpflags & TH_ACK)
-            tcp->th_ack = htonl(random());
+        /*
+           The cookie goes in the Sequence Number (acknowledged by SYN/ACKs and RSTs) and, if the ACK bit is set, in
+           the Acknowledgement Number (employed as the Sequence Number of RSTs)
+         */
+        cookie = probe_cookie(&(ipv6->ip6_src), &(ipv6->ip6_dst), ntohs(tcp->th_dport));
+        tcp->th_seq = htonl(cookie);
+
+        if (tcp->th_flags & TH_ACK)
+            tcp->th_ack = htonl(cookie);
         else
             tcp->th_ack = htonl(0);
 
@@ -4508,6 +5427,10 @@ int send_probe_remote(struct iface_data *idata, struct scan_list *scan, struct i
             rhbytes--;
         }
 
+        /* Sequence space consumed by the probe (a response may acknowledge all of it) */
+        tcp_probe_seglen = (ptr - ((unsigned char *)tcp + (tcp->th_off << 2))) + ((tcp->th_flags & TH_SYN) ? 1 : 0) +
+                           ((tcp->th_flags & TH_FIN) ? 1 : 0);
+
         ipv6->ip6_plen = htons((ptr - v6buffer) - MIN_IPV6_HLEN);
         tcp->th_sum = 0;
         tcp->th_sum = in_chksum(v6buffer, tcp, ptr - ((unsigned char *)tcp), IPPROTO_TCP);
@@ -4517,9 +5440,9 @@ int send_probe_remote(struct iface_data *idata, struct scan_list *scan, struct i
 #ifdef DEBUG
     puts("In send_probe_remote(), prior to send");
 #endif
-    if ((nw = pcap_inject(idata->pfd, buffer, ptr - buffer)) == -1) {
+    if ((nw = send_frame(idata, buffer, ptr - buffer)) == -1) {
         if (idata->verbose_f)
-            printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+            printf("send_frame(): %s\n", send_frame_error(idata));
 
         return (0);
     }
@@ -4529,7 +5452,7 @@ int send_probe_remote(struct iface_data *idata, struct scan_list *scan, struct i
 
     if (nw != (ptr - buffer)) {
         if (idata->verbose_f)
-            printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+            printf("send_frame(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
         return (0);
     }
 
@@ -4542,7 +5465,7 @@ int send_probe_remote(struct iface_data *idata, struct scan_list *scan, struct i
  * Sends a probe packet to a target port
  */
 
-int send_pscan_probe(struct iface_data *idata, struct scan_list *scan, struct port_list *port_list,
+int send_pscan_probe(struct iface_data *idata, struct in6_addr *dst, struct port_list *port_list,
                      struct in6_addr *srcaddr, unsigned char type) {
     unsigned char *ptr;
     struct ether_header *ether;
@@ -4574,8 +5497,7 @@ int send_pscan_probe(struct iface_data *idata, struct scan_list *scan, struct po
                 ether->dst = idata->nhhaddr;
             }
             else {
-                if (ipv6_to_ether(idata->pfd, idata, &((scan->target[scan->ctarget])->cur.in6_addr),
-                                  &(idata->hdstaddr)) != 1) {
+                if (ipv6_to_ether(idata->pfd, idata, dst, &(idata->hdstaddr)) != 1) {
                     return (1);
                 }
             }
@@ -4603,10 +5525,9 @@ int send_pscan_probe(struct iface_data *idata, struct scan_list *scan, struct po
 
     ipv6->ip6_src = idata->srcaddr;
     /* XXX Double-check this one */
-    /* ipv6->ip6_src= idata->srcaddr_f?(*srcaddr):*sel_src_addr_ra(idata,
-     * &((scan->target[scan->ctarget])->cur.in6_addr)); */
+    /* ipv6->ip6_src= idata->srcaddr_f?(*srcaddr):*sel_src_addr_ra(idata, dst); */
 
-    ipv6->ip6_dst = (scan->target[scan->ctarget])->cur.in6_addr;
+    ipv6->ip6_dst = *dst;
     prev_nh = (unsigned char *)&(ipv6->ip6_nxt);
 
     ptr = (unsigned char *)v6buffer + MIN_IPV6_HLEN;
@@ -4729,16 +5650,16 @@ int send_pscan_probe(struct iface_data *idata, struct scan_list *scan, struct po
         break;
     }
 
-    if ((nw = pcap_inject(idata->pfd, buffer, ptr - buffer)) == -1) {
+    if ((nw = send_frame(idata, buffer, ptr - buffer)) == -1) {
         if (idata->verbose_f)
-            printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+            printf("send_frame(): %s\n", send_frame_error(idata));
 
         return (0);
     }
 
     if (nw != (ptr - buffer)) {
         if (idata->verbose_f)
-            printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+            printf("send_frame(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
         return (0);
     }
 
@@ -4746,410 +5667,288 @@ int send_pscan_probe(struct iface_data *idata, struct scan_list *scan, struct po
 }
 
 /*
- * Function: multi_scan_local()
+ * Function: scan_local_set()
  *
- * Performs an IPv6 address scan on a local link
+ * Performs a local scan on all the interfaces of an interface set at the same time (the probes of each phase are
+ * sent on every interface, and the responses are read with read_iface_set()), and prints the results of each
+ * interface
  */
 
-int multi_scan_local(pcap_t *pfd, struct iface_data *idata, struct in6_addr *srcaddr, unsigned char type,
-                     const char *ptargetaddr, struct host_list *hlist) {
-
-    struct bpf_program pcap_filter;
-    struct pcap_pkthdr *pkthdr;
-    const u_char *pktdata;
-    struct ip6_hdr *pkt_ipv6;
-    struct icmp6_hdr *pkt_icmp6;
-    struct nd_neighbor_solicit *pkt_ns;
-    unsigned char *pkt_end;
-    unsigned char *ptr;
-
-    unsigned char buffer[PACKET_BUFFER_SIZE];
-    unsigned int icmp6_max_packet_size;
-    struct ether_header *ether;
-    unsigned char *v6buffer;
-    struct ip6_hdr *ipv6;
-    volatile unsigned int tries = 0;
-    struct in6_addr targetaddr;
-    struct sigaction new_sig, old_sig;
-    struct ip6_dest *destopth;
-    struct ip6_option *opt;
-    uint32_t *uint32;
-    unsigned char error_f = FALSE, llocalsrc_f = FALSE;
-    int result;
+void scan_local_set(struct iface_set *set) {
+    struct local_scan *scan;
+    struct iface_data *idata = set->iface[0];
+    unsigned int i;
 
-    icmp6_max_packet_size = idata->mtu;
-    ether = (struct ether_header *)buffer;
-    v6buffer = buffer + sizeof(struct ether_header);
-    ipv6 = (struct ip6_hdr *)v6buffer;
+    if ((scan = calloc(set->niface, sizeof(struct local_scan))) == NULL) {
+        puts("Not enough memory for the local scan");
+        exit(EXIT_FAILURE);
+    }
 
-    if (inet_pton(AF_INET6, ptargetaddr, &targetaddr) <= 0) {
-        if (idata->verbose_f > 1)
-            puts("inet_pton(): Source Address not valid");
+    for (i = 0; i < set->niface; i++) {
+        scan[i].local.maxhosts = MAX_IPV6_ENTRIES;
+        scan[i].global.maxhosts = MAX_IPV6_ENTRIES;
+        scan[i].candidate.maxhosts = MAX_IPV6_ENTRIES;
 
-        return (-1);
+        if ((scan[i].local.host = malloc(MAX_IPV6_ENTRIES * sizeof(struct host_entry *))) == NULL ||
+            (scan[i].global.host = malloc(MAX_IPV6_ENTRIES * sizeof(struct host_entry *))) == NULL ||
+            (scan[i].candidate.host = malloc(MAX_IPV6_ENTRIES * sizeof(struct host_entry *))) == NULL) {
+            puts("Not enough memory for the local scan");
+            exit(EXIT_FAILURE);
+        }
     }
 
-    if (IN6_IS_ADDR_LINKLOCAL(srcaddr))
-        llocalsrc_f = TRUE;
+    if (probe_echo_f) {
+        if (multi_scan_local(set, scan, PROBE_ICMP6_ECHO, LOCAL_SRC) == -1) {
+            if (tx_dump_stopped())
+                exit(EXIT_SUCCESS);
 
-    if (pfd == NULL)
-        return (-1);
-
-    switch (type) {
-    case PROBE_ICMP6_ECHO:
-        if (pcap_compile(pfd, &pcap_filter, PCAP_ICMPV6_ERNS_FILTER, PCAP_OPT, PCAP_NETMASK_UNKNOWN) == -1) {
             if (idata->verbose_f)
-                printf("pcap_compile(): %s", pcap_geterr(pfd));
+                puts("Error while learning link-local addresses with ICMPv6 Echo Requests");
 
-            return (-1);
+            exit(EXIT_FAILURE);
         }
-        break;
+    }
+
+    if (probe_unrec_f) {
+        if (multi_scan_local(set, scan, PROBE_UNREC_OPT, LOCAL_SRC) == -1) {
+            if (tx_dump_stopped())
+                exit(EXIT_SUCCESS);
 
-    case PROBE_UNREC_OPT:
-        if (pcap_compile(pfd, &pcap_filter, PCAP_ICMPV6_ERRORNS_FILTER, PCAP_OPT, PCAP_NETMASK_UNKNOWN) == -1) {
             if (idata->verbose_f)
-                printf("pcap_compile(): %s", pcap_geterr(pfd));
+                puts("Error while learning link-local addresses with Unrecognized options");
 
-            return (-1);
+            exit(EXIT_FAILURE);
         }
-        break;
-
-    default:
-        return (-1);
-        break;
     }
 
-    if (pcap_setfilter(pfd, &pcap_filter) == -1) {
-        if (idata->verbose_f)
-            printf("pcap_setfilter(): %s", pcap_geterr(pfd));
-
-        return (-1);
-    }
-
-    pcap_freecode(&pcap_filter);
-
-    ipv6->ip6_flow = 0;
-    ipv6->ip6_vfc = 0x60;
-    ipv6->ip6_hlim = 255;
-
-    ipv6->ip6_src = *srcaddr;
-    ipv6->ip6_dst = targetaddr;
-
-    ether->src = idata->ether;
-    ether->dst = ether_multicast(&(ipv6->ip6_dst));
-    ether->ether_type = htons(ETHERTYPE_IPV6);
-
-    prev_nh = (unsigned char *)&(ipv6->ip6_nxt);
-
-    ptr = (unsigned char *)v6buffer + MIN_IPV6_HLEN;
-
-    switch (type) {
-    case PROBE_ICMP6_ECHO:
-        *prev_nh = IPPROTO_ICMPV6;
+    if (print_global_f) {
+        if (probe_echo_f) {
+            if (multi_scan_local(set, scan, PROBE_ICMP6_ECHO, GLOBAL_SRC) == -1) {
+                if (tx_dump_stopped())
+                    exit(EXIT_SUCCESS);
 
-        if ((ptr + sizeof(struct icmp6_hdr) + ICMPV6_ECHO_PAYLOAD_SIZE) > (v6buffer + icmp6_max_packet_size)) {
-            if (idata->verbose_f > 1)
-                puts("Packet too large while creating ICMPv6 Echo Request Probe packet");
+                if (idata->verbose_f)
+                    puts("Error while learning global addresses with ICMPv6 Echo Requests");
 
-            return (-1);
+                exit(EXIT_FAILURE);
+            }
         }
 
-        icmp6 = (struct icmp6_hdr *)ptr;
-        icmp6->icmp6_type = ICMP6_ECHO_REQUEST;
-        icmp6->icmp6_code = 0;
-        icmp6->icmp6_cksum = random();
-        icmp6->icmp6_data16[0] = htons(getpid()); /* Identifier */
-        icmp6->icmp6_data16[1] = htons(random()); /* Sequence Number */
+        if (probe_unrec_f) {
+            if (multi_scan_local(set, scan, PROBE_UNREC_OPT, GLOBAL_SRC) == -1) {
+                if (tx_dump_stopped())
+                    exit(EXIT_SUCCESS);
 
-        ptr = ptr + sizeof(struct icmp6_hdr);
+                if (idata->verbose_f)
+                    puts("Error while learning global addresses with Unrecognized options");
 
-        for (i = 0; i < (ICMPV6_ECHO_PAYLOAD_SIZE >> 2); i++) {
-            *(uint32_t *)ptr = random();
-            ptr += sizeof(uint32_t);
+                exit(EXIT_FAILURE);
+            }
         }
-        break;
 
-    case PROBE_UNREC_OPT:
-        *prev_nh = IPPROTO_DSTOPTS;
-
-        if ((ptr + sizeof(struct icmp6_hdr) + 8 + ICMPV6_ECHO_PAYLOAD_SIZE) > (v6buffer + icmp6_max_packet_size)) {
-            if (idata->verbose_f > 1)
-                puts("Packet too large while creating Unrec. Opt. Probe Packet");
+        for (i = 0; i < set->niface; i++) {
+            if (create_candidate_globals(set->iface[i], &(scan[i].local), &(scan[i].global), &(scan[i].candidate)) ==
+                -1) {
+                if (idata->verbose_f)
+                    puts("Error while creating candidate global addresses");
 
-            return (-1);
+                exit(EXIT_FAILURE);
+            }
         }
 
-        destopth = (struct ip6_dest *)ptr;
-        destopth->ip6d_len = 0;
-        destopth->ip6d_nxt = IPPROTO_ICMPV6;
+        if (validate_host_entries(set, scan) == -1) {
+            if (tx_dump_stopped())
+                exit(EXIT_SUCCESS);
 
-        ptr = ptr + 2;
-        opt = (struct ip6_option *)ptr;
-        opt->ip6o_type = 0x80;
-        opt->ip6o_len = 4;
-
-        ptr = ptr + 2;
-        uint32 = (uint32_t *)ptr;
-        *uint32 = random();
-
-        ptr = ptr + 4;
-        icmp6 = (struct icmp6_hdr *)ptr;
-        icmp6->icmp6_type = ICMP6_ECHO_REQUEST;
-        icmp6->icmp6_code = 0;
-        icmp6->icmp6_cksum = random();
-        icmp6->icmp6_data16[0] = htons(getpid()); /* Identifier */
-        icmp6->icmp6_data16[1] = htons(random()); /* Sequence Number */
-
-        ptr = ptr + sizeof(struct icmp6_hdr);
+            if (idata->verbose_f)
+                puts("Error while validating global entries");
 
-        for (i = 0; i < (ICMPV6_ECHO_PAYLOAD_SIZE >> 2); i++) {
-            *(uint32_t *)ptr = random();
-            ptr += sizeof(uint32_t);
+            exit(EXIT_FAILURE);
         }
-        break;
     }
 
-    ipv6->ip6_plen = htons((ptr - v6buffer) - MIN_IPV6_HLEN);
-    icmp6->icmp6_cksum = 0;
-    icmp6->icmp6_cksum = in_chksum(v6buffer, icmp6, ptr - ((unsigned char *)icmp6), IPPROTO_ICMPV6);
-
-    /* We set the signal handler, and the anchor for siglongjump() */
-    canjump = 0;
-    memset(&new_sig, 0, sizeof(struct sigaction));
-    sigemptyset(&new_sig.sa_mask);
-    new_sig.sa_handler = &local_sig_alarm;
-
-    if (sigaction(SIGALRM, &new_sig, &old_sig) == -1) {
-        if (idata->verbose_f > 1)
-            puts("Error setting up 'Alarm' signal");
-
-        return (-1);
-    }
+    for (i = 0; i < set->niface; i++) {
+        /* Tell apart the results of each interface */
+        if (set->niface > 1)
+            printf("%sInterface %s:\n", (i ? "\n" : ""), set->iface[i]->iface);
 
-    if (sigsetjmp(env, 1) != 0)
-        tries++;
-
-    canjump = 1;
+        if (print_local_f) {
+            if (idata->verbose_f)
+                puts("Link-local addresses:");
 
-    while (tries <= idata->local_retrans && !error_f) {
-        if ((nw = pcap_inject(pfd, buffer, ptr - buffer)) == -1) {
-            if (idata->verbose_f > 1)
-                printf("pcap_inject(): %s\n", pcap_geterr(pfd));
+            if ((print_unique_f ? print_unique_host_entries(&(scan[i].local), print_type)
+                                : print_host_entries(&(scan[i].local), print_type)) == -1) {
+                if (idata->verbose_f)
+                    puts("Error while printing link-local addresses");
 
-            error_f = TRUE;
-            break;
+                exit(EXIT_FAILURE);
+            }
         }
 
-        if (nw != (ptr - buffer)) {
-            if (idata->verbose_f > 1)
-                printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+        if (print_global_f) {
+            if (idata->verbose_f)
+                puts("\nGlobal addresses:");
 
-            error_f = TRUE;
-            break;
-        }
+            if ((print_unique_f ? print_unique_host_entries(&(scan[i].global), print_type)
+                                : print_host_entries(&(scan[i].global), print_type)) == -1) {
+                if (idata->verbose_f)
+                    puts("Error while printing global addresses");
 
-        alarm(idata->local_timeout);
+                exit(EXIT_FAILURE);
+            }
+        }
 
-        while ((hlist->nhosts < hlist->maxhosts) && !error_f) {
+        free_host_entries(&(scan[i].local));
+        free_host_entries(&(scan[i].global));
+        free(scan[i].local.host);
+        free(scan[i].global.host);
+        free(scan[i].candidate.host);
+    }
 
-            do {
-                if ((result = pcap_next_ex(pfd, &pkthdr, &pktdata)) == -1) {
-                    if (idata->verbose_f > 1)
-                        printf("pcap_next_ex(): %s", pcap_geterr(pfd));
+    free(scan);
+}
 
-                    error_f = TRUE;
-                    break;
-                }
-            } while (result == 0 || pktdata == NULL);
+/*
+ * Function: multi_scan_local()
+ *
+ * Performs an IPv6 address scan on the local links of an interface set, by sending a probe to the all-nodes
+ * link-local multicast address from the link-local address (LOCAL_SRC) or from each of the global addresses
+ * (GLOBAL_SRC) of every interface
+ */
 
-            if (error_f)
-                break;
+int multi_scan_local(struct iface_set *set, struct local_scan *scan, unsigned char type, unsigned char src) {
+    struct local_probe *probes;
+    struct iface_data *idata;
+    unsigned int i, j, nprobes = 0;
+    int r;
 
-            pkt_ether = (struct ether_header *)pktdata;
-            pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + ETHER_HDR_LEN);
-            pkt_icmp6 = (struct icmp6_hdr *)((char *)pkt_ipv6 + sizeof(struct ip6_hdr));
-            pkt_ns = (struct nd_neighbor_solicit *)pkt_icmp6;
-            pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
+    for (i = 0; i < set->niface; i++)
+        nprobes += ((src == LOCAL_SRC) ? 1 : set->iface[i]->ip6_global.nprefix);
 
-            if ((pkt_end - pktdata) < (ETHER_HDR_LEN + MIN_IPV6_HLEN))
-                continue;
+    if (nprobes == 0)
+        return 0;
 
-            if (pkt_ipv6->ip6_nxt == IPPROTO_ICMPV6) {
-                if (pkt_icmp6->icmp6_type == ND_NEIGHBOR_SOLICIT) {
-                    if ((pkt_end - (unsigned char *)pkt_ns) < sizeof(struct nd_neighbor_solicit))
-                        continue;
+    if ((probes = calloc(nprobes, sizeof(struct local_probe))) == NULL) {
+        if (set->iface[0]->verbose_f > 1)
+            puts("Error when allocating memory for the local probes");
 
-                    if (is_eq_in6_addr(&(pkt_ns->nd_ns_target), srcaddr) ||
-                        is_eq_in6_addr(&(pkt_ns->nd_ns_target), &(idata->ip6_local))) {
-                        if (send_neighbor_advert(idata, pfd, pktdata) == -1) {
-                            error_f = TRUE;
-                            break;
-                        }
-                    }
-                }
-                else if ((pkt_icmp6->icmp6_type == ICMP6_ECHO_REPLY) || (pkt_icmp6->icmp6_type == ICMP6_PARAM_PROB)) {
-                    if ((pkt_end - (unsigned char *)pkt_icmp6) < sizeof(struct icmp6_hdr))
-                        continue;
+        return (-1);
+    }
 
-                    /*
-                       If the Source Address was a link-local address, we only want link-local addresses.
-                       OTOH, if the Source Address was a global address, we only want global addresses.
-                     */
-                    if (llocalsrc_f) {
-                        if (!IN6_IS_ADDR_LINKLOCAL(&(pkt_ipv6->ip6_src)))
-                            continue;
-                    }
-                    else {
-                        if (IN6_IS_ADDR_LINKLOCAL(&(pkt_ipv6->ip6_src)))
-                            continue;
-                    }
+    nprobes = 0;
 
-                    if (valid_icmp6_response(idata, type, pkthdr, pktdata, buffer)) {
-                        if (is_ip6_in_list(&(pkt_ipv6->ip6_src), hlist))
-                            continue;
+    for (i = 0; i < set->niface; i++) {
+        idata = set->iface[i];
 
-                        if ((hlist->host[hlist->nhosts] = malloc(sizeof(struct host_entry))) == NULL) {
-                            if (idata->verbose_f > 1)
-                                puts("Error when allocating memory for host data");
+        if (src == LOCAL_SRC) {
+            probes[nprobes].idata = idata;
+            probes[nprobes].srcaddr = &(idata->ip6_local);
+            probes[nprobes].hlist = &(scan[i].local);
+            nprobes++;
+        }
+        else {
+            for (j = 0; j < idata->ip6_global.nprefix; j++) {
+                probes[nprobes].idata = idata;
+                probes[nprobes].srcaddr = &((idata->ip6_global.prefix[j])->ip6);
+                probes[nprobes].hlist = &(scan[i].global);
+                nprobes++;
+            }
+        }
+    }
 
-                            error_f = TRUE;
-                            break;
-                        }
+    r = run_local_probes(set, probes, nprobes, type);
+    free(probes);
+    return (r);
+}
 
-                        memset(hlist->host[hlist->nhosts], 0, sizeof(struct host_entry));
+/*
+ * Function: set_local_filter()
+ *
+ * Sets the capture filter of an interface for the responses to a local probe of the specified type
+ */
 
-                        (hlist->host[hlist->nhosts])->ip6 = pkt_ipv6->ip6_src;
-                        (hlist->host[hlist->nhosts])->ether = pkt_ether->src;
-                        (hlist->host[hlist->nhosts])->flag = VALID_MAPPING;
-                        (hlist->nhosts)++;
-                    }
-                }
-            }
+int set_local_filter(struct iface_data *idata, unsigned char type) {
+    struct bpf_program pcap_filter;
+    const char *filter;
 
-        } /* Processing packets */
+    if (idata->pfd == NULL)
+        return (-1);
 
-    } /* Resending Neighbor Solicitations */
+    switch (type) {
+    case PROBE_ICMP6_ECHO:
+        filter = PCAP_ICMPV6_ERNS_FILTER;
+        break;
 
-    if (sigaction(SIGALRM, &old_sig, NULL) == -1) {
-        if (idata->verbose_f > 1)
-            puts("Error setting up 'Alarm' signal");
+    case PROBE_UNREC_OPT:
+        filter = PCAP_ICMPV6_ERRORNS_FILTER;
+        break;
 
-        error_f = TRUE;
+    default:
+        return (-1);
+        break;
     }
 
-    if (error_f)
+    if (pcap_compile(idata->pfd, &pcap_filter, filter, PCAP_OPT, PCAP_NETMASK_UNKNOWN) == -1) {
+        if (idata->verbose_f)
+            printf("pcap_compile(): %s", pcap_geterr(idata->pfd));
+
         return (-1);
-    else
-        return 0;
-}
+    }
 
-/*
- * Function: find_local_globals()
- *
- * Finds Global Unicast Addresses present on the local link
- */
+    if (pcap_setfilter(idata->pfd, &pcap_filter) == -1) {
+        if (idata->verbose_f)
+            printf("pcap_setfilter(): %s", pcap_geterr(idata->pfd));
 
-int find_local_globals(pcap_t *pfd, struct iface_data *idata, unsigned char type, const char *ptargetaddr,
-                       struct host_list *hlist) {
-    unsigned int i;
-    for (i = 0; i < idata->ip6_global.nprefix; i++) {
-        if (multi_scan_local(pfd, idata, &((idata->ip6_global.prefix[i])->ip6), type, ALL_NODES_MULTICAST_ADDR,
-                             hlist) == -1) {
-            return (-1);
-        }
+        pcap_freecode(&pcap_filter);
+        return (-1);
     }
 
+    pcap_freecode(&pcap_filter);
     return 0;
 }
 
 /*
- * Function: host_scan_local()
+ * Function: build_local_probe()
  *
- * Scans a single IPv6 address
+ * Crafts a local probe of the specified type: a multicast probe (to the all-nodes link-local multicast address) if
+ * the probe has a host list, or a unicast probe to the host entry otherwise
  */
 
-int host_scan_local(pcap_t *pfd, struct iface_data *idata, struct in6_addr *srcaddr, unsigned char type,
-                    struct host_entry *host) {
-    struct bpf_program pcap_filter;
-    struct pcap_pkthdr *pkthdr;
-    const u_char *pktdata;
-    struct ip6_hdr *pkt_ipv6;
-    struct icmp6_hdr *pkt_icmp6;
-    struct nd_neighbor_solicit *pkt_ns;
-    unsigned char *pkt_end;
-    volatile unsigned char *ptr;
-
-    unsigned char buffer[PACKET_BUFFER_SIZE];
-    unsigned int icmp6_max_packet_size;
+int build_local_probe(struct local_probe *probe, unsigned char type) {
+    struct iface_data *idata = probe->idata;
     struct ether_header *ether;
-    unsigned char *v6buffer;
+    unsigned char *v6buffer, *ptr;
     struct ip6_hdr *ipv6;
-    volatile unsigned int tries = 0;
-    struct in6_addr targetaddr;
-    struct sigaction new_sig, old_sig;
     struct ip6_dest *destopth;
     struct ip6_option *opt;
     uint32_t *uint32;
-    unsigned char foundaddr_f = FALSE, error_f = FALSE;
-    int result;
+    unsigned int i;
 
-    icmp6_max_packet_size = idata->mtu;
-    ether = (struct ether_header *)buffer;
-    v6buffer = buffer + sizeof(struct ether_header);
+    ether = (struct ether_header *)probe->buffer;
+    v6buffer = probe->buffer + sizeof(struct ether_header);
     ipv6 = (struct ip6_hdr *)v6buffer;
 
-    targetaddr = host->ip6;
-
-    if (pcap_datalink(pfd) != DLT_EN10MB) {
-        if (idata->verbose_f > 1)
-            printf("Error: Interface %s is not an Ethernet interface", idata->iface);
+    ipv6->ip6_flow = 0;
+    ipv6->ip6_vfc = 0x60;
+    ipv6->ip6_hlim = 255;
+    ipv6->ip6_src = *(probe->srcaddr);
 
-        return (-1);
+    if (probe->host != NULL) {
+        ipv6->ip6_dst = probe->host->ip6;
+        ether->dst = probe->host->ether;
     }
-
-    switch (type) {
-    case PROBE_ICMP6_ECHO:
-        if (pcap_compile(pfd, &pcap_filter, PCAP_ICMPV6_ERNS_FILTER, PCAP_OPT, PCAP_NETMASK_UNKNOWN) == -1) {
-            if (idata->verbose_f > 1)
-                printf("pcap_compile(): %s", pcap_geterr(pfd));
-
-            return (-1);
-        }
-
-        break;
-
-    case PROBE_UNREC_OPT:
-        if (pcap_compile(pfd, &pcap_filter, PCAP_ICMPV6_ERRORNS_FILTER, PCAP_OPT, PCAP_NETMASK_UNKNOWN) == -1) {
+    else {
+        if (inet_pton(AF_INET6, ALL_NODES_MULTICAST_ADDR, &(ipv6->ip6_dst)) <= 0) {
             if (idata->verbose_f > 1)
-                printf("pcap_compile(): %s", pcap_geterr(pfd));
+                puts("inet_pton(): Destination Address not valid");
 
             return (-1);
         }
 
-        break;
-
-    default:
-        return (-1);
-        break;
-    }
-
-    if (pcap_setfilter(pfd, &pcap_filter) == -1) {
-        if (idata->verbose_f > 1)
-            printf("pcap_setfilter(): %s", pcap_geterr(pfd));
-
-        return (-1);
+        ether->dst = ether_multicast(&(ipv6->ip6_dst));
     }
 
-    pcap_freecode(&pcap_filter);
-
-    ipv6->ip6_flow = 0;
-    ipv6->ip6_vfc = 0x60;
-    ipv6->ip6_hlim = 255;
-    ipv6->ip6_dst = targetaddr;
-    ipv6->ip6_src = *srcaddr;
-
     ether->src = idata->ether;
-    ether->dst = host->ether;
     ether->ether_type = htons(ETHERTYPE_IPV6);
 
     prev_nh = (unsigned char *)&(ipv6->ip6_nxt);
@@ -5160,32 +5959,19 @@ int host_scan_local(pcap_t *pfd, struct iface_data *idata, struct in6_addr *srca
     case PROBE_ICMP6_ECHO:
         *prev_nh = IPPROTO_ICMPV6;
 
-        if ((ptr + sizeof(struct icmp6_hdr) + ICMPV6_ECHO_PAYLOAD_SIZE) > (v6buffer + icmp6_max_packet_size)) {
+        if ((ptr + sizeof(struct icmp6_hdr) + ICMPV6_ECHO_PAYLOAD_SIZE) > (v6buffer + idata->mtu)) {
             if (idata->verbose_f > 1)
                 puts("Packet too large while creating ICMPv6 Echo Request Probe packet");
 
             return (-1);
         }
 
-        icmp6 = (struct icmp6_hdr *)ptr;
-        icmp6->icmp6_type = ICMP6_ECHO_REQUEST;
-        icmp6->icmp6_code = 0;
-        icmp6->icmp6_cksum = random();
-        icmp6->icmp6_data16[0] = htons(getpid()); /* Identifier */
-        icmp6->icmp6_data16[1] = htons(random()); /* Sequence Number */
-
-        ptr = ptr + sizeof(struct icmp6_hdr);
-
-        for (i = 0; i < (ICMPV6_ECHO_PAYLOAD_SIZE >> 2); i++) {
-            *(uint32_t *)ptr = random();
-            ptr += sizeof(uint32_t);
-        }
         break;
 
     case PROBE_UNREC_OPT:
         *prev_nh = IPPROTO_DSTOPTS;
 
-        if ((ptr + sizeof(struct icmp6_hdr) + 8 + ICMPV6_ECHO_PAYLOAD_SIZE) > (v6buffer + icmp6_max_packet_size)) {
+        if ((ptr + sizeof(struct icmp6_hdr) + 8 + ICMPV6_ECHO_PAYLOAD_SIZE) > (v6buffer + idata->mtu)) {
             if (idata->verbose_f > 1)
                 puts("Packet too large while creating Unrec. Opt. Probe Packet");
 
@@ -5206,128 +5992,236 @@ int host_scan_local(pcap_t *pfd, struct iface_data *idata, struct in6_addr *srca
         *uint32 = random();
 
         ptr = ptr + 4;
-        icmp6 = (struct icmp6_hdr *)ptr;
-        icmp6->icmp6_type = ICMP6_ECHO_REQUEST;
-        icmp6->icmp6_code = 0;
-        icmp6->icmp6_cksum = random();
-        icmp6->icmp6_data16[0] = htons(getpid()); /* Identifier */
-        icmp6->icmp6_data16[1] = htons(random()); /* Sequence Number */
-
-        ptr = ptr + sizeof(struct icmp6_hdr);
+        break;
 
-        for (i = 0; i < (ICMPV6_ECHO_PAYLOAD_SIZE >> 2); i++) {
-            *(uint32_t *)ptr = random();
-            ptr += sizeof(uint32_t);
-        }
+    default:
+        return (-1);
         break;
     }
 
+    icmp6 = (struct icmp6_hdr *)ptr;
+    icmp6->icmp6_type = ICMP6_ECHO_REQUEST;
+    icmp6->icmp6_code = 0;
+    icmp6->icmp6_cksum = random();
+    icmp6->icmp6_data16[0] = htons(getpid()); /* Identifier */
+    icmp6->icmp6_data16[1] = htons(random()); /* Sequence Number */
+
+    ptr = ptr + sizeof(struct icmp6_hdr);
+
+    for (i = 0; i < (ICMPV6_ECHO_PAYLOAD_SIZE >> 2); i++) {
+        *(uint32_t *)ptr = random();
+        ptr += sizeof(uint32_t);
+    }
+
     ipv6->ip6_plen = htons((ptr - v6buffer) - MIN_IPV6_HLEN);
     icmp6->icmp6_cksum = 0;
     icmp6->icmp6_cksum = in_chksum(v6buffer, icmp6, ptr - ((unsigned char *)icmp6), IPPROTO_ICMPV6);
 
-    /* We set the signal handler, and the anchor for siglongjump() */
-    canjump = 0;
-    memset(&new_sig, 0, sizeof(struct sigaction));
-    sigemptyset(&new_sig.sa_mask);
-    new_sig.sa_handler = &local_sig_alarm;
+    probe->len = ptr - probe->buffer;
+    return 0;
+}
+
+/*
+ * Function: run_local_probes()
+ *
+ * Sends a set of local probes (possibly on different interfaces of an interface set), and processes the responses
+ * received on any of the interfaces until all the probes have been answered, or the last retransmission times out.
+ * Multicast probes add every node that responds to their host list, while unicast probes validate their host entry.
+ */
+
+int run_local_probes(struct iface_set *set, struct local_probe *probes, unsigned int nprobes, unsigned char type) {
+    struct pcap_pkthdr *pkthdr;
+    const u_char *pktdata;
+    struct ip6_hdr *pkt_ipv6;
+    struct icmp6_hdr *pkt_icmp6;
+    struct nd_neighbor_solicit *pkt_ns;
+    unsigned char *pkt_end;
+    struct packet_view view;
+    struct iface_data *idata = set->iface[0], *rxiface;
+    struct local_probe *probe;
+    struct host_list *hlist;
+    struct event_loop loop;
+    unsigned int j, pending = nprobes, tries = 0;
+    unsigned char error_f = FALSE;
+    int result;
+
+    for (j = 0; j < nprobes; j++) {
+        probe = &(probes[j]);
+
+        if (probe->host != NULL && pcap_datalink(probe->idata->pfd) != DLT_EN10MB) {
+            if (probe->idata->verbose_f > 1)
+                printf("Error: Interface %s is not an Ethernet interface", probe->idata->iface);
+
+            return (-1);
+        }
+
+        if (set_local_filter(probe->idata, type) == -1 || build_local_probe(probe, type) == -1)
+            return (-1);
+    }
+
+    /* The responses may arrive on any of the interfaces of the set (see read_iface_set()) */
+    if (init_event_loop(&loop, -1, 1) == FAILURE) {
+        if (idata->verbose_f > 1)
+            puts("Error while initializing the event loop");
+
+        return (-1);
+    }
+
+    for (j = 0; j < set->niface; j++) {
+        if (set->iface[j]->fd >= 0 && add_event_fd(&loop, set->iface[j]->fd) == FAILURE) {
+            if (idata->verbose_f > 1)
+                puts("Error while initializing the event loop");
+
+            free_event_loop(&loop);
+            return (-1);
+        }
+    }
+
+    /* All the members of the set share the timeouts of the first interface (see clone_iface_data()) */
+    while (tries <= idata->local_retrans && pending && !error_f) {
+        for (j = 0; j < nprobes; j++) {
+            probe = &(probes[j]);
+
+            if (probe->done_f)
+                continue;
+
+            if ((nw = send_frame(probe->idata, probe->buffer, probe->len)) == -1) {
+                if (idata->verbose_f > 1)
+                    printf("send_frame(): %s\n", send_frame_error(probe->idata));
+
+                error_f = TRUE;
+                break;
+            }
+
+            if ((unsigned int)nw != probe->len) {
+                if (idata->verbose_f > 1)
+                    printf("send_frame(): only wrote %d bytes (rather than %u bytes)\n", nw, probe->len);
+
+                error_f = TRUE;
+                break;
+            }
+        }
+
+        set_event_timer(&loop, 0, idata->local_timeout);
+        tries++;
+
+        while (pending && !error_f) {
+            if (expired_event_timer(&loop, NULL))
+                break;
+
+            if ((result = read_iface_set(set, &rxiface, &pkthdr, &pktdata)) == -1) {
+                if (idata->verbose_f > 1)
+                    printf("pcap_next_ex(): %s", pcap_geterr(rxiface->pfd));
+
+                error_f = TRUE;
+                break;
+            }
+            else if (result == PCAP_ERROR_BREAK) {
+                /* End of the savefile (see open_rx_replay()): there are no more responses to wait for */
+                tries = idata->local_retrans + 1;
+                break;
+            }
+
+            if (result != 1) {
+                if (wait_event_loop(&loop) == FAILURE)
+                    error_f = TRUE;
+
+                continue;
+            }
+
+            if (dissect_packet(rxiface, pktdata, pkthdr, &view, 0) == FAILURE || view.proto != IPPROTO_ICMPV6 ||
+                (view.flags & PV_LATER_FRAGMENT))
+                continue;
+
+            pkt_ether = (struct ether_header *)pktdata;
+            pkt_ipv6 = view.ipv6;
+            pkt_icmp6 = (struct icmp6_hdr *)view.upper;
+            pkt_end = view.end;
+
+            if (pkt_icmp6->icmp6_type == ND_NEIGHBOR_SOLICIT) {
+                pkt_ns = (struct nd_neighbor_solicit *)pkt_icmp6;
 
-    if (sigaction(SIGALRM, &new_sig, &old_sig) == -1) {
-        if (idata->verbose_f > 1)
-            puts("Error setting up 'Alarm' signal");
+                if ((pkt_end - (unsigned char *)pkt_ns) < sizeof(struct nd_neighbor_solicit))
+                    continue;
 
-        return (-1);
-    }
+                for (j = 0; j < nprobes; j++) {
+                    if (probes[j].idata == rxiface && (is_eq_in6_addr(&(pkt_ns->nd_ns_target), probes[j].srcaddr) ||
+                                                       is_eq_in6_addr(&(pkt_ns->nd_ns_target), &(rxiface->ip6_local))))
+                        break;
+                }
 
-    if (sigsetjmp(env, 1) != 0)
-        tries++;
+                if (j < nprobes && send_neighbor_advert(rxiface, rxiface->pfd, pktdata) == -1)
+                    error_f = TRUE;
+            }
+            else if ((pkt_icmp6->icmp6_type == ICMP6_ECHO_REPLY) || (pkt_icmp6->icmp6_type == ICMP6_PARAM_PROB)) {
+                if ((pkt_end - (unsigned char *)pkt_icmp6) < sizeof(struct icmp6_hdr))
+                    continue;
 
-    canjump = 1;
+                for (j = 0; j < nprobes; j++) {
+                    probe = &(probes[j]);
 
-    while (tries <= idata->local_retrans && !foundaddr_f && !error_f) {
-        if ((nw = pcap_inject(pfd, buffer, ptr - buffer)) == -1) {
-            if (idata->verbose_f > 1)
-                printf("pcap_inject(): %s\n", pcap_geterr(pfd));
+                    if (probe->idata != rxiface || probe->done_f)
+                        continue;
 
-            error_f = TRUE;
-            break;
-        }
+                    /*
+                       If the Source Address of a multicast probe was a link-local address, we only want link-local
+                       addresses. OTOH, if the Source Address was a global address, we only want global addresses.
+                     */
+                    if (probe->host == NULL &&
+                        IN6_IS_ADDR_LINKLOCAL(probe->srcaddr) != IN6_IS_ADDR_LINKLOCAL(&(pkt_ipv6->ip6_src)))
+                        continue;
 
-        if (nw != (ptr - buffer)) {
-            if (idata->verbose_f > 1)
-                printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+                    if (valid_icmp6_response(rxiface, type, &view, probe->buffer))
+                        break;
+                }
 
-            error_f = TRUE;
-            break;
-        }
+                if (j == nprobes)
+                    continue;
 
-        alarm(idata->local_timeout);
+                if (probe->host != NULL) {
+                    probe->host->ether = pkt_ether->src;
+                    probe->host->flag = VALID_MAPPING;
+                    probe->done_f = TRUE;
+                    pending--;
+                    continue;
+                }
 
-        foundaddr_f = FALSE;
+                hlist = probe->hlist;
 
-        while (!foundaddr_f && !error_f) {
+                if (is_ip6_in_list(&(pkt_ipv6->ip6_src), hlist))
+                    continue;
 
-            do {
-                if ((result = pcap_next_ex(pfd, &pkthdr, &pktdata)) == -1) {
+                if ((hlist->host[hlist->nhosts] = arena_alloc(&(hlist->arena), sizeof(struct host_entry))) == NULL) {
                     if (idata->verbose_f > 1)
-                        printf("pcap_next_ex(): %s", pcap_geterr(pfd));
+                        puts("Error when allocating memory for host data");
 
                     error_f = TRUE;
                     break;
                 }
-            } while (result == 0 || pktdata == NULL);
-
-            if (error_f)
-                break;
-
-            pkt_ether = (struct ether_header *)pktdata;
-            pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + ETHER_HDR_LEN);
-            pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
-
-            if ((pkt_end - pktdata) < (ETHER_HDR_LEN + MIN_IPV6_HLEN))
-                continue;
 
-            if (pkt_ipv6->ip6_nxt == IPPROTO_ICMPV6) {
-                pkt_icmp6 = (struct icmp6_hdr *)((char *)pkt_ipv6 + sizeof(struct ip6_hdr));
+                memset(hlist->host[hlist->nhosts], 0, sizeof(struct host_entry));
 
-                if (pkt_icmp6->icmp6_type == ND_NEIGHBOR_SOLICIT) {
-                    pkt_ns = (struct nd_neighbor_solicit *)pkt_icmp6;
-
-                    if ((pkt_end - (unsigned char *)pkt_ns) < sizeof(struct nd_neighbor_solicit))
-                        continue;
+                (hlist->host[hlist->nhosts])->ip6 = pkt_ipv6->ip6_src;
+                (hlist->host[hlist->nhosts])->ether = pkt_ether->src;
+                (hlist->host[hlist->nhosts])->flag = VALID_MAPPING;
+                (hlist->nhosts)++;
 
-                    if (is_eq_in6_addr(&(pkt_ns->nd_ns_target), &(idata->ip6_local)) ||
-                        is_eq_in6_addr(&(pkt_ns->nd_ns_target), srcaddr)) {
-                        if (send_neighbor_advert(idata, pfd, pktdata) == -1) {
-                            error_f = TRUE;
-                            break;
+                /* Once the list is full, the probes that feed it are done */
+                if (hlist->nhosts >= hlist->maxhosts) {
+                    for (j = 0; j < nprobes; j++) {
+                        if (probes[j].hlist == hlist && !probes[j].done_f) {
+                            probes[j].done_f = TRUE;
+                            pending--;
                         }
                     }
                 }
-                else if ((pkt_icmp6->icmp6_type == ICMP6_ECHO_REPLY) || (pkt_icmp6->icmp6_type == ICMP6_PARAM_PROB)) {
-
-                    if ((pkt_end - (unsigned char *)pkt_icmp6) < sizeof(struct icmp6_hdr))
-                        continue;
-
-                    if (valid_icmp6_response(idata, type, pkthdr, pktdata, buffer)) {
-                        host->ether = pkt_ether->src;
-                        host->flag = VALID_MAPPING;
-                        foundaddr_f = TRUE;
-                        break;
-                    }
-                }
             }
 
         } /* Processing packets */
 
-    } /* Resending Probe packet */
-
-    if (sigaction(SIGALRM, &old_sig, NULL) == -1) {
-        if (idata->verbose_f > 1)
-            puts("Error setting up 'Alarm' signal");
+    } /* Resending probe packets */
 
-        error_f = TRUE;
-    }
+    free_event_loop(&loop);
 
     if (error_f)
         return (-1);
@@ -5427,11 +6321,7 @@ int print_unique_host_entries(struct host_list *hlist, unsigned char flag) {
  */
 
 void free_host_entries(struct host_list *hlist) {
-    unsigned int i;
-
-    for (i = 0; i < hlist->nhosts; i++)
-        free(hlist->host[i]);
-
+    free_arena(&(hlist->arena));
     hlist->nhosts = 0; /* Set the number of entries to 0, to reflect the released memory */
     return;
 }
@@ -5465,7 +6355,8 @@ int create_candidate_globals(struct iface_data *idata, struct host_list *local,
                 if (is_ip6_in_list(&caddr, global))
                     continue;
 
-                if ((candidate->host[candidate->nhosts] = malloc(sizeof(struct host_entry))) == NULL) {
+                if ((candidate->host[candidate->nhosts] =
+                         arena_alloc(&(candidate->arena), sizeof(struct host_entry))) == NULL) {
                     if (verbose_f > 1)
                         puts("Error allocating memory while creating local -> global list");
 
@@ -5487,36 +6378,83 @@ int create_candidate_globals(struct iface_data *idata, struct host_list *local,
 /*
  * Function: validate_host_entries()
  *
- * Tests entries in a list, updates entries with invalid mappings, and removes non-existent addresses
+ * Tests the candidate entries of each interface of a set, and copies the valid ones (with their updated mappings) to
+ * the "global" list of the interface. The candidates of the different interfaces are probed at the same time.
  */
 
-int validate_host_entries(pcap_t *pfd, struct iface_data *idata, struct host_list *candidate,
-                          struct host_list *global) {
-    unsigned int i;
-    struct in6_addr *srcaddrptr;
+int validate_host_entries(struct iface_set *set, struct local_scan *scan) {
+    struct local_probe probes[MAX_IFACE_SET];
+    struct host_list *candidate, *global;
+    unsigned int i, j, nprobes, next[MAX_IFACE_SET];
 
-    for (i = 0; i < candidate->nhosts; i++) {
-        if ((candidate->host[i])->flag == INVALID_MAPPING) {
-            srcaddrptr = sel_src_addr_ra(idata, &((candidate->host[i])->ip6));
+    for (i = 0; i < set->niface; i++)
+        next[i] = 0;
 
-            if (probe_unrec_f) {
-                if (host_scan_local(pfd, idata, srcaddrptr, PROBE_UNREC_OPT, candidate->host[i]) == -1)
-                    return (-1);
+    while (TRUE) {
+        /* Next entry of each interface that has yet to be validated */
+        nprobes = 0;
+
+        for (i = 0; i < set->niface; i++) {
+            candidate = &(scan[i].candidate);
+
+            while (next[i] < candidate->nhosts && (candidate->host[next[i]])->flag != INVALID_MAPPING)
+                next[i]++;
+
+            if (next[i] == candidate->nhosts)
+                continue;
+
+            memset(&(probes[nprobes]), 0, sizeof(struct local_probe));
+            probes[nprobes].idata = set->iface[i];
+            probes[nprobes].host = candidate->host[next[i]];
+            probes[nprobes].srcaddr = sel_src_addr_ra(set->iface[i], &((candidate->host[next[i]])->ip6));
+            nprobes++;
+            next[i]++;
+        }
+
+        if (nprobes == 0)
+            break;
+
+        if (probe_unrec_f) {
+            if (run_local_probes(set, probes, nprobes, PROBE_UNREC_OPT) == -1)
+                return (-1);
+        }
+
+        if (probe_echo_f) {
+            /* Only the entries that did not respond to the previous probe are probed again */
+            for (i = 0, j = 0; i < nprobes; i++) {
+                if ((probes[i].host)->flag == INVALID_MAPPING) {
+                    probes[j] = probes[i];
+                    probes[j].done_f = FALSE;
+                    j++;
+                }
             }
 
-            if (((candidate->host[i])->flag == INVALID_MAPPING) && probe_echo_f) {
-                if (host_scan_local(pfd, idata, srcaddrptr, PROBE_ICMP6_ECHO, candidate->host[i]) == -1)
+            if (j && run_local_probes(set, probes, j, PROBE_ICMP6_ECHO) == -1)
+                return (-1);
+        }
+    }
+
+    for (i = 0; i < set->niface; i++) {
+        candidate = &(scan[i].candidate);
+        global = &(scan[i].global);
+
+        /* Valid entries are copied to the "global" list, since the candidate list is released as a whole */
+        for (j = 0; j < candidate->nhosts; j++) {
+            if ((candidate->host[j])->flag == VALID_MAPPING && global->nhosts < global->maxhosts) {
+                if ((global->host[global->nhosts] = arena_alloc(&(global->arena), sizeof(struct host_entry))) ==
+                    NULL) {
+                    if (verbose_f > 1)
+                        puts("Error allocating memory while validating global addresses");
+
                     return (-1);
+                }
+
+                *(global->host[global->nhosts]) = *(candidate->host[j]);
+                (global->nhosts)++;
             }
         }
 
-        if ((candidate->host[i])->flag == VALID_MAPPING) {
-            global->host[global->nhosts] = candidate->host[i];
-            (global->nhosts)++;
-        }
-        else {
-            free(candidate->host[i]);
-        }
+        free_host_entries(candidate);
     }
 
     return 0;
@@ -5528,10 +6466,9 @@ int validate_host_entries(pcap_t *pfd, struct iface_data *idata, struct host_lis
  * Checks whether the response to an ICMPv6 probe is valid
  */
 
-int valid_icmp6_response(struct iface_data *idata, unsigned char type, struct pcap_pkthdr *pkthdr,
-                         const u_char *pktdata, unsigned char *pktsent) {
+int valid_icmp6_response(struct iface_data *idata, unsigned char type, struct packet_view *view,
+                         unsigned char *pktsent) {
 
-    struct ether_header *pkt_ether;
     struct ip6_hdr *pkt_ipv6, *ipv6;
     struct icmp6_hdr *pkt_icmp6, *pkt_icmp6_icmp6, *icmp6;
     unsigned char *pkt_end;
@@ -5543,21 +6480,13 @@ int valid_icmp6_response(struct iface_data *idata, unsigned char type, struct pc
     else
         icmp6 = (struct icmp6_hdr *)((char *)ipv6 + sizeof(struct ip6_hdr));
 
-    pkt_ether = (struct ether_header *)pktdata;
-    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + ETHER_HDR_LEN);
-    pkt_icmp6 = (struct icmp6_hdr *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
-    pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
+    /* The caller has dissected the packet (see dissect_packet()), so Extension Headers have been skipped */
+    pkt_ipv6 = view->ipv6;
+    pkt_icmp6 = (struct icmp6_hdr *)view->upper;
+    pkt_end = view->end;
 
     switch (type) {
     case PROBE_ICMP6_ECHO:
-        pkt_icmp6 = (struct icmp6_hdr *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
-
-        /* The packet length is the minimum of what we capured, and what is specified in the
-           IPv6 Total Lenght field
-         */
-        if (pkt_end > ((unsigned char *)pkt_icmp6 + pkt_ipv6->ip6_plen))
-            pkt_end = (unsigned char *)pkt_icmp6 + pkt_ipv6->ip6_plen;
-
         /*
            Discard the packet if it is not of the minimum size to contain an ICMPv6
            header and the payload we included in the ICMPv6 Echo Request
@@ -5568,14 +6497,6 @@ int valid_icmp6_response(struct iface_data *idata, unsigned char type, struct pc
         break;
 
     case PROBE_UNREC_OPT:
-        pkt_icmp6 = (struct icmp6_hdr *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
-
-        /* The packet length is the minimum of what we capured, and what is specified in the
-           IPv6 Total Lenght field
-         */
-        if (pkt_end > ((unsigned char *)pkt_icmp6 + pkt_ipv6->ip6_plen))
-            pkt_end = (unsigned char *)pkt_icmp6 + pkt_ipv6->ip6_plen;
-
         /*
            Discard the packet if it is not of the minimum size to contain an ICMPv6
            header and the embedded payload
@@ -5630,37 +6551,25 @@ int valid_icmp6_response(struct iface_data *idata, unsigned char type, struct pc
 /*
  * Function: valid_icmp6_response_remote()
  *
- * Checks whether the response to an ICMPv6 probe is valid
+ * Checks whether the response to an ICMPv6 probe is valid, by verifying the cookie included in the probe. For valid
+ * responses, the time at which the probe was sent is stored in "sent".
  */
 
-int valid_icmp6_response_remote(struct iface_data *idata, struct scan_list *scan, unsigned char type,
-                                struct pcap_pkthdr *pkthdr, const u_char *pktdata, unsigned char *pktsent) {
+int valid_icmp6_response_remote(struct iface_data *idata, unsigned char type, struct packet_view *view,
+                                struct timeval *sent) {
 
-    struct ether_header *pkt_ether;
-    struct ip6_hdr *pkt_ipv6, *ipv6;
-    struct icmp6_hdr *pkt_icmp6, *pkt_icmp6_icmp6, *icmp6;
+    struct ip6_hdr *pkt_ipv6, *pkt_ipv6_ipv6;
+    struct icmp6_hdr *pkt_icmp6, *pkt_icmp6_icmp6;
     unsigned char *pkt_end;
+    uint32_t cookie;
 
-    ipv6 = (struct ip6_hdr *)(pktsent + idata->linkhsize);
-
-    if (type == PROBE_UNREC_OPT)
-        icmp6 = (struct icmp6_hdr *)((char *)ipv6 + sizeof(struct ip6_hdr) + MIN_DST_OPT_HDR_SIZE);
-    else
-        icmp6 = (struct icmp6_hdr *)((char *)ipv6 + sizeof(struct ip6_hdr));
-
-    pkt_ether = (struct ether_header *)pktdata;
-    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata->linkhsize);
-    pkt_icmp6 = (struct icmp6_hdr *)((char *)pkt_ipv6 + sizeof(struct ip6_hdr));
-    pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
+    /* The caller has dissected the packet (see dissect_packet()), so Extension Headers have been skipped */
+    pkt_ipv6 = view->ipv6;
+    pkt_icmp6 = (struct icmp6_hdr *)view->upper;
+    pkt_end = view->end;
 
     switch (type) {
     case PROBE_ICMP6_ECHO:
-        /* The packet length is the minimum of what we capured, and what is specified in the
-           IPv6 Total Lenght field
-         */
-        if (pkt_end > ((unsigned char *)pkt_icmp6 + pkt_ipv6->ip6_plen))
-            pkt_end = (unsigned char *)pkt_icmp6 + pkt_ipv6->ip6_plen;
-
         /*
            Discard the packet if it is not of the minimum size to contain an ICMPv6
            header and the payload we included in the ICMPv6 Echo Request
@@ -5671,12 +6580,6 @@ int valid_icmp6_response_remote(struct iface_data *idata, struct scan_list *scan
         break;
 
     case PROBE_UNREC_OPT:
-        /* The packet length is the minimum of what we capured, and what is specified in the
-           IPv6 Total Lenght field
-         */
-        if (pkt_end > ((unsigned char *)pkt_icmp6 + pkt_ipv6->ip6_plen))
-            pkt_end = (unsigned char *)pkt_icmp6 + pkt_ipv6->ip6_plen;
-
         /*
            Discard the packet if it is not of the minimum size to contain an ICMPv6
            header and the empedded payload
@@ -5689,46 +6592,194 @@ int valid_icmp6_response_remote(struct iface_data *idata, struct scan_list *scan
         break;
     }
 
-    /*
-       Check that that the Destination Address of the incoming packet is the same as the one
-       we used for the Source Address of the Probe packet.
-     */
-    if (!is_eq_in6_addr(&(pkt_ipv6->ip6_dst), &(ipv6->ip6_src)))
-        return 0;
-
     /* Check that the ICMPv6 checksum is correct */
     if (in_chksum(pkt_ipv6, pkt_icmp6, pkt_end - ((unsigned char *)pkt_icmp6), IPPROTO_ICMPV6) != 0)
         return 0;
 
     switch (type) {
     case PROBE_ICMP6_ECHO:
-        if (pkt_icmp6->icmp6_data16[0] != icmp6->icmp6_data16[0]) {
-            return 0;
-        }
-        else if (pkt_icmp6->icmp6_data16[1] != icmp6->icmp6_data16[1]) {
-            return 0;
+        /* The Echo Reply is sent from the target to the Source Address of our probe */
+        if (probecookie_f) {
+            cookie = probe_cookie(&(pkt_ipv6->ip6_dst), &(pkt_ipv6->ip6_src), 0);
+
+            if (pkt_icmp6->icmp6_data16[0] != htons(cookie >> 16)) {
+                return 0;
+            }
+            else if (pkt_icmp6->icmp6_data16[1] != htons(cookie & 0xffff)) {
+                return 0;
+            }
         }
 
+        get_probe_timestamp((unsigned char *)pkt_icmp6 + sizeof(struct icmp6_hdr), sent);
         break;
 
     case PROBE_UNREC_OPT:
-        pkt_icmp6_icmp6 = (struct icmp6_hdr *)((unsigned char *)pkt_icmp6 + sizeof(struct icmp6_hdr) +
-                                               sizeof(struct ip6_hdr) + MIN_DST_OPT_HDR_SIZE);
+        /* The ICMPv6 error message embeds our probe */
+        pkt_ipv6_ipv6 = (struct ip6_hdr *)((unsigned char *)pkt_icmp6 + sizeof(struct icmp6_hdr));
+        pkt_icmp6_icmp6 = (struct icmp6_hdr *)((unsigned char *)pkt_ipv6_ipv6 + sizeof(struct ip6_hdr) +
+                                               MIN_DST_OPT_HDR_SIZE);
 
-        if (pkt_icmp6_icmp6->icmp6_data16[0] != icmp6->icmp6_data16[0]) {
+        if (!is_eq_in6_addr(&(pkt_ipv6->ip6_dst), &(pkt_ipv6_ipv6->ip6_src)) ||
+            !is_eq_in6_addr(&(pkt_ipv6->ip6_src), &(pkt_ipv6_ipv6->ip6_dst)))
             return 0;
-        }
 
-        else if (pkt_icmp6_icmp6->icmp6_data16[1] != icmp6->icmp6_data16[1]) {
-            return 0;
+        if (probecookie_f) {
+            cookie = probe_cookie(&(pkt_ipv6_ipv6->ip6_src), &(pkt_ipv6_ipv6->ip6_dst), 0);
+
+            if (pkt_icmp6_icmp6->icmp6_data16[0] != htons(cookie >> 16)) {
+                return 0;
+            }
+
+            else if (pkt_icmp6_icmp6->icmp6_data16[1] != htons(cookie & 0xffff)) {
+                return 0;
+            }
         }
 
+        get_probe_timestamp((unsigned char *)pkt_icmp6_icmp6 + sizeof(struct icmp6_hdr), sent);
         break;
     }
 
     return 1;
 }
 
+/*
+ * Function: valid_tcp_response_remote()
+ *
+ * Checks whether a TCP segment is a response to one of our TCP probes, by verifying the cookie included in the probe
+ */
+
+int valid_tcp_response_remote(struct ip6_hdr *pkt_ipv6, struct tcp_hdr *pkt_tcp) {
+    uint32_t cookie;
+
+    /* Responses replayed without the key of the scan cannot be validated (see init_probe_key()) */
+    if (!probecookie_f)
+        return (1);
+
+    cookie = probe_cookie(&(pkt_ipv6->ip6_dst), &(pkt_ipv6->ip6_src), ntohs(pkt_tcp->th_sport));
+
+    /* SYN/ACKs and RSTs acknowledge (part of) the sequence space consumed by our probe */
+    if (pkt_tcp->th_flags & TH_ACK)
+        return ((uint32_t)(ntohl(pkt_tcp->th_ack) - cookie) <= tcp_probe_seglen);
+
+    /* RSTs sent in response to segments with the ACK bit set employ the Acknowledgement Number as Sequence Number */
+    return (ntohl(pkt_tcp->th_seq) == cookie);
+}
+
+/*
+ * Function: init_probe_key()
+ *
+ * Initializes the secret key employed for computing probe cookies. The key is never printed: the responses to a
+ * scan can only be replayed (with '--read-pcap') if the key of the scan was chosen with '--probe-key'. Replayed
+ * responses are only accepted without validating their cookies when explicitly requested ('--no-probe-key').
+ */
+
+void init_probe_key(void) {
+    if (probekey_f)
+        return;
+
+    if (noprobekey_f) {
+        probecookie_f = FALSE;
+        return;
+    }
+
+    init_random_key(probe_key, sizeof(probe_key));
+}
+
+/*
+ * Function: read_probe_key()
+ *
+ * Reads the key of the probe cookies from a string of hexadecimal digits (see init_probe_key())
+ */
+
+int read_probe_key(const char *hex) {
+    unsigned int i, byte;
+
+    if (strlen(hex) != sizeof(probe_key) * 2)
+        return (FALSE);
+
+    for (i = 0; i < sizeof(probe_key); i++) {
+        if (!isxdigit((unsigned char)hex[i * 2]) || !isxdigit((unsigned char)hex[i * 2 + 1]) ||
+            sscanf(hex + i * 2, "%2x", &byte) != 1)
+            return (FALSE);
+
+        probe_key[i] = byte;
+    }
+
+    return (TRUE);
+}
+
+/*
+ * Function: init_random_key()
+ *
+ * Fills a key with random bytes (from /dev/urandom, if available)
+ */
+
+void init_random_key(uint8_t *key, size_t len) {
+    FILE *fp;
+    size_t i;
+
+    if ((fp = fopen("/dev/urandom", "r")) != NULL) {
+        if (fread(key, len, 1, fp) == 1) {
+            fclose(fp);
+            return;
+        }
+
+        fclose(fp);
+    }
+
+    for (i = 0; i < len; i++)
+        key[i] = random();
+}
+
+/*
+ * Function: probe_cookie()
+ *
+ * Computes the cookie for a probe, as a keyed hash (SipHash) of its Source Address, Destination Address and
+ * Destination Port
+ */
+
+uint32_t probe_cookie(struct in6_addr *src, struct in6_addr *dst, uint16_t port) {
+    unsigned char data[sizeof(struct in6_addr) * 2 + sizeof(uint16_t)];
+
+    memcpy(data, src, sizeof(struct in6_addr));
+    memcpy(data + sizeof(struct in6_addr), dst, sizeof(struct in6_addr));
+    data[sizeof(struct in6_addr) * 2] = port >> 8;
+    data[sizeof(struct in6_addr) * 2 + 1] = port & 0xff;
+
+    return ((uint32_t)siphash24(probe_key, data, sizeof(data)));
+}
+
+/*
+ * Function: set_probe_timestamp()
+ *
+ * Writes the current time at the start of the payload of a probe, such that the latency of the response can be
+ * measured without keeping any per-probe state
+ */
+
+void set_probe_timestamp(unsigned char *payload) {
+    struct timeval now;
+    uint32_t stamp[2];
+
+    gettimeofday(&now, NULL);
+    stamp[0] = htonl((uint32_t)now.tv_sec);
+    stamp[1] = htonl((uint32_t)now.tv_usec);
+    memcpy(payload, stamp, sizeof(stamp));
+}
+
+/*
+ * Function: get_probe_timestamp()
+ *
+ * Reads the time at which a probe was sent (see set_probe_timestamp())
+ */
+
+void get_probe_timestamp(const unsigned char *payload, struct timeval *sent) {
+    uint32_t stamp[2];
+
+    memcpy(stamp, payload, sizeof(stamp));
+    sent->tv_sec = ntohl(stamp[0]);
+    sent->tv_usec = ntohl(stamp[1]);
+}
+
 /*
  * Function: process_config_file()
  *
@@ -5778,57 +6829,191 @@ int process_config_file(const char *path) {
         ln++;
     }
 
-    fclose(fp);
+    fclose(fp);
+
+    if (!fname_f)
+        strncpy(fname, "/usr/local/share/ipv6toolkit/oui.txt", MAX_FILENAME_SIZE - 1);
+
+    if (!portsfname_f)
+        strncpy(portsfname, "/usr/local/share/ipv6toolkit/service-names-port-numbers.csv", MAX_FILENAME_SIZE - 1);
+
+    if (!topportsfname_f)
+        strncpy(topportsfname, "/usr/local/share/ipv6toolkit/top-port-numbers.csv", MAX_FILENAME_SIZE - 1);
+
+    return (1);
+}
+
+/*
+ * Function: is_ip6_in_scan_entry()
+ *
+ * Check whether an IPv6 address belongs to a scan range
+ */
+int is_ip6_in_scan_entry(struct scan_entry *entry, union my6_addr *myip6) {
+    unsigned int j;
+
+    for (j = 0; j < 8; j++) {
+        if ((ntohs(myip6->s6addr16[j]) < ntohs(entry->start.s6addr16[j])) ||
+            (ntohs(myip6->s6addr16[j]) > ntohs(entry->end.s6addr16[j]))) {
+            return (FALSE);
+        }
+    }
+
+    return (TRUE);
+}
+
+/*
+ * Function: is_ip6_in_scan_list()
+ *
+ * Check whether an IPv6 address belongs to one of our scan ranges. If the index of scan ranges has been built, the
+ * lookup is performed over the interval tree of the index (see find_scan_index()). Otherwise, all scan ranges are
+ * checked.
+ */
+int is_ip6_in_scan_list(struct scan_list *scan, struct in6_addr *ip6) {
+    unsigned int i;
+    union my6_addr myip6;
+
+    myip6.in6_addr = *ip6;
+
+    if (scan->index == NULL) {
+        for (i = 0; i < scan->ntarget; i++) {
+            if (is_ip6_in_scan_entry(scan->target[i], &myip6))
+                return (TRUE);
+        }
+
+        return (FALSE);
+    }
+
+    return (find_scan_index(scan->index, 0, scan->nindex, &myip6));
+}
+
+/*
+ * Function: find_scan_index()
+ *
+ * Checks whether an address belongs to any of the entries [lo, hi) of the index of scan ranges. The sorted index is
+ * employed as an implicit balanced tree (the root of each subtree is the middle entry), such that subtrees whose
+ * "maxend" is smaller than the address, and entries that start after the address, are never visited.
+ */
+int find_scan_index(struct scan_index_entry *idx, unsigned int lo, unsigned int hi, union my6_addr *addr) {
+    unsigned int mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+
+        if (memcmp(&(idx[mid].maxend), addr, sizeof(union my6_addr)) < 0)
+            return (FALSE);
+
+        if (find_scan_index(idx, lo, mid, addr))
+            return (TRUE);
+
+        if (memcmp(&(idx[mid].start), addr, sizeof(union my6_addr)) > 0)
+            return (FALSE);
+
+        if (memcmp(&(idx[mid].end), addr, sizeof(union my6_addr)) >= 0 &&
+            (idx[mid].entry == NULL || is_ip6_in_scan_entry(idx[mid].entry, addr)))
+            return (TRUE);
+
+        lo = mid + 1;
+    }
+
+    return (FALSE);
+}
+
+/*
+ * Function: set_scan_index_maxend()
+ *
+ * Computes the "maxend" of the entries [lo, hi) of the index of scan ranges (see find_scan_index()), and returns the
+ * largest "end" of those entries
+ */
+union my6_addr *set_scan_index_maxend(struct scan_index_entry *idx, unsigned int lo, unsigned int hi) {
+    union my6_addr *left, *right;
+    unsigned int mid;
+
+    if (lo >= hi)
+        return (NULL);
+
+    mid = lo + (hi - lo) / 2;
+    idx[mid].maxend = idx[mid].end;
+
+    left = set_scan_index_maxend(idx, lo, mid);
+    right = set_scan_index_maxend(idx, mid + 1, hi);
 
-    if (!fname_f)
-        strncpy(fname, "/usr/local/share/ipv6toolkit/oui.txt", MAX_FILENAME_SIZE - 1);
+    if (left != NULL && memcmp(left, &(idx[mid].maxend), sizeof(union my6_addr)) > 0)
+        idx[mid].maxend = *left;
 
-    if (!portsfname_f)
-        strncpy(portsfname, "/usr/local/share/ipv6toolkit/service-names-port-numbers.csv", MAX_FILENAME_SIZE - 1);
+    if (right != NULL && memcmp(right, &(idx[mid].maxend), sizeof(union my6_addr)) > 0)
+        idx[mid].maxend = *right;
 
-    if (!topportsfname_f)
-        strncpy(topportsfname, "/usr/local/share/ipv6toolkit/top-port-numbers.csv", MAX_FILENAME_SIZE - 1);
+    return (&(idx[mid].maxend));
+}
 
-    return (1);
+/*
+ * Function: compare_scan_index()
+ *
+ * Compares two index entries (for qsort())
+ */
+int compare_scan_index(const void *a, const void *b) {
+    return (memcmp(&(((struct scan_index_entry *)a)->start), &(((struct scan_index_entry *)b)->start),
+                   sizeof(union my6_addr)));
 }
 
 /*
- * Function: is_ip6_in_scan_list()
+ * Function: build_scan_index()
  *
- * Check whether an IPv6 address belongs to one of our scan ranges
+ * Builds a sorted index of the scan ranges of a scan_list. Ranges that cover all addresses between their first and
+ * last address are merged with the overlapping/adjacent ranges. Other ranges are kept as separate entries, and are
+ * checked word by word.
  */
-int is_ip6_in_scan_list(struct scan_list *scan, struct in6_addr *ip6) {
-    unsigned int i, j;
-    union my6_addr myip6;
+int build_scan_index(struct scan_list *scan) {
+    struct scan_index_entry *idx, *last;
+    struct scan_entry *entry;
+    unsigned int i, n;
 
-    myip6.in6_addr = *ip6;
+    free(scan->index);
+    scan->index = NULL;
+    scan->nindex = 0;
 
-    for (i = 0; i < scan->ntarget; i++) {
-        for (j = 0; j < 8; j++) {
-            if ((ntohs(myip6.s6addr16[j]) < ntohs((scan->target[i])->start.s6addr16[j])) ||
-                (ntohs(myip6.s6addr16[j]) > ntohs((scan->target[i])->end.s6addr16[j]))) {
-                break;
-            }
-        }
+    if (scan->ntarget == 0)
+        return (TRUE);
 
-        if (j == 8)
-            return (TRUE);
+    if ((idx = malloc(scan->ntarget * sizeof(struct scan_index_entry))) == NULL) {
+        if (verbose_f > 1)
+            puts("scan6: Not enough memory");
+
+        return (FALSE);
     }
 
-    return (FALSE);
-}
+    for (i = 0; i < scan->ntarget; i++) {
+        entry = scan->target[i];
+        idx[i].start = entry->start;
+        idx[i].end = entry->end;
+        idx[i].entry = is_scan_range_contiguous(&(entry->start), &(entry->end)) ? NULL : entry;
+    }
 
-/*
- * Handler for the ALARM signal.
- *
- * Used for setting a timeout on libpcap reads
- */
+    qsort(idx, scan->ntarget, sizeof(struct scan_index_entry), compare_scan_index);
 
-void local_sig_alarm(int num) {
-    if (canjump == 0)
-        return;
+    /* Coalesce contiguous ranges */
+    n = 0;
+    last = NULL;
+
+    for (i = 0; i < scan->ntarget; i++) {
+        if (last != NULL && last->entry == NULL && idx[i].entry == NULL &&
+            (memcmp(&(idx[i].start), &(last->end), sizeof(union my6_addr)) <= 0 ||
+             is_my6_addr_next(&(last->end), &(idx[i].start)))) {
+            if (memcmp(&(idx[i].end), &(last->end), sizeof(union my6_addr)) > 0)
+                last->end = idx[i].end;
+
+            continue;
+        }
+
+        idx[n] = idx[i];
+        last = &idx[n];
+        n++;
+    }
 
-    siglongjmp(env, 1);
+    set_scan_index_maxend(idx, 0, n);
+    scan->index = idx;
+    scan->nindex = n;
+    return (TRUE);
 }
 
 /*
@@ -6145,20 +7330,18 @@ void print_port_entries(struct port_list *port_list) {
 /*
  * Function: add_to_scan_list()
  *
- * Check whether an IPv6 address belongs to one of our scan ranges
+ * Adds a range to a scan_list. Duplicate and overlapping ranges are removed afterwards, in bulk, by
+ * normalize_scan_list(). If the list is full, it is normalized right away, such that such ranges do not take the
+ * room of other targets.
  */
 int add_to_scan_list(struct scan_list *scan_list, struct scan_entry *new_entry) {
 
     if (scan_list->ntarget >= scan_list->maxtarget) {
-        return (FALSE);
-    }
-
-    /* Do not add this entry if it is a duplicate */
-    if (is_scan_entry_duplicate(scan_list, new_entry)) {
-        return (TRUE);
+        if (normalize_scan_list(scan_list) <= 0)
+            return (FALSE);
     }
 
-    if ((scan_list->target[scan_list->ntarget] = malloc(sizeof(struct scan_entry))) == NULL) {
+    if ((scan_list->target[scan_list->ntarget] = arena_alloc(&(scan_list->arena), sizeof(struct scan_entry))) == NULL) {
         if (verbose_f > 1)
             puts("scan6: Not enough memory");
 
@@ -6171,27 +7354,473 @@ int add_to_scan_list(struct scan_list *scan_list, struct scan_entry *new_entry)
 }
 
 /*
- * Function: is_scan_entry_duplicate()
+ * Function: is_scan_range_contiguous()
  *
- * Compares two IPv6 addresses
+ * Checks whether a range covers all addresses between its first and last address (i.e., all words that follow the
+ * first varying word span their whole range)
  */
+int is_scan_range_contiguous(union my6_addr *start, union my6_addr *end) {
+    unsigned int j;
 
-int is_scan_entry_duplicate(struct scan_list *scan_list, struct scan_entry *scan_entry) {
-    unsigned int i, j;
+    for (j = 0; j < 8 && start->s6addr16[j] == end->s6addr16[j]; j++)
+        ;
 
-    for (i = 0; i < scan_list->ntarget; i++) {
-        for (j = 0; j < 8; j++) {
-            if (ntohs(scan_entry->start.in6_addr.s6_addr16[j]) <
-                    ntohs((scan_list->target[i])->start.in6_addr.s6_addr16[j]) ||
-                ntohs(scan_entry->end.in6_addr.s6_addr16[j]) >
-                    ntohs((scan_list->target[i])->end.in6_addr.s6_addr16[j])) {
+    for (j++; j < 8; j++) {
+        if (start->s6addr16[j] != 0 || end->s6addr16[j] != 0xffff)
+            return (FALSE);
+    }
+
+    return (TRUE);
+}
+
+/*
+ * Function: is_my6_addr_next()
+ *
+ * Checks whether an address immediately follows another one
+ */
+int is_my6_addr_next(union my6_addr *addr, union my6_addr *next) {
+    union my6_addr tmp;
+    int k;
+
+    tmp = *addr;
+
+    for (k = 15; k >= 0; k--) {
+        if (++(tmp.s6addr[k]) != 0)
+            break;
+    }
+
+    return (k >= 0 && memcmp(&tmp, next, sizeof(union my6_addr)) == 0);
+}
+
+/*
+ * Function: compare_scan_norm()
+ *
+ * Sorts ranges by their first address (ascending) and last address (descending), for qsort()
+ */
+int compare_scan_norm(const void *a, const void *b) {
+    const struct scan_norm_entry *na = a, *nb = b;
+    int r;
+
+    if ((r = memcmp(&(na->entry->start), &(nb->entry->start), sizeof(union my6_addr))) != 0)
+        return (r);
+
+    return (memcmp(&(nb->entry->end), &(na->entry->end), sizeof(union my6_addr)));
+}
+
+/*
+ * Function: compare_scan_norm_pos()
+ *
+ * Sorts ranges by their original position in the scan_list, for qsort()
+ */
+int compare_scan_norm_pos(const void *a, const void *b) {
+    const struct scan_norm_entry *na = a, *nb = b;
+
+    return ((na->pos > nb->pos) - (na->pos < nb->pos));
+}
+
+/*
+ * Function: normalize_scan_list()
+ *
+ * Removes duplicate ranges and ranges contained in contiguous ranges, and merges overlapping or adjacent contiguous
+ * ranges (as long as the result can still be represented as a scan_entry). Ranges are sorted to find such ranges in
+ * a single pass, and the resulting ranges are then put back in their original order. Returns the number of ranges
+ * that were removed, or -1 on error. Removed ranges are simply dropped (their storage belongs to the arena of the
+ * scan_list).
+ */
+int normalize_scan_list(struct scan_list *scan) {
+    struct scan_norm_entry *norm;
+    struct scan_entry *entry;
+    unsigned int i, n;
+    int cur, ncoalesced;
+
+    if (scan->ntarget < 2)
+        return (0);
+
+    if ((norm = malloc(scan->ntarget * sizeof(struct scan_norm_entry))) == NULL) {
+        if (verbose_f > 1)
+            puts("scan6: Not enough memory");
+
+        return (-1);
+    }
+
+    for (i = 0; i < scan->ntarget; i++) {
+        norm[i].entry = scan->target[i];
+        norm[i].pos = i;
+        norm[i].contiguous_f = is_scan_range_contiguous(&(scan->target[i]->start), &(scan->target[i]->end));
+    }
+
+    qsort(norm, scan->ntarget, sizeof(struct scan_norm_entry), compare_scan_norm);
+
+    /* "cur" is the kept contiguous range with the largest last address */
+    n = 0;
+    cur = -1;
+    ncoalesced = 0;
+
+    for (i = 0; i < scan->ntarget; i++) {
+        entry = norm[i].entry;
+
+        /* Exact duplicate of the previous range */
+        if (n > 0 && memcmp(&(norm[n - 1].entry->start), &(entry->start), sizeof(union my6_addr)) == 0 &&
+            memcmp(&(norm[n - 1].entry->end), &(entry->end), sizeof(union my6_addr)) == 0) {
+            if (norm[i].pos < norm[n - 1].pos)
+                norm[n - 1].pos = norm[i].pos;
+
+            ncoalesced++;
+            continue;
+        }
+
+        if (cur != -1) {
+            /* Contained in a contiguous range (ranges are sorted by first address) */
+            if (memcmp(&(entry->end), &(norm[cur].entry->end), sizeof(union my6_addr)) <= 0) {
+                if (norm[i].pos < norm[cur].pos)
+                    norm[cur].pos = norm[i].pos;
+
+                ncoalesced++;
+                continue;
+            }
+
+            /* Overlapping or adjacent contiguous ranges */
+            if (norm[i].contiguous_f &&
+                (memcmp(&(entry->start), &(norm[cur].entry->end), sizeof(union my6_addr)) <= 0 ||
+                 is_my6_addr_next(&(norm[cur].entry->end), &(entry->start))) &&
+                is_scan_range_contiguous(&(norm[cur].entry->start), &(entry->end))) {
+                norm[cur].entry->end = entry->end;
+
+                if (norm[i].pos < norm[cur].pos)
+                    norm[cur].pos = norm[i].pos;
+
+                ncoalesced++;
+                continue;
+            }
+        }
+
+        norm[n] = norm[i];
+
+        if (norm[n].contiguous_f)
+            cur = n;
+
+        n++;
+    }
+
+    /* Restore the original order of the ranges (e.g., "smart" entries go first) */
+    qsort(norm, n, sizeof(struct scan_norm_entry), compare_scan_norm_pos);
+
+    for (i = 0; i < n; i++) {
+        scan->target[i] = norm[i].entry;
+        scan->target[i]->cur = scan->target[i]->start;
+    }
+
+    scan->ntarget = n;
+    scan->ctarget = 0;
+    free(norm);
+    return (ncoalesced);
+}
+
+/*
+ * Function: check_scan_routes()
+ *
+ * Looks up the first and last address of each scan_entry in the snapshot of the kernel routing table, and returns
+ * the number of entries whose route differs from that of the Destination Address employed to select the next hop
+ * (0 if the routing table snapshot has not been loaded, see load_route_table()).
+ */
+
+unsigned int check_scan_routes(struct iface_data *idata, struct scan_list *scan) {
+#ifdef __linux__
+    struct route_entry nhroute, *route;
+    struct in6_addr *addrs[2];
+    unsigned int i, j, nmismatch = 0;
+
+    if ((route = lookup_route_table(idata, &(idata->dstaddr))) == NULL)
+        return (0);
+
+    nhroute = *route;
+
+    for (i = 0; i < scan->ntarget; i++) {
+        addrs[0] = &(scan->target[i]->start.in6_addr);
+        addrs[1] = &(scan->target[i]->end.in6_addr);
+
+        for (j = 0; j < 2; j++) {
+            if ((route = lookup_route_table(idata, addrs[j])) == NULL)
+                return (nmismatch);
+
+            if (route->type != nhroute.type || route->ifindex != nhroute.ifindex ||
+                route->gateway_f != nhroute.gateway_f ||
+                (route->gateway_f && !is_eq_in6_addr(&(route->gateway), &(nhroute.gateway)))) {
+                if (idata->verbose_f > 1)
+                    print_ipv6_address("Target range routed through another next hop: ", addrs[0]);
+
+                nmismatch++;
                 break;
             }
         }
+    }
 
-        if (j >= 8)
-            return (TRUE);
+    return (nmismatch);
+#else
+    return (0);
+#endif
+}
+
+/*
+ * Function: open_worker_pcaps()
+ *
+ * Opens one libpcap handle per scan worker (the first worker employs idata->pfd)
+ */
+
+int open_worker_pcaps(struct iface_data *idata, unsigned int n) {
+    unsigned int i;
+
+    worker_pfd[0] = idata->pfd;
+
+    for (i = 1; i < n; i++) {
+        if ((worker_pfd[i] = open_iface_pcap(idata->iface, errbuf)) == NULL) {
+            printf("open_iface_pcap(%s): %s\n", idata->iface, errbuf);
+            return (FAILURE);
+        }
+
+        if (pcap_setnonblock(worker_pfd[i], 1, errbuf) == -1) {
+            printf("pcap_setnonblock(): %s\n", errbuf);
+            return (FAILURE);
+        }
     }
 
-    return (FALSE);
+    return (SUCCESS);
+}
+
+/*
+ * Function: shard_scan_list()
+ *
+ * Restricts a scan_list to the targets that correspond to the specified shard. Each scan_entry is split along its
+ * highest-order varying word. Entries that are too small to be split are assigned to the shards in a round-robin
+ * fashion.
+ */
+
+int shard_scan_list(struct scan_list *scan, unsigned int shard, unsigned int nshards) {
+    unsigned int i, j, w, first, nwords;
+    struct scan_entry *entry;
+
+    if (shard >= nshards)
+        return (FAILURE);
+
+    j = 0;
+
+    for (i = 0; i < scan->ntarget; i++) {
+        entry = scan->target[i];
+
+        for (w = 0; w < 8; w++) {
+            if (entry->start.s6addr16[w] != entry->end.s6addr16[w])
+                break;
+        }
+
+        nwords = (w < 8) ? (ntohs(entry->end.s6addr16[w]) - ntohs(entry->start.s6addr16[w]) + 1) : 1;
+
+        if (nwords >= nshards) {
+            first = ntohs(entry->start.s6addr16[w]);
+            entry->start.s6addr16[w] = htons(first + (nwords * shard) / nshards);
+            entry->end.s6addr16[w] = htons(first + (nwords * (shard + 1)) / nshards - 1);
+            entry->cur = entry->start;
+            scan->target[j++] = entry;
+        }
+        else if ((i % nshards) == shard) {
+            scan->target[j++] = entry;
+        }
+    }
+
+    scan->ntarget = j;
+    scan->ctarget = 0;
+    return (SUCCESS);
+}
+
+/*
+ * Function: start_scan_workers()
+ *
+ * Forks one process per scan worker. In each worker, it returns after the scan_list has been restricted to the
+ * worker's shard and the worker's libpcap handle has been installed in idata. The parent process merges the output
+ * of all workers into its standard output, adds up the runtime metrics reported by the workers (if enabled), and
+ * exits once all workers have finished.
+ */
+
+int start_scan_workers(struct iface_data *idata, struct scan_list *scan) {
+    int pipefd[2], mpipefd[2] = {-1, -1}, status, sel, maxfd, failed = FALSE;
+    unsigned int i, j;
+    pid_t pid, workers[MAX_SCAN_WORKERS];
+    ssize_t nread;
+    char rbuff[LINE_BUFFER_SIZE];
+    struct metrics report;
+    struct timeval timeout;
+    fd_set rset;
+
+    if (pipe(pipefd) == -1) {
+        if (idata->verbose_f)
+            perror("scan6");
+
+        return (FAILURE);
+    }
+
+    if (idata->metrics != NULL && pipe(mpipefd) == -1) {
+        if (idata->verbose_f)
+            perror("scan6");
+
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return (FAILURE);
+    }
+
+    fflush(stdout);
+
+    for (i = 0; i < nworkers; i++) {
+        if ((pid = fork()) == -1) {
+            if (idata->verbose_f)
+                perror("scan6");
+
+            /* Stop the workers that have already been started, rather than leaving them scanning on their own */
+            for (j = 0; j < i; j++)
+                kill(workers[j], SIGTERM);
+
+            for (j = 0; j < i; j++) {
+                while (waitpid(workers[j], &status, 0) == -1 && errno == EINTR)
+                    ;
+            }
+
+            close(pipefd[0]);
+            close(pipefd[1]);
+
+            if (mpipefd[0] != -1) {
+                close(mpipefd[0]);
+                close(mpipefd[1]);
+            }
+
+            return (FAILURE);
+        }
+
+        if (pid == 0) {
+            worker_id = i;
+            close(pipefd[0]);
+
+            /* Each line is written with a single write(), such that the output of different workers is not mixed */
+            if (dup2(pipefd[1], STDOUT_FILENO) == -1)
+                exit(EXIT_FAILURE);
+
+            close(pipefd[1]);
+            setvbuf(stdout, NULL, _IOLBF, 0);
+
+            /*
+               The parent prints the metrics of all workers. Whatever was accounted before the fork is reported by
+               the first worker only.
+             */
+            if (idata->metrics != NULL) {
+                close(mpipefd[0]);
+                redirect_metrics(idata->metrics, mpipefd[1], worker_id);
+
+                if (worker_id != 0)
+                    sum_metrics(idata->metrics, NULL, 0);
+            }
+
+            for (i = 0; i < nworkers; i++) {
+                if (i != worker_id)
+                    pcap_close(worker_pfd[i]);
+            }
+
+            idata->pfd = worker_pfd[worker_id];
+
+            if ((idata->fd = pcap_fileno(idata->pfd)) == -1) {
+                if (idata->verbose_f)
+                    puts("Error obtaining descriptor number for pcap_t");
+
+                exit(EXIT_FAILURE);
+            }
+
+            srandom(time(NULL) ^ getpid());
+            prng_seed_random(thread_prng(), PRNG_FAST);
+
+            /* With a pseudorandom order, each worker permutes every nworkers-th index of the whole target space */
+            if (scan->perm_f) {
+                scan->perm_first = worker_id;
+                scan->perm_stride = nworkers;
+                reset_scan_list(scan);
+            }
+            else if (shard_scan_list(scan, worker_id, nworkers) == FAILURE || scan->ntarget == 0) {
+                exit(EXIT_SUCCESS);
+            }
+
+            return (SUCCESS);
+        }
+
+        workers[i] = pid;
+    }
+
+    close(pipefd[1]);
+
+    if (mpipefd[1] != -1)
+        close(mpipefd[1]);
+
+    for (i = 0; i < nworkers; i++)
+        pcap_close(worker_pfd[i]);
+
+    /* idata->pfd was worker_pfd[0] (the metrics of the parent must not query it at exit) */
+    idata->pfd = NULL;
+
+    while (pipefd[0] != -1 || mpipefd[0] != -1) {
+        FD_ZERO(&rset);
+        maxfd = -1;
+
+        if (pipefd[0] != -1) {
+            FD_SET(pipefd[0], &rset);
+            maxfd = pipefd[0];
+        }
+
+        if (mpipefd[0] != -1) {
+            FD_SET(mpipefd[0], &rset);
+            maxfd = (mpipefd[0] > maxfd) ? mpipefd[0] : maxfd;
+        }
+
+        timeout.tv_sec = 1;
+        timeout.tv_usec = 0;
+
+        if ((sel = select(maxfd + 1, &rset, NULL, NULL, &timeout)) == -1) {
+            if (errno == EINTR)
+                continue;
+
+            break;
+        }
+
+        if (sel && pipefd[0] != -1 && FD_ISSET(pipefd[0], &rset)) {
+            if ((nread = read(pipefd[0], rbuff, sizeof(rbuff))) > 0) {
+                fwrite(rbuff, 1, nread, stdout);
+                fflush(stdout);
+            }
+            else if (nread == 0 || errno != EINTR) {
+                close(pipefd[0]);
+                pipefd[0] = -1;
+            }
+        }
+
+        /* Each report is written with a single write(), so it is read whole */
+        if (sel && mpipefd[0] != -1 && FD_ISSET(mpipefd[0], &rset)) {
+            if ((nread = read(mpipefd[0], &report, sizeof(report))) == sizeof(report)) {
+                if (report.reporter < nworkers) {
+                    worker_metrics[report.reporter] = report;
+                    sum_metrics(idata->metrics, worker_metrics, nworkers);
+                }
+            }
+            else if (nread == 0 || (nread == -1 && errno != EINTR)) {
+                close(mpipefd[0]);
+                mpipefd[0] = -1;
+            }
+        }
+
+        if (idata->metrics != NULL && idata->metrics->interval && time(NULL) >= idata->metrics->next)
+            print_metrics(idata->metrics);
+    }
+
+    while ((pid = wait(&status)) != -1 || errno == EINTR) {
+        if (pid != -1 && (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS))
+            failed = TRUE;
+    }
+
+    /* Each worker has saved its own checkpoint file, and '-J' appends the worker number to the name by itself */
+    if (interrupted_f && checkpoint_f && idata->verbose_f)
+        printf("\nScan interrupted (resume it with '-J %s')\n", ckptfile);
+
+    exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
 }
@@ -11,6 +11,8 @@
 #define GLOBAL_SRC 2
 
 #define ICMPV6_ECHO_PAYLOAD_SIZE 56
+#define LOCAL_PROBE_SIZE 128 /* Ethernet, IPv6, Destination Options and ICMPv6 Echo Request (with its payload) */
+#define PROBE_TIMESTAMP_SIZE 8 /* Time at which a probe was sent, at the start of the Echo Request payload */
 #define MAX_IPV6_ENTRIES 65000
 
 /* Constant for the host-scanning functions */
@@ -27,13 +29,19 @@
 #define MAX_IEEE_OUIS_LINE_SIZE 160
 #define OUI_HEX_STRING_SIZE 5
 #define MAX_IEEE_OUIS 1000
-#define MAX_SCAN_ENTRIES 65535
+#define MAX_SCAN_ENTRIES 1048576
 #define MAX_PORT_ENTRIES 65536
-#define MAX_PREF_ENTRIES MAX_SCAN_ENTRIES
+#define MAX_PREF_ENTRIES 65535
 #define SELECT_TIMEOUT 4
 #define PSCAN_TIMEOUT 1
 #define MAX_RANGE_STR_LEN 79
 #define MIN_INC_RANGE 1000
+#define MAX_SCAN_WORKERS 64
+#define PROBE_KEY_SIZE 16 /* Size of the key employed for the probe cookies */
+#define PERM_KEY_SIZE 16  /* Size of the key employed for the pseudorandom target permutation */
+#define PERM_ROUNDS 4     /* Number of rounds of the Feistel network employed for the target permutation */
+#define PERM_MAX_BITS 62  /* Max size of the target space (in bits) that can be scanned in pseudorandom order */
+#define CHECKPOINT_INTERVAL 10 /* Seconds between consecutive scan checkpoints */
 /* #define	MAX_DESTNATIONS			65535 */
 #define MAX_IID_ENTRIES 65535
 
@@ -51,6 +59,24 @@ union my6_addr {
     struct in6_addr in6_addr;
 };
 
+/* Results of a local scan on one of the interfaces of an interface set (see scan_local_set()) */
+struct local_scan {
+    struct host_list local;
+    struct host_list global;
+    struct host_list candidate;
+};
+
+/* Local probe: sent to the all-nodes multicast address (with a host list), or to a single host entry */
+struct local_probe {
+    struct iface_data *idata;
+    struct in6_addr *srcaddr;
+    struct host_list *hlist; /* Nodes that respond to a multicast probe */
+    struct host_entry *host; /* Entry validated by a unicast probe */
+    unsigned char buffer[LOCAL_PROBE_SIZE];
+    unsigned int len;
+    unsigned char done_f;
+};
+
 /* Stores one remote target to scan */
 struct scan_entry {
     union my6_addr start;
@@ -58,6 +84,28 @@ struct scan_entry {
     union my6_addr cur;
 };
 
+/* Used when normalizing a scan_list (see normalize_scan_list()) */
+struct scan_norm_entry {
+    struct scan_entry *entry;
+    unsigned int pos; /* Position of the range in the original scan_list */
+    unsigned char contiguous_f;
+};
+
+/* Position of a scan, as saved in a checkpoint file (see save_scan_checkpoint()) */
+struct scan_checkpoint {
+    unsigned int ctarget; /* Equal to scan_list->ntarget once all targets have been scanned */
+    union my6_addr cur;
+    uint64_t perm_index; /* Index employed to obtain "cur", when scanning in pseudorandom order */
+};
+
+/* Stores one entry of the (sorted) index of scan ranges */
+struct scan_index_entry {
+    union my6_addr start;
+    union my6_addr end;
+    union my6_addr maxend;    /* Largest "end" of the subtree rooted at this entry (see find_scan_index()) */
+    struct scan_entry *entry; /* NULL if the entry covers all addresses from "start" to "end" */
+};
+
 /* Store the list of remote targets to scan */
 struct scan_list {
     struct scan_entry **target;
@@ -65,6 +113,18 @@ struct scan_list {
     unsigned int ntarget;   /* Number of existing enties */
     unsigned int maxtarget; /* Max enties */
     unsigned int inc;       /* Increment size */
+    struct arena arena;     /* Storage for the entries */
+    struct scan_index_entry *index; /* Sorted index of the scan ranges (see build_scan_index()) */
+    unsigned int nindex;
+
+    /* Pseudorandom target order (see init_scan_perm()) */
+    unsigned char perm_f;
+    uint8_t perm_key[PERM_KEY_SIZE];
+    unsigned int perm_halfbits; /* Size (in bits) of each half of the Feistel network */
+    uint64_t *perm_offset;      /* Index of the first address of each range (plus the total number of addresses) */
+    uint64_t perm_first;        /* First index to be permuted (i.e., the shard of this worker) */
+    uint64_t perm_stride;       /* Distance between consecutive indexes (i.e., the number of workers) */
+    uint64_t perm_next;         /* Next index to be permuted */
 };
 
 #define MAX_PORTS_LINE_SIZE 80
@@ -90,6 +150,7 @@ struct port_list {
 struct port_table_entry {
     unsigned int loaded;
     char name[MAX_PORTS_LINE_SIZE];
+    unsigned int index; /* Index of the port in the port-scan results, plus one (0 if the port is not scanned) */
 };
 
 /* Constants for port scan results */
@@ -126,17 +187,28 @@ struct print_scans_list {
     unsigned int donesending;
 };
 
+/* Constants for concurrent port scans (see init_hashed_host_list()) */
+#define PSCAN_BATCH_SIZE 1024             /* Max number of hosts that are port-scanned concurrently */
+#define PSCAN_MAX_RESULTS (16 * 1024 * 1024) /* Max memory (in bytes) for the port-scan results of a batch */
+#define PSCAN_HASH_SIZE 4096               /* Number of buckets of the hash table of hosts */
+
+/* Port-scan results are stored as 2 bits per port (see set_port_result()) */
+#define PSCAN_NO_RESPONSE 0
+#define PSCAN_RESP_OPEN 1
+#define PSCAN_RESP_CLOSED 2
+
 struct hashed_host_entry {
     struct in6_addr ip6;
-    unsigned int tcp_results[MAX_PORT_RANGE];
+    uint8_t *results; /* Port-scan results (2 bits per target port) */
     struct hashed_host_entry *next;
     struct hashed_host_entry *prev;
 };
 
 struct hashed_host_list {
-    struct hashed_host_entry **host; /* Double-linked list of host entries */
-    unsigned int nhosts;             /* Current number of host entries */
-    unsigned int maxhosts;           /* Maximum number of host entries */
-    uint16_t key_l;                  /* Low-order word of the hash key */
-    uint16_t key_h;                  /* High-order word of the hash key */
+    struct hashed_host_entry **host;   /* Double-linked list of host entries (one per hash bucket) */
+    struct hashed_host_entry *entries; /* Host entries, in the order in which they were added */
+    uint8_t *results;                  /* Port-scan results of all host entries */
+    unsigned int nhosts;               /* Current number of host entries */
+    unsigned int maxhosts;             /* Maximum number of host entries */
+    unsigned int resultsize;           /* Size (in bytes) of the port-scan results of each host entry */
 };
@@ -61,6 +61,8 @@ void print_attack_info(struct iface_data *);
 void usage(void);
 void print_help(void);
 void frag_and_send(struct iface_data *);
+void init_flood_template(struct iface_data *);
+void flood_src_addr(unsigned char *, unsigned int, void *);
 unsigned int queue_data(struct tcp_queue *, unsigned char *, unsigned int);
 unsigned int dequeue_data(struct tcp_queue *, unsigned char *, unsigned int);
 unsigned int queue_copy(struct tcp_queue *, unsigned char *, unsigned int, unsigned char *, unsigned int);
@@ -105,6 +107,7 @@ struct iface_data idata;
 /* Data structures for packets read from the wire */
 struct pcap_pkthdr *pkthdr;
 const u_char *pktdata;
+struct packet_view pview;
 unsigned char *pkt_end;
 struct ether_header *pkt_ether;
 struct nd_neighbor_solicit *pkt_ns;
@@ -149,6 +152,11 @@ uint16_t mask;
 uint8_t hoplimit;
 uint16_t addr_key;
 
+/* Template for the flood packets (see init_flood_template()) */
+struct packet_template tmpl;
+unsigned char tmpl_f = 0;
+struct port_prefix srcportprefix;
+
 char plinkaddr[ETHER_ADDR_PLEN];
 char psrcaddr[INET6_ADDRSTRLEN], pdstaddr[INET6_ADDRSTRLEN], pv6addr[INET6_ADDRSTRLEN];
 
@@ -171,6 +179,14 @@ unsigned char *prev_nh, *startoffragment;
 
 struct filters filters;
 
+/* Used for measuring the packet-generation speed (see open_tx_dump()) */
+char *txdumpfile = NULL;
+
+/* Runtime metrics (see init_metrics()) */
+struct metrics metrics;
+unsigned int statsinterval;
+unsigned char stats_f = FALSE;
+
 int main(int argc, char **argv) {
     extern char *optarg;
     char *endptr; /* Used by strtoul() */
@@ -218,6 +234,7 @@ int main(int argc, char **argv) {
                                        {"accept-dst-addr", required_argument, 0, 'g'},
                                        {"accept-link-src-addr", required_argument, 0, 'B'},
                                        {"accept-link-dst-addr", required_argument, 0, 'G'},
+                                       {"filter-file", required_argument, 0, 'I'},
                                        {"flood-sources", required_argument, 0, 'F'},
                                        {"flood-ports", required_argument, 0, 'T'},
                                        {"loop", no_argument, 0, 'l'},
@@ -226,11 +243,15 @@ int main(int argc, char **argv) {
                                        {"listen", no_argument, 0, 'L'},
                                        {"probe-mode", required_argument, 0, 'p'},
                                        {"retrans", required_argument, 0, 'x'},
+                                       {"write-pcap", required_argument, 0, 'Y'},
+                                       {"dry-run", no_argument, 0, '3'},
+                                       {"read-pcap", required_argument, 0, 'R'},
+                                       {"stats-interval", required_argument, 0, '1'},
                                        {"verbose", no_argument, 0, 'v'},
                                        {"help", no_argument, 0, 'h'},
                                        {0, 0, 0, 0}};
 
-    const char shortopts[] = "i:s:d:A:c:C:Z:u:U:H:y:S:D:P:o:a:X:q:Q:V:w:W:M:Nnj:k:J:K:b:g:B:G:F:T:lr:z:Lp:x:vh";
+    const char shortopts[] = "i:s:d:A:c:C:Z:u:U:H:y:S:D:P:o:a:X:q:Q:V:w:W:M:Nnj:k:J:K:b:g:B:G:F:T:lr:z:Lp:x:Y:vh";
 
     char option;
 
@@ -902,6 +923,14 @@ int main(int argc, char **argv) {
             filters.acceptfilters_f = 1;
             break;
 
+        case 'I': /* Address filters from a file */
+            if (load_filter_file(&filters, optarg) == FAILURE) {
+                printf("Error while loading address filters from file %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+
+            break;
+
         case 'F': /* Flood source addresses */
             nsources = atoi(optarg);
             if (nsources == 0) {
@@ -981,6 +1010,23 @@ int main(int argc, char **argv) {
             retrans_f = 1;
             break;
 
+        case 'Y': /* Write the packets to a savefile, rather than sending them */
+            txdumpfile = optarg;
+            break;
+
+        case '3': /* Discard the packets, rather than sending them */
+            txdumpfile = "/dev/null";
+            break;
+
+        case 'R': /* Read the incoming packets from a savefile, rather than from the network */
+            idata.rxreplayfile = optarg;
+            break;
+
+        case '1': /* Print the runtime metrics periodically */
+            statsinterval = atoi(optarg);
+            stats_f = TRUE;
+            break;
+
         case 'v': /* Be verbose */
             (idata.verbose_f)++;
             break;
@@ -1039,8 +1085,28 @@ int main(int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
 
+    if (init_tx_batch(&idata, TX_BATCH_SIZE) == FAILURE) {
+        puts("Error while initializing batched transmission");
+        exit(EXIT_FAILURE);
+    }
+
     release_privileges();
 
+    /* When replaying a savefile, the packets are not sent */
+    if (idata.rxreplayfile != NULL && txdumpfile == NULL)
+        txdumpfile = "/dev/null";
+
+    if (txdumpfile != NULL && open_tx_dump(&idata, txdumpfile) == FAILURE) {
+        printf("Error while opening savefile %s\n", txdumpfile);
+        exit(EXIT_FAILURE);
+    }
+
+    if (stats_f && (init_metrics(&metrics, "tcp6", statsinterval) == FAILURE ||
+                    attach_metrics(&metrics, &idata) == FAILURE)) {
+        puts("Error while initializing the runtime metrics");
+        exit(EXIT_FAILURE);
+    }
+
     if (data_f) {
         data[datalen] = 0;
 
@@ -1179,6 +1245,10 @@ int main(int argc, char **argv) {
     if (sleep_f)
         pktinterval = (nsleep * 1000000) / (nsources * nports);
 
+    /* Packets written to a savefile are generated as fast as possible */
+    if (txdumpfile != NULL)
+        pktinterval = 0;
+
     timeout.tv_sec = pktinterval / 1000000;
     timeout.tv_usec = pktinterval % 1000000;
     stimeout = timeout;
@@ -1277,24 +1347,22 @@ int main(int argc, char **argv) {
 #else
             if (TRUE) {
 #endif
-                /* Read a packet */
+                /* Drain all the packets that are available, rather than processing one per loop turn */
+                while ((r = read_frame(&idata, &pkthdr, &pktdata)) == 1) {
+                    if (pktdata == NULL)
+                        continue;
+
+                    /* Only TCP segments with a valid checksum are of interest */
+                    if (dissect_packet(&idata, pktdata, pkthdr, &pview, DISSECT_CKSUM) == FAILURE ||
+                        pview.proto != IPPROTO_TCP || !(pview.flags & PV_CKSUM_OK))
+                        continue;
 
-                if ((r = pcap_next_ex(idata.pfd, &pkthdr, &pktdata)) == -1) {
-                    printf("pcap_next_ex(): %s", pcap_geterr(idata.pfd));
-                    exit(EXIT_FAILURE);
-                }
-                else if (r == 1 && pktdata != NULL) {
                     pkt_ether = (struct ether_header *)pktdata;
-                    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata.linkhsize);
-                    pkt_tcp = (struct tcp_hdr *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
-                    pkt_ns = (struct nd_neighbor_solicit *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
-                    pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
+                    pkt_ipv6 = pview.ipv6;
+                    pkt_tcp = (struct tcp_hdr *)pview.upper;
+                    pkt_end = pview.end;
                     pkt_tcp_flags = pkt_tcp->th_flags;
 
-                    /* Check that we are able to look into the IPv6 header */
-                    if ((pkt_end - pktdata) < (idata.linkhsize + MIN_IPV6_HLEN))
-                        continue;
-
                     if (is_eq_in6_addr(&(pkt_ipv6->ip6_src), &(idata.srcaddr))) {
                         continue;
                     }
@@ -1311,9 +1379,11 @@ int main(int argc, char **argv) {
                         continue;
                     }
 
-                    /* The TCP checksum must be valid */
-                    if (in_chksum(pkt_ipv6, pkt_tcp, pkt_end - ((unsigned char *)pkt_tcp), IPPROTO_TCP) != 0)
-                        continue;
+                    count_filter_result(&idata, ACCEPTED);
+
+                    /* The response is timed against the last (re)transmission of the probe */
+                    if (idata.metrics != NULL)
+                        record_latency(idata.metrics, &lastprobe, &(pkthdr->ts));
 
                     printf("RESPONSE:TCP6:%s%s%s%s%s%s:\n", ((pkt_tcp_flags & TH_FIN) ? "F" : ""),
                            ((pkt_tcp_flags & TH_SYN) ? "S" : ""), ((pkt_tcp_flags & TH_RST) ? "R" : ""),
@@ -1322,6 +1392,15 @@ int main(int argc, char **argv) {
 
                     exit(EXIT_SUCCESS);
                 }
+
+                if (r == -1) {
+                    printf("pcap_next_ex(): %s", pcap_geterr(idata.pfd));
+                    exit(EXIT_FAILURE);
+                }
+                else if (r == PCAP_ERROR_BREAK) {
+                    /* End of the savefile (see open_rx_replay()) */
+                    break;
+                }
             }
         }
 
@@ -1374,6 +1453,16 @@ int main(int argc, char **argv) {
         FD_ZERO(&sset);
         FD_SET(idata.fd, &sset);
 
+        if (compile_filters(&filters) == FAILURE) {
+            puts("Error while compiling the address filters");
+            exit(EXIT_FAILURE);
+        }
+
+        if (set_filters_bpf(&idata, &filters, PCAP_TCPIPV6_NS_FILTER) == FAILURE) {
+            puts("Error while pushing the address filters into the capture filter");
+            exit(EXIT_FAILURE);
+        }
+
         if (idata.verbose_f) {
             print_filters(&idata, &filters);
             puts("Listening to incoming IPv6 messages...");
@@ -1435,29 +1524,27 @@ int main(int argc, char **argv) {
 #else
             if (TRUE) {
 #endif
-                /* Read a packet */
-                if ((r = pcap_next_ex(idata.pfd, &pkthdr, &pktdata)) == -1) {
-                    printf("pcap_next_ex(): %s", pcap_geterr(idata.pfd));
-                    exit(EXIT_FAILURE);
-                }
-                else if (r == 1 && pktdata != NULL) {
-                    pkt_ether = (struct ether_header *)pktdata;
-                    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata.linkhsize);
-                    pkt_tcp = (struct tcp_hdr *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
-                    pkt_ns = (struct nd_neighbor_solicit *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
-                    pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
+                /* Drain all the packets that are available, rather than processing one per loop turn */
+                while ((r = read_frame(&idata, &pkthdr, &pktdata)) == 1) {
+                    if (pktdata == NULL)
+                        continue;
 
-                    /* Check that we are able to look into the IPv6 header */
-                    if ((pkt_end - pktdata) < (idata.linkhsize + MIN_IPV6_HLEN))
+                    /* Walk the headers of the packet (and verify the TCP or ICMPv6 checksum) */
+                    if (dissect_packet(&idata, pktdata, pkthdr, &pview, DISSECT_CKSUM) == FAILURE)
                         continue;
 
+                    pkt_ether = (struct ether_header *)pktdata;
+                    pkt_ipv6 = pview.ipv6;
+                    pkt_tcp = (struct tcp_hdr *)pview.upper;
+                    pkt_ns = (struct nd_neighbor_solicit *)pview.upper;
+                    pkt_end = pview.end;
+
                     accepted_f = 0;
 
                     if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK)) {
                         if (filters.nblocklinksrc) {
                             if (match_ether(filters.blocklinksrc, filters.nblocklinksrc, &(pkt_ether->src))) {
-                                if (idata.verbose_f > 1)
-                                    print_filter_result(&idata, pktdata, BLOCKED);
+                                report_filter_result(&idata, pktdata, BLOCKED);
 
                                 continue;
                             }
@@ -1465,29 +1552,24 @@ int main(int argc, char **argv) {
 
                         if (filters.nblocklinkdst) {
                             if (match_ether(filters.blocklinkdst, filters.nblocklinkdst, &(pkt_ether->dst))) {
-                                if (idata.verbose_f > 1)
-                                    print_filter_result(&idata, pktdata, BLOCKED);
+                                report_filter_result(&idata, pktdata, BLOCKED);
 
                                 continue;
                             }
                         }
                     }
 
-                    if (filters.nblocksrc) {
-                        if (match_ipv6(filters.blocksrc, filters.blocksrclen, filters.nblocksrc,
-                                       &(pkt_ipv6->ip6_src))) {
-                            if (idata.verbose_f > 1)
-                                print_filter_result(&idata, pktdata, BLOCKED);
+                    if (filters.blocksrctrie.nprefix) {
+                        if (match_prefix_trie(&(filters.blocksrctrie), &(pkt_ipv6->ip6_src))) {
+                            report_filter_result(&idata, pktdata, BLOCKED);
 
                             continue;
                         }
                     }
 
-                    if (filters.nblockdst) {
-                        if (match_ipv6(filters.blockdst, filters.blockdstlen, filters.nblockdst,
-                                       &(pkt_ipv6->ip6_dst))) {
-                            if (idata.verbose_f > 1)
-                                print_filter_result(&idata, pktdata, BLOCKED);
+                    if (filters.blockdsttrie.nprefix) {
+                        if (match_prefix_trie(&(filters.blockdsttrie), &(pkt_ipv6->ip6_dst))) {
+                            report_filter_result(&idata, pktdata, BLOCKED);
 
                             continue;
                         }
@@ -1505,33 +1587,28 @@ int main(int argc, char **argv) {
                         }
                     }
 
-                    if (filters.nacceptsrc && !accepted_f) {
-                        if (match_ipv6(filters.acceptsrc, filters.acceptsrclen, filters.nacceptsrc,
-                                       &(pkt_ipv6->ip6_src)))
+                    if (filters.acceptsrctrie.nprefix && !accepted_f) {
+                        if (match_prefix_trie(&(filters.acceptsrctrie), &(pkt_ipv6->ip6_src)))
                             accepted_f = 1;
                     }
 
-                    if (filters.nacceptdst && !accepted_f) {
-                        if (match_ipv6(filters.acceptdst, filters.acceptdstlen, filters.nacceptdst,
-                                       &(pkt_ipv6->ip6_dst)))
+                    if (filters.acceptdsttrie.nprefix && !accepted_f) {
+                        if (match_prefix_trie(&(filters.acceptdsttrie), &(pkt_ipv6->ip6_dst)))
                             accepted_f = 1;
                     }
 
                     if (filters.acceptfilters_f && !accepted_f) {
-                        if (idata.verbose_f > 1)
-                            print_filter_result(&idata, pktdata, BLOCKED);
+                        report_filter_result(&idata, pktdata, BLOCKED);
 
                         continue;
                     }
 
+                    count_filter_result(&idata, ACCEPTED);
+
                     if (idata.verbose_f > 1)
                         print_filter_result(&idata, pktdata, ACCEPTED);
 
-                    if (pkt_ipv6->ip6_nxt == IPPROTO_TCP) {
-                        /* Check that we are able to look into the TCP header */
-                        if ((pkt_end - pktdata) < (idata.linkhsize + MIN_IPV6_HLEN + sizeof(struct tcp_hdr))) {
-                            continue;
-                        }
+                    if (pview.proto == IPPROTO_TCP && (pview.flags & PV_CKSUM_OK)) {
 
                         if (idata.dstaddr_f) {
                             if (!floods_f) {
@@ -1567,10 +1644,6 @@ int main(int argc, char **argv) {
                                 }
                             }
 
-                            /* The TCP checksum must be valid */
-                            if (in_chksum(pkt_ipv6, pkt_tcp, pkt_end - ((unsigned char *)pkt_tcp), IPPROTO_TCP) != 0)
-                                continue;
-
                             if (pkt_tcp->th_sport != htons(dstport)) {
                                 continue;
                             }
@@ -1580,13 +1653,16 @@ int main(int argc, char **argv) {
                             }
                         }
 
+                        /* Without floods, there is a single outstanding probe: that of the last probe interval */
+                        if (idata.metrics != NULL && idata.dstaddr_f && !floods_f && lastprobe.tv_sec)
+                            record_latency(idata.metrics, &lastprobe, &(pkthdr->ts));
+
                         /* Send a TCP segment */
                         send_packet(&idata, pktdata, pkthdr);
                     }
-                    else if (pkt_ipv6->ip6_nxt == IPPROTO_ICMPV6) {
+                    else if (pview.proto == IPPROTO_ICMPV6 && pview.nexthdrs == 0) {
                         /* Check that we are able to look into the NS header */
-                        if ((pkt_end - pktdata) <
-                            (idata.linkhsize + MIN_IPV6_HLEN + sizeof(struct nd_neighbor_solicit))) {
+                        if (pview.upperlen < sizeof(struct nd_neighbor_solicit)) {
                             continue;
                         }
 
@@ -1620,6 +1696,15 @@ int main(int argc, char **argv) {
                         }
                     }
                 }
+
+                if (r == -1) {
+                    printf("pcap_next_ex(): %s", pcap_geterr(idata.pfd));
+                    exit(EXIT_FAILURE);
+                }
+                else if (r == PCAP_ERROR_BREAK) {
+                    /* End of the savefile (see open_rx_replay()) */
+                    break;
+                }
             }
 
             if (idata.dstaddr_f && !donesending_f && is_time_elapsed(&curtime, &lastprobe, pktinterval)) {
@@ -1769,16 +1854,11 @@ void send_packet(struct iface_data *idata, const u_char *pktdata, struct pcap_pk
     senddata_f = 0;
 
     if (pktdata != NULL) { /* Sending a TCP segment in response to a received packet */
+        /* The received segment has already been dissected (into pview) by the caller */
         pkt_ether = (struct ether_header *)pktdata;
-        pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata->linkhsize);
-        pkt_tcp = (struct tcp_hdr *)((char *)pkt_ipv6 + sizeof(struct ip6_hdr));
-        pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
-
-        /* The packet length is the minimum of what we capured, and what is specified in the
-           IPv6 Total Lenght field
-         */
-        if (pkt_end > ((unsigned char *)pkt_ipv6 + sizeof(struct ip6_hdr) + ntohs(pkt_ipv6->ip6_plen)))
-            pkt_end = (unsigned char *)pkt_ipv6 + sizeof(struct ip6_hdr) + ntohs(pkt_ipv6->ip6_plen);
+        pkt_ipv6 = pview.ipv6;
+        pkt_tcp = (struct tcp_hdr *)pview.upper;
+        pkt_end = pview.end;
 
         pkt_ipv6addr = &(pkt_ipv6->ip6_src);
 
@@ -2159,6 +2239,19 @@ void send_packet(struct iface_data *idata, const u_char *pktdata, struct pcap_pk
             }
         }
 
+        if (tmpl_f) {
+            if (send_template_frames(idata, &tmpl, 1) == FAILURE) {
+                if (tx_dump_stopped())
+                    exit(EXIT_SUCCESS);
+
+                printf("Error while sending packets: %s\n", send_frame_error(idata));
+                exit(EXIT_FAILURE);
+            }
+
+            ports++;
+            return;
+        }
+
         if ((ptr + sizeof(struct tcp_hdr)) > (v6buffer + idata->max_packet_size)) {
             puts("Packet Too Large while inserting TCP header");
             exit(EXIT_FAILURE);
@@ -2172,7 +2265,7 @@ void send_packet(struct iface_data *idata, const u_char *pktdata, struct pcap_pk
                 randomize_port(&srcport, srcport, srcportpref);
             }
             else {
-                srcport = random();
+                srcport = prng_random32();
             }
         }
 
@@ -2181,7 +2274,7 @@ void send_packet(struct iface_data *idata, const u_char *pktdata, struct pcap_pk
         tcp->th_seq = htonl(tcpseq);
 
         if (!tcpack_f && (tcpflags & TH_ACK)) {
-            tcp->th_ack = htonl(random());
+            tcp->th_ack = htonl(prng_random32());
         }
 
         if (tcpflags_auto_f || tcpopen_f || tcpclose_f) {
@@ -2220,21 +2313,7 @@ void send_packet(struct iface_data *idata, const u_char *pktdata, struct pcap_pk
                "srcaddr" and srcpreflen.
              */
 
-            randomize_ipv6_addr(&(ipv6->ip6_src), &(idata->srcaddr), idata->srcpreflen);
-
-            /*
-               If we need to respond to incomming packets, we set the Interface ID such that we can
-               detect which IPv6 addresses we have used.
-             */
-            if (listen_f && useaddrkey_f) {
-                ipv6->ip6_src.s6_addr32[2] = ntohl((uint32_t)random() << 16);
-                ipv6->ip6_src.s6_addr32[2] =
-                    htonl(ntohl(ipv6->ip6_src.s6_addr32[2]) | ((ntohl(ipv6->ip6_src.s6_addr32[2]) >> 16) ^ addr_key));
-
-                ipv6->ip6_src.s6_addr32[3] = ntohl((uint32_t)random() << 16);
-                ipv6->ip6_src.s6_addr32[3] = htonl(ntohl(ipv6->ip6_src.s6_addr32[3]) |
-                                                   (uint32_t)((ntohl(ipv6->ip6_src.s6_addr32[3]) >> 16) ^ addr_key));
-            }
+            flood_src_addr((unsigned char *)&(ipv6->ip6_src), sizeof(struct in6_addr), idata);
         }
 
         tcp->th_sum = 0;
@@ -2242,12 +2321,81 @@ void send_packet(struct iface_data *idata, const u_char *pktdata, struct pcap_pk
 
         frag_and_send(idata);
 
+        /* The following packets only differ in a few fields, which are patched into a copy of this one */
+        if (!idata->fragh_f)
+            init_flood_template(idata);
+
         ports++;
 
         return;
     }
 }
 
+/*
+ * Function: init_flood_template()
+ *
+ * Builds the template for the flood packets from the packet that send_packet() has just sent. Only the fields
+ * that change from one packet to the next (Source Port, IPv6 Source Address, Acknowledgement Number) are rewritten
+ * for the subsequent packets, and the TCP checksum is patched accordingly.
+ */
+void init_flood_template(struct iface_data *idata) {
+    if (init_packet_template(&tmpl, buffer, ptr - buffer, (unsigned char *)&(tcp->th_sum) - buffer) == FAILURE)
+        return;
+
+    if (floodp_f) {
+        if (srcportrnd_f) {
+            srcportprefix.port = srcport;
+            srcportprefix.len = srcportpref;
+
+            if (add_template_field(&tmpl, (unsigned char *)&(tcp->th_sport) - buffer, sizeof(uint16_t),
+                                   template_random_port, &srcportprefix, 1, TRUE) == FAILURE)
+                return;
+        }
+        else if (add_template_field(&tmpl, (unsigned char *)&(tcp->th_sport) - buffer, sizeof(uint16_t),
+                                    template_random_bytes, NULL, 1, TRUE) == FAILURE) {
+            return;
+        }
+    }
+
+    if (!tcpack_f && (tcpflags & TH_ACK)) {
+        if (add_template_field(&tmpl, (unsigned char *)&(tcp->th_ack) - buffer, sizeof(tcp->th_ack),
+                               template_random_bytes, NULL, 1, TRUE) == FAILURE)
+            return;
+    }
+
+    if (floods_f) {
+        if (add_template_field(&tmpl, (unsigned char *)&(ipv6->ip6_src) - buffer, sizeof(struct in6_addr),
+                               flood_src_addr, idata, nports, TRUE) == FAILURE)
+            return;
+    }
+
+    tmpl_f = TRUE;
+}
+
+/*
+ * Function: flood_src_addr()
+ *
+ * Packet template generator for the IPv6 Source Address of the flood packets: a random address from the source
+ * prefix. If we need to respond to incomming packets, the Interface ID is set such that we can detect which IPv6
+ * addresses we have used.
+ */
+void flood_src_addr(unsigned char *field, unsigned int len, void *arg) {
+    struct iface_data *idata = arg;
+    struct in6_addr addr;
+
+    randomize_ipv6_addr(&addr, &(idata->srcaddr), idata->srcpreflen);
+
+    if (listen_f && useaddrkey_f) {
+        addr.s6_addr32[2] = ntohl(prng_random32() << 16);
+        addr.s6_addr32[2] = htonl(ntohl(addr.s6_addr32[2]) | ((ntohl(addr.s6_addr32[2]) >> 16) ^ addr_key));
+
+        addr.s6_addr32[3] = ntohl(prng_random32() << 16);
+        addr.s6_addr32[3] = htonl(ntohl(addr.s6_addr32[3]) | (uint32_t)((ntohl(addr.s6_addr32[3]) >> 16) ^ addr_key));
+    }
+
+    memcpy(field, &addr, (len < sizeof(addr)) ? len : sizeof(addr));
+}
+
 /*
  * Function: frag_and_send()
  *
@@ -2257,13 +2405,16 @@ void frag_and_send(struct iface_data *idata) {
     if (!idata->fragh_f) {
         ipv6->ip6_plen = htons((ptr - v6buffer) - MIN_IPV6_HLEN);
 
-        if ((nw = pcap_inject(idata->pfd, buffer, ptr - buffer)) == -1) {
-            printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+        if ((nw = send_frame(idata, buffer, ptr - buffer)) == -1) {
+            if (tx_dump_stopped())
+                exit(EXIT_SUCCESS);
+
+            printf("send_frame(): %s\n", send_frame_error(idata));
             exit(EXIT_FAILURE);
         }
 
         if (nw != (ptr - buffer)) {
-            printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+            printf("send_frame(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
             exit(EXIT_FAILURE);
         }
     }
@@ -2283,7 +2434,7 @@ void frag_and_send(struct iface_data *idata) {
 
         memcpy(fptr, (char *)&fraghdr, FRAG_HDR_SIZE);
         fh = (struct ip6_frag *)fptr;
-        fh->ip6f_ident = random();
+        fh->ip6f_ident = prng_random32();
         startoffragment = fptr + FRAG_HDR_SIZE;
 
         /*
@@ -2314,17 +2465,28 @@ void frag_and_send(struct iface_data *idata) {
 
             fipv6->ip6_plen = htons((fptr - fragbuffer) - MIN_IPV6_HLEN - idata->linkhsize);
 
-            if ((nw = pcap_inject(idata->pfd, fragbuffer, fptr - fragbuffer)) == -1) {
-                printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+            if ((nw = send_frame(idata, fragbuffer, fptr - fragbuffer)) == -1) {
+                if (tx_dump_stopped())
+                    exit(EXIT_SUCCESS);
+
+                printf("send_frame(): %s\n", send_frame_error(idata));
                 exit(EXIT_FAILURE);
             }
 
             if (nw != (fptr - fragbuffer)) {
-                printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+                printf("send_frame(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
                 exit(EXIT_FAILURE);
             }
         } /* Sending fragments */
     } /* Sending fragmented datagram */
+
+    if (flush_tx_batch(idata) == -1) {
+        if (tx_dump_stopped())
+            exit(EXIT_SUCCESS);
+
+        printf("Error while sending packets: %s\n", send_frame_error(idata));
+        exit(EXIT_FAILURE);
+    }
 }
 
 /*
@@ -2341,7 +2503,8 @@ void usage(void) {
          "[-M WIN_MOD_MODE] [-r RATE] [-p PROBE_MODE] [-x RETRANS] "
          "[-N] [-n] [-j PREFIX[/LEN]] [-k PREFIX[/LEN]] [-J LINK_ADDR] [-K LINK_ADDR] "
          "[-b PREFIX[/LEN]] [-g PREFIX[/LEN]] [-B LINK_ADDR] [-G LINK_ADDR] "
-         "[-F N_SOURCES] [-T N_PORTS] [-L | -l] [-z SECONDS] [-v] [-h]");
+         "[-F N_SOURCES] [-T N_PORTS] [-L | -l] [-z SECONDS] [-Y PCAP_FILE | --dry-run] "
+         "[--read-pcap PCAP_FILE] [--stats-interval SECONDS] [-v] [-h]");
 }
 
 /*
@@ -2392,12 +2555,17 @@ void print_help(void) {
          "  --accept-dst, -g          Accept IPv6 Destination Address prefix\n"
          "  --accept-link-src, -B     Accept Ethernet Source Address\n"
          "  --accept-link-dst, -G     Accept Ethernet Destination Address\n"
+         "  --filter-file             Load address filters from a file\n"
          "  --flood-sources, -F       Flood from multiple IPv6 Source Addresses\n"
          "  --flood-ports, -T         Flood from multiple TCP Source Ports\n"
          "  --listen, -L              Listen to incoming packets\n"
          "  --loop, -l                Send periodic TCP segments\n"
          "  --sleep, -z               Pause between sending TCP segments\n"
          "  --help, -h                Print help for the tcp6 tool\n"
+         "  --write-pcap, -Y          Write the packets to a pcap savefile, rather than sending them\n"
+         "  --dry-run                 Discard the packets, rather than sending them\n"
+         "  --read-pcap               Read the incoming packets from a pcap savefile\n"
+         "  --stats-interval          Print the runtime metrics every SECONDS (and as JSON at exit)\n"
          "  --verbose, -v             Be verbose\n"
          "\n"
          "Programmed by Fernando Gont for SI6 Networks <https://www.si6networks.com>\n"
@@ -2992,36 +3160,16 @@ int tcp_output(struct iface_data *idata, struct tcp *tcb, struct packet *packet,
  */
 
 int is_valid_tcp_segment(struct iface_data *idata, const u_char *pktdata, struct pcap_pkthdr *pkthdr) {
-    struct ether_header *pkt_ether;
+    struct packet_view view;
     struct ip6_hdr *pkt_ipv6;
-    struct tcp_hdr *pkt_tcp;
-    unsigned char *pkt_end;
-
-    pkt_ether = (struct ether_header *)pktdata;
-    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata->linkhsize);
-    pkt_tcp = (struct tcp_hdr *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
 
-    pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
-
-    /* XXX: We are assuming no extension headers on incoming packets -- this should be improved! */
-
-    /* The packet length is the minimum of what we capured, and what is specified in the
-       IPv6 Total Lenght field
-     */
-    if (pkt_end > ((unsigned char *)pkt_tcp + ntohs(pkt_ipv6->ip6_plen)))
-        pkt_end = (unsigned char *)pkt_tcp + ntohs(pkt_ipv6->ip6_plen);
-
-    /*
-       Discard the packet if it is not of the minimum size to contain a TCP header
-     */
-    if ((pkt_end - (unsigned char *)pkt_tcp) < sizeof(struct tcp_hdr)) {
+    /* The segment must be complete (not a fragment), and its TCP checksum must be correct */
+    if (dissect_packet(idata, pktdata, pkthdr, &view, DISSECT_CKSUM) == FAILURE || view.proto != IPPROTO_TCP ||
+        !(view.flags & PV_CKSUM_OK)) {
         return FALSE;
     }
 
-    /* Check that the TCP checksum is correct */
-    if (in_chksum(pkt_ipv6, pkt_tcp, pkt_end - ((unsigned char *)pkt_tcp), IPPROTO_TCP) != 0) {
-        return FALSE;
-    }
+    pkt_ipv6 = view.ipv6;
 
     /* XXX: Should perform additional checks on the IPv6 header */
     /*
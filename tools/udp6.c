@@ -61,7 +61,9 @@ void print_attack_info(struct iface_data *);
 void usage(void);
 void print_help(void);
 void frag_and_send(struct iface_data *);
-int is_valid_udp_datagram(struct iface_data *, const u_char *, struct pcap_pkthdr *);
+void init_flood_template(struct iface_data *);
+void flood_src_addr(unsigned char *, unsigned int, void *);
+int is_valid_udp_datagram(struct packet_view *);
 
 /* Flags */
 unsigned char floodt_f = 0;
@@ -87,6 +89,7 @@ struct iface_data idata;
 /* Data structures for packets read from the wire */
 struct pcap_pkthdr *pkthdr;
 const u_char *pktdata;
+struct packet_view pview;
 unsigned char *pkt_end;
 struct ether_header *pkt_ether;
 struct nd_neighbor_solicit *pkt_ns;
@@ -131,6 +134,11 @@ uint16_t mask;
 uint8_t hoplimit;
 uint16_t addr_key;
 
+/* Template for the flood packets (see init_flood_template()) */
+struct packet_template tmpl;
+unsigned char tmpl_f = 0;
+struct port_prefix srcportprefix;
+
 char plinkaddr[ETHER_ADDR_PLEN];
 char psrcaddr[INET6_ADDRSTRLEN], pdstaddr[INET6_ADDRSTRLEN], pv6addr[INET6_ADDRSTRLEN];
 
@@ -187,6 +195,7 @@ int main(int argc, char **argv) {
                                        {"accept-dst-addr", required_argument, 0, 'g'},
                                        {"accept-link-src-addr", required_argument, 0, 'B'},
                                        {"accept-link-dst-addr", required_argument, 0, 'G'},
+                                       {"filter-file", required_argument, 0, 'I'},
                                        {"flood-sources", required_argument, 0, 'F'},
                                        {"flood-ports", required_argument, 0, 'T'},
                                        {"loop", no_argument, 0, 'l'},
@@ -701,6 +710,14 @@ int main(int argc, char **argv) {
             filters.acceptfilters_f = 1;
             break;
 
+        case 'I': /* Address filters from a file */
+            if (load_filter_file(&filters, optarg) == FAILURE) {
+                printf("Error while loading address filters from file %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+
+            break;
+
         case 'F': /* Flood source addresses */
             nsources = atoi(optarg);
             if (nsources == 0) {
@@ -846,6 +863,11 @@ int main(int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
 
+    if (init_tx_batch(&idata, TX_BATCH_SIZE) == FAILURE) {
+        puts("Error while initializing batched transmission");
+        exit(EXIT_FAILURE);
+    }
+
     release_privileges();
 
     if (data_f) {
@@ -1048,20 +1070,14 @@ int main(int argc, char **argv) {
                     exit(EXIT_FAILURE);
                 }
                 else if (r == 1 && pktdata != NULL) {
-                    pkt_ether = (struct ether_header *)pktdata;
-                    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata.linkhsize);
-                    pkt_udp = (struct udp_hdr *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
-                    pkt_ns = (struct nd_neighbor_solicit *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
-                    pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
-
-                    /* Some preliminar sanity checks. */
-                    /* XXX: Might need/could remove some of the checks below */
-                    if (!is_valid_udp_datagram(&idata, pktdata, pkthdr))
+                    if (dissect_packet(&idata, pktdata, pkthdr, &pview, DISSECT_CKSUM) == FAILURE ||
+                        !is_valid_udp_datagram(&pview))
                         continue;
 
-                    /* Check that we are able to look into the IPv6 header */
-                    if ((pkt_end - pktdata) < (idata.linkhsize + MIN_IPV6_HLEN))
-                        continue;
+                    pkt_ether = (struct ether_header *)pktdata;
+                    pkt_ipv6 = pview.ipv6;
+                    pkt_udp = (struct udp_hdr *)pview.upper;
+                    pkt_end = pview.end;
 
                     if (is_eq_in6_addr(&(pkt_ipv6->ip6_src), &(idata.srcaddr))) {
                         continue;
@@ -1079,10 +1095,6 @@ int main(int argc, char **argv) {
                         continue;
                     }
 
-                    /* The UDP checksum must be valid */
-                    if (in_chksum(pkt_ipv6, pkt_udp, pkt_end - ((unsigned char *)pkt_udp), IPPROTO_UDP) != 0)
-                        continue;
-
                     printf("RESPONSE:UDP6\n");
                     exit(EXIT_SUCCESS);
                 }
@@ -1139,6 +1151,16 @@ int main(int argc, char **argv) {
         FD_ZERO(&sset);
         FD_SET(idata.fd, &sset);
 
+        if (compile_filters(&filters) == FAILURE) {
+            puts("Error while compiling the address filters");
+            exit(EXIT_FAILURE);
+        }
+
+        if (set_filters_bpf(&idata, &filters, PCAP_UDPIPV6_NS_FILTER) == FAILURE) {
+            puts("Error while pushing the address filters into the capture filter");
+            exit(EXIT_FAILURE);
+        }
+
         if (idata.verbose_f) {
             print_filters(&idata, &filters);
             puts("Listening to incoming UDP datagrams...");
@@ -1192,16 +1214,16 @@ int main(int argc, char **argv) {
                     exit(EXIT_FAILURE);
                 }
                 else if (r == 1 && pktdata != NULL) {
-                    pkt_ether = (struct ether_header *)pktdata;
-                    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata.linkhsize);
-                    pkt_udp = (struct udp_hdr *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
-                    pkt_ns = (struct nd_neighbor_solicit *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
-                    pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
-
-                    /* Check that we are able to look into the IPv6 header */
-                    if ((pkt_end - pktdata) < (idata.linkhsize + MIN_IPV6_HLEN))
+                    /* Walk the headers of the packet (and verify the UDP or ICMPv6 checksum) */
+                    if (dissect_packet(&idata, pktdata, pkthdr, &pview, DISSECT_CKSUM) == FAILURE)
                         continue;
 
+                    pkt_ether = (struct ether_header *)pktdata;
+                    pkt_ipv6 = pview.ipv6;
+                    pkt_udp = (struct udp_hdr *)pview.upper;
+                    pkt_ns = (struct nd_neighbor_solicit *)pview.upper;
+                    pkt_end = pview.end;
+
                     accepted_f = 0;
 
                     if (idata.type == DLT_EN10MB && !(idata.flags & IFACE_LOOPBACK)) {
@@ -1224,9 +1246,8 @@ int main(int argc, char **argv) {
                         }
                     }
 
-                    if (filters.nblocksrc) {
-                        if (match_ipv6(filters.blocksrc, filters.blocksrclen, filters.nblocksrc,
-                                       &(pkt_ipv6->ip6_src))) {
+                    if (filters.blocksrctrie.nprefix) {
+                        if (match_prefix_trie(&(filters.blocksrctrie), &(pkt_ipv6->ip6_src))) {
                             if (idata.verbose_f > 1)
                                 print_filter_result(&idata, pktdata, BLOCKED);
 
@@ -1234,9 +1255,8 @@ int main(int argc, char **argv) {
                         }
                     }
 
-                    if (filters.nblockdst) {
-                        if (match_ipv6(filters.blockdst, filters.blockdstlen, filters.nblockdst,
-                                       &(pkt_ipv6->ip6_dst))) {
+                    if (filters.blockdsttrie.nprefix) {
+                        if (match_prefix_trie(&(filters.blockdsttrie), &(pkt_ipv6->ip6_dst))) {
                             if (idata.verbose_f > 1)
                                 print_filter_result(&idata, pktdata, BLOCKED);
 
@@ -1256,15 +1276,13 @@ int main(int argc, char **argv) {
                         }
                     }
 
-                    if (filters.nacceptsrc && !accepted_f) {
-                        if (match_ipv6(filters.acceptsrc, filters.acceptsrclen, filters.nacceptsrc,
-                                       &(pkt_ipv6->ip6_src)))
+                    if (filters.acceptsrctrie.nprefix && !accepted_f) {
+                        if (match_prefix_trie(&(filters.acceptsrctrie), &(pkt_ipv6->ip6_src)))
                             accepted_f = 1;
                     }
 
-                    if (filters.nacceptdst && !accepted_f) {
-                        if (match_ipv6(filters.acceptdst, filters.acceptdstlen, filters.nacceptdst,
-                                       &(pkt_ipv6->ip6_dst)))
+                    if (filters.acceptdsttrie.nprefix && !accepted_f) {
+                        if (match_prefix_trie(&(filters.acceptdsttrie), &(pkt_ipv6->ip6_dst)))
                             accepted_f = 1;
                     }
 
@@ -1278,16 +1296,9 @@ int main(int argc, char **argv) {
                     if (idata.verbose_f > 1)
                         print_filter_result(&idata, pktdata, ACCEPTED);
 
-                    if (pkt_ipv6->ip6_nxt == IPPROTO_UDP) {
-                        /* Some preliminar sanity checks. */
-                        /* XXX: Might need/could remove some of the checks below */
-                        if (!is_valid_udp_datagram(&idata, pktdata, pkthdr))
-                            continue;
-
-                        /* Check that we are able to look into the UDP header */
-                        if ((pkt_end - pktdata) < (idata.linkhsize + MIN_IPV6_HLEN + sizeof(struct udp_hdr))) {
+                    if (pview.proto == IPPROTO_UDP) {
+                        if (!is_valid_udp_datagram(&pview))
                             continue;
-                        }
 
                         if (idata.dstaddr_f) {
                             if (!floods_f) {
@@ -1323,10 +1334,6 @@ int main(int argc, char **argv) {
                                 }
                             }
 
-                            /* The UDP checksum must be valid */
-                            if (in_chksum(pkt_ipv6, pkt_udp, pkt_end - ((unsigned char *)pkt_udp), IPPROTO_UDP) != 0)
-                                continue;
-
                             if (pkt_udp->uh_sport != htons(dstport)) {
                                 continue;
                             }
@@ -1339,11 +1346,9 @@ int main(int argc, char **argv) {
                         /* Send a UDP datagram */
                         send_packet(&idata, pktdata, pkthdr);
                     }
-                    else if (pkt_ipv6->ip6_nxt == IPPROTO_ICMPV6) {
-
+                    else if (pview.proto == IPPROTO_ICMPV6 && pview.nexthdrs == 0 && (pview.flags & PV_CKSUM_OK)) {
                         /* Check that we are able to look into the NS header */
-                        if ((pkt_end - pktdata) <
-                            (idata.linkhsize + MIN_IPV6_HLEN + sizeof(struct nd_neighbor_solicit))) {
+                        if (pview.upperlen < sizeof(struct nd_neighbor_solicit)) {
                             continue;
                         }
 
@@ -1524,16 +1529,11 @@ void send_packet(struct iface_data *idata, const u_char *pktdata, struct pcap_pk
     senddata_f = 0;
 
     if (pktdata != NULL) { /* Sending an UDP datagram in response to a received packet */
+        /* The received datagram has already been dissected (into pview) by the caller */
         pkt_ether = (struct ether_header *)pktdata;
-        pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata->linkhsize);
-        pkt_udp = (struct udp_hdr *)((char *)pkt_ipv6 + sizeof(struct ip6_hdr));
-        pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
-
-        /* The packet length is the minimum of what we capured, and what is specified in the
-           IPv6 Total Lenght field
-         */
-        if (pkt_end > ((unsigned char *)pkt_ipv6 + sizeof(struct ip6_hdr) + ntohs(pkt_ipv6->ip6_plen)))
-            pkt_end = (unsigned char *)pkt_ipv6 + sizeof(struct ip6_hdr) + ntohs(pkt_ipv6->ip6_plen);
+        pkt_ipv6 = pview.ipv6;
+        pkt_udp = (struct udp_hdr *)pview.upper;
+        pkt_end = pview.end;
 
         pkt_ipv6addr = &(pkt_ipv6->ip6_src);
 
@@ -1634,6 +1634,16 @@ void send_packet(struct iface_data *idata, const u_char *pktdata, struct pcap_pk
             }
         }
 
+        if (tmpl_f) {
+            if (send_template_frames(idata, &tmpl, 1) == FAILURE) {
+                puts("Error while sending packets");
+                exit(EXIT_FAILURE);
+            }
+
+            ports++;
+            return;
+        }
+
         if ((ptr + sizeof(struct udp_hdr)) > (v6buffer + idata->max_packet_size)) {
             puts("Packet Too Large while inserting UDP header");
             exit(EXIT_FAILURE);
@@ -1694,21 +1704,7 @@ void send_packet(struct iface_data *idata, const u_char *pktdata, struct pcap_pk
                "srcaddr" and srcpreflen.
              */
 
-            randomize_ipv6_addr(&(ipv6->ip6_src), &(idata->srcaddr), idata->srcpreflen);
-
-            /*
-               If we need to respond to incomming packets, we set the Interface ID such that we can
-               detect which IPv6 addresses we have used.
-             */
-            if (listen_f && useaddrkey_f) {
-                ipv6->ip6_src.s6_addr32[2] = ntohl((uint32_t)random() << 16);
-                ipv6->ip6_src.s6_addr32[2] =
-                    htonl(ntohl(ipv6->ip6_src.s6_addr32[2]) | ((ntohl(ipv6->ip6_src.s6_addr32[2]) >> 16) ^ addr_key));
-
-                ipv6->ip6_src.s6_addr32[3] = ntohl((uint32_t)random() << 16);
-                ipv6->ip6_src.s6_addr32[3] = htonl(ntohl(ipv6->ip6_src.s6_addr32[3]) |
-                                                   (uint32_t)((ntohl(ipv6->ip6_src.s6_addr32[3]) >> 16) ^ addr_key));
-            }
+            flood_src_addr((unsigned char *)&(ipv6->ip6_src), sizeof(struct in6_addr), idata);
 
             if (idata->type == DLT_EN10MB && !(idata->flags & IFACE_LOOPBACK) && !(idata->hsrcaddr_f)) {
                 for (i = 0; i < 6; i++)
@@ -1721,12 +1717,81 @@ void send_packet(struct iface_data *idata, const u_char *pktdata, struct pcap_pk
 
         frag_and_send(idata);
 
+        /* The following packets only differ in a few fields, which are patched into a copy of this one */
+        if (!idata->fragh_f)
+            init_flood_template(idata);
+
         ports++;
 
         return;
     }
 }
 
+/*
+ * Function: init_flood_template()
+ *
+ * Builds the template for the flood packets from the packet that send_packet() has just sent. Only the fields
+ * that change from one packet to the next (Source Port, IPv6 Source Address, Ethernet Source Address) are rewritten
+ * for the subsequent packets, and the UDP checksum is patched accordingly.
+ */
+void init_flood_template(struct iface_data *idata) {
+    if (init_packet_template(&tmpl, buffer, ptr - buffer, (unsigned char *)&(udp->uh_sum) - buffer) == FAILURE)
+        return;
+
+    if (floodp_f) {
+        if (srcportrnd_f) {
+            srcportprefix.port = srcport;
+            srcportprefix.len = srcportpref;
+
+            if (add_template_field(&tmpl, (unsigned char *)&(udp->uh_sport) - buffer, sizeof(uint16_t),
+                                   template_random_port, &srcportprefix, 1, TRUE) == FAILURE)
+                return;
+        }
+        else if (add_template_field(&tmpl, (unsigned char *)&(udp->uh_sport) - buffer, sizeof(uint16_t),
+                                    template_random_bytes, NULL, 1, TRUE) == FAILURE) {
+            return;
+        }
+    }
+
+    if (floods_f) {
+        if (add_template_field(&tmpl, (unsigned char *)&(ipv6->ip6_src) - buffer, sizeof(struct in6_addr),
+                               flood_src_addr, idata, nports, TRUE) == FAILURE)
+            return;
+
+        if (idata->type == DLT_EN10MB && !(idata->flags & IFACE_LOOPBACK) && !(idata->hsrcaddr_f)) {
+            if (add_template_field(&tmpl, (unsigned char *)&(ethernet->src) - buffer, sizeof(struct ether_addr),
+                                   template_random_bytes, NULL, nports, FALSE) == FAILURE)
+                return;
+        }
+    }
+
+    tmpl_f = TRUE;
+}
+
+/*
+ * Function: flood_src_addr()
+ *
+ * Packet template generator for the IPv6 Source Address of the flood packets: a random address from the source
+ * prefix. If we need to respond to incomming packets, the Interface ID is set such that we can detect which IPv6
+ * addresses we have used.
+ */
+void flood_src_addr(unsigned char *field, unsigned int len, void *arg) {
+    struct iface_data *idata = arg;
+    struct in6_addr addr;
+
+    randomize_ipv6_addr(&addr, &(idata->srcaddr), idata->srcpreflen);
+
+    if (listen_f && useaddrkey_f) {
+        addr.s6_addr32[2] = ntohl((uint32_t)random() << 16);
+        addr.s6_addr32[2] = htonl(ntohl(addr.s6_addr32[2]) | ((ntohl(addr.s6_addr32[2]) >> 16) ^ addr_key));
+
+        addr.s6_addr32[3] = ntohl((uint32_t)random() << 16);
+        addr.s6_addr32[3] = htonl(ntohl(addr.s6_addr32[3]) | (uint32_t)((ntohl(addr.s6_addr32[3]) >> 16) ^ addr_key));
+    }
+
+    memcpy(field, &addr, (len < sizeof(addr)) ? len : sizeof(addr));
+}
+
 /*
  * Function: frag_and_send()
  *
@@ -1736,13 +1801,13 @@ void frag_and_send(struct iface_data *idata) {
     if (!idata->fragh_f) {
         ipv6->ip6_plen = htons((ptr - v6buffer) - MIN_IPV6_HLEN);
 
-        if ((nw = pcap_inject(idata->pfd, buffer, ptr - buffer)) == -1) {
-            printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+        if ((nw = send_frame(idata, buffer, ptr - buffer)) == -1) {
+            printf("send_frame(): %s\n", send_frame_error(idata));
             exit(EXIT_FAILURE);
         }
 
         if (nw != (ptr - buffer)) {
-            printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+            printf("send_frame(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
             exit(EXIT_FAILURE);
         }
     }
@@ -1762,7 +1827,7 @@ void frag_and_send(struct iface_data *idata) {
 
         memcpy(fptr, (char *)&fraghdr, FRAG_HDR_SIZE);
         fh = (struct ip6_frag *)fptr;
-        fh->ip6f_ident = random();
+        fh->ip6f_ident = prng_random32();
         startoffragment = fptr + FRAG_HDR_SIZE;
 
         /*
@@ -1792,17 +1857,22 @@ void frag_and_send(struct iface_data *idata) {
 
             fipv6->ip6_plen = htons((fptr - fragbuffer) - MIN_IPV6_HLEN - idata->linkhsize);
 
-            if ((nw = pcap_inject(idata->pfd, fragbuffer, fptr - fragbuffer)) == -1) {
-                printf("pcap_inject(): %s\n", pcap_geterr(idata->pfd));
+            if ((nw = send_frame(idata, fragbuffer, fptr - fragbuffer)) == -1) {
+                printf("send_frame(): %s\n", send_frame_error(idata));
                 exit(EXIT_FAILURE);
             }
 
             if (nw != (fptr - fragbuffer)) {
-                printf("pcap_inject(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
+                printf("send_frame(): only wrote %d bytes (rather than %lu bytes)\n", nw, (LUI)(ptr - buffer));
                 exit(EXIT_FAILURE);
             }
         } /* Sending fragments */
     } /* Sending fragmented datagram */
+
+    if (flush_tx_batch(idata) == -1) {
+        printf("Error while sending packets: %s\n", send_frame_error(idata));
+        exit(EXIT_FAILURE);
+    }
 }
 
 /*
@@ -1855,6 +1925,7 @@ void print_help(void) {
          "  --accept-dst, -g          Accept IPv6 Destination Address prefix\n"
          "  --accept-link-src, -B     Accept Ethernet Source Address\n"
          "  --accept-link-dst, -G     Accept Ethernet Destination Address\n"
+         "  --filter-file             Load address filters from a file\n"
          "  --flood-sources, -F       Flood from multiple IPv6 Source Addresses\n"
          "  --flood-ports, -T         Flood from multiple UDP Source Ports\n"
          "  --listen, -L              Listen to incoming packets\n"
@@ -1996,45 +2067,25 @@ void print_attack_info(struct iface_data *idata) {
 /*
  * Function: is_valid_udp_datagram()
  *
- * Performs sanity checks on an incomming UDP/IPv6 segment
+ * Performs sanity checks on an incomming UDP/IPv6 datagram (already walked by dissect_packet())
  */
 
-int is_valid_udp_datagram(struct iface_data *idata, const u_char *pktdata, struct pcap_pkthdr *pkthdr) {
-    struct ether_header *pkt_ether;
+int is_valid_udp_datagram(struct packet_view *view) {
     struct ip6_hdr *pkt_ipv6;
     struct udp_hdr *pkt_udp;
-    unsigned char *pkt_end;
 
-    pkt_ether = (struct ether_header *)pktdata;
-    pkt_ipv6 = (struct ip6_hdr *)((char *)pkt_ether + idata->linkhsize);
-    pkt_udp = (struct udp_hdr *)((char *)pkt_ipv6 + MIN_IPV6_HLEN);
-
-    pkt_end = (unsigned char *)pktdata + pkthdr->caplen;
-
-    /* XXX: We are assuming no extension headers on incoming packets -- this should be improved! */
-
-    /* The packet length is the minimum of what we capured, and what is specified in the
-       IPv6 Total Lenght field
-     */
-    if (pkt_end > ((unsigned char *)pkt_udp + ntohs(pkt_ipv6->ip6_plen)))
-        pkt_end = (unsigned char *)pkt_udp + ntohs(pkt_ipv6->ip6_plen);
-
-    /*
-       Discard the packet if it is not of the minimum size to contain a UDP header
-     */
-    if ((pkt_end - (unsigned char *)pkt_udp) < sizeof(struct udp_hdr)) {
+    /* The datagram must be complete (not a fragment), and its UDP checksum must be correct */
+    if (view->proto != IPPROTO_UDP || !(view->flags & PV_CKSUM_OK)) {
         return FALSE;
     }
 
+    pkt_ipv6 = view->ipv6;
+    pkt_udp = (struct udp_hdr *)view->upper;
+
     /*
-       Discard the packet if it is not of the minimum size to contain a UDP header
+       Discard the packet if it is not of the minimum size to contain the whole UDP datagram
      */
-    if ((pkt_end - (unsigned char *)pkt_udp) < ntohs(pkt_udp->uh_ulen)) {
-        return FALSE;
-    }
-
-    /* Check that the UDP checksum is correct */
-    if (in_chksum(pkt_ipv6, pkt_udp, pkt_end - ((unsigned char *)pkt_udp), IPPROTO_UDP) != 0) {
+    if (view->upperlen < ntohs(pkt_udp->uh_ulen)) {
         return FALSE;
     }
 